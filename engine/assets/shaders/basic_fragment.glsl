@@ -16,8 +16,31 @@ out vec4 FragColor;
 
 uniform sampler2D uBaseColorTex;
 uniform vec4 uBaseColorFactor;
+
+// Variants (eshaders::program_variant) fix what the uniforms below switch:
+// TEXTURED / UNTEXTURED for uHasBaseColorTex, LIT / UNLIT for
+// uEnableLighting. Without them the uniform decides at runtime.
+#if defined(TEXTURED)
+const bool hasBaseColorTex = true;
+#elif defined(UNTEXTURED)
+const bool hasBaseColorTex = false;
+#else
 uniform bool uHasBaseColorTex;
+#define hasBaseColorTex uHasBaseColorTex
+#endif
+#if defined(LIT)
+const bool enableLighting = true;
+#elif defined(UNLIT)
+const bool enableLighting = false;
+#else
 uniform bool uEnableLighting;
+#define enableLighting uEnableLighting
+#endif
+// LOD cross-fade (erender::queue_lod_elements): > 0 keeps that share of a
+// 4x4 ordered dither, < 0 the rest of -uLodFade's share, 0 everything
+uniform float uLodFade;
+
+const int bayer[16] = int[16](0, 8, 2, 10, 12, 4, 14, 6, 3, 11, 1, 9, 15, 7, 13, 5);
 
 const vec3 lightDir = normalize(vec3(0.5, 1.0, 0.3));
 const vec3 ambientColor = vec3(0.3, 0.3, 0.35);
@@ -25,13 +48,19 @@ const vec3 lightColor = vec3(0.7, 0.7, 0.65);
 
 void main()
 {
+    if (uLodFade != 0.0) {
+        ivec2 p = ivec2(gl_FragCoord.xy) & 3;
+        float threshold = (float(bayer[p.y * 4 + p.x]) + 0.5) / 16.0;
+        if ((uLodFade > 0.0) != (threshold < abs(uLodFade))) discard;
+    }
+
     vec4 baseColor = uBaseColorFactor;
 
-    if (uHasBaseColorTex) {
+    if (hasBaseColorTex) {
         baseColor *= texture(uBaseColorTex, TexCoord);
     }
 
-    if (uEnableLighting) {
+    if (enableLighting) {
         float diff = max(dot(normalize(Normal), lightDir), 0.0);
         vec3 lighting = ambientColor + lightColor * diff;
         FragColor = vec4(baseColor.rgb * lighting, baseColor.a);
@@ -18,8 +18,13 @@ layout (location = 2) in vec2 aTexCoord; // glTF TEXCOORD_0
 
 uniform mat4 local;
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// Per-frame camera, shared by every program (eshaders::set_camera_look_at)
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+};
 
 out vec2 TexCoord;
 out vec3 Normal;
@@ -27,7 +32,7 @@ out vec3 Normal;
 void main()
 {
     mat4 world = model * local;
-    gl_Position = projection * view * world * vec4(aPos, 1.0);
+    gl_Position = viewProjection * world * vec4(aPos, 1.0);
     TexCoord = aTexCoord;
     Normal = mat3(transpose(inverse(world))) * aNormal;
 }
\ No newline at end of file
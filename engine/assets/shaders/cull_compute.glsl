@@ -0,0 +1,71 @@
+#version 430 core
+
+// GPU frustum culling for the render queue's multi-draws
+// (engine/render_queue_impl.h). One invocation per draw command: its box
+// is tested against the frustum planes and, if any of it is inside, the
+// command is kept. With uCompact the kept commands are packed to the
+// front of their run's range and the run's count is bumped (the draw
+// takes its count from that buffer); without it every command is copied
+// in place, culled ones with an instance count of 0.
+
+layout (local_size_x = 64) in;
+
+// glMultiDrawElementsIndirect's command layout (erender::DrawElementsCommand)
+struct DrawCommand {
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    int baseVertex;
+    uint baseInstance;
+};
+
+// World-space box; lo.w == 0 for a command that is never culled
+struct CullBox {
+    vec4 lo;
+    vec4 hi;
+};
+
+layout (std430, binding = 0) readonly buffer Commands { DrawCommand commands[]; };
+layout (std430, binding = 1) readonly buffer Boxes { CullBox boxes[]; };
+layout (std430, binding = 2) readonly buffer Runs { uvec2 runs[]; };  // Run, its first command
+layout (std430, binding = 3) writeonly buffer Culled { DrawCommand culled[]; };
+layout (std430, binding = 4) buffer Counts { uint counts[]; };        // Per run, zeroed
+
+uniform vec4 uPlanes[6];
+uniform uint uCommandCount;
+uniform bool uCompact;
+
+// Outside = fully behind some plane: the box corner furthest along its normal
+bool visible(CullBox b)
+{
+    if (b.lo.w == 0.0) {
+        return true;
+    }
+    for (int i = 0; i < 6; i++) {
+        vec3 n = uPlanes[i].xyz;
+        vec3 far = mix(b.lo.xyz, b.hi.xyz, greaterThanEqual(n, vec3(0.0)));
+        if (dot(n, far) + uPlanes[i].w < 0.0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void main()
+{
+    uint i = gl_GlobalInvocationID.x;
+    if (i >= uCommandCount) {
+        return;
+    }
+    DrawCommand c = commands[i];
+    bool keep = visible(boxes[i]);
+    if (uCompact) {
+        if (keep) {
+            uint slot = atomicAdd(counts[runs[i].x], 1u);
+            culled[runs[i].y + slot] = c;
+        }
+    } else {
+        c.instanceCount = keep ? 1u : 0u;
+        culled[i] = c;
+    }
+}
@@ -1,10 +1,9 @@
 #version 330 core
 
+in vec4 vColor;
 out vec4 FragColor;
 
-uniform vec4 uColor;
-
 void main()
 {
-    FragColor = uColor;
+    FragColor = vColor;
 }
@@ -1,10 +1,25 @@
 #version 330 core
 
 layout (location = 0) in vec2 aPos;
+layout (location = 1) in vec4 aColor;
+// Per arc instance while uArc is set; aPos is then (t along the arc,
+// -1 inner / +1 outer edge) of the cached strip
+layout (location = 2) in vec4 aArc;        // cx cy radius thickness
+layout (location = 3) in vec2 aArcAngles;  // start end, radians
+
+out vec4 vColor;
 
 uniform mat4 projection;
+uniform bool uArc;
 
 void main()
 {
-    gl_Position = projection * vec4(aPos, 0.0, 1.0);
+    vec2 pos = aPos;
+    if (uArc) {
+        float angle = mix(aArcAngles.x, aArcAngles.y, aPos.x);
+        float radius = aArc.z + aPos.y * aArc.w * 0.5;
+        pos = aArc.xy + radius * vec2(cos(angle), sin(angle));
+    }
+    gl_Position = projection * vec4(pos, 0.0, 1.0);
+    vColor = aColor;
 }
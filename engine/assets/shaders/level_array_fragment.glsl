@@ -0,0 +1,37 @@
+#version 330 core
+
+in vec3 TexCoord;
+in vec3 Normal;
+
+out vec4 FragColor;
+
+uniform sampler2DArray uBaseColorArray;
+uniform vec4 uBaseColorFactor;
+uniform bool uEnableLighting;
+// LOD cross-fade, as in basic_fragment.glsl
+uniform float uLodFade;
+
+const int bayer[16] = int[16](0, 8, 2, 10, 12, 4, 14, 6, 3, 11, 1, 9, 15, 7, 13, 5);
+
+const vec3 lightDir = normalize(vec3(0.5, 1.0, 0.3));
+const vec3 ambientColor = vec3(0.3, 0.3, 0.35);
+const vec3 lightColor = vec3(0.7, 0.7, 0.65);
+
+void main()
+{
+    if (uLodFade != 0.0) {
+        ivec2 p = ivec2(gl_FragCoord.xy) & 3;
+        float threshold = (float(bayer[p.y * 4 + p.x]) + 0.5) / 16.0;
+        if ((uLodFade > 0.0) != (threshold < abs(uLodFade))) discard;
+    }
+
+    vec4 baseColor = uBaseColorFactor * texture(uBaseColorArray, TexCoord);
+
+    if (uEnableLighting) {
+        float diff = max(dot(normalize(Normal), lightDir), 0.0);
+        vec3 lighting = ambientColor + lightColor * diff;
+        FragColor = vec4(baseColor.rgb * lighting, baseColor.a);
+    } else {
+        FragColor = baseColor;
+    }
+}
@@ -0,0 +1,27 @@
+#version 330 core
+
+// Merged level primitives (egltf::upload_merged): positions already in
+// model space, each vertex carrying its image's texture array layer
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoord;
+layout (location = 3) in float aLayer;
+
+uniform mat4 model;
+// Per-frame camera, shared by every program (eshaders::set_camera_look_at)
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+};
+
+out vec3 TexCoord;
+out vec3 Normal;
+
+void main()
+{
+    gl_Position = viewProjection * model * vec4(aPos, 1.0);
+    TexCoord = vec3(aTexCoord, aLayer);
+    Normal = mat3(transpose(inverse(model))) * aNormal;
+}
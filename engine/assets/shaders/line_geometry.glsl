@@ -1,7 +1,13 @@
 #version 330 core
 layout (lines) in;
 layout (triangle_strip, max_vertices = 4) out;
-uniform mat4 projection;
+// Per-frame camera, shared by every program (eshaders::set_camera_look_at)
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+};
 uniform float lineWidth;
 in vec3 worldPos[];
 out float edgeDist;
@@ -0,0 +1,44 @@
+#version 330 core
+// Lines without a geometry shader: one instance per line, drawn as a
+// 4-vertex triangle strip whose corners (gl_VertexID) are pushed out here
+// the way line_geometry.glsl emits them. Shares line_fragment.glsl.
+layout (location = 1) in vec3 aStart;
+layout (location = 2) in vec3 aEnd;
+// Joint palette mode (eanim::create_skeleton_lines): the line's two joints
+layout (location = 3) in ivec2 aJoints;
+uniform mat4 model;
+// Per-frame camera, shared by every program (eshaders::set_camera_look_at)
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+};
+uniform float lineWidth;
+uniform bool uUsePalette;
+uniform samplerBuffer uJointPalette;
+uniform int uPaletteOffset;
+out float edgeDist;
+out float boneHeight;
+void main() {
+    vec3 a = aStart;
+    vec3 b = aEnd;
+    if (uUsePalette) {
+        a = texelFetch(uJointPalette, (uPaletteOffset + aJoints.x) * 4 + 3).xyz;
+        b = texelFetch(uJointPalette, (uPaletteOffset + aJoints.y) * 4 + 3).xyz;
+    }
+    vec4 w0 = model * vec4(a, 1.0);
+    vec4 w1 = model * vec4(b, 1.0);
+    vec4 p0 = view * w0;
+    vec4 p1 = view * w1;
+
+    vec2 dir = normalize(p1.xy/p1.w - p0.xy/p0.w);
+    vec2 normal = vec2(-dir.y, dir.x) * lineWidth * 0.5;
+
+    // Corners 0,1 at the start and 2,3 at the end; even ones on +normal
+    vec4 p = gl_VertexID < 2 ? p0 : p1;
+    float side = (gl_VertexID & 1) == 0 ? 1.0 : -1.0;
+    edgeDist = -side;
+    boneHeight = (w0.y + w1.y) * 0.5;
+    gl_Position = projection * vec4(p.xy + normal * side * p.w, p.z, p.w);
+}
@@ -1,10 +1,26 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
 uniform mat4 model;
-uniform mat4 view;
+// Per-frame camera, shared by every program (eshaders::set_camera_look_at)
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+};
+// Joint palette mode (eanim::create_skeleton_lines): no vertex data; each
+// vertex is joint gl_VertexID, placed at the translation of its model
+// matrix in uJointPalette, this skeleton's starting at uPaletteOffset
+uniform bool uUsePalette;
+uniform samplerBuffer uJointPalette;
+uniform int uPaletteOffset;
 out vec3 worldPos;
 void main() {
-    vec4 wp = model * vec4(aPos, 1.0);
+    vec3 pos = aPos;
+    if (uUsePalette) {
+        pos = texelFetch(uJointPalette, (uPaletteOffset + gl_VertexID) * 4 + 3).xyz;
+    }
+    vec4 wp = model * vec4(pos, 1.0);
     worldPos = wp.xyz;
     gl_Position = view * wp;
 }
@@ -7,7 +7,15 @@ out vec4 FragColor;
 
 uniform sampler2D uBaseColorTex;
 uniform vec4 uBaseColorFactor;
+// TEXTURED / UNTEXTURED variants fix uHasBaseColorTex (basic_fragment.glsl)
+#if defined(TEXTURED)
+const bool hasBaseColorTex = true;
+#elif defined(UNTEXTURED)
+const bool hasBaseColorTex = false;
+#else
 uniform bool uHasBaseColorTex;
+#define hasBaseColorTex uHasBaseColorTex
+#endif
 
 // Simple directional light
 const vec3 lightDir = normalize(vec3(0.5, 1.0, 0.3));
@@ -18,7 +26,7 @@ void main()
 {
     vec4 baseColor = uBaseColorFactor;
 
-    if (uHasBaseColorTex) {
+    if (hasBaseColorTex) {
         baseColor *= texture(uBaseColorTex, TexCoord);
     }
 
@@ -1,30 +1,99 @@
 #version 330 core
 
+// Either vertex layout (engine/animation_mesh_impl.h): SkinnedVertex's
+// floats and uint16 joints, or the compact one's 10:10:10:2 normal, half
+// uvs, uint8 joints and unorm8 weights, which the attribute setup widens
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoord;
 layout (location = 3) in ivec4 aJoints;   // bone indices
 layout (location = 4) in vec4 aWeights;   // bone weights
+// Instanced draws (eanim::instance_batch_draw): per instance instead of
+// model and uPaletteOffset
+layout (location = 5) in mat4 aInstanceModel;        // 5-8
+layout (location = 9) in int aInstancePaletteOffset;
 
-// Maximum number of bones supported (Ruby model needs up to 190)
+// Maximum number of bones supported (Ruby model needs up to 190). A
+// variant (eshaders::program_variant) can size it to its mesh's joint
+// count: MAX_BONES=64.
+#ifndef MAX_BONES
 #define MAX_BONES 200
+#endif
 
 uniform mat4 uBoneMatrices[MAX_BONES];
+
+// Joint palette mode (engine/joint_palette_impl.h): every draw's matrices in
+// one texture buffer, 4 RGBA32F texels (columns) per matrix, this draw's
+// starting at uPaletteOffset. No MAX_BONES cap.
+uniform samplerBuffer uJointPalette;
+uniform int uPaletteOffset;
+
+// PALETTE / NO_PALETTE and INSTANCED / NOT_INSTANCED variants fix what
+// uUsePalette and uInstanced switch; without them the uniforms decide
+#if defined(PALETTE)
+const bool usePalette = true;
+#elif defined(NO_PALETTE)
+const bool usePalette = false;
+#else
+uniform bool uUsePalette;
+#define usePalette uUsePalette
+#endif
+#if defined(INSTANCED)
+const bool instanced = true;
+#elif defined(NOT_INSTANCED)
+const bool instanced = false;
+#else
+uniform bool uInstanced;
+#define instanced uInstanced
+#endif
+
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// Per-frame camera, shared by every program (eshaders::set_camera_look_at)
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+};
 
 out vec2 TexCoord;
 out vec3 Normal;
 
+// SKIN_CAPTURE (engine/skin_capture_impl.h): the skinned vertex in mesh
+// space, for transform feedback. PRESKINNED draws such captured vertices:
+// aPos and aNormal are already skinned, aJoints and aWeights unused.
+#ifdef SKIN_CAPTURE
+out vec3 SkinnedPosition;
+out vec3 SkinnedNormal;
+#endif
+
+mat4 jointMatrix(int joint)
+{
+    if (!usePalette) {
+        return uBoneMatrices[joint];
+    }
+    int offset = instanced ? aInstancePaletteOffset : uPaletteOffset;
+    int base = (offset + joint) * 4;
+    return mat4(texelFetch(uJointPalette, base),
+                texelFetch(uJointPalette, base + 1),
+                texelFetch(uJointPalette, base + 2),
+                texelFetch(uJointPalette, base + 3));
+}
+
 void main()
 {
+    mat4 modelM = instanced ? aInstanceModel : model;
+
+#ifdef PRESKINNED
+    mat4 skinMatrix = mat4(1.0);
+#else
     // Compute skinning matrix from bone influences
     mat4 skinMatrix =
-        aWeights.x * uBoneMatrices[aJoints.x] +
-        aWeights.y * uBoneMatrices[aJoints.y] +
-        aWeights.z * uBoneMatrices[aJoints.z] +
-        aWeights.w * uBoneMatrices[aJoints.w];
+        aWeights.x * jointMatrix(aJoints.x) +
+        aWeights.y * jointMatrix(aJoints.y) +
+        aWeights.z * jointMatrix(aJoints.z) +
+        aWeights.w * jointMatrix(aJoints.w);
+#endif
 
     // Apply skinning to position
     vec4 skinnedPos = skinMatrix * vec4(aPos, 1.0);
@@ -32,10 +101,15 @@ void main()
     // Apply skinning to normal (using mat3 to ignore translation)
     vec3 skinnedNormal = mat3(skinMatrix) * aNormal;
 
+#ifdef SKIN_CAPTURE
+    SkinnedPosition = skinnedPos.xyz;
+    SkinnedNormal = skinnedNormal;
+#endif
+
     // Transform to clip space
-    gl_Position = projection * view * model * skinnedPos;
+    gl_Position = viewProjection * modelM * skinnedPos;
 
     // Pass interpolated values to fragment shader
     TexCoord = aTexCoord;
-    Normal = normalize(mat3(model) * skinnedNormal);
+    Normal = normalize(mat3(modelM) * skinnedNormal);
 }
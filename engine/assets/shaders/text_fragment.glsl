@@ -1,13 +1,18 @@
 #version 330 core
 
 in vec2 TexCoord;
+in vec3 TextColor;
 out vec4 FragColor;
 
 uniform sampler2D uFontTexture;
-uniform vec3 uTextColor;
+uniform bool uSdf;  // Atlas holds signed distance fields (edge at 0.5)
 
 void main()
 {
     float alpha = texture(uFontTexture, TexCoord).r;
-    FragColor = vec4(uTextColor, alpha);
+    if (uSdf) {
+        float w = fwidth(alpha);
+        alpha = smoothstep(0.5 - w, 0.5 + w, alpha);
+    }
+    FragColor = vec4(TextColor, alpha);
 }
@@ -2,8 +2,10 @@
 
 layout (location = 0) in vec2 aPos;
 layout (location = 1) in vec2 aTexCoord;
+layout (location = 2) in vec3 aColor;
 
 out vec2 TexCoord;
+out vec3 TextColor;
 
 uniform mat4 projection;
 
@@ -11,4 +13,5 @@ void main()
 {
     gl_Position = projection * vec4(aPos, 0.0, 1.0);
     TexCoord = aTexCoord;
+    TextColor = aColor;
 }
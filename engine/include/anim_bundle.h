@@ -0,0 +1,46 @@
+#ifndef ANIM_BUNDLE_H
+#define ANIM_BUNDLE_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Animation bundle (.ozzb): a skeleton and many clips in one file, written
+// by engine/tools/ozzbundle and mapped by eanim::open_animation_bundle.
+//
+//   AnimationBundleHeader
+//   AnimationBundleEntry[clip_count]   name index, at index_offset
+//   skeleton .ozz archive              at skeleton_offset
+//   clip .ozz archives                 at each entry's offset
+//
+// Archives are the .ozz files' bytes verbatim, each starting on a
+// kAnimationBundleAlign boundary. Durations and track counts are in the
+// index, so a clip is only deserialized when it's first played.
+// Fields are little-endian, as on every platform the engine ships.
+
+constexpr char kAnimationBundleMagic[4] = {'O', 'Z', 'A', 'B'};
+constexpr uint32_t kAnimationBundleVersion = 1;
+constexpr size_t kAnimationBundleNameSize = 48;  // Including the terminator
+constexpr size_t kAnimationBundleAlign = 16;
+
+struct AnimationBundleHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t clip_count;
+  uint32_t reserved;
+  uint64_t index_offset;
+  uint64_t skeleton_offset;
+  uint64_t skeleton_size;
+};
+
+struct AnimationBundleEntry {
+  char name[kAnimationBundleNameSize];
+  uint64_t offset;
+  uint64_t size;
+  float duration;       // Seconds
+  uint32_t num_tracks;
+};
+
+static_assert(sizeof(AnimationBundleHeader) == 40, "bundle header layout");
+static_assert(sizeof(AnimationBundleEntry) == 72, "bundle entry layout");
+
+#endif // ANIM_BUNDLE_H
@@ -11,36 +11,168 @@
 #include "ozz/animation/runtime/skeleton.h"
 #include "ozz/animation/runtime/sampling_job.h"
 #include "ozz/animation/runtime/local_to_model_job.h"
+#include "ozz/animation/runtime/blending_job.h"
 #include "ozz/base/maths/soa_transform.h"
 #include "ozz/base/maths/simd_math.h"
 #include "ozz/base/containers/vector.h"
 #include "ozz_mesh.h"
+#include "engine/memtrack_impl.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
 
-// Animation context holds all runtime buffers needed for animation
+namespace eanim {
+struct AnimationBundle;
+}
+
+// One blend layer: a clip sampled into its own locals, weighted overall
+// and per joint (mask). Buffers are sized once when layers are created.
+struct AnimationLayer {
+  int animation_index = -1;
+  float ratio = 0.0f;
+  float weight = 0.0f;
+  bool additive = false;
+  ozz::vector<ozz::math::SoaTransform> locals;
+  ozz::vector<float> joint_weights;            // Per joint, padded to a multiple of 4
+  ozz::vector<ozz::math::SimdFloat4> mask;     // SoA copy of joint_weights for BlendingJob
+  bool masked = false;                         // false: mask ignored, all joints weight 1
+  bool mask_dirty = false;
+  ozz::animation::SamplingJob::Context context; // Per layer, so each clip keeps its cache
+};
+
+// Rest poses, parents and names, roughly (ozz doesn't say)
+inline int64_t skeleton_bytes(const ozz::animation::Skeleton* s) {
+  if (!s) return 0;
+  return s->num_soa_joints() * static_cast<int64_t>(sizeof(ozz::math::SoaTransform)) +
+         s->num_joints() * 18;
+}
+
+// A SamplingJob context kept for one clip (eanim::set_clip_contexts)
+struct ClipSamplingContext {
+  const ozz::animation::Animation* clip = nullptr;
+  uint32_t used = 0;                                   // clip_clock when last sampled
+  std::unique_ptr<ozz::animation::SamplingJob::Context> context;
+};
+
+// Skeleton and clips, shared by every context playing them. Refcounted:
+// each context holds a reference and the last one out deletes it. Clips
+// are added while loading; once a set is shared (eanim::share_context)
+// every clip is resolved and the set isn't written again, so contexts on
+// different threads can sample from it.
+struct AnimationSet {
+  ozz::animation::Skeleton* skeleton = nullptr;
+  ozz::vector<ozz::animation::Animation*> animations;  // nullptr: bundle clip not loaded yet
+
+  // Clips from a bundle (eanim::attach_bundle_clip) are the bundle's, not
+  // ours; bundle_slots[i] is animations[i]'s clip there, or -1
+  eanim::AnimationBundle* bundle = nullptr;
+  std::vector<int> bundle_slots;
+
+  std::atomic<int> refs{1};
+  ememtrack::Account account{ememtrack::CAT_ANIMATION};  // Skeleton and own clips
+
+  // Takes ownership of a clip loaded on its own (not a bundle's)
+  void add_animation(ozz::animation::Animation* animation) {
+    animations.push_back(animation);
+    if (animation) account.add_ram(static_cast<int64_t>(animation->size()));
+  }
+
+  ~AnimationSet() {
+    delete skeleton;
+    for (size_t i = 0; i < animations.size(); ++i) {
+      if (i < bundle_slots.size() && bundle_slots[i] >= 0) continue;
+      delete animations[i];
+    }
+  }
+};
+
+inline AnimationSet* retain_animation_set(AnimationSet* set) {
+  set->refs.fetch_add(1, std::memory_order_relaxed);
+  return set;
+}
+
+inline void release_animation_set(AnimationSet* set) {
+  if (set && set->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) delete set;
+}
+
+// Animation context holds all runtime buffers needed for animation; the
+// skeleton and clips are its set's
 struct AnimationContext {
-  ozz::animation::Skeleton* skeleton;
-  ozz::vector<ozz::animation::Animation*> animations;
+  AnimationSet* set;
+  ozz::animation::Skeleton* skeleton;  // set->skeleton, read on every sample
 
   // Runtime buffers
   ozz::vector<ozz::math::SoaTransform> locals;  // Local space transforms
   ozz::vector<ozz::math::Float4x4> models;       // Model space matrices
   ozz::animation::SamplingJob::Context context;  // Sampling context
+  ozz::vector<ozz::math::Float4x4> skinning;     // Skinning palette scratch, grown to the largest mesh
 
-  AnimationContext() : skeleton(nullptr) {}
+  // Last sample, so unchanged (animation, ratio) requests are skipped.
+  // pose_version bumps whenever models change; skinning and palette
+  // slices remember the version they were built from.
+  const ozz::animation::Animation* sampled_animation = nullptr;
+  float sampled_ratio = 0.0f;
+  int sampled_to_joint = 0;
+  uint32_t pose_version = 0;
+  const ozz::sample::Mesh* skinning_mesh = nullptr;  // What skinning holds
+  uint32_t skinning_version = 0;
 
-  ~AnimationContext() {
-    delete skeleton;
-    for (auto* anim : animations) {
-      delete anim;
-    }
+  // Blending (eanim::blend_*); SamplingJob::Context can't move, hence pointers
+  std::vector<std::unique_ptr<AnimationLayer>> layers;
+  ozz::vector<ozz::animation::BlendingJob::Layer> blend_layers;     // Scratch, capacity = layers
+  ozz::vector<ozz::animation::BlendingJob::Layer> additive_layers;  // Scratch, capacity = layers
+
+  // Contexts for the most recently sampled clips (eanim::sampling_context);
+  // empty: samples go through context, layers through their own
+  std::vector<ClipSamplingContext> clip_contexts;
+  uint32_t clip_clock = 0;
+
+  ememtrack::Account account{ememtrack::CAT_ANIMATION};  // The runtime buffers above
+
+  AnimationContext() : set(new AnimationSet()), skeleton(nullptr) {}
+
+  explicit AnimationContext(AnimationSet* shared)
+    : set(retain_animation_set(shared)), skeleton(shared->skeleton) {}
+
+  ~AnimationContext() { release_animation_set(set); }
+
+  AnimationContext(const AnimationContext&) = delete;
+  AnimationContext& operator=(const AnimationContext&) = delete;
+
+  // The set takes ownership of skeleton
+  void set_skeleton(ozz::animation::Skeleton* s) {
+    set->account.add_ram(skeleton_bytes(s) - skeleton_bytes(set->skeleton));
+    delete set->skeleton;
+    set->skeleton = s;
+    skeleton = s;
   }
 
   bool init(int num_soa_joints, int num_joints) {
     locals.resize(num_soa_joints);
     models.resize(num_joints);
     context.Resize(num_joints);
+    for (ClipSamplingContext& c : clip_contexts) c.context->Resize(num_joints);
+    account.set_ram(buffer_bytes());
+    pose_changed();
     return true;
   }
+
+  // locals, models and skinning; a sampling context is about a locals' worth
+  int64_t buffer_bytes() const {
+    return static_cast<int64_t>(locals.size() * (2 + clip_contexts.size()) *
+                                    sizeof(ozz::math::SoaTransform) +
+                                (models.size() + skinning.size()) * sizeof(ozz::math::Float4x4));
+  }
+
+  // Call after writing models other than through a sample. Versions are
+  // unique across contexts, so a new context at a freed one's address
+  // never matches its palette slices.
+  void pose_changed() {
+    static std::atomic<uint32_t> versions{0};
+    sampled_animation = nullptr;
+    pose_version = ++versions;
+  }
 };
 
 // Compute and upload skinning matrices directly to shader
@@ -56,21 +188,27 @@ inline void compute_and_upload_skinning_matrices(
   const auto& mesh = (*meshes)[mesh_index];
   size_t joint_count = mesh.joint_remaps.size();
 
-  // Allocate temp buffer
-  std::vector<float> matrices(joint_count * 16);
-
-  for (size_t i = 0; i < joint_count; ++i) {
-    ozz::math::Float4x4 skinning_matrix =
-        ctx->models[mesh.joint_remaps[i]] * mesh.inverse_bind_poses[i];
-    // Float4x4 has 4 SimdFloat4 columns - need to store each column properly
-    float* out = matrices.data() + i * 16;
-    ozz::math::StorePtrU(skinning_matrix.cols[0], out + 0);
-    ozz::math::StorePtrU(skinning_matrix.cols[1], out + 4);
-    ozz::math::StorePtrU(skinning_matrix.cols[2], out + 8);
-    ozz::math::StorePtrU(skinning_matrix.cols[3], out + 12);
+  // Reuse the context's palette; it only grows, so steady state doesn't allocate
+  if (ctx->skinning.size() < joint_count) {
+    ctx->skinning.resize(joint_count);
+    ctx->account.set_ram(ctx->buffer_bytes());
+  }
+
+  // ozz allocates Float4x4 16-byte aligned, so the products are stored
+  // straight into place as 4 packed columns (the column-major layout GL takes).
+  // The products are only redone when the pose or mesh changed; the upload
+  // always happens, since the uniform belongs to the shader, not this context.
+  ozz::math::Float4x4* out = ctx->skinning.data();
+  if (ctx->skinning_mesh != &mesh || ctx->skinning_version != ctx->pose_version) {
+    for (size_t i = 0; i < joint_count; ++i) {
+      out[i] = ctx->models[mesh.joint_remaps[i]] * mesh.inverse_bind_poses[i];
+    }
+    ctx->skinning_mesh = &mesh;
+    ctx->skinning_version = ctx->pose_version;
   }
 
-  glUniformMatrix4fv(uniform_location, static_cast<GLsizei>(joint_count), GL_FALSE, matrices.data());
+  glUniformMatrix4fv(uniform_location, static_cast<GLsizei>(joint_count), GL_FALSE,
+                     reinterpret_cast<const float*>(out));
 }
 
 #endif // ANIMATION_TYPES_H
@@ -0,0 +1,253 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// ============ ANIMATION STATE MACHINE ============
+// A character animation state machine compiled from data (anim/compile-
+// machine, engine.gfx3d.animation) into flat tables: states with their
+// clips, and transitions in priority order, each a run of conditions on a
+// character's float parameters. A machine holds many characters, each a
+// row of parameters plus its state, clip and time; machine_update steps
+// them all in one pass, and the resulting clip and ratio go straight to
+// sampling (batch_add_machine in engine/animation_batch_impl.h).
+//
+// Per character and update, unless its state is locked (a one-shot state
+// whose clip hasn't finished), the first transition from its state (or
+// from any state) whose conditions all hold is taken. A transition to the
+// state it is already in keeps it (the way to say "stay while ..."). On
+// entry the state's clip is picked by its selector parameter (clamped to
+// its clips) and time restarts; time then advances by dt either way.
+// Edge conditions compare against the parameters of the previous update.
+
+namespace eanim {
+
+const int SM_ANY = -1;          // Transition source: any state
+const int SM_STATE_TIME = -1;   // Condition parameter: seconds in the state
+
+const int SM_TRUE = 0;   // param != 0
+const int SM_FALSE = 1;  // param == 0
+const int SM_LT = 2;     // param < value
+const int SM_GT = 3;     // param > value
+const int SM_ROSE = 4;   // param != 0 now, == 0 last update
+const int SM_FELL = 5;   // param == 0 now, != 0 last update
+
+struct SmCondition {
+  int param;
+  int op;
+  float value;
+};
+
+struct SmTransition {
+  int from;
+  int to;
+  int first_condition;
+  int condition_count;
+};
+
+struct SmClip {
+  int animation_index;
+  float duration;
+};
+
+struct SmState {
+  int selector = -1;  // Parameter choosing the clip on entry; -1 = first clip
+  int first_clip = 0;
+  int clip_count = 0;
+  bool loop = true;
+  bool locked = false;
+};
+
+struct StateMachine {
+  int param_count = 0;
+  std::vector<SmState> states;
+  std::vector<SmClip> clips;
+  std::vector<SmCondition> conditions;
+  std::vector<SmTransition> transitions;
+
+  // Characters, one row each; free rows have active == 0
+  std::vector<float> params;       // rows of param_count
+  std::vector<float> prev_params;
+  std::vector<int> state;
+  std::vector<int> clip;           // Index into clips
+  std::vector<float> time;
+  std::vector<uint8_t> entered;    // State changed in the last update
+  std::vector<uint8_t> fresh;      // No update yet: no edges
+  std::vector<uint8_t> active;
+};
+
+// ---- Building (from compile-machine) ----
+
+inline StateMachine* create_state_machine(int param_count) {
+  StateMachine* sm = new StateMachine();
+  sm->param_count = param_count;
+  return sm;
+}
+
+inline void destroy_state_machine(StateMachine* sm) {
+  delete sm;
+}
+
+// Add a state; follow with its clips (sm_add_clip). Returns its index.
+inline int sm_add_state(StateMachine* sm, int selector, bool loop, bool locked) {
+  SmState s;
+  s.selector = selector;
+  s.first_clip = (int)sm->clips.size();
+  s.loop = loop;
+  s.locked = locked;
+  sm->states.push_back(s);
+  return (int)sm->states.size() - 1;
+}
+
+// Add a clip to the last state added
+inline void sm_add_clip(StateMachine* sm, int animation_index, float duration) {
+  sm->clips.push_back({animation_index, duration > 0.0f ? duration : 1.0f});
+  sm->states.back().clip_count++;
+}
+
+// Add a transition (lowest priority so far); follow with its conditions
+inline void sm_add_transition(StateMachine* sm, int from, int to) {
+  sm->transitions.push_back({from, to, (int)sm->conditions.size(), 0});
+}
+
+// Add a condition to the last transition added
+inline void sm_add_condition(StateMachine* sm, int param, int op, float value) {
+  sm->conditions.push_back({param, op, value});
+  sm->transitions.back().condition_count++;
+}
+
+// ---- Characters ----
+
+// Pick state's clip for the parameter row p
+inline int sm_select_clip(const StateMachine* sm, int state, const float* p) {
+  const SmState& s = sm->states[state];
+  int i = s.selector >= 0 ? (int)p[s.selector] : 0;
+  if (i < 0) i = 0;
+  if (i >= s.clip_count) i = s.clip_count - 1;
+  return s.first_clip + (i < 0 ? 0 : i);
+}
+
+// A character in initial_state (parameters zero, its clip the first).
+// Reuses a removed character's row. Returns the row.
+inline int sm_add_character(StateMachine* sm, int initial_state) {
+  int row = -1;
+  for (size_t i = 0; i < sm->active.size(); i++) {
+    if (!sm->active[i]) {
+      row = (int)i;
+      break;
+    }
+  }
+  if (row < 0) {
+    row = (int)sm->active.size();
+    sm->params.resize(sm->params.size() + sm->param_count, 0.0f);
+    sm->prev_params.resize(sm->prev_params.size() + sm->param_count, 0.0f);
+    sm->state.push_back(0);
+    sm->clip.push_back(0);
+    sm->time.push_back(0.0f);
+    sm->entered.push_back(0);
+    sm->fresh.push_back(1);
+    sm->active.push_back(0);
+  }
+  float* p = &sm->params[(size_t)row * sm->param_count];
+  for (int i = 0; i < sm->param_count; i++) p[i] = 0.0f;
+  sm->state[row] = initial_state;
+  sm->clip[row] = sm_select_clip(sm, initial_state, p);
+  sm->time[row] = 0.0f;
+  sm->entered[row] = 0;
+  sm->fresh[row] = 1;
+  sm->active[row] = 1;
+  return row;
+}
+
+inline void sm_remove_character(StateMachine* sm, int row) {
+  sm->active[row] = 0;
+}
+
+inline void sm_set_param(StateMachine* sm, int row, int param, float value) {
+  sm->params[(size_t)row * sm->param_count + param] = value;
+}
+
+// ---- Update ----
+
+inline bool sm_condition_holds(const SmCondition& c, const float* p, const float* prev,
+                               float state_time) {
+  float v = c.param == SM_STATE_TIME ? state_time : p[c.param];
+  float was = c.param == SM_STATE_TIME ? state_time : prev[c.param];
+  switch (c.op) {
+    case SM_TRUE: return v != 0.0f;
+    case SM_FALSE: return v == 0.0f;
+    case SM_LT: return v < c.value;
+    case SM_GT: return v > c.value;
+    case SM_ROSE: return v != 0.0f && was == 0.0f;
+    case SM_FELL: return v == 0.0f && was != 0.0f;
+    default: return false;
+  }
+}
+
+inline void sm_update_character(StateMachine* sm, int row, float dt) {
+  const int n = sm->param_count;
+  float* p = &sm->params[(size_t)row * n];
+  float* prev = &sm->prev_params[(size_t)row * n];
+  if (sm->fresh[row]) {
+    for (int i = 0; i < n; i++) prev[i] = p[i];
+    sm->fresh[row] = 0;
+  }
+  const int current = sm->state[row];
+  const float t = sm->time[row];
+  const SmState& s = sm->states[current];
+  int next = current;
+  if (!(s.locked && t < sm->clips[sm->clip[row]].duration)) {
+    for (const SmTransition& tr : sm->transitions) {
+      if (tr.from != SM_ANY && tr.from != current) continue;
+      bool holds = true;
+      for (int i = 0; i < tr.condition_count && holds; i++) {
+        holds = sm_condition_holds(sm->conditions[tr.first_condition + i], p, prev, t);
+      }
+      if (holds) {
+        next = tr.to;
+        break;
+      }
+    }
+  }
+  sm->entered[row] = next != current;
+  if (next != current) {
+    sm->state[row] = next;
+    sm->clip[row] = sm_select_clip(sm, next, p);
+    sm->time[row] = dt;
+  } else {
+    sm->time[row] = t + dt;
+  }
+  for (int i = 0; i < n; i++) prev[i] = p[i];
+}
+
+// Step every character by dt seconds
+inline void machine_update(StateMachine* sm, float dt) {
+  for (size_t row = 0; row < sm->active.size(); row++) {
+    if (sm->active[row]) sm_update_character(sm, (int)row, dt);
+  }
+}
+
+// ---- Results ----
+
+inline int sm_state(const StateMachine* sm, int row) { return sm->state[row]; }
+inline bool sm_entered(const StateMachine* sm, int row) { return sm->entered[row] != 0; }
+inline float sm_time(const StateMachine* sm, int row) { return sm->time[row]; }
+
+inline int sm_animation_index(const StateMachine* sm, int row) {
+  return sm->clips[sm->clip[row]].animation_index;
+}
+
+// Where in its clip the character is, 0..1: wrapped for looping states,
+// held at 1 once a one-shot's clip ends
+inline float sm_ratio(const StateMachine* sm, int row) {
+  float duration = sm->clips[sm->clip[row]].duration;
+  float t = sm->time[row];
+  if (sm->states[sm->state[row]].loop) {
+    t = std::fmod(t, duration);
+  } else if (t > duration) {
+    t = duration;
+  }
+  return t / duration;
+}
+
+}  // namespace eanim
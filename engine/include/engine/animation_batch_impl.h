@@ -0,0 +1,234 @@
+#pragma once
+#include "animation_types.h"
+#include "engine/anim_machine_impl.h"
+#include "engine/animation_impl.h"
+#include "engine/jobs_impl.h"
+#include "engine/joint_palette_impl.h"
+#include "engine/profile_impl.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+// ============ BATCHED ANIMATION UPDATE ============
+// Samples many contexts per frame on the job pool (engine/jobs_impl.h).
+// Jobs are queued with batch_add (and batch_add_skinned, which also claims
+// a joint palette slice and fills it once the pose is sampled); batch_run
+// splits them over the calling thread and the pool's idle workers and
+// returns when all are done.
+// Each job owns its context for the run, so a context may appear at most
+// once per batch. Palette slices are claimed serially at add time, so only
+// the fills run in parallel.
+//
+// With the pose cache on (batch_set_pose_cache), jobs whose skeleton,
+// animation and ratio quantized to 1/steps of the clip match an earlier
+// job's are not sampled: after the run they copy that job's model matrices
+// (and share its palette slice for the same mesh). Contexts load their own
+// copies of skeletons and clips, so matching is by content (joint count,
+// clip name and duration), not pointer. A follower's local transforms are
+// left as they were.
+
+namespace eanim {
+
+struct AnimationJob {
+  AnimationContext* ctx = nullptr;
+  int animation_index = 0;
+  float ratio = 0.0f;
+  int to_joint = ozz::animation::Skeleton::kMaxJoints;  // See sample_animation_ozz_to
+  const ozz::sample::Mesh* mesh = nullptr;  // Skinned jobs only
+  JointPalette* palette = nullptr;
+  int palette_offset = -1;
+  int leader = -1;                          // Pose cache: job whose pose this one copies
+  bool ok = false;
+};
+
+struct AnimationBatch {
+  std::vector<AnimationJob> jobs;
+  int helpers = -1;             // Pool workers a run may use; -1 = any
+  int pose_cache_steps = 0;     // Ratio quantization; 0 = cache off
+  std::vector<int> leaders;     // Jobs actually sampled this run
+  int shared = 0;               // Jobs served from the cache last run
+};
+
+inline void run_animation_job(AnimationJob& job) {
+  if (job.leader >= 0) return;  // Filled in by copy_cached_poses
+  AnimationContext* ctx = job.ctx;
+  // Bundle clips were loaded in batch_add, so this doesn't contend
+  ozz::animation::Animation* animation = context_animation(ctx, job.animation_index);
+  if (!animation) {
+    job.ok = false;
+    return;
+  }
+  job.ok = sample_animation_ozz_to(ctx, animation, job.ratio, job.to_joint);
+  if (job.ok && job.palette && job.palette_offset >= 0) {
+    palette_fill(job.palette, job.palette_offset, ctx, *job.mesh);
+  }
+}
+
+// Pose cache followers take their leader's model matrices
+inline void copy_cached_poses(AnimationBatch* b) {
+  b->shared = 0;
+  for (AnimationJob& job : b->jobs) {
+    if (job.leader < 0) continue;
+    const AnimationJob& leader = b->jobs[job.leader];
+    job.ok = leader.ok;
+    if (!job.ok) continue;
+    size_t n = std::min(job.ctx->models.size(), leader.ctx->models.size());
+    std::copy(leader.ctx->models.begin(), leader.ctx->models.begin() + n, job.ctx->models.begin());
+    job.ctx->pose_changed();
+    if (job.mesh && job.palette && job.palette_offset >= 0) {
+      palette_fill(job.palette, job.palette_offset, job.ctx, *job.mesh);
+    }
+    ++b->shared;
+  }
+}
+
+// workers > 0 caps the pool workers a run takes beyond the calling
+// thread; <= 0 lets it use them all
+inline AnimationBatch* create_animation_batch(int workers) {
+  AnimationBatch* b = new AnimationBatch();
+  b->helpers = workers > 0 ? workers : -1;
+  return b;
+}
+
+inline void destroy_animation_batch(AnimationBatch* b) {
+  delete b;
+}
+
+inline void batch_clear(AnimationBatch* b) {
+  b->jobs.clear();
+  b->leaders.clear();
+}
+
+// steps > 0 turns the pose cache on, sharing poses whose ratios round to
+// the same 1/steps of their clip; 0 turns it off
+inline void batch_set_pose_cache(AnimationBatch* b, int steps) {
+  b->pose_cache_steps = steps > 0 ? steps : 0;
+}
+
+inline bool same_pose(const AnimationJob& a, const AnimationJob& b) {
+  if (a.ratio != b.ratio || a.to_joint != b.to_joint) return false;
+  const ozz::animation::Skeleton* sa = a.ctx->skeleton;
+  const ozz::animation::Skeleton* sb = b.ctx->skeleton;
+  if (!sa || !sb || sa->num_joints() != sb->num_joints()) return false;
+  const ozz::animation::Animation* aa = a.ctx->set->animations[a.animation_index];
+  const ozz::animation::Animation* ab = b.ctx->set->animations[b.animation_index];
+  if (aa == ab) return true;
+  return aa->duration() == ab->duration() && aa->num_tracks() == ab->num_tracks() &&
+         strcmp(aa->name(), ab->name()) == 0;
+}
+
+// Pose cache: point job i at an earlier job with the same pose, if any
+inline void find_pose_leader(AnimationBatch* b, int i) {
+  AnimationJob& job = b->jobs[i];
+  if (!context_animation(job.ctx, job.animation_index)) {
+    return;
+  }
+  float steps = static_cast<float>(b->pose_cache_steps);
+  job.ratio = std::round(job.ratio * steps) / steps;
+  for (int l : b->leaders) {
+    if (same_pose(b->jobs[l], job)) {
+      job.leader = l;
+      return;
+    }
+  }
+  b->leaders.push_back(i);
+}
+
+// Queue a sample; returns the job index
+inline int batch_add(AnimationBatch* b, AnimationContext* ctx, int animation_index, float ratio) {
+  AnimationJob job;
+  job.ctx = ctx;
+  job.animation_index = animation_index;
+  job.ratio = ratio;
+  context_animation(ctx, animation_index);  // Load a bundle clip here, not on a worker
+  b->jobs.push_back(job);
+  int i = static_cast<int>(b->jobs.size()) - 1;
+  if (b->pose_cache_steps > 0) {
+    find_pose_leader(b, i);
+  }
+  return i;
+}
+
+// Queue a sample of a state machine character's current clip and ratio
+// (after machine_update), so a machine's results go to sampling without a
+// round trip through script values
+inline int batch_add_machine(AnimationBatch* b, AnimationContext* ctx, const StateMachine* sm,
+                             int character) {
+  return batch_add(b, ctx, sm_animation_index(sm, character), sm_ratio(sm, character));
+}
+
+// Queue a sample that also writes mesh_index's skinning matrices into
+// palette; the job's batch_offset is -1 if the palette is full
+inline int batch_add_skinned(AnimationBatch* b, AnimationContext* ctx, int animation_index, float ratio,
+                             ozz::vector<ozz::sample::Mesh>* meshes, int mesh_index, JointPalette* p) {
+  int i = batch_add(b, ctx, animation_index, ratio);
+  if (meshes && p && mesh_index >= 0 && mesh_index < static_cast<int>(meshes->size())) {
+    AnimationJob& job = b->jobs[i];
+    job.mesh = &(*meshes)[mesh_index];
+    job.palette = p;
+    const AnimationJob* leader = job.leader >= 0 ? &b->jobs[job.leader] : nullptr;
+    if (leader && leader->palette == p && leader->mesh &&
+        leader->mesh->joint_remaps.size() == job.mesh->joint_remaps.size() &&
+        leader->mesh->inverse_bind_poses.data() == job.mesh->inverse_bind_poses.data()) {
+      job.palette_offset = leader->palette_offset;
+      job.mesh = nullptr;  // Nothing of its own to fill
+    } else {
+      job.palette_offset = palette_reserve(p, job.mesh->joint_remaps.size());
+    }
+  }
+  return i;
+}
+
+// Limit a queued job's model-space conversion to joints up to to_joint.
+// Set before queueing further jobs so the pose cache keys on it.
+inline void batch_set_joint_limit(AnimationBatch* b, int job, int to_joint) {
+  AnimationJob& j = b->jobs[job];
+  j.to_joint = to_joint;
+  if (b->pose_cache_steps <= 0) return;
+  // Re-key: it may no longer match its leader, or may now match another
+  if (j.leader < 0 && !b->leaders.empty() && b->leaders.back() == job) {
+    b->leaders.pop_back();
+  }
+  j.leader = -1;
+  for (int l : b->leaders) {
+    if (same_pose(b->jobs[l], j)) {
+      j.leader = l;
+      return;
+    }
+  }
+  b->leaders.push_back(job);
+}
+
+// Run every queued job; returns once all have finished
+inline void batch_run(AnimationBatch* b) {
+  if (b->jobs.empty()) return;
+  {
+    EPROFILE_ZONE("animation jobs");
+    ejobs::parallel_for(static_cast<int>(b->jobs.size()), 1,
+                        [b](int i) { run_animation_job(b->jobs[i]); }, b->helpers);
+  }
+  copy_cached_poses(b);
+}
+
+inline bool batch_ok(AnimationBatch* b, int job) {
+  return b->jobs[job].ok;
+}
+
+inline int batch_offset(AnimationBatch* b, int job) {
+  const AnimationJob& j = b->jobs[job];
+  return j.ok ? j.palette_offset : -1;
+}
+
+// Jobs the pose cache served in the last run
+inline int batch_shared_count(AnimationBatch* b) {
+  return b->shared;
+}
+
+// Pool workers a run may use beyond the calling thread
+inline int batch_worker_count(AnimationBatch* b) {
+  int pool = ejobs::worker_count();
+  return b->helpers < 0 ? pool : std::min(b->helpers, pool);
+}
+
+} // namespace eanim
@@ -1,10 +1,14 @@
 #pragma once
 #include "animation_types.h"
+#include "anim_bundle.h"
 #include "ozz_mesh.h"
+#include "engine/frame_arena_impl.h"
 #include "ozz/animation/runtime/animation.h"
 #include "ozz/animation/runtime/skeleton.h"
 #include "ozz/animation/runtime/sampling_job.h"
 #include "ozz/animation/runtime/local_to_model_job.h"
+#include "ozz/animation/runtime/blending_job.h"
+#include "ozz/animation/runtime/skeleton_utils.h"
 #include "ozz/base/io/archive.h"
 #include "ozz/base/io/stream.h"
 #include "ozz/base/maths/soa_transform.h"
@@ -15,7 +19,15 @@
 #include "ozz/base/containers/vector_archive.h"
 #include <iostream>
 #include <fstream>
+#include <algorithm>
 #include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace eanim {
 // Factory function to avoid copy construction issues
@@ -118,16 +130,371 @@ inline ozz::animation::Animation* load_animation_ozz(const char* path) {
   return animation;
 }
 
-// Sample animation at a given time ratio (0.0 to 1.0)
-inline bool sample_animation_ozz(AnimationContext* ctx, ozz::animation::Animation* anim, float time_ratio) {
+// ============ ANIMATION BUNDLES ============
+// A .ozzb bundle (see anim_bundle.h) is mapped read-only; clips are
+// deserialized from the mapping the first time a context plays them and
+// then shared by every context attached to the bundle, so clips a mode
+// never plays cost neither load time nor memory. The bundle owns its clips
+// and must outlive the contexts using it.
+
+// Read-only ozz stream over a mapped archive, so nothing is copied first
+class MappedStream : public ozz::io::Stream {
+ public:
+  MappedStream(const char* data, size_t size) : data_(data), size_(size), position_(0) {}
+
+  virtual bool opened() const { return data_ != nullptr; }
+
+  virtual size_t Read(void* buffer, size_t size) {
+    size_t n = std::min(size, size_ - position_);
+    std::memcpy(buffer, data_ + position_, n);
+    position_ += n;
+    return n;
+  }
+
+  virtual size_t Write(const void*, size_t) { return 0; }
+
+  virtual int Seek(int offset, Origin origin) {
+    long base = origin == kSet ? 0 : origin == kEnd ? static_cast<long>(size_) : static_cast<long>(position_);
+    long target = base + offset;
+    if (target < 0 || target > static_cast<long>(size_)) {
+      return -1;
+    }
+    position_ = static_cast<size_t>(target);
+    return 0;
+  }
+
+  virtual int Tell() const { return static_cast<int>(position_); }
+
+  virtual size_t Size() const { return size_; }
+
+ private:
+  const char* data_;
+  size_t size_;
+  size_t position_;
+};
+
+struct AnimationBundle {
+  void* mapping = nullptr;
+  size_t size = 0;
+  const AnimationBundleHeader* header = nullptr;
+  const AnimationBundleEntry* entries = nullptr;
+  std::vector<std::unique_ptr<ozz::animation::Animation>> clips;  // Deserialized on first use
+  std::mutex mutex;                                               // Guards clips
+  ememtrack::Account account{ememtrack::CAT_ANIMATION};           // Deserialized clips
+};
+
+inline bool bundle_range_ok(const AnimationBundle* b, uint64_t offset, uint64_t size) {
+  return offset <= b->size && size <= b->size - offset;
+}
+
+inline void close_animation_bundle(AnimationBundle* b) {
+  if (!b) return;
+  if (b->mapping) {
+    munmap(b->mapping, b->size);
+  }
+  delete b;
+}
+
+// Map a bundle and check its index; nullptr if missing or malformed
+inline AnimationBundle* open_animation_bundle(const char* path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return nullptr;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(AnimationBundleHeader))) {
+    close(fd);
+    return nullptr;
+  }
+  void* mapping = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    return nullptr;
+  }
+
+  AnimationBundle* b = new AnimationBundle();
+  b->mapping = mapping;
+  b->size = static_cast<size_t>(st.st_size);
+  const char* base = static_cast<const char*>(mapping);
+  b->header = reinterpret_cast<const AnimationBundleHeader*>(base);
+  const AnimationBundleHeader& h = *b->header;
+  bool ok = std::memcmp(h.magic, kAnimationBundleMagic, sizeof(h.magic)) == 0 &&
+            h.version == kAnimationBundleVersion &&
+            bundle_range_ok(b, h.index_offset, static_cast<uint64_t>(h.clip_count) * sizeof(AnimationBundleEntry)) &&
+            bundle_range_ok(b, h.skeleton_offset, h.skeleton_size);
+  if (ok) {
+    b->entries = reinterpret_cast<const AnimationBundleEntry*>(base + h.index_offset);
+    for (uint32_t i = 0; ok && i < h.clip_count; ++i) {
+      const AnimationBundleEntry& e = b->entries[i];
+      ok = bundle_range_ok(b, e.offset, e.size) && memchr(e.name, '\0', sizeof(e.name)) != nullptr;
+    }
+  }
+  if (!ok) {
+    std::cerr << "Malformed animation bundle: " << path << std::endl;
+    close_animation_bundle(b);
+    return nullptr;
+  }
+  b->clips.resize(h.clip_count);
+  return b;
+}
+
+inline int bundle_clip_count(AnimationBundle* b) {
+  return static_cast<int>(b->header->clip_count);
+}
+
+// Index of the clip called name, or -1
+inline int bundle_find_clip(AnimationBundle* b, const char* name) {
+  for (uint32_t i = 0; i < b->header->clip_count; ++i) {
+    if (std::strcmp(b->entries[i].name, name) == 0) {
+      return static_cast<int>(i);
+    }
+  }
+  return -1;
+}
+
+inline const char* bundle_clip_name(AnimationBundle* b, int clip) {
+  return b->entries[clip].name;
+}
+
+inline float bundle_clip_duration(AnimationBundle* b, int clip) {
+  return b->entries[clip].duration;
+}
+
+inline int bundle_clip_tracks(AnimationBundle* b, int clip) {
+  return static_cast<int>(b->entries[clip].num_tracks);
+}
+
+template <typename T>
+inline bool load_mapped_archive(AnimationBundle* b, uint64_t offset, uint64_t size, T* out) {
+  MappedStream stream(static_cast<const char*>(b->mapping) + offset, static_cast<size_t>(size));
+  ozz::io::IArchive archive(&stream);
+  if (!archive.TestTag<T>()) {
+    return false;
+  }
+  archive >> *out;
+  return true;
+}
+
+// The bundle's skeleton, as a new object the caller owns (a context's
+// skeleton is deleted with it)
+inline ozz::animation::Skeleton* bundle_load_skeleton(AnimationBundle* b) {
+  ozz::animation::Skeleton* skeleton = new ozz::animation::Skeleton();
+  if (!load_mapped_archive(b, b->header->skeleton_offset, b->header->skeleton_size, skeleton)) {
+    delete skeleton;
+    return nullptr;
+  }
+  return skeleton;
+}
+
+// A clip, deserialized on first call; nullptr if corrupt
+inline ozz::animation::Animation* bundle_clip(AnimationBundle* b, int clip) {
+  if (!b || clip < 0 || clip >= bundle_clip_count(b)) {
+    return nullptr;
+  }
+  std::lock_guard<std::mutex> lock(b->mutex);
+  if (!b->clips[clip]) {
+    std::unique_ptr<ozz::animation::Animation> animation(new ozz::animation::Animation());
+    const AnimationBundleEntry& e = b->entries[clip];
+    if (!load_mapped_archive(b, e.offset, e.size, animation.get())) {
+      return nullptr;
+    }
+    b->account.add_ram(static_cast<int64_t>(animation->size()));
+    b->clips[clip] = std::move(animation);
+  }
+  return b->clips[clip].get();
+}
+
+// Give ctx's set an animation slot for a bundle clip without loading it.
+// Returns the slot's index, or -1 (a set uses at most one bundle).
+inline int attach_bundle_clip(AnimationContext* ctx, AnimationBundle* b, int clip) {
+  if (!ctx || !b || clip < 0 || clip >= bundle_clip_count(b)) {
+    return -1;
+  }
+  AnimationSet* set = ctx->set;
+  if (set->bundle && set->bundle != b) {
+    return -1;
+  }
+  set->bundle = b;
+  set->bundle_slots.resize(set->animations.size(), -1);
+  set->animations.push_back(nullptr);
+  set->bundle_slots.push_back(clip);
+  return static_cast<int>(set->animations.size()) - 1;
+}
+
+// The set's animation at index, loading a bundle clip on first use
+inline ozz::animation::Animation* set_animation(AnimationSet* set, int index) {
+  if (index < 0 || index >= static_cast<int>(set->animations.size())) {
+    return nullptr;
+  }
+  ozz::animation::Animation*& animation = set->animations[index];
+  if (!animation && index < static_cast<int>(set->bundle_slots.size()) && set->bundle_slots[index] >= 0) {
+    animation = bundle_clip(set->bundle, set->bundle_slots[index]);
+  }
+  return animation;
+}
+
+// ctx's animation at index, loading a bundle clip on first use
+inline ozz::animation::Animation* context_animation(AnimationContext* ctx, int index) {
+  return ctx ? set_animation(ctx->set, index) : nullptr;
+}
+
+// Load every bundle clip in ctx's set now, rather than on first sample
+inline void load_all_clips(AnimationContext* ctx) {
+  if (!ctx) return;
+  for (int i = 0; i < static_cast<int>(ctx->set->animations.size()); ++i) {
+    set_animation(ctx->set, i);
+  }
+}
+
+// ============ PER-CLIP SAMPLING CONTEXTS ============
+// A SamplingJob context caches keyframe cursors for the clip it sampled
+// last and starts over from the first keys when given another, so a state
+// machine going run, jump, land, run re-seeks on every switch. With clip
+// contexts on, each of the count most recently sampled clips keeps a
+// context of its own (the least recently used is handed to a new clip),
+// so going back to one samples incrementally again. Plain samples and
+// blend layers both take them. Off by default: each is about a locals'
+// worth of memory.
+
+// Keep count clip contexts (0: off). Needs the skeleton loaded.
+inline void set_clip_contexts(AnimationContext* ctx, int count) {
+  if (!ctx || !ctx->skeleton || count < 0) {
+    return;
+  }
+  int num_joints = ctx->skeleton->num_joints();
+  ctx->clip_contexts.resize(count);
+  for (ClipSamplingContext& c : ctx->clip_contexts) {
+    if (!c.context) c.context.reset(new ozz::animation::SamplingJob::Context(num_joints));
+  }
+  ctx->account.set_ram(ctx->buffer_bytes());
+}
+
+// The context to sample anim through: its clip context while those are
+// on, else fallback
+inline ozz::animation::SamplingJob::Context* sampling_context(
+    AnimationContext* ctx, const ozz::animation::Animation* anim,
+    ozz::animation::SamplingJob::Context* fallback) {
+  if (ctx->clip_contexts.empty()) {
+    return fallback;
+  }
+  ClipSamplingContext* slot = nullptr;
+  for (ClipSamplingContext& c : ctx->clip_contexts) {
+    if (c.clip == anim) {
+      slot = &c;
+      break;
+    }
+    if (!slot || c.used < slot->used) slot = &c;
+  }
+  // A context given a different clip invalidates its cache itself
+  slot->clip = anim;
+  slot->used = ++ctx->clip_clock;
+  return slot->context.get();
+}
+
+// A new context playing source's skeleton and clips, with buffers of its
+// own: kilobytes where a loaded context is megabytes. The set's clips are
+// resolved first so it isn't written while contexts share it.
+inline AnimationContext* share_context(AnimationContext* source) {
+  if (!source || !source->skeleton) {
+    return nullptr;
+  }
+  load_all_clips(source);
+  AnimationContext* ctx = new AnimationContext(source->set);
+  ctx->init(ctx->skeleton->num_soa_joints(), ctx->skeleton->num_joints());
+  set_clip_contexts(ctx, static_cast<int>(source->clip_contexts.size()));
+  return ctx;
+}
+
+inline void destroy_animation_context(AnimationContext* ctx) {
+  delete ctx;
+}
+
+// ============ CONTEXT POOL ============
+// Contexts sharing one set, made up front and recycled, so characters
+// coming and going mid-match don't allocate. Acquiring past the pool's
+// size makes another context rather than failing; it joins the pool when
+// released. A released context keeps its blend layers.
+
+struct ContextPool {
+  AnimationSet* set = nullptr;
+  std::vector<AnimationContext*> free;
+  int created = 0;
+  int clip_contexts = 0;                 // The source's, for each new context
+};
+
+inline AnimationContext* new_pool_context(ContextPool* pool) {
+  AnimationContext* ctx = new AnimationContext(pool->set);
+  ctx->init(ctx->skeleton->num_soa_joints(), ctx->skeleton->num_joints());
+  set_clip_contexts(ctx, pool->clip_contexts);
+  ++pool->created;
+  return ctx;
+}
+
+// count contexts sharing source's set, sized to its skeleton
+inline ContextPool* create_context_pool(AnimationContext* source, int count) {
+  if (!source || !source->skeleton) {
+    return nullptr;
+  }
+  load_all_clips(source);
+  ContextPool* pool = new ContextPool();
+  pool->set = retain_animation_set(source->set);
+  pool->clip_contexts = static_cast<int>(source->clip_contexts.size());
+  pool->free.reserve(count > 0 ? count : 0);
+  for (int i = 0; i < count; ++i) {
+    pool->free.push_back(new_pool_context(pool));
+  }
+  return pool;
+}
+
+// Frees the pooled contexts; contexts still acquired are their holders'
+inline void destroy_context_pool(ContextPool* pool) {
+  if (!pool) return;
+  for (AnimationContext* ctx : pool->free) delete ctx;
+  release_animation_set(pool->set);
+  delete pool;
+}
+
+inline AnimationContext* context_pool_acquire(ContextPool* pool) {
+  if (pool->free.empty()) {
+    return new_pool_context(pool);
+  }
+  AnimationContext* ctx = pool->free.back();
+  pool->free.pop_back();
+  return ctx;
+}
+
+// ctx must have come from this pool
+inline void context_pool_release(ContextPool* pool, AnimationContext* ctx) {
+  if (!ctx) return;
+  ctx->pose_changed();
+  ctx->skinning_mesh = nullptr;
+  pool->free.push_back(ctx);
+}
+
+inline int context_pool_free(ContextPool* pool) { return static_cast<int>(pool->free.size()); }
+inline int context_pool_created(ContextPool* pool) { return pool->created; }
+
+// Sample animation at a given time ratio (0.0 to 1.0), converting joints
+// up to to_joint (in skeleton order: depth-first, so a prefix is the root
+// and whole limbs). Joints past it keep their previous model matrices;
+// animation LOD uses this to skip extremities on distant characters.
+inline bool sample_animation_ozz_to(AnimationContext* ctx, ozz::animation::Animation* anim, float time_ratio,
+                                    int to_joint) {
   if (!ctx || !anim || !ctx->skeleton) {
     return false;
   }
 
+  // Same request as last time (paused, or rendering faster than the
+  // animation clock): the pose is already in place
+  if (ctx->sampled_animation == anim && ctx->sampled_ratio == time_ratio &&
+      ctx->sampled_to_joint == to_joint) {
+    return true;
+  }
+
   // Sample animation
   ozz::animation::SamplingJob sampling_job;
   sampling_job.animation = anim;
-  sampling_job.context = &ctx->context;
+  sampling_job.context = sampling_context(ctx, anim, &ctx->context);
   sampling_job.ratio = time_ratio;
   sampling_job.output = ozz::make_span(ctx->locals);
   if (!sampling_job.Run()) {
@@ -139,13 +506,152 @@ inline bool sample_animation_ozz(AnimationContext* ctx, ozz::animation::Animatio
   ltm_job.skeleton = ctx->skeleton;
   ltm_job.input = ozz::make_span(ctx->locals);
   ltm_job.output = ozz::make_span(ctx->models);
-  if (!ltm_job.Run()) {
-    return false;
+  ltm_job.to = to_joint;
+  bool ok = ltm_job.Run();
+
+  ctx->pose_changed();
+  if (ok) {
+    ctx->sampled_animation = anim;
+    ctx->sampled_ratio = time_ratio;
+    ctx->sampled_to_joint = to_joint;
   }
+  return ok;
+}
 
+// Sample animation at a given time ratio (0.0 to 1.0)
+inline bool sample_animation_ozz(AnimationContext* ctx, ozz::animation::Animation* anim, float time_ratio) {
+  return sample_animation_ozz_to(ctx, anim, time_ratio, ozz::animation::Skeleton::kMaxJoints);
+}
+
+// ============ BLENDING ============
+// Layered poses via ozz BlendingJob: each layer samples its own clip into
+// preallocated locals, then the layers are blended (normal layers by
+// weight, additive ones on top) into ctx->locals over the rest pose and
+// converted to model space. A layer mask weights it per joint, e.g. an
+// upper-body aim layer over locomotion. Crossfading two layers' weights
+// replaces an authored transition clip.
+
+// Create count layers (dropping any existing ones); all start at weight 0
+inline bool blend_set_layer_count(AnimationContext* ctx, int count) {
+  if (!ctx || !ctx->skeleton || count < 0) {
+    return false;
+  }
+  int num_soa = ctx->skeleton->num_soa_joints();
+  int num_joints = ctx->skeleton->num_joints();
+  ctx->layers.clear();
+  for (int i = 0; i < count; ++i) {
+    std::unique_ptr<AnimationLayer> layer(new AnimationLayer());
+    layer->locals.resize(num_soa);
+    layer->joint_weights.assign(static_cast<size_t>(num_soa) * 4, 1.0f);
+    layer->mask.resize(num_soa);
+    layer->context.Resize(num_joints);
+    ctx->layers.push_back(std::move(layer));
+  }
+  ctx->blend_layers.reserve(count);
+  ctx->additive_layers.reserve(count);
   return true;
 }
 
+inline AnimationLayer* blend_layer(AnimationContext* ctx, int layer) {
+  if (!ctx || layer < 0 || layer >= static_cast<int>(ctx->layers.size())) {
+    return nullptr;
+  }
+  return ctx->layers[layer].get();
+}
+
+inline void blend_set_layer(AnimationContext* ctx, int layer, int animation_index, float ratio, float weight) {
+  AnimationLayer* l = blend_layer(ctx, layer);
+  if (!l) return;
+  l->animation_index = animation_index;
+  l->ratio = ratio;
+  l->weight = weight;
+}
+
+inline void blend_set_additive(AnimationContext* ctx, int layer, bool additive) {
+  AnimationLayer* l = blend_layer(ctx, layer);
+  if (l) l->additive = additive;
+}
+
+// Set every joint's mask weight (and whether the mask applies at all)
+inline void blend_clear_mask(AnimationContext* ctx, int layer, bool masked, float weight) {
+  AnimationLayer* l = blend_layer(ctx, layer);
+  if (!l) return;
+  std::fill(l->joint_weights.begin(), l->joint_weights.end(), weight);
+  l->masked = masked;
+  l->mask_dirty = true;
+}
+
+// Set the mask weight of root_joint and all its descendants; enables the mask
+inline void blend_mask_subtree(AnimationContext* ctx, int layer, int root_joint, float weight) {
+  AnimationLayer* l = blend_layer(ctx, layer);
+  if (!l || root_joint < 0 || root_joint >= ctx->skeleton->num_joints()) return;
+  ozz::animation::IterateJointsDF(
+      *ctx->skeleton,
+      [l, weight](int joint, int) { l->joint_weights[joint] = weight; },
+      root_joint);
+  l->masked = true;
+  l->mask_dirty = true;
+}
+
+inline int find_joint(AnimationContext* ctx, const char* name) {
+  if (!ctx || !ctx->skeleton) return -1;
+  return ozz::animation::FindJoint(*ctx->skeleton, name);
+}
+
+// Sample every layer with weight > 0, blend and update model matrices.
+// threshold: total weight under which the rest pose fades in.
+inline bool blend_run(AnimationContext* ctx, float threshold) {
+  if (!ctx || !ctx->skeleton) {
+    return false;
+  }
+  ctx->blend_layers.clear();
+  ctx->additive_layers.clear();
+  for (auto& owned : ctx->layers) {
+    AnimationLayer* l = owned.get();
+    if (l->weight <= 0.0f || !context_animation(ctx, l->animation_index)) {
+      continue;
+    }
+    ozz::animation::SamplingJob sampling_job;
+    sampling_job.animation = context_animation(ctx, l->animation_index);
+    sampling_job.context = sampling_context(ctx, sampling_job.animation, &l->context);
+    sampling_job.ratio = l->ratio;
+    sampling_job.output = ozz::make_span(l->locals);
+    if (!sampling_job.Run()) {
+      return false;
+    }
+    if (l->mask_dirty) {
+      for (size_t i = 0; i < l->mask.size(); ++i) {
+        l->mask[i] = ozz::math::simd_float4::LoadPtrU(l->joint_weights.data() + i * 4);
+      }
+      l->mask_dirty = false;
+    }
+    ozz::animation::BlendingJob::Layer layer;
+    layer.weight = l->weight;
+    layer.transform = ozz::make_span(l->locals);
+    if (l->masked) {
+      layer.joint_weights = ozz::make_span(l->mask);
+    }
+    (l->additive ? ctx->additive_layers : ctx->blend_layers).push_back(layer);
+  }
+
+  ozz::animation::BlendingJob blend_job;
+  blend_job.threshold = threshold;
+  blend_job.layers = ozz::make_span(ctx->blend_layers);
+  blend_job.additive_layers = ozz::make_span(ctx->additive_layers);
+  blend_job.rest_pose = ctx->skeleton->joint_rest_poses();
+  blend_job.output = ozz::make_span(ctx->locals);
+  ctx->pose_changed();
+  if (!blend_job.Run()) {
+    return false;
+  }
+
+  ozz::animation::LocalToModelJob ltm_job;
+  ltm_job.skeleton = ctx->skeleton;
+  ltm_job.input = ozz::make_span(ctx->locals);
+  ltm_job.output = ozz::make_span(ctx->models);
+  return ltm_job.Run();
+}
+
 // ============ MESH LOADING ============
 
 // Load meshes from .ozz file
@@ -204,6 +710,16 @@ inline void get_joint_position(AnimationContext* ctx, int index, float* out_xyz)
   out_xyz[2] = m[14];
 }
 
+// Caller-owned vertex buffer for max_lines skeleton lines, reused across
+// frames instead of frame scratch
+inline float* create_line_buffer(int max_lines) {
+  return new float[static_cast<size_t>(max_lines > 0 ? max_lines : 0) * 6];
+}
+
+inline void destroy_line_buffer(float* buffer) {
+  delete[] buffer;
+}
+
 // Build skeleton line vertices for debug rendering
 // Returns number of lines (pairs of vertices) written
 // Each line is 2 vertices * 3 floats = 6 floats
@@ -245,9 +761,9 @@ inline int build_skeleton_lines_rest_pose(AnimationContext* ctx, float* out_vert
   int num_soa = skel->num_soa_joints();
   auto parents = skel->joint_parents();
 
-  // Compute rest pose world positions
-  std::vector<ozz::math::SoaTransform> rest_locals(num_soa);
-  std::vector<ozz::math::Float4x4> rest_models(num_joints);
+  // Compute rest pose world positions, in frame scratch
+  ozz::math::SoaTransform* rest_locals = earena::alloc_array<ozz::math::SoaTransform>(num_soa);
+  ozz::math::Float4x4* rest_models = earena::alloc_array<ozz::math::Float4x4>(num_joints);
 
   for (int i = 0; i < num_soa; ++i) {
     rest_locals[i] = skel->joint_rest_poses()[i];
@@ -255,8 +771,8 @@ inline int build_skeleton_lines_rest_pose(AnimationContext* ctx, float* out_vert
 
   ozz::animation::LocalToModelJob ltm_job;
   ltm_job.skeleton = skel;
-  ltm_job.input = ozz::make_span(rest_locals);
-  ltm_job.output = ozz::make_span(rest_models);
+  ltm_job.input = ozz::span<const ozz::math::SoaTransform>(rest_locals, num_soa);
+  ltm_job.output = ozz::span<ozz::math::Float4x4>(rest_models, num_joints);
   if (!ltm_job.Run()) return 0;
 
   // Build line segments
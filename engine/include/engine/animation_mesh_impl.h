@@ -2,9 +2,13 @@
 #include "gl_wrappers.h"
 #include "ozz/base/containers/vector.h"
 #include "ozz_mesh.h"
+#include "engine/jobs_impl.h"
+#include "engine/vertex_pack_impl.h"
+#include <algorithm>
 #include <vector>
 #include <cstring>
 #include <cstdint>
+#include <cmath>
 
 // Skinned vertex layout matching skinned_vertex.glsl
 // Total stride: 48 bytes
@@ -17,6 +21,132 @@ struct SkinnedVertex {
 };
 
 namespace emesh {
+// ============================================================================
+// Interleaving
+// ============================================================================
+// Each part's SoA arrays are converted one attribute stream at a time, with
+// the influence count switched on once per part rather than per weight.
+// Large meshes are cut into vertex ranges that the job pool's threads claim
+// in turn; every range writes its own slice of the output, so no locking
+// is needed.
+
+const int PARALLEL_MIN_VERTICES = 16384;   // Smaller meshes convert on the calling thread
+const int RANGE_VERTICES = 4096;           // Vertices per range claimed by a thread
+
+struct VertexRange {
+  int part;
+  int begin;    // Within the part
+  int end;
+  int offset;   // Of the part's first vertex in the output
+};
+
+// Run fn(i) for i in [0, count), on the job pool (ejobs::parallel_for)
+template <typename Fn>
+inline void for_each_range(int count, int total_vertices, Fn fn) {
+  if (total_vertices < PARALLEL_MIN_VERTICES) {
+    for (int i = 0; i < count; ++i) fn(i);
+    return;
+  }
+  ejobs::parallel_for(count, 1, fn);
+}
+
+inline std::vector<VertexRange> vertex_ranges(const ozz::sample::Mesh& mesh) {
+  std::vector<VertexRange> ranges;
+  int offset = 0;
+  for (size_t pi = 0; pi < mesh.parts.size(); ++pi) {
+    int count = mesh.parts[pi].vertex_count();
+    for (int b = 0; b < count; b += RANGE_VERTICES) {
+      ranges.push_back({static_cast<int>(pi), b, std::min(count, b + RANGE_VERTICES), offset});
+    }
+    offset += count;
+  }
+  return ranges;
+}
+
+// Convert part vertices [begin, end) into out[begin, end)
+inline void build_part_vertices(const ozz::sample::Mesh::Part& part, int begin, int end, SkinnedVertex* out) {
+  for (int vi = begin; vi < end; ++vi) {
+    std::memcpy(out[vi].pos, &part.positions[vi * 3], sizeof(float) * 3);
+  }
+
+  if (!part.normals.empty()) {
+    for (int vi = begin; vi < end; ++vi) {
+      std::memcpy(out[vi].norm, &part.normals[vi * 3], sizeof(float) * 3);
+    }
+  } else {
+    for (int vi = begin; vi < end; ++vi) {
+      out[vi].norm[0] = 0.0f; out[vi].norm[1] = 1.0f; out[vi].norm[2] = 0.0f;
+    }
+  }
+
+  if (!part.uvs.empty()) {
+    for (int vi = begin; vi < end; ++vi) {
+      std::memcpy(out[vi].uv, &part.uvs[vi * 2], sizeof(float) * 2);
+    }
+  } else {
+    for (int vi = begin; vi < end; ++vi) {
+      out[vi].uv[0] = 0.0f; out[vi].uv[1] = 0.0f;
+    }
+  }
+
+  // Joint indices: influences per vertex, the first 4 kept, padded with 0
+  const int influences = part.influences_count();
+  const int joints = part.joint_indices.empty() ? 0 : std::min(influences, 4);
+  for (int vi = begin; vi < end; ++vi) {
+    uint16_t* j = out[vi].joints;
+    j[0] = j[1] = j[2] = j[3] = 0;
+    for (int i = 0; i < joints; ++i) j[i] = part.joint_indices[vi * influences + i];
+  }
+
+  // Weights: ozz stores influences - 1 per vertex, the last is 1 - sum(others).
+  // Past 4 influences only the first 4 stored weights are kept.
+  const float* w = part.joint_weights.empty() ? nullptr : part.joint_weights.data();
+  const int stored = influences - 1;
+  for (int vi = begin; vi < end; ++vi) {
+    float* o = out[vi].weights;
+    o[0] = o[1] = o[2] = o[3] = 0.0f;
+  }
+  if (influences <= 0) return;
+  if (!w || influences == 1) {
+    // No stored weights: the implicit weight takes it all
+    if (stored < 4) {
+      for (int vi = begin; vi < end; ++vi) out[vi].weights[stored] = 1.0f;
+    }
+    return;
+  }
+  switch (influences) {
+    case 2:
+      for (int vi = begin; vi < end; ++vi) {
+        float a = w[vi];
+        out[vi].weights[0] = a;
+        out[vi].weights[1] = 1.0f - a;
+      }
+      break;
+    case 3:
+      for (int vi = begin; vi < end; ++vi) {
+        float a = w[vi * 2], b = w[vi * 2 + 1];
+        out[vi].weights[0] = a;
+        out[vi].weights[1] = b;
+        out[vi].weights[2] = 1.0f - (a + b);
+      }
+      break;
+    case 4:
+      for (int vi = begin; vi < end; ++vi) {
+        float a = w[vi * 3], b = w[vi * 3 + 1], c = w[vi * 3 + 2];
+        out[vi].weights[0] = a;
+        out[vi].weights[1] = b;
+        out[vi].weights[2] = c;
+        out[vi].weights[3] = 1.0f - (a + b + c);
+      }
+      break;
+    default:
+      for (int vi = begin; vi < end; ++vi) {
+        std::memcpy(out[vi].weights, &w[vi * stored], sizeof(float) * 4);
+      }
+      break;
+  }
+}
+
 // Build interleaved vertex buffer from ozz mesh parts
 // Returns vertex count, fills output buffer
 inline int build_skinned_vertices(
@@ -29,67 +159,15 @@ inline int build_skinned_vertices(
   }
   const auto& mesh = (*meshes)[mesh_index];
 
-  // Count total vertices across all parts
   int total_verts = mesh.vertex_count();
   out_vertices.resize(total_verts);
 
-  int vertex_offset = 0;
-  for (size_t pi = 0; pi < mesh.parts.size(); ++pi) {
-    const auto& part = mesh.parts[pi];
-    int part_verts = part.vertex_count();
-    int influences = part.influences_count();
-
-    for (int vi = 0; vi < part_verts; ++vi) {
-      SkinnedVertex& v = out_vertices[vertex_offset + vi];
-
-      // Position (3 floats per vertex)
-      v.pos[0] = part.positions[vi * 3 + 0];
-      v.pos[1] = part.positions[vi * 3 + 1];
-      v.pos[2] = part.positions[vi * 3 + 2];
-
-      // Normal (3 floats per vertex)
-      if (!part.normals.empty()) {
-        v.norm[0] = part.normals[vi * 3 + 0];
-        v.norm[1] = part.normals[vi * 3 + 1];
-        v.norm[2] = part.normals[vi * 3 + 2];
-      } else {
-        v.norm[0] = 0.0f; v.norm[1] = 1.0f; v.norm[2] = 0.0f;
-      }
-
-      // UV (2 floats per vertex)
-      if (!part.uvs.empty()) {
-        v.uv[0] = part.uvs[vi * 2 + 0];
-        v.uv[1] = part.uvs[vi * 2 + 1];
-      } else {
-        v.uv[0] = 0.0f; v.uv[1] = 0.0f;
-      }
-
-      // Joint indices (influences per vertex, pad to 4)
-      for (int i = 0; i < 4; ++i) {
-        if (i < influences && !part.joint_indices.empty()) {
-          v.joints[i] = part.joint_indices[vi * influences + i];
-        } else {
-          v.joints[i] = 0;
-        }
-      }
-
-      // Joint weights (influences-1 per vertex because last is implicit, pad to 4)
-      // ozz stores N-1 weights, last weight = 1 - sum(others)
-      float weight_sum = 0.0f;
-      for (int i = 0; i < 4; ++i) {
-        if (i < influences - 1 && !part.joint_weights.empty()) {
-          v.weights[i] = part.joint_weights[vi * (influences - 1) + i];
-          weight_sum += v.weights[i];
-        } else if (i == influences - 1 && influences > 0) {
-          // Last weight is implicit
-          v.weights[i] = 1.0f - weight_sum;
-        } else {
-          v.weights[i] = 0.0f;
-        }
-      }
-    }
-    vertex_offset += part_verts;
-  }
+  std::vector<VertexRange> ranges = vertex_ranges(mesh);
+  SkinnedVertex* out = out_vertices.data();
+  for_each_range(static_cast<int>(ranges.size()), total_verts, [&](int i) {
+    const VertexRange& r = ranges[i];
+    build_part_vertices(mesh.parts[r.part], r.begin, r.end, out + r.offset);
+  });
   return total_verts;
 }
 
@@ -105,4 +183,105 @@ inline size_t skinned_vertex_size() {
 inline void set_vertex_attrib_i_pointer(GLuint index, GLint size, GLenum type, GLsizei stride, size_t offset) {
   glVertexAttribIPointer(index, size, type, stride, reinterpret_cast<void*>(offset));
 }
+
+// ============================================================================
+// Compact layout
+// ============================================================================
+// The same attributes at the same locations as SkinnedVertex, packed:
+// position 3 floats (12), normal GL_INT_2_10_10_10_REV (4), uv 2 half
+// floats (4), joints 4 uint8 (4), weights 4 unorm8 (4) = 28 bytes. Joints
+// stay uint16 (8) when an index is past 255, and uvs float (8) when one is
+// past HALF_UV_LIMIT, as in the glTF upload. skinned_vertex.glsl reads
+// either layout unchanged.
+
+struct CompactSkinnedLayout {
+  int stride = 0;
+  bool wide_joints = false;
+  bool float_uvs = false;
+};
+
+// Pack build_skinned_vertices' output into out; returns its layout
+inline CompactSkinnedLayout pack_compact_skinned_vertices(const std::vector<SkinnedVertex>& vertices,
+                                                          std::vector<unsigned char>& out) {
+  CompactSkinnedLayout layout;
+  for (const SkinnedVertex& v : vertices) {
+    for (int i = 0; i < 4; ++i) {
+      if (v.joints[i] > 255) layout.wide_joints = true;
+    }
+    if (std::fabs(v.uv[0]) > evpack::HALF_UV_LIMIT || std::fabs(v.uv[1]) > evpack::HALF_UV_LIMIT) {
+      layout.float_uvs = true;
+    }
+  }
+  layout.stride = 12 + 4 + (layout.float_uvs ? 8 : 4) + (layout.wide_joints ? 8 : 4) + 4;
+
+  // Each vertex's bytes go at i * stride, so ranges pack independently
+  out.resize((size_t)layout.stride * vertices.size());
+  int count = static_cast<int>(vertices.size());
+  int ranges = (count + RANGE_VERTICES - 1) / RANGE_VERTICES;
+  for_each_range(ranges, count, [&](int r) {
+    int end = std::min(count, (r + 1) * RANGE_VERTICES);
+    for (int i = r * RANGE_VERTICES; i < end; ++i) {
+      const SkinnedVertex& v = vertices[i];
+      unsigned char* p = out.data() + (size_t)layout.stride * i;
+      std::memcpy(p, v.pos, 12);
+      p += 12;
+      uint32_t n = evpack::pack_snorm_2_10_10_10(v.norm);
+      std::memcpy(p, &n, 4);
+      p += 4;
+      if (layout.float_uvs) {
+        std::memcpy(p, v.uv, 8);
+        p += 8;
+      } else {
+        uint16_t h[2] = {evpack::float_to_half(v.uv[0]), evpack::float_to_half(v.uv[1])};
+        std::memcpy(p, h, 4);
+        p += 4;
+      }
+      if (layout.wide_joints) {
+        std::memcpy(p, v.joints, 8);
+        p += 8;
+      } else {
+        uint8_t j[4] = {(uint8_t)v.joints[0], (uint8_t)v.joints[1],
+                        (uint8_t)v.joints[2], (uint8_t)v.joints[3]};
+        std::memcpy(p, j, 4);
+        p += 4;
+      }
+      evpack::pack_unorm8_weights(v.weights, p);
+    }
+  });
+  return layout;
+}
+
+// Attribute pointers for a compact VBO bound to the current VAO
+inline void set_compact_skinned_attributes(const CompactSkinnedLayout& layout) {
+  GLsizei stride = layout.stride;
+  size_t offset = 0;
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, int_to_ptr(offset));
+  glEnableVertexAttribArray(0);
+  offset += 12;
+  glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, int_to_ptr(offset));
+  glEnableVertexAttribArray(1);
+  offset += 4;
+  glVertexAttribPointer(2, 2, layout.float_uvs ? GL_FLOAT : GL_HALF_FLOAT, GL_FALSE, stride,
+                        int_to_ptr(offset));
+  glEnableVertexAttribArray(2);
+  offset += layout.float_uvs ? 8 : 4;
+  set_vertex_attrib_i_pointer(3, 4, layout.wide_joints ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE,
+                              stride, offset);
+  glEnableVertexAttribArray(3);
+  offset += layout.wide_joints ? 8 : 4;
+  glVertexAttribPointer(4, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, int_to_ptr(offset));
+  glEnableVertexAttribArray(4);
+}
+
+// Build, pack and upload mesh_index to the bound GL_ARRAY_BUFFER and set
+// the bound VAO's attributes. Returns the vertex count.
+inline int upload_compact_skinned_vertices(ozz::vector<ozz::sample::Mesh>* meshes, int mesh_index) {
+  std::vector<SkinnedVertex> vertices;
+  int count = build_skinned_vertices(meshes, mesh_index, vertices);
+  std::vector<unsigned char> packed;
+  CompactSkinnedLayout layout = pack_compact_skinned_vertices(vertices, packed);
+  glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)packed.size(), packed.data(), GL_STATIC_DRAW);
+  set_compact_skinned_attributes(layout);
+  return count;
+}
 } // namespace emesh
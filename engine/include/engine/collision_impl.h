@@ -2,166 +2,1729 @@
 #include <glm/glm.hpp>
 #include <vector>
 #include <cmath>
+#include <cfloat>
+#include <algorithm>
+#include <utility>
+#include <unordered_map>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "engine/gc_alloc_impl.h"
+#include "engine/memtrack_impl.h"
 
 namespace ecol {
-// Raycast down from position, find highest ground below
-// Returns ground Y coordinate, or -99999.0f if no ground found
-inline float raycast_ground(
-    std::vector<glm::vec3>* positions,
-    std::vector<unsigned int>* indices,
-    float px, float py, float pz
+
+// Collision vertices and triangle indices. Large and pointer-free, so they
+// live outside the collector's scan (egc::AtomicAllocator).
+using Positions = egc::atomic_vector<glm::vec3>;
+using Indices = egc::atomic_vector<unsigned int>;
+
+// ============================================================================
+// Triangle table
+// ============================================================================
+
+// Precomputed triangle table, stored as blocks of four triangles with one
+// SIMD lane per triangle (v0, both edges and the unit normal). Built once by
+// build_bvh in leaf order, so traversal reads it linearly with no index
+// gathers. Unused lanes are zeroed, which makes them degenerate and never hit.
+struct Tri4 {
+    float v0x[4], v0y[4], v0z[4];
+    float e1x[4], e1y[4], e1z[4];
+    float e2x[4], e2y[4], e2z[4];
+    float nx[4], ny[4], nz[4];
+    unsigned int id[4];
+};
+
+inline void pack_tri4(
+    Positions* positions,
+    Indices* indices,
+    const unsigned int* tri_ids, unsigned int count,
+    Tri4* out
 ) {
-    const float EPSILON = 0.000001f;
-    float ray_height = py + 100.0f;
-    glm::vec3 ray_origin(px, ray_height, pz);
-    glm::vec3 ray_dir(0.0f, -1.0f, 0.0f);
+    for (unsigned int k = 0; k < 4; k++) {
+        glm::vec3 v0(0.0f), e1(0.0f), e2(0.0f), n(0.0f);
+        unsigned int tri = 0;
+        if (k < count) {
+            tri = tri_ids[k];
+            v0 = (*positions)[(*indices)[tri*3]];
+            e1 = (*positions)[(*indices)[tri*3+1]] - v0;
+            e2 = (*positions)[(*indices)[tri*3+2]] - v0;
+            glm::vec3 c = glm::cross(e1, e2);
+            float len = glm::length(c);
+            if (len > 0.0f) n = c / len;
+        }
+        out->v0x[k] = v0.x; out->v0y[k] = v0.y; out->v0z[k] = v0.z;
+        out->e1x[k] = e1.x; out->e1y[k] = e1.y; out->e1z[k] = e1.z;
+        out->e2x[k] = e2.x; out->e2y[k] = e2.y; out->e2z[k] = e2.z;
+        out->nx[k] = n.x; out->ny[k] = n.y; out->nz[k] = n.z;
+        out->id[k] = tri;
+    }
+}
+
+// ============================================================================
+// Mesh cleanup
+// ============================================================================
+// Level meshes come out of exporters and brush CSG with every face's
+// vertices separate, faces of touching brushes pressed back to back, and
+// zero-area slivers. All of it gets a place in the tree and is tested by
+// every ray, so clean_mesh strips it before the BVH is built:
+//   1. Weld: vertices within weld_epsilon of an earlier one take its index
+//      (and position). Cells of weld_epsilon, searched 3x3x3.
+//   2. Drop triangles with a repeated corner or (near) zero area.
+//   3. Drop repeats of a triangle over the same three corners, and with
+//      drop_back_to_back, both faces of a pair wound oppositely over them:
+//      two solids touching there, so neither face can be reached.
+//   4. Drop vertices no triangle uses.
 
-    float closest_y = -99999.0f;
-    bool found = false;
+struct CleanStats {
+    unsigned int vertices_in = 0, vertices_out = 0;
+    unsigned int triangles_in = 0, triangles_out = 0;
+    unsigned int degenerate = 0;      // Triangles
+    unsigned int duplicate = 0;       // Triangles
+    unsigned int back_to_back = 0;    // Pairs
+};
 
+inline CleanStats* create_clean_stats() {
+    return new CleanStats();
+}
+
+inline void destroy_clean_stats(CleanStats* stats) {
+    delete stats;
+}
+
+// Weld cell of p, packed 21 bits an axis (exact, unlike a hash)
+inline long long weld_cell_key(long long cx, long long cy, long long cz) {
+    const long long mask = (1LL << 21) - 1;
+    return ((cx & mask) << 42) | ((cy & mask) << 21) | (cz & mask);
+}
+
+// Clean positions/indices in place. stats may be null.
+inline void clean_mesh(
+    Positions* positions,
+    Indices* indices,
+    float weld_epsilon,
+    bool drop_back_to_back,
+    CleanStats* stats
+) {
+    CleanStats local;
+    CleanStats& st = stats ? *stats : local;
+    st = CleanStats();
+    size_t num_verts = positions->size();
     size_t num_tris = indices->size() / 3;
-    for (size_t i = 0; i < num_tris; i++) {
+    st.vertices_in = (unsigned int)num_verts;
+    st.triangles_in = (unsigned int)num_tris;
+
+    // 1. Weld: cell -> first vertex in it, chained through next
+    std::vector<unsigned int> remap(num_verts);
+    if (weld_epsilon > 0.0f) {
+        const unsigned int NONE = 0xFFFFFFFFu;
+        float inv_cell = 1.0f / weld_epsilon;
+        float eps2 = weld_epsilon * weld_epsilon;
+        std::unordered_map<long long, unsigned int> cell_head;
+        std::vector<unsigned int> next(num_verts, NONE);
+        cell_head.reserve(num_verts);
+        for (size_t v = 0; v < num_verts; v++) {
+            const glm::vec3& p = (*positions)[v];
+            long long cx = (long long)floorf(p.x * inv_cell);
+            long long cy = (long long)floorf(p.y * inv_cell);
+            long long cz = (long long)floorf(p.z * inv_cell);
+            unsigned int found = NONE;
+            for (int dx = -1; dx <= 1 && found == NONE; dx++) {
+                for (int dy = -1; dy <= 1 && found == NONE; dy++) {
+                    for (int dz = -1; dz <= 1 && found == NONE; dz++) {
+                        auto it = cell_head.find(weld_cell_key(cx + dx, cy + dy, cz + dz));
+                        if (it == cell_head.end()) continue;
+                        for (unsigned int u = it->second; u != NONE; u = next[u]) {
+                            glm::vec3 d = (*positions)[u] - p;
+                            if (glm::dot(d, d) <= eps2) {
+                                found = u;
+                                break;
+                            }
+                        }
+                    }
+                }
+            }
+            if (found != NONE) {
+                remap[v] = found;
+                continue;
+            }
+            // Only representatives are chained, so welds never drift
+            remap[v] = (unsigned int)v;
+            auto it = cell_head.find(weld_cell_key(cx, cy, cz));
+            if (it == cell_head.end()) {
+                cell_head.emplace(weld_cell_key(cx, cy, cz), (unsigned int)v);
+            } else {
+                next[v] = it->second;
+                it->second = (unsigned int)v;
+            }
+        }
+    } else {
+        for (size_t v = 0; v < num_verts; v++) remap[v] = (unsigned int)v;
+    }
+
+    // 2 and 3. Triangles, keyed by their corners with the smallest first
+    // and the other two in order; the flag is the winding
+    struct TriKey {
+        unsigned int a, b, c;
+        bool operator==(const TriKey& o) const { return a == o.a && b == o.b && c == o.c; }
+    };
+    struct TriKeyHash {
+        size_t operator()(const TriKey& k) const {
+            return (size_t)k.a * 73856093u ^ (size_t)k.b * 19349663u ^ (size_t)k.c * 83492791u;
+        }
+    };
+    std::unordered_map<TriKey, unsigned int, TriKeyHash> seen;  // -> kept triangle
+    seen.reserve(num_tris);
+    std::vector<bool> keep(num_tris, false);
+    std::vector<bool> flipped(num_tris, false);
+    for (size_t t = 0; t < num_tris; t++) {
+        unsigned int i0 = remap[(*indices)[t * 3]];
+        unsigned int i1 = remap[(*indices)[t * 3 + 1]];
+        unsigned int i2 = remap[(*indices)[t * 3 + 2]];
+        if (i0 == i1 || i1 == i2 || i0 == i2) {
+            st.degenerate++;
+            continue;
+        }
+        glm::vec3 v0 = (*positions)[i0];
+        glm::vec3 c = glm::cross((*positions)[i1] - v0, (*positions)[i2] - v0);
+        if (glm::dot(c, c) < 1e-12f) {
+            st.degenerate++;
+            continue;
+        }
+        // Rotate the smallest corner first; winding is then whether the
+        // other two come in increasing order
+        unsigned int r0 = i0, r1 = i1, r2 = i2;
+        while (r0 > r1 || r0 > r2) {
+            unsigned int tmp = r0;
+            r0 = r1;
+            r1 = r2;
+            r2 = tmp;
+        }
+        bool flip = r1 > r2;
+        TriKey key{r0, flip ? r2 : r1, flip ? r1 : r2};
+        auto it = seen.find(key);
+        if (it == seen.end()) {
+            seen.emplace(key, (unsigned int)t);
+            keep[t] = true;
+            flipped[t] = flip;
+            (*indices)[t * 3] = i0;
+            (*indices)[t * 3 + 1] = i1;
+            (*indices)[t * 3 + 2] = i2;
+        } else if (flipped[it->second] == flip || !drop_back_to_back) {
+            st.duplicate++;
+        } else {
+            // The pair goes; a third face over these corners starts afresh
+            keep[it->second] = false;
+            seen.erase(it);
+            st.back_to_back++;
+        }
+    }
+
+    // 4. Compact triangles, then vertices
+    std::vector<unsigned int> new_index(num_verts, 0xFFFFFFFFu);
+    Positions out_positions;
+    size_t out_tris = 0;
+    for (size_t t = 0; t < num_tris; t++) {
+        if (!keep[t]) continue;
+        for (int k = 0; k < 3; k++) {
+            unsigned int v = (*indices)[t * 3 + k];
+            if (new_index[v] == 0xFFFFFFFFu) {
+                new_index[v] = (unsigned int)out_positions.size();
+                out_positions.push_back((*positions)[v]);
+            }
+            (*indices)[out_tris * 3 + k] = new_index[v];
+        }
+        out_tris++;
+    }
+    indices->resize(out_tris * 3);
+    indices->shrink_to_fit();
+    positions->swap(out_positions);
+    st.vertices_out = (unsigned int)positions->size();
+    st.triangles_out = (unsigned int)out_tris;
+}
+
+// ============================================================================
+// BVH
+// ============================================================================
+
+// Flattened BVH node. Interior nodes store the index of their left child
+// in left_first (the right child is always left_first + 1) and count == 0.
+// Leaves store their first block in Bvh::tris and their triangle count.
+struct BvhNode {
+    glm::vec3 bmin;
+    unsigned int left_first;
+    glm::vec3 bmax;
+    unsigned int count;
+};
+
+// One independently built sub-tree of a piecewise Bvh (see bvh_add_piece)
+struct BvhPiece {
+    BvhNode root;
+    unsigned int vert_first = 0, vert_count = 0;
+    unsigned int tri_first = 0, tri_count = 0;
+    unsigned int node_first = 0, node_count = 0;     // its sub-tree in Bvh::nodes
+    unsigned int block_first = 0, block_count = 0;   // its leaves' blocks in Bvh::tris
+    bool live = false;
+};
+
+struct Bvh {
+    egc::atomic_vector<BvhNode> nodes;
+    egc::atomic_vector<Tri4> tris;  // leaf triangles, packed four per block
+    Indices tri_slot;               // triangle id -> block * 4 + lane
+    Indices adj_offsets;            // CSR: neighbors of triangle i are
+    Indices adj_list;               // adj_list[adj_offsets[i] .. [i+1])
+    // Piecewise trees only: nodes[0] is the top-level root, piece sub-trees
+    // fill [1, piece_nodes_end) and the rest of the top level follows them
+    std::vector<BvhPiece> pieces;
+    Indices tri_piece;                    // triangle id -> piece handle
+    std::vector<unsigned int> free_pieces;
+    unsigned int piece_nodes_end = 0;
+    unsigned int live_tris = 0;
+    unsigned int dead_tris = 0;
+    ememtrack::Account account{ememtrack::CAT_COLLISION};
+};
+
+// Report what the tree's arrays hold now (not the mesh it indexes)
+inline void bvh_account(Bvh* bvh) {
+    bvh->account.set_ram((int64_t)(
+        bvh->nodes.capacity() * sizeof(BvhNode) +
+        bvh->tris.capacity() * sizeof(Tri4) +
+        (bvh->tri_slot.capacity() + bvh->adj_offsets.capacity() + bvh->adj_list.capacity() +
+         bvh->tri_piece.capacity()) * sizeof(unsigned int) +
+        bvh->pieces.capacity() * sizeof(BvhPiece)));
+}
+
+const unsigned int BVH_LEAF_SIZE = 4;
+const int BVH_MAX_DEPTH = 64;
+// Fixed traversal stacks: one slot a level plus one. A piecewise tree puts
+// its top level (log2(pieces) deep) over sub-trees of up to BVH_MAX_DEPTH.
+const int BVH_STACK_SIZE = 2 * BVH_MAX_DEPTH + 1;
+const unsigned int MAX_TRI_NEIGHBORS = 32;
+const float WELD_GRID = 1000.0f;  // vertices within 1/1000 unit share a corner
+
+// Triangles sharing a corner, welded by position since level meshes rarely
+// share vertex indices across faces. Capped at MAX_TRI_NEIGHBORS per triangle.
+inline void build_adjacency(
+    Bvh* bvh,
+    Positions* positions,
+    Indices* indices
+) {
+    unsigned int num_tris = (unsigned int)(indices->size() / 3);
+    std::unordered_map<long long, unsigned int> weld;
+    std::vector<unsigned int> corner(indices->size());
+    for (size_t i = 0; i < indices->size(); i++) {
+        glm::vec3 p = (*positions)[(*indices)[i]];
+        long long qx = (long long)floorf(p.x * WELD_GRID);
+        long long qy = (long long)floorf(p.y * WELD_GRID);
+        long long qz = (long long)floorf(p.z * WELD_GRID);
+        long long key = weld_cell_key(qx, qy, qz);
+        auto it = weld.find(key);
+        if (it == weld.end()) it = weld.emplace(key, (unsigned int)weld.size()).first;
+        corner[i] = it->second;
+    }
+
+    // Corner -> triangles touching it
+    std::vector<unsigned int> corner_offsets(weld.size() + 1, 0);
+    for (unsigned int c : corner) corner_offsets[c + 1]++;
+    for (size_t c = 0; c < weld.size(); c++) corner_offsets[c + 1] += corner_offsets[c];
+    std::vector<unsigned int> corner_tris(corner.size());
+    std::vector<unsigned int> fill(corner_offsets.begin(), corner_offsets.end() - 1);
+    for (size_t i = 0; i < corner.size(); i++) corner_tris[fill[corner[i]]++] = (unsigned int)(i / 3);
+
+    bvh->adj_offsets.assign(num_tris + 1, 0);
+    bvh->adj_list.clear();
+    for (unsigned int t = 0; t < num_tris; t++) {
+        unsigned int start = (unsigned int)bvh->adj_list.size();
+        for (int k = 0; k < 3; k++) {
+            unsigned int c = corner[t * 3 + k];
+            for (unsigned int j = corner_offsets[c]; j < corner_offsets[c + 1]; j++) {
+                unsigned int other = corner_tris[j];
+                if (other == t) continue;
+                if (bvh->adj_list.size() - start >= MAX_TRI_NEIGHBORS) break;
+                if (std::find(bvh->adj_list.begin() + start, bvh->adj_list.end(), other)
+                    == bvh->adj_list.end()) {
+                    bvh->adj_list.push_back(other);
+                }
+            }
+        }
+        bvh->adj_offsets[t + 1] = (unsigned int)bvh->adj_list.size();
+    }
+}
+
+inline void bvh_fit_node(
+    std::vector<unsigned int>* tri_order, BvhNode& node,
+    std::vector<glm::vec3>* tri_min, std::vector<glm::vec3>* tri_max
+) {
+    node.bmin = glm::vec3(FLT_MAX);
+    node.bmax = glm::vec3(-FLT_MAX);
+    for (unsigned int i = 0; i < node.count; i++) {
+        unsigned int tri = (*tri_order)[node.left_first + i];
+        node.bmin = glm::min(node.bmin, (*tri_min)[tri]);
+        node.bmax = glm::max(node.bmax, (*tri_max)[tri]);
+    }
+}
+
+// Build a BVH over an indexed triangle mesh.
+// Splits at the centroid midpoint of the longest axis, falling back to a
+// median split when all centroids land on one side.
+// Caller owns the result (call destroy_bvh when the mesh is released).
+inline Bvh* build_bvh(
+    Positions* positions,
+    Indices* indices
+) {
+    Bvh* bvh = new Bvh();
+    unsigned int num_tris = (unsigned int)(indices->size() / 3);
+    if (num_tris == 0) return bvh;
+
+    std::vector<glm::vec3> tri_min(num_tris);
+    std::vector<glm::vec3> tri_max(num_tris);
+    std::vector<glm::vec3> centroid(num_tris);
+    std::vector<unsigned int> tri_order(num_tris);
+    for (unsigned int i = 0; i < num_tris; i++) {
         glm::vec3 v0 = (*positions)[(*indices)[i*3]];
         glm::vec3 v1 = (*positions)[(*indices)[i*3+1]];
         glm::vec3 v2 = (*positions)[(*indices)[i*3+2]];
+        tri_min[i] = glm::min(v0, glm::min(v1, v2));
+        tri_max[i] = glm::max(v0, glm::max(v1, v2));
+        centroid[i] = (v0 + v1 + v2) * (1.0f / 3.0f);
+        tri_order[i] = i;
+    }
 
-        // Moller-Trumbore ray-triangle intersection
-        glm::vec3 edge1 = v1 - v0;
-        glm::vec3 edge2 = v2 - v0;
-        glm::vec3 h = glm::cross(ray_dir, edge2);
-        float a = glm::dot(edge1, h);
+    bvh->nodes.reserve(num_tris * 2);
+    BvhNode root;
+    root.left_first = 0;
+    root.count = num_tris;
+    bvh_fit_node(&tri_order, root, &tri_min, &tri_max);
+    bvh->nodes.push_back(root);
 
-        if (fabs(a) < EPSILON) continue;
+    // (node, depth) pairs; depth is capped so traversal's fixed stack
+    // (BVH_STACK_SIZE) suffices
+    std::vector<std::pair<unsigned int, int>> stack;
+    stack.push_back({0, 0});
+    while (!stack.empty()) {
+        unsigned int node_idx = stack.back().first;
+        int depth = stack.back().second;
+        stack.pop_back();
+        BvhNode node = bvh->nodes[node_idx];
+        if (node.count <= BVH_LEAF_SIZE || depth >= BVH_MAX_DEPTH - 1) continue;
 
-        float f = 1.0f / a;
-        glm::vec3 s = ray_origin - v0;
-        float u = f * glm::dot(s, h);
-        if (u < 0.0f || u > 1.0f) continue;
-
-        glm::vec3 q = glm::cross(s, edge1);
-        float v = f * glm::dot(ray_dir, q);
-        if (v < 0.0f || u + v > 1.0f) continue;
-
-        float t = f * glm::dot(edge2, q);
-        if (t > EPSILON) {
-            float hit_y = ray_height - t;
-            if (hit_y > closest_y) {
-                closest_y = hit_y;
-                found = true;
+        // Centroid bounds decide the split axis
+        glm::vec3 cmin(FLT_MAX), cmax(-FLT_MAX);
+        for (unsigned int i = 0; i < node.count; i++) {
+            glm::vec3 c = centroid[tri_order[node.left_first + i]];
+            cmin = glm::min(cmin, c);
+            cmax = glm::max(cmax, c);
+        }
+        glm::vec3 extent = cmax - cmin;
+        int axis = 0;
+        if (extent.y > extent.x) axis = 1;
+        if (extent.z > extent[axis]) axis = 2;
+        if (extent[axis] <= 0.0f) continue;  // all centroids coincide
+        float split = cmin[axis] + extent[axis] * 0.5f;
+
+        unsigned int* first = &tri_order[node.left_first];
+        unsigned int* last = first + node.count;
+        unsigned int* mid = std::partition(first, last, [&](unsigned int tri) {
+            return centroid[tri][axis] < split;
+        });
+        unsigned int left_count = (unsigned int)(mid - first);
+        if (left_count == 0 || left_count == node.count) {
+            left_count = node.count / 2;
+            std::nth_element(first, first + left_count, last,
+                [&](unsigned int a, unsigned int b) {
+                    return centroid[a][axis] < centroid[b][axis];
+                });
+        }
+
+        BvhNode left, right;
+        left.left_first = node.left_first;
+        left.count = left_count;
+        right.left_first = node.left_first + left_count;
+        right.count = node.count - left_count;
+        bvh_fit_node(&tri_order, left, &tri_min, &tri_max);
+        bvh_fit_node(&tri_order, right, &tri_min, &tri_max);
+
+        unsigned int left_idx = (unsigned int)bvh->nodes.size();
+        bvh->nodes.push_back(left);
+        bvh->nodes.push_back(right);
+        bvh->nodes[node_idx].left_first = left_idx;
+        bvh->nodes[node_idx].count = 0;
+        stack.push_back({left_idx, depth + 1});
+        stack.push_back({left_idx + 1, depth + 1});
+    }
+
+    // Pack each leaf's triangles into the table and repoint the leaf at it
+    bvh->tris.reserve(num_tris / 2);
+    bvh->tri_slot.resize(num_tris);
+    for (BvhNode& node : bvh->nodes) {
+        if (node.count == 0) continue;
+        unsigned int first_block = (unsigned int)bvh->tris.size();
+        for (unsigned int i = 0; i < node.count; i += 4) {
+            Tri4 block;
+            unsigned int n = std::min(4u, node.count - i);
+            pack_tri4(positions, indices, &tri_order[node.left_first + i], n, &block);
+            for (unsigned int k = 0; k < n; k++) {
+                bvh->tri_slot[block.id[k]] = (unsigned int)bvh->tris.size() * 4 + k;
             }
+            bvh->tris.push_back(block);
         }
+        node.left_first = first_block;
     }
 
-    return found ? closest_y : -99999.0f;
+    build_adjacency(bvh, positions, indices);
+    bvh_account(bvh);
+    return bvh;
 }
-// Ground raycast with surface normal output
-// Returns ground Y, writes hit triangle normal to out_nx/ny/nz
-// Returns -99999.0f if no ground found
-inline float raycast_ground_normal(
-    std::vector<glm::vec3>* positions,
-    std::vector<unsigned int>* indices,
-    float px, float py, float pz,
-    float* out_nx, float* out_ny, float* out_nz
+
+inline void destroy_bvh(Bvh* bvh) {
+    delete bvh;
+}
+
+// ============================================================================
+// Piecewise BVH
+// ============================================================================
+// For meshes edited a piece at a time (the course editor) or paged in and
+// out (streamed level sectors). Each piece keeps its own sub-tree inside
+// the shared node/table arrays, and a small top level over the piece roots
+// is rebuilt on every edit, so an edit costs O(piece + pieces) rather than
+// a whole-mesh rebuild. A piece's sub-tree is built on add, or given
+// already built (bvh_add_built_piece). Removed pieces are tombstoned and
+// compacted once dead triangles outnumber live ones; compaction moves the
+// live sub-trees rather than rebuilding them. Queries take the result like
+// any other Bvh, with the positions/indices vectors it fills.
+
+inline Bvh* create_piece_bvh() {
+    return new Bvh();
+}
+
+// Append a piece's triangles and sub, a Bvh built over them alone (node,
+// block and triangle ids local to it). Leaves the top level stale.
+inline void bvh_splice_piece(
+    Bvh* bvh,
+    Positions* positions,
+    Indices* indices,
+    unsigned int piece,
+    const Positions* piece_positions,
+    const Indices* piece_indices,
+    const Bvh* sub
+) {
+    if (bvh->nodes.empty()) {
+        bvh->nodes.push_back(BvhNode());  // top-level root slot
+        bvh->piece_nodes_end = 1;
+    }
+    bvh->nodes.resize(bvh->piece_nodes_end);
+
+    BvhPiece& p = bvh->pieces[piece];
+    p.vert_first = (unsigned int)positions->size();
+    p.vert_count = (unsigned int)piece_positions->size();
+    p.tri_first = (unsigned int)(indices->size() / 3);
+    p.tri_count = (unsigned int)(piece_indices->size() / 3);
+    p.node_first = p.node_count = 0;
+    p.block_first = p.block_count = 0;
+    p.live = true;
+    bvh->live_tris += p.tri_count;
+    if (p.tri_count == 0) return;
+
+    positions->insert(positions->end(), piece_positions->begin(), piece_positions->end());
+    for (unsigned int idx : *piece_indices) indices->push_back(idx + p.vert_first);
+
+    unsigned int node_base = (unsigned int)bvh->nodes.size();
+    unsigned int block_base = (unsigned int)bvh->tris.size();
+    for (BvhNode node : sub->nodes) {
+        node.left_first += node.count > 0 ? block_base : node_base;
+        bvh->nodes.push_back(node);
+    }
+    for (Tri4 block : sub->tris) {
+        for (int k = 0; k < 4; k++) block.id[k] += p.tri_first;
+        bvh->tris.push_back(block);
+    }
+    if (bvh->adj_offsets.empty()) bvh->adj_offsets.push_back(0);
+    for (unsigned int t = 0; t < p.tri_count; t++) {
+        bvh->tri_slot.push_back(sub->tri_slot[t] + block_base * 4);
+        bvh->tri_piece.push_back(piece);
+        for (unsigned int j = sub->adj_offsets.empty() ? 0 : sub->adj_offsets[t];
+             j < (sub->adj_offsets.empty() ? 0 : sub->adj_offsets[t + 1]); j++) {
+            bvh->adj_list.push_back(sub->adj_list[j] + p.tri_first);
+        }
+        bvh->adj_offsets.push_back((unsigned int)bvh->adj_list.size());
+    }
+    p.root = bvh->nodes[node_base];
+    p.node_first = node_base;
+    p.node_count = (unsigned int)sub->nodes.size();
+    p.block_first = block_base;
+    p.block_count = (unsigned int)sub->tris.size();
+    bvh->piece_nodes_end = (unsigned int)bvh->nodes.size();
+}
+
+// Build a piece's sub-tree and append it. Leaves the top level stale.
+inline void bvh_append_piece(
+    Bvh* bvh,
+    Positions* positions,
+    Indices* indices,
+    unsigned int piece,
+    Positions* piece_positions,
+    Indices* piece_indices
+) {
+    if (piece_indices->empty()) {
+        bvh_splice_piece(bvh, positions, indices, piece, piece_positions, piece_indices, nullptr);
+        return;
+    }
+    Bvh* sub = build_bvh(piece_positions, piece_indices);
+    bvh_splice_piece(bvh, positions, indices, piece, piece_positions, piece_indices, sub);
+    destroy_bvh(sub);
+}
+
+// Copy a live piece's triangles and sub-tree out of old arrays, ids made
+// local again, as bvh_splice_piece takes them
+inline void bvh_extract_piece(
+    const Bvh* old,
+    const Positions* old_positions,
+    const Indices* old_indices,
+    const BvhPiece& p,
+    Positions* piece_positions,
+    Indices* piece_indices,
+    Bvh* sub
+) {
+    piece_positions->assign(old_positions->begin() + p.vert_first,
+                            old_positions->begin() + p.vert_first + p.vert_count);
+    piece_indices->clear();
+    for (unsigned int j = p.tri_first * 3; j < (p.tri_first + p.tri_count) * 3; j++) {
+        piece_indices->push_back((*old_indices)[j] - p.vert_first);
+    }
+    sub->nodes.clear();
+    sub->tris.clear();
+    sub->tri_slot.clear();
+    sub->adj_offsets.clear();
+    sub->adj_list.clear();
+    for (unsigned int i = p.node_first; i < p.node_first + p.node_count; i++) {
+        BvhNode node = old->nodes[i];
+        node.left_first -= node.count > 0 ? p.block_first : p.node_first;
+        sub->nodes.push_back(node);
+    }
+    for (unsigned int i = p.block_first; i < p.block_first + p.block_count; i++) {
+        Tri4 block = old->tris[i];
+        for (int k = 0; k < 4; k++) block.id[k] -= p.tri_first;
+        sub->tris.push_back(block);
+    }
+    sub->adj_offsets.push_back(0);
+    for (unsigned int t = p.tri_first; t < p.tri_first + p.tri_count; t++) {
+        sub->tri_slot.push_back(old->tri_slot[t] - p.block_first * 4);
+        for (unsigned int j = old->adj_offsets[t]; j < old->adj_offsets[t + 1]; j++) {
+            sub->adj_list.push_back(old->adj_list[j] - p.tri_first);
+        }
+        sub->adj_offsets.push_back((unsigned int)sub->adj_list.size());
+    }
+}
+
+// Rebuild the top level over live piece roots. Leaves of the top level are
+// copies of the piece roots, so traversal descends into the sub-trees as-is.
+// Median splits keep it log2(pieces) deep.
+inline void bvh_build_top(
+    Bvh* bvh,
+    Positions* positions,
+    Indices* indices
+) {
+    std::vector<unsigned int> order;
+    for (unsigned int i = 0; i < bvh->pieces.size(); i++) {
+        if (bvh->pieces[i].live && bvh->pieces[i].tri_count > 0) order.push_back(i);
+    }
+    if (order.empty()) {
+        // Nothing left to hit: drop all triangle data, tombstones included
+        positions->clear();
+        indices->clear();
+        bvh->nodes.clear();
+        bvh->tris.clear();
+        bvh->tri_slot.clear();
+        bvh->tri_piece.clear();
+        bvh->adj_offsets.clear();
+        bvh->adj_list.clear();
+        bvh->piece_nodes_end = 0;
+        bvh->dead_tris = 0;
+        bvh_account(bvh);
+        return;
+    }
+
+    bvh->nodes.resize(bvh->piece_nodes_end);
+    auto center = [&](unsigned int piece, int axis) {
+        const BvhNode& r = bvh->pieces[piece].root;
+        return r.bmin[axis] + r.bmax[axis];
+    };
+    // (node, begin, end) over order
+    struct Range { unsigned int node, begin, end; };
+    std::vector<Range> stack;
+    stack.push_back({0, 0, (unsigned int)order.size()});
+    while (!stack.empty()) {
+        Range r = stack.back();
+        stack.pop_back();
+        if (r.end - r.begin == 1) {
+            bvh->nodes[r.node] = bvh->pieces[order[r.begin]].root;
+            continue;
+        }
+        BvhNode node;
+        node.bmin = glm::vec3(FLT_MAX);
+        node.bmax = glm::vec3(-FLT_MAX);
+        for (unsigned int i = r.begin; i < r.end; i++) {
+            node.bmin = glm::min(node.bmin, bvh->pieces[order[i]].root.bmin);
+            node.bmax = glm::max(node.bmax, bvh->pieces[order[i]].root.bmax);
+        }
+        glm::vec3 extent = node.bmax - node.bmin;
+        int axis = 0;
+        if (extent.y > extent.x) axis = 1;
+        if (extent.z > extent[axis]) axis = 2;
+        unsigned int mid = r.begin + (r.end - r.begin) / 2;
+        std::nth_element(order.begin() + r.begin, order.begin() + mid, order.begin() + r.end,
+            [&](unsigned int a, unsigned int b) { return center(a, axis) < center(b, axis); });
+
+        unsigned int left_idx = (unsigned int)bvh->nodes.size();
+        bvh->nodes.push_back(BvhNode());
+        bvh->nodes.push_back(BvhNode());
+        node.left_first = left_idx;
+        node.count = 0;
+        bvh->nodes[r.node] = node;
+        stack.push_back({left_idx, r.begin, mid});
+        stack.push_back({left_idx + 1, mid, r.end});
+    }
+    bvh_account(bvh);
+}
+
+// Re-append every live piece, discarding tombstoned data. Sub-trees are
+// moved, not rebuilt. Handles are kept.
+inline void bvh_compact_pieces(
+    Bvh* bvh,
+    Positions* positions,
+    Indices* indices
+) {
+    Positions old_positions;
+    Indices old_indices;
+    old_positions.swap(*positions);
+    old_indices.swap(*indices);
+    Bvh old;
+    old.nodes.swap(bvh->nodes);
+    old.tris.swap(bvh->tris);
+    old.tri_slot.swap(bvh->tri_slot);
+    old.adj_offsets.swap(bvh->adj_offsets);
+    old.adj_list.swap(bvh->adj_list);
+    bvh->nodes.clear();
+    bvh->tris.clear();
+    bvh->tri_slot.clear();
+    bvh->tri_piece.clear();
+    bvh->adj_offsets.clear();
+    bvh->adj_list.clear();
+    bvh->piece_nodes_end = 0;
+    bvh->live_tris = 0;
+    bvh->dead_tris = 0;
+
+    Positions piece_positions;
+    Indices piece_indices;
+    Bvh sub;
+    for (unsigned int i = 0; i < bvh->pieces.size(); i++) {
+        BvhPiece& p = bvh->pieces[i];
+        if (!p.live) continue;
+        bvh_extract_piece(&old, &old_positions, &old_indices, p, &piece_positions, &piece_indices,
+                          &sub);
+        bvh_splice_piece(bvh, positions, indices, i, &piece_positions, &piece_indices, &sub);
+    }
+}
+
+// A free piece handle, reused or new
+inline unsigned int bvh_alloc_piece(Bvh* bvh) {
+    if (!bvh->free_pieces.empty()) {
+        unsigned int piece = bvh->free_pieces.back();
+        bvh->free_pieces.pop_back();
+        return piece;
+    }
+    bvh->pieces.push_back(BvhPiece());
+    return (unsigned int)(bvh->pieces.size() - 1);
+}
+
+// Add a piece (indices local to piece_positions). Returns its handle.
+inline int bvh_add_piece(
+    Bvh* bvh,
+    Positions* positions,
+    Indices* indices,
+    Positions* piece_positions,
+    Indices* piece_indices
+) {
+    unsigned int piece = bvh_alloc_piece(bvh);
+    bvh_append_piece(bvh, positions, indices, piece, piece_positions, piece_indices);
+    bvh_build_top(bvh, positions, indices);
+    return (int)piece;
+}
+
+// bvh_add_piece with its sub-tree already built over the piece alone (a
+// baked level sector). Returns its handle.
+inline int bvh_add_built_piece(
+    Bvh* bvh,
+    Positions* positions,
+    Indices* indices,
+    const Positions* piece_positions,
+    const Indices* piece_indices,
+    const Bvh* sub
+) {
+    unsigned int piece = bvh_alloc_piece(bvh);
+    bvh_splice_piece(bvh, positions, indices, piece, piece_positions, piece_indices, sub);
+    bvh_build_top(bvh, positions, indices);
+    return (int)piece;
+}
+
+// Remove a piece added with bvh_add_piece. Its triangles stay in the arrays
+// (degenerate, so a stale ProbeCache can't hit them) until compaction.
+inline void bvh_remove_piece(
+    Bvh* bvh,
+    Positions* positions,
+    Indices* indices,
+    int piece
+) {
+    if (piece < 0 || piece >= (int)bvh->pieces.size() || !bvh->pieces[piece].live) return;
+    BvhPiece& p = bvh->pieces[piece];
+    for (unsigned int t = p.tri_first; t < p.tri_first + p.tri_count; t++) {
+        unsigned int slot = bvh->tri_slot[t];
+        Tri4& b = bvh->tris[slot / 4];
+        int k = (int)(slot % 4);
+        b.e1x[k] = b.e1y[k] = b.e1z[k] = 0.0f;
+        b.e2x[k] = b.e2y[k] = b.e2z[k] = 0.0f;
+    }
+    p.live = false;
+    bvh->live_tris -= p.tri_count;
+    bvh->dead_tris += p.tri_count;
+    bvh->free_pieces.push_back((unsigned int)piece);
+
+    if (bvh->dead_tris > bvh->live_tris) {
+        bvh_compact_pieces(bvh, positions, indices);
+    }
+    bvh_build_top(bvh, positions, indices);
+}
+
+// Slab test. Returns entry distance, or FLT_MAX when the ray misses
+// the box or enters it beyond t_max.
+inline float ray_aabb(
+    const glm::vec3& origin, const glm::vec3& inv_dir,
+    const glm::vec3& bmin, const glm::vec3& bmax, float t_max
+) {
+    glm::vec3 t0 = (bmin - origin) * inv_dir;
+    glm::vec3 t1 = (bmax - origin) * inv_dir;
+    glm::vec3 tsmall = glm::min(t0, t1);
+    glm::vec3 tbig = glm::max(t0, t1);
+    float t_enter = std::max(std::max(tsmall.x, tsmall.y), std::max(tsmall.z, 0.0f));
+    float t_exit = std::min(std::min(tbig.x, tbig.y), std::min(tbig.z, t_max));
+    return t_enter <= t_exit ? t_enter : FLT_MAX;
+}
+
+// ============================================================================
+// Ray queries
+// ============================================================================
+
+// Moller-Trumbore ray-triangle intersection from a vertex and two edges
+// Returns true and writes the hit distance to out_t when t > EPSILON
+inline bool intersect_edges(
+    const glm::vec3& ray_origin, const glm::vec3& ray_dir,
+    const glm::vec3& v0, const glm::vec3& edge1, const glm::vec3& edge2,
+    float* out_t
 ) {
     const float EPSILON = 0.000001f;
-    float ray_height = py + 100.0f;
-    glm::vec3 ray_origin(px, ray_height, pz);
-    glm::vec3 ray_dir(0.0f, -1.0f, 0.0f);
+    glm::vec3 h = glm::cross(ray_dir, edge2);
+    float a = glm::dot(edge1, h);
 
-    float closest_y = -99999.0f;
-    bool found = false;
-    glm::vec3 hit_normal(0.0f, 1.0f, 0.0f);
+    if (fabs(a) < EPSILON) return false;
 
-    size_t num_tris = indices->size() / 3;
-    for (size_t i = 0; i < num_tris; i++) {
-        glm::vec3 v0 = (*positions)[(*indices)[i*3]];
-        glm::vec3 v1 = (*positions)[(*indices)[i*3+1]];
-        glm::vec3 v2 = (*positions)[(*indices)[i*3+2]];
+    float f = 1.0f / a;
+    glm::vec3 s = ray_origin - v0;
+    float u = f * glm::dot(s, h);
+    if (u < 0.0f || u > 1.0f) return false;
+
+    glm::vec3 q = glm::cross(s, edge1);
+    float v = f * glm::dot(ray_dir, q);
+    if (v < 0.0f || u + v > 1.0f) return false;
+
+    float t = f * glm::dot(edge2, q);
+    if (t > EPSILON) {
+        *out_t = t;
+        return true;
+    }
+    return false;
+}
+
+inline bool intersect_triangle(
+    const glm::vec3& ray_origin, const glm::vec3& ray_dir,
+    const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2,
+    float* out_t
+) {
+    return intersect_edges(ray_origin, ray_dir, v0, v1 - v0, v2 - v0, out_t);
+}
+
+// Moller-Trumbore against four triangles at once.
+// Returns the lane of the nearest hit closer than *closest_t (and updates
+// it), or -1. Uses SSE on x86; elsewhere the plain lane loops are left for
+// the compiler to vectorize (NEON on arm64).
+inline int intersect_tri4(
+    const Tri4& tri, const glm::vec3& o, const glm::vec3& d, float* closest_t
+) {
+    const float EPSILON = 0.000001f;
+    float t_lane[4];
+    int hit_mask = 0;
+#if defined(__SSE2__)
+    __m128 dx = _mm_set1_ps(d.x), dy = _mm_set1_ps(d.y), dz = _mm_set1_ps(d.z);
+    __m128 e1x = _mm_loadu_ps(tri.e1x), e1y = _mm_loadu_ps(tri.e1y), e1z = _mm_loadu_ps(tri.e1z);
+    __m128 e2x = _mm_loadu_ps(tri.e2x), e2y = _mm_loadu_ps(tri.e2y), e2z = _mm_loadu_ps(tri.e2z);
 
-        glm::vec3 edge1 = v1 - v0;
-        glm::vec3 edge2 = v2 - v0;
-        glm::vec3 h = glm::cross(ray_dir, edge2);
-        float a = glm::dot(edge1, h);
+    // h = cross(d, e2), a = dot(e1, h)
+    __m128 hx = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+    __m128 hy = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+    __m128 hz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+    __m128 a = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, hx), _mm_mul_ps(e1y, hy)), _mm_mul_ps(e1z, hz));
+    __m128 abs_a = _mm_andnot_ps(_mm_set1_ps(-0.0f), a);
+    __m128 mask = _mm_cmpge_ps(abs_a, _mm_set1_ps(EPSILON));
+    __m128 f = _mm_div_ps(_mm_set1_ps(1.0f), a);
 
-        if (fabs(a) < EPSILON) continue;
+    // s = o - v0, u = f * dot(s, h)
+    __m128 sx = _mm_sub_ps(_mm_set1_ps(o.x), _mm_loadu_ps(tri.v0x));
+    __m128 sy = _mm_sub_ps(_mm_set1_ps(o.y), _mm_loadu_ps(tri.v0y));
+    __m128 sz = _mm_sub_ps(_mm_set1_ps(o.z), _mm_loadu_ps(tri.v0z));
+    __m128 u = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, hx), _mm_mul_ps(sy, hy)), _mm_mul_ps(sz, hz)));
+    mask = _mm_and_ps(mask, _mm_cmpge_ps(u, _mm_setzero_ps()));
+    mask = _mm_and_ps(mask, _mm_cmple_ps(u, _mm_set1_ps(1.0f)));
 
+    // q = cross(s, e1), v = f * dot(d, q), t = f * dot(e2, q)
+    __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+    __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+    __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+    __m128 v = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)));
+    mask = _mm_and_ps(mask, _mm_cmpge_ps(v, _mm_setzero_ps()));
+    mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f)));
+    __m128 t = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)));
+    mask = _mm_and_ps(mask, _mm_cmpgt_ps(t, _mm_set1_ps(EPSILON)));
+    mask = _mm_and_ps(mask, _mm_cmplt_ps(t, _mm_set1_ps(*closest_t)));
+
+    hit_mask = _mm_movemask_ps(mask);
+    if (!hit_mask) return -1;
+    _mm_storeu_ps(t_lane, t);
+#else
+    for (int k = 0; k < 4; k++) {
+        float hx = d.y * tri.e2z[k] - d.z * tri.e2y[k];
+        float hy = d.z * tri.e2x[k] - d.x * tri.e2z[k];
+        float hz = d.x * tri.e2y[k] - d.y * tri.e2x[k];
+        float a = tri.e1x[k] * hx + tri.e1y[k] * hy + tri.e1z[k] * hz;
         float f = 1.0f / a;
-        glm::vec3 s = ray_origin - v0;
-        float u = f * glm::dot(s, h);
-        if (u < 0.0f || u > 1.0f) continue;
-
-        glm::vec3 q = glm::cross(s, edge1);
-        float v = f * glm::dot(ray_dir, q);
-        if (v < 0.0f || u + v > 1.0f) continue;
-
-        float t = f * glm::dot(edge2, q);
-        if (t > EPSILON) {
-            float hit_y = ray_height - t;
-            if (hit_y > closest_y) {
-                closest_y = hit_y;
-                found = true;
-                // Compute triangle normal
-                glm::vec3 n = glm::normalize(glm::cross(edge1, edge2));
-                // Ensure normal points upward
-                if (n.y < 0) n = -n;
-                hit_normal = n;
+        float sx = o.x - tri.v0x[k], sy = o.y - tri.v0y[k], sz = o.z - tri.v0z[k];
+        float u = f * (sx * hx + sy * hy + sz * hz);
+        float qx = sy * tri.e1z[k] - sz * tri.e1y[k];
+        float qy = sz * tri.e1x[k] - sx * tri.e1z[k];
+        float qz = sx * tri.e1y[k] - sy * tri.e1x[k];
+        float v = f * (d.x * qx + d.y * qy + d.z * qz);
+        float t = f * (tri.e2x[k] * qx + tri.e2y[k] * qy + tri.e2z[k] * qz);
+        bool hit = fabsf(a) >= EPSILON && u >= 0.0f && u <= 1.0f
+                   && v >= 0.0f && u + v <= 1.0f
+                   && t > EPSILON && t < *closest_t;
+        t_lane[k] = t;
+        hit_mask |= (hit ? 1 : 0) << k;
+    }
+    if (!hit_mask) return -1;
+#endif
+
+    int best = -1;
+    for (int k = 0; k < 4; k++) {
+        if ((hit_mask & (1 << k)) && t_lane[k] < *closest_t) {
+            *closest_t = t_lane[k];
+            best = k;
+        }
+    }
+    return best;
+}
+
+// Closest hit along a ray, strictly nearer than t_max.
+// Traverses the BVH when one is given, otherwise scans every triangle.
+// Returns the hit triangle id, or -1 if nothing was hit. out_normal (may be
+// null) receives the triangle's unit normal as wound, not flipped.
+inline long ray_closest_hit(
+    Positions* positions,
+    Indices* indices,
+    Bvh* bvh,
+    const glm::vec3& ray_origin, const glm::vec3& ray_dir,
+    float t_max, float* out_t, glm::vec3* out_normal
+) {
+    long hit_tri = -1;
+    float closest_t = t_max;
+
+    if (!bvh || bvh->nodes.empty()) {
+        size_t num_tris = indices->size() / 3;
+        for (size_t i = 0; i < num_tris; i++) {
+            float t;
+            if (intersect_triangle(ray_origin, ray_dir,
+                                   (*positions)[(*indices)[i*3]],
+                                   (*positions)[(*indices)[i*3+1]],
+                                   (*positions)[(*indices)[i*3+2]], &t)
+                && t < closest_t) {
+                closest_t = t;
+                hit_tri = (long)i;
+            }
+        }
+        if (hit_tri >= 0 && out_normal) {
+            glm::vec3 v0 = (*positions)[(*indices)[hit_tri*3]];
+            glm::vec3 v1 = (*positions)[(*indices)[hit_tri*3+1]];
+            glm::vec3 v2 = (*positions)[(*indices)[hit_tri*3+2]];
+            *out_normal = glm::normalize(glm::cross(v1 - v0, v2 - v0));
+        }
+        *out_t = closest_t;
+        return hit_tri;
+    }
+
+    // Zero components get a huge finite inverse instead of inf, so a ray
+    // lying exactly on a slab plane gives 0 * big = 0 rather than NaN
+    glm::vec3 inv_dir;
+    for (int k = 0; k < 3; k++) {
+        inv_dir[k] = 1.0f / (ray_dir[k] != 0.0f ? ray_dir[k] : 1e-30f);
+    }
+    const BvhNode* nodes = bvh->nodes.data();
+    const Tri4* tris = bvh->tris.data();
+    const Tri4* hit_block = nullptr;
+    int hit_lane = 0;
+    unsigned int stack[BVH_STACK_SIZE];
+    int sp = 0;
+    if (ray_aabb(ray_origin, inv_dir, nodes[0].bmin, nodes[0].bmax, closest_t) == FLT_MAX) {
+        return -1;
+    }
+    stack[sp++] = 0;
+
+    while (sp > 0) {
+        const BvhNode& node = nodes[stack[--sp]];
+        if (node.count > 0) {
+            // Leaves are tested four triangles per SIMD lane group
+            unsigned int num_blocks = (node.count + 3) / 4;
+            for (unsigned int i = 0; i < num_blocks; i++) {
+                const Tri4& block = tris[node.left_first + i];
+                int lane = intersect_tri4(block, ray_origin, ray_dir, &closest_t);
+                if (lane >= 0) {
+                    hit_block = &block;
+                    hit_lane = lane;
+                }
             }
+            continue;
+        }
+
+        // Push the far child first so the near one is visited first
+        unsigned int a = node.left_first;
+        unsigned int b = node.left_first + 1;
+        float ta = ray_aabb(ray_origin, inv_dir, nodes[a].bmin, nodes[a].bmax, closest_t);
+        float tb = ray_aabb(ray_origin, inv_dir, nodes[b].bmin, nodes[b].bmax, closest_t);
+        if (ta > tb) {
+            std::swap(a, b);
+            std::swap(ta, tb);
         }
+        if (tb != FLT_MAX) stack[sp++] = b;
+        if (ta != FLT_MAX) stack[sp++] = a;
     }
 
-    if (found) {
-        *out_nx = hit_normal.x;
-        *out_ny = hit_normal.y;
-        *out_nz = hit_normal.z;
+    *out_t = closest_t;
+    if (!hit_block) return -1;
+    if (out_normal) {
+        *out_normal = glm::vec3(hit_block->nx[hit_lane],
+                                hit_block->ny[hit_lane],
+                                hit_block->nz[hit_lane]);
     }
-    return found ? closest_y : -99999.0f;
+    return (long)hit_block->id[hit_lane];
+}
+
+// Flip a normal so it faces against dir
+inline glm::vec3 face_against(glm::vec3 n, const glm::vec3& dir) {
+    return glm::dot(n, dir) > 0.0f ? -n : n;
+}
+
+// ============================================================================
+// Probe cache
+// ============================================================================
+// Per-entity memory of the last triangle a probe hit. A grounded player is
+// almost always over that triangle or one next to it, so those are tested
+// first. The seed hit then bounds a verifying traversal that only descends
+// into boxes reaching above it, so the answer matches the uncached query
+// (to within PROBE_CACHE_EPSILON) while skipping most of the tree.
+
+struct ProbeCache {
+    long last_tri = -1;
+};
+
+const float PROBE_CACHE_EPSILON = 0.0001f;
+
+inline ProbeCache* create_probe_cache() {
+    return new ProbeCache();
+}
+
+inline void destroy_probe_cache(ProbeCache* cache) {
+    delete cache;
+}
+
+// Test one triangle from the packed table by id
+inline bool intersect_tri_id(
+    Bvh* bvh, long tri,
+    const glm::vec3& ray_origin, const glm::vec3& ray_dir,
+    float* out_t, glm::vec3* out_normal
+) {
+    unsigned int slot = bvh->tri_slot[tri];
+    const Tri4& b = bvh->tris[slot / 4];
+    int k = (int)(slot % 4);
+    glm::vec3 v0(b.v0x[k], b.v0y[k], b.v0z[k]);
+    glm::vec3 e1(b.e1x[k], b.e1y[k], b.e1z[k]);
+    glm::vec3 e2(b.e2x[k], b.e2y[k], b.e2z[k]);
+    if (!intersect_edges(ray_origin, ray_dir, v0, e1, e2, out_t)) return false;
+    *out_normal = glm::vec3(b.nx[k], b.ny[k], b.nz[k]);
+    return true;
+}
+
+// ray_closest_hit seeded from cache (may be null). Updates the cache.
+inline long ray_closest_hit_cached(
+    Positions* positions,
+    Indices* indices,
+    Bvh* bvh, ProbeCache* cache,
+    const glm::vec3& ray_origin, const glm::vec3& ray_dir,
+    float t_max, float* out_t, glm::vec3* out_normal
+) {
+    if (!cache || !bvh || bvh->tri_slot.empty()
+        || cache->last_tri < 0 || cache->last_tri >= (long)bvh->tri_slot.size()) {
+        glm::vec3 n;
+        long tri = ray_closest_hit(positions, indices, bvh, ray_origin, ray_dir, t_max, out_t, &n);
+        if (out_normal) *out_normal = n;
+        if (cache) cache->last_tri = tri;
+        return tri;
+    }
+
+    long seed = -1;
+    float seed_t = t_max;
+    glm::vec3 seed_n(0.0f);
+    float t;
+    glm::vec3 n;
+    if (intersect_tri_id(bvh, cache->last_tri, ray_origin, ray_dir, &t, &n) && t < seed_t) {
+        seed = cache->last_tri;
+        seed_t = t;
+        seed_n = n;
+    }
+    for (unsigned int j = bvh->adj_offsets[cache->last_tri];
+         j < bvh->adj_offsets[cache->last_tri + 1]; j++) {
+        long other = (long)bvh->adj_list[j];
+        if (intersect_tri_id(bvh, other, ray_origin, ray_dir, &t, &n) && t < seed_t) {
+            seed = other;
+            seed_t = t;
+            seed_n = n;
+        }
+    }
+
+    long tri;
+    if (seed < 0) {
+        tri = ray_closest_hit(positions, indices, bvh, ray_origin, ray_dir, t_max, out_t, &n);
+    } else {
+        // Anything nearer than the seed must still be found
+        tri = ray_closest_hit(positions, indices, bvh, ray_origin, ray_dir,
+                              seed_t - PROBE_CACHE_EPSILON, out_t, &n);
+        if (tri < 0) {
+            tri = seed;
+            *out_t = seed_t;
+            n = seed_n;
+        }
+    }
+    if (out_normal) *out_normal = n;
+    cache->last_tri = tri;
+    return tri;
+}
+
+// Raycast down from position, find highest ground below
+// Returns ground Y coordinate, or -99999.0f if no ground found
+inline float raycast_ground(
+    Positions* positions,
+    Indices* indices,
+    Bvh* bvh,
+    float px, float py, float pz
+) {
+    float ray_height = py + 100.0f;
+    glm::vec3 ray_origin(px, ray_height, pz);
+    glm::vec3 ray_dir(0.0f, -1.0f, 0.0f);
+
+    float t;
+    long tri = ray_closest_hit(positions, indices, bvh, ray_origin, ray_dir, FLT_MAX, &t, nullptr);
+    return tri >= 0 ? ray_height - t : -99999.0f;
+}
+
+// Ground raycast with surface normal output
+// Returns ground Y, writes hit triangle normal to out_nx/ny/nz
+// Returns -99999.0f if no ground found. cache may be null.
+inline float raycast_ground_normal_cached(
+    Positions* positions,
+    Indices* indices,
+    Bvh* bvh, ProbeCache* cache,
+    float px, float py, float pz,
+    float* out_nx, float* out_ny, float* out_nz
+) {
+    float ray_height = py + 100.0f;
+    glm::vec3 ray_origin(px, ray_height, pz);
+    glm::vec3 ray_dir(0.0f, -1.0f, 0.0f);
+
+    float t;
+    glm::vec3 n;
+    long tri = ray_closest_hit_cached(positions, indices, bvh, cache, ray_origin, ray_dir, FLT_MAX, &t, &n);
+    if (tri < 0) return -99999.0f;
+
+    // Facing against the downward ray means the normal points upward
+    n = face_against(n, ray_dir);
+    *out_nx = n.x;
+    *out_ny = n.y;
+    *out_nz = n.z;
+    return ray_height - t;
+}
+
+inline float raycast_ground_normal(
+    Positions* positions,
+    Indices* indices,
+    Bvh* bvh,
+    float px, float py, float pz,
+    float* out_nx, float* out_ny, float* out_nz
+) {
+    return raycast_ground_normal_cached(positions, indices, bvh, nullptr,
+                                        px, py, pz, out_nx, out_ny, out_nz);
 }
 
 // Horizontal raycast: fires along XZ plane
 // Returns distance to nearest hit, or -1.0f if no hit within max_dist
 inline float raycast_horizontal(
-    std::vector<glm::vec3>* positions,
-    std::vector<unsigned int>* indices,
+    Positions* positions,
+    Indices* indices,
+    Bvh* bvh,
     float ox, float oy, float oz,
     float dx, float dy, float dz,
     float max_dist
 ) {
-    const float EPSILON = 0.000001f;
     glm::vec3 ray_origin(ox, oy, oz);
     glm::vec3 ray_dir(dx, dy, dz);
 
-    float closest_t = max_dist + 1.0f;
-    bool found = false;
+    float t;
+    long tri = ray_closest_hit(positions, indices, bvh, ray_origin, ray_dir, max_dist + 1.0f, &t, nullptr);
+    return tri >= 0 ? t : -1.0f;
+}
 
-    size_t num_tris = indices->size() / 3;
-    for (size_t i = 0; i < num_tris; i++) {
-        glm::vec3 v0 = (*positions)[(*indices)[i*3]];
-        glm::vec3 v1 = (*positions)[(*indices)[i*3+1]];
-        glm::vec3 v2 = (*positions)[(*indices)[i*3+2]];
+// Closest hit on a piecewise Bvh (editor picking). Returns the handle of the
+// piece hit, or -1, with the distance in out_t. Removed pieces have
+// degenerate triangles, so they are never hit.
+inline int raycast_piece(
+    Positions* positions,
+    Indices* indices,
+    Bvh* bvh,
+    float ox, float oy, float oz,
+    float dx, float dy, float dz,
+    float max_dist, float* out_t
+) {
+    if (bvh->tri_piece.empty()) return -1;
+    long tri = ray_closest_hit(positions, indices, bvh, glm::vec3(ox, oy, oz),
+                               glm::vec3(dx, dy, dz), max_dist, out_t, nullptr);
+    if (tri < 0 || tri >= (long)bvh->tri_piece.size()) return -1;
+    return (int)bvh->tri_piece[tri];
+}
 
-        glm::vec3 edge1 = v1 - v0;
-        glm::vec3 edge2 = v2 - v0;
-        glm::vec3 h = glm::cross(ray_dir, edge2);
-        float a = glm::dot(edge1, h);
+// ============================================================================
+// Batched queries
+// ============================================================================
+// One call per tick instead of one per probe. Buffers are flat floats so
+// native callers (and jank, via std::vector<float>) can fill them directly.
 
-        if (fabs(a) < EPSILON) continue;
+const int RAY_STRIDE = 7;   // ox oy oz dx dy dz max_dist
+const int HIT_STRIDE = 4;   // t nx ny nz
 
-        float f = 1.0f / a;
-        glm::vec3 s = ray_origin - v0;
-        float u = f * glm::dot(s, h);
-        if (u < 0.0f || u > 1.0f) continue;
+// The calling thread's batch input buffer, emptied, and its hit buffer
+// sized for count hits. Reused from call to call, so a batch from jank
+// allocates nothing once they have grown; read the hits before the next
+// batch on the same thread.
+inline std::vector<float>* batch_input() {
+    thread_local std::vector<float> input;
+    input.clear();
+    return &input;
+}
 
-        glm::vec3 q = glm::cross(s, edge1);
-        float v = f * glm::dot(ray_dir, q);
-        if (v < 0.0f || u + v > 1.0f) continue;
+inline std::vector<float>* batch_hits(int count) {
+    thread_local std::vector<float> hits;
+    hits.resize((size_t)count * HIT_STRIDE);
+    return &hits;
+}
 
-        float t = f * glm::dot(edge2, q);
-        if (t > EPSILON && t < closest_t) {
-            closest_t = t;
-            found = true;
+// Closest hit for each ray in rays (count * RAY_STRIDE floats).
+// Writes count * HIT_STRIDE floats to out: distance (-1.0f on miss, same
+// max_dist slack as raycast_horizontal) and the normal facing the ray.
+inline void raycast_batch(
+    Positions* positions,
+    Indices* indices,
+    Bvh* bvh,
+    const float* rays, int count,
+    float* out
+) {
+    for (int i = 0; i < count; i++) {
+        const float* r = rays + i * RAY_STRIDE;
+        float* o = out + i * HIT_STRIDE;
+        glm::vec3 ray_origin(r[0], r[1], r[2]);
+        glm::vec3 ray_dir(r[3], r[4], r[5]);
+        float t;
+        glm::vec3 n;
+        long tri = ray_closest_hit(positions, indices, bvh, ray_origin, ray_dir, r[6] + 1.0f, &t, &n);
+        if (tri < 0) {
+            o[0] = -1.0f; o[1] = 0.0f; o[2] = 0.0f; o[3] = 0.0f;
+            continue;
+        }
+        n = face_against(n, ray_dir);
+        o[0] = t; o[1] = n.x; o[2] = n.y; o[3] = n.z;
+    }
+}
+
+// Ground probe for each point in points (count * 3 floats), matching
+// raycast_ground_normal. Writes count * HIT_STRIDE floats to out:
+// ground Y (-99999.0f if none) and the upward-facing normal.
+// cache (may be null) is shared by all points, so pass one entity's probes.
+inline void raycast_ground_batch_cached(
+    Positions* positions,
+    Indices* indices,
+    Bvh* bvh, ProbeCache* cache,
+    const float* points, int count,
+    float* out
+) {
+    for (int i = 0; i < count; i++) {
+        const float* p = points + i * 3;
+        float* o = out + i * HIT_STRIDE;
+        o[1] = 0.0f; o[2] = 1.0f; o[3] = 0.0f;
+        o[0] = raycast_ground_normal_cached(positions, indices, bvh, cache, p[0], p[1], p[2],
+                                            &o[1], &o[2], &o[3]);
+    }
+}
+
+inline void raycast_ground_batch(
+    Positions* positions,
+    Indices* indices,
+    Bvh* bvh,
+    const float* points, int count,
+    float* out
+) {
+    raycast_ground_batch_cached(positions, indices, bvh, nullptr, points, count, out);
+}
+
+// ============================================================================
+// Swept sphere
+// ============================================================================
+// Moves a sphere along a segment and reports the first contact, covering
+// triangle faces, edges and corners. Catches thin ledges that rays between
+// them miss, and does not tunnel at high speed because the whole path is
+// tested.
+
+// Closest point on triangle abc to p (Ericson, Real-Time Collision Detection 5.1.5)
+inline glm::vec3 closest_point_on_triangle(
+    const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c
+) {
+    glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+    float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f) return a;
+    glm::vec3 bp = p - b;
+    float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3) return b;
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) return a + ab * (d1 / (d1 - d3));
+    glm::vec3 cp = p - c;
+    float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6) return c;
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) return a + ac * (d2 / (d2 - d6));
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) {
+        return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+    }
+    float denom = 1.0f / (va + vb + vc);
+    return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+// Earliest t in [0, t_max) where the ray o + d*t comes within r of point c
+inline bool sweep_point(
+    const glm::vec3& o, const glm::vec3& d, float r, const glm::vec3& c,
+    float t_max, float* out_t
+) {
+    glm::vec3 m = o - c;
+    float b = glm::dot(m, d);
+    float cc = glm::dot(m, m) - r * r;
+    if (b >= 0.0f) return false;  // moving away (overlap is handled separately)
+    float disc = b * b - cc;
+    if (disc < 0.0f) return false;
+    float t = -b - sqrtf(disc);
+    if (t < 0.0f || t >= t_max) return false;
+    *out_t = t;
+    return true;
+}
+
+// Earliest t in [0, t_max) where the ray comes within r of segment ab
+inline bool sweep_segment(
+    const glm::vec3& o, const glm::vec3& d, float r,
+    const glm::vec3& a, const glm::vec3& b,
+    float t_max, float* out_t
+) {
+    glm::vec3 ab = b - a;
+    float ab2 = glm::dot(ab, ab);
+    if (ab2 < 1e-12f) return false;
+    glm::vec3 ao = o - a;
+    glm::vec3 d_perp = d - ab * (glm::dot(d, ab) / ab2);
+    glm::vec3 ao_perp = ao - ab * (glm::dot(ao, ab) / ab2);
+    float qa = glm::dot(d_perp, d_perp);
+    if (qa < 1e-12f) return false;  // parallel to the edge; corners cover it
+    float qb = glm::dot(d_perp, ao_perp);
+    float qc = glm::dot(ao_perp, ao_perp) - r * r;
+    if (qb >= 0.0f) return false;
+    float disc = qb * qb - qa * qc;
+    if (disc < 0.0f) return false;
+    float t = (-qb - sqrtf(disc)) / qa;
+    if (t < 0.0f || t >= t_max) return false;
+    float s = glm::dot(ao + d * t, ab) / ab2;
+    if (s < 0.0f || s > 1.0f) return false;
+    *out_t = t;
+    return true;
+}
+
+// Sweep a sphere (center o, unit direction d, radius r) against one
+// triangle with unit normal n. On a hit earlier than t_max, writes the
+// time of impact and the contact normal (pointing from the surface
+// toward the sphere). Contacts the sphere is already leaving are ignored.
+inline bool sweep_sphere_triangle(
+    const glm::vec3& o, const glm::vec3& d, float r,
+    const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2,
+    const glm::vec3& n, float t_max,
+    float* out_t, glm::vec3* out_normal
+) {
+    // Already touching at the start
+    glm::vec3 cp = closest_point_on_triangle(o, v0, v1, v2);
+    glm::vec3 sep = o - cp;
+    float dist2 = glm::dot(sep, sep);
+    if (dist2 <= r * r) {
+        glm::vec3 cn = dist2 > 1e-12f ? sep / sqrtf(dist2) : face_against(n, d);
+        if (glm::dot(cn, d) >= 0.0f) return false;
+        *out_t = 0.0f;
+        *out_normal = cn;
+        return true;
+    }
+
+    bool hit = false;
+    float best = t_max;
+    glm::vec3 best_n(0.0f);
+
+    // Face interior
+    glm::vec3 fn = glm::dot(o - v0, n) >= 0.0f ? n : -n;
+    float dist0 = glm::dot(o - v0, fn);
+    float dn = glm::dot(d, fn);
+    if (dn < 0.0f) {
+        float t = (dist0 - r) / -dn;
+        if (t >= 0.0f && t < best) {
+            glm::vec3 p = o + d * t - fn * r;
+            glm::vec3 q = closest_point_on_triangle(p, v0, v1, v2);
+            glm::vec3 diff = p - q;
+            if (glm::dot(diff, diff) < 1e-6f) {
+                best = t;
+                best_n = fn;
+                hit = true;
+            }
+        }
+    }
+
+    // Edges and corners
+    const glm::vec3* verts[3] = {&v0, &v1, &v2};
+    for (int k = 0; k < 3; k++) {
+        const glm::vec3& a = *verts[k];
+        const glm::vec3& b = *verts[(k + 1) % 3];
+        float t;
+        if (sweep_segment(o, d, r, a, b, best, &t)) {
+            glm::vec3 c = o + d * t;
+            glm::vec3 ab = b - a;
+            glm::vec3 q = a + ab * (glm::dot(c - a, ab) / glm::dot(ab, ab));
+            best = t;
+            best_n = glm::normalize(c - q);
+            hit = true;
+        }
+        if (sweep_point(o, d, r, a, best, &t)) {
+            best = t;
+            best_n = glm::normalize(o + d * t - a);
+            hit = true;
+        }
+    }
+
+    if (!hit) return false;
+    *out_t = best;
+    *out_normal = best_n;
+    return true;
+}
+
+// Sweep a sphere from (ox, oy, oz) along unit direction (dx, dy, dz) for up
+// to max_dist. Triangles whose |normal.y| exceeds max_normal_y are skipped
+// (pass 1.0f or more to test everything; 0.7f keeps walkable floors out of a
+// wall sweep). Writes the contact normal to out_n* and the triangle id to
+// out_tri. Returns time of impact (distance travelled), or -1.0f if no hit.
+inline float sweep_sphere(
+    Positions* positions,
+    Indices* indices,
+    Bvh* bvh,
+    float ox, float oy, float oz,
+    float dx, float dy, float dz,
+    float radius, float max_dist, float max_normal_y,
+    float* out_nx, float* out_ny, float* out_nz, int* out_tri
+) {
+    glm::vec3 o(ox, oy, oz);
+    glm::vec3 d(dx, dy, dz);
+    float best = max_dist;
+    long hit_tri = -1;
+    glm::vec3 hit_n(0.0f);
+
+    if (!bvh || bvh->nodes.empty()) {
+        size_t num_tris = indices->size() / 3;
+        for (size_t i = 0; i < num_tris; i++) {
+            glm::vec3 v0 = (*positions)[(*indices)[i*3]];
+            glm::vec3 v1 = (*positions)[(*indices)[i*3+1]];
+            glm::vec3 v2 = (*positions)[(*indices)[i*3+2]];
+            glm::vec3 c = glm::cross(v1 - v0, v2 - v0);
+            float len = glm::length(c);
+            if (len <= 0.0f) continue;
+            glm::vec3 n = c / len;
+            if (fabsf(n.y) > max_normal_y) continue;
+            float t;
+            glm::vec3 cn;
+            if (sweep_sphere_triangle(o, d, radius, v0, v1, v2, n, best, &t, &cn)
+                && (hit_tri < 0 || t < best)) {
+                best = t;
+                hit_n = cn;
+                hit_tri = (long)i;
+            }
+        }
+    } else {
+        glm::vec3 inv_dir;
+        for (int k = 0; k < 3; k++) {
+            inv_dir[k] = 1.0f / (d[k] != 0.0f ? d[k] : 1e-30f);
+        }
+        glm::vec3 pad(radius);
+        const BvhNode* nodes = bvh->nodes.data();
+        const Tri4* tris = bvh->tris.data();
+        unsigned int stack[BVH_STACK_SIZE];
+        int sp = 0;
+        stack[sp++] = 0;
+        while (sp > 0) {
+            const BvhNode& node = nodes[stack[--sp]];
+            // Boxes are inflated by the radius: a conservative Minkowski sum
+            if (ray_aabb(o, inv_dir, node.bmin - pad, node.bmax + pad, best) == FLT_MAX) continue;
+            if (node.count == 0) {
+                stack[sp++] = node.left_first + 1;
+                stack[sp++] = node.left_first;
+                continue;
+            }
+            for (unsigned int i = 0; i < node.count; i++) {
+                const Tri4& block = tris[node.left_first + i / 4];
+                int k = (int)(i % 4);
+                glm::vec3 n(block.nx[k], block.ny[k], block.nz[k]);
+                if (fabsf(n.y) > max_normal_y) continue;
+                glm::vec3 v0(block.v0x[k], block.v0y[k], block.v0z[k]);
+                glm::vec3 v1 = v0 + glm::vec3(block.e1x[k], block.e1y[k], block.e1z[k]);
+                glm::vec3 v2 = v0 + glm::vec3(block.e2x[k], block.e2y[k], block.e2z[k]);
+                float t;
+                glm::vec3 cn;
+                if (sweep_sphere_triangle(o, d, radius, v0, v1, v2, n, best, &t, &cn)
+                    && (hit_tri < 0 || t < best)) {
+                    best = t;
+                    hit_n = cn;
+                    hit_tri = (long)block.id[k];
+                }
+            }
+        }
+    }
+
+    if (hit_tri < 0) return -1.0f;
+    *out_nx = hit_n.x;
+    *out_ny = hit_n.y;
+    *out_nz = hit_n.z;
+    *out_tri = (int)hit_tri;
+    return best;
+}
+
+// ============================================================================
+// Caller-owned results
+// ============================================================================
+// The *_into queries write into a QueryHit the caller keeps, so a hot loop
+// reads its fields instead of getting a fresh result map per query.
+
+struct QueryHit {
+    bool hit = false;
+    float value = 0.0f;  // Ground Y, or distance along the ray or sweep
+    float nx = 0.0f, ny = 0.0f, nz = 0.0f;
+    int triangle = -1;   // Sweeps only
+};
+
+inline QueryHit* create_query_hit() {
+    return new QueryHit();
+}
+
+inline void destroy_query_hit(QueryHit* hit) {
+    delete hit;
+}
+
+// raycast_ground_normal_cached into out. cache may be null.
+inline bool raycast_ground_into(
+    Positions* positions,
+    Indices* indices,
+    Bvh* bvh, ProbeCache* cache,
+    float px, float py, float pz,
+    QueryHit* out
+) {
+    out->value = raycast_ground_normal_cached(positions, indices, bvh, cache, px, py, pz,
+                                              &out->nx, &out->ny, &out->nz);
+    out->hit = out->value > -99998.0f;
+    out->triangle = -1;
+    return out->hit;
+}
+
+inline bool sweep_sphere_into(
+    Positions* positions,
+    Indices* indices,
+    Bvh* bvh,
+    float ox, float oy, float oz,
+    float dx, float dy, float dz,
+    float radius, float max_dist, float max_normal_y,
+    QueryHit* out
+) {
+    out->value = sweep_sphere(positions, indices, bvh, ox, oy, oz, dx, dy, dz,
+                              radius, max_dist, max_normal_y,
+                              &out->nx, &out->ny, &out->nz, &out->triangle);
+    out->hit = out->value >= 0.0f;
+    return out->hit;
+}
+
+// ============================================================================
+// Query region
+// ============================================================================
+// The triangles overlapping one box, gathered by a single traversal and
+// repacked four per block. An entity's probes for a tick (ground rays, wall
+// sweeps) then scan that short list instead of each walking the whole tree.
+// A probe gets the same answer as from the Bvh as long as everything it
+// could touch lies inside the box.
+
+struct QueryRegion {
+    glm::vec3 bmin = glm::vec3(0.0f), bmax = glm::vec3(0.0f);
+    std::vector<Tri4> tris;
+    unsigned int count = 0;   // Triangles in tris; the last block's spare lanes are zeroed
+};
+
+inline QueryRegion* create_query_region() {
+    return new QueryRegion();
+}
+
+inline void destroy_query_region(QueryRegion* region) {
+    delete region;
+}
+
+inline bool boxes_overlap(const glm::vec3& amin, const glm::vec3& amax,
+                          const glm::vec3& bmin, const glm::vec3& bmax) {
+    return amin.x <= bmax.x && amax.x >= bmin.x
+        && amin.y <= bmax.y && amax.y >= bmin.y
+        && amin.z <= bmax.z && amax.z >= bmin.z;
+}
+
+// Refill region with bvh's triangles overlapping [bmin, bmax]
+inline void region_gather(QueryRegion* region, Bvh* bvh, const glm::vec3& bmin, const glm::vec3& bmax) {
+    region->bmin = bmin;
+    region->bmax = bmax;
+    region->tris.clear();
+    region->count = 0;
+    if (!bvh || bvh->nodes.empty()) return;
+    const BvhNode* nodes = bvh->nodes.data();
+    const Tri4* tris = bvh->tris.data();
+    unsigned int stack[BVH_STACK_SIZE];
+    int sp = 0;
+    stack[sp++] = 0;
+    while (sp > 0) {
+        const BvhNode& node = nodes[stack[--sp]];
+        if (!boxes_overlap(node.bmin, node.bmax, bmin, bmax)) continue;
+        if (node.count == 0) {
+            stack[sp++] = node.left_first + 1;
+            stack[sp++] = node.left_first;
+            continue;
+        }
+        for (unsigned int i = 0; i < node.count; i++) {
+            const Tri4& b = tris[node.left_first + i / 4];
+            int k = (int)(i % 4);
+            glm::vec3 v0(b.v0x[k], b.v0y[k], b.v0z[k]);
+            glm::vec3 v1 = v0 + glm::vec3(b.e1x[k], b.e1y[k], b.e1z[k]);
+            glm::vec3 v2 = v0 + glm::vec3(b.e2x[k], b.e2y[k], b.e2z[k]);
+            if (!boxes_overlap(glm::min(v0, glm::min(v1, v2)), glm::max(v0, glm::max(v1, v2)),
+                               bmin, bmax)) {
+                continue;
+            }
+            int j = (int)(region->count % 4);
+            if (j == 0) region->tris.push_back(Tri4{});
+            Tri4& o = region->tris.back();
+            o.v0x[j] = b.v0x[k]; o.v0y[j] = b.v0y[k]; o.v0z[j] = b.v0z[k];
+            o.e1x[j] = b.e1x[k]; o.e1y[j] = b.e1y[k]; o.e1z[j] = b.e1z[k];
+            o.e2x[j] = b.e2x[k]; o.e2y[j] = b.e2y[k]; o.e2z[j] = b.e2z[k];
+            o.nx[j] = b.nx[k]; o.ny[j] = b.ny[k]; o.nz[j] = b.nz[k];
+            o.id[j] = b.id[k];
+            region->count++;
+        }
+    }
+}
+
+// raycast_ground_normal against the region's triangles
+inline float region_raycast_ground(
+    QueryRegion* region,
+    float px, float py, float pz,
+    float* out_nx, float* out_ny, float* out_nz
+) {
+    float ray_height = py + 100.0f;
+    glm::vec3 ray_origin(px, ray_height, pz);
+    glm::vec3 ray_dir(0.0f, -1.0f, 0.0f);
+
+    float closest_t = FLT_MAX;
+    const Tri4* hit_block = nullptr;
+    int hit_lane = 0;
+    for (const Tri4& block : region->tris) {
+        int lane = intersect_tri4(block, ray_origin, ray_dir, &closest_t);
+        if (lane >= 0) {
+            hit_block = &block;
+            hit_lane = lane;
+        }
+    }
+    if (!hit_block) return -99999.0f;
+
+    glm::vec3 n = face_against(glm::vec3(hit_block->nx[hit_lane], hit_block->ny[hit_lane],
+                                         hit_block->nz[hit_lane]), ray_dir);
+    *out_nx = n.x;
+    *out_ny = n.y;
+    *out_nz = n.z;
+    return ray_height - closest_t;
+}
+
+// sweep_sphere against the region's triangles
+inline float region_sweep_sphere(
+    QueryRegion* region,
+    float ox, float oy, float oz,
+    float dx, float dy, float dz,
+    float radius, float max_dist, float max_normal_y,
+    float* out_nx, float* out_ny, float* out_nz, int* out_tri
+) {
+    glm::vec3 o(ox, oy, oz);
+    glm::vec3 d(dx, dy, dz);
+    float best = max_dist;
+    long hit_tri = -1;
+    glm::vec3 hit_n(0.0f);
+    for (unsigned int i = 0; i < region->count; i++) {
+        const Tri4& block = region->tris[i / 4];
+        int k = (int)(i % 4);
+        glm::vec3 n(block.nx[k], block.ny[k], block.nz[k]);
+        if (fabsf(n.y) > max_normal_y) continue;
+        glm::vec3 v0(block.v0x[k], block.v0y[k], block.v0z[k]);
+        glm::vec3 v1 = v0 + glm::vec3(block.e1x[k], block.e1y[k], block.e1z[k]);
+        glm::vec3 v2 = v0 + glm::vec3(block.e2x[k], block.e2y[k], block.e2z[k]);
+        float t;
+        glm::vec3 cn;
+        if (sweep_sphere_triangle(o, d, radius, v0, v1, v2, n, best, &t, &cn)
+            && (hit_tri < 0 || t < best)) {
+            best = t;
+            hit_n = cn;
+            hit_tri = (long)block.id[k];
         }
     }
 
-    return found ? closest_t : -1.0f;
+    if (hit_tri < 0) return -1.0f;
+    *out_nx = hit_n.x;
+    *out_ny = hit_n.y;
+    *out_nz = hit_n.z;
+    *out_tri = (int)hit_tri;
+    return best;
 }
 } // namespace ecol
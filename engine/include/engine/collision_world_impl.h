@@ -0,0 +1,369 @@
+#pragma once
+#include "engine/collision_impl.h"
+
+// ============================================================================
+// Collision world
+// ============================================================================
+// The static level mesh plus dynamic bodies (moving platforms, doors, props)
+// that move every tick. A body is a small triangle mesh in its own local
+// space, with its own BVH built once, and a rigid transform (rotation and
+// translation, no scale). Moving a body only updates its transform and
+// world bounds, so it never touches the static tree.
+//
+// Bodies are kept in an incremental sweep-and-prune list: sorted by world
+// min.x, and re-sorted by insertion after moves, which is close to O(n) as
+// bodies only move a little per tick. A query takes the bodies whose x
+// interval meets its own from a prefix of that list, then tests the other
+// axes and the body's own tree with the ray brought into local space.
+// Queries cover the static mesh and every body; hits report which body
+// (or STATIC_BODY) they came from.
+
+namespace ecol {
+
+const int STATIC_BODY = -1;
+
+struct Body {
+    Positions positions;            // Local space
+    Indices indices;
+    Bvh* bvh = nullptr;
+    glm::vec3 local_min = glm::vec3(0.0f), local_max = glm::vec3(0.0f);
+    glm::mat3 rotation = glm::mat3(1.0f);
+    glm::vec3 translation = glm::vec3(0.0f);
+    glm::vec3 world_min = glm::vec3(0.0f), world_max = glm::vec3(0.0f);
+    bool live = false;
+};
+
+struct World {
+    // The level mesh; not owned
+    Positions* static_positions = nullptr;
+    Indices* static_indices = nullptr;
+    Bvh* static_bvh = nullptr;
+    std::vector<Body> bodies;              // Indexed by handle
+    std::vector<unsigned int> free_bodies;
+    std::vector<unsigned int> sorted;      // Live handles by world_min.x
+    bool sort_dirty = false;
+};
+
+// static_* may be null for a world of bodies only
+inline World* create_world(Positions* static_positions, Indices* static_indices, Bvh* static_bvh) {
+    World* w = new World();
+    w->static_positions = static_positions;
+    w->static_indices = static_indices;
+    w->static_bvh = static_bvh;
+    return w;
+}
+
+inline void destroy_world(World* w) {
+    for (Body& b : w->bodies) {
+        if (b.bvh) destroy_bvh(b.bvh);
+    }
+    delete w;
+}
+
+inline void body_update_bounds(Body* b) {
+    // Box of the rotated local box: center moves, extent grows by |R|
+    glm::vec3 center = (b->local_min + b->local_max) * 0.5f;
+    glm::vec3 extent = (b->local_max - b->local_min) * 0.5f;
+    glm::vec3 world_center = b->rotation * center + b->translation;
+    glm::vec3 world_extent(0.0f);
+    for (int c = 0; c < 3; c++) {
+        for (int r = 0; r < 3; r++) {
+            world_extent[r] += fabsf(b->rotation[c][r]) * extent[c];
+        }
+    }
+    b->world_min = world_center - world_extent;
+    b->world_max = world_center + world_extent;
+}
+
+// Add a body from a mesh in its local space (indices local to positions).
+// The triangles are copied. It starts at the identity transform. Returns
+// its handle.
+inline int world_add_body(World* w, const Positions* positions, const Indices* indices) {
+    unsigned int handle;
+    if (!w->free_bodies.empty()) {
+        handle = w->free_bodies.back();
+        w->free_bodies.pop_back();
+    } else {
+        handle = (unsigned int)w->bodies.size();
+        w->bodies.emplace_back();
+    }
+    Body& b = w->bodies[handle];
+    b.positions.assign(positions->begin(), positions->end());
+    b.indices.assign(indices->begin(), indices->end());
+    b.bvh = build_bvh(&b.positions, &b.indices);
+    b.local_min = glm::vec3(FLT_MAX);
+    b.local_max = glm::vec3(-FLT_MAX);
+    for (const glm::vec3& p : b.positions) {
+        b.local_min = glm::min(b.local_min, p);
+        b.local_max = glm::max(b.local_max, p);
+    }
+    if (b.positions.empty()) b.local_min = b.local_max = glm::vec3(0.0f);
+    b.rotation = glm::mat3(1.0f);
+    b.translation = glm::vec3(0.0f);
+    b.live = true;
+    body_update_bounds(&b);
+    w->sorted.push_back(handle);
+    w->sort_dirty = true;
+    return (int)handle;
+}
+
+// A box body centered on its origin, twelve triangles wound outward
+inline int world_add_box(World* w, float hx, float hy, float hz) {
+    Positions positions;
+    for (int i = 0; i < 8; i++) {
+        positions.push_back(glm::vec3((i & 1) ? hx : -hx, (i & 2) ? hy : -hy, (i & 4) ? hz : -hz));
+    }
+    static const unsigned int faces[36] = {
+        0, 4, 6,  0, 6, 2,    // -x
+        1, 3, 7,  1, 7, 5,    // +x
+        0, 1, 5,  0, 5, 4,    // -y
+        2, 6, 7,  2, 7, 3,    // +y
+        0, 2, 3,  0, 3, 1,    // -z
+        4, 5, 7,  4, 7, 6,    // +z
+    };
+    Indices indices(faces, faces + 36);
+    return world_add_body(w, &positions, &indices);
+}
+
+inline bool world_body_live(World* w, int handle) {
+    return handle >= 0 && (size_t)handle < w->bodies.size() && w->bodies[handle].live;
+}
+
+// Remove a body. Unknown handles are ignored.
+inline void world_remove_body(World* w, int handle) {
+    if (!world_body_live(w, handle)) return;
+    Body& b = w->bodies[handle];
+    destroy_bvh(b.bvh);
+    b.bvh = nullptr;
+    b.positions.clear();
+    b.positions.shrink_to_fit();
+    b.indices.clear();
+    b.indices.shrink_to_fit();
+    b.live = false;
+    w->sorted.erase(std::find(w->sorted.begin(), w->sorted.end(), (unsigned int)handle));
+    w->free_bodies.push_back((unsigned int)handle);
+}
+
+// Place a body: position and unit rotation quaternion (x, y, z, w)
+inline void world_set_transform(World* w, int handle,
+                                float px, float py, float pz,
+                                float qx, float qy, float qz, float qw) {
+    if (!world_body_live(w, handle)) return;
+    Body& b = w->bodies[handle];
+    float xx = qx * qx, yy = qy * qy, zz = qz * qz;
+    float xy = qx * qy, xz = qx * qz, yz = qy * qz;
+    float wx = qw * qx, wy = qw * qy, wz = qw * qz;
+    // Column-major, as glm stores it
+    b.rotation = glm::mat3(
+        1.0f - 2.0f * (yy + zz), 2.0f * (xy + wz), 2.0f * (xz - wy),
+        2.0f * (xy - wz), 1.0f - 2.0f * (xx + zz), 2.0f * (yz + wx),
+        2.0f * (xz + wy), 2.0f * (yz - wx), 1.0f - 2.0f * (xx + yy));
+    b.translation = glm::vec3(px, py, pz);
+    body_update_bounds(&b);
+    w->sort_dirty = true;
+}
+
+// Restore w->sorted by world_min.x. Insertion sort, since bodies barely
+// move between queries and the list is almost in order.
+inline void world_sort(World* w) {
+    if (!w->sort_dirty) return;
+    std::vector<unsigned int>& s = w->sorted;
+    for (size_t i = 1; i < s.size(); i++) {
+        unsigned int h = s[i];
+        float key = w->bodies[h].world_min.x;
+        size_t j = i;
+        while (j > 0 && w->bodies[s[j - 1]].world_min.x > key) {
+            s[j] = s[j - 1];
+            j--;
+        }
+        s[j] = h;
+    }
+    w->sort_dirty = false;
+}
+
+// Call fn(handle, body) for each body whose world box overlaps [qmin, qmax]
+template <typename Fn>
+inline void world_each_overlap(World* w, const glm::vec3& qmin, const glm::vec3& qmax, Fn fn) {
+    world_sort(w);
+    for (unsigned int h : w->sorted) {
+        Body& b = w->bodies[h];
+        if (b.world_min.x > qmax.x) break;   // Sorted: no later body reaches
+        if (boxes_overlap(b.world_min, b.world_max, qmin, qmax)) fn((int)h, b);
+    }
+}
+
+// Bodies overlapping a box, written to out (at most max_out). Returns how
+// many overlap, which may be more than were written.
+inline int world_query_box(World* w,
+                           float min_x, float min_y, float min_z,
+                           float max_x, float max_y, float max_z,
+                           int* out, int max_out) {
+    int n = 0;
+    world_each_overlap(w, glm::vec3(min_x, min_y, min_z), glm::vec3(max_x, max_y, max_z),
+                       [&](int h, Body&) {
+                           if (n < max_out) out[n] = h;
+                           n++;
+                       });
+    return n;
+}
+
+// Box around the segment o + d * [0, t], padded by r
+inline void segment_bounds(const glm::vec3& o, const glm::vec3& d, float t, float r,
+                           glm::vec3* bmin, glm::vec3* bmax) {
+    glm::vec3 e = o + d * t;
+    *bmin = glm::min(o, e) - glm::vec3(r);
+    *bmax = glm::max(o, e) + glm::vec3(r);
+}
+
+// Closest hit along a ray over the static mesh and every body, nearer than
+// t_max. Returns the hit body (STATIC_BODY for the level mesh), or -2 if
+// nothing was hit, with the distance, world normal as wound and triangle
+// id (within its body) in the out params.
+inline int world_ray_closest_hit(World* w, const glm::vec3& o, const glm::vec3& d, float t_max,
+                                 float* out_t, glm::vec3* out_normal, long* out_tri) {
+    int hit_body = -2;
+    float best = t_max;
+    if (w->static_indices) {
+        float t;
+        glm::vec3 n;
+        long tri = ray_closest_hit(w->static_positions, w->static_indices, w->static_bvh,
+                                   o, d, best, &t, &n);
+        if (tri >= 0) {
+            best = t;
+            *out_normal = n;
+            *out_tri = tri;
+            hit_body = STATIC_BODY;
+        }
+    }
+    // An unbounded ray would take every body; clamp its box to the farthest one
+    float reach = best;
+    if (reach == FLT_MAX) reach = 1e6f;
+    glm::vec3 qmin, qmax;
+    segment_bounds(o, d, reach, 0.0f, &qmin, &qmax);
+    glm::vec3 inv_dir;
+    for (int k = 0; k < 3; k++) {
+        inv_dir[k] = 1.0f / (d[k] != 0.0f ? d[k] : 1e-30f);
+    }
+    world_each_overlap(w, qmin, qmax, [&](int h, Body& b) {
+        if (ray_aabb(o, inv_dir, b.world_min, b.world_max, best) == FLT_MAX) return;
+        // Rigid, so distances are the same in local space
+        glm::mat3 inv = glm::transpose(b.rotation);
+        glm::vec3 lo = inv * (o - b.translation);
+        glm::vec3 ld = inv * d;
+        float t;
+        glm::vec3 n;
+        long tri = ray_closest_hit(&b.positions, &b.indices, b.bvh, lo, ld, best, &t, &n);
+        if (tri >= 0) {
+            best = t;
+            *out_normal = b.rotation * n;
+            *out_tri = tri;
+            hit_body = h;
+        }
+    });
+    *out_t = best;
+    return hit_body;
+}
+
+// raycast_ground_normal over the world. Also writes the body stood on
+// (STATIC_BODY for the level), so callers can carry a player along with
+// a platform. Returns -99999.0f if no ground found.
+inline float world_raycast_ground(World* w, float px, float py, float pz,
+                                  float* out_nx, float* out_ny, float* out_nz, int* out_body) {
+    float ray_height = py + 100.0f;
+    glm::vec3 ray_origin(px, ray_height, pz);
+    glm::vec3 ray_dir(0.0f, -1.0f, 0.0f);
+
+    float t;
+    glm::vec3 n;
+    long tri;
+    int body = world_ray_closest_hit(w, ray_origin, ray_dir, FLT_MAX, &t, &n, &tri);
+    if (body < STATIC_BODY) return -99999.0f;
+
+    n = face_against(n, ray_dir);
+    *out_nx = n.x;
+    *out_ny = n.y;
+    *out_nz = n.z;
+    *out_body = body;
+    return ray_height - t;
+}
+
+// Closest hit along a ray (unit direction) within max_dist. Writes the
+// normal facing back along the ray and the body hit. Returns the distance,
+// or -1.0f if no hit.
+inline float world_raycast(World* w,
+                           float ox, float oy, float oz,
+                           float dx, float dy, float dz,
+                           float max_dist,
+                           float* out_nx, float* out_ny, float* out_nz, int* out_body) {
+    glm::vec3 d(dx, dy, dz);
+    float t;
+    glm::vec3 n;
+    long tri;
+    int body = world_ray_closest_hit(w, glm::vec3(ox, oy, oz), d, max_dist, &t, &n, &tri);
+    if (body < STATIC_BODY) return -1.0f;
+    n = face_against(n, d);
+    *out_nx = n.x;
+    *out_ny = n.y;
+    *out_nz = n.z;
+    *out_body = body;
+    return t;
+}
+
+// sweep_sphere over the static mesh and every body the swept sphere's box
+// reaches. Writes the world contact normal, the triangle id and the body
+// hit. Returns time of impact, or -1.0f if no hit.
+inline float world_sweep_sphere(World* w,
+                                float ox, float oy, float oz,
+                                float dx, float dy, float dz,
+                                float radius, float max_dist, float max_normal_y,
+                                float* out_nx, float* out_ny, float* out_nz,
+                                int* out_tri, int* out_body) {
+    glm::vec3 o(ox, oy, oz);
+    glm::vec3 d(dx, dy, dz);
+    float best = max_dist;
+    int hit_body = -2;
+    if (w->static_indices) {
+        float nx, ny, nz;
+        int tri;
+        float t = sweep_sphere(w->static_positions, w->static_indices, w->static_bvh,
+                               ox, oy, oz, dx, dy, dz, radius, best, max_normal_y,
+                               &nx, &ny, &nz, &tri);
+        if (t >= 0.0f) {
+            best = t;
+            *out_nx = nx;
+            *out_ny = ny;
+            *out_nz = nz;
+            *out_tri = tri;
+            hit_body = STATIC_BODY;
+        }
+    }
+    glm::vec3 qmin, qmax;
+    segment_bounds(o, d, best, radius, &qmin, &qmax);
+    world_each_overlap(w, qmin, qmax, [&](int h, Body& b) {
+        glm::mat3 inv = glm::transpose(b.rotation);
+        glm::vec3 lo = inv * (o - b.translation);
+        glm::vec3 ld = inv * d;
+        // max_normal_y filters by the world up axis; a body's local y only
+        // matches it while the body is upright, so only filter then
+        float local_max_normal_y = fabsf(b.rotation[1][1] - 1.0f) < 1e-4f ? max_normal_y : 1.0f;
+        float nx, ny, nz;
+        int tri;
+        float t = sweep_sphere(&b.positions, &b.indices, b.bvh,
+                               lo.x, lo.y, lo.z, ld.x, ld.y, ld.z,
+                               radius, best, local_max_normal_y, &nx, &ny, &nz, &tri);
+        if (t >= 0.0f && (hit_body < STATIC_BODY || t < best)) {
+            glm::vec3 n = b.rotation * glm::vec3(nx, ny, nz);
+            best = t;
+            *out_nx = n.x;
+            *out_ny = n.y;
+            *out_nz = n.z;
+            *out_tri = tri;
+            hit_body = h;
+        }
+    });
+    if (hit_body < STATIC_BODY) return -1.0f;
+    *out_body = hit_body;
+    return best;
+}
+
+} // namespace ecol
@@ -0,0 +1,279 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "enet.h"
+#include "engine/netlog_impl.h"
+
+namespace ecomp {
+
+// ============================================================================
+// Datagram compression
+// ============================================================================
+// An ENetCompressor (engine.networking.protocol :compression) running a
+// small byte-oriented LZ77 over each outgoing datagram, optionally primed
+// with a dictionary both ends share. Sequences:
+//   varint literal count | literals | varint (match length - MIN_MATCH) |
+//   u16 offset back into dictionary + output
+// and the last sequence ends after its literals. Snapshots repeat the same
+// schema tags, flag bytes and near-identical entity rows, which is what the
+// matches (and a dictionary trained on real traffic) pick up.
+
+const int MIN_MATCH = 4;
+const int HASH_BITS = 12;
+const int HASH_SIZE = 1 << HASH_BITS;
+const size_t MAX_OFFSET = 65535;
+const size_t MAX_DICTIONARY = 32768;
+
+// compression_stat field ids
+const int C_SENT_RAW = 0;         // datagram bytes offered to compress
+const int C_SENT_PACKED = 1;      // bytes that went out (raw when compression didn't help)
+const int C_RECEIVED_PACKED = 2;  // compressed datagram bytes received
+const int C_RECEIVED_RAW = 3;     // ...and their size once decompressed
+const int C_DATAGRAMS = 4;        // datagrams compressed
+
+struct Compressor {
+    std::vector<unsigned char> dict;
+    std::vector<int> dict_table;      // hash table after priming with dict
+    std::vector<int> table;
+    std::vector<unsigned char> window;  // dict + current input / output
+    double sent_raw = 0.0, sent_packed = 0.0;
+    double received_packed = 0.0, received_raw = 0.0;
+    double datagrams = 0.0;
+};
+
+inline uint32_t hash4(const unsigned char* p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+inline void put_varint(unsigned char* out, size_t* pos, uint64_t v) {
+    while (v >= 0x80) {
+        out[(*pos)++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    out[(*pos)++] = (unsigned char)v;
+}
+
+inline bool get_varint(const unsigned char* in, size_t len, size_t* pos, uint64_t* v) {
+    uint64_t result = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (*pos >= len) return false;
+        unsigned char b = in[(*pos)++];
+        result |= (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            *v = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Compress window[start:] (window[0:start] is the dictionary). Returns the
+// output size, or 0 if it would not fit out_limit.
+inline size_t lz_compress(Compressor* c, size_t start, unsigned char* out, size_t out_limit) {
+    const unsigned char* w = c->window.data();
+    size_t end = c->window.size();
+    size_t pos = start, anchor = start, o = 0;
+    c->table = c->dict_table;
+    int* table = c->table.data();
+    // Worst-case sequence header: two varints + offset
+    const size_t HEADER = 12;
+    while (pos + MIN_MATCH <= end) {
+        uint32_t h = hash4(w + pos);
+        int candidate = table[h];
+        table[h] = (int)pos;
+        if (candidate < 0 || pos - (size_t)candidate > MAX_OFFSET
+            || memcmp(w + candidate, w + pos, MIN_MATCH) != 0) {
+            pos++;
+            continue;
+        }
+        size_t length = MIN_MATCH;
+        while (pos + length < end && w[candidate + length] == w[pos + length]) length++;
+        size_t literals = pos - anchor;
+        if (o + HEADER + literals > out_limit) return 0;
+        put_varint(out, &o, literals);
+        memcpy(out + o, w + anchor, literals);
+        o += literals;
+        put_varint(out, &o, length - MIN_MATCH);
+        size_t offset = pos - (size_t)candidate;
+        out[o++] = (unsigned char)(offset & 0xFF);
+        out[o++] = (unsigned char)(offset >> 8);
+        // Index a few positions inside the match so the next one can find it
+        for (size_t i = pos + 1; i + MIN_MATCH <= end && i < pos + length; i += 2) {
+            table[hash4(w + i)] = (int)i;
+        }
+        pos += length;
+        anchor = pos;
+    }
+    size_t literals = end - anchor;
+    if (o + HEADER + literals > out_limit) return 0;
+    put_varint(out, &o, literals);
+    memcpy(out + o, w + anchor, literals);
+    o += literals;
+    return o;
+}
+
+// Decompress in into window after the dictionary. Returns false if in is
+// malformed or the output would pass out_limit.
+inline bool lz_decompress(Compressor* c, const unsigned char* in, size_t len, size_t out_limit) {
+    size_t start = c->dict.size();
+    c->window.resize(start);
+    size_t pos = 0;
+    while (true) {
+        uint64_t literals;
+        if (!get_varint(in, len, &pos, &literals) || literals > len - pos
+            || c->window.size() - start + literals > out_limit) return false;
+        c->window.insert(c->window.end(), in + pos, in + pos + literals);
+        pos += literals;
+        if (pos == len) return true;
+        uint64_t extra;
+        if (!get_varint(in, len, &pos, &extra) || len - pos < 2) return false;
+        size_t length = (size_t)extra + MIN_MATCH;
+        size_t offset = (size_t)in[pos] | ((size_t)in[pos + 1] << 8);
+        pos += 2;
+        size_t have = c->window.size();
+        if (offset == 0 || offset > have || have - start + length > out_limit) return false;
+        // Byte by byte: matches may overlap their own output
+        for (size_t i = 0; i < length; i++) c->window.push_back(c->window[have - offset + i]);
+    }
+}
+
+// ============================================================================
+// ENet callbacks
+// ============================================================================
+
+inline size_t ENET_CALLBACK compress_cb(void* context, const ENetBuffer* in_buffers, size_t in_count,
+                                        size_t in_limit, enet_uint8* out, size_t out_limit) {
+    Compressor* c = (Compressor*)context;
+    c->window.assign(c->dict.begin(), c->dict.end());
+    for (size_t i = 0; i < in_count; i++) {
+        const unsigned char* data = (const unsigned char*)in_buffers[i].data;
+        c->window.insert(c->window.end(), data, data + in_buffers[i].dataLength);
+    }
+    size_t packed = lz_compress(c, c->dict.size(), out, out_limit);
+    c->sent_raw += (double)in_limit;
+    c->sent_packed += (double)(packed > 0 && packed < in_limit ? packed : in_limit);
+    if (packed > 0 && packed < in_limit) c->datagrams += 1.0;
+    return packed;
+}
+
+inline size_t ENET_CALLBACK decompress_cb(void* context, const enet_uint8* in, size_t in_limit,
+                                          enet_uint8* out, size_t out_limit) {
+    Compressor* c = (Compressor*)context;
+    if (!lz_decompress(c, in, in_limit, out_limit)) return 0;
+    size_t start = c->dict.size();
+    size_t n = c->window.size() - start;
+    memcpy(out, c->window.data() + start, n);
+    c->received_packed += (double)in_limit;
+    c->received_raw += (double)n;
+    return n;
+}
+
+inline void ENET_CALLBACK destroy_cb(void* context) {
+    delete (Compressor*)context;
+}
+
+// ============================================================================
+// Setup
+// ============================================================================
+
+inline void prime_dictionary(Compressor* c) {
+    c->dict_table.assign(HASH_SIZE, -1);
+    const unsigned char* d = c->dict.data();
+    for (size_t i = 0; i + MIN_MATCH <= c->dict.size(); i++) {
+        c->dict_table[hash4(d + i)] = (int)i;
+    }
+}
+
+inline Compressor* install(ENetHost* host, Compressor* c) {
+    prime_dictionary(c);
+    ENetCompressor callbacks;
+    callbacks.context = c;
+    callbacks.compress = compress_cb;
+    callbacks.decompress = decompress_cb;
+    callbacks.destroy = destroy_cb;
+    enet_host_compress(host, &callbacks);
+    return c;
+}
+
+// Returns the host-owned context (freed with the host)
+inline Compressor* enable_compression(ENetHost* host) {
+    return install(host, new Compressor());
+}
+
+// Dictionary from a file (first MAX_DICTIONARY bytes). An unreadable file
+// gives no dictionary; check dictionary_size against what the peer loaded
+inline Compressor* enable_compression_with_dictionary(ENetHost* host, const char* path) {
+    Compressor* c = new Compressor();
+    FILE* f = fopen(path, "rb");
+    if (f) {
+        unsigned char buf[4096];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), f)) > 0 && c->dict.size() < MAX_DICTIONARY) {
+            c->dict.insert(c->dict.end(), buf, buf + n);
+        }
+        fclose(f);
+        if (c->dict.size() > MAX_DICTIONARY) c->dict.resize(MAX_DICTIONARY);
+    }
+    return install(host, c);
+}
+
+inline int dictionary_size(Compressor* c) {
+    return (int)c->dict.size();
+}
+
+inline double compression_stat(Compressor* c, int field) {
+    switch (field) {
+        case C_SENT_RAW: return c->sent_raw;
+        case C_SENT_PACKED: return c->sent_packed;
+        case C_RECEIVED_PACKED: return c->received_packed;
+        case C_RECEIVED_RAW: return c->received_raw;
+        case C_DATAGRAMS: return c->datagrams;
+    }
+    return 0.0;
+}
+
+// ============================================================================
+// Dictionary training
+// ============================================================================
+// The dictionary is raw sample content: the newest payloads of a recording
+// (engine/netlog_impl.h) of the given kind (< 0 for sent and received),
+// up to max_bytes, newest last so the most typical bytes sit at the
+// shortest offsets. Returns the bytes written, or -1 if the log can't be
+// read or the output written.
+
+inline int train_dictionary(const char* log_path, const char* out_path, int kind, int max_bytes) {
+    enetlog::Playback* p = enetlog::open_playback(log_path);
+    if (!enetlog::playback_ok(p)) {
+        enetlog::close_playback(p);
+        return -1;
+    }
+    size_t limit = max_bytes > 0 && (size_t)max_bytes < MAX_DICTIONARY ? (size_t)max_bytes : MAX_DICTIONARY;
+    std::vector<std::pair<size_t, size_t>> spans;  // payload offset, length
+    while (enetlog::playback_next(p)) {
+        bool wanted = kind < 0 ? p->kind == enetlog::KIND_SENT || p->kind == enetlog::KIND_RECEIVED
+                              : p->kind == kind;
+        if (wanted && p->length > 0) spans.push_back({p->payload, p->length});
+    }
+    std::vector<unsigned char> dict;
+    size_t i = spans.size();
+    while (i > 0 && dict.size() < limit) {
+        i--;
+        size_t take = std::min(spans[i].second, limit - dict.size());
+        const unsigned char* src = p->data.data() + spans[i].first;
+        dict.insert(dict.begin(), src, src + take);
+    }
+    enetlog::close_playback(p);
+    FILE* f = fopen(out_path, "wb");
+    if (!f) return -1;
+    size_t written = fwrite(dict.data(), 1, dict.size(), f);
+    fclose(f);
+    return written == dict.size() ? (int)written : -1;
+}
+
+} // namespace ecomp
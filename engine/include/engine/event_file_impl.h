@@ -0,0 +1,319 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace eevents {
+
+// ============================================================================
+// Event files
+// ============================================================================
+// engine.events' optional backing store: each appended batch, encoded by
+// the caller, copied as one record into a memory-mapped segment file. An
+// append costs its own bytes and nothing else: no rewrite, no syscall. A
+// flusher thread msyncs what was written every sync_ms; closing syncs the
+// rest, so a crash loses at most the last interval.
+//
+// Segments are path.000000, path.000001, ..., each created at its full
+// size and mapped whole; a record that doesn't fit in what's left of one
+// starts the next. Layout, little-endian:
+//   "SCEV" u32 VERSION
+//   records, each: u32 length (> 0) | u32 check | payload
+//   zeros to the end of the segment
+// check is FNV-1a of the payload, low 32 bits. Opening scans the segments
+// in order and stops at the first record that is cut short or fails its
+// check (a write torn by a crash): that record and everything after it is
+// dropped, the rest of its segment zeroed and any later segments deleted,
+// and appends continue from there.
+//
+// Appends from several threads take a short lock for the copy; encoding
+// happens before it, on the caller's thread. Closing takes the same lock
+// to unmap, and the EventFile itself is never freed, so an append racing
+// the close finds it closed (file_append returns false) rather than
+// touching freed memory.
+
+const uint32_t FILE_VERSION = 1;
+const char FILE_MAGIC[4] = {'S', 'C', 'E', 'V'};
+const size_t FILE_HEADER_BYTES = 8;
+const size_t RECORD_HEADER_BYTES = 8;
+
+inline uint32_t record_check(const unsigned char* p, size_t n) {
+    uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < n; i++) {
+        h ^= p[i];
+        h *= 1099511628211ull;
+    }
+    return (uint32_t)h;
+}
+
+struct FileSegment {
+    int fd = -1;
+    unsigned char* data = nullptr;
+    size_t size = 0;
+};
+
+struct EventFile {
+    std::string path;
+    size_t segment_bytes = 0;
+    int sync_ms = 1000;
+
+    std::mutex mutex;
+    std::vector<FileSegment> segments;  // Only the last is written
+    size_t offset = 0;                  // Write position in the last segment
+    size_t synced = 0;                  // Of the last segment, msynced up to
+    bool failed = false;                // A segment couldn't be made; appends refused
+    bool closed = false;                // close_event_file ran; appends refused
+
+    // Recovery: records found on open, read with next_record
+    size_t read_segment = 0;
+    size_t read_offset = FILE_HEADER_BYTES;
+    const unsigned char* record = nullptr;
+    size_t record_length = 0;
+    int64_t recovered = 0;
+    int64_t dropped_bytes = 0;  // Torn tail zeroed on open
+
+    std::condition_variable wake;
+    bool stopping = false;
+    std::thread flusher;
+};
+
+inline std::string segment_path(const EventFile* f, size_t index) {
+    char suffix[24];
+    snprintf(suffix, sizeof(suffix), ".%06zu", index);
+    return f->path + suffix;
+}
+
+// Map segment index, creating it at size bytes if it doesn't exist
+inline bool map_segment(EventFile* f, size_t index, size_t size, FileSegment* out) {
+    std::string p = segment_path(f, index);
+    int fd = open(p.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return false;
+    struct stat st;
+    bool fresh = fstat(fd, &st) == 0 && st.st_size == 0;
+    if (fresh && ftruncate(fd, (off_t)size) != 0) {
+        close(fd);
+        return false;
+    }
+    if (!fresh) size = (size_t)st.st_size;
+    void* data = size >= FILE_HEADER_BYTES
+                     ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+                     : MAP_FAILED;
+    if (data == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+    out->fd = fd;
+    out->data = (unsigned char*)data;
+    out->size = size;
+    if (fresh) {
+        memcpy(out->data, FILE_MAGIC, 4);
+        memcpy(out->data + 4, &FILE_VERSION, 4);
+    }
+    return memcmp(out->data, FILE_MAGIC, 4) == 0 &&
+           memcmp(out->data + 4, &FILE_VERSION, 4) == 0;
+}
+
+inline void unmap_segment(FileSegment* s) {
+    if (s->data) munmap(s->data, s->size);
+    if (s->fd >= 0) close(s->fd);
+    s->data = nullptr;
+    s->fd = -1;
+}
+
+inline void sync_range(FileSegment* s, size_t from, size_t to) {
+    if (to <= from) return;
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t start = from - from % page;
+    msync(s->data + start, to - start, MS_SYNC);
+}
+
+// The valid records' end in segment s; zeroes anything after it and sets
+// torn if there was anything
+inline size_t scan_segment(EventFile* f, FileSegment* s, bool* torn) {
+    size_t pos = FILE_HEADER_BYTES;
+    while (s->size - pos >= RECORD_HEADER_BYTES) {
+        uint32_t length = 0;
+        uint32_t check = 0;
+        memcpy(&length, s->data + pos, 4);
+        memcpy(&check, s->data + pos + 4, 4);
+        if (length == 0 || s->size - pos - RECORD_HEADER_BYTES < length ||
+            record_check(s->data + pos + RECORD_HEADER_BYTES, length) != check) {
+            break;
+        }
+        pos += RECORD_HEADER_BYTES + length;
+    }
+    size_t end = pos;
+    while (pos < s->size && s->data[pos] == 0) pos++;
+    *torn = pos < s->size;
+    if (*torn) {
+        f->dropped_bytes += (int64_t)(s->size - end);
+        memset(s->data + end, 0, s->size - end);
+        sync_range(s, end, s->size);
+    }
+    return end;
+}
+
+inline void flush_loop(EventFile* f) {
+    std::unique_lock<std::mutex> lock(f->mutex);
+    while (!f->stopping) {
+        f->wake.wait_for(lock, std::chrono::milliseconds(f->sync_ms));
+        if (f->segments.empty() || f->synced >= f->offset) continue;
+        FileSegment s = f->segments.back();
+        size_t from = f->synced;
+        size_t to = f->offset;
+        // The segment stays mapped until close, so sync without the lock
+        lock.unlock();
+        sync_range(&s, from, to);
+        lock.lock();
+        if (f->synced < to && !f->segments.empty() && f->segments.back().data == s.data) {
+            f->synced = to;
+        }
+    }
+}
+
+// Open (or start) the event file at path: the existing segments are
+// scanned up to the first torn record, which is dropped with everything
+// after it, and the intact records are left for next_record. nullptr if
+// the first segment can't be made or isn't an event file.
+inline EventFile* open_event_file(const char* path, int64_t segment_bytes, int sync_ms) {
+    EventFile* f = new EventFile();
+    f->path = path;
+    f->segment_bytes = (size_t)segment_bytes;
+    f->sync_ms = sync_ms > 0 ? sync_ms : 1;
+    for (size_t i = 0;; i++) {
+        struct stat st;
+        if (i > 0 && stat(segment_path(f, i).c_str(), &st) != 0) break;
+        FileSegment s;
+        if (!map_segment(f, i, f->segment_bytes, &s)) {
+            unmap_segment(&s);
+            if (i == 0) {
+                delete f;
+                return nullptr;
+            }
+            break;
+        }
+        bool torn = false;
+        f->offset = scan_segment(f, &s, &torn);
+        f->segments.push_back(s);
+        if (torn) {
+            // Later segments were written after the tear: drop them too
+            for (size_t j = i + 1; stat(segment_path(f, j).c_str(), &st) == 0; j++) {
+                f->dropped_bytes += (int64_t)st.st_size;
+                unlink(segment_path(f, j).c_str());
+            }
+            break;
+        }
+    }
+    f->synced = f->offset;
+    f->flusher = std::thread(flush_loop, f);
+    return f;
+}
+
+// Advance to the next recovered record; false after the last
+inline bool next_record(EventFile* f) {
+    while (f->read_segment < f->segments.size()) {
+        FileSegment& s = f->segments[f->read_segment];
+        size_t end = f->read_segment + 1 == f->segments.size() ? f->offset : s.size;
+        uint32_t length = 0;
+        if (end - f->read_offset >= RECORD_HEADER_BYTES) {
+            memcpy(&length, s.data + f->read_offset, 4);
+        }
+        if (length > 0 && f->read_offset + RECORD_HEADER_BYTES + length <= end) {
+            f->record = s.data + f->read_offset + RECORD_HEADER_BYTES;
+            f->record_length = length;
+            f->read_offset += RECORD_HEADER_BYTES + length;
+            f->recovered++;
+            return true;
+        }
+        f->read_segment++;
+        f->read_offset = FILE_HEADER_BYTES;
+    }
+    return false;
+}
+
+inline const unsigned char* record_data(EventFile* f) { return f->record; }
+inline int record_length(EventFile* f) { return (int)f->record_length; }
+inline int64_t recovered_count(EventFile* f) { return f->recovered; }
+inline int64_t dropped_bytes(EventFile* f) { return f->dropped_bytes; }
+
+// The calling thread's buffer to encode a record into, emptied
+inline std::vector<unsigned char>* scratch_bytes() {
+    thread_local std::vector<unsigned char> bytes;
+    bytes.clear();
+    return &bytes;
+}
+
+// Append one record. Returns false if it couldn't be written (no room
+// could be made for it), in which case later appends fail too.
+inline bool file_append(EventFile* f, const std::vector<unsigned char>* payload) {
+    const size_t need = RECORD_HEADER_BYTES + payload->size();
+    const uint32_t length = (uint32_t)payload->size();
+    const uint32_t check = record_check(payload->data(), payload->size());
+    std::lock_guard<std::mutex> lock(f->mutex);
+    if (f->failed || f->closed || length == 0) return false;
+    if (f->segments.back().size - f->offset < need) {
+        FileSegment& last = f->segments.back();
+        sync_range(&last, f->synced, f->offset);
+        FileSegment s;
+        size_t size = f->segment_bytes > FILE_HEADER_BYTES + need ? f->segment_bytes
+                                                                  : FILE_HEADER_BYTES + need;
+        if (!map_segment(f, f->segments.size(), size, &s)) {
+            unmap_segment(&s);
+            f->failed = true;
+            return false;
+        }
+        f->segments.push_back(s);
+        f->offset = FILE_HEADER_BYTES;
+        f->synced = f->offset;
+    }
+    unsigned char* at = f->segments.back().data + f->offset;
+    memcpy(at + RECORD_HEADER_BYTES, payload->data(), payload->size());
+    memcpy(at + 4, &check, 4);
+    memcpy(at, &length, 4);
+    f->offset += need;
+    return true;
+}
+
+// msync everything written so far now
+inline void file_sync(EventFile* f) {
+    std::lock_guard<std::mutex> lock(f->mutex);
+    if (f->closed || f->segments.empty()) return;
+    sync_range(&f->segments.back(), f->synced, f->offset);
+    f->synced = f->offset;
+}
+
+inline bool file_closed(EventFile* f) {
+    std::lock_guard<std::mutex> lock(f->mutex);
+    return f->closed;
+}
+
+// Sync, unmap and stop the flusher. f stays allocated (see above); later
+// appends and syncs do nothing.
+inline void close_event_file(EventFile* f) {
+    {
+        std::lock_guard<std::mutex> lock(f->mutex);
+        if (f->closed || f->stopping) return;
+        f->stopping = true;
+    }
+    f->wake.notify_all();
+    f->flusher.join();
+    std::lock_guard<std::mutex> lock(f->mutex);
+    if (!f->segments.empty()) sync_range(&f->segments.back(), f->synced, f->offset);
+    for (FileSegment& s : f->segments) unmap_segment(&s);
+    f->segments.clear();
+    f->closed = true;
+}
+
+} // namespace eevents
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <jank/runtime/object.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+#if !defined(EGC_NO_GC) && __has_include(<gc/gc.h>)
+#include <gc/gc.h>
+#define EEVENTS_GC 1
+#endif
+
+namespace eevents {
+
+// ============================================================================
+// Append log
+// ============================================================================
+// The write side of engine.events: a multi-producer, append-only log of
+// batches (one jank value per append), numbered by sequence. A producer
+// reserves its sequence with one fetch_add on the tail and stores its
+// batch in that slot; there is no lock and no shared value to retry on,
+// so appends from many threads don't serialize behind each other.
+//
+// Slots live in fixed-size segments found through a ring directory, a
+// segment installed by whichever producer gets to it first. Batches are
+// published as a prefix: committed is the count of sequences whose slots
+// are all filled, advanced by whoever sees the next slot filled (readers
+// and producers both help), so a reader that takes committed sees every
+// batch before it and none after.
+//
+// Segments are collector memory and scanned, so the batches they hold
+// stay alive; the log itself is an uncollectable root. Releasing a
+// segment only drops it from the directory, and the collector frees it
+// once no reader still has it. Without the collector (EGC_NO_GC tools,
+// single-threaded) released segments are freed at once.
+//
+// The directory is a ring of MAX_SEGMENTS, so appends can run at most
+// (MAX_SEGMENTS - 1) * SEGMENT_SLOTS (about 4M) batches ahead of the
+// oldest unreleased segment. Past that, appends return APPEND_FULL
+// until a reader releases; engine.events answers it by catching its
+// view up (which releases) and retrying.
+
+const int64_t SEGMENT_SLOTS = 1024;
+const int64_t MAX_SEGMENTS = 4096;  // Ring size: how far appends may run ahead of release
+const int64_t APPEND_FULL = -1;     // The ring is full of unreleased segments
+const int64_t APPEND_MOVED = -2;    // log_append_at: the tail wasn't where expected
+
+struct Segment {
+    int64_t base;  // First sequence held
+    std::atomic<jank::runtime::object*> slots[SEGMENT_SLOTS];
+};
+
+struct Log {
+    std::atomic<int64_t> tail{0};       // Next sequence to reserve
+    std::atomic<int64_t> committed{0};  // Sequences published, as a prefix
+    std::atomic<int64_t> released{0};   // Segments below this are gone
+    std::atomic<Segment*> directory[MAX_SEGMENTS];
+};
+
+inline void* alloc_scanned(size_t bytes, bool root) {
+#ifdef EEVENTS_GC
+    return root ? GC_MALLOC_UNCOLLECTABLE(bytes) : GC_MALLOC(bytes);
+#else
+    (void)root;
+    return calloc(1, bytes);
+#endif
+}
+
+inline void free_scanned(void* p) {
+#ifdef EEVENTS_GC
+    GC_FREE(p);
+#else
+    free(p);
+#endif
+}
+
+inline Log* create_log() {
+    return new (alloc_scanned(sizeof(Log), true)) Log();
+}
+
+inline void destroy_log(Log* log) {
+#ifndef EEVENTS_GC
+    for (auto& entry : log->directory) free_scanned(entry.load());
+#endif
+    free_scanned(log);
+}
+
+inline std::atomic<Segment*>& directory_entry(Log* log, int64_t seq) {
+    return log->directory[(seq / SEGMENT_SLOTS) % MAX_SEGMENTS];
+}
+
+// The segment holding seq, installed if it isn't yet; nullptr only when a
+// released reader asks for a segment that has since gone
+inline Segment* segment_for(Log* log, int64_t seq, bool install) {
+    const int64_t base = seq - seq % SEGMENT_SLOTS;
+    std::atomic<Segment*>& entry = directory_entry(log, seq);
+    Segment* s = entry.load(std::memory_order_acquire);
+    while (!s || s->base != base) {
+        if (!install || s) return nullptr;
+        Segment* fresh = new (alloc_scanned(sizeof(Segment), false)) Segment();
+        fresh->base = base;
+        if (entry.compare_exchange_strong(s, fresh, std::memory_order_acq_rel)) return fresh;
+        free_scanned(fresh);
+    }
+    return s;
+}
+
+inline void fill(Log* log, int64_t seq, jank::runtime::object_ref batch) {
+    Segment* s = segment_for(log, seq, true);
+    s->slots[seq % SEGMENT_SLOTS].store(batch.data, std::memory_order_release);
+}
+
+// Whether another append fits in the ring. Producers racing past the
+// check overshoot by at most one each, well inside the last segment.
+inline bool has_room(Log* log, int64_t tail) {
+    return tail < log->released.load(std::memory_order_acquire) +
+                      (MAX_SEGMENTS - 1) * SEGMENT_SLOTS;
+}
+
+// Append batch; returns its sequence, or APPEND_FULL
+inline int64_t log_append(Log* log, jank::runtime::object_ref batch) {
+    if (!has_room(log, log->tail.load(std::memory_order_relaxed))) return APPEND_FULL;
+    int64_t seq = log->tail.fetch_add(1, std::memory_order_acq_rel);
+    fill(log, seq, batch);
+    return seq;
+}
+
+// Append batch only if it takes sequence expected, i.e. nothing has been
+// reserved since a reader saw committed == expected. Returns expected,
+// APPEND_MOVED or APPEND_FULL.
+inline int64_t log_append_at(Log* log, int64_t expected, jank::runtime::object_ref batch) {
+    if (!has_room(log, expected)) return APPEND_FULL;
+    int64_t seq = expected;
+    if (!log->tail.compare_exchange_strong(seq, expected + 1, std::memory_order_acq_rel)) {
+        return APPEND_MOVED;
+    }
+    fill(log, expected, batch);
+    return expected;
+}
+
+// Sequences published: every slot below is filled. Moves committed past
+// any slots filled since.
+inline int64_t log_committed(Log* log) {
+    int64_t c = log->committed.load(std::memory_order_acquire);
+    while (c < log->tail.load(std::memory_order_acquire)) {
+        Segment* s = segment_for(log, c, false);
+        if (!s || !s->slots[c % SEGMENT_SLOTS].load(std::memory_order_acquire)) break;
+        if (log->committed.compare_exchange_weak(c, c + 1, std::memory_order_acq_rel)) c++;
+    }
+    return c;
+}
+
+inline int64_t log_tail(Log* log) {
+    return log->tail.load(std::memory_order_acquire);
+}
+
+// The batch at seq (below log_committed), or nil if it has been released
+inline jank::runtime::object_ref log_get(Log* log, int64_t seq) {
+    Segment* s = segment_for(log, seq, false);
+    jank::runtime::object* batch = s ? s->slots[seq % SEGMENT_SLOTS].load(std::memory_order_acquire)
+                                     : nullptr;
+    return batch ? jank::runtime::object_ref{batch} : jank::runtime::jank_nil;
+}
+
+// Let go of the segments wholly below seq (read and kept elsewhere)
+inline void log_release(Log* log, int64_t seq) {
+    int64_t r = log->released.load(std::memory_order_acquire);
+    while (r + SEGMENT_SLOTS <= seq) {
+        if (log->released.compare_exchange_weak(r, r + SEGMENT_SLOTS, std::memory_order_acq_rel)) {
+            Segment* s = directory_entry(log, r).exchange(nullptr, std::memory_order_acq_rel);
+#ifndef EEVENTS_GC
+            free_scanned(s);
+#else
+            (void)s;
+#endif
+            r += SEGMENT_SLOTS;
+        }
+    }
+}
+
+} // namespace eevents
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <type_traits>
+#include <vector>
+
+namespace earena {
+
+// ============================================================================
+// Frame arena
+// ============================================================================
+// Linear scratch memory for the current frame: allocating bumps an offset,
+// and end_frame takes it back to zero in one step. Nothing is freed on its
+// own and no destructors run, so it only holds trivially destructible data
+// that's dead by the frame boundary (skinning scratch, line vertices, flush
+// bookkeeping). Main thread only.
+//
+// A frame that outgrows the block is served from spill allocations, freed
+// at end_frame, which then grows the block to cover that frame's total;
+// once the block has reached the working set no frame calls malloc.
+
+const size_t ARENA_INITIAL_BYTES = 256 * 1024;
+const size_t ARENA_BLOCK_ALIGN = 64;
+
+struct FrameArena {
+    char* block = nullptr;
+    size_t capacity = 0;
+    size_t used = 0;
+    std::vector<void*> spill;   // This frame's overflow allocations
+    size_t spill_bytes = 0;
+    // Stats
+    size_t last_used = 0;       // Bytes the last finished frame needed
+    size_t peak_used = 0;
+    int grows = 0;              // Times the block was reallocated
+    int spills = 0;             // Overflow allocations since start
+};
+
+inline FrameArena& frame_arena() {
+    static FrameArena a;
+    return a;
+}
+
+inline size_t align_up(size_t n, size_t align) {
+    return (n + align - 1) & ~(align - 1);
+}
+
+inline void grow(FrameArena& a, size_t bytes) {
+    std::free(a.block);
+    a.capacity = align_up(std::max(bytes, ARENA_INITIAL_BYTES), ARENA_BLOCK_ALIGN);
+    a.block = static_cast<char*>(std::aligned_alloc(ARENA_BLOCK_ALIGN, a.capacity));
+    ++a.grows;
+}
+
+// bytes of scratch aligned to align (a power of two up to 64), valid until
+// the next end_frame
+inline void* alloc(size_t bytes, size_t align = 16) {
+    FrameArena& a = frame_arena();
+    if (!a.block) grow(a, ARENA_INITIAL_BYTES);
+    size_t offset = align_up(a.used, align);
+    if (offset + bytes <= a.capacity) {
+        a.used = offset + bytes;
+        return a.block + offset;
+    }
+    size_t size = align_up(std::max(bytes, (size_t)1), align);
+    void* p = std::aligned_alloc(align, size);
+    a.spill.push_back(p);
+    a.spill_bytes += size + align;
+    ++a.spills;
+    return p;
+}
+
+template <typename T>
+inline T* alloc_array(size_t count) {
+    static_assert(std::is_trivially_destructible<T>::value,
+                  "the frame arena never runs destructors");
+    return static_cast<T*>(alloc(count * sizeof(T), std::max(alignof(T), (size_t)16)));
+}
+
+// For jank, which can't name the template
+inline float* alloc_floats(int count) {
+    return alloc_array<float>((size_t)count);
+}
+
+// Frame boundary: everything allocated this frame is released
+inline void end_frame() {
+    FrameArena& a = frame_arena();
+    size_t demand = a.used + a.spill_bytes;
+    for (void* p : a.spill) std::free(p);
+    a.spill.clear();
+    if (a.spill_bytes > 0) grow(a, demand + demand / 2);
+    a.spill_bytes = 0;
+    a.last_used = demand;
+    a.peak_used = std::max(a.peak_used, demand);
+    a.used = 0;
+}
+
+} // namespace earena
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+// Tools built without the collector (EGC_NO_GC, or no BDWGC headers) get
+// plain malloc from the same allocator
+#if !defined(EGC_NO_GC) && __has_include(<gc/gc.h>)
+#include <gc/gc.h>
+#define EGC_ATOMIC_ALLOC 1
+#ifndef GC_ATOMIC_UNCOLLECTABLE
+// Built into the collector by default, but gc.h only declares it when asked
+extern "C" void* GC_malloc_atomic_uncollectable(size_t);
+#endif
+#else
+#define EGC_ATOMIC_ALLOC 0
+#endif
+
+namespace egc {
+
+// ============================================================================
+// Pointer-free bulk buffers
+// ============================================================================
+// Collision vertices, BVH nodes, vertex batches: megabytes holding no
+// pointers. Allocated with GC_malloc_atomic_uncollectable they are never
+// scanned, so a collection doesn't walk them, and never collected, so their
+// lifetime stays the owning container's whether or not the collector can see
+// that container. Only for element types that hold no pointers into the GC
+// heap: the collector won't find them here.
+
+template <typename T>
+struct AtomicAllocator {
+    using value_type = T;
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "AtomicAllocator is for plain data; it isn't scanned for pointers");
+
+    AtomicAllocator() noexcept = default;
+    template <typename U>
+    AtomicAllocator(const AtomicAllocator<U>&) noexcept {}
+
+    T* allocate(std::size_t n) {
+        std::size_t bytes = n * sizeof(T);
+#if EGC_ATOMIC_ALLOC
+        void* p = GC_malloc_atomic_uncollectable(bytes ? bytes : 1);
+#else
+        void* p = std::malloc(bytes ? bytes : 1);
+#endif
+        if (!p) throw std::bad_alloc();
+        return static_cast<T*>(p);
+    }
+
+    void deallocate(T* p, std::size_t) noexcept {
+#if EGC_ATOMIC_ALLOC
+        GC_free(p);
+#else
+        std::free(p);
+#endif
+    }
+};
+
+template <typename T, typename U>
+inline bool operator==(const AtomicAllocator<T>&, const AtomicAllocator<U>&) { return true; }
+template <typename T, typename U>
+inline bool operator!=(const AtomicAllocator<T>&, const AtomicAllocator<U>&) { return false; }
+
+template <typename T>
+using atomic_vector = std::vector<T, AtomicAllocator<T>>;
+
+} // namespace egc
@@ -0,0 +1,206 @@
+#pragma once
+
+#include <gc/gc.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "engine/timing_impl.h"
+
+namespace egc {
+
+// ============================================================================
+// Frame-budget collection
+// ============================================================================
+// Incremental GC work sized to what's left of the frame: slices of
+// GC_collect_a_little run until the next one would likely overrun the
+// budget or the cycle is done. A full collection happens only once the
+// heap in use passes a threshold, so pause length stays predictable.
+
+struct FrameGc {
+    double gc_ms = 0.0;         // Spent in the last frame_collect
+    int slices = 0;
+    bool forced = false;
+    double slice_ms_avg = 0.05; // Running estimate of one slice's cost
+};
+
+inline FrameGc& frame_gc() {
+    static FrameGc f;
+    return f;
+}
+
+// target_ms: frame time to aim for; used_ms: already spent this frame;
+// force_bytes: heap in use that triggers a full collection (0 = never).
+// Returns the milliseconds spent collecting.
+inline double frame_collect(double target_ms, double used_ms, size_t force_bytes) {
+    FrameGc& f = frame_gc();
+    double start = etiming::now_ms();
+    f.slices = 0;
+    f.forced = false;
+
+    if (force_bytes > 0 && GC_get_memory_use() > force_bytes) {
+        GC_gcollect();
+        f.forced = true;
+    } else {
+        double budget = target_ms - used_ms;
+        double now = start;
+        while (now - start + f.slice_ms_avg <= budget) {
+            int more = GC_collect_a_little();
+            double after = etiming::now_ms();
+            f.slice_ms_avg += 0.1 * ((after - now) - f.slice_ms_avg);
+            now = after;
+            ++f.slices;
+            if (!more) break;
+        }
+    }
+    f.gc_ms = etiming::now_ms() - start;
+    return f.gc_ms;
+}
+
+// ============================================================================
+// Allocation and pause telemetry
+// ============================================================================
+// Bytes allocated per frame (GC_get_total_bytes deltas), per tagged scope,
+// and each collection's pause (GC_EVENT_START to GC_EVENT_END through
+// GC_set_on_collection_event), with the last TELEMETRY_FRAMES frames kept
+// for graphs. Scopes are main-thread only; pauses are whatever thread
+// collected.
+
+const int TELEMETRY_FRAMES = 120;
+
+struct AllocScope {
+    std::string tag;
+    size_t frame_bytes = 0;  // Accumulating this frame
+    size_t last_bytes = 0;   // Finished last frame
+};
+
+struct Telemetry {
+    bool installed = false;
+    size_t frame_start_bytes = 0;
+    double frame_start_ms = 0.0;
+    double collection_start_ms = 0.0;
+    // This frame so far
+    double frame_pause_ms = 0.0;
+    int frame_pauses = 0;
+    int last_frame_pauses = 0;
+    // Last collection
+    double last_pause_ms = 0.0;
+    double max_pause_ms = 0.0;  // Since install
+    // Rings of finished frames, oldest at head
+    size_t alloc_bytes[TELEMETRY_FRAMES] = {};
+    double pause_ms[TELEMETRY_FRAMES] = {};
+    double frame_ms[TELEMETRY_FRAMES] = {};
+    int head = 0;
+    int count = 0;
+    std::vector<AllocScope> scopes;
+};
+
+inline Telemetry& telemetry() {
+    static Telemetry t;
+    return t;
+}
+
+inline void on_collection_event(GC_EventType event) {
+    Telemetry& t = telemetry();
+    if (event == GC_EVENT_START) {
+        t.collection_start_ms = etiming::now_ms();
+    } else if (event == GC_EVENT_END) {
+        double pause = etiming::now_ms() - t.collection_start_ms;
+        t.last_pause_ms = pause;
+        t.max_pause_ms = std::max(t.max_pause_ms, pause);
+        t.frame_pause_ms += pause;
+        ++t.frame_pauses;
+    }
+}
+
+inline void telemetry_install() {
+    Telemetry& t = telemetry();
+    if (t.installed) return;
+    t.installed = true;
+    t.frame_start_bytes = GC_get_total_bytes();
+    t.frame_start_ms = etiming::now_ms();
+    GC_set_on_collection_event(on_collection_event);
+}
+
+// Close the frame: push its allocation and pause totals onto the rings
+// and roll every scope's bytes over
+inline void telemetry_frame() {
+    Telemetry& t = telemetry();
+    size_t total = GC_get_total_bytes();
+    double now = etiming::now_ms();
+    int slot = (t.head + t.count) % TELEMETRY_FRAMES;
+    if (t.count == TELEMETRY_FRAMES) {
+        t.head = (t.head + 1) % TELEMETRY_FRAMES;
+    } else {
+        ++t.count;
+    }
+    t.alloc_bytes[slot] = total - t.frame_start_bytes;
+    t.pause_ms[slot] = t.frame_pause_ms;
+    t.frame_ms[slot] = now - t.frame_start_ms;
+    t.frame_start_bytes = total;
+    t.frame_start_ms = now;
+    t.frame_pause_ms = 0.0;
+    t.last_frame_pauses = t.frame_pauses;
+    t.frame_pauses = 0;
+    for (AllocScope& s : t.scopes) {
+        s.last_bytes = s.frame_bytes;
+        s.frame_bytes = 0;
+    }
+}
+
+// Index of the scope tagged tag, created on first use
+inline int scope_index(const char* tag) {
+    Telemetry& t = telemetry();
+    for (size_t i = 0; i < t.scopes.size(); ++i) {
+        if (t.scopes[i].tag == tag) return (int)i;
+    }
+    t.scopes.push_back({tag});
+    return (int)t.scopes.size() - 1;
+}
+
+inline size_t scope_begin() {
+    return GC_get_total_bytes();
+}
+
+inline void scope_end(int scope, size_t start_bytes) {
+    telemetry().scopes[scope].frame_bytes += GC_get_total_bytes() - start_bytes;
+}
+
+inline int scope_count() {
+    return (int)telemetry().scopes.size();
+}
+
+inline std::string scope_tag(int scope) {
+    return telemetry().scopes[scope].tag;
+}
+
+inline size_t scope_last_bytes(int scope) {
+    return telemetry().scopes[scope].last_bytes;
+}
+
+// i-th finished frame, 0 = oldest
+inline size_t frame_alloc_bytes(int i) {
+    const Telemetry& t = telemetry();
+    return t.alloc_bytes[(t.head + i) % TELEMETRY_FRAMES];
+}
+
+inline double frame_pause_ms(int i) {
+    const Telemetry& t = telemetry();
+    return t.pause_ms[(t.head + i) % TELEMETRY_FRAMES];
+}
+
+// Bytes per second over the whole history
+inline double alloc_rate() {
+    const Telemetry& t = telemetry();
+    double bytes = 0.0;
+    double ms = 0.0;
+    for (int i = 0; i < t.count; ++i) {
+        bytes += (double)t.alloc_bytes[i];
+        ms += t.frame_ms[i];
+    }
+    return ms > 0.0 ? bytes * 1000.0 / ms : 0.0;
+}
+
+} // namespace egc
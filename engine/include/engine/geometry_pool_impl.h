@@ -0,0 +1,279 @@
+#pragma once
+#include "gl_wrappers.h"
+#include "engine/gl_state_impl.h"
+#include "engine/memtrack_impl.h"
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// ============ STATIC GEOMETRY POOLS ============
+// Static meshes with the same vertex format share one VAO: a pool's vertex
+// and index buffers are carved into ranges, one pair per mesh, and a mesh
+// draws as (first index, base vertex) into them. Packets from one pool
+// differ only in their ranges, so the render queue sorts them together,
+// binds the VAO once and multi-draws what shares the rest of their state
+// (erender::queue_base_vertex).
+//
+// A pool starts at INITIAL_VERTICES / INITIAL_INDICES and doubles whenever
+// an upload doesn't fit, copying what it holds on the GPU
+// (glCopyBufferSubData). Handles are offsets, so they survive the move.
+// Freed ranges go on a first-fit free list, joined to their neighbours.
+//
+// Where GL 4.3 or ARB_vertex_attrib_binding is available the VAO declares
+// its format once (glVertexAttribFormat) and a grown vertex buffer is only
+// rebound (glBindVertexBuffer). Elsewhere (macOS stops at 4.1) the
+// attribute pointers are specified again.
+//
+// Indices are relative to the mesh's base vertex, so 16-bit index pools
+// take any mesh of up to 65536 vertices. Pools live as long as the GL
+// context; meshes are freed one by one.
+
+namespace egeompool {
+
+const int MAX_ATTRIBUTES = 4;
+const uint32_t INITIAL_VERTICES = 1 << 16;
+const uint32_t INITIAL_INDICES = 1 << 18;
+
+struct Attribute {
+  GLuint location;
+  GLint size;
+  GLenum type;
+  GLboolean normalized;
+  GLuint offset;                       // Into the vertex
+};
+
+// What pools are told apart by
+struct Format {
+  GLsizei stride = 0;
+  int attribute_count = 0;
+  Attribute attributes[MAX_ATTRIBUTES] = {};
+  GLenum index_type = GL_UNSIGNED_INT;
+
+  void add(GLuint location, GLint size, GLenum type, GLboolean normalized, GLuint offset) {
+    attributes[attribute_count++] = Attribute{location, size, type, normalized, offset};
+  }
+};
+
+inline bool format_equal(const Format& a, const Format& b) {
+  if (a.stride != b.stride || a.attribute_count != b.attribute_count ||
+      a.index_type != b.index_type) {
+    return false;
+  }
+  for (int i = 0; i < a.attribute_count; ++i) {
+    const Attribute& x = a.attributes[i];
+    const Attribute& y = b.attributes[i];
+    if (x.location != y.location || x.size != y.size || x.type != y.type ||
+        x.normalized != y.normalized || x.offset != y.offset) {
+      return false;
+    }
+  }
+  return true;
+}
+
+inline size_t index_bytes(GLenum type) {
+  return type == GL_UNSIGNED_SHORT ? 2 : 4;
+}
+
+// Glue format's attributes to the bound VAO and GL_ARRAY_BUFFER, at offset
+// bytes in (glVertexAttribPointer)
+inline void set_attribute_pointers(const Format& format, size_t offset) {
+  for (int i = 0; i < format.attribute_count; ++i) {
+    const Attribute& a = format.attributes[i];
+    glVertexAttribPointer(a.location, a.size, a.type, a.normalized, format.stride,
+                          (void*)(offset + a.offset));
+    glEnableVertexAttribArray(a.location);
+  }
+}
+
+inline bool attrib_binding_supported() {
+#ifdef __APPLE__
+  return false;
+#else
+  return GLEW_VERSION_4_3 || GLEW_ARB_vertex_attrib_binding;
+#endif
+}
+
+// ---- Range allocation ----
+
+struct Span {
+  uint32_t first;
+  uint32_t count;
+};
+
+struct Allocator {
+  uint32_t capacity = 0;
+  std::vector<Span> free;              // Sorted by first, never adjacent
+};
+
+// First fit; false when no free span is large enough
+inline bool take(Allocator* a, uint32_t count, uint32_t* first) {
+  for (size_t i = 0; i < a->free.size(); ++i) {
+    Span& s = a->free[i];
+    if (s.count < count) continue;
+    *first = s.first;
+    s.first += count;
+    s.count -= count;
+    if (s.count == 0) a->free.erase(a->free.begin() + i);
+    return true;
+  }
+  return false;
+}
+
+inline void give(Allocator* a, uint32_t first, uint32_t count) {
+  if (count == 0) return;
+  auto it = std::lower_bound(a->free.begin(), a->free.end(), first,
+                             [](const Span& s, uint32_t f) { return s.first < f; });
+  it = a->free.insert(it, Span{first, count});
+  if (it + 1 != a->free.end() && it->first + it->count == (it + 1)->first) {
+    it->count += (it + 1)->count;
+    a->free.erase(it + 1);
+  }
+  if (it != a->free.begin() && (it - 1)->first + (it - 1)->count == it->first) {
+    (it - 1)->count += it->count;
+    a->free.erase(it);
+  }
+}
+
+// ---- Pools ----
+
+struct Pool {
+  Format format;
+  GLuint vao = 0, vbo = 0, ebo = 0;
+  bool attrib_binding = false;
+  Allocator vertices;
+  Allocator indices;
+  int meshes = 0;
+};
+
+struct Mesh {
+  Pool* pool;
+  uint32_t base_vertex, vertex_count;
+  uint32_t first_index, index_count;
+};
+
+inline std::vector<Pool*>& pools() {
+  static std::vector<Pool*> p;
+  return p;
+}
+
+// A new buffer of bytes bound to target, holding the first keep bytes of
+// old (0: none), which is deleted
+inline GLuint replace_buffer(GLenum target, GLuint old, size_t keep, size_t bytes) {
+  GLuint buffer = 0;
+  glGenBuffers(1, &buffer);
+  eglstate::bind_buffer(target, buffer);
+  glBufferData(target, (GLsizeiptr)bytes, nullptr, GL_STATIC_DRAW);
+  ememtrack::track_buffer(buffer, ememtrack::CAT_MESHES, (int64_t)bytes);
+  if (old) {
+    glBindBuffer(GL_COPY_READ_BUFFER, old);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, (GLsizeiptr)keep);
+    eglstate::forget_buffer(old);
+    ememtrack::untrack_buffer(old);
+    glDeleteBuffers(1, &old);
+  }
+  return buffer;
+}
+
+// Attach the pool's vertex buffer to its VAO (bound)
+inline void attach_vertices(Pool* p) {
+#ifndef __APPLE__
+  if (p->attrib_binding) {
+    glBindVertexBuffer(0, p->vbo, 0, p->format.stride);
+    return;
+  }
+#endif
+  eglstate::bind_buffer(GL_ARRAY_BUFFER, p->vbo);
+  set_attribute_pointers(p->format, 0);
+}
+
+inline void grow_vertices(Pool* p, uint32_t capacity) {
+  eglstate::bind_vertex_array(p->vao);
+  p->vbo = replace_buffer(GL_ARRAY_BUFFER, p->vbo,
+                          (size_t)p->vertices.capacity * p->format.stride,
+                          (size_t)capacity * p->format.stride);
+  attach_vertices(p);
+  give(&p->vertices, p->vertices.capacity, capacity - p->vertices.capacity);
+  p->vertices.capacity = capacity;
+}
+
+inline void grow_indices(Pool* p, uint32_t capacity) {
+  size_t bytes = index_bytes(p->format.index_type);
+  eglstate::bind_vertex_array(p->vao);
+  // Bound with the VAO bound, so the new one is its element buffer
+  p->ebo = replace_buffer(GL_ELEMENT_ARRAY_BUFFER, p->ebo,
+                          (size_t)p->indices.capacity * bytes, (size_t)capacity * bytes);
+  give(&p->indices, p->indices.capacity, capacity - p->indices.capacity);
+  p->indices.capacity = capacity;
+}
+
+inline Pool* create_pool(const Format& format) {
+  Pool* p = new Pool();
+  p->format = format;
+  p->attrib_binding = attrib_binding_supported();
+  glGenVertexArrays(1, &p->vao);
+  eglstate::bind_vertex_array(p->vao);
+#ifndef __APPLE__
+  if (p->attrib_binding) {
+    for (int i = 0; i < format.attribute_count; ++i) {
+      const Attribute& a = format.attributes[i];
+      glVertexAttribFormat(a.location, a.size, a.type, a.normalized, a.offset);
+      glVertexAttribBinding(a.location, 0);
+      glEnableVertexAttribArray(a.location);
+    }
+  }
+#endif
+  grow_vertices(p, INITIAL_VERTICES);
+  grow_indices(p, INITIAL_INDICES);
+  return p;
+}
+
+// The pool for format, made on first use
+inline Pool* pool_for(const Format& format) {
+  for (Pool* p : pools()) {
+    if (format_equal(p->format, format)) return p;
+  }
+  pools().push_back(create_pool(format));
+  return pools().back();
+}
+
+// Copy vertex_count vertices (format's layout) and index_count indices
+// (format's index type, relative to the first vertex) into the pool for
+// format. Leaves the pool's VAO bound.
+inline Mesh* upload(const Format& format, const void* vertices, uint32_t vertex_count,
+                    const void* indices, uint32_t index_count) {
+  Pool* p = pool_for(format);
+  Mesh* m = new Mesh{p, 0, vertex_count, 0, index_count};
+  while (!take(&p->vertices, vertex_count, &m->base_vertex)) {
+    grow_vertices(p, std::max(p->vertices.capacity * 2, p->vertices.capacity + vertex_count));
+  }
+  while (!take(&p->indices, index_count, &m->first_index)) {
+    grow_indices(p, std::max(p->indices.capacity * 2, p->indices.capacity + index_count));
+  }
+  size_t ib = index_bytes(format.index_type);
+  eglstate::bind_vertex_array(p->vao);
+  eglstate::bind_buffer(GL_ARRAY_BUFFER, p->vbo);
+  wrap_glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)((size_t)m->base_vertex * format.stride),
+                       (GLsizeiptr)((size_t)vertex_count * format.stride), vertices);
+  eglstate::bind_buffer(GL_ELEMENT_ARRAY_BUFFER, p->ebo);
+  wrap_glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, (GLintptr)((size_t)m->first_index * ib),
+                       (GLsizeiptr)((size_t)index_count * ib), indices);
+  ++p->meshes;
+  return m;
+}
+
+// Return m's ranges to its pool
+inline void free_mesh(Mesh* m) {
+  if (!m) return;
+  give(&m->pool->vertices, m->base_vertex, m->vertex_count);
+  give(&m->pool->indices, m->first_index, m->index_count);
+  --m->pool->meshes;
+  delete m;
+}
+
+inline GLuint mesh_vao(const Mesh* m) { return m->pool->vao; }
+inline GLenum mesh_index_type(const Mesh* m) { return m->pool->format.index_type; }
+inline int mesh_base_vertex(const Mesh* m) { return (int)m->base_vertex; }
+inline int mesh_first_index(const Mesh* m) { return (int)m->first_index; }
+
+} // namespace egeompool
@@ -0,0 +1,294 @@
+#pragma once
+#include "engine/gfx2d_text_impl.h"
+#include <cstdlib>
+#include <memory>
+
+// ============ FONT MANAGER ============
+// Several faces at several sizes, with glyphs packed into shared atlases
+// instead of one 512x512 texture per baked size (g_font).
+//
+// A face is a TTF kept in memory. A font is a face at a pixel size, with
+// ASCII 32-126 packed into the first atlas of its kind that has room; a
+// new atlas is opened when none does.
+//   - Bitmap fonts are packed with stbtt_PackFontRanges and look right at
+//     their own size.
+//   - SDF fonts hold a signed distance field per glyph
+//     (stbtt_GetCodepointSDF) rendered once at SDF_PIXEL_SIZE. Any size
+//     scales from that, so one SDF font serves every size crisply.
+// Text queued for a font (queue_font_text) joins its atlas's batch;
+// flush_fonts draws each non-empty batch with one call.
+
+namespace etext {
+
+const int FONT_ATLAS_SIZE = 1024;
+const int FONT_FIRST_CHAR = 32;
+const int FONT_CHAR_COUNT = 95;          // 32-126
+const float SDF_PIXEL_SIZE = 40.0f;      // SDF glyphs are rendered at this size
+const int SDF_PADDING = 6;               // Pixels of distance field around each glyph
+const unsigned char SDF_ON_EDGE = 128;
+
+struct FontFace {
+    std::vector<unsigned char> ttf;
+    stbtt_fontinfo info;
+};
+
+struct Glyph {
+    float s0, t0, s1, t1;                // Atlas UVs
+    float x0, y0, x1, y1;                // Quad relative to the pen, at the font's size
+    float advance;
+};
+
+struct FontAtlas {
+    GLuint texture = 0;
+    bool sdf = false;
+    std::vector<unsigned char> pixels;   // CPU copy, for packing more fonts in
+    stbtt_pack_context pack;             // Bitmap atlases
+    int shelf_x = 0, shelf_y = 0, shelf_h = 0;  // SDF atlases: shelf packer
+    std::vector<float> batch;            // Queued glyph vertices
+};
+
+struct Font {
+    int atlas;
+    float size;                          // Pixel size glyph metrics are in
+    Glyph glyphs[FONT_CHAR_COUNT];
+};
+
+struct FontManager {
+    std::vector<std::unique_ptr<FontFace>> faces;
+    std::vector<std::unique_ptr<FontAtlas>> atlases;
+    std::vector<Font> fonts;
+    int last_draws = 0;
+};
+
+inline FontManager& fonts() {
+    static FontManager m;
+    return m;
+}
+
+// ---- Faces ----
+
+// Returns the face id, or -1 if the TTF can't be read
+inline int load_face_from_buffer(const unsigned char* ttf, size_t size) {
+    std::unique_ptr<FontFace> face(new FontFace());
+    face->ttf.assign(ttf, ttf + size);
+    if (!stbtt_InitFont(&face->info, face->ttf.data(),
+                        stbtt_GetFontOffsetForIndex(face->ttf.data(), 0))) {
+        return -1;
+    }
+    fonts().faces.push_back(std::move(face));
+    return (int)fonts().faces.size() - 1;
+}
+
+inline int load_face_from_resource(const char* resource_name) {
+    const char* data = nullptr;
+    std::size_t size = 0;
+    if (!eresources::find_resource(resource_name, &data, &size)) {
+        fprintf(stderr, "Font resource not found: %s\n", resource_name);
+        return -1;
+    }
+    return load_face_from_buffer(reinterpret_cast<const unsigned char*>(data), size);
+}
+
+// ---- Atlases ----
+
+inline int create_atlas(bool sdf) {
+    std::unique_ptr<FontAtlas> a(new FontAtlas());
+    a->sdf = sdf;
+    a->pixels.assign((size_t)FONT_ATLAS_SIZE * FONT_ATLAS_SIZE, 0);
+    if (!sdf) {
+        stbtt_PackBegin(&a->pack, a->pixels.data(), FONT_ATLAS_SIZE, FONT_ATLAS_SIZE, 0, 1, nullptr);
+    }
+    glGenTextures(1, &a->texture);
+    eglstate::active_texture(GL_TEXTURE0);
+    eglstate::bind_texture(GL_TEXTURE_2D, a->texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, FONT_ATLAS_SIZE, FONT_ATLAS_SIZE, 0,
+                 GL_RED, GL_UNSIGNED_BYTE, a->pixels.data());
+    // The atlas and its CPU copy, kept for packing more fonts in
+    ememtrack::track_texture(a->texture, ememtrack::CAT_FONTS, (int64_t)a->pixels.size());
+    ememtrack::add(ememtrack::CAT_FONTS, ememtrack::RAM, (int64_t)a->pixels.size());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    fonts().atlases.push_back(std::move(a));
+    return (int)fonts().atlases.size() - 1;
+}
+
+inline void upload_atlas(FontAtlas* a) {
+    eglstate::active_texture(GL_TEXTURE0);
+    eglstate::bind_texture(GL_TEXTURE_2D, a->texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    wrap_glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, FONT_ATLAS_SIZE, FONT_ATLAS_SIZE,
+                         GL_RED, GL_UNSIGNED_BYTE, a->pixels.data());
+}
+
+// Pack a bitmap font into atlas a. False if it doesn't fit.
+inline bool pack_bitmap_font(FontAtlas* a, FontFace* face, float size, Font* font) {
+    stbtt_packedchar packed[FONT_CHAR_COUNT];
+    stbtt_pack_range range = {};
+    range.font_size = size;
+    range.first_unicode_codepoint_in_range = FONT_FIRST_CHAR;
+    range.num_chars = FONT_CHAR_COUNT;
+    range.chardata_for_range = packed;
+    if (!stbtt_PackFontRanges(&a->pack, face->ttf.data(), 0, &range, 1)) {
+        return false;
+    }
+    const float inv = 1.0f / FONT_ATLAS_SIZE;
+    for (int i = 0; i < FONT_CHAR_COUNT; ++i) {
+        const stbtt_packedchar& p = packed[i];
+        font->glyphs[i] = Glyph{p.x0 * inv, p.y0 * inv, p.x1 * inv, p.y1 * inv,
+                                p.xoff, p.yoff, p.xoff2, p.yoff2, p.xadvance};
+    }
+    return true;
+}
+
+// Pack an SDF font into atlas a, shelf by shelf. False if it doesn't fit;
+// the atlas is only touched once every glyph has a place.
+inline bool pack_sdf_font(FontAtlas* a, FontFace* face, Font* font) {
+    struct Rendered { unsigned char* bitmap; int w, h, xoff, yoff, x, y; };
+    float scale = stbtt_ScaleForPixelHeight(&face->info, SDF_PIXEL_SIZE);
+    Rendered rendered[FONT_CHAR_COUNT];
+    int shelf_x = a->shelf_x, shelf_y = a->shelf_y, shelf_h = a->shelf_h;
+    bool fits = true;
+    for (int i = 0; i < FONT_CHAR_COUNT; ++i) {
+        Rendered& r = rendered[i];
+        r.bitmap = stbtt_GetCodepointSDF(&face->info, scale, FONT_FIRST_CHAR + i, SDF_PADDING,
+                                         SDF_ON_EDGE, (float)SDF_ON_EDGE / SDF_PADDING,
+                                         &r.w, &r.h, &r.xoff, &r.yoff);
+        if (!r.bitmap) r.w = r.h = 0;      // Space and other empty glyphs
+        if (shelf_x + r.w + 1 > FONT_ATLAS_SIZE) {
+            shelf_x = 0;
+            shelf_y += shelf_h + 1;
+            shelf_h = 0;
+        }
+        if (shelf_y + r.h > FONT_ATLAS_SIZE) fits = false;
+        r.x = shelf_x;
+        r.y = shelf_y;
+        shelf_x += r.w + 1;
+        if (r.h > shelf_h) shelf_h = r.h;
+    }
+    if (fits) {
+        a->shelf_x = shelf_x;
+        a->shelf_y = shelf_y;
+        a->shelf_h = shelf_h;
+    }
+    const float inv = 1.0f / FONT_ATLAS_SIZE;
+    for (int i = 0; i < FONT_CHAR_COUNT; ++i) {
+        Rendered& r = rendered[i];
+        if (fits) {
+            for (int row = 0; row < r.h; ++row) {
+                std::memcpy(&a->pixels[(size_t)(r.y + row) * FONT_ATLAS_SIZE + r.x],
+                            r.bitmap + (size_t)row * r.w, r.w);
+            }
+            int advance, lsb;
+            stbtt_GetCodepointHMetrics(&face->info, FONT_FIRST_CHAR + i, &advance, &lsb);
+            font->glyphs[i] = Glyph{r.x * inv, r.y * inv, (r.x + r.w) * inv, (r.y + r.h) * inv,
+                                    (float)r.xoff, (float)r.yoff,
+                                    (float)(r.xoff + r.w), (float)(r.yoff + r.h),
+                                    advance * scale};
+        }
+        if (r.bitmap) stbtt_FreeSDF(r.bitmap, nullptr);
+    }
+    return fits;
+}
+
+// ---- Fonts ----
+
+// Add face at size (pixels); with sdf, size only sets the default draw
+// size, the glyphs being SDF_PIXEL_SIZE fields. Returns the font id, or -1.
+inline int add_font(int face_id, float size, bool sdf) {
+    FontManager& m = fonts();
+    if (face_id < 0 || face_id >= (int)m.faces.size()) return -1;
+    FontFace* face = m.faces[face_id].get();
+    Font font;
+    font.size = sdf ? SDF_PIXEL_SIZE : size;
+    font.atlas = -1;
+    for (int i = 0; i < (int)m.atlases.size() && font.atlas < 0; ++i) {
+        FontAtlas* a = m.atlases[i].get();
+        if (a->sdf != sdf) continue;
+        if (sdf ? pack_sdf_font(a, face, &font) : pack_bitmap_font(a, face, size, &font)) {
+            font.atlas = i;
+        }
+    }
+    if (font.atlas < 0) {
+        int i = create_atlas(sdf);
+        FontAtlas* a = m.atlases[i].get();
+        if (!(sdf ? pack_sdf_font(a, face, &font) : pack_bitmap_font(a, face, size, &font))) {
+            return -1;                   // Larger than a whole atlas
+        }
+        font.atlas = i;
+    }
+    upload_atlas(m.atlases[font.atlas].get());
+    m.fonts.push_back(font);
+    return (int)m.fonts.size() - 1;
+}
+
+// ---- Drawing ----
+
+// Queue text in font at size pixels (<= 0: the font's own size)
+inline void queue_font_text(int font_id, const char* text, float x, float y, float size,
+                            float r, float g, float b) {
+    FontManager& m = fonts();
+    if (font_id < 0 || font_id >= (int)m.fonts.size()) return;
+    const Font& font = m.fonts[font_id];
+    float scale = size > 0.0f ? size / font.size : 1.0f;
+    std::vector<float>& out = m.atlases[font.atlas]->batch;
+    float pen = x;
+    for (const char* p = text; *p; p++) {
+        int c = (unsigned char)*p - FONT_FIRST_CHAR;
+        if (c < 0 || c >= FONT_CHAR_COUNT) continue;
+        const Glyph& gl = font.glyphs[c];
+        if (gl.x1 > gl.x0) {
+            float x0 = pen + gl.x0 * scale, y0 = y + gl.y0 * scale;
+            float x1 = pen + gl.x1 * scale, y1 = y + gl.y1 * scale;
+            const float quad[] = {
+                x0, y0, gl.s0, gl.t0, r, g, b,
+                x1, y0, gl.s1, gl.t0, r, g, b,
+                x1, y1, gl.s1, gl.t1, r, g, b,
+
+                x0, y0, gl.s0, gl.t0, r, g, b,
+                x1, y1, gl.s1, gl.t1, r, g, b,
+                x0, y1, gl.s0, gl.t1, r, g, b
+            };
+            out.insert(out.end(), quad, quad + 6 * FLOATS_PER_GLYPH_VERTEX);
+        }
+        pen += gl.advance * scale;
+    }
+}
+
+// Draw every atlas's queued text, one call per atlas. Uses g_font's shader
+// and VAO, so the default font must be initialized.
+inline void flush_fonts(int screen_w, int screen_h) {
+    FontManager& m = fonts();
+    m.last_draws = 0;
+    if (!g_font) return;
+    bool begun = false;
+    for (auto& a : m.atlases) {
+        if (a->batch.empty()) continue;
+        if (!begun) {
+            begin_text_draw(screen_w, screen_h);
+            begun = true;
+        }
+        eglstate::bind_texture(GL_TEXTURE_2D, a->texture);
+        glUniform1i(eshaders::uniform_location(g_font->shader, "uSdf"), a->sdf ? 1 : 0);
+        GLint first = eglstream::shared_vertices(a->batch.data(), a->batch.size() * sizeof(float),
+                                                 GLYPH_VERTEX_BYTES);
+        if (first >= 0) {
+            wrap_glDrawArrays(GL_TRIANGLES, first, (GLsizei)(a->batch.size() / FLOATS_PER_GLYPH_VERTEX));
+            ++m.last_draws;
+        }
+        a->batch.clear();
+    }
+    if (begun) end_text_draw();
+}
+
+inline int atlas_count() {
+    return (int)fonts().atlases.size();
+}
+
+inline int font_count() {
+    return (int)fonts().fonts.size();
+}
+
+} // namespace etext
@@ -1,17 +1,61 @@
 #pragma once
 #include "gl_wrappers.h"
+#include "engine/gl_state_impl.h"
+#include "engine/gl_stream_impl.h"
+#include "engine/gl_timer_impl.h"
+#include "engine/shaders_impl.h"
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <cstddef>
 #include <cmath>
 #include <vector>
 
-// Graphics2D state - stored in C++ to avoid closure capture issues
+// Graphics2D state - stored in C++ to avoid closure capture issues.
+//
+// Primitives between begin_2d_impl and end_2d_impl are not drawn one by
+// one: each appends triangles, with the color current at the time as a
+// vertex attribute, to one batch, and end_2d_impl streams the batch through
+// the shared ring (gl_stream_impl.h, which vbo names) and draws it with GL
+// state set once. Primitives outside a begin/end pair are drawn as they
+// come, as before.
+//
+// Arc outlines aren't tessellated per call. One strip of ARC_SEGMENTS
+// segments is built at init, each vertex holding (t along the arc, -1 inner
+// / +1 outer edge), and graphics2d_vertex.glsl places it from per-instance
+// center, radius, thickness, start and end angles and color while uArc is
+// set. A batch's arcs go into one glDrawArraysInstanced, drawn beneath its
+// other primitives.
+const int ARC_SEGMENTS = 64;
+const int ARC_STRIP_VERTICES = 2 * (ARC_SEGMENTS + 1);
+const GLuint ARC_PARAMS_ATTRIB = 2;   // cx cy radius thickness
+const GLuint ARC_ANGLES_ATTRIB = 3;   // start end
+const GLuint ARC_COLOR_ATTRIB = 1;    // Shared with the batch's aColor
+
+struct ArcInstance {
+    float params[4];
+    float angles[2];
+    float color[4];
+};
+
 struct Graphics2DState {
     GLuint vao;
     GLuint vbo;
     GLuint shader;
+    glm::mat4 projection = glm::mat4(1.0f);
+    float color[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+    std::vector<float> batch;   // x y r g b a per vertex
+    bool batching = false;
+    int last_vertices = 0;      // Last flush
+    int last_draws = 0;
+    // Cached arc strip and its instances
+    GLuint arc_vao = 0;
+    GLuint arc_strip = 0;
+    GLuint arc_instances = 0;
+    size_t arc_capacity = 0;            // Instances arc_instances holds
+    std::vector<ArcInstance> arcs;      // Pending, drawn at the next flush
 };
 
 inline Graphics2DState*& get_g_gfx2d() {
@@ -23,44 +67,146 @@ inline Graphics2DState*& get_g_gfx2d() {
 #define float_size_2d (egfx2d::get_float_size_2d())
 
 namespace egfx2d {
+// The unit arc strip and the VAO drawing it with per-instance attributes
+inline void create_arc_mesh(Graphics2DState* g) {
+    float strip[ARC_STRIP_VERTICES * 2];
+    for (int i = 0; i <= ARC_SEGMENTS; ++i) {
+        float t = (float)i / ARC_SEGMENTS;
+        strip[i * 4 + 0] = t;
+        strip[i * 4 + 1] = -1.0f;
+        strip[i * 4 + 2] = t;
+        strip[i * 4 + 3] = 1.0f;
+    }
+    glGenVertexArrays(1, &g->arc_vao);
+    glGenBuffers(1, &g->arc_strip);
+    glGenBuffers(1, &g->arc_instances);
+    eglstate::bind_vertex_array(g->arc_vao);
+    eglstate::bind_buffer(GL_ARRAY_BUFFER, g->arc_strip);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(strip), strip, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+
+    g->arc_capacity = 16;
+    eglstate::bind_buffer(GL_ARRAY_BUFFER, g->arc_instances);
+    glBufferData(GL_ARRAY_BUFFER, g->arc_capacity * sizeof(ArcInstance), nullptr, GL_STREAM_DRAW);
+    glVertexAttribPointer(ARC_PARAMS_ATTRIB, 4, GL_FLOAT, GL_FALSE, sizeof(ArcInstance),
+                          (void*)offsetof(ArcInstance, params));
+    glVertexAttribPointer(ARC_ANGLES_ATTRIB, 2, GL_FLOAT, GL_FALSE, sizeof(ArcInstance),
+                          (void*)offsetof(ArcInstance, angles));
+    glVertexAttribPointer(ARC_COLOR_ATTRIB, 4, GL_FLOAT, GL_FALSE, sizeof(ArcInstance),
+                          (void*)offsetof(ArcInstance, color));
+    const GLuint attribs[3] = {ARC_PARAMS_ATTRIB, ARC_ANGLES_ATTRIB, ARC_COLOR_ATTRIB};
+    for (GLuint attrib : attribs) {
+        glEnableVertexAttribArray(attrib);
+        glVertexAttribDivisor(attrib, 1);
+    }
+    eglstate::bind_buffer(GL_ARRAY_BUFFER, 0);
+    eglstate::bind_vertex_array(0);
+}
+
 inline void init_gfx2d_state(GLuint vao, GLuint vbo, GLuint shader) {
     if (g_gfx2d) delete g_gfx2d;
     g_gfx2d = new Graphics2DState();
     g_gfx2d->vao = vao;
     g_gfx2d->vbo = vbo;
     g_gfx2d->shader = shader;
+    create_arc_mesh(g_gfx2d);
 }
 
 inline size_t get_float_size_2d() { return sizeof(float); }
 
+const size_t FLOATS_PER_VERTEX_2D = 6;
+const size_t VERTEX_BYTES_2D = FLOATS_PER_VERTEX_2D * sizeof(float);
+// Vertices per draw: whole triangles, well inside one stream region
+const size_t MAX_DRAW_VERTICES_2D = 3 * 8192;
+
 inline void* voidify_int_2d(int i) {
     return (void*)(intptr_t)i;
 }
 
-inline void begin_2d_impl(int screen_w, int screen_h) {
-    if (!g_gfx2d) return;
+inline void push_vertex_2d(float x, float y) {
+    const float* c = g_gfx2d->color;
+    float v[FLOATS_PER_VERTEX_2D] = {x, y, c[0], c[1], c[2], c[3]};
+    g_gfx2d->batch.insert(g_gfx2d->batch.end(), v, v + FLOATS_PER_VERTEX_2D);
+}
+
+// Upload the pending arcs and draw them all, growing the instance buffer
+// if they don't fit. The shader must be in use.
+inline void draw_arcs_2d() {
+    Graphics2DState* g = g_gfx2d;
+    eglstate::bind_vertex_array(g->arc_vao);
+    eglstate::bind_buffer(GL_ARRAY_BUFFER, g->arc_instances);
+    while (g->arc_capacity < g->arcs.size()) g->arc_capacity *= 2;
+    // Orphan, as instance_batch_draw does, so last frame's draw doesn't stall us
+    glBufferData(GL_ARRAY_BUFFER, g->arc_capacity * sizeof(ArcInstance), nullptr, GL_STREAM_DRAW);
+    wrap_glBufferSubData(GL_ARRAY_BUFFER, 0, g->arcs.size() * sizeof(ArcInstance), g->arcs.data());
+    GLint arc = eshaders::uniform_location(g->shader, "uArc");
+    glUniform1i(arc, 1);
+    wrap_glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, ARC_STRIP_VERTICES, (GLsizei)g->arcs.size());
+    glUniform1i(arc, 0);
+    ++g->last_draws;
+    g->arcs.clear();
+}
 
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glDisable(GL_DEPTH_TEST);
+// Draw and empty the batch: arcs first, then the triangles
+inline void flush_2d() {
+    std::vector<float>& batch = g_gfx2d->batch;
+    size_t vertex_count = batch.size() / FLOATS_PER_VERTEX_2D;
+    g_gfx2d->last_vertices = (int)(vertex_count + g_gfx2d->arcs.size() * ARC_STRIP_VERTICES);
+    g_gfx2d->last_draws = 0;
+    if (vertex_count == 0 && g_gfx2d->arcs.empty()) return;
 
-    glUseProgram(g_gfx2d->shader);
+    egltimer::Scope gpu(egltimer::PASS_GFX2D);
+    eglstate::enable(GL_BLEND);
+    eglstate::blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    eglstate::disable(GL_DEPTH_TEST);
+    eglstate::use_program(g_gfx2d->shader);
+    glUniformMatrix4fv(eshaders::uniform_location(g_gfx2d->shader, "projection"), 1, GL_FALSE,
+                       glm::value_ptr(g_gfx2d->projection));
+    if (!g_gfx2d->arcs.empty()) draw_arcs_2d();
+    if (vertex_count == 0) return;
+    eglstate::bind_vertex_array(g_gfx2d->vao);
 
-    glm::mat4 projection = glm::ortho(0.0f, (float)screen_w, (float)screen_h, 0.0f);
-    glUniformMatrix4fv(glGetUniformLocation(g_gfx2d->shader, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+    for (size_t start = 0; start < vertex_count; start += MAX_DRAW_VERTICES_2D) {
+        size_t count = std::min(MAX_DRAW_VERTICES_2D, vertex_count - start);
+        GLint first = eglstream::shared_vertices(batch.data() + start * FLOATS_PER_VERTEX_2D,
+                                                 count * VERTEX_BYTES_2D, VERTEX_BYTES_2D);
+        if (first < 0) break;
+        wrap_glDrawArrays(GL_TRIANGLES, first, (GLsizei)count);
+        ++g_gfx2d->last_draws;
+    }
+    batch.clear();
+}
+
+// Outside begin/end, draw what was just appended
+inline void flush_unbatched_2d() {
+    if (!g_gfx2d->batching) {
+        flush_2d();
+        eglstate::enable(GL_DEPTH_TEST);
+        eglstate::disable(GL_BLEND);
+    }
+}
 
-    glBindVertexArray(g_gfx2d->vao);
+inline void begin_2d_impl(int screen_w, int screen_h) {
+    if (!g_gfx2d) return;
+    g_gfx2d->projection = glm::ortho(0.0f, (float)screen_w, (float)screen_h, 0.0f);
+    g_gfx2d->batch.clear();
+    g_gfx2d->arcs.clear();
+    g_gfx2d->batching = true;
 }
 
 inline void end_2d_impl() {
-    glBindVertexArray(0);
-    glEnable(GL_DEPTH_TEST);
-    glDisable(GL_BLEND);
+    if (!g_gfx2d) return;
+    flush_2d();
+    g_gfx2d->batching = false;
+    eglstate::enable(GL_DEPTH_TEST);
+    eglstate::disable(GL_BLEND);
 }
 
 inline void set_color_impl(float r, float g, float b, float a) {
     if (!g_gfx2d) return;
-    glUniform4f(glGetUniformLocation(g_gfx2d->shader, "uColor"), r, g, b, a);
+    float* c = g_gfx2d->color;
+    c[0] = r; c[1] = g; c[2] = b; c[3] = a;
 }
 
 inline void render_line_impl(float x1, float y1, float x2, float y2, float thickness) {
@@ -74,76 +220,42 @@ inline void render_line_impl(float x1, float y1, float x2, float y2, float thick
     float nx = -dy / len * thickness * 0.5f;
     float ny = dx / len * thickness * 0.5f;
 
-    float vertices[] = {
-        x1 - nx, y1 - ny,
-        x1 + nx, y1 + ny,
-        x2 + nx, y2 + ny,
-
-        x1 - nx, y1 - ny,
-        x2 + nx, y2 + ny,
-        x2 - nx, y2 - ny
-    };
+    push_vertex_2d(x1 - nx, y1 - ny);
+    push_vertex_2d(x1 + nx, y1 + ny);
+    push_vertex_2d(x2 + nx, y2 + ny);
 
-    glBindBuffer(GL_ARRAY_BUFFER, g_gfx2d->vbo);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
-    glDrawArrays(GL_TRIANGLES, 0, 6);
+    push_vertex_2d(x1 - nx, y1 - ny);
+    push_vertex_2d(x2 + nx, y2 + ny);
+    push_vertex_2d(x2 - nx, y2 - ny);
+    flush_unbatched_2d();
 }
 
+// Queues an instance of the cached strip; segments is ignored, the strip
+// has ARC_SEGMENTS
 inline void render_arc_outline_impl(float cx, float cy, float radius, float start_angle, float end_angle, int segments, float thickness) {
-    if (!g_gfx2d) return;
-
-    std::vector<float> vertices;
-    float angle_step = (end_angle - start_angle) / segments;
-    float inner_r = radius - thickness * 0.5f;
-    float outer_r = radius + thickness * 0.5f;
-
-    for (int i = 0; i < segments; i++) {
-        float a1 = start_angle + i * angle_step;
-        float a2 = start_angle + (i + 1) * angle_step;
-
-        float cos1 = cos(a1), sin1 = sin(a1);
-        float cos2 = cos(a2), sin2 = sin(a2);
-
-        vertices.push_back(cx + inner_r * cos1);
-        vertices.push_back(cy + inner_r * sin1);
-        vertices.push_back(cx + outer_r * cos1);
-        vertices.push_back(cy + outer_r * sin1);
-        vertices.push_back(cx + outer_r * cos2);
-        vertices.push_back(cy + outer_r * sin2);
-
-        vertices.push_back(cx + inner_r * cos1);
-        vertices.push_back(cy + inner_r * sin1);
-        vertices.push_back(cx + outer_r * cos2);
-        vertices.push_back(cy + outer_r * sin2);
-        vertices.push_back(cx + inner_r * cos2);
-        vertices.push_back(cy + inner_r * sin2);
-    }
-
-    glBindBuffer(GL_ARRAY_BUFFER, g_gfx2d->vbo);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, vertices.size() * sizeof(float), vertices.data());
-    glDrawArrays(GL_TRIANGLES, 0, vertices.size() / 2);
+    if (!g_gfx2d || segments <= 0) return;
+    const float* c = g_gfx2d->color;
+    g_gfx2d->arcs.push_back({{cx, cy, radius, thickness}, {start_angle, end_angle},
+                             {c[0], c[1], c[2], c[3]}});
+    flush_unbatched_2d();
 }
 
 inline void render_filled_arc_impl(float cx, float cy, float radius, float start_angle, float end_angle, int segments) {
-    if (!g_gfx2d) return;
+    if (!g_gfx2d || segments <= 0) return;
 
-    std::vector<float> vertices;
     float angle_step = (end_angle - start_angle) / segments;
 
     for (int i = 0; i < segments; i++) {
         float a1 = start_angle + i * angle_step;
         float a2 = start_angle + (i + 1) * angle_step;
 
-        vertices.push_back(cx);
-        vertices.push_back(cy);
-        vertices.push_back(cx + radius * cos(a1));
-        vertices.push_back(cy + radius * sin(a1));
-        vertices.push_back(cx + radius * cos(a2));
-        vertices.push_back(cy + radius * sin(a2));
+        push_vertex_2d(cx, cy);
+        push_vertex_2d(cx + radius * cos(a1), cy + radius * sin(a1));
+        push_vertex_2d(cx + radius * cos(a2), cy + radius * sin(a2));
     }
-
-    glBindBuffer(GL_ARRAY_BUFFER, g_gfx2d->vbo);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, vertices.size() * sizeof(float), vertices.data());
-    glDrawArrays(GL_TRIANGLES, 0, vertices.size() / 2);
+    flush_unbatched_2d();
 }
+
+inline int last_vertices_2d() { return g_gfx2d ? g_gfx2d->last_vertices : 0; }
+inline int last_draws_2d() { return g_gfx2d ? g_gfx2d->last_draws : 0; }
 } // namespace egfx2d
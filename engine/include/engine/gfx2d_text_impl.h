@@ -7,19 +7,28 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <vector>
 #include <cstddef>
+#include <cstring>
+#include <string>
 
-#include <jank/aot/resource.hpp>
+#include "engine/resources_impl.h"
+#include "engine/gl_state_impl.h"
+#include "engine/memtrack_impl.h"
+#include "engine/gl_stream_impl.h"
+#include "engine/gl_timer_impl.h"
+#include "engine/shaders_impl.h"
 
 // Font rendering state
 struct FontData {
     GLuint texture_id;
     GLuint vao;
-    GLuint vbo;
+    GLuint vbo;             // The shared streaming buffer (gl_stream_impl.h)
     GLuint shader;
     stbtt_bakedchar char_data[96]; // ASCII 32-127
     float font_size;
     int atlas_width;
     int atlas_height;
+    std::vector<float> batch;      // Queued glyph vertices (etext::queue_text)
+    int last_glyphs = 0;           // Drawn by the last flush
 };
 
 inline FontData*& get_g_font() {
@@ -49,28 +58,31 @@ inline bool init_font_from_buffer(const unsigned char* font_buffer, std::size_t
                          32, 96, g_font->char_data);
 
     glGenTextures(1, &g_font->texture_id);
-    glBindTexture(GL_TEXTURE_2D, g_font->texture_id);
+    eglstate::bind_texture(GL_TEXTURE_2D, g_font->texture_id);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, atlas_w, atlas_h, 0,
                  GL_RED, GL_UNSIGNED_BYTE, atlas_bitmap);
+    ememtrack::track_texture(g_font->texture_id, ememtrack::CAT_FONTS, (int64_t)atlas_w * atlas_h);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
     free(atlas_bitmap);
 
     glGenVertexArrays(1, &g_font->vao);
-    glGenBuffers(1, &g_font->vbo);
+    g_font->vbo = eglstream::shared_buffer();
 
-    glBindVertexArray(g_font->vao);
-    glBindBuffer(GL_ARRAY_BUFFER, g_font->vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 6 * 4 * 128, nullptr, GL_DYNAMIC_DRAW);
+    eglstate::bind_vertex_array(g_font->vao);
+    eglstate::bind_buffer(GL_ARRAY_BUFFER, g_font->vbo);
 
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
+    const GLsizei stride = 7 * sizeof(float);  // x y s t r g b
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, stride, (void*)0);
     glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2 * sizeof(float)));
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void*)(2 * sizeof(float)));
     glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void*)(4 * sizeof(float)));
+    glEnableVertexAttribArray(2);
 
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    eglstate::bind_buffer(GL_ARRAY_BUFFER, 0);
+    eglstate::bind_vertex_array(0);
 
     return true;
 }
@@ -93,41 +105,29 @@ inline bool init_font_cpp(const char* font_path, float font_size, GLuint shader)
 }
 
 inline bool init_font_from_resource(const char* resource_name, float font_size, GLuint shader) {
-    auto opt = jank::aot::find_resource(jtl::immutable_string{ resource_name });
-    if (!opt.is_some()) {
+    const char* data = nullptr;
+    std::size_t size = 0;
+    if (!eresources::find_resource(resource_name, &data, &size)) {
         fprintf(stderr, "Font resource not found: %s\n", resource_name);
         return false;
     }
-    auto view = opt.unwrap();
     return init_font_from_buffer(
-        reinterpret_cast<const unsigned char*>(view.data()),
-        view.size(),
+        reinterpret_cast<const unsigned char*>(data),
+        size,
         font_size,
         shader);
 }
 
-inline void render_text_cpp(const char* text, float x, float y, float r, float g, float b, int screen_w, int screen_h) {
-    if (!g_font) return;
-
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glDisable(GL_DEPTH_TEST);
-
-    glUseProgram(g_font->shader);
-
-    glm::mat4 projection = glm::ortho(0.0f, (float)screen_w, (float)screen_h, 0.0f);
-    glUniformMatrix4fv(glGetUniformLocation(g_font->shader, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
-    glUniform3f(glGetUniformLocation(g_font->shader, "uTextColor"), r, g, b);
-
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, g_font->texture_id);
-    glUniform1i(glGetUniformLocation(g_font->shader, "uFontTexture"), 0);
+const size_t FLOATS_PER_GLYPH_VERTEX = 7;  // x y s t r g b
+const size_t GLYPH_VERTEX_BYTES = FLOATS_PER_GLYPH_VERTEX * sizeof(float);
 
-    glBindVertexArray(g_font->vao);
-
-    std::vector<float> vertices;
+// Lay text out as glyph quads (two triangles each) appended to out
+inline void layout_text(std::vector<float>& out, const char* text, float x, float y,
+                        float r, float g, float b) {
     float cursor_x = x;
     float cursor_y = y;
+    float inv_w = 1.0f / (float)g_font->atlas_width;
+    float inv_h = 1.0f / (float)g_font->atlas_height;
 
     for (const char* p = text; *p; p++) {
         char c = *p;
@@ -140,36 +140,193 @@ inline void render_text_cpp(const char* text, float x, float y, float r, float g
         float x1 = x0 + (bc->x1 - bc->x0);
         float y1 = y0 + (bc->y1 - bc->y0);
 
-        float s0 = bc->x0 / (float)g_font->atlas_width;
-        float t0 = bc->y0 / (float)g_font->atlas_height;
-        float s1 = bc->x1 / (float)g_font->atlas_width;
-        float t1 = bc->y1 / (float)g_font->atlas_height;
+        float s0 = bc->x0 * inv_w;
+        float t0 = bc->y0 * inv_h;
+        float s1 = bc->x1 * inv_w;
+        float t1 = bc->y1 * inv_h;
 
-        float quad[] = {
-            x0, y0, s0, t0,
-            x1, y0, s1, t0,
-            x1, y1, s1, t1,
+        const float quad[] = {
+            x0, y0, s0, t0, r, g, b,
+            x1, y0, s1, t0, r, g, b,
+            x1, y1, s1, t1, r, g, b,
 
-            x0, y0, s0, t0,
-            x1, y1, s1, t1,
-            x0, y1, s0, t1
+            x0, y0, s0, t0, r, g, b,
+            x1, y1, s1, t1, r, g, b,
+            x0, y1, s0, t1, r, g, b
         };
-
-        for (int i = 0; i < 24; i++) {
-            vertices.push_back(quad[i]);
-        }
+        out.insert(out.end(), quad, quad + 6 * FLOATS_PER_GLYPH_VERTEX);
 
         cursor_x += bc->xadvance;
     }
+}
+
+// ============ TEXT BATCH ============
+// queue_text lays strings out into one per-frame glyph stream, color per
+// vertex; flush_text draws the lot with one draw call and GL state set
+// once. render_text_cpp is a queue followed by a flush.
+
+inline void queue_text(const char* text, float x, float y, float r, float g, float b) {
+    if (!g_font) return;
+    layout_text(g_font->batch, text, x, y, r, g, b);
+}
+
+// Set the text shader, atlas and blend state for drawing glyphs
+inline void begin_text_draw(int screen_w, int screen_h) {
+    eglstate::enable(GL_BLEND);
+    eglstate::blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    eglstate::disable(GL_DEPTH_TEST);
+
+    eglstate::use_program(g_font->shader);
+
+    glm::mat4 projection = glm::ortho(0.0f, (float)screen_w, (float)screen_h, 0.0f);
+    glUniformMatrix4fv(eshaders::uniform_location(g_font->shader, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+
+    eglstate::active_texture(GL_TEXTURE0);
+    eglstate::bind_texture(GL_TEXTURE_2D, g_font->texture_id);
+    glUniform1i(eshaders::uniform_location(g_font->shader, "uFontTexture"), 0);
+    glUniform1i(eshaders::uniform_location(g_font->shader, "uSdf"), 0);
+
+    eglstate::bind_vertex_array(g_font->vao);
+}
+
+inline void end_text_draw() {
+    eglstate::enable(GL_DEPTH_TEST);
+    eglstate::disable(GL_BLEND);
+}
+
+// Draw everything queued since the last flush
+inline void flush_text(int screen_w, int screen_h) {
+    if (!g_font) return;
+    std::vector<float>& batch = g_font->batch;
+    g_font->last_glyphs = (int)(batch.size() / (6 * FLOATS_PER_GLYPH_VERTEX));
+    if (batch.empty()) return;
+
+    egltimer::Scope gpu(egltimer::PASS_TEXT);
+    begin_text_draw(screen_w, screen_h);
+    GLint first = eglstream::shared_vertices(batch.data(), batch.size() * sizeof(float), GLYPH_VERTEX_BYTES);
+    if (first >= 0) {
+        wrap_glDrawArrays(GL_TRIANGLES, first, (GLsizei)(batch.size() / FLOATS_PER_GLYPH_VERTEX));
+    }
+    end_text_draw();
+    batch.clear();
+}
 
-    glBindBuffer(GL_ARRAY_BUFFER, g_font->vbo);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, vertices.size() * sizeof(float), vertices.data());
+inline int last_glyphs() {
+    return g_font ? g_font->last_glyphs : 0;
+}
+
+inline void render_text_cpp(const char* text, float x, float y, float r, float g, float b, int screen_w, int screen_h) {
+    queue_text(text, x, y, r, g, b);
+    flush_text(screen_w, screen_h);
+}
+
+// ============ TEXT BLOCKS ============
+// Retained text for strings that rarely change (HUD lines, key bindings).
+// A block keeps its glyph quads in its own VBO. Each frame the caller
+// restates its lines (text_block_begin, text_block_line per line); a line
+// equal to last frame's costs a string compare. The block is laid out and
+// uploaded again only when a line changed, then drawn with one call.
+
+struct TextLine {
+    std::string text;
+    float x, y, r, g, b;
+};
+
+struct TextBlock {
+    GLuint vao = 0;
+    GLuint vbo = 0;
+    size_t capacity = 0;           // Bytes the VBO holds
+    std::vector<TextLine> lines;
+    size_t next = 0;               // Lines restated this frame
+    bool dirty = true;
+    GLsizei vertex_count = 0;
+    std::vector<float> scratch;    // Layout staging
+    int layouts = 0;               // Times laid out, for stats
+};
+
+inline TextBlock* create_text_block() {
+    TextBlock* b = new TextBlock();
+    glGenVertexArrays(1, &b->vao);
+    glGenBuffers(1, &b->vbo);
+    eglstate::bind_vertex_array(b->vao);
+    eglstate::bind_buffer(GL_ARRAY_BUFFER, b->vbo);
+    const GLsizei stride = GLYPH_VERTEX_BYTES;
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, stride, (void*)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void*)(2 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void*)(4 * sizeof(float)));
+    glEnableVertexAttribArray(2);
+    eglstate::bind_vertex_array(0);
+    return b;
+}
+
+inline void destroy_text_block(TextBlock* b) {
+    if (!b) return;
+    eglstate::forget_vertex_array(b->vao);
+    eglstate::forget_buffer(b->vbo);
+    glDeleteBuffers(1, &b->vbo);
+    glDeleteVertexArrays(1, &b->vao);
+    delete b;
+}
+
+inline void text_block_begin(TextBlock* b) {
+    b->next = 0;
+}
+
+inline void text_block_line(TextBlock* block, const char* text, float x, float y,
+                            float r, float g, float b) {
+    if (block->next < block->lines.size()) {
+        TextLine& line = block->lines[block->next];
+        if (line.x != x || line.y != y || line.r != r || line.g != g || line.b != b
+            || std::strcmp(line.text.c_str(), text) != 0) {
+            line.text = text;
+            line.x = x; line.y = y;
+            line.r = r; line.g = g; line.b = b;
+            block->dirty = true;
+        }
+    } else {
+        block->lines.push_back(TextLine{text, x, y, r, g, b});
+        block->dirty = true;
+    }
+    ++block->next;
+}
 
-    glDrawArrays(GL_TRIANGLES, 0, vertices.size() / 4);
+// Lay out again if any line changed since the last draw, then draw
+inline void text_block_draw(TextBlock* b, int screen_w, int screen_h) {
+    if (!g_font) return;
+    if (b->next != b->lines.size()) {
+        b->lines.resize(b->next);
+        b->dirty = true;
+    }
+    if (b->dirty) {
+        b->scratch.clear();
+        for (const TextLine& line : b->lines) {
+            layout_text(b->scratch, line.text.c_str(), line.x, line.y, line.r, line.g, line.b);
+        }
+        size_t bytes = b->scratch.size() * sizeof(float);
+        eglstate::bind_buffer(GL_ARRAY_BUFFER, b->vbo);
+        if (bytes > b->capacity) {
+            b->capacity = bytes;
+            wrap_glBufferData(GL_ARRAY_BUFFER, bytes, b->scratch.data(), GL_DYNAMIC_DRAW);
+        } else if (bytes > 0) {
+            // Orphan so a draw of the old layout still in flight isn't waited on
+            glBufferData(GL_ARRAY_BUFFER, b->capacity, nullptr, GL_DYNAMIC_DRAW);
+            wrap_glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, b->scratch.data());
+        }
+        b->vertex_count = (GLsizei)(b->scratch.size() / FLOATS_PER_GLYPH_VERTEX);
+        b->dirty = false;
+        ++b->layouts;
+    }
+    if (b->vertex_count == 0) return;
+    begin_text_draw(screen_w, screen_h);
+    eglstate::bind_vertex_array(b->vao);
+    wrap_glDrawArrays(GL_TRIANGLES, 0, b->vertex_count);
+    end_text_draw();
+}
 
-    glBindVertexArray(0);
-    glBindTexture(GL_TEXTURE_2D, 0);
-    glEnable(GL_DEPTH_TEST);
-    glDisable(GL_BLEND);
+inline int text_block_layouts(TextBlock* b) {
+    return b->layouts;
 }
+
 } // namespace etext
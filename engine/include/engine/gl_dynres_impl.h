@@ -0,0 +1,135 @@
+#pragma once
+#include "gl_wrappers.h"
+#include "engine/gl_timer_impl.h"
+#include <algorithm>
+#include <cmath>
+
+// ============ DYNAMIC RESOLUTION ============
+// The world drawn into a color + depth target at a fraction of the native
+// viewport, then stretched over it with a linear blit, so a GPU-bound
+// frame trades pixels for time. The target is sized for the full native
+// viewport and a frame only uses its bottom-left scale x scale corner,
+// so changing scale never reallocates (a window resize does).
+//
+// The scale follows the GPU pass timers (gl_timer_impl.h), which must be
+// on: every SETTLE_FRAMES frames, long enough for the last change to show
+// up in the timers, it moves by the square root of target / measured GPU
+// time, the pixel count being what it pays for. It drops at once and
+// climbs back in small steps, and not until the frame is comfortably
+// under the target, so it doesn't oscillate around it.
+//
+// begin binds the target in place of whatever framebuffer is bound and
+// end blits into that one, leaving it bound at the native viewport with
+// its depth cleared for UI drawn after.
+
+namespace egldynres {
+
+const int SETTLE_FRAMES = 4;
+const float MAX_RAISE = 0.05f;          // Largest step up per adjustment
+const float RAISE_BELOW = 0.85f;        // Raise only under this share of target_ms
+const float SCALE_STEP = 1.0f / 64.0f;  // Scales are rounded to this
+
+struct Target {
+  float target_ms = 14.0f;   // GPU time to hold the passes to
+  float min_scale = 0.5f;
+  float max_scale = 1.0f;
+  float scale = 1.0f;
+  int frames = 0;            // Since the last adjustment
+  GLuint fbo = 0, color = 0, depth = 0;
+  int alloc_width = 0, alloc_height = 0;
+  GLint native[4] = {};      // The viewport begin found
+  GLint outer_fbo = 0;       // The framebuffer begin replaced
+  int width = 0, height = 0; // This frame's scaled size
+};
+
+inline Target* create_target(float target_ms, float min_scale, float max_scale) {
+  Target* t = new Target();
+  t->target_ms = target_ms;
+  t->min_scale = std::min(min_scale, max_scale);
+  t->max_scale = max_scale;
+  t->scale = max_scale;
+  return t;
+}
+
+inline void free_buffers(Target* t) {
+  if (t->fbo) glDeleteFramebuffers(1, &t->fbo);
+  if (t->color) glDeleteRenderbuffers(1, &t->color);
+  if (t->depth) glDeleteRenderbuffers(1, &t->depth);
+  t->fbo = t->color = t->depth = 0;
+  t->alloc_width = t->alloc_height = 0;
+}
+
+inline void destroy_target(Target* t) {
+  free_buffers(t);
+  delete t;
+}
+
+inline void allocate(Target* t, int width, int height) {
+  free_buffers(t);
+  glGenFramebuffers(1, &t->fbo);
+  glGenRenderbuffers(1, &t->color);
+  glGenRenderbuffers(1, &t->depth);
+  glBindRenderbuffer(GL_RENDERBUFFER, t->color);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+  glBindRenderbuffer(GL_RENDERBUFFER, t->depth);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, t->fbo);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, t->color);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, t->depth);
+  t->alloc_width = width;
+  t->alloc_height = height;
+}
+
+// Move scale toward the target from the latest GPU pass times
+inline void adjust(Target* t) {
+  if (!egltimer::enabled() || ++t->frames < SETTLE_FRAMES) return;
+  t->frames = 0;
+  double gpu_ms = 0.0;
+  for (int p = 0; p < egltimer::PASS_COUNT; ++p) gpu_ms += egltimer::last_ms(p);
+  if (gpu_ms <= 0.0) return;
+  float wanted = t->scale * (float)std::sqrt(t->target_ms / gpu_ms);
+  float next = t->scale;
+  if (gpu_ms > t->target_ms) {
+    next = wanted;
+  } else if (gpu_ms < t->target_ms * RAISE_BELOW) {
+    next = std::min(wanted, t->scale + MAX_RAISE);
+  }
+  next = std::round(next / SCALE_STEP) * SCALE_STEP;
+  t->scale = std::clamp(next, t->min_scale, t->max_scale);
+}
+
+// Start drawing the world into the target at the current scale
+inline void begin(Target* t) {
+  adjust(t);
+  glGetIntegerv(GL_VIEWPORT, t->native);
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &t->outer_fbo);
+  int w = std::max<int>(t->native[2], 1);
+  int h = std::max<int>(t->native[3], 1);
+  if (w != t->alloc_width || h != t->alloc_height) allocate(t, w, h);
+  t->width = std::max(1, (int)(w * t->scale));
+  t->height = std::max(1, (int)(h * t->scale));
+  glBindFramebuffer(GL_FRAMEBUFFER, t->fbo);
+  glViewport(0, 0, t->width, t->height);
+}
+
+// Stretch the frame over the native viewport of the framebuffer begin
+// replaced, and go back to drawing there
+inline void end(Target* t) {
+  egltimer::Scope gpu(egltimer::PASS_WORLD);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, t->fbo);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, t->outer_fbo);
+  glBlitFramebuffer(0, 0, t->width, t->height,
+                    t->native[0], t->native[1],
+                    t->native[0] + t->native[2], t->native[1] + t->native[3],
+                    GL_COLOR_BUFFER_BIT, t->scale < 1.0f ? GL_LINEAR : GL_NEAREST);
+  glBindFramebuffer(GL_FRAMEBUFFER, t->outer_fbo);
+  glViewport(t->native[0], t->native[1], t->native[2], t->native[3]);
+  glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+inline float scale(Target* t) { return t->scale; }
+inline int width(Target* t) { return t->width; }
+inline int height(Target* t) { return t->height; }
+
+} // namespace egldynres
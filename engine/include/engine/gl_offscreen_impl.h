@@ -0,0 +1,318 @@
+#pragma once
+#include "gl_wrappers.h"
+#include "engine/gl_state_impl.h"
+#include <GLFW/glfw3.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#if defined(__linux__)
+#include <dlfcn.h>
+#endif
+
+// ============ OFFSCREEN RENDERING ============
+// A GL 3.3 core context with nothing on screen, for benchmark and stress
+// runs on machines without a display. On Linux the context comes from EGL
+// with no surface at all: Mesa's surfaceless platform, else the first EGL
+// device (NVIDIA's headless path), else the default display. libEGL is
+// opened at runtime, so builds don't link it and machines without it fall
+// back to a hidden GLFW window (which does need a display server). Either
+// way every frame renders into a framebuffer object of the requested size,
+// bound in place of the default framebuffer.
+//
+// present stands in for the swap: it keeps at most FRAMES_IN_FLIGHT frames
+// queued on the GPU, as a swap chain would, so frame times stay honest.
+// ENGINE_OFFSCREEN=1 asks the game's bench and stress modes for it.
+
+namespace egloffscreen {
+
+const int FRAMES_IN_FLIGHT = 2;
+
+struct Offscreen {
+  int width = 0;
+  int height = 0;
+  const char* backend = "";            // "egl" or "hidden-window"
+  void* egl_display = nullptr;
+  void* egl_context = nullptr;
+  GLFWwindow* window = nullptr;
+  GLuint fbo = 0;
+  GLuint color = 0;
+  GLuint depth = 0;
+  GLsync fences[FRAMES_IN_FLIGHT] = {};
+  int fence_slot = 0;
+};
+
+inline bool requested() {
+  const char* env = std::getenv("ENGINE_OFFSCREEN");
+  return env && std::atoi(env) != 0;
+}
+
+// GLEW for the current context. glewInit also wants a GLX display, which
+// an EGL context doesn't have; glewContextInit only loads the GL entry
+// points (through libglvnd's dispatch, so they serve any context).
+inline bool load_gl(bool egl) {
+#ifndef __APPLE__
+  glewExperimental = GL_TRUE;
+  GLenum err = egl ? glewContextInit() : glewInit();
+  if (err != GLEW_OK) {
+    fprintf(stderr, "[offscreen] GLEW initialization failed: %s\n", glewGetErrorString(err));
+    return false;
+  }
+  while (glGetError() != GL_NO_ERROR) {}
+#else
+  (void)egl;
+#endif
+  return true;
+}
+
+#if defined(__linux__)
+// The few EGL declarations used, so no EGL headers are needed either
+typedef int32_t EGLint;
+typedef unsigned int EGLBoolean;
+typedef unsigned int EGLenum;
+
+const EGLint EGL_NONE_ = 0x3038;
+const EGLint EGL_SURFACE_TYPE_ = 0x3033;
+const EGLint EGL_PBUFFER_BIT_ = 0x0001;
+const EGLint EGL_RENDERABLE_TYPE_ = 0x3040;
+const EGLint EGL_OPENGL_BIT_ = 0x0008;
+const EGLint EGL_CONTEXT_MAJOR_VERSION_ = 0x3098;
+const EGLint EGL_CONTEXT_MINOR_VERSION_ = 0x30FB;
+const EGLint EGL_CONTEXT_OPENGL_PROFILE_MASK_ = 0x30FD;
+const EGLint EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_ = 0x0001;
+const EGLint EGL_EXTENSIONS_ = 0x3055;
+const EGLenum EGL_OPENGL_API_ = 0x30A2;
+const EGLenum EGL_PLATFORM_SURFACELESS_MESA_ = 0x31DD;
+const EGLenum EGL_PLATFORM_DEVICE_EXT_ = 0x313F;
+
+struct Egl {
+  void* lib = nullptr;
+  void* (*GetProcAddress)(const char*) = nullptr;
+  void* (*GetDisplay)(void*) = nullptr;
+  void* (*GetPlatformDisplayEXT)(EGLenum, void*, const EGLint*) = nullptr;
+  EGLBoolean (*QueryDevicesEXT)(EGLint, void**, EGLint*) = nullptr;
+  const char* (*QueryString)(void*, EGLint) = nullptr;
+  EGLBoolean (*Initialize)(void*, EGLint*, EGLint*) = nullptr;
+  EGLBoolean (*Terminate)(void*) = nullptr;
+  EGLBoolean (*BindAPI)(EGLenum) = nullptr;
+  EGLBoolean (*ChooseConfig)(void*, const EGLint*, void**, EGLint, EGLint*) = nullptr;
+  void* (*CreateContext)(void*, void*, void*, const EGLint*) = nullptr;
+  EGLBoolean (*DestroyContext)(void*, void*) = nullptr;
+  EGLBoolean (*MakeCurrent)(void*, void*, void*, void*) = nullptr;
+};
+
+inline Egl& egl() {
+  static Egl e;
+  return e;
+}
+
+inline bool load_egl() {
+  Egl& e = egl();
+  if (e.lib) return true;
+  void* lib = dlopen("libEGL.so.1", RTLD_NOW | RTLD_LOCAL);
+  if (!lib) lib = dlopen("libEGL.so", RTLD_NOW | RTLD_LOCAL);
+  if (!lib) return false;
+  e.lib = lib;
+  e.GetProcAddress = (void* (*)(const char*))dlsym(lib, "eglGetProcAddress");
+  e.GetDisplay = (void* (*)(void*))dlsym(lib, "eglGetDisplay");
+  e.QueryString = (const char* (*)(void*, EGLint))dlsym(lib, "eglQueryString");
+  e.Initialize = (EGLBoolean (*)(void*, EGLint*, EGLint*))dlsym(lib, "eglInitialize");
+  e.Terminate = (EGLBoolean (*)(void*))dlsym(lib, "eglTerminate");
+  e.BindAPI = (EGLBoolean (*)(EGLenum))dlsym(lib, "eglBindAPI");
+  e.ChooseConfig = (EGLBoolean (*)(void*, const EGLint*, void**, EGLint, EGLint*))
+      dlsym(lib, "eglChooseConfig");
+  e.CreateContext = (void* (*)(void*, void*, void*, const EGLint*))dlsym(lib, "eglCreateContext");
+  e.DestroyContext = (EGLBoolean (*)(void*, void*))dlsym(lib, "eglDestroyContext");
+  e.MakeCurrent = (EGLBoolean (*)(void*, void*, void*, void*))dlsym(lib, "eglMakeCurrent");
+  if (e.GetProcAddress) {
+    e.GetPlatformDisplayEXT = (void* (*)(EGLenum, void*, const EGLint*))
+        e.GetProcAddress("eglGetPlatformDisplayEXT");
+    e.QueryDevicesEXT = (EGLBoolean (*)(EGLint, void**, EGLint*))
+        e.GetProcAddress("eglQueryDevicesEXT");
+  }
+  bool ok = e.GetDisplay && e.QueryString && e.Initialize && e.Terminate && e.BindAPI &&
+            e.ChooseConfig && e.CreateContext && e.DestroyContext && e.MakeCurrent;
+  if (!ok) {
+    dlclose(lib);
+    e = Egl();
+  }
+  return ok;
+}
+
+inline bool has_extension(const char* extensions, const char* name) {
+  if (!extensions) return false;
+  size_t n = std::strlen(name);
+  for (const char* p = std::strstr(extensions, name); p; p = std::strstr(p + n, name)) {
+    if ((p == extensions || p[-1] == ' ') && (p[n] == ' ' || p[n] == '\0')) return true;
+  }
+  return false;
+}
+
+// An initialized display: surfaceless, else a device, else the default
+inline void* open_egl_display() {
+  Egl& e = egl();
+  const char* client = e.QueryString(nullptr, EGL_EXTENSIONS_);
+  void* candidates[3] = {};
+  int n = 0;
+  if (e.GetPlatformDisplayEXT && has_extension(client, "EGL_MESA_platform_surfaceless")) {
+    candidates[n++] = e.GetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA_, nullptr, nullptr);
+  }
+  if (e.GetPlatformDisplayEXT && e.QueryDevicesEXT &&
+      has_extension(client, "EGL_EXT_platform_device")) {
+    void* device = nullptr;
+    EGLint devices = 0;
+    if (e.QueryDevicesEXT(1, &device, &devices) && devices > 0) {
+      candidates[n++] = e.GetPlatformDisplayEXT(EGL_PLATFORM_DEVICE_EXT_, device, nullptr);
+    }
+  }
+  candidates[n++] = e.GetDisplay(nullptr);
+  for (int i = 0; i < n; ++i) {
+    EGLint major = 0, minor = 0;
+    if (candidates[i] && e.Initialize(candidates[i], &major, &minor)) return candidates[i];
+  }
+  return nullptr;
+}
+
+// A current surfaceless GL 3.3 core context, or false
+inline bool create_egl_context(Offscreen* o) {
+  if (!load_egl()) return false;
+  Egl& e = egl();
+  void* display = open_egl_display();
+  if (!display) return false;
+  const EGLint config_attribs[] = {
+    EGL_SURFACE_TYPE_, EGL_PBUFFER_BIT_,
+    EGL_RENDERABLE_TYPE_, EGL_OPENGL_BIT_,
+    EGL_NONE_,
+  };
+  const EGLint context_attribs[] = {
+    EGL_CONTEXT_MAJOR_VERSION_, 3,
+    EGL_CONTEXT_MINOR_VERSION_, 3,
+    EGL_CONTEXT_OPENGL_PROFILE_MASK_, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_,
+    EGL_NONE_,
+  };
+  void* config = nullptr;
+  EGLint configs = 0;
+  void* context = nullptr;
+  if (e.BindAPI(EGL_OPENGL_API_) &&
+      e.ChooseConfig(display, config_attribs, &config, 1, &configs) && configs > 0) {
+    context = e.CreateContext(display, config, nullptr, context_attribs);
+  }
+  // EGL_KHR_surfaceless_context: no draw or read surface
+  if (!context || !e.MakeCurrent(display, nullptr, nullptr, context)) {
+    if (context) e.DestroyContext(display, context);
+    e.Terminate(display);
+    return false;
+  }
+  o->egl_display = display;
+  o->egl_context = context;
+  o->backend = "egl";
+  return true;
+}
+#endif
+
+// A current context in a window that's never shown. glfwInit must have run.
+inline bool create_hidden_window(Offscreen* o) {
+  glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+  GLFWwindow* window = glfwCreateWindow(o->width, o->height, "offscreen", nullptr, nullptr);
+  glfwDefaultWindowHints();
+  if (!window) return false;
+  glfwMakeContextCurrent(window);
+  o->window = window;
+  o->backend = "hidden-window";
+  return true;
+}
+
+inline void destroy_context(Offscreen* o) {
+#if defined(__linux__)
+  if (o->egl_context) {
+    Egl& e = egl();
+    e.MakeCurrent(o->egl_display, nullptr, nullptr, nullptr);
+    e.DestroyContext(o->egl_display, o->egl_context);
+    e.Terminate(o->egl_display);
+    o->egl_context = nullptr;
+    o->egl_display = nullptr;
+  }
+#endif
+  if (o->window) {
+    glfwDestroyWindow(o->window);
+    o->window = nullptr;
+  }
+}
+
+// Color and depth renderbuffers behind one framebuffer, left bound
+inline bool create_framebuffer(Offscreen* o) {
+  glGenFramebuffers(1, &o->fbo);
+  glGenRenderbuffers(1, &o->color);
+  glGenRenderbuffers(1, &o->depth);
+  glBindRenderbuffer(GL_RENDERBUFFER, o->color);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, o->width, o->height);
+  glBindRenderbuffer(GL_RENDERBUFFER, o->depth);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, o->width, o->height);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, o->fbo);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, o->color);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, o->depth);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) return false;
+  glViewport(0, 0, o->width, o->height);
+  return true;
+}
+
+// An offscreen context of width x height, current, with its framebuffer
+// bound; nullptr if neither backend works
+inline Offscreen* open_offscreen(int width, int height) {
+  Offscreen* o = new Offscreen();
+  o->width = width;
+  o->height = height;
+  bool egl = false;
+#if defined(__linux__)
+  egl = create_egl_context(o);
+#endif
+  if (!egl && !create_hidden_window(o)) {
+    fprintf(stderr, "[offscreen] No EGL context or hidden window could be created\n");
+    delete o;
+    return nullptr;
+  }
+  if (!load_gl(egl) || !create_framebuffer(o)) {
+    fprintf(stderr, "[offscreen] Framebuffer setup failed on the %s backend\n", o->backend);
+    destroy_context(o);
+    delete o;
+    return nullptr;
+  }
+  fprintf(stderr, "[offscreen] %dx%d on the %s backend\n", width, height, o->backend);
+  return o;
+}
+
+inline const char* backend(Offscreen* o) { return o->backend; }
+
+// End of frame in place of a swap: wait for the frame FRAMES_IN_FLIGHT
+// back to finish on the GPU, fence this one and rebind the framebuffer
+inline void present(Offscreen* o) {
+  GLsync& fence = o->fences[o->fence_slot];
+  if (fence) {
+    glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+    glDeleteSync(fence);
+  }
+  fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  o->fence_slot = (o->fence_slot + 1) % FRAMES_IN_FLIGHT;
+  glBindFramebuffer(GL_FRAMEBUFFER, o->fbo);
+  glFlush();
+}
+
+inline void close_offscreen(Offscreen* o) {
+  if (!o) return;
+  for (GLsync& fence : o->fences) {
+    if (fence) glDeleteSync(fence);
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  glDeleteFramebuffers(1, &o->fbo);
+  glDeleteRenderbuffers(1, &o->color);
+  glDeleteRenderbuffers(1, &o->depth);
+  destroy_context(o);
+  delete o;
+}
+
+} // namespace egloffscreen
@@ -0,0 +1,220 @@
+#pragma once
+#include "gl_wrappers.h"
+
+// ============ GL STATE CACHE ============
+// CPU-side shadow of the GL binding and enable state the engine touches:
+// current program, VAO, array/texture buffer bindings, the element buffer of
+// the bound VAO, active texture unit, 2D and buffer textures per unit, blend,
+// depth test, face culling and the blend function. Every setter compares
+// against the shadow and skips the driver call when nothing would change.
+//
+// All engine and game GL binds go through here (engine.gl in jank). Code that
+// binds behind its back must call invalidate() afterwards; code that deletes
+// an object must call the matching forget_* so a recycled name is not taken
+// for "already bound".
+//
+// GL is single-threaded here, so the shadow is a plain global.
+
+namespace eglstate {
+
+const GLuint UNKNOWN = 0xFFFFFFFFu;
+const int MAX_TEXTURE_UNITS = 16;
+
+enum Tri : signed char { TRI_UNKNOWN = -1, TRI_OFF = 0, TRI_ON = 1 };
+
+struct GlState {
+  GLuint program = UNKNOWN;
+  GLuint vao = UNKNOWN;
+  GLuint array_buffer = UNKNOWN;
+  GLuint element_buffer = UNKNOWN;           // Belongs to the bound VAO
+  GLuint texture_buffer_binding = UNKNOWN;   // GL_TEXTURE_BUFFER buffer target
+  GLuint active_unit = UNKNOWN;              // 0-based
+  GLuint texture_2d[MAX_TEXTURE_UNITS];
+  GLuint texture_buffer[MAX_TEXTURE_UNITS];
+  GLuint texture_2d_array[MAX_TEXTURE_UNITS];
+  Tri blend = TRI_UNKNOWN;
+  Tri depth_test = TRI_UNKNOWN;
+  Tri cull_face = TRI_UNKNOWN;
+  GLenum blend_src = UNKNOWN;
+  GLenum blend_dst = UNKNOWN;
+  // Counters: this frame, and the last finished one (end_frame)
+  int issued = 0;
+  int saved = 0;
+  int last_issued = 0;
+  int last_saved = 0;
+
+  GlState() {
+    for (int i = 0; i < MAX_TEXTURE_UNITS; ++i) {
+      texture_2d[i] = UNKNOWN;
+      texture_buffer[i] = UNKNOWN;
+      texture_2d_array[i] = UNKNOWN;
+    }
+  }
+};
+
+inline GlState& state() {
+  static GlState s;
+  return s;
+}
+
+// Returns true (and counts the call) when value differs from the shadow
+inline bool changes(GLuint& shadow, GLuint value) {
+  GlState& s = state();
+  if (shadow == value) {
+    ++s.saved;
+    return false;
+  }
+  shadow = value;
+  ++s.issued;
+  return true;
+}
+
+// Forget everything, e.g. after code that drives GL directly
+inline void invalidate() {
+  GlState& s = state();
+  GlState fresh;
+  fresh.issued = s.issued;
+  fresh.saved = s.saved;
+  fresh.last_issued = s.last_issued;
+  fresh.last_saved = s.last_saved;
+  s = fresh;
+}
+
+// ---- Bindings ----
+
+inline void use_program(GLuint program) {
+  if (changes(state().program, program)) wrap_glUseProgram(program);
+}
+
+inline void bind_vertex_array(GLuint vao) {
+  GlState& s = state();
+  if (changes(s.vao, vao)) {
+    glBindVertexArray(vao);
+    // The element binding is part of the VAO; we don't know this one's
+    s.element_buffer = UNKNOWN;
+  }
+}
+
+inline void bind_buffer(GLenum target, GLuint buffer) {
+  GlState& s = state();
+  GLuint* shadow = target == GL_ARRAY_BUFFER ? &s.array_buffer
+                 : target == GL_ELEMENT_ARRAY_BUFFER ? &s.element_buffer
+                 : target == GL_TEXTURE_BUFFER ? &s.texture_buffer_binding
+                 : nullptr;
+  if (!shadow) {
+    ++s.issued;
+    glBindBuffer(target, buffer);
+    return;
+  }
+  if (changes(*shadow, buffer)) glBindBuffer(target, buffer);
+}
+
+// unit is GL_TEXTURE0 + n, as glActiveTexture takes it
+inline void active_texture(GLenum unit) {
+  if (changes(state().active_unit, unit - GL_TEXTURE0)) glActiveTexture(unit);
+}
+
+// Binds on the active unit
+inline void bind_texture(GLenum target, GLuint texture) {
+  GlState& s = state();
+  GLuint unit = s.active_unit;
+  GLuint* shadow = nullptr;
+  if (unit < (GLuint)MAX_TEXTURE_UNITS) {
+    shadow = target == GL_TEXTURE_2D ? &s.texture_2d[unit]
+           : target == GL_TEXTURE_BUFFER ? &s.texture_buffer[unit]
+           : target == GL_TEXTURE_2D_ARRAY ? &s.texture_2d_array[unit]
+           : nullptr;
+  }
+  if (!shadow) {
+    ++s.issued;
+    wrap_glBindTexture(target, texture);
+    return;
+  }
+  if (changes(*shadow, texture)) wrap_glBindTexture(target, texture);
+}
+
+// ---- Capabilities ----
+
+inline Tri* capability_shadow(GLenum cap) {
+  GlState& s = state();
+  return cap == GL_BLEND ? &s.blend
+       : cap == GL_DEPTH_TEST ? &s.depth_test
+       : cap == GL_CULL_FACE ? &s.cull_face
+       : nullptr;
+}
+
+inline void set_capability(GLenum cap, bool on) {
+  GlState& s = state();
+  Tri* shadow = capability_shadow(cap);
+  Tri want = on ? TRI_ON : TRI_OFF;
+  if (shadow && *shadow == want) {
+    ++s.saved;
+    return;
+  }
+  if (shadow) *shadow = want;
+  ++s.issued;
+  if (on) glEnable(cap); else glDisable(cap);
+}
+
+inline void enable(GLenum cap) { set_capability(cap, true); }
+inline void disable(GLenum cap) { set_capability(cap, false); }
+
+inline void blend_func(GLenum src, GLenum dst) {
+  GlState& s = state();
+  if (s.blend_src == src && s.blend_dst == dst) {
+    ++s.saved;
+    return;
+  }
+  s.blend_src = src;
+  s.blend_dst = dst;
+  ++s.issued;
+  glBlendFunc(src, dst);
+}
+
+// ---- Deletion ----
+// Deleting a bound object reverts that binding to 0 in GL
+
+inline void forget_program(GLuint program) {
+  GlState& s = state();
+  if (s.program == program) s.program = UNKNOWN;
+}
+
+inline void forget_vertex_array(GLuint vao) {
+  GlState& s = state();
+  if (s.vao == vao) {
+    s.vao = 0;
+    s.element_buffer = UNKNOWN;
+  }
+}
+
+inline void forget_buffer(GLuint buffer) {
+  GlState& s = state();
+  if (s.array_buffer == buffer) s.array_buffer = 0;
+  if (s.element_buffer == buffer) s.element_buffer = UNKNOWN;
+  if (s.texture_buffer_binding == buffer) s.texture_buffer_binding = 0;
+}
+
+inline void forget_texture(GLuint texture) {
+  GlState& s = state();
+  for (int i = 0; i < MAX_TEXTURE_UNITS; ++i) {
+    if (s.texture_2d[i] == texture) s.texture_2d[i] = 0;
+    if (s.texture_buffer[i] == texture) s.texture_buffer[i] = 0;
+    if (s.texture_2d_array[i] == texture) s.texture_2d_array[i] = 0;
+  }
+}
+
+// ---- Frame counters ----
+
+// Close the frame's counters; read them with last_frame_issued / _saved
+inline void end_frame() {
+  GlState& s = state();
+  s.last_issued = s.issued;
+  s.last_saved = s.saved;
+  s.issued = 0;
+  s.saved = 0;
+}
+
+inline int last_frame_issued() { return state().last_issued; }
+inline int last_frame_saved() { return state().last_saved; }
+
+} // namespace eglstate
@@ -0,0 +1,204 @@
+#pragma once
+#include "gl_wrappers.h"
+#include "engine/gl_state_impl.h"
+#include "engine/memtrack_impl.h"
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+// ============ STREAMING BUFFER ============
+// One ring of GL_ARRAY_BUFFER memory that dynamic vertex producers (lines,
+// text, gfx2d) suballocate from instead of glBufferSubData-ing into their
+// own buffer at offset 0 and drawing straight away, which makes the driver
+// wait for the previous draw from that buffer.
+//
+// The ring is split into STREAM_REGIONS regions, one per frame in flight.
+// Allocations are placed at a multiple of their vertex stride, so a VAO
+// whose attributes point at offset 0 of the ring draws an allocation with
+// glDrawArrays(first_vertex, ...). end_frame, or an allocation that doesn't
+// fit, moves on to the next region.
+//
+// With GL_ARB_buffer_storage the ring is persistently and coherently mapped:
+// producers write straight into it, and a fence per region keeps the CPU
+// from overwriting a region the GPU has not finished reading. Without it
+// (macOS tops out at GL 4.1), writes go through a CPU staging copy and are
+// uploaded with unsynchronized glMapBufferRange; the buffer is orphaned
+// each time the ring wraps, so the driver hands back fresh storage instead
+// of waiting.
+
+namespace eglstream {
+
+const int STREAM_REGIONS = 3;
+const size_t SHARED_STREAM_BYTES = 4 * 1024 * 1024;
+
+struct StreamBuffer {
+  GLuint buffer = 0;
+  size_t size = 0;
+  size_t region_size = 0;
+  int region = 0;
+  size_t head = 0;                      // Next free byte, absolute
+  bool persistent = false;
+  unsigned char* mapped = nullptr;      // Persistent mapping
+  std::vector<unsigned char> staging;   // Fallback: CPU copy of the ring
+  GLsync fences[STREAM_REGIONS] = {};   // Persistent: last use of each region
+  size_t pending_offset = 0;            // Fallback: allocation awaiting commit
+  size_t pending_bytes = 0;
+};
+
+inline bool buffer_storage_supported() {
+#ifdef __APPLE__
+  return false;
+#else
+  return GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+#endif
+}
+
+inline StreamBuffer* create_stream(size_t bytes) {
+  StreamBuffer* s = new StreamBuffer();
+  s->region_size = bytes / STREAM_REGIONS;
+  s->size = s->region_size * STREAM_REGIONS;
+  s->persistent = buffer_storage_supported();
+  glGenBuffers(1, &s->buffer);
+  eglstate::bind_buffer(GL_ARRAY_BUFFER, s->buffer);
+#ifndef __APPLE__
+  if (s->persistent) {
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(GL_ARRAY_BUFFER, s->size, nullptr, flags);
+    s->mapped = static_cast<unsigned char*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, s->size, flags));
+    s->persistent = s->mapped != nullptr;
+  }
+#endif
+  if (!s->persistent) {
+    glBufferData(GL_ARRAY_BUFFER, s->size, nullptr, GL_STREAM_DRAW);
+    s->staging.resize(s->size);
+  }
+  ememtrack::track_buffer(s->buffer, ememtrack::CAT_GL_STREAMS, (int64_t)s->size);
+  return s;
+}
+
+inline void destroy_stream(StreamBuffer* s) {
+  if (!s) return;
+  for (GLsync& fence : s->fences) {
+    if (fence) glDeleteSync(fence);
+  }
+  eglstate::bind_buffer(GL_ARRAY_BUFFER, s->buffer);
+  if (s->mapped) glUnmapBuffer(GL_ARRAY_BUFFER);
+  eglstate::forget_buffer(s->buffer);
+  ememtrack::untrack_buffer(s->buffer);
+  glDeleteBuffers(1, &s->buffer);
+  delete s;
+}
+
+// Fence the current region and start writing at the next one
+inline void advance_region(StreamBuffer* s) {
+  if (s->persistent) {
+    if (s->fences[s->region]) glDeleteSync(s->fences[s->region]);
+    s->fences[s->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  }
+  s->region = (s->region + 1) % STREAM_REGIONS;
+  s->head = s->region * s->region_size;
+  if (s->persistent) {
+    GLsync fence = s->fences[s->region];
+    if (fence) {
+      // Normally signalled long ago: this region was drawn from two frames back
+      while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {
+      }
+      glDeleteSync(fence);
+      s->fences[s->region] = nullptr;
+    }
+  } else if (s->region == 0) {
+    eglstate::bind_buffer(GL_ARRAY_BUFFER, s->buffer);
+    glBufferData(GL_ARRAY_BUFFER, s->size, nullptr, GL_STREAM_DRAW);
+  }
+}
+
+// Claim bytes for vertices of stride bytes each. Returns where to write them
+// and their first vertex (through first_vertex), or nullptr if bytes can't
+// fit in a region. Call stream_commit once written, before drawing.
+inline void* stream_alloc(StreamBuffer* s, size_t bytes, size_t stride, GLint* first_vertex) {
+  if (!s || bytes == 0 || stride == 0 || bytes + stride > s->region_size) return nullptr;
+  size_t region_end = (s->region + 1) * s->region_size;
+  size_t offset = (s->head + stride - 1) / stride * stride;
+  if (offset + bytes > region_end) {
+    advance_region(s);
+    offset = (s->head + stride - 1) / stride * stride;
+  }
+  s->head = offset + bytes;
+  *first_vertex = static_cast<GLint>(offset / stride);
+  glcount::buffer_upload((long long)bytes);
+  if (s->persistent) {
+    return s->mapped + offset;
+  }
+  s->pending_offset = offset;
+  s->pending_bytes = bytes;
+  return s->staging.data() + offset;
+}
+
+// Make the last stream_alloc's bytes visible to GL. A no-op when mapped
+// persistently and coherently.
+inline void stream_commit(StreamBuffer* s) {
+  if (s->persistent || s->pending_bytes == 0) return;
+  eglstate::bind_buffer(GL_ARRAY_BUFFER, s->buffer);
+  // Nothing drawn since the last orphan reads this range, so skip the sync
+  void* dst = glMapBufferRange(GL_ARRAY_BUFFER, s->pending_offset, s->pending_bytes,
+                               GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT |
+                               GL_MAP_UNSYNCHRONIZED_BIT);
+  if (dst) {
+    std::memcpy(dst, s->staging.data() + s->pending_offset, s->pending_bytes);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+  } else {
+    glBufferSubData(GL_ARRAY_BUFFER, s->pending_offset, s->pending_bytes,
+                    s->staging.data() + s->pending_offset);
+  }
+  s->pending_bytes = 0;
+}
+
+// Copy bytes of vertex data into the ring. Returns the first vertex, or -1
+// if it doesn't fit.
+inline GLint stream_vertices(StreamBuffer* s, const void* data, size_t bytes, size_t stride) {
+  GLint first = -1;
+  void* dst = stream_alloc(s, bytes, stride, &first);
+  if (!dst) return -1;
+  std::memcpy(dst, data, bytes);
+  stream_commit(s);
+  return first;
+}
+
+// Once per frame, after the frame's draws
+inline void end_frame(StreamBuffer* s) {
+  if (s) advance_region(s);
+}
+
+// ---- Shared ring ----
+// Created on first use (needs a current context) and used by every engine
+// vertex producer
+
+inline StreamBuffer*& shared_slot() {
+  static StreamBuffer* s = nullptr;
+  return s;
+}
+
+inline StreamBuffer* shared() {
+  StreamBuffer*& s = shared_slot();
+  if (!s) s = create_stream(SHARED_STREAM_BYTES);
+  return s;
+}
+
+// The shared ring's buffer, for VAOs to point their attributes at
+inline GLuint shared_buffer() {
+  return shared()->buffer;
+}
+
+inline GLint shared_vertices(const void* data, size_t bytes, size_t stride) {
+  return stream_vertices(shared(), data, bytes, stride);
+}
+
+inline void end_shared_frame() {
+  end_frame(shared_slot());
+}
+
+inline bool shared_persistent() {
+  return shared()->persistent;
+}
+
+} // namespace eglstream
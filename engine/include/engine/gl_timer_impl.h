@@ -0,0 +1,111 @@
+#pragma once
+#include "gl_wrappers.h"
+#include "engine/profile_impl.h"
+#include <vector>
+
+// ============ GPU PASS TIMERS ============
+// GL_TIME_ELAPSED queries around the render passes (render queue flush
+// and instanced skinned draws as the world, text, gfx2d). Each pass takes a fresh query per use from its pool for
+// the current frame slot; a pass used several times in a frame is summed.
+// Results are read FRAME_SLOTS - 1 frames later, only once available, so
+// reading never stalls the pipeline. A slot whose queries still aren't
+// done when it comes round again is dropped and its queries reused.
+//
+// Queries can't nest, so passes mustn't either. Off until set_enabled;
+// finished frames' times go to eprofile as GPU phases.
+
+namespace egltimer {
+
+const int FRAME_SLOTS = 3;
+
+enum Pass { PASS_WORLD = 0, PASS_TEXT, PASS_GFX2D, PASS_COUNT };
+
+inline const char* pass_name(int pass) {
+  static const char* const NAMES[PASS_COUNT] = {"gpu world", "gpu text", "gpu gfx2d"};
+  return NAMES[pass];
+}
+
+struct PassQueries {
+  std::vector<GLuint> pool;   // Generated queries, reused every FRAME_SLOTS frames
+  int used = 0;               // Issued in this slot's frame
+};
+
+struct Timers {
+  bool enabled = false;
+  int slot = 0;
+  int active = -1;            // Pass with a query open
+  PassQueries passes[FRAME_SLOTS][PASS_COUNT];
+  double last_ms[PASS_COUNT] = {};
+  int zones[PASS_COUNT] = {};
+  bool named = false;
+};
+
+inline Timers& timers() {
+  static Timers t;
+  return t;
+}
+
+inline void set_enabled(bool enabled) { timers().enabled = enabled; }
+inline bool enabled() { return timers().enabled; }
+
+inline void begin_pass(int pass) {
+  Timers& t = timers();
+  if (!t.enabled || t.active >= 0) return;
+  PassQueries& q = t.passes[t.slot][pass];
+  if (q.used == (int)q.pool.size()) {
+    GLuint id = 0;
+    glGenQueries(1, &id);
+    q.pool.push_back(id);
+  }
+  glBeginQuery(GL_TIME_ELAPSED, q.pool[q.used++]);
+  t.active = pass;
+}
+
+inline void end_pass(int pass) {
+  Timers& t = timers();
+  if (t.active != pass) return;
+  glEndQuery(GL_TIME_ELAPSED);
+  t.active = -1;
+}
+
+struct Scope {
+  int pass;
+  explicit Scope(int p) : pass(p) { begin_pass(p); }
+  ~Scope() { end_pass(pass); }
+  Scope(const Scope&) = delete;
+  Scope& operator=(const Scope&) = delete;
+};
+
+// Move to the next slot, first collecting that slot's results from
+// FRAME_SLOTS - 1 frames ago if the GPU has finished them
+inline void end_frame() {
+  Timers& t = timers();
+  if (!t.enabled) return;
+  if (!t.named) {
+    for (int p = 0; p < PASS_COUNT; ++p) t.zones[p] = eprofile::zone_id(pass_name(p));
+    t.named = true;
+  }
+  t.slot = (t.slot + 1) % FRAME_SLOTS;
+  for (int p = 0; p < PASS_COUNT; ++p) {
+    PassQueries& q = t.passes[t.slot][p];
+    if (q.used > 0) {
+      GLint available = 0;
+      glGetQueryObjectiv(q.pool[q.used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+      if (available) {
+        GLuint64 total = 0;
+        for (int i = 0; i < q.used; ++i) {
+          GLuint64 ns = 0;
+          glGetQueryObjectui64v(q.pool[i], GL_QUERY_RESULT, &ns);
+          total += ns;
+        }
+        t.last_ms[p] = total / 1.0e6;
+        eprofile::gpu_record(t.zones[p], t.last_ms[p]);
+      }
+    }
+    q.used = 0;
+  }
+}
+
+inline double last_ms(int pass) { return timers().last_ms[pass]; }
+
+} // namespace egltimer
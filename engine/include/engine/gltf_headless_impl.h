@@ -1,6 +1,9 @@
 #pragma once
 #include "cgltf.h"
+#include <glm/glm.hpp>
+#include "engine/collision_impl.h"
 #include <cstring>
+#include <vector>
 
 namespace egltf_hl {
 inline bool node_is_colonly(cgltf_node* node) {
@@ -20,4 +23,106 @@ inline cgltf_float* get_node_translation (cgltf_node* node) {
 inline cgltf_float* get_node_scale (cgltf_node* node) {
   return node->scale;
 }
+
+// ============================================================================
+// Native collision buffers
+// ============================================================================
+// Fill collision vectors straight from cgltf accessors without building
+// jank [x y z] vectors. Node transforms are ignored, matching load-collision.
+
+static_assert(sizeof(glm::vec3) == 3 * sizeof(float), "glm::vec3 must be tightly packed");
+
+inline cgltf_accessor* find_position_accessor(cgltf_primitive* primitive) {
+  for (cgltf_size i = 0; i < primitive->attributes_count; i++) {
+    if (primitive->attributes[i].type == cgltf_attribute_type_position) {
+      return primitive->attributes[i].data;
+    }
+  }
+  return nullptr;
+}
+
+// Append one primitive's positions and indices. Indices are rebased onto
+// the vertices already in positions. Returns false if it has no positions.
+inline bool append_collision_primitive(
+    cgltf_primitive* primitive,
+    ecol::Positions* positions,
+    ecol::Indices* indices) {
+  cgltf_accessor* pos = find_position_accessor(primitive);
+  if (!pos || pos->count == 0) return false;
+
+  size_t base = positions->size();
+  positions->resize(base + pos->count);
+  cgltf_accessor_unpack_floats(pos, &(*positions)[base].x, pos->count * 3);
+
+  cgltf_accessor* idx = primitive->indices;
+  size_t ibase = indices->size();
+  if (!idx) {
+    // Non-indexed triangle list
+    indices->resize(ibase + pos->count);
+    for (size_t i = 0; i < pos->count; i++) {
+      (*indices)[ibase + i] = (unsigned int)(base + i);
+    }
+    return true;
+  }
+
+  indices->resize(ibase + idx->count);
+  unsigned int* out = &(*indices)[ibase];
+  // unpack_indices refuses sparse accessors; fall back to per-index reads
+  if (cgltf_accessor_unpack_indices(idx, out, sizeof(unsigned int), idx->count) < idx->count) {
+    for (size_t i = 0; i < idx->count; i++) {
+      out[i] = (unsigned int)cgltf_accessor_read_index(idx, i);
+    }
+  }
+  if (base > 0) {
+    for (size_t i = 0; i < idx->count; i++) out[i] += (unsigned int)base;
+  }
+  return true;
+}
+
+// Append every "-colonly" node of every scene into one mesh, reserving
+// the exact sizes up front. Returns the number of nodes appended.
+inline int append_collision_nodes(
+    cgltf_data* data,
+    ecol::Positions* positions,
+    ecol::Indices* indices) {
+  size_t vertex_count = 0;
+  size_t index_count = 0;
+  for (cgltf_size s = 0; s < data->scenes_count; s++) {
+    cgltf_scene* scene = &data->scenes[s];
+    for (cgltf_size n = 0; n < scene->nodes_count; n++) {
+      cgltf_node* node = scene->nodes[n];
+      if (!node_is_colonly(node) || !node->mesh) continue;
+      for (cgltf_size p = 0; p < node->mesh->primitives_count; p++) {
+        cgltf_primitive* primitive = &node->mesh->primitives[p];
+        cgltf_accessor* pos = find_position_accessor(primitive);
+        if (!pos) continue;
+        vertex_count += pos->count;
+        index_count += primitive->indices ? primitive->indices->count : pos->count;
+      }
+    }
+  }
+  positions->reserve(positions->size() + vertex_count);
+  indices->reserve(indices->size() + index_count);
+
+  int appended = 0;
+  for (cgltf_size s = 0; s < data->scenes_count; s++) {
+    cgltf_scene* scene = &data->scenes[s];
+    for (cgltf_size n = 0; n < scene->nodes_count; n++) {
+      cgltf_node* node = scene->nodes[n];
+      if (!node_is_colonly(node) || !node->mesh) continue;
+      bool any = false;
+      for (cgltf_size p = 0; p < node->mesh->primitives_count; p++) {
+        any = append_collision_primitive(&node->mesh->primitives[p], positions, indices) || any;
+      }
+      if (any) appended++;
+    }
+  }
+  return appended;
+}
+
+// Free buffers load-collision-buffers allocated but won't return
+inline void destroy_collision_buffers(ecol::Positions* positions, ecol::Indices* indices) {
+  delete positions;
+  delete indices;
+}
 } // namespace egltf_hl
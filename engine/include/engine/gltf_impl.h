@@ -1,26 +1,17 @@
 #pragma once
 #include "cgltf.h"
+#include "gl_wrappers.h"
+#include "engine/gl_state_impl.h"
+#include "engine/memtrack_impl.h"
+#include "engine/geometry_pool_impl.h"
+#include "engine/gltf_unpack_impl.h"
+#include "engine/vertex_pack_impl.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <cstring>
-
-struct Vertex {
-  float pos[3];
-  float norm[3];
-  float uv[2];
-
-  Vertex(float px, float py, float pz,
-         float nx, float ny, float nz,
-         float u, float v) {
-      pos[0]=px; pos[1]=py; pos[2]=pz;
-      norm[0]=nx; norm[1]=ny; norm[2]=nz;
-      uv[0]=u; uv[1]=v;
-  }
-
-  Vertex() { // default ctor for array allocation
-      pos[0]=pos[1]=pos[2]=0.0f;
-      norm[0]=norm[1]=norm[2]=0.0f;
-      uv[0]=uv[1]=0.0f;
-  }
-};
+#include <utility>
+#include <vector>
 
 inline size_t int_size_fn() { return sizeof(int); }
 #define int_size (int_size_fn())
@@ -50,4 +41,257 @@ inline bool node_is_colonly(cgltf_node* node) {
   if (len < slen) return false;
   return strcmp(str + len - slen, suffix) == 0;
 }
+
+// ============================================================================
+// Packed upload
+// ============================================================================
+// The VBO interleaves only the attributes the shader reads (attribute_mask,
+// ATTRIB_* bits, at locations 0/1/2 as in basic_vertex.glsl). With
+// quantize, normals go in as GL_INT_2_10_10_10_REV (4 bytes, not 12) and
+// uvs as half floats (4 bytes, not 8). Uvs stay float when any lies outside
+// +-HALF_UV_LIMIT, where half precision would show in tiled textures.
+// Indices are 16-bit whenever every vertex fits, so a position+normal+uv
+// vertex drops from 32 to 20 bytes and most indices from 4 to 2.
+
+const int ATTRIB_POSITION = 1;
+const int ATTRIB_NORMAL = 2;
+const int ATTRIB_UV = 4;
+using evpack::HALF_UV_LIMIT;
+
+using evpack::pack_snorm_2_10_10_10;
+using evpack::float_to_half;
+using evpack::put;
+
+// Interleave b's vertices (plus layers, a float per vertex for location 3,
+// when given; see upload_merged) into data and return their layout. The
+// index type is left for the caller to choose.
+inline egeompool::Format pack_vertices(const PrimitiveBuffers* b, const std::vector<float>* layers,
+                                       int attribute_mask, bool quantize,
+                                       std::vector<unsigned char>* data) {
+  bool normals = (attribute_mask & ATTRIB_NORMAL) != 0;
+  bool uvs = (attribute_mask & ATTRIB_UV) != 0;
+  bool half_uvs = quantize && uvs;
+  if (half_uvs) {
+    for (const Vertex& v : b->vertices) {
+      if (std::fabs(v.uv[0]) > HALF_UV_LIMIT || std::fabs(v.uv[1]) > HALF_UV_LIMIT) {
+        half_uvs = false;
+        break;
+      }
+    }
+  }
+  egeompool::Format format;
+  GLuint offset = 0;
+  format.add(0, 3, GL_FLOAT, GL_FALSE, offset);
+  offset += 12;
+  if (normals) {
+    if (quantize) {
+      format.add(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, offset);
+      offset += 4;
+    } else {
+      format.add(1, 3, GL_FLOAT, GL_FALSE, offset);
+      offset += 12;
+    }
+  }
+  if (uvs) {
+    format.add(2, 2, half_uvs ? GL_HALF_FLOAT : GL_FLOAT, GL_FALSE, offset);
+    offset += half_uvs ? 4 : 8;
+  }
+  if (layers) {
+    format.add(3, 1, GL_FLOAT, GL_FALSE, offset);
+    offset += 4;
+  }
+  format.stride = (GLsizei)offset;
+
+  data->clear();
+  data->reserve(format.stride * b->vertices.size());
+  for (size_t i = 0; i < b->vertices.size(); ++i) {
+    const Vertex& v = b->vertices[i];
+    put(data, v.pos, 12);
+    if (normals) {
+      if (quantize) {
+        uint32_t n = pack_snorm_2_10_10_10(v.norm);
+        put(data, &n, 4);
+      } else {
+        put(data, v.norm, 12);
+      }
+    }
+    if (uvs) {
+      if (half_uvs) {
+        uint16_t h[2] = {float_to_half(v.uv[0]), float_to_half(v.uv[1])};
+        put(data, h, 4);
+      } else {
+        put(data, v.uv, 8);
+      }
+    }
+    if (layers) put(data, &(*layers)[i], 4);
+  }
+  return format;
+}
+
+// Upload b into a new VAO (VBO and EBO bound to it) and return the index
+// type to draw with (GL_UNSIGNED_SHORT or GL_UNSIGNED_INT). layers, when
+// given, is a float per vertex for location 3 (see upload_merged).
+inline GLenum upload_vertices(const PrimitiveBuffers* b, const std::vector<float>* layers,
+                              int attribute_mask, bool quantize, GLuint* vao_out) {
+  std::vector<unsigned char> data;
+  egeompool::Format format = pack_vertices(b, layers, attribute_mask, quantize, &data);
+
+  GLuint vao = 0, vbo = 0, ebo = 0;
+  glGenVertexArrays(1, &vao);
+  eglstate::bind_vertex_array(vao);
+  glGenBuffers(1, &vbo);
+  eglstate::bind_buffer(GL_ARRAY_BUFFER, vbo);
+  glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)data.size(), data.data(), GL_STATIC_DRAW);
+  ememtrack::track_buffer(vbo, ememtrack::CAT_MESHES, (int64_t)data.size());
+
+  glGenBuffers(1, &ebo);
+  eglstate::bind_buffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+  GLenum index_type = GL_UNSIGNED_INT;
+  if (b->vertices.size() <= 0x10000) {
+    std::vector<uint16_t> short_indices(b->indices.begin(), b->indices.end());
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)(short_indices.size() * 2),
+                 short_indices.data(), GL_STATIC_DRAW);
+    index_type = GL_UNSIGNED_SHORT;
+  } else {
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)(b->indices.size() * 4),
+                 b->indices.data(), GL_STATIC_DRAW);
+  }
+  ememtrack::track_buffer(ebo, ememtrack::CAT_MESHES,
+                          (int64_t)(b->indices.size() * (index_type == GL_UNSIGNED_SHORT ? 2 : 4)));
+
+  egeompool::set_attribute_pointers(format, 0);
+  *vao_out = vao;
+  return index_type;
+}
+
+inline GLenum upload_primitive(PrimitiveBuffers* b, int attribute_mask, bool quantize,
+                               GLuint* vao_out) {
+  return upload_vertices(b, nullptr, attribute_mask, quantize, vao_out);
+}
+
+// Copy b into the shared pool for its vertex format (egeompool) instead of
+// a VAO of its own. Draw it from the mesh's VAO at its first index, with
+// its base vertex (erender::queue_base_vertex); free with
+// egeompool::free_mesh.
+inline egeompool::Mesh* upload_pooled(const PrimitiveBuffers* b, int attribute_mask, bool quantize) {
+  std::vector<unsigned char> data;
+  egeompool::Format format = pack_vertices(b, nullptr, attribute_mask, quantize, &data);
+  if (b->vertices.size() <= 0x10000) {
+    format.index_type = GL_UNSIGNED_SHORT;
+    std::vector<uint16_t> short_indices(b->indices.begin(), b->indices.end());
+    return egeompool::upload(format, data.data(), (uint32_t)b->vertices.size(),
+                             short_indices.data(), (uint32_t)short_indices.size());
+  }
+  return egeompool::upload(format, data.data(), (uint32_t)b->vertices.size(),
+                           b->indices.data(), (uint32_t)b->indices.size());
+}
+
+// Delete a VAO from upload_primitive along with its VBO and EBO
+inline void free_primitive_vao(GLuint vao) {
+  GLint vbo = 0, ebo = 0;
+  eglstate::bind_vertex_array(vao);
+  glGetVertexAttribiv(0, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING, &vbo);
+  glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &ebo);
+  eglstate::bind_vertex_array(0);
+  GLuint buffers[2] = {(GLuint)vbo, (GLuint)ebo};
+  ememtrack::untrack_buffer(buffers[0]);
+  ememtrack::untrack_buffer(buffers[1]);
+  glDeleteBuffers(2, buffers);
+  glDeleteVertexArrays(1, &vao);
+  eglstate::forget_buffer(buffers[0]);
+  eglstate::forget_buffer(buffers[1]);
+  eglstate::forget_vertex_array(vao);
+}
+
+// ============================================================================
+// Merged upload
+// ============================================================================
+// Primitives whose images share a texture array (etextures::array_set_build)
+// go into one VAO, so the render queue draws them with one binding and
+// multi-draws what it can't merge. Each primitive's node scale-then-
+// translate is baked into its vertices (normals through the inverse
+// scale), leaving them in model space, and every vertex carries its
+// image's array layer at location 3 (level_array_vertex.glsl).
+//
+// Indices are laid out level-major: every primitive's finest range, then
+// every primitive's first LOD, and so on, so visible neighbours drawn at
+// the same level sit next to each other and merge into one range.
+
+struct MergedPart {
+  size_t vertex_base;
+  std::vector<unsigned int> indices;   // The primitive's own, LODs included
+  std::vector<std::pair<uint32_t, uint32_t>> levels;  // (first, count) in indices, finest first
+  std::vector<GLint> firsts;           // Each level's first in the merged EBO
+};
+
+struct MergedBuilder {
+  PrimitiveBuffers buffers;
+  std::vector<float> layers;
+  std::vector<MergedPart> parts;
+};
+
+inline MergedBuilder* create_merged() {
+  return new MergedBuilder();
+}
+
+// Copy b in under scale (sx, sy, sz) then translate (tx, ty, tz), textured
+// from layer. Returns its part; give it its levels with merged_add_level.
+inline int merged_add(MergedBuilder* m, const PrimitiveBuffers* b, float layer,
+                      float sx, float sy, float sz, float tx, float ty, float tz) {
+  MergedPart part;
+  part.vertex_base = m->buffers.vertices.size();
+  part.indices = b->indices;
+  const float s[3] = {sx, sy, sz}, t[3] = {tx, ty, tz};
+  for (Vertex v : b->vertices) {
+    float len = 0.0f;
+    for (int k = 0; k < 3; ++k) {
+      v.pos[k] = s[k] * (v.pos[k] + t[k]);
+      v.norm[k] = s[k] != 0.0f ? v.norm[k] / s[k] : v.norm[k];
+      len += v.norm[k] * v.norm[k];
+    }
+    if (len > 0.0f) {
+      len = std::sqrt(len);
+      for (float& c : v.norm) c /= len;
+    }
+    m->buffers.vertices.push_back(v);
+    m->layers.push_back(layer);
+  }
+  m->parts.push_back(std::move(part));
+  return (int)m->parts.size() - 1;
+}
+
+// Next level of part: count indices from first, in the primitive's own
+// indices (its finest first, then the LODs its chain has)
+inline void merged_add_level(MergedBuilder* m, int part, int first, int count) {
+  m->parts[part].levels.push_back({(uint32_t)first, (uint32_t)count});
+}
+
+// Upload every part into a new VAO (freed by free_primitive_vao) and return
+// the index type; the parts' firsts are set after
+inline GLenum upload_merged(MergedBuilder* m, int attribute_mask, bool quantize, GLuint* vao_out) {
+  std::vector<unsigned int>& out = m->buffers.indices;
+  out.clear();
+  size_t depth = 0;
+  for (const MergedPart& part : m->parts) depth = std::max(depth, part.levels.size());
+  for (size_t level = 0; level < depth; ++level) {
+    for (MergedPart& part : m->parts) {
+      if (level >= part.levels.size()) continue;
+      part.firsts.push_back((GLint)out.size());
+      const auto& range = part.levels[level];
+      for (uint32_t i = 0; i < range.second; ++i) {
+        out.push_back((unsigned int)part.vertex_base + part.indices[range.first + i]);
+      }
+    }
+  }
+  return upload_vertices(&m->buffers, &m->layers, attribute_mask, quantize, vao_out);
+}
+
+// Where part's level starts in the merged EBO, after upload_merged
+inline int merged_first(const MergedBuilder* m, int part, int level) {
+  return m->parts[part].firsts[level];
+}
+
+inline void free_merged(MergedBuilder* m) {
+  delete m;
+}
 } // namespace egltf
@@ -0,0 +1,122 @@
+#pragma once
+#include "cgltf.h"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+// glTF primitives to plain vertex/index arrays, with no GL, so the client
+// upload (gltf_impl.h), the headless loader and the level baker
+// (tools/levelbake) share one unpacking.
+
+struct Vertex {
+  float pos[3];
+  float norm[3];
+  float uv[2];
+
+  Vertex(float px, float py, float pz,
+         float nx, float ny, float nz,
+         float u, float v) {
+      pos[0]=px; pos[1]=py; pos[2]=pz;
+      norm[0]=nx; norm[1]=ny; norm[2]=nz;
+      uv[0]=u; uv[1]=v;
+  }
+
+  Vertex() { // default ctor for array allocation
+      pos[0]=pos[1]=pos[2]=0.0f;
+      norm[0]=norm[1]=norm[2]=0.0f;
+      uv[0]=uv[1]=0.0f;
+  }
+};
+
+namespace egltf {
+
+// ============================================================================
+// Native primitive buffers
+// ============================================================================
+// A render primitive unpacked straight from its accessors into the
+// interleaved vertices and indices load uploads, in bulk
+// (cgltf_accessor_unpack_*) rather than one read per element into jank
+// vectors. Missing normals or uvs are left zero.
+
+struct PrimitiveBuffers {
+  std::vector<Vertex> vertices;
+  std::vector<unsigned int> indices;
+  float min[3] = {0.0f, 0.0f, 0.0f};    // Local-space position bounds
+  float max[3] = {0.0f, 0.0f, 0.0f};
+};
+
+static_assert(sizeof(Vertex) == 8 * sizeof(float), "Vertex must be tightly packed");
+
+inline cgltf_accessor* find_attribute(cgltf_primitive* primitive, cgltf_attribute_type type) {
+  for (cgltf_size i = 0; i < primitive->attributes_count; i++) {
+    if (primitive->attributes[i].type == type && primitive->attributes[i].index == 0) {
+      return primitive->attributes[i].data;
+    }
+  }
+  return nullptr;
+}
+
+// Unpack accessor's first n components per element into field offset of
+// each vertex
+inline void unpack_into_vertices(cgltf_accessor* accessor, std::vector<Vertex>* vertices,
+                                 size_t field, size_t n) {
+  if (!accessor) return;
+  size_t components = cgltf_num_components(accessor->type);
+  size_t count = std::min((size_t)accessor->count, vertices->size());
+  std::vector<float> tmp(accessor->count * components);
+  cgltf_accessor_unpack_floats(accessor, tmp.data(), tmp.size());
+  n = std::min(n, components);
+  for (size_t i = 0; i < count; i++) {
+    float* dst = reinterpret_cast<float*>(&(*vertices)[i]) + field;
+    std::memcpy(dst, &tmp[i * components], n * sizeof(float));
+  }
+}
+
+// Returns nullptr if the primitive has no positions. Free with
+// free_primitive_buffers.
+inline PrimitiveBuffers* unpack_primitive(cgltf_primitive* primitive) {
+  cgltf_accessor* pos = find_attribute(primitive, cgltf_attribute_type_position);
+  if (!pos || pos->count == 0) return nullptr;
+
+  PrimitiveBuffers* b = new PrimitiveBuffers();
+  b->vertices.resize(pos->count);
+  unpack_into_vertices(pos, &b->vertices, 0, 3);
+  unpack_into_vertices(find_attribute(primitive, cgltf_attribute_type_normal), &b->vertices, 3, 3);
+  unpack_into_vertices(find_attribute(primitive, cgltf_attribute_type_texcoord), &b->vertices, 6, 2);
+
+  for (int k = 0; k < 3; k++) b->min[k] = b->max[k] = b->vertices[0].pos[k];
+  for (const Vertex& v : b->vertices) {
+    for (int k = 0; k < 3; k++) {
+      b->min[k] = std::min(b->min[k], v.pos[k]);
+      b->max[k] = std::max(b->max[k], v.pos[k]);
+    }
+  }
+
+  cgltf_accessor* idx = primitive->indices;
+  if (!idx) {
+    b->indices.resize(pos->count);
+    for (size_t i = 0; i < pos->count; i++) b->indices[i] = (unsigned int)i;
+    return b;
+  }
+  b->indices.resize(idx->count);
+  // unpack_indices refuses sparse accessors; fall back to per-index reads
+  if (cgltf_accessor_unpack_indices(idx, b->indices.data(), sizeof(unsigned int), idx->count) < idx->count) {
+    for (size_t i = 0; i < idx->count; i++) {
+      b->indices[i] = (unsigned int)cgltf_accessor_read_index(idx, i);
+    }
+  }
+  return b;
+}
+
+inline void free_primitive_buffers(PrimitiveBuffers* b) {
+  delete b;
+}
+
+inline int primitive_index_count(PrimitiveBuffers* b) {
+  return (int)b->indices.size();
+}
+
+inline float primitive_bound(PrimitiveBuffers* b, int max, int axis) {
+  return max ? b->max[axis] : b->min[axis];
+}
+} // namespace egltf
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <GLFW/glfw3.h>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include "engine/timing_impl.h"
+
+namespace einput {
+
+// ============================================================================
+// Input sampler
+// ============================================================================
+// GLFW delivers input only on the thread that polls (the main thread), as
+// callbacks during glfwPollEvents. The sampler's callbacks apply each event
+// as it is delivered: cursor motion turns the look angles per event (raw,
+// unaccelerated motion where the platform has it) and watched keys set or
+// clear bits of a held mask, each stamped on etiming::now_ns's clock. Any
+// thread can take a sample, so a simulation thread steps on the state as
+// of the latest poll rather than a copy the render thread made at the
+// start of its frame.
+
+const int MAX_KEYS = 64;
+
+struct Sampler {
+    std::mutex mutex;
+    std::vector<int> keys;  // Watched GLFW key codes; bit i of held is keys[i]
+    uint64_t held = 0;
+    double sensitivity = 0.05;  // Degrees per unit of cursor motion
+    double yaw = 0.0;
+    double pitch = 0.0;
+    double min_pitch = -90.0;
+    double max_pitch = 90.0;
+    double last_x = 0.0;
+    double last_y = 0.0;
+    bool have_cursor = false;  // last_x/y hold a position to measure from
+    int64_t event_ns = 0;      // Newest event's time
+    uint64_t events = 0;       // Events applied since creation
+};
+
+// The sampler the installed callbacks feed (one window at a time)
+inline Sampler* active = nullptr;
+
+inline Sampler* create_sampler(double sensitivity, double yaw, double pitch,
+                               double min_pitch, double max_pitch) {
+    Sampler* s = new Sampler();
+    s->sensitivity = sensitivity;
+    s->yaw = yaw;
+    s->pitch = pitch;
+    s->min_pitch = min_pitch;
+    s->max_pitch = max_pitch;
+    return s;
+}
+
+// Watch a GLFW key; returns its bit in the held mask, or -1 past MAX_KEYS.
+// Call before install.
+inline int watch_key(Sampler* s, int key) {
+    if ((int)s->keys.size() >= MAX_KEYS) return -1;
+    s->keys.push_back(key);
+    return (int)s->keys.size() - 1;
+}
+
+inline void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+    (void)window;
+    (void)scancode;
+    (void)mods;
+    Sampler* s = active;
+    if (!s || action == GLFW_REPEAT) return;
+    std::lock_guard<std::mutex> lock(s->mutex);
+    for (size_t i = 0; i < s->keys.size(); i++) {
+        if (s->keys[i] != key) continue;
+        if (action == GLFW_PRESS) s->held |= uint64_t(1) << i;
+        else s->held &= ~(uint64_t(1) << i);
+    }
+    s->event_ns = etiming::now_ns();
+    s->events++;
+}
+
+inline void cursor_callback(GLFWwindow* window, double x, double y) {
+    (void)window;
+    Sampler* s = active;
+    if (!s) return;
+    std::lock_guard<std::mutex> lock(s->mutex);
+    if (s->have_cursor) {
+        s->yaw += (x - s->last_x) * s->sensitivity;
+        s->pitch -= (y - s->last_y) * s->sensitivity;
+        if (s->pitch > s->max_pitch) s->pitch = s->max_pitch;
+        if (s->pitch < s->min_pitch) s->pitch = s->min_pitch;
+    }
+    s->last_x = x;
+    s->last_y = y;
+    s->have_cursor = true;
+    s->event_ns = etiming::now_ns();
+    s->events++;
+}
+
+// Feed s from window's events, starting from the keys held now. Returns
+// whether raw mouse motion is on (the cursor must be disabled for it to
+// apply).
+inline bool install(GLFWwindow* window, Sampler* s) {
+    {
+        std::lock_guard<std::mutex> lock(s->mutex);
+        s->held = 0;
+        for (size_t i = 0; i < s->keys.size(); i++) {
+            if (glfwGetKey(window, s->keys[i]) == GLFW_PRESS) s->held |= uint64_t(1) << i;
+        }
+        s->have_cursor = false;
+    }
+    active = s;
+    glfwSetKeyCallback(window, key_callback);
+    glfwSetCursorPosCallback(window, cursor_callback);
+    bool raw = glfwRawMouseMotionSupported() == GLFW_TRUE;
+    if (raw) glfwSetInputMode(window, GLFW_RAW_MOUSE_MOTION, GLFW_TRUE);
+    return raw;
+}
+
+inline void uninstall(GLFWwindow* window) {
+    glfwSetKeyCallback(window, nullptr);
+    glfwSetCursorPosCallback(window, nullptr);
+    active = nullptr;
+}
+
+inline void destroy_sampler(Sampler* s) {
+    if (active == s) active = nullptr;
+    delete s;
+}
+
+// ---- Samples ----
+
+struct Sample {
+    uint64_t held = 0;
+    double yaw = 0.0;
+    double pitch = 0.0;
+    int64_t event_ns = 0;
+    uint64_t events = 0;
+};
+
+inline void take_sample(Sampler* s, Sample* out) {
+    std::lock_guard<std::mutex> lock(s->mutex);
+    out->held = s->held;
+    out->yaw = s->yaw;
+    out->pitch = s->pitch;
+    out->event_ns = s->event_ns;
+    out->events = s->events;
+}
+
+inline bool sample_held(const Sample* sample, int bit) {
+    return bit >= 0 && bit < MAX_KEYS && (sample->held >> bit) & 1;
+}
+
+inline double sample_yaw(const Sample* sample) { return sample->yaw; }
+inline double sample_pitch(const Sample* sample) { return sample->pitch; }
+inline double sample_event_ms(const Sample* sample) { return (double)sample->event_ns / 1.0e6; }
+inline int64_t sample_events(const Sample* sample) { return (int64_t)sample->events; }
+
+} // namespace einput
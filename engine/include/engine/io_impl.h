@@ -1,5 +1,12 @@
 #pragma once
 #include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
 
 namespace eio {
 inline char* charify_void (void* buffer) {
@@ -9,4 +16,87 @@ inline char* charify_void (void* buffer) {
 inline const char* dirent_name(struct dirent* entry) {
   return entry->d_name;
 }
+
+// ============ MAPPED FILES ============
+// A whole file mapped read-only, so loaders read it in place instead of
+// through a malloc'd copy. An empty file maps to data == nullptr, size 0.
+
+struct MappedFile {
+  const unsigned char* data = nullptr;
+  size_t size = 0;
+};
+
+// nullptr if the file can't be opened or mapped
+inline MappedFile* map_file(const char* path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return nullptr;
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return nullptr;
+  }
+  MappedFile* f = new MappedFile();
+  if (st.st_size > 0) {
+    void* mapping = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+      close(fd);
+      delete f;
+      return nullptr;
+    }
+    f->data = static_cast<const unsigned char*>(mapping);
+    f->size = (size_t)st.st_size;
+  }
+  close(fd);
+  return f;
+}
+
+inline void unmap_file(MappedFile* f) {
+  if (!f) return;
+  if (f->data) munmap(const_cast<unsigned char*>(f->data), f->size);
+  delete f;
+}
+
+// Mapped PROT_READ: writing through it faults
+inline unsigned char* mapped_data(MappedFile* f) { return const_cast<unsigned char*>(f->data); }
+inline size_t mapped_size(MappedFile* f) { return f->size; }
+
+// The contents as text; the one copy, for callers that need a string
+inline std::string mapped_string(MappedFile* f) {
+  return f->data ? std::string(reinterpret_cast<const char*>(f->data), f->size) : std::string();
+}
+
+// ============ CHUNKED READS ============
+// Reads a file front to back through one reused buffer, for files too big
+// to want whole, mapped or not.
+
+struct ChunkReader {
+  FILE* file = nullptr;
+  std::vector<unsigned char> buffer;
+  size_t filled = 0;  // Bytes of buffer the last next_chunk read
+};
+
+inline ChunkReader* open_chunks(const char* path, size_t chunk_bytes) {
+  FILE* file = fopen(path, "rb");
+  if (!file) return nullptr;
+  ChunkReader* r = new ChunkReader();
+  r->file = file;
+  r->buffer.resize(chunk_bytes > 0 ? chunk_bytes : 1);
+  return r;
+}
+
+// Bytes read into chunk_data, 0 at the end of the file (or on error)
+inline size_t next_chunk(ChunkReader* r) {
+  r->filled = fread(r->buffer.data(), 1, r->buffer.size(), r->file);
+  return r->filled;
+}
+
+inline unsigned char* chunk_data(ChunkReader* r) { return r->buffer.data(); }
+
+inline bool chunks_failed(ChunkReader* r) { return ferror(r->file) != 0; }
+
+inline void close_chunks(ChunkReader* r) {
+  if (!r) return;
+  fclose(r->file);
+  delete r;
+}
 } // namespace eio
@@ -0,0 +1,271 @@
+#pragma once
+#include "engine/profile_impl.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// ============ JOB SYSTEM ============
+// One pool of worker threads shared by the engine's parallel work
+// (animation batches, skinned mesh interleaving, texture decodes), so
+// subsystems take turns on the cores instead of each starting threads of
+// their own. Each worker owns a deque: it pushes and pops its own jobs at
+// the back and, once that runs dry, steals the oldest job at the front of
+// another's. Jobs submitted from outside the pool go round-robin to the
+// workers' deques.
+//
+// parallel_for splits an index range over the caller and idle workers.
+// A Counter tracks a group of jobs: submitting against it adds one, each
+// job finishing takes one off. wait runs queued jobs on the waiting thread
+// until its counter reaches zero, so a job may wait on jobs of its own
+// without tying up a worker. Jobs queued with after start once a counter
+// reaches zero, chaining stages without anyone blocking in between.
+//
+// Jobs must only ever block in wait. Threads that sit on I/O (the level
+// stream's reader, the network thread) stay dedicated. The pool starts on
+// first use with a worker per core beyond the main thread;
+// ENGINE_JOB_WORKERS=n sets the count, 0 running every job inline on the
+// thread that submits it. It is never torn down, so jobs still running at
+// exit never see their pool destroyed under them.
+
+namespace ejobs {
+
+struct Counter;
+
+struct Job {
+  std::function<void()> fn;
+  Counter* counter = nullptr;          // Decremented once fn returns; may be null
+};
+
+struct Counter {
+  std::atomic<int> pending{0};
+  std::mutex mutex;                    // Held while finishing and over continuations
+  std::vector<Job> continuations;      // Queued when pending reaches zero
+};
+
+struct Worker {
+  std::mutex mutex;
+  std::deque<Job> jobs;
+};
+
+struct Scheduler {
+  std::vector<std::unique_ptr<Worker>> workers;
+  std::vector<std::thread> threads;
+  std::atomic<size_t> next_worker{0};  // Round robin for outside submits
+  std::atomic<int> queued{0};          // Jobs in every deque
+  std::mutex sleep_mutex;
+  std::condition_variable wake;
+};
+
+// The pool's index of the calling thread, -1 outside it
+inline thread_local int current_worker = -1;
+
+inline void worker_loop(Scheduler* s, int index);
+
+inline Scheduler* start_scheduler() {
+  Scheduler* s = new Scheduler();
+  int n = -1;
+  if (const char* env = std::getenv("ENGINE_JOB_WORKERS")) n = std::atoi(env);
+  if (n < 0) {
+    unsigned cores = std::thread::hardware_concurrency();
+    n = cores > 1 ? static_cast<int>(cores) - 1 : 0;
+  }
+  for (int i = 0; i < n; ++i) s->workers.push_back(std::make_unique<Worker>());
+  for (int i = 0; i < n; ++i) s->threads.emplace_back(worker_loop, s, i);
+  for (auto& t : s->threads) t.detach();
+  return s;
+}
+
+inline Scheduler* scheduler() {
+  static Scheduler* s = start_scheduler();
+  return s;
+}
+
+inline int worker_count() {
+  return static_cast<int>(scheduler()->workers.size());
+}
+
+inline void push(Scheduler* s, Job job) {
+  int self = current_worker;
+  size_t i = self >= 0 ? (size_t)self : s->next_worker.fetch_add(1) % s->workers.size();
+  {
+    std::lock_guard<std::mutex> lock(s->workers[i]->mutex);
+    s->workers[i]->jobs.push_back(std::move(job));
+  }
+  s->queued.fetch_add(1);
+  { std::lock_guard<std::mutex> lock(s->sleep_mutex); }
+  s->wake.notify_one();
+}
+
+// The calling worker's newest job, else the oldest one another worker has
+inline bool try_take(Scheduler* s, Job* out) {
+  if (s->queued.load() == 0) return false;
+  size_t n = s->workers.size();
+  int self = current_worker;
+  size_t start = self >= 0 ? (size_t)self : 0;
+  for (size_t k = 0; k < n; ++k) {
+    Worker& w = *s->workers[(start + k) % n];
+    std::lock_guard<std::mutex> lock(w.mutex);
+    if (w.jobs.empty()) continue;
+    if (k == 0 && self >= 0) {
+      *out = std::move(w.jobs.back());
+      w.jobs.pop_back();
+    } else {
+      *out = std::move(w.jobs.front());
+      w.jobs.pop_front();
+    }
+    s->queued.fetch_sub(1);
+    return true;
+  }
+  return false;
+}
+
+inline void finish(Counter* c) {
+  if (!c) return;
+  std::vector<Job> ready;
+  {
+    std::lock_guard<std::mutex> lock(c->mutex);
+    if (c->pending.fetch_sub(1) == 1) ready.swap(c->continuations);
+  }
+  Scheduler* s = scheduler();
+  for (Job& job : ready) {
+    if (s->workers.empty()) {
+      job.fn();
+      finish(job.counter);
+    } else {
+      push(s, std::move(job));
+    }
+  }
+}
+
+inline void run(Job& job) {
+  job.fn();
+  finish(job.counter);
+}
+
+inline void worker_loop(Scheduler* s, int index) {
+  current_worker = index;
+  for (;;) {
+    Job job;
+    if (try_take(s, &job)) {
+      run(job);
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(s->sleep_mutex);
+    s->wake.wait(lock, [s] { return s->queued.load() > 0; });
+  }
+}
+
+// Queue fn, counted against c (may be null)
+inline void submit(Counter* c, std::function<void()> fn) {
+  if (c) c->pending.fetch_add(1);
+  Scheduler* s = scheduler();
+  Job job{std::move(fn), c};
+  if (s->workers.empty()) {
+    run(job);
+    return;
+  }
+  push(s, std::move(job));
+}
+
+// Queue fn, counted against c, once dependency reaches zero (at once if
+// it already has)
+inline void after(Counter* dependency, Counter* c, std::function<void()> fn) {
+  if (c) c->pending.fetch_add(1);
+  {
+    std::lock_guard<std::mutex> lock(dependency->mutex);
+    if (dependency->pending.load() > 0) {
+      dependency->continuations.push_back(Job{std::move(fn), c});
+      return;
+    }
+  }
+  Job job{std::move(fn), c};
+  Scheduler* s = scheduler();
+  if (s->workers.empty()) {
+    run(job);
+    return;
+  }
+  push(s, std::move(job));
+}
+
+inline bool done(Counter* c) {
+  return c->pending.load() == 0;
+}
+
+// Run queued jobs until c reaches zero. c may be freed once this returns.
+inline void wait(Counter* c) {
+  EPROFILE_ZONE("job wait");
+  Scheduler* s = scheduler();
+  while (c->pending.load() > 0) {
+    Job job;
+    if (try_take(s, &job)) {
+      run(job);
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  // The last finish may still hold the lock
+  std::lock_guard<std::mutex> lock(c->mutex);
+}
+
+struct ForRange {
+  std::atomic<int> next{0};            // Next chunk to claim
+  std::atomic<int> finished{0};
+};
+
+// fn(i) for i in [0, count), in chunks of grain indices claimed in turn by
+// the calling thread and up to max_helpers workers (-1: all of them).
+// Returns once every chunk is done, without waiting for helpers that never
+// got to start (they find nothing left), so the caller never picks up
+// unrelated jobs queued ahead of them, like a texture decode mid-frame.
+template <typename Fn>
+inline void parallel_for(int count, int grain, Fn&& fn, int max_helpers = -1) {
+  if (count <= 0) return;
+  grain = std::max(grain, 1);
+  int chunks = (count + grain - 1) / grain;
+  int helpers = std::min(chunks - 1, worker_count());
+  if (max_helpers >= 0) helpers = std::min(helpers, max_helpers);
+  auto range = std::make_shared<ForRange>();
+  auto* body = &fn;
+  // Touches fn only with a chunk claimed, which the caller is still waiting on
+  auto drain = [range, body, count, grain, chunks] {
+    for (int c = range->next++; c < chunks; c = range->next++) {
+      int end = std::min(count, (c + 1) * grain);
+      for (int i = c * grain; i < end; ++i) (*body)(i);
+      range->finished++;
+    }
+  };
+  for (int h = 0; h < helpers; ++h) submit(nullptr, drain);
+  drain();
+  while (range->finished.load() < chunks) std::this_thread::yield();
+}
+
+// ---- Native jobs from jank ----
+// jank code can't run on the pool (its runtime is single-threaded), but it
+// can start native functions there and hold on to the handle.
+
+typedef void (*NativeJob)(void* data);
+
+inline Counter* create_handle() {
+  return new Counter();
+}
+
+// fn is a NativeJob passed as void*, as jank boxes it
+inline void submit_native(Counter* handle, void* fn, void* data) {
+  NativeJob job = reinterpret_cast<NativeJob>(fn);
+  submit(handle, [job, data] { job(data); });
+}
+
+// Wait for every job submitted against handle, then free it
+inline void wait_handle(Counter* handle) {
+  wait(handle);
+  delete handle;
+}
+
+} // namespace ejobs
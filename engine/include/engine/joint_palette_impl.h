@@ -0,0 +1,369 @@
+#pragma once
+#include "gl_wrappers.h"
+#include "engine/gl_state_impl.h"
+#include "engine/gl_timer_impl.h"
+#include "engine/memtrack_impl.h"
+#include "engine/shaders_impl.h"
+#include "animation_types.h"
+#include "ozz/base/containers/vector.h"
+#include "ozz/base/maths/simd_math.h"
+#include "ozz_mesh.h"
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <cstdint>
+#include <vector>
+
+// ============ JOINT PALETTE ============
+// One texture buffer holding every skinned draw's matrices for a frame.
+// Each draw appends its mesh's skinning matrices and gets back their offset
+// (in matrices); skinned_vertex.glsl reads uJointPalette at uPaletteOffset
+// instead of the uBoneMatrices uniform array, so there is one upload per
+// frame rather than one glUniformMatrix4fv per draw, and no MAX_BONES cap.
+//
+// Per frame: palette_reset, palette_append per draw, palette_upload, then
+// palette_bind before the draws and palette_set_offset before each one.
+//
+// A slice whose context, mesh and pose version match what it held last
+// frame is not refilled, and if no slice changed the upload is skipped.
+
+namespace eanim {
+
+// What a slice starting at some offset was last filled from
+struct PaletteSlice {
+  const AnimationContext* ctx = nullptr;
+  const ozz::sample::Mesh* mesh = nullptr;
+  uint32_t pose_version = 0;
+};
+
+struct JointPalette {
+  GLuint buffer = 0;
+  GLuint texture = 0;
+  ozz::vector<ozz::math::Float4x4> matrices;  // CPU staging, 16-byte aligned
+  std::vector<PaletteSlice> slices;           // By start offset
+  size_t count = 0;                           // Matrices appended this frame
+  size_t capacity = 0;                        // Matrices the buffer holds
+  size_t uploaded_count = 0;                  // Matrices in the buffer now
+  std::atomic<bool> dirty{true};              // Staging differs from the buffer
+  GLint offset_location = -1;                 // uPaletteOffset of the bound shader
+};
+
+inline JointPalette* create_joint_palette(int max_joints) {
+  JointPalette* p = new JointPalette();
+  p->capacity = max_joints > 0 ? static_cast<size_t>(max_joints) : 1;
+  p->matrices.resize(p->capacity);
+  p->slices.resize(p->capacity);
+  glGenBuffers(1, &p->buffer);
+  eglstate::bind_buffer(GL_TEXTURE_BUFFER, p->buffer);
+  glBufferData(GL_TEXTURE_BUFFER, p->capacity * sizeof(ozz::math::Float4x4), nullptr, GL_STREAM_DRAW);
+  ememtrack::track_buffer(p->buffer, ememtrack::CAT_GL_STREAMS,
+                          (int64_t)(p->capacity * sizeof(ozz::math::Float4x4)));
+  glGenTextures(1, &p->texture);
+  eglstate::bind_texture(GL_TEXTURE_BUFFER, p->texture);
+  glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, p->buffer);
+  eglstate::bind_texture(GL_TEXTURE_BUFFER, 0);
+  eglstate::bind_buffer(GL_TEXTURE_BUFFER, 0);
+  return p;
+}
+
+inline void destroy_joint_palette(JointPalette* p) {
+  if (!p) return;
+  eglstate::forget_texture(p->texture);
+  eglstate::forget_buffer(p->buffer);
+  ememtrack::untrack_buffer(p->buffer);
+  glDeleteTextures(1, &p->texture);
+  glDeleteBuffers(1, &p->buffer);
+  delete p;
+}
+
+inline void palette_reset(JointPalette* p) {
+  p->count = 0;
+}
+
+// Claim room for joint_count matrices. Returns their offset, or -1 if
+// they don't fit. Filling claimed slices (palette_fill) is thread safe.
+inline int palette_reserve(JointPalette* p, size_t joint_count) {
+  if (!p || p->count + joint_count > p->capacity) {
+    return -1;
+  }
+  int offset = static_cast<int>(p->count);
+  p->count += joint_count;
+  return offset;
+}
+
+// Write a mesh's skinning matrices for ctx's current pose at offset,
+// unless the slice already holds exactly that
+inline void palette_fill(JointPalette* p, int offset, AnimationContext* ctx, const ozz::sample::Mesh& mesh) {
+  PaletteSlice& slice = p->slices[offset];
+  if (slice.ctx == ctx && slice.mesh == &mesh && slice.pose_version == ctx->pose_version) {
+    return;
+  }
+  ozz::math::Float4x4* out = p->matrices.data() + offset;
+  for (size_t i = 0; i < mesh.joint_remaps.size(); ++i) {
+    out[i] = ctx->models[mesh.joint_remaps[i]] * mesh.inverse_bind_poses[i];
+  }
+  slice.ctx = ctx;
+  slice.mesh = &mesh;
+  slice.pose_version = ctx->pose_version;
+  // Slices that started inside this one were overwritten
+  for (size_t i = 1; i < mesh.joint_remaps.size(); ++i) {
+    p->slices[offset + i] = PaletteSlice();
+  }
+  p->dirty.store(true, std::memory_order_relaxed);
+}
+
+// Append a mesh's skinning matrices for ctx's current pose.
+// Returns their offset in the palette, or -1 if they don't fit.
+inline int palette_append(
+  JointPalette* p,
+  AnimationContext* ctx,
+  ozz::vector<ozz::sample::Mesh>* meshes,
+  int mesh_index
+) {
+  if (!p || !ctx || !meshes || mesh_index < 0 || mesh_index >= static_cast<int>(meshes->size())) {
+    return -1;
+  }
+  const auto& mesh = (*meshes)[mesh_index];
+  int offset = palette_reserve(p, mesh.joint_remaps.size());
+  if (offset >= 0) {
+    palette_fill(p, offset, ctx, mesh);
+  }
+  return offset;
+}
+
+// Upload this frame's matrices. The store is orphaned first so the driver
+// hands back fresh memory instead of waiting on last frame's draws.
+// Skipped when every slice is as last uploaded.
+inline void palette_upload(JointPalette* p) {
+  if (!p->dirty.load(std::memory_order_relaxed) && p->count == p->uploaded_count) {
+    return;
+  }
+  p->dirty.store(false, std::memory_order_relaxed);
+  p->uploaded_count = p->count;
+  eglstate::bind_buffer(GL_TEXTURE_BUFFER, p->buffer);
+  glBufferData(GL_TEXTURE_BUFFER, p->capacity * sizeof(ozz::math::Float4x4), nullptr, GL_STREAM_DRAW);
+  if (p->count > 0) {
+    wrap_glBufferSubData(GL_TEXTURE_BUFFER, 0, p->count * sizeof(ozz::math::Float4x4), p->matrices.data());
+  }
+  eglstate::bind_buffer(GL_TEXTURE_BUFFER, 0);
+}
+
+// Bind the palette to texture_unit and switch shader (in use) to palette mode
+inline void palette_bind(JointPalette* p, GLuint shader, int texture_unit) {
+  eglstate::active_texture(GL_TEXTURE0 + texture_unit);
+  eglstate::bind_texture(GL_TEXTURE_BUFFER, p->texture);
+  glUniform1i(eshaders::uniform_location(shader, "uJointPalette"), texture_unit);
+  glUniform1i(eshaders::uniform_location(shader, "uUsePalette"), 1);
+  p->offset_location = eshaders::uniform_location(shader, "uPaletteOffset");
+}
+
+inline void palette_set_offset(JointPalette* p, int offset) {
+  glUniform1i(p->offset_location, offset);
+}
+
+// Back to per-draw uBoneMatrices uploads on shader (in use)
+inline void palette_unbind(GLuint shader) {
+  glUniform1i(eshaders::uniform_location(shader, "uUsePalette"), 0);
+}
+
+inline int palette_count(JointPalette* p) {
+  return static_cast<int>(p->count);
+}
+
+// ============ SKELETON LINES ============
+// Line skeletons drawn straight from the palette. palette_append_joints
+// writes a context's joint model matrices (not skinning matrices) into the
+// palette, and a skeleton's bones are a static GL_UNSIGNED_SHORT index
+// buffer of (parent, child) joint pairs. With uUsePalette set,
+// line_vertex.glsl takes each vertex's position from the translation of
+// joint gl_VertexID at uPaletteOffset, so nothing is rebuilt or streamed
+// per character per frame.
+
+// Append ctx's joint model matrices for its current pose. Returns their
+// offset, or -1 if they don't fit. A slice already holding this pose is
+// left as it is.
+inline int palette_append_joints(JointPalette* p, AnimationContext* ctx) {
+  if (!p || !ctx || ctx->models.empty()) {
+    return -1;
+  }
+  size_t joint_count = ctx->models.size();
+  int offset = palette_reserve(p, joint_count);
+  if (offset < 0) {
+    return -1;
+  }
+  PaletteSlice& slice = p->slices[offset];
+  // mesh == nullptr marks a joint slice
+  if (slice.ctx == ctx && slice.mesh == nullptr && slice.pose_version == ctx->pose_version) {
+    return offset;
+  }
+  std::memcpy(p->matrices.data() + offset, ctx->models.data(),
+              joint_count * sizeof(ozz::math::Float4x4));
+  slice.ctx = ctx;
+  slice.mesh = nullptr;
+  slice.pose_version = ctx->pose_version;
+  for (size_t i = 1; i < joint_count; ++i) {
+    p->slices[offset + i] = PaletteSlice();
+  }
+  p->dirty.store(true, std::memory_order_relaxed);
+  return offset;
+}
+
+// Build a VAO holding only an index buffer of ctx's skeleton's bones, with
+// the same bones build_skeleton_lines emits. Returns the index count (two
+// per bone) and the VAO and EBO through the output parameters. The same
+// buffer is also the per-instance joint pair (location 3, aJoints) for
+// line_quad_vertex.glsl: draw 4-vertex strips, one instance per bone.
+inline int create_skeleton_lines(AnimationContext* ctx, GLuint* vao_out, GLuint* ebo_out) {
+  *vao_out = 0;
+  *ebo_out = 0;
+  if (!ctx || !ctx->skeleton) return 0;
+  auto parents = ctx->skeleton->joint_parents();
+  std::vector<GLushort> indices;
+  for (int i = 0; i < ctx->skeleton->num_joints(); ++i) {
+    int parent = parents[i];
+    if (parent <= 0) continue;  // Root, and bones hanging off model_root
+    indices.push_back(static_cast<GLushort>(parent));
+    indices.push_back(static_cast<GLushort>(i));
+  }
+  GLuint vao, ebo;
+  glGenVertexArrays(1, &vao);
+  glGenBuffers(1, &ebo);
+  eglstate::bind_vertex_array(vao);
+  eglstate::bind_buffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLushort), indices.data(),
+               GL_STATIC_DRAW);
+  eglstate::bind_buffer(GL_ARRAY_BUFFER, ebo);
+  glVertexAttribIPointer(3, 2, GL_UNSIGNED_SHORT, 2 * sizeof(GLushort), (void*)0);
+  glEnableVertexAttribArray(3);
+  glVertexAttribDivisor(3, 1);
+  eglstate::bind_vertex_array(0);
+  *vao_out = vao;
+  *ebo_out = ebo;
+  return static_cast<int>(indices.size());
+}
+
+inline void destroy_skeleton_lines(GLuint vao, GLuint ebo) {
+  eglstate::forget_vertex_array(vao);
+  eglstate::forget_buffer(ebo);
+  glDeleteBuffers(1, &ebo);
+  glDeleteVertexArrays(1, &vao);
+}
+
+// ============ INSTANCED SKINNED DRAWS ============
+// Every character sharing one skinned mesh in a single glDrawElementsInstanced.
+// A batch owns an instance buffer attached to the mesh's VAO: per instance a
+// model matrix (divisor-1 attributes 5-8, aInstanceModel) and that
+// character's palette offset (attribute 9, aInstancePaletteOffset).
+// skinned_vertex.glsl takes those instead of model / uPaletteOffset while
+// uInstanced is set.
+//
+// Per frame, after the palette is appended and uploaded: instance_batch_reset,
+// instance_batch_add per character, then palette_bind and instance_batch_draw.
+
+const GLuint INSTANCE_MODEL_ATTRIB = 5;    // 5-8: one vec4 column each
+const GLuint INSTANCE_OFFSET_ATTRIB = 9;
+
+struct SkinnedInstance {
+  float model[16];       // Column-major
+  GLint palette_offset;
+};
+
+struct SkinnedInstanceBatch {
+  GLuint vao = 0;
+  GLuint buffer = 0;
+  GLsizei index_count = 0;                 // Of the mesh's GL_UNSIGNED_SHORT EBO
+  size_t capacity = 0;                     // Instances the buffer holds
+  std::vector<SkinnedInstance> instances;  // This frame's, CPU staging
+};
+
+// vao is a create-skinned-vao VAO; its index buffer stays as it is
+inline SkinnedInstanceBatch* create_instance_batch(GLuint vao, int index_count, int max_instances) {
+  SkinnedInstanceBatch* b = new SkinnedInstanceBatch();
+  b->vao = vao;
+  b->index_count = index_count;
+  b->capacity = max_instances > 0 ? static_cast<size_t>(max_instances) : 1;
+  b->instances.reserve(b->capacity);
+  glGenBuffers(1, &b->buffer);
+  eglstate::bind_vertex_array(vao);
+  eglstate::bind_buffer(GL_ARRAY_BUFFER, b->buffer);
+  // Sized up front so plain draws of this VAO read instance 0 in bounds
+  glBufferData(GL_ARRAY_BUFFER, b->capacity * sizeof(SkinnedInstance), nullptr, GL_STREAM_DRAW);
+  ememtrack::track_buffer(b->buffer, ememtrack::CAT_GL_STREAMS,
+                          (int64_t)(b->capacity * sizeof(SkinnedInstance)));
+  for (GLuint i = 0; i < 4; ++i) {
+    GLuint attrib = INSTANCE_MODEL_ATTRIB + i;
+    glVertexAttribPointer(attrib, 4, GL_FLOAT, GL_FALSE, sizeof(SkinnedInstance),
+                          (void*)(offsetof(SkinnedInstance, model) + i * 4 * sizeof(float)));
+    glEnableVertexAttribArray(attrib);
+    glVertexAttribDivisor(attrib, 1);
+  }
+  glVertexAttribIPointer(INSTANCE_OFFSET_ATTRIB, 1, GL_INT, sizeof(SkinnedInstance),
+                         (void*)offsetof(SkinnedInstance, palette_offset));
+  glEnableVertexAttribArray(INSTANCE_OFFSET_ATTRIB);
+  glVertexAttribDivisor(INSTANCE_OFFSET_ATTRIB, 1);
+  return b;
+}
+
+// Frees the instance buffer; the mesh VAO belongs to its creator
+inline void destroy_instance_batch(SkinnedInstanceBatch* b) {
+  if (!b) return;
+  eglstate::forget_buffer(b->buffer);
+  ememtrack::untrack_buffer(b->buffer);
+  glDeleteBuffers(1, &b->buffer);
+  delete b;
+}
+
+inline void instance_batch_reset(SkinnedInstanceBatch* b) {
+  b->instances.clear();
+}
+
+// Add an instance with a full model matrix. False once the batch is full.
+inline bool instance_batch_add(SkinnedInstanceBatch* b, const float* model, int palette_offset) {
+  if (b->instances.size() >= b->capacity || palette_offset < 0) {
+    return false;
+  }
+  SkinnedInstance inst;
+  std::memcpy(inst.model, model, sizeof(inst.model));
+  inst.palette_offset = palette_offset;
+  b->instances.push_back(inst);
+  return true;
+}
+
+// Add an instance standing at (x, y, z), turned yaw_degrees about +Y
+inline bool instance_batch_add_placed(SkinnedInstanceBatch* b, float x, float y, float z,
+                                      float yaw_degrees, int palette_offset) {
+  float a = yaw_degrees * 0.017453292519943295f;
+  float c = std::cos(a), s = std::sin(a);
+  const float model[16] = {
+    c,    0.0f, -s,   0.0f,
+    0.0f, 1.0f, 0.0f, 0.0f,
+    s,    0.0f, c,    0.0f,
+    x,    y,    z,    1.0f,
+  };
+  return instance_batch_add(b, model, palette_offset);
+}
+
+inline int instance_batch_count(SkinnedInstanceBatch* b) {
+  return static_cast<int>(b->instances.size());
+}
+
+// Upload the frame's instances and draw them all. shader must be in use with
+// the palette bound (palette_bind); view and projection are its uniforms.
+inline void instance_batch_draw(SkinnedInstanceBatch* b, GLuint shader) {
+  if (b->instances.empty() || b->index_count == 0) return;
+  egltimer::Scope gpu(egltimer::PASS_WORLD);
+  eglstate::bind_vertex_array(b->vao);
+  eglstate::bind_buffer(GL_ARRAY_BUFFER, b->buffer);
+  // Orphan, as palette_upload does, so last frame's draws don't stall us
+  glBufferData(GL_ARRAY_BUFFER, b->capacity * sizeof(SkinnedInstance), nullptr, GL_STREAM_DRAW);
+  wrap_glBufferSubData(GL_ARRAY_BUFFER, 0, b->instances.size() * sizeof(SkinnedInstance),
+                       b->instances.data());
+  GLint instanced = eshaders::uniform_location(shader, "uInstanced");
+  glUniform1i(instanced, 1);
+  wrap_glDrawElementsInstanced(GL_TRIANGLES, b->index_count, GL_UNSIGNED_SHORT, (void*)0,
+                               static_cast<GLsizei>(b->instances.size()));
+  glUniform1i(instanced, 0);
+}
+
+} // namespace eanim
@@ -0,0 +1,399 @@
+#pragma once
+#include "cgltf.h"
+#include "level_bake.h"
+#include "engine/collision_impl.h"
+#include "engine/gltf_unpack_impl.h"
+#include "engine/pvs_impl.h"
+#include <glm/glm.hpp>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// ============ BAKED LEVELS ============
+// Loader for .level files (level_bake.h, written by tools/levelbake). The
+// file is mapped and its section table checked. Every range and index is
+// validated, then the arrays are copied out as they are: the collision
+// Bvh comes back finished, with no build_bvh, and render primitives come
+// back as the PrimitiveBuffers gltf/load uploads (a primitive's LOD
+// chain appended to its indices), and the PVS as an epvs::Pvs. A sectorized level's collision comes back as a piecewise Bvh
+// with a piece per sector; engine/level_stream_impl.h loads its sectors
+// one at a time instead.
+
+namespace elevel {
+
+const uint64_t FNV_OFFSET = 14695981039346656037ull;
+const uint64_t FNV_PRIME = 1099511628211ull;
+
+inline uint64_t fnv1a(uint64_t h, const unsigned char* p, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    h ^= p[i];
+    h *= FNV_PRIME;
+  }
+  return h;
+}
+
+inline bool hash_file(const std::string& path, uint64_t* h) {
+  FILE* f = fopen(path.c_str(), "rb");
+  if (!f) return false;
+  unsigned char buf[65536];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) *h = fnv1a(*h, buf, n);
+  fclose(f);
+  return true;
+}
+
+// FNV-1a over the .gltf and the buffer files it names; 0 if any is missing
+inline uint64_t source_hash(const char* gltf_path) {
+  cgltf_options options = {};
+  cgltf_data* data = nullptr;
+  if (cgltf_parse_file(&options, gltf_path, &data) != cgltf_result_success) return 0;
+  uint64_t h = FNV_OFFSET;
+  bool ok = hash_file(gltf_path, &h);
+  std::filesystem::path dir = std::filesystem::path(gltf_path).parent_path();
+  for (cgltf_size i = 0; ok && i < data->buffers_count; ++i) {
+    const char* uri = data->buffers[i].uri;
+    if (uri && std::strncmp(uri, "data:", 5) != 0) ok = hash_file((dir / uri).string(), &h);
+  }
+  cgltf_free(data);
+  return ok ? h : 0;
+}
+
+struct Level {
+  void* mapping = nullptr;
+  size_t size = 0;
+  const LevelHeader* header = nullptr;
+};
+
+inline void close_level(Level* l) {
+  if (!l) return;
+  if (l->mapping) munmap(l->mapping, l->size);
+  delete l;
+}
+
+template <typename T>
+inline const T* section(const Level* l, LevelSection s, size_t* count) {
+  const LevelSectionEntry& e = l->header->sections[s];
+  *count = (size_t)(e.size / sizeof(T));
+  return reinterpret_cast<const T*>(static_cast<const char*>(l->mapping) + e.offset);
+}
+
+inline bool indices_ok(const uint32_t* indices, size_t count, size_t vertex_count) {
+  for (size_t i = 0; i < count; ++i) {
+    if (indices[i] >= vertex_count) return false;
+  }
+  return true;
+}
+
+inline bool slice_ok(uint64_t first, uint64_t count, size_t total) {
+  return first <= total && count <= total - first;
+}
+
+// A collision mesh and its sub-tree: triangles over positions, tri_slot
+// into blocks, adj_offsets (tri_count + 1 of them, or none) into adj and
+// adj into the triangles, nodes into themselves and the blocks
+inline bool collision_ok(size_t positions, const uint32_t* idx, size_t indices,
+                         const ecol::BvhNode* node, size_t nodes, size_t blocks,
+                         const uint32_t* slot, size_t slots, const uint32_t* adj_off,
+                         size_t adj_offsets, const uint32_t* adj, size_t adj_list) {
+  size_t tri_count = indices / 3;
+  if (indices % 3 != 0 || !indices_ok(idx, indices, positions) ||
+      slots != tri_count || !indices_ok(slot, slots, blocks * 4) ||
+      (adj_offsets != 0 && adj_offsets != tri_count + 1) ||
+      !indices_ok(adj, adj_list, tri_count) || (tri_count > 0 && nodes == 0)) {
+    return false;
+  }
+  for (size_t i = 0; i + 1 < adj_offsets; ++i) {
+    if (adj_off[i] > adj_off[i + 1] || adj_off[i + 1] > adj_list) return false;
+  }
+  for (size_t i = 0; i < nodes; ++i) {
+    const ecol::BvhNode& n = node[i];
+    bool ok = n.count == 0 ? (size_t)n.left_first + 1 < nodes
+                           : (size_t)n.left_first + (n.count + 3) / 4 <= blocks;
+    if (!ok) return false;
+  }
+  return true;
+}
+
+// Check every section's range and element size, every primitive's slice
+// and every index against what it indexes
+inline bool validate_level(const Level* l) {
+  const LevelHeader& h = *l->header;
+  if (std::memcmp(h.magic, kLevelMagic, sizeof(h.magic)) != 0 || h.version != kLevelVersion ||
+      h.section_count != kLevelSectionCount) {
+    return false;
+  }
+  static const size_t ELEMENT_BYTES[kLevelSectionCount] = {
+      sizeof(glm::vec3), 4, sizeof(ecol::BvhNode), sizeof(ecol::Tri4), 4, 4, 4,
+      sizeof(Vertex), 4, sizeof(LevelPrimitive), sizeof(LevelPvsGrid), 1, sizeof(LevelSector),
+      sizeof(LevelLod)};
+  for (uint32_t s = 0; s < kLevelSectionCount; ++s) {
+    const LevelSectionEntry& e = h.sections[s];
+    if (e.offset > l->size || e.size > l->size - e.offset || e.size % ELEMENT_BYTES[s] != 0 ||
+        e.offset % kLevelAlign != 0) {
+      return false;
+    }
+  }
+
+  size_t positions, indices, nodes, tris, slots, adj_offsets, adj_list, sectors, primitives;
+  section<glm::vec3>(l, kLevelCollisionPositions, &positions);
+  const uint32_t* idx = section<uint32_t>(l, kLevelCollisionIndices, &indices);
+  const ecol::BvhNode* node = section<ecol::BvhNode>(l, kLevelBvhNodes, &nodes);
+  section<ecol::Tri4>(l, kLevelBvhTris, &tris);
+  const uint32_t* slot = section<uint32_t>(l, kLevelBvhTriSlot, &slots);
+  const uint32_t* adj_off = section<uint32_t>(l, kLevelBvhAdjOffsets, &adj_offsets);
+  const uint32_t* adj = section<uint32_t>(l, kLevelBvhAdjList, &adj_list);
+  const LevelSector* sector = section<LevelSector>(l, kLevelSectors, &sectors);
+  section<LevelPrimitive>(l, kLevelPrimitives, &primitives);
+  if (sectors == 0 && !collision_ok(positions, idx, indices, node, nodes, tris, slot, slots,
+                                    adj_off, adj_offsets, adj, adj_list)) {
+    return false;
+  }
+  for (size_t i = 0; i < sectors; ++i) {
+    const LevelSector& c = sector[i];
+    uint64_t tri_first = c.index_first / 3, tri_count = c.index_count / 3;
+    if (c.index_first % 3 != 0 || c.index_count % 3 != 0 ||
+        !slice_ok(c.primitive_first, c.primitive_count, primitives) ||
+        !slice_ok(c.position_first, c.position_count, positions) ||
+        !slice_ok(c.index_first, c.index_count, indices) ||
+        !slice_ok(c.node_first, c.node_count, nodes) ||
+        !slice_ok(c.block_first, c.block_count, tris) ||
+        !slice_ok(tri_first, tri_count, slots) ||
+        !slice_ok(c.adj_offset_first, tri_count + 1, adj_offsets) ||
+        !slice_ok(c.adj_first, c.adj_count, adj_list) ||
+        !collision_ok(c.position_count, idx + c.index_first, c.index_count, node + c.node_first,
+                      c.node_count, c.block_count, slot + tri_first, tri_count,
+                      adj_off + c.adj_offset_first, tri_count + 1, adj + c.adj_first,
+                      c.adj_count)) {
+      return false;
+    }
+  }
+
+  size_t vertices, render_indices, lods;
+  section<Vertex>(l, kLevelVertices, &vertices);
+  const uint32_t* ridx = section<uint32_t>(l, kLevelIndices, &render_indices);
+  const LevelPrimitive* prim = section<LevelPrimitive>(l, kLevelPrimitives, &primitives);
+  const LevelLod* lod = section<LevelLod>(l, kLevelLods, &lods);
+  for (size_t i = 0; i < primitives; ++i) {
+    const LevelPrimitive& p = prim[i];
+    if (p.vertex_first > vertices || p.vertex_count > vertices - p.vertex_first ||
+        p.index_first > render_indices || p.index_count > render_indices - p.index_first ||
+        !indices_ok(ridx + p.index_first, p.index_count, p.vertex_count) ||
+        !slice_ok(p.lod_first, p.lod_count, lods) ||
+        std::memchr(p.texture_uri, '\0', sizeof(p.texture_uri)) == nullptr) {
+      return false;
+    }
+    for (uint32_t k = 0; k < p.lod_count; ++k) {
+      const LevelLod& d = lod[p.lod_first + k];
+      if (!slice_ok(d.index_first, d.index_count, render_indices) || d.index_count % 3 != 0 ||
+          !indices_ok(ridx + d.index_first, d.index_count, p.vertex_count) ||
+          !(d.error >= 0.0f && d.error < HUGE_VALF)) {
+        return false;
+      }
+    }
+  }
+
+  size_t grids, pvs_bytes;
+  const LevelPvsGrid* grid = section<LevelPvsGrid>(l, kLevelPvsGrid, &grids);
+  section<uint8_t>(l, kLevelPvsBits, &pvs_bytes);
+  if (grids > 1) return false;
+  if (grids == 0) return pvs_bytes == 0;
+  uint64_t clusters = 1;
+  for (int k = 0; k < 3; ++k) {
+    if (grid->dims[k] == 0 || grid->dims[k] > (1u << 16)) return false;
+    clusters *= grid->dims[k];
+  }
+  return clusters <= (1u << 20) && grid->cell_size > 0.0f &&
+         grid->row_bytes == (clusters + 7) / 8 && pvs_bytes == clusters * grid->row_bytes;
+}
+
+// Map and validate a baked level; nullptr if missing, malformed or, when
+// source_path names a glTF that exists, baked from a different version of it
+inline Level* open_level(const char* path, const char* source_path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return nullptr;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(LevelHeader)) {
+    close(fd);
+    return nullptr;
+  }
+  void* mapping = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) return nullptr;
+
+  Level* l = new Level();
+  l->mapping = mapping;
+  l->size = (size_t)st.st_size;
+  l->header = static_cast<const LevelHeader*>(mapping);
+  if (l->header->version != kLevelVersion) {
+    std::cerr << "Old level format (rebake with build-assets): " << path << std::endl;
+    close_level(l);
+    return nullptr;
+  }
+  if (!validate_level(l)) {
+    std::cerr << "Malformed level: " << path << std::endl;
+    close_level(l);
+    return nullptr;
+  }
+  if (source_path && std::filesystem::exists(source_path) &&
+      source_hash(source_path) != l->header->source_hash) {
+    std::cerr << "Stale level (rebake with build-assets): " << path << std::endl;
+    close_level(l);
+    return nullptr;
+  }
+  return l;
+}
+
+template <typename T>
+inline void copy_section(const Level* l, LevelSection s, egc::atomic_vector<T>* out) {
+  size_t count;
+  const T* data = section<T>(l, s, &count);
+  out->assign(data, data + count);
+}
+
+template <typename T>
+inline void copy_slice(const Level* l, LevelSection s, size_t first, size_t count,
+                       egc::atomic_vector<T>* out) {
+  size_t total;
+  const T* data = section<T>(l, s, &total) + first;
+  out->assign(data, data + count);
+}
+
+inline int level_sector_count(const Level* l) {
+  size_t count;
+  section<LevelSector>(l, kLevelSectors, &count);
+  return (int)count;
+}
+
+inline const LevelSector* level_sector(const Level* l, int i) {
+  size_t count;
+  return section<LevelSector>(l, kLevelSectors, &count) + i;
+}
+
+// Sector i's collision mesh and its sub-tree, every id local to the sector,
+// for ecol::bvh_splice_piece / bvh_add_built_piece. Fills positions and
+// indices; nullptr if the sector has no collision. Reads only the mapping,
+// so any thread may call it while the level is open.
+inline ecol::Bvh* sector_collision(const Level* l, int i, ecol::Positions* positions,
+                                   ecol::Indices* indices) {
+  const LevelSector& c = *level_sector(l, i);
+  if (c.index_count == 0) return nullptr;
+  uint32_t tri_count = c.index_count / 3;
+  copy_slice(l, kLevelCollisionPositions, c.position_first, c.position_count, positions);
+  copy_slice(l, kLevelCollisionIndices, c.index_first, c.index_count, indices);
+  ecol::Bvh* bvh = new ecol::Bvh();
+  copy_slice(l, kLevelBvhNodes, c.node_first, c.node_count, &bvh->nodes);
+  copy_slice(l, kLevelBvhTris, c.block_first, c.block_count, &bvh->tris);
+  copy_slice(l, kLevelBvhTriSlot, c.index_first / 3, tri_count, &bvh->tri_slot);
+  copy_slice(l, kLevelBvhAdjOffsets, c.adj_offset_first, tri_count + 1, &bvh->adj_offsets);
+  copy_slice(l, kLevelBvhAdjList, c.adj_first, c.adj_count, &bvh->adj_list);
+  ecol::bvh_account(bvh);
+  return bvh;
+}
+
+// Every sector as a piece of one piecewise Bvh (the whole level, for the
+// server and clients that don't stream)
+inline ecol::Bvh* level_sector_collision(const Level* l, ecol::Positions* positions,
+                                         ecol::Indices* indices) {
+  ecol::Bvh* bvh = ecol::create_piece_bvh();
+  ecol::Positions piece_positions;
+  ecol::Indices piece_indices;
+  for (int i = 0; i < level_sector_count(l); ++i) {
+    ecol::Bvh* sub = sector_collision(l, i, &piece_positions, &piece_indices);
+    if (!sub) continue;
+    ecol::bvh_splice_piece(bvh, positions, indices, ecol::bvh_alloc_piece(bvh), &piece_positions,
+                           &piece_indices, sub);
+    ecol::destroy_bvh(sub);
+  }
+  if (bvh->live_tris == 0) {
+    ecol::destroy_bvh(bvh);
+    return nullptr;
+  }
+  ecol::bvh_build_top(bvh, positions, indices);
+  return bvh;
+}
+
+// The collision mesh as prepare-collision-buffers would build it. Fills
+// positions and indices; nullptr if the level has no collision.
+inline ecol::Bvh* level_collision(const Level* l, ecol::Positions* positions,
+                                  ecol::Indices* indices) {
+  if (l->header->sections[kLevelCollisionIndices].size == 0) return nullptr;
+  if (level_sector_count(l) > 0) return level_sector_collision(l, positions, indices);
+  copy_section(l, kLevelCollisionPositions, positions);
+  copy_section(l, kLevelCollisionIndices, indices);
+  ecol::Bvh* bvh = new ecol::Bvh();
+  copy_section(l, kLevelBvhNodes, &bvh->nodes);
+  copy_section(l, kLevelBvhTris, &bvh->tris);
+  copy_section(l, kLevelBvhTriSlot, &bvh->tri_slot);
+  copy_section(l, kLevelBvhAdjOffsets, &bvh->adj_offsets);
+  copy_section(l, kLevelBvhAdjList, &bvh->adj_list);
+  ecol::bvh_account(bvh);
+  return bvh;
+}
+
+// The level's PVS; nullptr if it has none. Free with epvs::destroy_pvs.
+inline epvs::Pvs* level_pvs(const Level* l) {
+  size_t grids, bytes;
+  const LevelPvsGrid* grid = section<LevelPvsGrid>(l, kLevelPvsGrid, &grids);
+  if (grids == 0) return nullptr;
+  const uint8_t* bits = section<uint8_t>(l, kLevelPvsBits, &bytes);
+  epvs::Pvs* p = new epvs::Pvs();
+  p->grid = *grid;
+  p->bits.assign(bits, bits + bytes);
+  return p;
+}
+
+inline int level_primitive_count(const Level* l) {
+  size_t count;
+  section<LevelPrimitive>(l, kLevelPrimitives, &count);
+  return (int)count;
+}
+
+inline const LevelPrimitive* level_primitive(const Level* l, int i) {
+  size_t count;
+  return section<LevelPrimitive>(l, kLevelPrimitives, &count) + i;
+}
+
+// LOD k (0 for the first coarser one) of primitive i
+inline const LevelLod* level_lod(const Level* l, int i, int k) {
+  size_t count;
+  return section<LevelLod>(l, kLevelLods, &count) + level_primitive(l, i)->lod_first + k;
+}
+
+// Indices primitive i's buffers carry: its own, then each LOD's
+inline size_t primitive_index_total(const Level* l, int i) {
+  const LevelPrimitive& p = *level_primitive(l, i);
+  size_t total = p.index_count;
+  for (uint32_t k = 0; k < p.lod_count; ++k) total += level_lod(l, i, (int)k)->index_count;
+  return total;
+}
+
+// Primitive i's vertices and indices, LOD chain appended in order, for
+// gltf load (which frees them)
+inline egltf::PrimitiveBuffers* level_primitive_buffers(const Level* l, int i) {
+  const LevelPrimitive& p = *level_primitive(l, i);
+  size_t count;
+  const Vertex* vertices = section<Vertex>(l, kLevelVertices, &count) + p.vertex_first;
+  const uint32_t* indices = section<uint32_t>(l, kLevelIndices, &count);
+  egltf::PrimitiveBuffers* b = new egltf::PrimitiveBuffers();
+  b->vertices.assign(vertices, vertices + p.vertex_count);
+  b->indices.reserve(primitive_index_total(l, i));
+  b->indices.assign(indices + p.index_first, indices + p.index_first + p.index_count);
+  for (uint32_t k = 0; k < p.lod_count; ++k) {
+    const LevelLod& d = *level_lod(l, i, (int)k);
+    b->indices.insert(b->indices.end(), indices + d.index_first,
+                      indices + d.index_first + d.index_count);
+  }
+  std::memcpy(b->min, p.bounds_min, sizeof(b->min));
+  std::memcpy(b->max, p.bounds_max, sizeof(b->max));
+  return b;
+}
+
+} // namespace elevel
@@ -0,0 +1,339 @@
+#pragma once
+#include "level_bake.h"
+#include "engine/collision_impl.h"
+#include "engine/gltf_unpack_impl.h"
+#include "engine/level_impl.h"
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// ============ LEVEL STREAMING ============
+// Pages a sectorized level's sectors (level_bake.h) in and out around a
+// focus point instead of loading the whole level up front. The .level
+// stays mapped while streaming. A worker thread copies a wanted sector's
+// render primitives and collision sub-tree out of the mapping, so the
+// page faults and copies land there rather than on the frame. The main
+// thread takes finished sectors with take_loaded, uploads their
+// primitives and later frees them for the sectors take_evicted hands back.
+//
+// Sector collision goes into one piecewise Bvh, a piece per resident
+// sector (ecol::bvh_add_built_piece). The thread that queries it (the
+// client's prediction) may not be the main thread, so splices and
+// removals are queued and applied by sync_collision on that thread
+// between queries; the mesh never changes under a query.
+//
+// Sectors within radius of the focus (on x/z, to their bounds) are wanted,
+// nearest first, while their footprint fits the budget. A resident sector
+// stays until it is radius + margin away or a nearer one needs its share
+// of the budget, so a player on a border doesn't page it in and out. The
+// footprint is estimated from the baked sizes: the collision arrays as
+// copied and the render vertices and indices before upload packs them.
+//
+// Everything but the worker and sync_collision runs on the thread that
+// made the stream.
+
+namespace estream {
+
+const int SECTOR_UNLOADED = 0;
+const int SECTOR_QUEUED = 1;       // Waiting for or on the worker
+const int SECTOR_RESIDENT = 2;     // Taken: primitives with the caller, collision queued or in
+
+// A sector as the worker copied it out
+struct SectorData {
+  int sector = -1;
+  ecol::Positions positions;
+  ecol::Indices indices;
+  ecol::Bvh* bvh = nullptr;        // Local sub-tree; nullptr without collision
+  std::vector<egltf::PrimitiveBuffers*> primitives;
+};
+
+struct Stream {
+  elevel::Level* level = nullptr;
+  int sector_count = 0;
+  std::vector<int> state;
+  std::vector<int> piece;          // Collision piece handle while in the mesh, else -1 (sync_collision's)
+  std::vector<size_t> bytes;       // Estimated footprint
+  size_t budget = 0;
+  size_t committed = 0;            // Footprint of queued and resident sectors
+  float radius = 0.0f;
+  float margin = 0.0f;
+  // Resident collision, edited in place as sectors come and go
+  ecol::Positions* positions = nullptr;
+  ecol::Indices* indices = nullptr;
+  ecol::Bvh* bvh = nullptr;
+  std::vector<int> evicted;        // Resident sectors dropped since take_evicted
+  std::vector<std::pair<float, int>> order;  // Scratch for focus
+
+  std::thread worker;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::deque<int> jobs;            // Sectors to copy out, nearest first
+  std::deque<SectorData*> loaded;
+  bool stopping = false;
+
+  // Collision edits for sync_collision: a sector's collision to splice
+  // in, or nullptr to take the sector out
+  std::mutex collision_mutex;
+  std::vector<std::pair<int, SectorData*>> collision_ops;
+};
+
+inline void free_sector_data(SectorData* d) {
+  if (!d) return;
+  if (d->bvh) ecol::destroy_bvh(d->bvh);
+  for (egltf::PrimitiveBuffers* b : d->primitives) {
+    if (b) egltf::free_primitive_buffers(b);
+  }
+  delete d;
+}
+
+inline size_t sector_bytes(const elevel::Level* l, int i) {
+  const LevelSector& c = *elevel::level_sector(l, i);
+  size_t bytes = (size_t)c.position_count * sizeof(glm::vec3) + (size_t)c.index_count * 4 +
+                 (size_t)c.node_count * sizeof(ecol::BvhNode) +
+                 (size_t)c.block_count * sizeof(ecol::Tri4) + (size_t)c.index_count / 3 * 8 +
+                 (size_t)c.adj_count * 4;
+  for (uint32_t k = 0; k < c.primitive_count; ++k) {
+    const LevelPrimitive& p = *elevel::level_primitive(l, (int)(c.primitive_first + k));
+    bytes += (size_t)p.vertex_count * sizeof(Vertex) +
+             elevel::primitive_index_total(l, (int)(c.primitive_first + k)) * 4;
+  }
+  return bytes;
+}
+
+// Distance on x/z from (x, z) to sector i's bounds; 0 inside
+inline float sector_distance(const elevel::Level* l, int i, float x, float z) {
+  const LevelSector& c = *elevel::level_sector(l, i);
+  float dx = std::max(std::max(c.bounds_min[0] - x, x - c.bounds_max[0]), 0.0f);
+  float dz = std::max(std::max(c.bounds_min[2] - z, z - c.bounds_max[2]), 0.0f);
+  return std::sqrt(dx * dx + dz * dz);
+}
+
+inline void stream_worker(Stream* s) {
+  for (;;) {
+    int sector;
+    {
+      std::unique_lock<std::mutex> lock(s->mutex);
+      s->wake.wait(lock, [&] { return s->stopping || !s->jobs.empty(); });
+      if (s->stopping) return;
+      sector = s->jobs.front();
+      s->jobs.pop_front();
+    }
+    SectorData* d = new SectorData();
+    d->sector = sector;
+    d->bvh = elevel::sector_collision(s->level, sector, &d->positions, &d->indices);
+    const LevelSector& c = *elevel::level_sector(s->level, sector);
+    for (uint32_t k = 0; k < c.primitive_count; ++k) {
+      d->primitives.push_back(
+          elevel::level_primitive_buffers(s->level, (int)(c.primitive_first + k)));
+    }
+    std::lock_guard<std::mutex> lock(s->mutex);
+    s->loaded.push_back(d);
+  }
+}
+
+// Open a sectorized level for streaming; nullptr if it is missing,
+// malformed, stale (as elevel::open_level) or has no sectors. Nothing is
+// resident until the first focus.
+inline Stream* open_stream(const char* path, const char* source_path, double budget_bytes,
+                           float radius, float margin) {
+  elevel::Level* l = elevel::open_level(path, source_path);
+  if (!l) return nullptr;
+  if (elevel::level_sector_count(l) == 0) {
+    elevel::close_level(l);
+    return nullptr;
+  }
+  Stream* s = new Stream();
+  s->level = l;
+  s->sector_count = elevel::level_sector_count(l);
+  s->state.assign(s->sector_count, SECTOR_UNLOADED);
+  s->piece.assign(s->sector_count, -1);
+  for (int i = 0; i < s->sector_count; ++i) s->bytes.push_back(sector_bytes(l, i));
+  s->budget = budget_bytes > 0.0 ? (size_t)budget_bytes : 0;
+  s->radius = radius;
+  s->margin = margin;
+  s->positions = new ecol::Positions();
+  s->indices = new ecol::Indices();
+  s->bvh = ecol::create_piece_bvh();
+  s->worker = std::thread(stream_worker, s);
+  return s;
+}
+
+inline void queue_collision(Stream* s, int sector, SectorData* d) {
+  std::lock_guard<std::mutex> lock(s->collision_mutex);
+  s->collision_ops.push_back({sector, d});
+}
+
+inline void unload_sector(Stream* s, int i) {
+  if (s->state[i] == SECTOR_RESIDENT) {
+    queue_collision(s, i, nullptr);
+    s->evicted.push_back(i);
+  }
+  s->state[i] = SECTOR_UNLOADED;
+  s->committed -= s->bytes[i];
+}
+
+// Move the focus to (x, z): queue the wanted sectors nearest first and
+// drop the ones no longer kept. Cheap enough to call every frame.
+inline void focus(Stream* s, float x, float z) {
+  s->order.clear();
+  for (int i = 0; i < s->sector_count; ++i) {
+    float d = sector_distance(s->level, i, x, z);
+    if (d <= s->radius + s->margin || s->state[i] != SECTOR_UNLOADED) s->order.push_back({d, i});
+  }
+  std::sort(s->order.begin(), s->order.end());
+
+  // Keep what fits, nearest first; the nearest always fits
+  std::vector<char> keep(s->sector_count, 0);
+  size_t total = 0;
+  for (const auto& [d, i] : s->order) {
+    bool wanted = d <= s->radius || (s->state[i] != SECTOR_UNLOADED && d <= s->radius + s->margin);
+    if (!wanted) continue;
+    if (total > 0 && s->budget > 0 && total + s->bytes[i] > s->budget) continue;
+    keep[i] = 1;
+    total += s->bytes[i];
+  }
+
+  for (const auto& [d, i] : s->order) {
+    if (!keep[i] && s->state[i] != SECTOR_UNLOADED) unload_sector(s, i);
+    if (keep[i] && s->state[i] == SECTOR_UNLOADED) {
+      s->state[i] = SECTOR_QUEUED;
+      s->committed += s->bytes[i];
+    }
+  }
+  bool any = false;
+  {
+    std::lock_guard<std::mutex> lock(s->mutex);
+    s->jobs.clear();
+    for (const auto& [d, i] : s->order) {
+      if (s->state[i] == SECTOR_QUEUED) s->jobs.push_back(i);
+    }
+    any = !s->jobs.empty();
+  }
+  if (any) s->wake.notify_one();
+}
+
+// The next sector the worker finished that is still wanted, its collision
+// queued for sync_collision; nullptr when none is ready. The caller takes
+// the primitive buffers it wants (sector_data_take_primitive) and frees
+// the rest with free_sector_data.
+inline SectorData* take_loaded(Stream* s) {
+  for (;;) {
+    SectorData* d;
+    {
+      std::lock_guard<std::mutex> lock(s->mutex);
+      if (s->loaded.empty()) return nullptr;
+      d = s->loaded.front();
+      s->loaded.pop_front();
+    }
+    // Dropped or already taken while the worker had it
+    if (s->state[d->sector] != SECTOR_QUEUED) {
+      free_sector_data(d);
+      continue;
+    }
+    if (d->bvh) {
+      SectorData* c = new SectorData();
+      c->sector = d->sector;
+      c->positions.swap(d->positions);
+      c->indices.swap(d->indices);
+      c->bvh = d->bvh;
+      d->bvh = nullptr;
+      queue_collision(s, d->sector, c);
+    }
+    s->state[d->sector] = SECTOR_RESIDENT;
+    return d;
+  }
+}
+
+// Apply the queued collision edits. Call on the thread that queries the
+// mesh, between queries. Returns how many were applied.
+inline int sync_collision(Stream* s) {
+  std::vector<std::pair<int, SectorData*>> ops;
+  {
+    std::lock_guard<std::mutex> lock(s->collision_mutex);
+    if (s->collision_ops.empty()) return 0;
+    ops.swap(s->collision_ops);
+  }
+  for (auto& [sector, d] : ops) {
+    if (s->piece[sector] >= 0) {
+      ecol::bvh_remove_piece(s->bvh, s->positions, s->indices, s->piece[sector]);
+      s->piece[sector] = -1;
+    }
+    if (d) {
+      s->piece[sector] = ecol::bvh_add_built_piece(s->bvh, s->positions, s->indices,
+                                                   &d->positions, &d->indices, d->bvh);
+      free_sector_data(d);
+    }
+  }
+  return (int)ops.size();
+}
+
+// A resident sector dropped since the last call, whose primitives the
+// caller should free; -1 when there are none
+inline int take_evicted(Stream* s) {
+  if (s->evicted.empty()) return -1;
+  int i = s->evicted.back();
+  s->evicted.pop_back();
+  return i;
+}
+
+inline int sector_data_sector(SectorData* d) { return d->sector; }
+
+inline int sector_data_primitive_count(SectorData* d) { return (int)d->primitives.size(); }
+
+// The level primitive index of d's k-th primitive
+inline int sector_data_primitive_index(Stream* s, SectorData* d, int k) {
+  return (int)elevel::level_sector(s->level, d->sector)->primitive_first + k;
+}
+
+// Hand d's k-th primitive buffers to the caller (gltf load frees them)
+inline egltf::PrimitiveBuffers* sector_data_take_primitive(SectorData* d, int k) {
+  egltf::PrimitiveBuffers* b = d->primitives[k];
+  d->primitives[k] = nullptr;
+  return b;
+}
+
+inline int resident_count(Stream* s) {
+  return (int)std::count(s->state.begin(), s->state.end(), SECTOR_RESIDENT);
+}
+
+inline int queued_count(Stream* s) {
+  return (int)std::count(s->state.begin(), s->state.end(), SECTOR_QUEUED);
+}
+
+inline double committed_bytes(Stream* s) { return (double)s->committed; }
+
+inline elevel::Level* stream_level(Stream* s) { return s->level; }
+
+inline ecol::Positions* stream_positions(Stream* s) { return s->positions; }
+
+inline ecol::Indices* stream_indices(Stream* s) { return s->indices; }
+
+inline ecol::Bvh* stream_bvh(Stream* s) { return s->bvh; }
+
+// Stop the worker and free everything but the resident primitives, which
+// the caller frees (every sector it took and hasn't seen evicted). Nothing
+// may be querying the collision mesh.
+inline void close_stream(Stream* s) {
+  if (!s) return;
+  {
+    std::lock_guard<std::mutex> lock(s->mutex);
+    s->stopping = true;
+    s->jobs.clear();
+  }
+  s->wake.notify_all();
+  if (s->worker.joinable()) s->worker.join();
+  for (SectorData* d : s->loaded) free_sector_data(d);
+  for (auto& [sector, d] : s->collision_ops) free_sector_data(d);
+  ecol::destroy_bvh(s->bvh);
+  delete s->positions;
+  delete s->indices;
+  elevel::close_level(s->level);
+  delete s;
+}
+
+} // namespace estream
@@ -1,26 +1,80 @@
 #pragma once
 #include "gl_wrappers.h"
+#include "engine/gl_state_impl.h"
+#include "engine/gl_stream_impl.h"
+#include <cstdlib>
+#include <cstring>
 
 namespace elines {
-// Create line VAO and VBO, returns them via output parameters
-inline void create_line_vao(int max_lines, unsigned int* vao_out, unsigned int* vbo_out) {
-  GLuint vao, vbo;
+const size_t LINE_VERTEX_BYTES = 3 * sizeof(float);
+
+// Whether lines are drawn as instanced quads (line_quad_vertex.glsl, one
+// instance per line) rather than expanded by line_geometry.glsl. The
+// geometry path stays on NVIDIA's and AMD's own desktop drivers, where it
+// is as fast; Mesa, Apple's GL-over-Metal and the mobile drivers run
+// geometry shaders slowly or emulate them. ENGINE_LINE_QUADS=1 or 0
+// forces either. Needs a current context the first time.
+inline bool use_line_quads() {
+  static int quads = -1;
+  if (quads < 0) {
+    const char* env = std::getenv("ENGINE_LINE_QUADS");
+    if (env && *env) {
+      quads = std::strcmp(env, "0") != 0;
+    } else {
+      const char* vendor = (const char*)glGetString(GL_VENDOR);
+      const char* version = (const char*)glGetString(GL_VERSION);
+      bool mesa = version && std::strstr(version, "Mesa");
+      bool desktop = vendor && (std::strstr(vendor, "NVIDIA") || std::strstr(vendor, "ATI") ||
+                                std::strstr(vendor, "AMD"));
+      quads = mesa || !desktop;
+    }
+  }
+  return quads == 1;
+}
+
+// Create a line VAO reading from the shared streaming buffer: per vertex
+// at location 0 for the geometry path, per line (start and end, divisor 1)
+// at locations 1 and 2 for the quad path
+inline unsigned int create_line_vao() {
+  GLuint vao;
   glGenVertexArrays(1, &vao);
-  glGenBuffers(1, &vbo);
-  glBindVertexArray(vao);
-  glBindBuffer(GL_ARRAY_BUFFER, vbo);
-  glBufferData(GL_ARRAY_BUFFER, max_lines * 6 * sizeof(float), nullptr, GL_DYNAMIC_DRAW);
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+  eglstate::bind_vertex_array(vao);
+  eglstate::bind_buffer(GL_ARRAY_BUFFER, eglstream::shared_buffer());
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, LINE_VERTEX_BYTES, (void*)0);
   glEnableVertexAttribArray(0);
-  glBindVertexArray(0);
-  *vao_out = vao;
-  *vbo_out = vbo;
+  for (GLuint i = 1; i <= 2; ++i) {
+    glVertexAttribPointer(i, 3, GL_FLOAT, GL_FALSE, 2 * LINE_VERTEX_BYTES,
+                          (void*)((i - 1) * LINE_VERTEX_BYTES));
+    glEnableVertexAttribArray(i);
+    glVertexAttribDivisor(i, 1);
+  }
+  eglstate::bind_vertex_array(0);
+  return vao;
+}
+
+// Stream line vertices (6 floats per line) for the next draw. Returns the
+// first vertex to draw from, or -1 if they don't fit.
+inline int stream_lines(const float* vertices, int line_count) {
+  if (line_count <= 0) return -1;
+  return eglstream::shared_vertices(vertices, line_count * 2 * LINE_VERTEX_BYTES, LINE_VERTEX_BYTES);
 }
 
-// Update line VBO with vertex data
-inline void update_line_vbo(unsigned int vbo, float* vertices, int line_count) {
-  glBindBuffer(GL_ARRAY_BUFFER, vbo);
-  glBufferSubData(GL_ARRAY_BUFFER, 0, line_count * 6 * sizeof(float), vertices);
+// Draw line_count streamed lines from first_vertex with the bound line
+// VAO, as GL_LINES or, under use_line_quads, as instanced quads: the
+// per-line attributes are re-pointed at the lines (instanced draws have
+// no base instance before GL 4.2)
+inline void draw_lines(int first_vertex, int line_count) {
+  if (first_vertex < 0 || line_count <= 0) return;
+  if (!use_line_quads()) {
+    wrap_glDrawArrays(GL_LINES, first_vertex, line_count * 2);
+    return;
+  }
+  eglstate::bind_buffer(GL_ARRAY_BUFFER, eglstream::shared_buffer());
+  size_t offset = (size_t)first_vertex * LINE_VERTEX_BYTES;
+  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 2 * LINE_VERTEX_BYTES, (void*)offset);
+  glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 2 * LINE_VERTEX_BYTES,
+                        (void*)(offset + LINE_VERTEX_BYTES));
+  wrap_glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, line_count);
 }
 
 } // namespace elines
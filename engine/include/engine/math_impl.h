@@ -0,0 +1,65 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <cmath>
+
+// ============ NATIVE VECTOR OPS ============
+// Fused glm::vec3 / glm::quat operations for engine.math's v3- and quat-
+// macros. Values stay native in jank locals, so a chain of these makes no
+// persistent vectors; convert to [x y z] only where a value leaves for
+// state or an API that takes one.
+
+namespace emath {
+
+inline glm::vec3 add(const glm::vec3& a, const glm::vec3& b) {
+  return a + b;
+}
+
+inline glm::vec3 sub(const glm::vec3& a, const glm::vec3& b) {
+  return a - b;
+}
+
+inline glm::vec3 scale(const glm::vec3& v, float s) {
+  return v * s;
+}
+
+inline float dot(const glm::vec3& a, const glm::vec3& b) {
+  return glm::dot(a, b);
+}
+
+inline glm::vec3 add_scaled(const glm::vec3& a, const glm::vec3& b, float s) {
+  return a + b * s;
+}
+
+inline glm::vec3 lerp(const glm::vec3& a, const glm::vec3& b, float t) {
+  return a + (b - a) * t;
+}
+
+inline float length(const glm::vec3& v) {
+  return glm::length(v);
+}
+
+// Zero for a (near) zero vector rather than NaNs
+inline glm::vec3 normalize(const glm::vec3& v) {
+  float len = glm::length(v);
+  return len > 1e-6f ? v / len : glm::vec3(0.0f);
+}
+
+// The game's view angles in degrees: turns +X to
+// (cos yaw cos pitch, -sin pitch, sin yaw cos pitch), so yaw goes toward +Z
+// and positive pitch looks down
+inline glm::quat quat_yaw_pitch(float yaw_degrees, float pitch_degrees) {
+  glm::quat yaw = glm::angleAxis(glm::radians(-yaw_degrees), glm::vec3(0.0f, 1.0f, 0.0f));
+  glm::quat pitch = glm::angleAxis(glm::radians(-pitch_degrees), glm::vec3(0.0f, 0.0f, 1.0f));
+  return yaw * pitch;
+}
+
+inline glm::vec3 rotate(const glm::quat& q, const glm::vec3& v) {
+  return q * v;
+}
+
+inline glm::quat slerp(const glm::quat& a, const glm::quat& b, float t) {
+  return glm::slerp(a, b, t);
+}
+
+} // namespace emath
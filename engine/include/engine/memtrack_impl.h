@@ -0,0 +1,187 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+// ============ MEMORY ACCOUNTING ============
+// Native (RAM) and GPU (VRAM) bytes held per subsystem, for the memory
+// the GC heap doesn't see: ozz clips and context buffers, collision BVHs,
+// glTF vertex buffers, textures, font atlases and the streaming GL
+// buffers. Owners report it one of two ways:
+//   - an Account member, set to what the object holds now and zeroed by
+//     its destructor, for CPU-side objects (animation sets, BVHs);
+//   - track_texture / track_buffer by GL name when uploading, and
+//     untrack_* just before deleting, for GL objects whose owner is a
+//     plain name (textures, VBOs).
+// Figures are estimates from sizes the engine asked for (mip chains at
+// 4/3 of the base level), not driver numbers.
+//
+// set_budget gives a category a RAM and/or VRAM limit (0: none). Going
+// over prints one warning, and another only after dropping back under.
+// Totals are atomics, so jobs (bundle clips deserializing on the pool)
+// can report; the GL name maps take a lock.
+
+namespace ememtrack {
+
+enum Category {
+  CAT_ANIMATION = 0,   // Skeletons, clips, context buffers
+  CAT_COLLISION,       // BVH arrays (not the meshes they index)
+  CAT_MESHES,          // glTF vertex and index buffers
+  CAT_TEXTURES,
+  CAT_FONTS,           // Glyph atlases and their CPU copies
+  CAT_GL_STREAMS,      // Streaming vertex ring, joint palettes, instance buffers, skin captures
+  CAT_COUNT
+};
+
+enum Kind { RAM = 0, VRAM = 1, KIND_COUNT };
+
+inline const char* category_name(int category) {
+  static const char* const NAMES[CAT_COUNT] = {"animation", "collision", "meshes",
+                                               "textures", "fonts", "gl-streams"};
+  return NAMES[category];
+}
+
+// -1 for an unknown name
+inline int category_index(const char* name) {
+  for (int c = 0; c < CAT_COUNT; ++c) {
+    if (std::strcmp(category_name(c), name) == 0) return c;
+  }
+  return -1;
+}
+
+// GL texture / buffer name -> (category, bytes)
+using NameMap = std::unordered_map<unsigned int, std::pair<int, int64_t>>;
+
+struct Registry {
+  std::atomic<int64_t> bytes[CAT_COUNT][KIND_COUNT] = {};
+  std::atomic<int64_t> budget[CAT_COUNT][KIND_COUNT] = {};
+  std::atomic<bool> over[CAT_COUNT][KIND_COUNT] = {};
+  std::mutex names_mutex;
+  NameMap textures;
+  NameMap buffers;
+};
+
+inline Registry& registry() {
+  static Registry r;
+  return r;
+}
+
+inline void check_budget(int category, int kind, int64_t total) {
+  Registry& r = registry();
+  int64_t limit = r.budget[category][kind].load(std::memory_order_relaxed);
+  bool over = limit > 0 && total > limit;
+  if (over == r.over[category][kind].load(std::memory_order_relaxed)) return;
+  if (r.over[category][kind].exchange(over) != over && over) {
+    fprintf(stderr, "[memory] %s over its %s budget: %.1f MB of %.1f MB\n",
+            category_name(category), kind == RAM ? "RAM" : "VRAM",
+            total / 1048576.0, limit / 1048576.0);
+  }
+}
+
+// bytes may be negative
+inline void add(int category, int kind, int64_t bytes) {
+  if (bytes == 0) return;
+  int64_t total = registry().bytes[category][kind].fetch_add(bytes) + bytes;
+  check_budget(category, kind, total);
+}
+
+inline int64_t bytes(int category, int kind) {
+  return registry().bytes[category][kind].load(std::memory_order_relaxed);
+}
+
+inline int64_t budget(int category, int kind) {
+  return registry().budget[category][kind].load(std::memory_order_relaxed);
+}
+
+inline void set_budget(int category, int kind, int64_t limit) {
+  registry().budget[category][kind].store(limit);
+  check_budget(category, kind, bytes(category, kind));
+}
+
+inline bool over_budget(int category, int kind) {
+  return registry().over[category][kind].load(std::memory_order_relaxed);
+}
+
+// What one object holds, reported as it changes and released with it
+struct Account {
+  int category;
+  int64_t ram = 0;
+  int64_t vram = 0;
+
+  explicit Account(int c) : category(c) {}
+  ~Account() { set(0, 0); }
+  Account(const Account&) = delete;
+  Account& operator=(const Account&) = delete;
+  // Moves hand the tracked bytes over: the totals don't change, and the
+  // source is left tracking nothing
+  Account(Account&& o) noexcept : category(o.category), ram(o.ram), vram(o.vram) {
+    o.ram = 0;
+    o.vram = 0;
+  }
+  Account& operator=(Account&& o) noexcept {
+    if (this != &o) {
+      set(0, 0);
+      category = o.category;
+      ram = o.ram;
+      vram = o.vram;
+      o.ram = 0;
+      o.vram = 0;
+    }
+    return *this;
+  }
+
+  void set(int64_t new_ram, int64_t new_vram) {
+    add(category, RAM, new_ram - ram);
+    add(category, VRAM, new_vram - vram);
+    ram = new_ram;
+    vram = new_vram;
+  }
+  void set_ram(int64_t new_ram) { set(new_ram, vram); }
+  void add_ram(int64_t delta) { set(ram + delta, vram); }
+};
+
+// ---- GL objects by name ----
+
+inline void track(NameMap& names, unsigned int name, int category, int64_t bytes) {
+  if (name == 0) return;
+  std::pair<int, int64_t> old(category, 0);
+  {
+    std::lock_guard<std::mutex> lock(registry().names_mutex);
+    auto it = names.find(name);
+    if (it != names.end()) old = it->second;
+    names[name] = {category, bytes};
+  }
+  add(old.first, VRAM, -old.second);
+  add(category, VRAM, bytes);
+}
+
+inline void untrack(NameMap& names, unsigned int name) {
+  std::pair<int, int64_t> old(0, 0);
+  {
+    std::lock_guard<std::mutex> lock(registry().names_mutex);
+    auto it = names.find(name);
+    if (it == names.end()) return;
+    old = it->second;
+    names.erase(it);
+  }
+  add(old.first, VRAM, -old.second);
+}
+
+// Record texture's storage, replacing what it was tracked at before
+inline void track_texture(unsigned int texture, int category, int64_t bytes) {
+  track(registry().textures, texture, category, bytes);
+}
+
+inline void untrack_texture(unsigned int texture) { untrack(registry().textures, texture); }
+
+inline void track_buffer(unsigned int buffer, int category, int64_t bytes) {
+  track(registry().buffers, buffer, category, bytes);
+}
+
+inline void untrack_buffer(unsigned int buffer) { untrack(registry().buffers, buffer); }
+
+} // namespace ememtrack
@@ -0,0 +1,317 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// ============================================================================
+// Offline mesh optimization
+// ============================================================================
+// Index and vertex reordering for the asset tools (levelbake, ozzmeshopt),
+// in the order they're applied:
+//   optimize_vertex_cache  - triangle order for post-transform cache reuse
+//                            (Forsyth's linear-speed algorithm)
+//   optimize_overdraw      - cluster order, outward-facing clusters first,
+//                            giving back at most threshold of the ACMR
+//   vertex_fetch_remap     - vertices renumbered in first-use order, so
+//                            fetches walk the vertex buffer forward
+// acmr is the average cache miss ratio (transforms per triangle, 0.5 to 3)
+// of a FIFO cache of ACMR_CACHE_SIZE, which the tools report before and
+// after. Nothing here changes the triangles themselves, only their order.
+
+namespace emeshopt {
+
+const int ACMR_CACHE_SIZE = 16;    // FIFO entries, a conservative post-transform cache
+const int SCORE_CACHE_SIZE = 32;   // LRU the cache optimizer scores against
+const float OVERDRAW_THRESHOLD = 1.05f;
+
+inline float acmr(const uint32_t* indices, size_t index_count, size_t vertex_count,
+                  int cache_size = ACMR_CACHE_SIZE) {
+  if (index_count < 3) return 0.0f;
+  std::vector<uint32_t> stamp(vertex_count, 0);  // FIFO position + cache_size when cached
+  uint32_t time = (uint32_t)cache_size + 1;
+  size_t misses = 0;
+  for (size_t i = 0; i < index_count; ++i) {
+    uint32_t v = indices[i];
+    if (time - stamp[v] > (uint32_t)cache_size) {
+      stamp[v] = time++;
+      ++misses;
+    }
+  }
+  return (float)misses / (float)(index_count / 3);
+}
+
+inline float vertex_score(int cache_position, uint32_t live_triangles) {
+  if (live_triangles == 0) return -1.0f;
+  float score = 0.0f;
+  if (cache_position >= 0) {
+    if (cache_position < 3) {
+      // The last triangle's vertices: fixed, so the next one doesn't just
+      // reuse the same edge
+      score = 0.75f;
+    } else {
+      float scaled = 1.0f - (float)(cache_position - 3) / (float)(SCORE_CACHE_SIZE - 3);
+      score = std::pow(scaled, 1.5f);
+    }
+  }
+  // Vertices with few triangles left are finished off first
+  return score + 2.0f / std::sqrt((float)live_triangles);
+}
+
+inline void optimize_vertex_cache(uint32_t* indices, size_t index_count, size_t vertex_count) {
+  size_t triangle_count = index_count / 3;
+  if (triangle_count < 2) return;
+
+  // Triangles around each vertex; live ones are the first live[v]
+  std::vector<uint32_t> live(vertex_count, 0);
+  for (size_t i = 0; i < triangle_count * 3; ++i) ++live[indices[i]];
+  std::vector<uint32_t> offsets(vertex_count + 1, 0);
+  for (size_t v = 0; v < vertex_count; ++v) offsets[v + 1] = offsets[v] + live[v];
+  std::vector<uint32_t> adjacency(triangle_count * 3);
+  {
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t t = 0; t < triangle_count; ++t) {
+      for (int k = 0; k < 3; ++k) adjacency[fill[indices[t * 3 + k]]++] = (uint32_t)t;
+    }
+  }
+
+  std::vector<int> cache_position(vertex_count, -1);
+  std::vector<float> score(vertex_count);
+  for (size_t v = 0; v < vertex_count; ++v) score[v] = vertex_score(-1, live[v]);
+  std::vector<float> triangle_score(triangle_count);
+  for (size_t t = 0; t < triangle_count; ++t) {
+    triangle_score[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+  }
+  std::vector<char> emitted(triangle_count, 0);
+  std::vector<uint32_t> out(triangle_count * 3);
+  std::vector<uint32_t> cache;
+  std::vector<uint32_t> next_cache;
+  cache.reserve(SCORE_CACHE_SIZE + 3);
+  next_cache.reserve(SCORE_CACHE_SIZE + 3);
+
+  long best = -1;
+  size_t scan = 0;  // Triangles before this are all emitted
+  for (size_t emitted_count = 0; emitted_count < triangle_count; ++emitted_count) {
+    if (best < 0) {
+      // Nothing in the cache has triangles left: take the best remaining
+      float best_score = -1.0f;
+      while (emitted[scan]) ++scan;
+      for (size_t t = scan; t < triangle_count; ++t) {
+        if (!emitted[t] && triangle_score[t] > best_score) {
+          best_score = triangle_score[t];
+          best = (long)t;
+        }
+      }
+    }
+    size_t t = (size_t)best;
+    emitted[t] = 1;
+    const uint32_t* tri = indices + t * 3;
+    out[emitted_count * 3] = tri[0];
+    out[emitted_count * 3 + 1] = tri[1];
+    out[emitted_count * 3 + 2] = tri[2];
+
+    // Drop the triangle from its vertices' live lists
+    for (int k = 0; k < 3; ++k) {
+      uint32_t v = tri[k];
+      uint32_t* list = adjacency.data() + offsets[v];
+      for (uint32_t i = 0; i < live[v]; ++i) {
+        if (list[i] == t) {
+          list[i] = list[live[v] - 1];
+          --live[v];
+          break;
+        }
+      }
+    }
+
+    // The triangle's vertices move to the front of the cache
+    next_cache.assign(tri, tri + 3);
+    for (uint32_t v : cache) {
+      if (v != tri[0] && v != tri[1] && v != tri[2]) next_cache.push_back(v);
+    }
+    for (size_t i = 0; i < next_cache.size(); ++i) {
+      int position = i < (size_t)SCORE_CACHE_SIZE ? (int)i : -1;
+      cache_position[next_cache[i]] = position;
+      score[next_cache[i]] = vertex_score(position, live[next_cache[i]]);
+    }
+
+    // Rescore the triangles around every vertex that moved, picking the
+    // best of them for next
+    best = -1;
+    float best_score = -1.0f;
+    for (uint32_t v : next_cache) {
+      const uint32_t* list = adjacency.data() + offsets[v];
+      for (uint32_t i = 0; i < live[v]; ++i) {
+        uint32_t u = list[i];
+        float s = score[indices[u * 3]] + score[indices[u * 3 + 1]] + score[indices[u * 3 + 2]];
+        triangle_score[u] = s;
+        if (s > best_score) {
+          best_score = s;
+          best = (long)u;
+        }
+      }
+    }
+    if (next_cache.size() > (size_t)SCORE_CACHE_SIZE) next_cache.resize(SCORE_CACHE_SIZE);
+    cache.swap(next_cache);
+  }
+  std::copy(out.begin(), out.end(), indices);
+}
+
+// Reorder clusters of the (cache-optimized) triangles so that ones facing
+// away from the mesh's centre draw first and occlude the rest. A cluster
+// ends where the FIFO simulation had flushed (a triangle with three
+// misses), or where its ACMR so far is within threshold of the whole
+// run's, so clusters can move without costing more than threshold in
+// cache misses. positions are 3 floats at stride floats apart.
+inline void optimize_overdraw(uint32_t* indices, size_t index_count, const float* positions,
+                              size_t stride, size_t vertex_count,
+                              float threshold = OVERDRAW_THRESHOLD) {
+  size_t triangle_count = index_count / 3;
+  if (triangle_count < 2) return;
+  auto pos = [&](uint32_t v) { return positions + (size_t)v * stride; };
+
+  // Hard boundaries: triangles the FIFO reaches with nothing cached
+  std::vector<uint32_t> stamp(vertex_count, 0);
+  uint32_t time = ACMR_CACHE_SIZE + 1;
+  std::vector<int> misses(triangle_count);
+  for (size_t t = 0; t < triangle_count; ++t) {
+    int m = 0;
+    for (int k = 0; k < 3; ++k) {
+      uint32_t v = indices[t * 3 + k];
+      if (time - stamp[v] > (uint32_t)ACMR_CACHE_SIZE) {
+        stamp[v] = time++;
+        ++m;
+      }
+    }
+    misses[t] = m;
+  }
+  std::vector<size_t> hard;
+  for (size_t t = 0; t < triangle_count; ++t) {
+    if (t == 0 || misses[t] == 3) hard.push_back(t);
+  }
+  hard.push_back(triangle_count);
+
+  // Soft boundaries inside each hard run
+  std::vector<size_t> starts;
+  for (size_t h = 0; h + 1 < hard.size(); ++h) {
+    size_t begin = hard[h], end = hard[h + 1];
+    size_t run_misses = 0;
+    for (size_t t = begin; t < end; ++t) run_misses += misses[t];
+    float run_acmr = (float)run_misses / (float)(end - begin);
+    starts.push_back(begin);
+    size_t cluster_misses = 0;
+    size_t cluster_begin = begin;
+    for (size_t t = begin; t < end; ++t) {
+      cluster_misses += misses[t];
+      float cluster_acmr = (float)cluster_misses / (float)(t + 1 - cluster_begin);
+      if (t + 1 < end && cluster_acmr <= run_acmr * threshold) {
+        starts.push_back(t + 1);
+        cluster_begin = t + 1;
+        cluster_misses = 0;
+      }
+    }
+  }
+  starts.push_back(triangle_count);
+  size_t cluster_count = starts.size() - 1;
+  if (cluster_count < 2) return;
+
+  // Mesh centre, area weighted
+  double centre[3] = {0.0, 0.0, 0.0};
+  double total_area = 0.0;
+  std::vector<float> cluster_key(cluster_count);
+  std::vector<double> cluster_data(cluster_count * 7, 0.0);  // centroid*area, normal, area
+  for (size_t c = 0; c < cluster_count; ++c) {
+    double* d = cluster_data.data() + c * 7;
+    for (size_t t = starts[c]; t < starts[c + 1]; ++t) {
+      const float* a = pos(indices[t * 3]);
+      const float* b = pos(indices[t * 3 + 1]);
+      const float* e = pos(indices[t * 3 + 2]);
+      double ab[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+      double ae[3] = {e[0] - a[0], e[1] - a[1], e[2] - a[2]};
+      double n[3] = {ab[1] * ae[2] - ab[2] * ae[1],
+                     ab[2] * ae[0] - ab[0] * ae[2],
+                     ab[0] * ae[1] - ab[1] * ae[0]};
+      double area = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+      for (int k = 0; k < 3; ++k) {
+        d[k] += (a[k] + b[k] + e[k]) / 3.0 * area;
+        d[3 + k] += n[k];
+      }
+      d[6] += area;
+    }
+    for (int k = 0; k < 3; ++k) centre[k] += d[k];
+    total_area += d[6];
+  }
+  if (total_area <= 0.0) return;
+  for (int k = 0; k < 3; ++k) centre[k] /= total_area;
+
+  for (size_t c = 0; c < cluster_count; ++c) {
+    const double* d = cluster_data.data() + c * 7;
+    double length = std::sqrt(d[3] * d[3] + d[4] * d[4] + d[5] * d[5]);
+    if (d[6] <= 0.0 || length <= 0.0) {
+      cluster_key[c] = 0.0f;
+      continue;
+    }
+    double key = 0.0;
+    for (int k = 0; k < 3; ++k) key += (d[k] / d[6] - centre[k]) * (d[3 + k] / length);
+    cluster_key[c] = (float)key;
+  }
+
+  std::vector<size_t> order(cluster_count);
+  for (size_t c = 0; c < cluster_count; ++c) order[c] = c;
+  std::stable_sort(order.begin(), order.end(),
+                   [&](size_t x, size_t y) { return cluster_key[x] > cluster_key[y]; });
+
+  std::vector<uint32_t> out;
+  out.reserve(triangle_count * 3);
+  for (size_t c : order) {
+    out.insert(out.end(), indices + starts[c] * 3, indices + starts[c + 1] * 3);
+  }
+  std::copy(out.begin(), out.end(), indices);
+}
+
+// remap[old] = new, numbering vertices in the order the indices first use
+// them (unused ones last). With groups (a group id per vertex, groups
+// numbered in vertex order), vertices stay within their group's range,
+// for layouts like ozz mesh parts that are split by vertex type.
+inline std::vector<uint32_t> vertex_fetch_remap(const uint32_t* indices, size_t index_count,
+                                                size_t vertex_count,
+                                                const uint32_t* groups = nullptr) {
+  std::vector<uint32_t> order;
+  order.reserve(vertex_count);
+  std::vector<char> seen(vertex_count, 0);
+  for (size_t i = 0; i < index_count; ++i) {
+    uint32_t v = indices[i];
+    if (!seen[v]) {
+      seen[v] = 1;
+      order.push_back(v);
+    }
+  }
+  for (size_t v = 0; v < vertex_count; ++v) {
+    if (!seen[v]) order.push_back((uint32_t)v);
+  }
+  if (groups) {
+    // Keeps first-use order within each group
+    std::stable_sort(order.begin(), order.end(),
+                     [&](uint32_t a, uint32_t b) { return groups[a] < groups[b]; });
+  }
+  std::vector<uint32_t> remap(vertex_count);
+  for (size_t i = 0; i < order.size(); ++i) remap[order[i]] = (uint32_t)i;
+  return remap;
+}
+
+inline void remap_indices(uint32_t* indices, size_t index_count, const std::vector<uint32_t>& remap) {
+  for (size_t i = 0; i < index_count; ++i) indices[i] = remap[indices[i]];
+}
+
+// Move each element (of elements_per_vertex Ts) to its remapped slot
+template <typename T>
+void remap_vertices(T* data, size_t vertex_count, size_t elements_per_vertex,
+                    const std::vector<uint32_t>& remap) {
+  std::vector<T> copy(data, data + vertex_count * elements_per_vertex);
+  for (size_t v = 0; v < vertex_count; ++v) {
+    std::copy(copy.begin() + v * elements_per_vertex, copy.begin() + (v + 1) * elements_per_vertex,
+              data + (size_t)remap[v] * elements_per_vertex);
+  }
+}
+
+}  // namespace emeshopt
@@ -0,0 +1,212 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+#include <unordered_map>
+#include <vector>
+
+// ============================================================================
+// Offline mesh simplification
+// ============================================================================
+// Index-only LOD generation for the asset tools (levelbake). simplify
+// collapses edges into one of their endpoints, cheapest first by quadric
+// error (Garland-Heckbert: the area-weighted planes of the triangles
+// around each vertex), so a LOD indexes the original vertex buffer and one
+// VAO draws a whole chain. Vertices on open or non-manifold edges are
+// locked: that covers the mesh's border, attribute seams (split vertices)
+// and the cuts between primitives and sectors, so neighbours never crack
+// apart. Collapses that would flip a triangle are skipped.
+//
+// Collapses run in passes: each pass takes the cheapest edge out of every
+// vertex, sorts them, and applies the ones whose neighbourhoods no earlier
+// collapse of the pass touched. The result's error is the largest applied
+// collapse's quadric error as a distance, in the positions' units: how far
+// the LOD may stray from the original surface, which a renderer projects
+// to pixels to pick a level.
+
+namespace emeshopt {
+
+// Symmetric 4x4 plane quadric: xx xy xz xw yy yz yw zz zw ww
+struct Quadric {
+  double a[10] = {};
+  double weight = 0.0;
+};
+
+inline void add_plane(Quadric* q, const double n[3], double d, double w) {
+  const double p[4] = {n[0], n[1], n[2], d};
+  int k = 0;
+  for (int i = 0; i < 4; ++i) {
+    for (int j = i; j < 4; ++j) q->a[k++] += w * p[i] * p[j];
+  }
+  q->weight += w;
+}
+
+inline void add_quadric(Quadric* q, const Quadric& o) {
+  for (int i = 0; i < 10; ++i) q->a[i] += o.a[i];
+  q->weight += o.weight;
+}
+
+// Weighted sum of squared distances from p to the quadric's planes
+inline double quadric_eval(const Quadric& q, const float* p) {
+  double x = p[0], y = p[1], z = p[2];
+  const double* a = q.a;
+  double e = a[0] * x * x + 2.0 * a[1] * x * y + 2.0 * a[2] * x * z + 2.0 * a[3] * x +
+             a[4] * y * y + 2.0 * a[5] * y * z + 2.0 * a[6] * y +
+             a[7] * z * z + 2.0 * a[8] * z + a[9];
+  return e > 0.0 ? e : 0.0;
+}
+
+inline void triangle_normal(const float* a, const float* b, const float* c, double n[3]) {
+  double u[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+  double v[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+  n[0] = u[1] * v[2] - u[2] * v[1];
+  n[1] = u[2] * v[0] - u[0] * v[2];
+  n[2] = u[0] * v[1] - u[1] * v[0];
+}
+
+// indices simplified to at most target_index_count indices where that
+// stays within target_error (a distance); result_error gets the error of
+// the result (may be null). positions are float xyz, stride bytes apart.
+inline std::vector<uint32_t> simplify(const uint32_t* indices, size_t index_count,
+                                      const float* positions, size_t vertex_count, size_t stride,
+                                      size_t target_index_count, float target_error,
+                                      float* result_error) {
+  std::vector<uint32_t> result(indices, indices + index_count - index_count % 3);
+  auto pos = [&](uint32_t v) {
+    return reinterpret_cast<const float*>(reinterpret_cast<const char*>(positions) + v * stride);
+  };
+
+  // Lock every vertex of an edge that isn't shared by exactly two triangles
+  std::unordered_map<uint64_t, int> edge_use;
+  auto edge_key = [](uint32_t a, uint32_t b) {
+    return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+  };
+  for (size_t i = 0; i < result.size(); i += 3) {
+    for (int k = 0; k < 3; ++k) ++edge_use[edge_key(result[i + k], result[i + (k + 1) % 3])];
+  }
+  std::vector<char> locked(vertex_count, 0);
+  for (const auto& e : edge_use) {
+    if (e.second != 2) {
+      locked[e.first >> 32] = 1;
+      locked[e.first & 0xffffffffu] = 1;
+    }
+  }
+
+  std::vector<Quadric> quadrics(vertex_count);
+  for (size_t i = 0; i < result.size(); i += 3) {
+    const float* p0 = pos(result[i]);
+    double n[3];
+    triangle_normal(p0, pos(result[i + 1]), pos(result[i + 2]), n);
+    double len = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if (len == 0.0) continue;
+    for (double& c : n) c /= len;
+    double d = -(n[0] * p0[0] + n[1] * p0[1] + n[2] * p0[2]);
+    for (int k = 0; k < 3; ++k) add_plane(&quadrics[result[i + k]], n, d, 0.5 * len);
+  }
+
+  struct Collapse {
+    uint32_t from, to;
+    double cost;  // Squared distance
+  };
+  const double limit = (double)target_error * (double)target_error;
+  double worst = 0.0;
+  std::vector<uint32_t> tri_offsets(vertex_count + 1), tri_list, remap(vertex_count);
+  std::vector<double> best_cost(vertex_count);
+  std::vector<uint32_t> best_to(vertex_count);
+  std::vector<char> dirty(vertex_count);
+  std::vector<Collapse> candidates;
+
+  while (result.size() > target_index_count) {
+    // Triangles around each vertex
+    std::fill(tri_offsets.begin(), tri_offsets.end(), 0);
+    for (uint32_t v : result) ++tri_offsets[v + 1];
+    std::partial_sum(tri_offsets.begin(), tri_offsets.end(), tri_offsets.begin());
+    tri_list.resize(result.size());
+    std::vector<uint32_t> fill(tri_offsets.begin(), tri_offsets.end() - 1);
+    for (size_t i = 0; i < result.size(); ++i) tri_list[fill[result[i]]++] = (uint32_t)(i / 3);
+
+    // Cheapest collapse out of each unlocked vertex
+    std::fill(best_cost.begin(), best_cost.end(), HUGE_VAL);
+    for (size_t i = 0; i < result.size(); i += 3) {
+      for (int k = 0; k < 3; ++k) {
+        uint32_t a = result[i + k], b = result[i + (k + 1) % 3];
+        for (int dir = 0; dir < 2; ++dir) {
+          uint32_t u = dir ? b : a, v = dir ? a : b;
+          if (locked[u]) continue;
+          double weight = quadrics[u].weight + quadrics[v].weight;
+          double cost = weight > 0.0
+                            ? (quadric_eval(quadrics[u], pos(v)) + quadric_eval(quadrics[v], pos(v))) /
+                                  weight
+                            : 0.0;
+          if (cost < best_cost[u]) {
+            best_cost[u] = cost;
+            best_to[u] = v;
+          }
+        }
+      }
+    }
+    candidates.clear();
+    for (uint32_t u = 0; u < vertex_count; ++u) {
+      if (best_cost[u] <= limit) candidates.push_back({u, best_to[u], best_cost[u]});
+    }
+    std::sort(candidates.begin(), candidates.end(),
+              [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+    std::iota(remap.begin(), remap.end(), 0u);
+    std::fill(dirty.begin(), dirty.end(), 0);
+    size_t triangles = result.size() / 3;
+    size_t collapses = 0;
+    for (const Collapse& c : candidates) {
+      if (triangles * 3 <= target_index_count) break;
+      if (dirty[c.from] || dirty[c.to]) continue;
+      bool flips = false;
+      size_t removed = 0;
+      for (uint32_t j = tri_offsets[c.from]; j < tri_offsets[c.from + 1] && !flips; ++j) {
+        const uint32_t* t = &result[(size_t)tri_list[j] * 3];
+        if (t[0] == c.to || t[1] == c.to || t[2] == c.to) {
+          ++removed;
+          continue;
+        }
+        const float* before[3] = {pos(t[0]), pos(t[1]), pos(t[2])};
+        const float* after[3] = {before[0], before[1], before[2]};
+        for (int k = 0; k < 3; ++k) {
+          if (t[k] == c.from) after[k] = pos(c.to);
+        }
+        double n0[3], n1[3];
+        triangle_normal(before[0], before[1], before[2], n0);
+        triangle_normal(after[0], after[1], after[2], n1);
+        flips = n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2] <= 0.0;
+      }
+      if (flips) continue;
+
+      remap[c.from] = c.to;
+      add_quadric(&quadrics[c.to], quadrics[c.from]);
+      worst = std::max(worst, c.cost);
+      triangles -= removed;
+      ++collapses;
+      dirty[c.to] = 1;
+      for (uint32_t j = tri_offsets[c.from]; j < tri_offsets[c.from + 1]; ++j) {
+        const uint32_t* t = &result[(size_t)tri_list[j] * 3];
+        dirty[t[0]] = dirty[t[1]] = dirty[t[2]] = 1;
+      }
+    }
+    if (collapses == 0) break;
+
+    size_t out = 0;
+    for (size_t i = 0; i < result.size(); i += 3) {
+      uint32_t a = remap[result[i]], b = remap[result[i + 1]], c = remap[result[i + 2]];
+      if (a == b || b == c || a == c) continue;
+      result[out++] = a;
+      result[out++] = b;
+      result[out++] = c;
+    }
+    result.resize(out);
+  }
+
+  if (result_error) *result_error = (float)std::sqrt(worst);
+  return result;
+}
+
+} // namespace emeshopt
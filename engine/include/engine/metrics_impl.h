@@ -0,0 +1,374 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "enet.h"
+
+namespace emetrics {
+
+// ============================================================================
+// Tick metrics
+// ============================================================================
+// A Registry holds named series for one server loop. During a pass each
+// series accumulates (add, from any thread: it's an atomic fixed-point
+// sum), and end_pass records the totals into the series' histograms, so
+// work split across threads (parallel command processing) sums into one
+// sample. Timing series are in ms and spread over the ticks the pass ran,
+// like the loop's tick cost; count series are recorded once per pass.
+//
+// Histograms are log-linear: SUB_BUCKETS per power of two from 1/1024 up
+// to 2^OCTAVES / 1024 units, so quantiles are good to about 9% (and exact
+// at powers of two). Register every series before the loop starts; add
+// only indexes them. Each series
+// keeps the window being filled and the last finished one (roll_window);
+// reports and the endpoint read the finished one.
+
+const int SUB_BUCKETS = 8;
+const int OCTAVES = 32;
+const int BUCKETS = SUB_BUCKETS * OCTAVES + 1;
+const double BUCKET_UNIT = 1024.0;  // Bucket 1 starts at 1 / BUCKET_UNIT
+const double FIXED_POINT = 1.0e6;   // Accumulated units per 1.0
+
+struct Histogram {
+    uint64_t counts[BUCKETS] = {};
+    uint64_t count = 0;
+    double sum = 0.0;
+    double max = 0.0;
+};
+
+inline int bucket_of(double v) {
+    double scaled = v * BUCKET_UNIT;
+    if (scaled < 1.0) return 0;
+    int b = (int)(std::log2(scaled) * SUB_BUCKETS) + 1;
+    return std::min(b, BUCKETS - 1);
+}
+
+// Smallest value bucket b holds
+inline double bucket_floor(int b) {
+    return b == 0 ? 0.0 : std::exp2((double)(b - 1) / SUB_BUCKETS) / BUCKET_UNIT;
+}
+
+inline void record(Histogram& h, double v, uint64_t weight) {
+    h.counts[bucket_of(v)] += weight;
+    h.count += weight;
+    h.sum += v * (double)weight;
+    h.max = std::max(h.max, v);
+}
+
+inline double quantile(const Histogram& h, double q) {
+    if (h.count == 0) return 0.0;
+    uint64_t rank = (uint64_t)std::ceil(q * (double)h.count);
+    if (rank == 0) rank = 1;
+    uint64_t seen = 0;
+    for (int b = 0; b < BUCKETS; ++b) {
+        seen += h.counts[b];
+        if (seen >= rank) return std::min(bucket_floor(b), h.max);
+    }
+    return h.max;
+}
+
+struct Series {
+    std::string name;
+    bool timing;                        // ms, spread over the pass's ticks
+    std::atomic<int64_t> pending{0};    // This pass, FIXED_POINT units
+    std::atomic<bool> touched{false};
+    Histogram window;                   // Loop thread only
+    Histogram last;                     // Under Registry::mutex
+    uint64_t total_count = 0;           // Since start, under Registry::mutex
+    double total_sum = 0.0;
+    Series(const std::string& n, bool t) : name(n), timing(t) {}
+};
+
+struct Gauge {
+    std::string name;
+    std::string labels;                 // Prometheus labels, e.g. connection="3"
+    double value;
+};
+
+struct Registry {
+    std::string label;                  // Tells registries apart on the endpoint
+    std::mutex mutex;
+    std::deque<Series> series;          // Stable addresses for add
+    std::vector<Gauge> gauges;
+    uint64_t ticks = 0;
+    uint64_t window_ticks = 0;
+    uint64_t last_ticks = 0;
+};
+
+struct Registries {
+    std::mutex mutex;
+    std::vector<Registry*> all;
+};
+
+inline Registries& registries() {
+    static Registries r;
+    return r;
+}
+
+inline Registry* create(const char* label) {
+    Registry* r = new Registry();
+    r->label = label;
+    Registries& rs = registries();
+    std::lock_guard<std::mutex> lock(rs.mutex);
+    rs.all.push_back(r);
+    return r;
+}
+
+inline void destroy(Registry* r) {
+    Registries& rs = registries();
+    {
+        std::lock_guard<std::mutex> lock(rs.mutex);
+        rs.all.erase(std::remove(rs.all.begin(), rs.all.end(), r), rs.all.end());
+    }
+    delete r;
+}
+
+// Index of the series called name, created (as timing or count) on first use
+inline int series(Registry* r, const char* name, bool timing) {
+    std::lock_guard<std::mutex> lock(r->mutex);
+    for (size_t i = 0; i < r->series.size(); ++i) {
+        if (r->series[i].name == name) return (int)i;
+    }
+    r->series.emplace_back(name, timing);
+    return (int)r->series.size() - 1;
+}
+
+inline void add(Registry* r, int s, double v) {
+    Series& series = r->series[s];
+    series.pending.fetch_add((int64_t)std::llround(v * FIXED_POINT), std::memory_order_relaxed);
+    series.touched.store(true, std::memory_order_relaxed);
+}
+
+// Close a pass that ran ticks ticks (0 leaves everything pending for the
+// next one). Loop thread only.
+inline void end_pass(Registry* r, int ticks) {
+    if (ticks <= 0) return;
+    size_t n;
+    {
+        std::lock_guard<std::mutex> lock(r->mutex);
+        n = r->series.size();
+    }
+    for (size_t i = 0; i < n; ++i) {
+        Series& s = r->series[i];
+        if (!s.touched.exchange(false, std::memory_order_relaxed)) continue;
+        double v = (double)s.pending.exchange(0, std::memory_order_relaxed) / FIXED_POINT;
+        if (s.timing) {
+            record(s.window, v / ticks, (uint64_t)ticks);
+        } else {
+            record(s.window, v, 1);
+        }
+    }
+    r->window_ticks += (uint64_t)ticks;
+}
+
+// Finish the window: it becomes what quantile and the endpoint report
+inline void roll_window(Registry* r) {
+    std::lock_guard<std::mutex> lock(r->mutex);
+    for (Series& s : r->series) {
+        s.last = s.window;
+        s.total_count += s.window.count;
+        s.total_sum += s.window.sum;
+        s.window = Histogram();
+    }
+    r->ticks += r->window_ticks;
+    r->last_ticks = r->window_ticks;
+    r->window_ticks = 0;
+}
+
+inline int series_count(Registry* r) {
+    std::lock_guard<std::mutex> lock(r->mutex);
+    return (int)r->series.size();
+}
+
+inline std::string series_name(Registry* r, int s) {
+    std::lock_guard<std::mutex> lock(r->mutex);
+    return r->series[s].name;
+}
+
+inline double last_quantile(Registry* r, int s, double q) {
+    std::lock_guard<std::mutex> lock(r->mutex);
+    return quantile(r->series[s].last, q);
+}
+
+inline double last_max(Registry* r, int s) {
+    std::lock_guard<std::mutex> lock(r->mutex);
+    return r->series[s].last.max;
+}
+
+inline double last_mean(Registry* r, int s) {
+    std::lock_guard<std::mutex> lock(r->mutex);
+    const Histogram& h = r->series[s].last;
+    return h.count ? h.sum / (double)h.count : 0.0;
+}
+
+// Replace the gauges (per-connection values come and go with connections)
+inline void clear_gauges(Registry* r) {
+    std::lock_guard<std::mutex> lock(r->mutex);
+    r->gauges.clear();
+}
+
+inline void set_gauge(Registry* r, const char* name, const char* labels, double value) {
+    std::lock_guard<std::mutex> lock(r->mutex);
+    for (Gauge& g : r->gauges) {
+        if (g.name == name && g.labels == labels) {
+            g.value = value;
+            return;
+        }
+    }
+    r->gauges.push_back({name, labels, value});
+}
+
+// ============================================================================
+// Endpoint
+// ============================================================================
+// Every registry's last window in the Prometheus text format, over plain
+// HTTP on a loopback port: each timing series as a summary (p50, p99, max)
+// in seconds, count series as summaries in their own unit, and gauges.
+// poll_endpoint answers whatever connections are waiting, without
+// blocking, so a server loop can call it every pass.
+
+inline void append(std::string& out, const char* fmt, ...) {
+    char buf[512];
+    va_list args;
+    va_start(args, fmt);
+    int n = std::vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    if (n > 0) out.append(buf, (size_t)std::min(n, (int)sizeof(buf) - 1));
+}
+
+inline std::string labels_with(const std::string& base, const std::string& extra) {
+    if (base.empty()) return extra;
+    if (extra.empty()) return base;
+    return base + "," + extra;
+}
+
+// Series and gauge names may be jank keywords (snapshot-build)
+inline std::string metric_name(const std::string& name) {
+    std::string out = name;
+    for (char& c : out) {
+        if (!std::isalnum((unsigned char)c)) c = '_';
+    }
+    return out;
+}
+
+inline std::string render_text(const char* prefix) {
+    std::string out;
+    Registries& rs = registries();
+    std::lock_guard<std::mutex> all_lock(rs.mutex);
+    for (Registry* r : rs.all) {
+        std::lock_guard<std::mutex> lock(r->mutex);
+        std::string base = r->label.empty() ? "" : "match=\"" + r->label + "\"";
+        append(out, "%s_ticks_total{%s} %llu\n", prefix, base.c_str(),
+               (unsigned long long)r->ticks);
+        for (const Series& s : r->series) {
+            std::string name = metric_name(s.name);
+            double scale = s.timing ? 0.001 : 1.0;
+            const char* unit = s.timing ? "_seconds" : "";
+            const double values[] = {quantile(s.last, 0.5), quantile(s.last, 0.99), s.last.max};
+            const char* const quantiles[] = {"quantile=\"0.5\"", "quantile=\"0.99\"",
+                                             "quantile=\"1\""};
+            for (int q = 0; q < 3; ++q) {
+                append(out, "%s_%s%s{%s} %.9g\n", prefix, name.c_str(), unit,
+                       labels_with(base, quantiles[q]).c_str(), values[q] * scale);
+            }
+            append(out, "%s_%s%s_sum{%s} %.9g\n", prefix, name.c_str(), unit, base.c_str(),
+                   s.total_sum * scale);
+            append(out, "%s_%s%s_count{%s} %llu\n", prefix, name.c_str(), unit, base.c_str(),
+                   (unsigned long long)s.total_count);
+        }
+        for (const Gauge& g : r->gauges) {
+            append(out, "%s_%s{%s} %.9g\n", prefix, metric_name(g.name).c_str(),
+                   labels_with(base, g.labels).c_str(), g.value);
+        }
+    }
+    return out;
+}
+
+struct Endpoint {
+    std::mutex mutex;
+    ENetSocket socket = ENET_SOCKET_NULL;
+    std::string prefix;
+};
+
+inline Endpoint& endpoint() {
+    static Endpoint e;
+    return e;
+}
+
+// Listen on 127.0.0.1:port. Returns false if the port can't be bound.
+inline bool serve(int port, const char* prefix) {
+    Endpoint& e = endpoint();
+    std::lock_guard<std::mutex> lock(e.mutex);
+    if (e.socket != ENET_SOCKET_NULL) return true;
+    ENetSocket s = enet_socket_create(ENET_SOCKET_TYPE_STREAM);
+    if (s == ENET_SOCKET_NULL) return false;
+    ENetAddress address = {};
+    enet_address_set_host_ip(&address, "127.0.0.1");
+    address.port = (enet_uint16)port;
+    enet_socket_set_option(s, ENET_SOCKOPT_IPV6_V6ONLY, 0);
+    enet_socket_set_option(s, ENET_SOCKOPT_REUSEADDR, 1);
+    if (enet_socket_bind(s, &address) < 0 || enet_socket_listen(s, 8) < 0) {
+        enet_socket_destroy(s);
+        return false;
+    }
+    enet_socket_set_option(s, ENET_SOCKOPT_NONBLOCK, 1);
+    e.socket = s;
+    e.prefix = prefix;
+    return true;
+}
+
+// Answer every waiting connection with the current text; any thread.
+// Returns how many were answered.
+inline int poll_endpoint() {
+    Endpoint& e = endpoint();
+    std::unique_lock<std::mutex> lock(e.mutex, std::try_to_lock);
+    if (!lock.owns_lock() || e.socket == ENET_SOCKET_NULL) return 0;
+    int answered = 0;
+    for (;;) {
+        ENetSocket client = enet_socket_accept(e.socket, nullptr);
+        if (client == ENET_SOCKET_NULL) break;
+        // The request is ignored (every path gets the metrics), but read
+        // what has arrived so closing doesn't reset the connection
+        char request[1024];
+        ENetBuffer in;
+        in.data = request;
+        in.dataLength = sizeof(request);
+        enet_socket_set_option(client, ENET_SOCKOPT_NONBLOCK, 1);
+        enet_socket_receive(client, nullptr, &in, 1);
+        enet_socket_set_option(client, ENET_SOCKOPT_NONBLOCK, 0);
+        std::string body = render_text(e.prefix.c_str());
+        std::string response;
+        append(response, "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                         "Content-Length: %zu\r\nConnection: close\r\n\r\n", body.size());
+        response += body;
+        ENetBuffer out;
+        out.data = (void*)response.data();
+        out.dataLength = response.size();
+        enet_socket_send(client, nullptr, &out, 1);
+        enet_socket_shutdown(client, ENET_SOCKET_SHUTDOWN_WRITE);
+        enet_socket_destroy(client);
+        ++answered;
+    }
+    return answered;
+}
+
+inline void stop_endpoint() {
+    Endpoint& e = endpoint();
+    std::lock_guard<std::mutex> lock(e.mutex);
+    if (e.socket != ENET_SOCKET_NULL) {
+        enet_socket_destroy(e.socket);
+        e.socket = ENET_SOCKET_NULL;
+    }
+}
+
+} // namespace emetrics
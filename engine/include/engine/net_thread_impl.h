@@ -0,0 +1,296 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "enet.h"
+#include "engine/networking_impl.h"
+
+namespace enet_io {
+
+// ============================================================================
+// Network I/O thread
+// ============================================================================
+// Runs enet_host_service for one host on its own thread, so acknowledgments
+// and resends keep their pace however long the owner's tick or frame takes.
+// While it runs the thread owns the host: the owner never calls ENet on it,
+// and the two sides talk through two single-producer single-consumer rings.
+//   in   received events, packets still attached (I/O thread -> owner)
+//   out  sends, broadcasts, releases and disconnects (owner -> I/O thread)
+// Packets are created by the owner and handed over in `out`; received ones
+// are handed back in `in` and destroyed by the owner once decoded. Outgoing
+// commands wait at most service_ms before the thread picks them up.
+//
+// Peer statistics (enet_impl::peer_stat) are read from the owner without
+// synchronization while the thread runs, so they are approximate.
+//
+// While the owner waits at least IDLE_WAIT_MS for an event (an idle server
+// hibernating), the thread services with the owner's timeout instead of
+// service_ms, so neither side wakes until traffic arrives. Commands queued
+// from another thread meanwhile wait for that traffic or the timeout.
+
+const int IDLE_WAIT_MS = 100;
+
+template <typename T>
+struct SpscRing {
+    std::vector<T> slots;
+    size_t mask = 0;
+    alignas(64) std::atomic<size_t> head{0};  // Next to pop; consumer only writes
+    alignas(64) std::atomic<size_t> tail{0};  // Next to push; producer only writes
+
+    explicit SpscRing(size_t capacity) {
+        size_t n = 1;
+        while (n < capacity) n <<= 1;
+        slots.resize(n);
+        mask = n - 1;
+    }
+
+    bool push(const T& v) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == slots.size()) return false;
+        slots[t & mask] = v;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T* out) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) return false;
+        *out = slots[h & mask];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+};
+
+// ENet event as received; type is the ENetEventType
+struct Inbound {
+    int type = 0;
+    ENetPeer* peer = nullptr;
+    uint32_t peer_id = 0;
+    ENetPacket* packet = nullptr;
+};
+
+const int OUT_SEND = 0;            // packet to peer on channel
+const int OUT_BROADCAST = 1;       // packet to every peer on channel
+const int OUT_RELEASE = 2;         // enet_impl::release_packet, after the sends queued before it
+const int OUT_DISCONNECT = 3;
+const int OUT_DISCONNECT_NOW = 4;
+
+struct Outbound {
+    int kind = OUT_SEND;
+    ENetPeer* peer = nullptr;
+    int channel = 0;
+    ENetPacket* packet = nullptr;
+};
+
+struct IoThread {
+    ENetHost* host = nullptr;
+    int service_ms = 1;
+    SpscRing<Inbound> in;
+    SpscRing<Outbound> out;
+    std::atomic<bool> running{true};
+    // wait_inbound sleeps here; the I/O thread only takes the lock to wake it
+    std::atomic<int> waiters{0};
+    std::atomic<int> idle_wait_ms{0};  // The owner's wait, while at least IDLE_WAIT_MS
+    std::mutex wake_mutex;
+    std::condition_variable wake;
+    std::thread thread;
+
+    IoThread(ENetHost* h, int ms, size_t capacity)
+        : host(h), service_ms(ms), in(capacity), out(capacity) {}
+};
+
+inline void apply_outbound(ENetHost* host, const Outbound& o) {
+    switch (o.kind) {
+        case OUT_SEND:
+            if (enet_peer_send(o.peer, (enet_uint8)o.channel, o.packet) < 0) {
+                enet_impl::release_packet(o.packet);
+            }
+            break;
+        case OUT_BROADCAST:
+            // Destroys the packet itself if no peer took it
+            enet_host_broadcast(host, (enet_uint8)o.channel, o.packet);
+            break;
+        case OUT_RELEASE: enet_impl::release_packet(o.packet); break;
+        case OUT_DISCONNECT: enet_peer_disconnect(o.peer, 0); break;
+        case OUT_DISCONNECT_NOW: enet_peer_disconnect_now(o.peer, 0); break;
+    }
+}
+
+// Apply every queued command; true if there were any
+inline bool drain_outbound(IoThread* io) {
+    Outbound o;
+    bool any = false;
+    while (io->out.pop(&o)) {
+        apply_outbound(io->host, o);
+        any = true;
+    }
+    return any;
+}
+
+// A full ring means the owner is far behind; wait for it rather than drop
+// reliable traffic
+inline void push_inbound(IoThread* io, const Inbound& e) {
+    while (!io->in.push(e)) {
+        if (!io->running.load(std::memory_order_acquire)) {
+            if (e.packet) enet_packet_destroy(e.packet);
+            return;
+        }
+        std::this_thread::yield();
+    }
+}
+
+inline void wake_owner(IoThread* io) {
+    if (io->waiters.load() > 0) {
+        { std::lock_guard<std::mutex> lock(io->wake_mutex); }
+        io->wake.notify_one();
+    }
+}
+
+inline void io_loop(IoThread* io) {
+    ENetEvent event;
+    while (io->running.load(std::memory_order_acquire)) {
+        if (drain_outbound(io)) enet_host_flush(io->host);
+        bool received = false;
+        int wait_ms = io->idle_wait_ms.load(std::memory_order_acquire);
+        if (wait_ms == 0 || !io->out.empty()) wait_ms = io->service_ms;
+        int r = enet_host_service(io->host, &event, (enet_uint32)wait_ms);
+        while (r > 0) {
+            push_inbound(io, {(int)event.type, event.peer, enet_impl::get_peer_id(event.peer),
+                              event.packet});
+            received = true;
+            r = enet_host_check_events(io->host, &event);
+        }
+        if (received) wake_owner(io);
+    }
+}
+
+inline IoThread* start_io_thread(ENetHost* host, int service_ms, int capacity) {
+    IoThread* io = new IoThread(host, service_ms > 0 ? service_ms : 1,
+                                capacity > 16 ? (size_t)capacity : 16);
+    io->thread = std::thread(io_loop, io);
+    return io;
+}
+
+// Stop and join the thread, handing the host back to the caller: commands
+// still queued are applied and flushed, received events not yet polled are
+// dropped
+inline void stop_io_thread(IoThread* io) {
+    io->running.store(false, std::memory_order_release);
+    if (io->thread.joinable()) io->thread.join();
+    if (drain_outbound(io)) enet_host_flush(io->host);
+    Inbound e;
+    while (io->in.pop(&e)) {
+        if (e.packet) enet_packet_destroy(e.packet);
+    }
+    delete io;
+}
+
+// ---- Owner side: receiving ----
+
+// Wait up to timeout_ms for an event; true if one is ready
+inline bool wait_inbound(IoThread* io, int timeout_ms) {
+    if (!io->in.empty() || timeout_ms <= 0) return !io->in.empty();
+    io->waiters.fetch_add(1);
+    if (timeout_ms >= IDLE_WAIT_MS) io->idle_wait_ms.store(timeout_ms, std::memory_order_release);
+    {
+        std::unique_lock<std::mutex> lock(io->wake_mutex);
+        io->wake.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                          [io] { return !io->in.empty(); });
+    }
+    io->idle_wait_ms.store(0, std::memory_order_release);
+    io->waiters.fetch_sub(1);
+    return !io->in.empty();
+}
+
+inline bool next_inbound(IoThread* io, Inbound* e) { return io->in.pop(e); }
+
+// [POINTER FIELD] as enet_impl::event_view
+inline void inbound_view(Inbound* e, enet_impl::PacketView* view) {
+    if (e->packet && e->packet->data) {
+        view->data = e->packet->data;
+        view->length = e->packet->dataLength;
+    } else {
+        view->data = nullptr;
+        view->length = 0;
+    }
+}
+
+inline void destroy_inbound_packet(Inbound* e) {
+    if (e->packet) {
+        enet_packet_destroy(e->packet);
+        e->packet = nullptr;
+    }
+}
+
+// ---- Owner side: sending ----
+
+inline void queue_outbound(IoThread* io, const Outbound& o) {
+    while (!io->out.push(o)) std::this_thread::yield();
+}
+
+// [STRING-TO-VOID*] as enet_impl::send_on; 0 once queued, -1 if no packet
+inline int send_on(IoThread* io, ENetPeer* peer, const char* data, size_t len, int channel,
+                   int delivery) {
+    ENetPacket* packet = enet_impl::create_packet_on(data, len, delivery);
+    if (!packet) return -1;
+    queue_outbound(io, {OUT_SEND, peer, channel, packet});
+    return 0;
+}
+
+inline int send_bytes_on(IoThread* io, ENetPeer* peer, const std::vector<unsigned char>* data,
+                         int channel, int delivery) {
+    return send_on(io, peer, (const char*)data->data(), data->size(), channel, delivery);
+}
+
+inline void broadcast_on(IoThread* io, const char* data, size_t len, int channel, int delivery) {
+    ENetPacket* packet = enet_impl::create_packet_on(data, len, delivery);
+    if (packet) queue_outbound(io, {OUT_BROADCAST, nullptr, channel, packet});
+}
+
+inline void broadcast_bytes_on(IoThread* io, const std::vector<unsigned char>* data, int channel,
+                               int delivery) {
+    broadcast_on(io, (const char*)data->data(), data->size(), channel, delivery);
+}
+
+// A packet from enet_impl::create_packet_on for several peers. Release it
+// with release_packet, which is queued behind the sends, never directly.
+inline int send_shared_packet(IoThread* io, ENetPeer* peer, ENetPacket* packet, int channel) {
+    if (!packet) return -1;
+    queue_outbound(io, {OUT_SEND, peer, channel, packet});
+    return 0;
+}
+
+inline void release_packet(IoThread* io, ENetPacket* packet) {
+    if (packet) queue_outbound(io, {OUT_RELEASE, nullptr, 0, packet});
+}
+
+inline void disconnect(IoThread* io, ENetPeer* peer) {
+    queue_outbound(io, {OUT_DISCONNECT, peer, 0, nullptr});
+}
+
+inline void disconnect_now(IoThread* io, ENetPeer* peer) {
+    queue_outbound(io, {OUT_DISCONNECT_NOW, peer, 0, nullptr});
+}
+
+inline void batch_deliver(void* ctx, ENetPeer* peer, int channel, ENetPacket* packet) {
+    queue_outbound(static_cast<IoThread*>(ctx), {OUT_SEND, peer, channel, packet});
+}
+
+// Send b's packets through the thread rather than straight to ENet
+inline void attach_batcher(IoThread* io, enet_impl::Batcher* b) {
+    b->deliver = batch_deliver;
+    b->deliver_ctx = io;
+}
+
+} // namespace enet_io
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "engine/wire_impl.h"
+#include "engine/networking_impl.h"
+
+namespace enetlog {
+
+// ============================================================================
+// Message log
+// ============================================================================
+// Compact binary record of a connection's traffic (engine.networking.protocol
+// start-recording!), for deterministic playback. File: MAGIC, then records
+//   u8 kind | varint connection + 1 (0 = none / all peers) |
+//   varint microseconds since the previous record | varint length | payload
+// Payloads are the packets exactly as sent or received (binary or EDN).
+
+const char MAGIC[] = "ENETLOG1";
+const size_t MAGIC_LEN = 8;
+
+const int KIND_RECEIVED = 0;
+const int KIND_SENT = 1;
+const int KIND_CONNECT = 2;
+const int KIND_DISCONNECT = 3;
+
+struct Recorder {
+    FILE* file = nullptr;
+    double last_ms = -1.0;
+    std::vector<unsigned char> head;  // record header scratch
+};
+
+// [NULL POINTER] check recorder_ok rather than the pointer
+inline Recorder* open_recorder(const char* path) {
+    Recorder* r = new Recorder();
+    r->file = fopen(path, "wb");
+    if (r->file) fwrite(MAGIC, 1, MAGIC_LEN, r->file);
+    return r;
+}
+
+inline bool recorder_ok(Recorder* r) {
+    return r->file != nullptr;
+}
+
+inline void close_recorder(Recorder* r) {
+    if (r->file) fclose(r->file);
+    r->file = nullptr;
+}
+
+inline void record(Recorder* r, int kind, int connection, double now_ms,
+                   const unsigned char* data, size_t len) {
+    if (!r->file) return;
+    double dt_us = r->last_ms < 0.0 ? 0.0 : (now_ms - r->last_ms) * 1000.0;
+    r->last_ms = now_ms;
+    r->head.clear();
+    ewire::write_u8(&r->head, kind);
+    ewire::write_varint(&r->head, (uint64_t)(connection < 0 ? 0 : connection + 1));
+    ewire::write_varint(&r->head, (uint64_t)(dt_us > 0.0 ? dt_us + 0.5 : 0.0));
+    ewire::write_varint(&r->head, (uint64_t)len);
+    fwrite(r->head.data(), 1, r->head.size(), r->file);
+    if (len > 0) fwrite(data, 1, len, r->file);
+}
+
+inline void record_view(Recorder* r, int kind, int connection, double now_ms,
+                        enet_impl::PacketView* view) {
+    record(r, kind, connection, now_ms, view->data, view->length);
+}
+
+inline void record_bytes(Recorder* r, int kind, int connection, double now_ms,
+                         const std::vector<unsigned char>* bytes) {
+    record(r, kind, connection, now_ms, bytes->data(), bytes->size());
+}
+
+inline void record_text(Recorder* r, int kind, int connection, double now_ms, const char* text) {
+    record(r, kind, connection, now_ms, (const unsigned char*)text, text ? strlen(text) : 0);
+}
+
+inline void record_event(Recorder* r, int kind, int connection, double now_ms) {
+    record(r, kind, connection, now_ms, nullptr, 0);
+}
+
+// ============================================================================
+// Playback
+// ============================================================================
+// The whole log is read into memory; playback_next steps a cursor through
+// it and the current record's payload is read in place.
+
+struct Playback {
+    std::vector<unsigned char> data;
+    ewire::Reader cursor;
+    bool ok = false;
+    int kind = 0;
+    int connection = -1;
+    double time_ms = 0.0;
+    size_t payload = 0;
+    size_t length = 0;
+};
+
+inline Playback* open_playback(const char* path) {
+    Playback* p = new Playback();
+    FILE* f = fopen(path, "rb");
+    if (!f) return p;
+    unsigned char buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) p->data.insert(p->data.end(), buf, buf + n);
+    fclose(f);
+    p->ok = p->data.size() >= MAGIC_LEN && memcmp(p->data.data(), MAGIC, MAGIC_LEN) == 0;
+    ewire::reader_init(&p->cursor, &p->data);
+    p->cursor.pos = MAGIC_LEN;
+    return p;
+}
+
+inline bool playback_ok(Playback* p) {
+    return p->ok;
+}
+
+inline void close_playback(Playback* p) {
+    delete p;
+}
+
+// Advance to the next record; false at the end (or on a truncated record)
+inline bool playback_next(Playback* p) {
+    ewire::Reader* c = &p->cursor;
+    if (!p->ok || c->pos >= c->len) return false;
+    p->kind = ewire::read_u8(c);
+    p->connection = (int)ewire::read_varint(c) - 1;
+    p->time_ms += (double)ewire::read_varint(c) / 1000.0;
+    p->length = (size_t)ewire::read_count(c);
+    p->payload = c->pos;
+    if (!ewire::read_ok(c)) return false;
+    c->pos += p->length;
+    return true;
+}
+
+inline int playback_kind(Playback* p) { return p->kind; }
+inline int playback_connection(Playback* p) { return p->connection; }
+inline double playback_time_ms(Playback* p) { return p->time_ms; }
+inline int playback_length(Playback* p) { return (int)p->length; }
+
+// The current payload as a PacketView, decoded like a received packet
+inline void playback_view(Playback* p, enet_impl::PacketView* view) {
+    view->data = p->data.data() + p->payload;
+    view->length = p->length;
+}
+
+} // namespace enetlog
@@ -1,17 +1,40 @@
 #pragma once
 
 #include "enet.h"
+#include "engine/wire_impl.h"
 #include <cstring>
 #include <cstdlib>
+#include <vector>
+#include <string>
+#include <map>
 
 namespace enet_impl {
 
 // [MACRO] enet_address_set_host is a #define, invisible to jank
-inline ENetPeer* connect_to_host(ENetHost* host, const char* hostname, uint16_t port) {
+inline ENetPeer* connect_to_host(ENetHost* host, const char* hostname, uint16_t port,
+                                 int channels) {
     ENetAddress addr;
     enet_address_set_host(&addr, hostname);
     addr.port = port;
-    return enet_host_connect(host, &addr, 2, 0);
+    return enet_host_connect(host, &addr, (size_t)channels, 0);
+}
+
+// Per-channel delivery (engine.networking.protocol channel layout).
+// Unreliable packets over the MTU fragment unreliably: ENet's default
+// sends those fragments reliably, which would put head-of-line blocking
+// back onto the unreliable channels.
+const int DELIVERY_RELIABLE = 0;     // resent until acknowledged, in order
+const int DELIVERY_SEQUENCED = 1;    // may be lost; older than the newest received is dropped
+const int DELIVERY_UNSEQUENCED = 2;  // may be lost or arrive in any order
+
+inline uint32_t delivery_flags(int delivery) {
+    switch (delivery) {
+        case DELIVERY_RELIABLE: return ENET_PACKET_FLAG_RELIABLE;
+        case DELIVERY_SEQUENCED: return ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT;
+        case DELIVERY_UNSEQUENCED:
+            return ENET_PACKET_FLAG_UNSEQUENCED | ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT;
+    }
+    return 0;
 }
 
 // [STRING-TO-VOID*] enet_packet_create takes const void*, jank strings
@@ -32,6 +55,254 @@ inline void broadcast_packet(ENetHost* host, const char* data, size_t len, int c
     }
 }
 
+// [STRING-TO-VOID*] as send_packet, with a channel's delivery
+inline int send_on(ENetPeer* peer, const char* data, size_t len, int channel, int delivery) {
+    ENetPacket* packet = enet_packet_create(data, len, delivery_flags(delivery));
+    if (!packet) return -1;
+    return enet_peer_send(peer, channel, packet);
+}
+
+inline void broadcast_on(ENetHost* host, const char* data, size_t len, int channel, int delivery) {
+    ENetPacket* packet = enet_packet_create(data, len, delivery_flags(delivery));
+    if (packet) {
+      enet_host_broadcast(host, channel, packet);
+    }
+}
+
+// [STRING-TO-VOID*] binary payloads (engine/wire_impl.h) live in a byte vector
+inline int send_bytes(ENetPeer* peer, const std::vector<unsigned char>* data, int channel, bool reliable) {
+    return send_packet(peer, (const char*)data->data(), data->size(), channel, reliable);
+}
+
+inline void broadcast_bytes(ENetHost* host, const std::vector<unsigned char>* data, int channel, bool reliable) {
+    broadcast_packet(host, (const char*)data->data(), data->size(), channel, reliable);
+}
+
+inline int send_bytes_on(ENetPeer* peer, const std::vector<unsigned char>* data, int channel, int delivery) {
+    return send_on(peer, (const char*)data->data(), data->size(), channel, delivery);
+}
+
+inline void broadcast_bytes_on(ENetHost* host, const std::vector<unsigned char>* data, int channel, int delivery) {
+    broadcast_on(host, (const char*)data->data(), data->size(), channel, delivery);
+}
+
+// [STRING-TO-VOID*] one packet for several peers. ENet reference-counts a
+// packet per queued send and frees it after the last one goes out, so the
+// payload is copied once however many peers it is sent to. Call
+// release_packet after the last send_shared_packet.
+inline ENetPacket* create_packet(const char* data, size_t len, bool reliable) {
+    return enet_packet_create(data, len, reliable ? ENET_PACKET_FLAG_RELIABLE : 0);
+}
+
+inline ENetPacket* create_packet_bytes(const std::vector<unsigned char>* data, bool reliable) {
+    return create_packet((const char*)data->data(), data->size(), reliable);
+}
+
+inline ENetPacket* create_packet_on(const char* data, size_t len, int delivery) {
+    return enet_packet_create(data, len, delivery_flags(delivery));
+}
+
+inline ENetPacket* create_packet_bytes_on(const std::vector<unsigned char>* data, int delivery) {
+    return create_packet_on((const char*)data->data(), data->size(), delivery);
+}
+
+inline int send_shared_packet(ENetPeer* peer, ENetPacket* packet, int channel) {
+    if (!packet) return -1;
+    return enet_peer_send(peer, channel, packet);
+}
+
+// [POINTER FIELD] a packet no peer accepted is still ours to free
+inline void release_packet(ENetPacket* packet) {
+    if (packet && packet->referenceCount == 0) {
+      enet_packet_destroy(packet);
+    }
+}
+
+// [POINTER FIELD] binary packets start with a NUL marker byte, which the
+// null-terminated copy below can't carry
+inline bool event_is_binary(ENetEvent* event) {
+    return event->packet && event->packet->data && event->packet->dataLength > 0
+        && event->packet->data[0] == 0;
+}
+
+// [POINTER FIELD] copy the packet payload into out, NULs included
+inline void copy_event_bytes(ENetEvent* event, std::vector<unsigned char>* out) {
+    if (event->packet && event->packet->data) {
+      out->assign(event->packet->data, event->packet->data + event->packet->dataLength);
+    } else {
+      out->clear();
+    }
+}
+
+// [POINTER FIELD] borrowed view of a received payload. Valid only until the
+// packet is destroyed; decoders read it in place instead of copying.
+struct PacketView {
+    const unsigned char* data = nullptr;
+    size_t length = 0;
+    std::string text;  // EDN fallback only: view_text's null-terminated copy
+};
+
+inline void event_view(ENetEvent* event, PacketView* view) {
+    if (event->packet && event->packet->data) {
+      view->data = event->packet->data;
+      view->length = event->packet->dataLength;
+    } else {
+      view->data = nullptr;
+      view->length = 0;
+    }
+}
+
+inline bool view_is_binary(PacketView* view) {
+    return view->length > 0 && view->data[0] == 0;
+}
+
+// [POINTER FIELD] view->data is a pointer field reference, like event->packet
+inline void view_reader(PacketView* view, ewire::Reader* r) {
+    ewire::reader_init_span(r, view->data, view->length);
+}
+
+// Text payloads still need a terminator for jank's string conversion
+inline const char* view_text(PacketView* view) {
+    view->text.assign((const char*)view->data, view->length);
+    return view->text.c_str();
+}
+
+// Outgoing batches (engine.networking.protocol :batch). Messages for one
+// peer and channel are appended to a batch until flush, then go out as one
+// ENet packet: BATCH_MARKER, then per message a varint length and the
+// payload. A batch that would pass its byte budget is sent early; a lone
+// message goes out bare, without the envelope. Peers are only read to
+// send, so a peer disconnected before flush just refuses the packet.
+const unsigned char BATCH_MARKER = 0x01;
+
+struct PendingBatch {
+    ENetPeer* peer = nullptr;
+    int channel = 0;
+    int delivery = DELIVERY_RELIABLE;
+    std::vector<unsigned char> data;
+    size_t first = 0;   // offset of the first payload (after its length)
+    int count = 0;
+};
+
+struct Batcher {
+    std::vector<PendingBatch> batches;  // first `used` are live; the rest keep their capacity
+    size_t used = 0;
+    std::map<std::pair<ENetPeer*, int>, size_t> index;
+    size_t budget = 1200;
+    int packets = 0;    // packets sent since the last flush
+    // Takes each packet instead of enet_peer_send when set (engine/net_thread_impl.h)
+    void (*deliver)(void* ctx, ENetPeer* peer, int channel, ENetPacket* packet) = nullptr;
+    void* deliver_ctx = nullptr;
+};
+
+inline Batcher* create_batcher(int budget) {
+    Batcher* b = new Batcher();
+    b->budget = budget > 16 ? (size_t)budget : 16;
+    return b;
+}
+
+inline void destroy_batcher(Batcher* b) {
+    delete b;
+}
+
+inline void batch_deliver(Batcher* b, ENetPeer* peer, int channel, ENetPacket* packet) {
+    if (!packet) return;
+    if (b->deliver) {
+        b->deliver(b->deliver_ctx, peer, channel, packet);
+    } else if (enet_peer_send(peer, (enet_uint8)channel, packet) < 0) {
+        enet_packet_destroy(packet);
+    }
+}
+
+inline void batch_emit(Batcher* b, PendingBatch* p) {
+    if (p->count == 0) return;
+    const unsigned char* data = p->data.data();
+    size_t len = p->data.size();
+    if (p->count == 1) {
+        data += p->first;
+        len -= p->first;
+    }
+    batch_deliver(b, p->peer, p->channel, enet_packet_create(data, len, delivery_flags(p->delivery)));
+    b->packets++;
+    p->data.clear();
+    p->data.push_back(BATCH_MARKER);
+    p->count = 0;
+}
+
+inline void batch_send(Batcher* b, ENetPeer* peer, int channel, int delivery,
+                       const unsigned char* data, size_t len) {
+    std::pair<ENetPeer*, int> key(peer, channel);
+    auto it = b->index.find(key);
+    PendingBatch* p;
+    if (it == b->index.end()) {
+        if (b->used == b->batches.size()) b->batches.emplace_back();
+        size_t slot = b->used++;
+        b->index[key] = slot;
+        p = &b->batches[slot];
+        p->peer = peer;
+        p->channel = channel;
+        p->data.clear();
+        p->data.push_back(BATCH_MARKER);
+        p->count = 0;
+    } else {
+        p = &b->batches[it->second];
+    }
+    p->delivery = delivery;
+    // varint length prefix is at most 5 bytes for any packet ENet accepts
+    if (p->count > 0 && p->data.size() + 5 + len > b->budget) batch_emit(b, p);
+    if (1 + 5 + len > b->budget) {
+        // Too big to share a datagram: send alone, after what was queued
+        batch_deliver(b, peer, channel, enet_packet_create(data, len, delivery_flags(delivery)));
+        b->packets++;
+        return;
+    }
+    ewire::write_varint(&p->data, (uint64_t)len);
+    if (p->count == 0) p->first = p->data.size();
+    p->data.insert(p->data.end(), data, data + len);
+    p->count++;
+}
+
+// [STRING-TO-VOID*] jank strings arrive as const char*
+inline void batch_send_text(Batcher* b, ENetPeer* peer, int channel, int delivery,
+                            const char* data, size_t len) {
+    batch_send(b, peer, channel, delivery, (const unsigned char*)data, len);
+}
+
+inline void batch_send_bytes(Batcher* b, ENetPeer* peer, int channel, int delivery,
+                             const std::vector<unsigned char>* data) {
+    batch_send(b, peer, channel, delivery, data->data(), data->size());
+}
+
+// Send every pending batch; returns the packets sent since the last flush
+inline int batch_flush(Batcher* b) {
+    for (size_t i = 0; i < b->used; i++) batch_emit(b, &b->batches[i]);
+    b->used = 0;
+    b->index.clear();
+    int packets = b->packets;
+    b->packets = 0;
+    return packets;
+}
+
+// Received batches: iterate the payloads of a view with BATCH_MARKER
+inline bool view_is_batch(PacketView* view) {
+    return view->length > 0 && view->data[0] == BATCH_MARKER;
+}
+
+inline void batch_reader(PacketView* view, ewire::Reader* r) {
+    ewire::reader_init_span(r, view->data + 1, view->length - 1);
+}
+
+// Point sub at the next payload; false at the end or on a malformed batch
+inline bool batch_next(ewire::Reader* r, PacketView* sub) {
+    if (!r->ok || r->pos >= r->len) return false;
+    int n = ewire::read_count(r);
+    if (!r->ok) return false;
+    sub->data = r->data + r->pos;
+    sub->length = (size_t)n;
+    r->pos += (size_t)n;
+    return true;
+}
+
 // [POINTER FIELD + MALLOC] event->packet is non-convertible ENetPacket*&,
 // plus needs malloc+memcpy+null-terminate pattern
 inline char* get_event_data_copy(ENetEvent* event) {
@@ -47,6 +318,41 @@ inline char* get_event_data_copy(ENetEvent* event) {
     return nullptr;
 }
 
+// [STRUCT FIELDS + MACRO] link statistics ENet keeps per peer. Loss and
+// throttle are scaled by ENET_PEER_PACKET_LOSS_SCALE / _THROTTLE_SCALE
+// (enum constants); queue depths are lengths of ENet's command lists.
+const int PEER_RTT = 0;                 // mean round trip (ms)
+const int PEER_RTT_VARIANCE = 1;        // ms
+const int PEER_PACKET_LOSS = 2;         // mean reliable packet loss, 0-1
+const int PEER_PACKET_LOSS_VARIANCE = 3;
+const int PEER_THROTTLE = 4;            // unreliable send throttle, 0-1 (1 = none dropped)
+const int PEER_BYTES_SENT = 5;          // session totals
+const int PEER_BYTES_RECEIVED = 6;
+const int PEER_RELIABLE_IN_FLIGHT = 7;  // reliable commands sent, awaiting ack
+const int PEER_RELIABLE_BYTES_IN_TRANSIT = 8;
+const int PEER_QUEUED_COMMANDS = 9;     // queued, not yet sent
+
+inline double peer_stat(ENetPeer* peer, int field) {
+    if (!peer) return 0.0;
+    switch (field) {
+        case PEER_RTT: return (double)peer->roundTripTime;
+        case PEER_RTT_VARIANCE: return (double)peer->roundTripTimeVariance;
+        case PEER_PACKET_LOSS: return (double)peer->packetLoss / (double)ENET_PEER_PACKET_LOSS_SCALE;
+        case PEER_PACKET_LOSS_VARIANCE:
+            return (double)peer->packetLossVariance / (double)ENET_PEER_PACKET_LOSS_SCALE;
+        case PEER_THROTTLE:
+            return (double)peer->packetThrottle / (double)ENET_PEER_PACKET_THROTTLE_SCALE;
+        case PEER_BYTES_SENT: return (double)peer->totalDataSent;
+        case PEER_BYTES_RECEIVED: return (double)peer->totalDataReceived;
+        case PEER_RELIABLE_IN_FLIGHT: return (double)enet_list_size(&peer->sentReliableCommands);
+        case PEER_RELIABLE_BYTES_IN_TRANSIT: return (double)peer->reliableDataInTransit;
+        case PEER_QUEUED_COMMANDS:
+            return (double)(enet_list_size(&peer->outgoingCommands)
+                            + enet_list_size(&peer->outgoingSendReliableCommands));
+    }
+    return 0.0;
+}
+
 // [POINTER ARITHMETIC] peer - peer->host->peers
 inline uint32_t get_peer_id(ENetPeer* peer) {
     if (peer && peer->host) {
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <jank/runtime/context.hpp>
+#include <jank/runtime/obj/deferred_cpp_function.hpp>
+#include <jank/runtime/obj/symbol.hpp>
+#include <jank/runtime/rtti.hpp>
+
+#include <cstdio>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace epreload {
+
+// ============================================================================
+// Deferred function realization
+// ============================================================================
+// JIT-loaded defns start as deferred_cpp_function and compile on first
+// call; realizing a namespace compiles them all now instead.
+
+inline int realize_deferred_functions(const char* ns_name) {
+    auto const ns = jank::runtime::__rt_ctx->find_ns(
+        jank::runtime::make_box<jank::runtime::obj::symbol>(ns_name));
+    if (ns.is_nil()) return 0;
+
+    int realized = 0;
+    auto const mappings = ns->get_mappings();
+    for (auto const& entry : mappings->data) {
+        auto const var = jank::runtime::try_object<jank::runtime::var>(entry.second);
+        if (var.is_nil()) continue;
+
+        auto const root = var->deref();
+        if (root.get_type() != jank::runtime::object_type::deferred_cpp_function) continue;
+
+        jank::runtime::expect_object<jank::runtime::obj::deferred_cpp_function>(root)->realize();
+        ++realized;
+    }
+    return realized;
+}
+
+// ============================================================================
+// Lazy preload queue
+// ============================================================================
+// Namespaces left for the game loop to load a few at a time (:preload
+// :lazy). The JIT context is single-threaded, so this runs in per-frame
+// slices on the main thread rather than on a thread of its own. The order
+// they were finished in, with the ones the game reached first up front,
+// is saved for the next launch.
+
+struct LazyQueue {
+    std::deque<std::string> pending;
+    std::vector<std::string> first_use;  // Loaded by the game before the queue got there
+    std::vector<std::string> realized;
+    std::string order_path;
+};
+
+inline LazyQueue& lazy_queue() {
+    static LazyQueue q;
+    return q;
+}
+
+inline void lazy_begin(const char* order_path) {
+    LazyQueue& q = lazy_queue();
+    q = LazyQueue();
+    q.order_path = order_path;
+}
+
+inline void lazy_push(const char* ns_name) {
+    lazy_queue().pending.push_back(ns_name);
+}
+
+inline int lazy_pending_count() {
+    return (int)lazy_queue().pending.size();
+}
+
+// Next namespace to load; "" when done
+inline std::string lazy_next() {
+    LazyQueue& q = lazy_queue();
+    return q.pending.empty() ? std::string() : q.pending.front();
+}
+
+inline void lazy_pop(bool first_use) {
+    LazyQueue& q = lazy_queue();
+    if (q.pending.empty()) return;
+    (first_use ? q.first_use : q.realized).push_back(q.pending.front());
+    q.pending.pop_front();
+}
+
+// Write the order as an EDN vector of strings, first-use namespaces first
+inline bool lazy_save_order() {
+    LazyQueue& q = lazy_queue();
+    if (q.order_path.empty()) return false;
+    FILE* f = std::fopen(q.order_path.c_str(), "w");
+    if (!f) return false;
+    std::fprintf(f, "[");
+    for (const auto* list : {&q.first_use, &q.realized}) {
+        for (const std::string& ns : *list) std::fprintf(f, "\n \"%s\"", ns.c_str());
+    }
+    std::fprintf(f, "]\n");
+    std::fclose(f);
+    return true;
+}
+
+} // namespace epreload
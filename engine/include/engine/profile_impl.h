@@ -0,0 +1,229 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "engine/timing_impl.h"
+
+namespace eprofile {
+
+// ============================================================================
+// Scoped frame profiler
+// ============================================================================
+// Zones are named once (zone_id) and timed with zone_begin/zone_end, or a
+// Zone on the stack (EPROFILE_ZONE). Each thread writes finished zones to
+// its own ring with a release store of the write count, so recording takes
+// no lock; frame_mark on the main thread drains every ring. The main
+// thread's outermost zones become the frame's phases (for the overlay) and,
+// while capturing, every zone goes to the capture for Chrome trace export
+// (chrome://tracing, Perfetto).
+
+const uint64_t RING_EVENTS = 1 << 15;  // Per thread; older zones are lost past this per frame
+
+struct Event {
+    int zone;
+    int depth;
+    double start_ms;
+    double end_ms;
+};
+
+struct ThreadBuffer {
+    std::vector<Event> ring = std::vector<Event>(RING_EVENTS);
+    std::atomic<uint64_t> written{0};
+    uint64_t read = 0;                   // Main thread only
+    int tid = 0;
+    int depth = 0;
+};
+
+struct Phase {
+    int zone;
+    double ms;
+};
+
+struct TraceEvent {
+    int zone;
+    int tid;
+    double start_ms;
+    double dur_ms;
+};
+
+struct Profiler {
+    std::mutex mutex;                    // Zone names and thread registration
+    std::vector<std::string> names;
+    std::unordered_map<std::string, int> ids;
+    std::vector<ThreadBuffer*> threads;
+    ThreadBuffer* main = nullptr;        // The thread calling frame_mark
+    // Last finished frame
+    double frame_start_ms = 0.0;
+    double frame_ms = 0.0;
+    std::vector<Phase> phases;
+    std::vector<Phase> building;
+    std::vector<Phase> gpu_phases;       // From GPU timers, a few frames late
+    std::vector<Phase> gpu_building;
+    // Capture
+    bool capturing = false;
+    double capture_origin_ms = 0.0;
+    std::vector<TraceEvent> capture;
+};
+
+inline Profiler& profiler() {
+    static Profiler p;
+    return p;
+}
+
+inline ThreadBuffer* thread_buffer() {
+    thread_local ThreadBuffer* buffer = nullptr;
+    if (!buffer) {
+        // Never freed: the main thread may still be draining it
+        buffer = new ThreadBuffer();
+        Profiler& p = profiler();
+        std::lock_guard<std::mutex> lock(p.mutex);
+        buffer->tid = (int)p.threads.size() + 1;
+        p.threads.push_back(buffer);
+    }
+    return buffer;
+}
+
+// Id for a zone name; look it up once per call site
+inline int zone_id(const char* name) {
+    Profiler& p = profiler();
+    std::lock_guard<std::mutex> lock(p.mutex);
+    auto it = p.ids.find(name);
+    if (it != p.ids.end()) return it->second;
+    int id = (int)p.names.size();
+    p.names.push_back(name);
+    p.ids.emplace(name, id);
+    return id;
+}
+
+inline std::string zone_name(int zone) {
+    Profiler& p = profiler();
+    std::lock_guard<std::mutex> lock(p.mutex);
+    return zone >= 0 && zone < (int)p.names.size() ? p.names[zone] : std::string();
+}
+
+inline double zone_begin() {
+    ++thread_buffer()->depth;
+    return etiming::now_ms();
+}
+
+inline void zone_end(int zone, double start_ms) {
+    double end = etiming::now_ms();
+    ThreadBuffer* b = thread_buffer();
+    int depth = --b->depth;
+    uint64_t n = b->written.load(std::memory_order_relaxed);
+    b->ring[n % RING_EVENTS] = {zone, depth, start_ms, end};
+    b->written.store(n + 1, std::memory_order_release);
+}
+
+struct Zone {
+    int zone;
+    double start;
+    explicit Zone(int id) : zone(id), start(zone_begin()) {}
+    ~Zone() { zone_end(zone, start); }
+    Zone(const Zone&) = delete;
+    Zone& operator=(const Zone&) = delete;
+};
+
+#define EPROFILE_CONCAT_(a, b) a##b
+#define EPROFILE_CONCAT(a, b) EPROFILE_CONCAT_(a, b)
+// Time the rest of the enclosing scope as name (a string literal)
+#define EPROFILE_ZONE(name)                                                          \
+    static const int EPROFILE_CONCAT(eprofile_id_, __LINE__) = eprofile::zone_id(name); \
+    eprofile::Zone EPROFILE_CONCAT(eprofile_zone_, __LINE__)(EPROFILE_CONCAT(eprofile_id_, __LINE__))
+
+// GPU time for a pass (main thread; see egltimer), shown with the next
+// frame_mark's phases
+inline void gpu_record(int zone, double ms) {
+    profiler().gpu_building.push_back({zone, ms});
+}
+
+// Close the frame: drain every thread's ring, total the main thread's
+// outermost zones into phases, and keep everything while capturing
+inline void frame_mark() {
+    Profiler& p = profiler();
+    if (!p.main) p.main = thread_buffer();
+    double now = etiming::now_ms();
+    if (p.frame_start_ms > 0.0) p.frame_ms = now - p.frame_start_ms;
+    p.frame_start_ms = now;
+
+    std::vector<ThreadBuffer*> threads;
+    {
+        std::lock_guard<std::mutex> lock(p.mutex);
+        threads = p.threads;
+    }
+    p.building.clear();
+    for (ThreadBuffer* b : threads) {
+        uint64_t written = b->written.load(std::memory_order_acquire);
+        if (written - b->read > RING_EVENTS) b->read = written - RING_EVENTS;
+        for (; b->read < written; ++b->read) {
+            const Event& e = b->ring[b->read % RING_EVENTS];
+            if (b == p.main && e.depth == 0) {
+                bool found = false;
+                for (Phase& ph : p.building) {
+                    if (ph.zone == e.zone) {
+                        ph.ms += e.end_ms - e.start_ms;
+                        found = true;
+                        break;
+                    }
+                }
+                if (!found) p.building.push_back({e.zone, e.end_ms - e.start_ms});
+            }
+            if (p.capturing) {
+                p.capture.push_back({e.zone, b->tid, e.start_ms, e.end_ms - e.start_ms});
+            }
+        }
+    }
+    p.phases.swap(p.building);
+    if (!p.gpu_building.empty()) {
+        p.gpu_phases.swap(p.gpu_building);
+        p.gpu_building.clear();
+    }
+}
+
+inline double frame_ms() { return profiler().frame_ms; }
+inline int phase_count() { return (int)profiler().phases.size(); }
+inline int phase_zone(int i) { return profiler().phases[i].zone; }
+inline double phase_ms(int i) { return profiler().phases[i].ms; }
+inline int gpu_phase_count() { return (int)profiler().gpu_phases.size(); }
+inline int gpu_phase_zone(int i) { return profiler().gpu_phases[i].zone; }
+inline double gpu_phase_ms(int i) { return profiler().gpu_phases[i].ms; }
+
+inline void capture_begin() {
+    Profiler& p = profiler();
+    p.capture.clear();
+    p.capturing = true;
+    p.capture_origin_ms = etiming::now_ms();
+}
+
+inline bool capturing() { return profiler().capturing; }
+
+// Stop capturing and write what was captured as Chrome trace JSON
+inline bool capture_end(const char* path) {
+    Profiler& p = profiler();
+    p.capturing = false;
+    FILE* f = std::fopen(path, "w");
+    if (!f) {
+        std::printf("Can't write profile trace: %s\n", path);
+        return false;
+    }
+    std::fprintf(f, "{\"traceEvents\":[");
+    for (size_t i = 0; i < p.capture.size(); ++i) {
+        const TraceEvent& e = p.capture[i];
+        std::fprintf(f, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.1f,\"dur\":%.1f,\"pid\":1,\"tid\":%d}",
+                     i ? "," : "", etiming::json_escape(zone_name(e.zone)).c_str(),
+                     (e.start_ms - p.capture_origin_ms) * 1000.0, e.dur_ms * 1000.0, e.tid);
+    }
+    std::fprintf(f, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    std::fclose(f);
+    std::printf("Profile trace: %s (%zu zones)\n", path, p.capture.size());
+    p.capture.clear();
+    return true;
+}
+
+} // namespace eprofile
@@ -0,0 +1,78 @@
+#pragma once
+#include "level_bake.h"
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// ============ POTENTIALLY VISIBLE SET ============
+// A baked level's cluster visibility (level_bake.h, built by
+// tools/levelbake). Points map to grid clusters; a cluster sees the ones
+// whose bits are set in its row. Anything outside the grid (no cluster,
+// -1) is treated as visible from everywhere and sees everything, so a
+// player flying above the level or geometry past its bounds is never
+// wrongly hidden. Read-only once loaded; safe to query from any thread.
+
+namespace epvs {
+
+struct Pvs {
+  LevelPvsGrid grid;
+  std::vector<uint8_t> bits;           // row_bytes per cluster
+};
+
+inline int cluster_count(const Pvs* p) {
+  return (int)(p->grid.dims[0] * p->grid.dims[1] * p->grid.dims[2]);
+}
+
+inline int cell_coord(const Pvs* p, float v, int axis) {
+  return (int)std::floor((v - p->grid.origin[axis]) / p->grid.cell_size);
+}
+
+// Cluster containing (x, y, z), or -1 outside the grid
+inline int pvs_cluster(const Pvs* p, float x, float y, float z) {
+  if (!p) return -1;
+  int c[3] = {cell_coord(p, x, 0), cell_coord(p, y, 1), cell_coord(p, z, 2)};
+  for (int k = 0; k < 3; ++k) {
+    if (c[k] < 0 || c[k] >= (int)p->grid.dims[k]) return -1;
+  }
+  return c[0] + (int)p->grid.dims[0] * (c[1] + (int)p->grid.dims[1] * c[2]);
+}
+
+inline bool pvs_visible(const Pvs* p, int from, int to) {
+  if (!p || from < 0 || to < 0) return true;
+  return (p->bits[(size_t)from * p->grid.row_bytes + (size_t)(to >> 3)] >> (to & 7)) & 1;
+}
+
+inline bool pvs_point_visible(const Pvs* p, float fx, float fy, float fz,
+                              float tx, float ty, float tz) {
+  return pvs_visible(p, pvs_cluster(p, fx, fy, fz), pvs_cluster(p, tx, ty, tz));
+}
+
+// Whether any cluster a box overlaps is visible from cluster from. Boxes
+// reaching outside the grid count as visible.
+inline bool pvs_box_visible(const Pvs* p, int from, const glm::vec3& lo, const glm::vec3& hi) {
+  if (!p || from < 0) return true;
+  int c0[3], c1[3];
+  for (int k = 0; k < 3; ++k) {
+    c0[k] = cell_coord(p, lo[k], k);
+    c1[k] = cell_coord(p, hi[k], k);
+    if (c0[k] < 0 || c1[k] >= (int)p->grid.dims[k]) return true;
+  }
+  const uint8_t* row = p->bits.data() + (size_t)from * p->grid.row_bytes;
+  for (int z = c0[2]; z <= c1[2]; ++z) {
+    for (int y = c0[1]; y <= c1[1]; ++y) {
+      for (int x = c0[0]; x <= c1[0]; ++x) {
+        int to = x + (int)p->grid.dims[0] * (y + (int)p->grid.dims[1] * z);
+        if ((row[to >> 3] >> (to & 7)) & 1) return true;
+      }
+    }
+  }
+  return false;
+}
+
+inline void destroy_pvs(Pvs* p) {
+  delete p;
+}
+
+} // namespace epvs
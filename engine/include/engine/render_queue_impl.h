@@ -0,0 +1,955 @@
+#pragma once
+#include "gl_wrappers.h"
+#include "engine/gl_state_impl.h"
+#include "engine/frame_arena_impl.h"
+#include "engine/profile_impl.h"
+#include "engine/gl_timer_impl.h"
+#include "engine/pvs_impl.h"
+#include "engine/shaders_impl.h"
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// ============ RENDER QUEUE ============
+// Deferred draws for engine.gfx3d.render. A frame records packets (program,
+// texture, VAO, draw range, uniforms) between queue_begin and queue_flush;
+// the flush culls them against the view frustum, sorts opaque packets by
+// state (program, texture, VAO, range), merges neighbours that draw
+// adjacent ranges with identical state, then executes them through the GL
+// state cache. Opaque indexed ranges left with identical state but gaps
+// between them (a merged level's visible primitives) go down as one
+// multi-draw. Blended packets go last, in submission order.
+//
+// Where GL 4.3 or ARB_multi_draw_indirect is available, the flush writes
+// every multi-draw's surviving ranges as draw commands into one indirect
+// buffer (a single upload a frame) and issues each run with
+// glMultiDrawElementsIndirect, so the GL calls don't grow with the visible
+// primitive count. Elsewhere (macOS stops at 4.1) the same commands go
+// through glMultiDrawElements.
+//
+// Packets may carry a base vertex (queue_base_vertex), added to every index
+// they draw: meshes suballocated from a shared pool (geometry_pool_impl.h)
+// all draw from one VAO, so they sort together and multi-draw like ranges
+// of one mesh.
+//
+// Uniforms are recorded the way GL keeps them: per program and sticky, so a
+// value set once applies to every later packet of that program. Each packet
+// points at the program's uniform snapshot at the time it was submitted;
+// the flush re-applies a snapshot only when it changes. Per-frame constants
+// (projection, view) can still be set on the program directly before the
+// flush, but anything that varies between packets must go through the queue.
+//
+// A culled frame can also be given a level's PVS and the eye's cluster
+// (queue_pvs); bounded packets in no cluster visible from there are culled
+// along with those outside the frustum.
+//
+// Meshes with LOD chains (index ranges of one VAO, coarsest last, each
+// with its simplification error) pick a level per frame from the eye and
+// pixel scale given by queue_lod: the coarsest whose error projects to at
+// most one allowed pixel at the mesh's box. Switching needs the projection
+// to clear the threshold by LOD_HYSTERESIS either way, so a mesh at a
+// boundary doesn't flip every frame. A chain may cross-fade over
+// LOD_FADE_FRAMES: both levels are drawn, complementary halves of a
+// screen-door dither (the program's fade uniform, see basic_fragment.glsl).
+//
+// With queue_texture_usage set for the frame, every bounded 2D-textured
+// packet that survives culling also notes how many pixels its bounds span
+// on screen; texture streaming (texture_stream_impl.h) reads the frame's
+// usage to pick which mip levels to keep resident.
+//
+// With queue_gpu_cull on and compute shaders available (GL 4.3), bounded
+// packets that can join a multi-draw skip the frustum test at submit: the
+// flush uploads each command's box next to the commands and a compute pass
+// (cull_compute.glsl) tests them all, writing the survivors into the
+// indirect buffer the draws read. Where the draw count can come from a
+// buffer (ARB_indirect_parameters) survivors are packed to the front of
+// their run; elsewhere culled commands keep their slot with no instances.
+// The PVS test stays on the CPU, and a deferred packet that ends up in no
+// multi-draw is frustum tested at the flush. Without compute the CPU tests
+// everything as before. GPU-culled ranges aren't known on the CPU: they
+// count as visible in the stats (triangles included) and report texture
+// usage as if drawn.
+
+namespace erender {
+
+enum UniformKind : unsigned char { U_1I, U_1F, U_3F, U_4F, U_MAT4 };
+
+struct QueuedUniform {
+  GLint location;
+  UniformKind kind;
+  GLint i;
+  float v[16];
+};
+
+inline bool uniform_equal(const QueuedUniform& a, const QueuedUniform& b) {
+  if (a.kind != b.kind) return false;
+  switch (a.kind) {
+    case U_1I: return a.i == b.i;
+    case U_1F: return a.v[0] == b.v[0];
+    case U_3F: return std::memcmp(a.v, b.v, 3 * sizeof(float)) == 0;
+    case U_4F: return std::memcmp(a.v, b.v, 4 * sizeof(float)) == 0;
+    case U_MAT4: return std::memcmp(a.v, b.v, 16 * sizeof(float)) == 0;
+  }
+  return false;
+}
+
+// A program's uniform values while recording
+struct ProgramUniformState {
+  GLuint program;
+  std::vector<QueuedUniform> values;   // One per location, in set order
+  int snapshot = -1;                   // -1: changed since last snapshot
+};
+
+struct Snapshot {
+  size_t first;                        // Into RenderQueue::snapshot_uniforms
+  size_t count;
+};
+
+// World-space bounds of the next packet
+enum BoundsKind : unsigned char { BOUNDS_NONE, BOUNDS_SPHERE, BOUNDS_BOX };
+
+struct Bounds {
+  BoundsKind kind = BOUNDS_NONE;       // NONE: never culled
+  glm::vec3 lo;                        // Box min, or sphere centre
+  glm::vec3 hi;                        // Box max
+  float radius = 0.0f;
+};
+
+struct Packet {
+  GLuint program;
+  GLuint texture;                      // On unit 0; 0 = none
+  GLenum texture_target;               // GL_TEXTURE_2D, or GL_TEXTURE_2D_ARRAY
+  GLuint vao;
+  GLenum mode;
+  GLenum index_type;                   // 0 for glDrawArrays
+  GLint first;                         // First vertex or index
+  GLsizei count;
+  GLint base_vertex;                   // Added to each index (pooled meshes)
+  GLsizei instances;                   // 0: not instanced
+  bool blend;
+  int snapshot;
+  uint32_t seq;                        // Submission order
+  Bounds deferred;                     // Frustum test left to the flush; NONE: done
+};
+
+struct QueueStats {
+  int submitted = 0;
+  int culled = 0;
+  int merged = 0;
+  int draws = 0;
+  int uniform_uploads = 0;
+  int triangles = 0;
+  int batched = 0;                     // Ranges drawn by another's multi-draw
+  int gpu_tested = 0;                  // Ranges left to the compute cull
+};
+
+const float LOD_HYSTERESIS = 0.15f;
+const int LOD_FADE_FRAMES = 12;
+
+struct LodLevel {
+  GLint first;                         // In indices
+  GLsizei count;
+  float error;                         // World units; grows along the chain
+};
+
+struct LodChain {
+  std::vector<LodLevel> levels;        // Finest first
+  int current = 0;
+  int fading = -1;                     // Level being faded out, or -1
+  float fade = 1.0f;                   // current's share of the dither
+  bool dither = false;
+};
+
+// glMultiDrawElementsIndirect's command layout
+struct DrawElementsCommand {
+  GLuint count;
+  GLuint instance_count;
+  GLuint first_index;
+  GLint base_vertex;
+  GLuint base_instance;
+};
+
+// A multi-draw command's box for the compute cull (cull_compute.glsl)
+struct CullBox {
+  float lo[4];                         // w: 1 to test, 0 never culled
+  float hi[4];
+};
+
+// The run a command belongs to, and the run's first command
+struct CullRun {
+  GLuint run;
+  GLuint first;
+};
+
+const GLuint CULL_GROUP_SIZE = 64;     // cull_compute.glsl's local_size_x
+
+// A texture drawn this frame, and the screen size it was drawn at
+struct TextureUsage {
+  GLuint texture;
+  float pixels;                        // Its packet's bounds, across
+};
+
+// A flush's unit of work: one packet, or a multi-draw of commands
+struct DrawRun {
+  Packet state;
+  size_t first_command;                // Into the flush's commands
+  GLsizei commands;                    // 0: draw state's own range
+};
+
+inline bool multi_draw_indirect_supported() {
+#ifdef __APPLE__
+  return false;
+#else
+  return GLEW_VERSION_4_3 || GLEW_ARB_multi_draw_indirect;
+#endif
+}
+
+// The compute cull also needs compute shaders and storage buffers
+inline bool gpu_cull_supported() {
+#ifdef __APPLE__
+  return false;
+#else
+  return multi_draw_indirect_supported() &&
+         (GLEW_VERSION_4_3 || (GLEW_ARB_compute_shader && GLEW_ARB_shader_storage_buffer_object));
+#endif
+}
+
+// Draw counts read from a buffer (glMultiDrawElementsIndirectCountARB)
+inline bool indirect_count_supported() {
+#ifdef __APPLE__
+  return false;
+#else
+  return GLEW_ARB_indirect_parameters;
+#endif
+}
+
+// cull_compute.glsl, built on first use; 0 if it doesn't build
+inline GLuint cull_program() {
+  static GLuint program = 0;
+  static bool tried = false;
+#ifndef __APPLE__
+  if (tried) return program;
+  tried = true;
+  GLuint cs = eshaders::compile_shader_from_resource("shaders/cull_compute.glsl", GL_COMPUTE_SHADER);
+  if (!cs) return 0;
+  GLuint p = glCreateProgram();
+  glAttachShader(p, cs);
+  glLinkProgram(p);
+  glDeleteShader(cs);
+  GLint linked = 0;
+  glGetProgramiv(p, GL_LINK_STATUS, &linked);
+  if (!linked) {
+    eshaders::log_link_error(p);
+    glDeleteProgram(p);
+    return 0;
+  }
+  eshaders::reflect_uniforms(p);
+  program = p;
+#else
+  (void)tried;
+#endif
+  return program;
+}
+
+struct RenderQueue {
+  std::vector<Packet> packets;
+  std::vector<ProgramUniformState> programs;
+  std::vector<QueuedUniform> snapshot_uniforms;
+  std::vector<Snapshot> snapshots;
+  std::vector<uint32_t> order;
+  glm::vec4 planes[6];
+  bool cull = false;
+  const epvs::Pvs* pvs = nullptr;      // Set per frame by queue_pvs
+  int pvs_from = -1;                   // The eye's cluster
+  glm::vec3 lod_eye;                   // Set per frame by queue_lod
+  float lod_scale = 0.0f;              // Allowed pixels per unit of error at distance 1; 0: finest
+  glm::vec3 usage_eye;                 // Set per frame by queue_texture_usage
+  float usage_scale = 0.0f;            // Pixels per unit at distance 1; 0: not recorded
+  std::vector<TextureUsage> usage;     // This frame's, until the next begin
+  Bounds next_bounds;
+  GLenum next_texture_target = GL_TEXTURE_2D;
+  GLsizei next_instances = 0;
+  GLint next_base_vertex = 0;
+  QueueStats stats;                    // This frame so far
+  QueueStats last;                     // Last flush
+  int indirect = -1;                   // multi_draw_indirect_supported, once asked
+  GLuint indirect_buffer = 0;
+  size_t indirect_capacity = 0;        // Bytes
+  bool gpu_cull_wanted = false;        // queue_gpu_cull
+  int gpu_cull = -1;                   // gpu_cull_supported and the program built, once asked
+  int indirect_count = -1;             // indirect_count_supported, once asked
+  bool defer_cull = false;             // This frame leaves multi-draw ranges to the GPU
+  GLuint cull_boxes = 0;               // Compute cull inputs and outputs, grown as needed
+  size_t cull_boxes_capacity = 0;
+  GLuint cull_runs = 0;
+  size_t cull_runs_capacity = 0;
+  GLuint culled_buffer = 0;            // The draws' indirect buffer when culled on the GPU
+  size_t culled_capacity = 0;
+  GLuint count_buffer = 0;
+  size_t count_capacity = 0;
+};
+
+inline RenderQueue* create_queue() {
+  return new RenderQueue();
+}
+
+inline void destroy_queue(RenderQueue* q) {
+  for (GLuint buffer : {q->indirect_buffer, q->cull_boxes, q->cull_runs, q->culled_buffer,
+                        q->count_buffer}) {
+    if (!buffer) continue;
+    eglstate::forget_buffer(buffer);
+    glDeleteBuffers(1, &buffer);
+  }
+  delete q;
+}
+
+// Start a frame without culling
+inline void queue_begin(RenderQueue* q) {
+  q->packets.clear();
+  q->programs.clear();
+  q->snapshot_uniforms.clear();
+  q->snapshots.clear();
+  q->cull = false;
+  q->defer_cull = false;
+  q->pvs = nullptr;
+  q->pvs_from = -1;
+  q->lod_scale = 0.0f;
+  q->usage_scale = 0.0f;
+  q->usage.clear();
+  q->next_bounds = Bounds();
+  q->next_texture_target = GL_TEXTURE_2D;
+  q->next_instances = 0;
+  q->next_base_vertex = 0;
+  q->stats = QueueStats();
+}
+
+// Start a frame, culling bounded packets outside the view frustum
+inline void queue_begin_culled(RenderQueue* q, const glm::mat4& projection, const glm::mat4& view) {
+  queue_begin(q);
+  // Gribb-Hartmann: planes from the rows of the combined matrix
+  glm::mat4 m = glm::transpose(projection * view);
+  q->planes[0] = m[3] + m[0];
+  q->planes[1] = m[3] - m[0];
+  q->planes[2] = m[3] + m[1];
+  q->planes[3] = m[3] - m[1];
+  q->planes[4] = m[3] + m[2];
+  q->planes[5] = m[3] - m[2];
+  for (glm::vec4& p : q->planes) {
+    float len = glm::length(glm::vec3(p));
+    if (len > 0.0f) p /= len;
+  }
+  q->cull = true;
+  if (q->gpu_cull_wanted && q->gpu_cull < 0) {
+    q->gpu_cull = gpu_cull_supported() && cull_program() ? 1 : 0;
+  }
+  q->defer_cull = q->gpu_cull_wanted && q->gpu_cull == 1;
+}
+
+// Leave multi-draw ranges' frustum test to a compute pass where GL can run
+// one; the CPU tests them otherwise. From the next queue_begin_culled.
+inline void queue_gpu_cull(RenderQueue* q, bool on) {
+  q->gpu_cull_wanted = on;
+}
+
+// Also cull by pvs (nullptr: don't) as seen from the eye at (x, y, z).
+// Call after queue_begin_culled.
+inline void queue_pvs(RenderQueue* q, const epvs::Pvs* pvs, float x, float y, float z) {
+  q->pvs = pvs;
+  q->pvs_from = epvs::pvs_cluster(pvs, x, y, z);
+}
+
+// Pick LOD chain levels for the eye at (x, y, z) this frame. pixels_per_unit
+// is the viewport's pixels per unit at distance 1 (height / (2 tan(fov/2)))
+// over the error allowed in pixels. Without it, chains draw their finest.
+inline void queue_lod(RenderQueue* q, float x, float y, float z, float pixels_per_unit) {
+  q->lod_eye = glm::vec3(x, y, z);
+  q->lod_scale = pixels_per_unit > 0.0f ? pixels_per_unit : 0.0f;
+}
+
+// Record this frame's texture usage as seen from the eye at (x, y, z).
+// pixels_per_unit is the viewport's pixels per unit at distance 1
+// (height / (2 tan(fov/2))).
+inline void queue_texture_usage(RenderQueue* q, float x, float y, float z, float pixels_per_unit) {
+  q->usage_eye = glm::vec3(x, y, z);
+  q->usage_scale = pixels_per_unit > 0.0f ? pixels_per_unit : 0.0f;
+}
+
+inline int usage_count(const RenderQueue* q) { return (int)q->usage.size(); }
+
+// ---- Recording uniforms ----
+
+inline ProgramUniformState& program_state(RenderQueue* q, GLuint program) {
+  for (ProgramUniformState& s : q->programs) {
+    if (s.program == program) return s;
+  }
+  q->programs.push_back(ProgramUniformState{program, {}, -1});
+  return q->programs.back();
+}
+
+inline void record_uniform(RenderQueue* q, GLuint program, const QueuedUniform& u) {
+  if (u.location < 0) return;
+  ProgramUniformState& s = program_state(q, program);
+  for (QueuedUniform& held : s.values) {
+    if (held.location == u.location) {
+      if (!uniform_equal(held, u)) {
+        held = u;
+        s.snapshot = -1;
+      }
+      return;
+    }
+  }
+  s.values.push_back(u);
+  s.snapshot = -1;
+}
+
+inline void queue_uniform_1i(RenderQueue* q, GLuint program, GLint location, GLint v) {
+  QueuedUniform u{location, U_1I, v, {}};
+  record_uniform(q, program, u);
+}
+
+inline void queue_uniform_1f(RenderQueue* q, GLuint program, GLint location, float v) {
+  QueuedUniform u{location, U_1F, 0, {v}};
+  record_uniform(q, program, u);
+}
+
+inline void queue_uniform_3f(RenderQueue* q, GLuint program, GLint location,
+                             float x, float y, float z) {
+  QueuedUniform u{location, U_3F, 0, {x, y, z}};
+  record_uniform(q, program, u);
+}
+
+inline void queue_uniform_4f(RenderQueue* q, GLuint program, GLint location,
+                             float x, float y, float z, float w) {
+  QueuedUniform u{location, U_4F, 0, {x, y, z, w}};
+  record_uniform(q, program, u);
+}
+
+inline void queue_uniform_mat4(RenderQueue* q, GLuint program, GLint location, const float* m) {
+  QueuedUniform u{location, U_MAT4, 0, {}};
+  std::memcpy(u.v, m, 16 * sizeof(float));
+  record_uniform(q, program, u);
+}
+
+// ---- Recording draws ----
+
+// Bounding sphere of the next submitted packet (world space)
+inline void queue_bounds(RenderQueue* q, float x, float y, float z, float radius) {
+  q->next_bounds.kind = BOUNDS_SPHERE;
+  q->next_bounds.lo = glm::vec3(x, y, z);
+  q->next_bounds.radius = radius;
+}
+
+// Axis-aligned bounding box of the next submitted packet (world space)
+inline void queue_box(RenderQueue* q, float min_x, float min_y, float min_z,
+                      float max_x, float max_y, float max_z) {
+  q->next_bounds.kind = BOUNDS_BOX;
+  q->next_bounds.lo = glm::vec3(min_x, min_y, min_z);
+  q->next_bounds.hi = glm::vec3(max_x, max_y, max_z);
+}
+
+// The next submitted packet's texture is a GL_TEXTURE_2D_ARRAY
+inline void queue_texture_array(RenderQueue* q) {
+  q->next_texture_target = GL_TEXTURE_2D_ARRAY;
+}
+
+// Draw the next submitted packet as instances copies (glDraw*Instanced).
+// Instanced packets are never merged or batched with others.
+inline void queue_instances(RenderQueue* q, GLsizei instances) {
+  q->next_instances = instances;
+}
+
+// Indices of the next submitted packet count from vertex base (a mesh in a
+// geometry pool)
+inline void queue_base_vertex(RenderQueue* q, GLint base) {
+  q->next_base_vertex = base;
+}
+
+// b's box (a sphere's is the cube around it)
+inline void bounds_box(const Bounds& b, glm::vec3* lo, glm::vec3* hi) {
+  *lo = b.lo;
+  *hi = b.hi;
+  if (b.kind == BOUNDS_SPHERE) {
+    *lo = b.lo - glm::vec3(b.radius);
+    *hi = b.lo + glm::vec3(b.radius);
+  }
+}
+
+// The box around both; NONE (never culled) if either is
+inline Bounds bounds_union(const Bounds& a, const Bounds& b) {
+  if (a.kind == BOUNDS_NONE || b.kind == BOUNDS_NONE) return Bounds();
+  glm::vec3 alo, ahi, blo, bhi;
+  bounds_box(a, &alo, &ahi);
+  bounds_box(b, &blo, &bhi);
+  Bounds u;
+  u.kind = BOUNDS_BOX;
+  u.lo = glm::min(alo, blo);
+  u.hi = glm::max(ahi, bhi);
+  return u;
+}
+
+// Outside = fully behind some plane. For a box that's its corner furthest
+// along the plane normal.
+inline bool bounds_in_frustum(const RenderQueue* q, const Bounds& b) {
+  for (const glm::vec4& p : q->planes) {
+    glm::vec3 n(p);
+    if (b.kind == BOUNDS_SPHERE) {
+      if (glm::dot(n, b.lo) + p.w < -b.radius) return false;
+    } else {
+      glm::vec3 far(n.x >= 0.0f ? b.hi.x : b.lo.x,
+                    n.y >= 0.0f ? b.hi.y : b.lo.y,
+                    n.z >= 0.0f ? b.hi.z : b.lo.z);
+      if (glm::dot(n, far) + p.w < 0.0f) return false;
+    }
+  }
+  return true;
+}
+
+inline bool bounds_in_pvs(const RenderQueue* q, const Bounds& b) {
+  if (!q->pvs || q->pvs_from < 0) return true;
+  glm::vec3 lo, hi;
+  bounds_box(b, &lo, &hi);
+  return epvs::pvs_box_visible(q->pvs, q->pvs_from, lo, hi);
+}
+
+inline bool bounds_visible(const RenderQueue* q, const Bounds& b) {
+  return bounds_in_frustum(q, b) && bounds_in_pvs(q, b);
+}
+
+// Pixels across b's extent from the usage eye (an eye inside it: very close)
+inline float bounds_pixels(const RenderQueue* q, const Bounds& b) {
+  glm::vec3 lo, hi;
+  bounds_box(b, &lo, &hi);
+  glm::vec3 out = glm::max(glm::max(lo - q->usage_eye, q->usage_eye - hi), glm::vec3(0.0f));
+  float distance = std::max(glm::length(out), 0.01f);
+  return glm::length(hi - lo) * q->usage_scale / distance;
+}
+
+inline int program_snapshot(RenderQueue* q, GLuint program) {
+  ProgramUniformState& s = program_state(q, program);
+  if (s.snapshot < 0) {
+    s.snapshot = (int)q->snapshots.size();
+    q->snapshots.push_back(Snapshot{q->snapshot_uniforms.size(), s.values.size()});
+    q->snapshot_uniforms.insert(q->snapshot_uniforms.end(), s.values.begin(), s.values.end());
+  }
+  return s.snapshot;
+}
+
+inline void submit(RenderQueue* q, GLuint program, GLuint vao, GLuint texture,
+                   GLenum mode, GLenum index_type, GLint first, GLsizei count, bool blend) {
+  Bounds bounds = q->next_bounds;
+  GLenum texture_target = q->next_texture_target;
+  GLsizei instances = q->next_instances;
+  GLint base_vertex = q->next_base_vertex;
+  q->next_bounds = Bounds();
+  q->next_texture_target = GL_TEXTURE_2D;
+  q->next_instances = 0;
+  q->next_base_vertex = 0;
+  if (count <= 0) return;
+  ++q->stats.submitted;
+  // Ranges that may join a multi-draw can leave the frustum to the GPU
+  bool defer = q->defer_cull && bounds.kind != BOUNDS_NONE && index_type != 0 &&
+               instances == 0 && !blend;
+  if (q->cull && bounds.kind != BOUNDS_NONE &&
+      !(defer ? bounds_in_pvs(q, bounds) : bounds_visible(q, bounds))) {
+    ++q->stats.culled;
+    return;
+  }
+  if (q->usage_scale > 0.0f && texture && texture_target == GL_TEXTURE_2D &&
+      bounds.kind != BOUNDS_NONE) {
+    q->usage.push_back(TextureUsage{texture, bounds_pixels(q, bounds)});
+  }
+  Packet p;
+  p.program = program;
+  p.texture = texture;
+  p.texture_target = texture_target;
+  p.vao = vao;
+  p.mode = mode;
+  p.index_type = index_type;
+  p.first = first;
+  p.count = count;
+  p.base_vertex = base_vertex;
+  p.instances = instances;
+  p.blend = blend;
+  p.snapshot = program_snapshot(q, program);
+  p.seq = (uint32_t)q->packets.size();
+  p.deferred = defer ? bounds : Bounds();
+  q->packets.push_back(p);
+}
+
+// Indexed draw; first is in indices (GL_UNSIGNED_INT or GL_UNSIGNED_SHORT)
+inline void queue_elements(RenderQueue* q, GLuint program, GLuint vao, GLuint texture,
+                           GLenum mode, GLsizei count, GLenum index_type, GLint first,
+                           bool blend) {
+  submit(q, program, vao, texture, mode, index_type, first, count, blend);
+}
+
+inline void queue_arrays(RenderQueue* q, GLuint program, GLuint vao, GLuint texture,
+                         GLenum mode, GLint first, GLsizei count, bool blend) {
+  submit(q, program, vao, texture, mode, 0, first, count, blend);
+}
+
+// ---- LOD chains ----
+
+inline LodChain* create_lod_chain(bool dither) {
+  LodChain* c = new LodChain();
+  c->dither = dither;
+  return c;
+}
+
+inline void destroy_lod_chain(LodChain* c) {
+  delete c;
+}
+
+inline void lod_chain_add(LodChain* c, GLint first, GLsizei count, float error) {
+  float floor = c->levels.empty() ? 0.0f : c->levels.back().error;
+  c->levels.push_back(LodLevel{first, count, std::max(error, floor)});
+}
+
+// Advance c's level for a mesh with world box lo..hi; call once a frame
+inline int lod_select(const RenderQueue* q, LodChain* c, const glm::vec3& lo, const glm::vec3& hi) {
+  int n = (int)c->levels.size();
+  int next = 0;
+  if (q->lod_scale > 0.0f && n > 1) {
+    glm::vec3 out = glm::max(glm::max(lo - q->lod_eye, q->lod_eye - hi), glm::vec3(0.0f));
+    float distance = glm::length(out);
+    // Coarsest level to switch down to, and coarsest still kept
+    int coarser = 0, keep = 0;
+    for (int i = 1; i < n; ++i) {
+      float pixels = c->levels[i].error * q->lod_scale;
+      if (pixels * (1.0f + LOD_HYSTERESIS) <= distance) coarser = i;
+      if (pixels * (1.0f - LOD_HYSTERESIS) <= distance) keep = i;
+    }
+    next = std::min(std::max(std::min(c->current, n - 1), coarser), keep);
+  }
+  if (next != c->current) {
+    c->fading = c->dither ? c->current : -1;
+    c->fade = 0.0f;
+    c->current = next;
+  }
+  if (c->fading >= 0) {
+    c->fade += 1.0f / (float)LOD_FADE_FRAMES;
+    if (c->fade >= 1.0f) c->fading = -1;
+  }
+  if (c->fading < 0) c->fade = 1.0f;
+  return c->current;
+}
+
+// Queue c's level for this frame (lod_select over the box) as indexed
+// triangles; while it cross-fades the level it's leaving too, each through
+// fade_location (the float uniform the dither reads, reset to 0 after)
+inline void queue_lod_elements(RenderQueue* q, GLuint program, GLint fade_location, GLuint vao,
+                               GLuint texture, GLenum index_type, LodChain* c,
+                               float min_x, float min_y, float min_z,
+                               float max_x, float max_y, float max_z) {
+  GLenum texture_target = q->next_texture_target;
+  GLint base_vertex = q->next_base_vertex;
+  q->next_texture_target = GL_TEXTURE_2D;
+  q->next_base_vertex = 0;
+  if (c->levels.empty()) return;
+  glm::vec3 lo(min_x, min_y, min_z), hi(max_x, max_y, max_z);
+  int level = lod_select(q, c, lo, hi);
+  const LodLevel& l = c->levels[level];
+  if (c->fading < 0) {
+    queue_box(q, min_x, min_y, min_z, max_x, max_y, max_z);
+    q->next_texture_target = texture_target;
+    q->next_base_vertex = base_vertex;
+    submit(q, program, vao, texture, GL_TRIANGLES, index_type, l.first, l.count, false);
+    return;
+  }
+  const LodLevel& old = c->levels[c->fading];
+  queue_uniform_1f(q, program, fade_location, c->fade);
+  queue_box(q, min_x, min_y, min_z, max_x, max_y, max_z);
+  q->next_texture_target = texture_target;
+  q->next_base_vertex = base_vertex;
+  submit(q, program, vao, texture, GL_TRIANGLES, index_type, l.first, l.count, false);
+  queue_uniform_1f(q, program, fade_location, -c->fade);
+  queue_box(q, min_x, min_y, min_z, max_x, max_y, max_z);
+  q->next_texture_target = texture_target;
+  q->next_base_vertex = base_vertex;
+  submit(q, program, vao, texture, GL_TRIANGLES, index_type, old.first, old.count, false);
+  queue_uniform_1f(q, program, fade_location, 0.0f);
+}
+
+// ---- Flush ----
+
+inline size_t index_size(GLenum type) {
+  return type == GL_UNSIGNED_SHORT ? 2 : type == GL_UNSIGNED_BYTE ? 1 : 4;
+}
+
+inline bool packet_before(const Packet& a, const Packet& b) {
+  // Opaque before blended; blended keep submission order
+  if (a.blend != b.blend) return !a.blend;
+  if (a.blend) return a.seq < b.seq;
+  if (a.program != b.program) return a.program < b.program;
+  if (a.texture != b.texture) return a.texture < b.texture;
+  if (a.vao != b.vao) return a.vao < b.vao;
+  if (a.snapshot != b.snapshot) return a.snapshot < b.snapshot;
+  if (a.base_vertex != b.base_vertex) return a.base_vertex < b.base_vertex;
+  if (a.first != b.first) return a.first < b.first;
+  return a.seq < b.seq;
+}
+
+// b continues a: same state and the range right after a's
+inline bool packet_merges(const Packet& a, const Packet& b) {
+  return !a.blend && !b.blend && a.instances == 0 && b.instances == 0
+      && a.program == b.program && a.texture == b.texture && a.vao == b.vao
+      && a.snapshot == b.snapshot && a.mode == b.mode && a.index_type == b.index_type
+      && a.base_vertex == b.base_vertex && a.first + a.count == b.first
+      && (a.mode == GL_TRIANGLES || a.mode == GL_LINES || a.mode == GL_POINTS);
+}
+
+// b can join a's multi-draw: same state, both indexed, any range
+inline bool packet_batches(const Packet& a, const Packet& b) {
+  return !a.blend && !b.blend && a.index_type != 0 && a.instances == 0 && b.instances == 0
+      && a.program == b.program && a.texture == b.texture && a.vao == b.vao
+      && a.snapshot == b.snapshot && a.mode == b.mode && a.index_type == b.index_type;
+}
+
+// Orphan buffer (grown to hold bytes) on target and fill it with data, so
+// the upload never waits on last frame's draws. data nullptr: left for the
+// GPU to write.
+inline void upload_orphaned(GLenum target, GLuint* buffer, size_t* capacity, const void* data,
+                            size_t bytes) {
+  if (!*buffer) glGenBuffers(1, buffer);
+  eglstate::bind_buffer(target, *buffer);
+  if (bytes > *capacity) *capacity = std::max(bytes, 2 * *capacity);
+  glBufferData(target, (GLsizeiptr)*capacity, nullptr, data ? GL_STREAM_DRAW : GL_STREAM_COPY);
+  if (data) wrap_glBufferSubData(target, 0, (GLsizeiptr)bytes, data);
+}
+
+#ifndef __APPLE__
+// Frustum test commands (in q->indirect_buffer) on the GPU into
+// q->culled_buffer, which is left bound as the draws' indirect buffer
+inline void gpu_cull_commands(RenderQueue* q, const CullBox* boxes, const CullRun* runs,
+                              size_t command_count, size_t run_count) {
+  EPROFILE_ZONE("render gpu cull");
+  if (q->indirect_count < 0) q->indirect_count = indirect_count_supported() ? 1 : 0;
+  upload_orphaned(GL_SHADER_STORAGE_BUFFER, &q->cull_boxes, &q->cull_boxes_capacity, boxes,
+                  command_count * sizeof(CullBox));
+  upload_orphaned(GL_SHADER_STORAGE_BUFFER, &q->cull_runs, &q->cull_runs_capacity, runs,
+                  command_count * sizeof(CullRun));
+  upload_orphaned(GL_SHADER_STORAGE_BUFFER, &q->culled_buffer, &q->culled_capacity, nullptr,
+                  command_count * sizeof(DrawElementsCommand));
+  GLuint* zeros = earena::alloc_array<GLuint>(run_count);
+  std::fill(zeros, zeros + run_count, 0u);
+  upload_orphaned(GL_SHADER_STORAGE_BUFFER, &q->count_buffer, &q->count_capacity, zeros,
+                  run_count * sizeof(GLuint));
+
+  GLuint program = cull_program();
+  eglstate::use_program(program);
+  glUniform4fv(eshaders::uniform_location(program, "uPlanes"), 6, &q->planes[0].x);
+  glUniform1ui(eshaders::uniform_location(program, "uCommandCount"), (GLuint)command_count);
+  glUniform1i(eshaders::uniform_location(program, "uCompact"), q->indirect_count);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, q->indirect_buffer);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, q->cull_boxes);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, q->cull_runs);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, q->culled_buffer);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, q->count_buffer);
+  glDispatchCompute((GLuint)((command_count + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE), 1, 1);
+  // The draws read the commands and counts the pass wrote
+  glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+  eglstate::bind_buffer(GL_DRAW_INDIRECT_BUFFER, q->culled_buffer);
+  if (q->indirect_count) glBindBuffer(GL_PARAMETER_BUFFER_ARB, q->count_buffer);
+}
+#endif
+
+inline void apply_uniform(const QueuedUniform& u) {
+  switch (u.kind) {
+    case U_1I: glUniform1i(u.location, u.i); break;
+    case U_1F: glUniform1f(u.location, u.v[0]); break;
+    case U_3F: glUniform3f(u.location, u.v[0], u.v[1], u.v[2]); break;
+    case U_4F: glUniform4f(u.location, u.v[0], u.v[1], u.v[2], u.v[3]); break;
+    case U_MAT4: glUniformMatrix4fv(u.location, 1, GL_FALSE, u.v); break;
+  }
+}
+
+// Everything p draws with but its range
+inline void apply_state(RenderQueue* q, const Packet& p, int* applied) {
+  eglstate::use_program(p.program);
+  if (p.blend) {
+    eglstate::enable(GL_BLEND);
+    eglstate::blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  } else {
+    eglstate::disable(GL_BLEND);
+  }
+  size_t slot = 0;
+  while (slot < q->programs.size() && q->programs[slot].program != p.program) ++slot;
+  if (applied[slot] != p.snapshot) {
+    const Snapshot& s = q->snapshots[p.snapshot];
+    for (size_t i = 0; i < s.count; ++i) {
+      apply_uniform(q->snapshot_uniforms[s.first + i]);
+    }
+    q->stats.uniform_uploads += (int)s.count;
+    applied[slot] = p.snapshot;
+  }
+  if (p.texture != 0) {
+    eglstate::active_texture(GL_TEXTURE0);
+    eglstate::bind_texture(p.texture_target, p.texture);
+  }
+  eglstate::bind_vertex_array(p.vao);
+}
+
+inline void execute(RenderQueue* q, const Packet& p, int* applied) {
+  apply_state(q, p, applied);
+  const void* offset = (const void*)((size_t)p.first * index_size(p.index_type));
+  if (p.instances > 0 && p.index_type != 0) {
+    wrap_glDrawElementsInstancedBaseVertex(p.mode, p.count, p.index_type, offset, p.instances,
+                                           p.base_vertex);
+  } else if (p.instances > 0) {
+    wrap_glDrawArraysInstanced(p.mode, p.first, p.count, p.instances);
+  } else if (p.index_type != 0 && p.base_vertex != 0) {
+    wrap_glDrawElementsBaseVertex(p.mode, p.count, p.index_type, offset, p.base_vertex);
+  } else if (p.index_type != 0) {
+    wrap_glDrawElements(p.mode, p.count, p.index_type, offset);
+  } else {
+    wrap_glDrawArrays(p.mode, p.first, p.count);
+  }
+  ++q->stats.draws;
+  if (p.mode == GL_TRIANGLES) q->stats.triangles += p.count / 3;
+}
+
+// Sort, merge and draw everything recorded since queue_begin. Leaves
+// blending off.
+inline void queue_flush(RenderQueue* q) {
+  EPROFILE_ZONE("render flush");
+  egltimer::Scope gpu(egltimer::PASS_WORLD);
+  size_t n = q->packets.size();
+  q->order.resize(n);
+  for (size_t i = 0; i < n; ++i) q->order[i] = (uint32_t)i;
+  const std::vector<Packet>& packets = q->packets;
+  std::sort(q->order.begin(), q->order.end(), [&](uint32_t a, uint32_t b) {
+    return packet_before(packets[a], packets[b]);
+  });
+
+  // Snapshot last applied per program, in frame scratch
+  int* applied = earena::alloc_array<int>(q->programs.size());
+  std::fill(applied, applied + q->programs.size(), -1);
+  if (q->indirect < 0) q->indirect = multi_draw_indirect_supported() ? 1 : 0;
+  DrawRun* runs = earena::alloc_array<DrawRun>(n);
+  DrawElementsCommand* commands = earena::alloc_array<DrawElementsCommand>(n);
+  CullBox* boxes = q->defer_cull ? earena::alloc_array<CullBox>(n) : nullptr;
+  CullRun* command_runs = q->defer_cull ? earena::alloc_array<CullRun>(n) : nullptr;
+  size_t run_count = 0, command_count = 0, deferred = 0;
+  // The sorted packet at i with the adjacent ones merged into it
+  auto take_merged = [&](size_t* i) {
+    Packet p = packets[q->order[(*i)++]];
+    while (*i < n && packet_merges(p, packets[q->order[*i]])) {
+      const Packet& next = packets[q->order[(*i)++]];
+      p.count += next.count;
+      p.deferred = bounds_union(p.deferred, next.deferred);
+      ++q->stats.merged;
+    }
+    return p;
+  };
+  // Runs, with every multi-draw's ranges as commands
+  size_t i = 0;
+  while (i < n) {
+    Packet p = take_merged(&i);
+    bool batches = i < n && packet_batches(p, packets[q->order[i]]);
+    // A deferred range drawn on its own is tested here after all
+    if (!batches && p.deferred.kind != BOUNDS_NONE && !bounds_in_frustum(q, p.deferred)) {
+      ++q->stats.culled;
+      continue;
+    }
+    DrawRun& run = runs[run_count++];
+    run.state = p;
+    run.first_command = command_count;
+    run.commands = 0;
+    if (!batches) continue;
+    for (Packet b = p;; b = take_merged(&i)) {
+      if (boxes) {
+        glm::vec3 lo(0.0f), hi(0.0f);
+        bool tested = b.deferred.kind != BOUNDS_NONE;
+        if (tested) bounds_box(b.deferred, &lo, &hi);
+        boxes[command_count] = CullBox{{lo.x, lo.y, lo.z, tested ? 1.0f : 0.0f},
+                                       {hi.x, hi.y, hi.z, 0.0f}};
+        command_runs[command_count] = CullRun{(GLuint)(run_count - 1), (GLuint)run.first_command};
+        if (tested) ++deferred;
+      }
+      commands[command_count++] = DrawElementsCommand{(GLuint)b.count, 1, (GLuint)b.first,
+                                                      b.base_vertex, 0};
+      ++run.commands;
+      if (i == n || !packet_batches(p, packets[q->order[i]])) break;
+    }
+  }
+
+#ifndef __APPLE__
+  bool gpu_culled = false;
+  if (q->indirect && command_count > 0) {
+    upload_orphaned(GL_DRAW_INDIRECT_BUFFER, &q->indirect_buffer, &q->indirect_capacity, commands,
+                    command_count * sizeof(DrawElementsCommand));
+    if (deferred > 0) {
+      gpu_cull_commands(q, boxes, command_runs, command_count, run_count);
+      gpu_culled = true;
+      q->stats.gpu_tested += (int)deferred;
+    }
+  }
+#endif
+
+  GLsizei* counts = earena::alloc_array<GLsizei>(command_count);
+  const void** offsets = earena::alloc_array<const void*>(command_count);
+  GLint* base_vertices = earena::alloc_array<GLint>(command_count);
+  for (size_t r = 0; r < run_count; ++r) {
+    const DrawRun& run = runs[r];
+    const Packet& p = run.state;
+    if (run.commands == 0) {
+      execute(q, p, applied);
+      continue;
+    }
+    apply_state(q, p, applied);
+    const DrawElementsCommand* c = commands + run.first_command;
+    int indices = 0;
+    for (GLsizei k = 0; k < run.commands; ++k) indices += (int)c[k].count;
+    glcount::draw(p.mode, indices);
+#ifndef __APPLE__
+    if (q->indirect) {
+      const void* at = (const void*)(run.first_command * sizeof(DrawElementsCommand));
+      if (gpu_culled && q->indirect_count) {
+        glMultiDrawElementsIndirectCountARB(p.mode, p.index_type, at,
+                                            (GLintptr)(r * sizeof(GLuint)), run.commands, 0);
+      } else {
+        glMultiDrawElementsIndirect(p.mode, p.index_type, at, run.commands, 0);
+      }
+    } else
+#endif
+    {
+      bool based = false;
+      for (GLsizei k = 0; k < run.commands; ++k) {
+        counts[k] = (GLsizei)c[k].count;
+        offsets[k] = (const void*)((size_t)c[k].first_index * index_size(p.index_type));
+        base_vertices[k] = c[k].base_vertex;
+        based = based || c[k].base_vertex != 0;
+      }
+      if (based) {
+        glMultiDrawElementsBaseVertex(p.mode, counts, p.index_type, offsets, run.commands,
+                                      base_vertices);
+      } else {
+        glMultiDrawElements(p.mode, counts, p.index_type, offsets, run.commands);
+      }
+    }
+    ++q->stats.draws;
+    q->stats.batched += run.commands - 1;
+    if (p.mode == GL_TRIANGLES) q->stats.triangles += indices / 3;
+  }
+  eglstate::disable(GL_BLEND);
+  q->last = q->stats;
+  q->packets.clear();
+}
+
+inline int last_submitted(RenderQueue* q) { return q->last.submitted; }
+inline int last_culled(RenderQueue* q) { return q->last.culled; }
+inline int last_merged(RenderQueue* q) { return q->last.merged; }
+inline int last_draws(RenderQueue* q) { return q->last.draws; }
+inline int last_uniform_uploads(RenderQueue* q) { return q->last.uniform_uploads; }
+inline int last_triangles(RenderQueue* q) { return q->last.triangles; }
+inline int last_batched(RenderQueue* q) { return q->last.batched; }
+inline int last_gpu_tested(RenderQueue* q) { return q->last.gpu_tested; }
+// Whether flushes multi-draw through an indirect buffer (known after the first)
+inline bool draws_indirect(RenderQueue* q) { return q->indirect == 1; }
+// Whether queue_gpu_cull found compute culling available (known after the
+// first culled frame that asked)
+inline bool culls_on_gpu(RenderQueue* q) { return q->gpu_cull == 1; }
+
+} // namespace erender
@@ -0,0 +1,46 @@
+#pragma once
+#include <cstddef>
+
+#include <jank/aot/resource.hpp>
+
+// Defined in libengine_assets (generated by scripts/embed-assets.clj).
+// Assets packed with --zstd are decompressed on their first lookup here and
+// only then registered with jank, so engine code looks them up through
+// eresources rather than jank::aot::find_resource directly.
+extern "C" bool engine_find_resource(char const* name, char const** data, std::size_t* size);
+
+namespace eresources {
+
+// Bytes of a named resource, valid for the life of the process: engine
+// assets first (a hash lookup into the embedded table), then anything else
+// registered with jank. Never a copy: the view points at the embedded
+// bytes, or at a --zstd asset's one decompressed buffer.
+inline bool find_resource(const char* name, const char** data, std::size_t* size) {
+  if (engine_find_resource(name, data, size)) {
+    return true;
+  }
+  auto opt = jank::aot::find_resource(jtl::immutable_string{ name });
+  if (!opt.is_some()) {
+    return false;
+  }
+  auto view = opt.unwrap();
+  *data = view.data();
+  *size = view.size();
+  return true;
+}
+
+struct View {
+  const char* data = nullptr;
+  std::size_t size = 0;
+};
+
+// find_resource as a view; data is nullptr if there's no such resource
+inline View view(const char* name) {
+  View v;
+  if (!find_resource(name, &v.data, &v.size)) {
+    v = View();
+  }
+  return v;
+}
+
+} // namespace eresources
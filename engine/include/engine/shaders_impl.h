@@ -4,8 +4,19 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <sys/stat.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#ifdef _WIN32
+#include <direct.h>
+#endif
 
-#include <jank/aot/resource.hpp>
+#include "engine/resources_impl.h"
 
 namespace eshaders {
 inline GLuint compile_shader_from_source(const char* source_data, std::size_t source_len,
@@ -53,13 +64,13 @@ inline GLuint compile_shader_from_file(const char* path, GLenum shader_type) {
 }
 
 inline GLuint compile_shader_from_resource(const char* resource_name, GLenum shader_type) {
-  auto opt = jank::aot::find_resource(jtl::immutable_string{ resource_name });
-  if (!opt.is_some()) {
+  const char* data = nullptr;
+  std::size_t size = 0;
+  if (!eresources::find_resource(resource_name, &data, &size)) {
     fprintf(stderr, "Shader resource not found: %s\n", resource_name);
     return 0;
   }
-  auto view = opt.unwrap();
-  return compile_shader_from_source(view.data(), view.size(), shader_type, resource_name);
+  return compile_shader_from_source(data, size, shader_type, resource_name);
 }
 
 inline void log_compilation_error (unsigned int shader_id) {
@@ -73,4 +84,498 @@ inline void log_link_error (unsigned int program_id) {
   glGetProgramInfoLog(program_id, 512, NULL, info_log);
   printf("%s", info_log);
 }
+
+// ============================================================================
+// Uniform location cache
+// ============================================================================
+// Active uniforms are reflected once per program (at link time, or on first
+// lookup for programs linked elsewhere) into a name-sorted table, so the
+// per-frame uniform_location is a binary search with strcmp: no driver call
+// and no allocation. Names that were not reflected (array elements such as
+// "uBones[3]", or unknown names) hit the driver once and are cached too,
+// -1 included, matching glGetUniformLocation.
+
+struct ProgramUniforms {
+  std::vector<std::string> names;  // sorted
+  std::vector<GLint> locations;
+};
+
+inline std::unordered_map<GLuint, ProgramUniforms>& uniform_tables() {
+  static std::unordered_map<GLuint, ProgramUniforms> tables;
+  return tables;
+}
+
+inline size_t uniform_lower_bound(const ProgramUniforms& u, const char* name) {
+  size_t lo = 0, hi = u.names.size();
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (strcmp(u.names[mid].c_str(), name) < 0) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+inline void uniform_insert(ProgramUniforms* u, const char* name, GLint location) {
+  size_t i = uniform_lower_bound(*u, name);
+  if (i < u->names.size() && u->names[i] == name) return;
+  u->names.insert(u->names.begin() + i, name);
+  u->locations.insert(u->locations.begin() + i, location);
+}
+
+// Rebuild program's table from glGetActiveUniform. Call after linking.
+inline ProgramUniforms& reflect_uniforms(GLuint program) {
+  ProgramUniforms& u = uniform_tables()[program];
+  u.names.clear();
+  u.locations.clear();
+  GLint count = 0;
+  glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+  for (GLint i = 0; i < count; i++) {
+    char name[256];
+    GLsizei length = 0;
+    GLint size = 0;
+    GLenum type = 0;
+    glGetActiveUniform(program, (GLuint)i, sizeof(name), &length, &size, &type, name);
+    GLint location = glGetUniformLocation(program, name);
+    uniform_insert(&u, name, location);
+    // Arrays report "name[0]"; the bare name means the same location
+    if (length > 3 && strcmp(name + length - 3, "[0]") == 0) {
+      name[length - 3] = '\0';
+      uniform_insert(&u, name, location);
+    }
+  }
+  return u;
+}
+
+// ============================================================================
+// Per-frame camera
+// ============================================================================
+// View, projection, their product and the eye position live in one std140
+// uniform buffer at CAMERA_BINDING. Programs declaring the Camera block
+// (the 3D shaders) are pointed at it when linked, so the camera is set
+// once a frame (set_camera_projection, then set_camera_look_at) instead of
+// per program with glUniform.
+
+const GLuint CAMERA_BINDING = 0;
+
+struct CameraBlock {   // std140 layout of the GLSL Camera block
+  glm::mat4 view;
+  glm::mat4 projection;
+  glm::mat4 view_projection;
+  glm::vec4 position;  // w = 1
+};
+
+struct Camera {
+  GLuint ubo = 0;
+  CameraBlock block;
+  float projection_args[4] = {0.0f, 0.0f, 0.0f, 0.0f};  // fov, aspect, near, far
+};
+
+inline Camera& camera() {
+  static Camera c;
+  return c;
+}
+
+inline void bind_camera_block(GLuint program) {
+  GLuint index = glGetUniformBlockIndex(program, "Camera");
+  if (index != GL_INVALID_INDEX) glUniformBlockBinding(program, index, CAMERA_BINDING);
+}
+
+// Perspective with a vertical fov in degrees; rebuilt only when an
+// argument changes. Takes effect at the next set_camera_look_at.
+inline void set_camera_projection(float fov_degrees, float aspect, float near_plane, float far_plane) {
+  Camera& c = camera();
+  const float args[4] = {fov_degrees, aspect, near_plane, far_plane};
+  if (memcmp(args, c.projection_args, sizeof(args)) == 0) return;
+  memcpy(c.projection_args, args, sizeof(args));
+  c.block.projection = glm::perspective(glm::radians(fov_degrees), aspect, near_plane, far_plane);
+}
+
+// View from eye toward target (+Y up); uploads the block
+inline void set_camera_look_at(float ex, float ey, float ez, float tx, float ty, float tz) {
+  Camera& c = camera();
+  glm::vec3 eye(ex, ey, ez);
+  c.block.view = glm::lookAt(eye, glm::vec3(tx, ty, tz), glm::vec3(0.0f, 1.0f, 0.0f));
+  c.block.view_projection = c.block.projection * c.block.view;
+  c.block.position = glm::vec4(eye, 1.0f);
+  if (!c.ubo) {
+    glGenBuffers(1, &c.ubo);
+    glBindBuffer(GL_UNIFORM_BUFFER, c.ubo);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(CameraBlock), nullptr, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, CAMERA_BINDING, c.ubo);
+  } else {
+    glBindBuffer(GL_UNIFORM_BUFFER, c.ubo);
+  }
+  wrap_glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(CameraBlock), &c.block);
+}
+
+inline const glm::mat4& camera_view() { return camera().block.view; }
+inline const glm::mat4& camera_projection() { return camera().block.projection; }
+
+inline void cache_uniforms(GLuint program) {
+  reflect_uniforms(program);
+  bind_camera_block(program);
+}
+
+inline GLint uniform_location(GLuint program, const char* name) {
+  auto& tables = uniform_tables();
+  auto it = tables.find(program);
+  ProgramUniforms& u = it != tables.end() ? it->second : reflect_uniforms(program);
+  size_t i = uniform_lower_bound(u, name);
+  if (i < u.names.size() && u.names[i] == name) return u.locations[i];
+  GLint location = glGetUniformLocation(program, name);
+  uniform_insert(&u, name, location);
+  return location;
+}
+
+inline void forget_uniforms(GLuint program) {
+  uniform_tables().erase(program);
+}
+// ============================================================================
+// Program cache
+// ============================================================================
+// program_from_resources memoizes linked programs by a hash of their stage
+// sources, so asking for the same registry program twice links it once; the
+// program (and its uniform values) is shared by every caller. Linked programs
+// are also saved with glGetProgramBinary under the shader cache dir, keyed by
+// the source hash and the GL vendor/renderer/version strings, so a new driver
+// never sees a stale binary. Later runs load the binary instead of compiling.
+// ENGINE_SHADER_CACHE overrides the dir; "0" turns the disk cache off.
+//
+// A variant is a registry program compiled with preprocessor defines
+// ("TEXTURED MAX_BONES=64", space separated) inserted after each stage's
+// #version line, so features a shader would otherwise switch on a uniform
+// are fixed at compile time and dead branches dropped. The hash covers the
+// specialized text, so each variant is memoized and disk cached on its
+// own; "" is the program as written.
+
+inline uint64_t fnv1a(uint64_t h, const void* data, std::size_t len) {
+  const unsigned char* p = (const unsigned char*)data;
+  for (std::size_t i = 0; i < len; i++) {
+    h ^= p[i];
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+const uint64_t FNV_OFFSET = 14695981039346656037ull;
+const uint32_t PROGRAM_BINARY_MAGIC = 0x31475250;  // "PRG1"
+
+inline std::unordered_map<uint64_t, GLuint>& program_memo() {
+  static std::unordered_map<uint64_t, GLuint> memo;
+  return memo;
+}
+
+inline std::string program_cache_dir() {
+  const char* override_dir = getenv("ENGINE_SHADER_CACHE");
+  if (override_dir) return strcmp(override_dir, "0") == 0 ? std::string() : override_dir;
+#if defined(_WIN32)
+  const char* base = getenv("LOCALAPPDATA");
+  return base ? std::string(base) + "\\jank-engine\\shaders" : std::string();
+#elif defined(__APPLE__)
+  const char* home = getenv("HOME");
+  return home ? std::string(home) + "/Library/Caches/jank-engine/shaders" : std::string();
+#else
+  const char* xdg = getenv("XDG_CACHE_HOME");
+  if (xdg && *xdg) return std::string(xdg) + "/jank-engine/shaders";
+  const char* home = getenv("HOME");
+  return home ? std::string(home) + "/.cache/jank-engine/shaders" : std::string();
+#endif
+}
+
+inline void make_dirs(const std::string& path) {
+  for (std::size_t i = 1; i <= path.size(); i++) {
+    if (i == path.size() || path[i] == '/' || path[i] == '\\') {
+      std::string dir = path.substr(0, i);
+#ifdef _WIN32
+      _mkdir(dir.c_str());
+#else
+      mkdir(dir.c_str(), 0755);
+#endif
+    }
+  }
+}
+
+inline bool program_binaries_supported() {
+  GLint formats = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+  return formats > 0;
+}
+
+inline std::string program_binary_path(uint64_t source_hash) {
+  std::string dir = program_cache_dir();
+  if (dir.empty() || !program_binaries_supported()) return std::string();
+  uint64_t h = source_hash;
+  const GLenum strings[] = {GL_VENDOR, GL_RENDERER, GL_VERSION};
+  for (GLenum name : strings) {
+    const char* value = (const char*)glGetString(name);
+    if (value) h = fnv1a(h, value, strlen(value));
+  }
+  char file[32];
+  snprintf(file, sizeof(file), "/%016llx.bin", (unsigned long long)h);
+  return dir + file;
+}
+
+// Returns the linked program, or 0 when there is no usable binary
+inline GLuint load_program_binary(const std::string& path) {
+  FILE* f = fopen(path.c_str(), "rb");
+  if (!f) return 0;
+  uint32_t header[3] = {0, 0, 0};  // magic, format, length
+  std::vector<char> binary;
+  bool ok = fread(header, sizeof(header), 1, f) == 1 && header[0] == PROGRAM_BINARY_MAGIC;
+  if (ok) {
+    binary.resize(header[2]);
+    ok = fread(binary.data(), 1, binary.size(), f) == binary.size();
+  }
+  fclose(f);
+  if (!ok) return 0;
+
+  GLuint program = glCreateProgram();
+  glProgramBinary(program, (GLenum)header[1], binary.data(), (GLsizei)binary.size());
+  GLint success = 0;
+  glGetProgramiv(program, GL_LINK_STATUS, &success);
+  if (!success) {
+    // Driver rejected it (updated in place); relink and overwrite
+    glDeleteProgram(program);
+    remove(path.c_str());
+    return 0;
+  }
+  return program;
+}
+
+inline void save_program_binary(const std::string& path, GLuint program) {
+  GLint length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0) return;
+  std::vector<char> binary((std::size_t)length);
+  GLenum format = 0;
+  glGetProgramBinary(program, length, &length, &format, binary.data());
+
+  make_dirs(path.substr(0, path.find_last_of("/\\")));
+  std::string tmp = path + ".tmp";
+  FILE* f = fopen(tmp.c_str(), "wb");
+  if (!f) return;
+  uint32_t header[3] = {PROGRAM_BINARY_MAGIC, (uint32_t)format, (uint32_t)length};
+  bool ok = fwrite(header, sizeof(header), 1, f) == 1
+         && fwrite(binary.data(), 1, (std::size_t)length, f) == (std::size_t)length;
+  ok = fclose(f) == 0 && ok;
+  // Write then rename, so a concurrent or crashed run never reads half a file
+  if (!ok || rename(tmp.c_str(), path.c_str()) != 0) remove(tmp.c_str());
+}
+
+// ============================================================================
+// Batched compilation
+// ============================================================================
+// submit_program starts a program's compile and link without asking for any
+// status, so the driver can build several programs (on its own threads with
+// GL_KHR_parallel_shader_compile) while the caller loads assets. The first
+// program_from_resources for it queries link status, which is where a
+// caller waits if the driver isn't done, and only then saves the binary.
+
+struct PendingProgram {
+  GLuint program = 0;
+  GLuint stages[3] = {0, 0, 0};  // all 0 when loaded from a binary
+  std::string labels[3];
+  std::string binary_path;
+};
+
+inline std::unordered_map<uint64_t, PendingProgram>& pending_programs() {
+  static std::unordered_map<uint64_t, PendingProgram> pending;
+  return pending;
+}
+
+// Let the driver compile on as many threads as it likes, if it can
+inline void enable_parallel_compile() {
+  static bool done = false;
+  if (done) return;
+  done = true;
+  typedef void (*MaxThreadsFn)(GLuint);
+  MaxThreadsFn max_threads = nullptr;
+  if (glfwExtensionSupported("GL_KHR_parallel_shader_compile")) {
+    max_threads = (MaxThreadsFn)glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+  } else if (glfwExtensionSupported("GL_ARB_parallel_shader_compile")) {
+    max_threads = (MaxThreadsFn)glfwGetProcAddress("glMaxShaderCompilerThreadsARB");
+  }
+  if (max_threads) max_threads(0xFFFFFFFFu);
+}
+
+// A stage's source with defines as #define lines after its #version line,
+// then a #line so compile errors keep the file's line numbers
+inline std::string specialize(const char* data, std::size_t size, const char* defines) {
+  std::string src(data, size);
+  std::size_t at = 0, pos = 0;
+  int next_line = 1, line = 1;
+  while (pos < src.size()) {
+    std::size_t end = src.find('\n', pos);
+    if (end == std::string::npos) end = src.size();
+    std::size_t first = src.find_first_not_of(" \t", pos);
+    if (first < end && src.compare(first, 8, "#version") == 0) {
+      at = end < src.size() ? end + 1 : end;
+      next_line = line + 1;
+      break;
+    }
+    pos = end + 1;
+    ++line;
+  }
+  std::string block = at == src.size() && at > 0 && src[at - 1] != '\n' ? "\n" : "";
+  const char* d = defines;
+  while (*d) {
+    while (*d == ' ') ++d;
+    const char* start = d;
+    while (*d && *d != ' ') ++d;
+    if (d == start) continue;
+    std::string define(start, d);
+    std::size_t eq = define.find('=');
+    if (eq != std::string::npos) define[eq] = ' ';
+    block += "#define " + define + "\n";
+  }
+  block += "#line " + std::to_string(next_line) + "\n";
+  src.insert(at, block);
+  return src;
+}
+
+// A program's stage sources as compiled: straight from the registry, or
+// specialized copies for a variant
+struct StageSources {
+  std::string text[3];
+  const char* data[3] = {nullptr, nullptr, nullptr};
+  std::size_t size[3] = {0, 0, 0};
+};
+
+// Stage sources for a registry program with defines ("" for none) and
+// their hash. gs_name may be "".
+inline bool program_sources(const char* const names[3], const char* defines, StageSources* out,
+                            uint64_t* out_hash) {
+  uint64_t h = FNV_OFFSET;
+  for (int i = 0; i < 3; i++) {
+    if (i == 1 && (!names[1] || !*names[1])) continue;
+    if (!eresources::find_resource(names[i], &out->data[i], &out->size[i])) {
+      fprintf(stderr, "Shader resource not found: %s\n", names[i]);
+      return false;
+    }
+    if (defines && *defines) {
+      out->text[i] = specialize(out->data[i], out->size[i], defines);
+      out->data[i] = out->text[i].data();
+      out->size[i] = out->text[i].size();
+    }
+    h = fnv1a(h, &i, sizeof(i));
+    h = fnv1a(h, out->data[i], out->size[i]);
+  }
+  *out_hash = h;
+  return true;
+}
+
+inline void start_program(PendingProgram* p, const char* const data[3],
+                          const std::size_t size[3], bool use_binary) {
+  const GLenum types[3] = {GL_VERTEX_SHADER, GL_GEOMETRY_SHADER, GL_FRAGMENT_SHADER};
+  if (use_binary && !p->binary_path.empty()) {
+    p->program = load_program_binary(p->binary_path);
+    if (p->program) return;
+  }
+  p->program = glCreateProgram();
+  for (int i = 0; i < 3; i++) {
+    if (!data[i]) continue;
+    GLuint shader = glCreateShader(types[i]);
+    GLint len = (GLint)size[i];
+    const char* sources[1] = { data[i] };
+    glShaderSource(shader, 1, sources, &len);
+    glCompileShader(shader);
+    glAttachShader(p->program, shader);
+    p->stages[i] = shader;
+  }
+  if (!p->binary_path.empty()) {
+    glProgramParameteri(p->program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  }
+  glLinkProgram(p->program);
+}
+
+// Begin building a registry program variant (defines "" for the program as
+// written); no-op if built or already started. Returns false if a stage
+// source is missing.
+inline bool submit_variant(const char* vs_name, const char* gs_name, const char* fs_name,
+                           const char* defines) {
+  enable_parallel_compile();
+  const char* names[3] = {vs_name, gs_name, fs_name};
+  StageSources sources;
+  uint64_t h;
+  if (!program_sources(names, defines, &sources, &h)) return false;
+  if (program_memo().count(h) || pending_programs().count(h)) return true;
+  PendingProgram& p = pending_programs()[h];
+  for (int i = 0; i < 3; i++) {
+    p.labels[i] = names[i] ? names[i] : "";
+    if (defines && *defines) p.labels[i] += std::string(" [") + defines + "]";
+  }
+  p.binary_path = program_binary_path(h);
+  start_program(&p, sources.data, sources.size, true);
+  return true;
+}
+
+inline bool submit_program(const char* vs_name, const char* gs_name, const char* fs_name) {
+  return submit_variant(vs_name, gs_name, fs_name, "");
+}
+
+// Wait for a submitted program and check it. Returns 0 on failure.
+inline GLuint finish_program(uint64_t h, const char* const data[3], const std::size_t size[3]) {
+  PendingProgram p = pending_programs()[h];
+  pending_programs().erase(h);
+
+  GLint success = 0;
+  glGetProgramiv(p.program, GL_LINK_STATUS, &success);
+  bool from_binary = !p.stages[0];
+  if (!success && from_binary) {
+    // load_program_binary only checks the link status lazily here
+    glDeleteProgram(p.program);
+    remove(p.binary_path.c_str());
+    start_program(&p, data, size, false);
+    glGetProgramiv(p.program, GL_LINK_STATUS, &success);
+    from_binary = false;
+  }
+  if (!success) {
+    for (int i = 0; i < 3; i++) {
+      if (!p.stages[i]) continue;
+      GLint compiled = 0;
+      glGetShaderiv(p.stages[i], GL_COMPILE_STATUS, &compiled);
+      if (!compiled) {
+        char info_log[512];
+        glGetShaderInfoLog(p.stages[i], 512, NULL, info_log);
+        fprintf(stderr, "Shader compilation failed: %s\n%s\n", p.labels[i].c_str(), info_log);
+      }
+    }
+    log_link_error(p.program);
+  }
+  for (GLuint shader : p.stages) {
+    if (shader) glDeleteShader(shader);
+  }
+  if (!success) {
+    glDeleteProgram(p.program);
+    return 0;
+  }
+  if (!from_binary && !p.binary_path.empty()) save_program_binary(p.binary_path, p.program);
+  reflect_uniforms(p.program);
+  bind_camera_block(p.program);
+  program_memo()[h] = p.program;
+  return p.program;
+}
+
+// Program variant from registry sources; gs_name may be "" for none,
+// defines "" for the program as written. Memoized and disk cached (see
+// above); finishes a submit_variant if one is in flight. Returns 0 on
+// failure.
+inline GLuint program_variant(const char* vs_name, const char* gs_name, const char* fs_name,
+                              const char* defines) {
+  const char* names[3] = {vs_name, gs_name, fs_name};
+  StageSources sources;
+  uint64_t h;
+  if (!program_sources(names, defines, &sources, &h)) return 0;
+
+  auto it = program_memo().find(h);
+  if (it != program_memo().end()) return it->second;
+  if (!pending_programs().count(h) && !submit_variant(vs_name, gs_name, fs_name, defines)) return 0;
+  return finish_program(h, sources.data, sources.size);
+}
+
+inline GLuint program_from_resources(const char* vs_name, const char* gs_name,
+                                     const char* fs_name) {
+  return program_variant(vs_name, gs_name, fs_name, "");
+}
+
 } // namespace eshaders
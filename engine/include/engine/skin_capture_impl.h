@@ -0,0 +1,193 @@
+#pragma once
+#include "gl_wrappers.h"
+#include "engine/gl_state_impl.h"
+#include "engine/gl_timer_impl.h"
+#include "engine/joint_palette_impl.h"
+#include "engine/memtrack_impl.h"
+#include "engine/resources_impl.h"
+#include "engine/shaders_impl.h"
+#include "animation_types.h"
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// ============ SKIN CAPTURE ============
+// Pre-skinning for meshes drawn more than once a frame (extra passes,
+// several viewports). A skinned mesh is run once through skinned_vertex.glsl
+// built with SKIN_CAPTURE, with the rasterizer off, and transform feedback
+// writes each vertex's skinned position and normal (mesh space) into the
+// target's own buffer. The target's VAO reads those as attributes 0 and 1,
+// the source mesh's texcoords as attribute 2 and its index buffer, so any
+// number of later draws use the skinned program's PRESKINNED variant: no
+// palette reads and no blend per vertex per pass.
+//
+// GL 3.3 has no compute shaders (and macOS stops at 4.1), hence transform
+// feedback. Per frame, after the palette is uploaded: skin_capture_begin,
+// skin_capture per target, skin_capture_end, then draw the targets' VAOs.
+// A target whose context pose hasn't changed since its last capture keeps
+// what it holds.
+
+namespace eanim {
+
+const GLsizei SKIN_CAPTURE_STRIDE = 6 * sizeof(float);  // vec3 position, vec3 normal
+
+struct SkinTarget {
+  GLuint source_vao = 0;   // create-skinned-vao mesh; owned by its creator
+  GLuint vao = 0;          // Captured vertices + the source's texcoords and indices
+  GLuint buffer = 0;
+  GLsizei vertex_count = 0;
+  const AnimationContext* ctx = nullptr;  // Last captured from
+  uint32_t pose_version = 0;
+};
+
+struct SkinCaptureState {
+  GLuint program = 0;
+  bool failed = false;
+  JointPalette* palette = nullptr;  // Between begin and end
+  int captured = 0;                 // Since the last begin
+  int skipped = 0;
+};
+
+inline SkinCaptureState& skin_capture_state() {
+  static SkinCaptureState s;
+  return s;
+}
+
+// skinned_vertex.glsl with SKIN_CAPTURE, its outputs bound for transform
+// feedback before linking (which the program cache can't do), built once.
+// 0 if it doesn't build.
+inline GLuint skin_capture_program() {
+  SkinCaptureState& s = skin_capture_state();
+  if (s.program || s.failed) return s.program;
+  s.failed = true;
+  eresources::View src = eresources::view("shaders/skinned_vertex.glsl");
+  if (!src.data) return 0;
+  std::string text =
+    eshaders::specialize(src.data, src.size, "NOT_INSTANCED PALETTE SKIN_CAPTURE");
+  GLuint vs = eshaders::compile_shader_from_source(text.data(), text.size(), GL_VERTEX_SHADER,
+                                                   "shaders/skinned_vertex.glsl [SKIN_CAPTURE]");
+  if (!vs) return 0;
+  GLuint program = glCreateProgram();
+  glAttachShader(program, vs);
+  const char* varyings[2] = {"SkinnedPosition", "SkinnedNormal"};
+  glTransformFeedbackVaryings(program, 2, varyings, GL_INTERLEAVED_ATTRIBS);
+  glLinkProgram(program);
+  glDeleteShader(vs);
+  GLint linked = 0;
+  glGetProgramiv(program, GL_LINK_STATUS, &linked);
+  if (!linked) {
+    eshaders::log_link_error(program);
+    glDeleteProgram(program);
+    return 0;
+  }
+  eshaders::reflect_uniforms(program);
+  eshaders::bind_camera_block(program);  // gl_Position still reads it
+  s.program = program;
+  s.failed = false;
+  return program;
+}
+
+// A target for source_vao (a create-skinned-vao VAO of vertex_count
+// vertices). nullptr if the capture program doesn't build.
+inline SkinTarget* create_skin_target(GLuint source_vao, int vertex_count) {
+  if (!skin_capture_program() || vertex_count <= 0) return nullptr;
+  SkinTarget* t = new SkinTarget();
+  t->source_vao = source_vao;
+  t->vertex_count = vertex_count;
+
+  // The source's texcoord attribute and index buffer, to share
+  eglstate::bind_vertex_array(source_vao);
+  GLint uv_buffer = 0, uv_size = 2, uv_type = GL_FLOAT, uv_normalized = GL_FALSE, uv_stride = 0;
+  GLint ebo = 0;
+  void* uv_offset = nullptr;
+  glGetVertexAttribiv(2, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING, &uv_buffer);
+  glGetVertexAttribiv(2, GL_VERTEX_ATTRIB_ARRAY_SIZE, &uv_size);
+  glGetVertexAttribiv(2, GL_VERTEX_ATTRIB_ARRAY_TYPE, &uv_type);
+  glGetVertexAttribiv(2, GL_VERTEX_ATTRIB_ARRAY_NORMALIZED, &uv_normalized);
+  glGetVertexAttribiv(2, GL_VERTEX_ATTRIB_ARRAY_STRIDE, &uv_stride);
+  glGetVertexAttribPointerv(2, GL_VERTEX_ATTRIB_ARRAY_POINTER, &uv_offset);
+  glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &ebo);
+
+  const GLsizeiptr bytes = (GLsizeiptr)vertex_count * SKIN_CAPTURE_STRIDE;
+  glGenBuffers(1, &t->buffer);
+  glGenVertexArrays(1, &t->vao);
+  eglstate::bind_vertex_array(t->vao);
+  eglstate::bind_buffer(GL_ARRAY_BUFFER, t->buffer);
+  glBufferData(GL_ARRAY_BUFFER, bytes, nullptr, GL_DYNAMIC_COPY);
+  ememtrack::track_buffer(t->buffer, ememtrack::CAT_GL_STREAMS, (int64_t)bytes);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, SKIN_CAPTURE_STRIDE, (void*)0);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, SKIN_CAPTURE_STRIDE, (void*)(3 * sizeof(float)));
+  glEnableVertexAttribArray(1);
+  if (uv_buffer) {
+    eglstate::bind_buffer(GL_ARRAY_BUFFER, (GLuint)uv_buffer);
+    glVertexAttribPointer(2, uv_size, (GLenum)uv_type, (GLboolean)uv_normalized, uv_stride,
+                          uv_offset);
+    glEnableVertexAttribArray(2);
+  }
+  eglstate::bind_buffer(GL_ELEMENT_ARRAY_BUFFER, (GLuint)ebo);
+  eglstate::bind_vertex_array(0);
+  return t;
+}
+
+// Frees the captured buffer and VAO; the source mesh belongs to its creator
+inline void destroy_skin_target(SkinTarget* t) {
+  if (!t) return;
+  eglstate::forget_vertex_array(t->vao);
+  eglstate::forget_buffer(t->buffer);
+  ememtrack::untrack_buffer(t->buffer);
+  glDeleteVertexArrays(1, &t->vao);
+  glDeleteBuffers(1, &t->buffer);
+  delete t;
+}
+
+// Start capturing from palette (uploaded for this frame). Returns false,
+// changing nothing, if the capture program doesn't build.
+inline bool skin_capture_begin(JointPalette* p, int texture_unit) {
+  GLuint program = skin_capture_program();
+  if (!program) return false;
+  SkinCaptureState& s = skin_capture_state();
+  s.palette = p;
+  s.captured = 0;
+  s.skipped = 0;
+  eglstate::use_program(program);
+  palette_bind(p, program, texture_unit);
+  glEnable(GL_RASTERIZER_DISCARD);
+  return true;
+}
+
+// Skin t's source mesh with the palette matrices at palette_offset (an
+// append-skinning-matrices offset for ctx's current pose). Skipped when t
+// already holds ctx at this pose.
+inline void skin_capture(SkinTarget* t, int palette_offset, const AnimationContext* ctx) {
+  SkinCaptureState& s = skin_capture_state();
+  if (!t || !s.palette || palette_offset < 0) return;
+  if (ctx && t->ctx == ctx && t->pose_version == ctx->pose_version) {
+    ++s.skipped;
+    return;
+  }
+  egltimer::Scope gpu(egltimer::PASS_WORLD);
+  palette_set_offset(s.palette, palette_offset);
+  eglstate::bind_vertex_array(t->source_vao);
+  glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, t->buffer);
+  glBeginTransformFeedback(GL_POINTS);
+  glDrawArrays(GL_POINTS, 0, t->vertex_count);
+  glEndTransformFeedback();
+  t->ctx = ctx;
+  t->pose_version = ctx ? ctx->pose_version : 0;
+  ++s.captured;
+}
+
+inline void skin_capture_end() {
+  SkinCaptureState& s = skin_capture_state();
+  if (!s.palette) return;
+  glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+  glDisable(GL_RASTERIZER_DISCARD);
+  s.palette = nullptr;
+}
+
+// Targets captured / left as they were since the last skin_capture_begin
+inline int skin_capture_count() { return skin_capture_state().captured; }
+inline int skin_capture_skipped() { return skin_capture_state().skipped; }
+
+} // namespace eanim
@@ -0,0 +1,443 @@
+#pragma once
+#include "engine/textures_impl.h"
+#include "engine/render_queue_impl.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// ============ TEXTURE STREAMING ============
+// Textures whose mip levels come and go under a VRAM budget. A streamed
+// texture gets its GL name at once (a 1x1 white placeholder), then only
+// its low levels, STREAM_LOW_MIP_SIZE texels across and smaller; those
+// stay resident. Finer levels are loaded for the screen size the render
+// queue saw the texture drawn at (queue_texture_usage): the level whose
+// texels are about one per pixel across the packet's bounds.
+//
+// Decoding runs on the job pool: the image is decoded whole (PNG and JPEG
+// can't decode a level on its own), box-filtered down, and the levels
+// asked for come back to stream_update, which uploads them on the GL
+// thread within its time budget. Residency is GL_TEXTURE_BASE_LEVEL: the
+// finest level resident is the base, coarser ones sit under it. Evicting
+// raises the base and re-specifies the dropped levels at 0x0, freeing
+// them, so the texture's name (what packets and materials hold) never
+// changes.
+//
+// Over budget, textures not drawn this frame give back their fine levels
+// first, least recently drawn first; then the drawn ones shed levels,
+// smallest on screen first. A finer level is only asked for when it fits,
+// after making room from textures not drawn this frame.
+//
+// Streamed textures live outside the texture cache: the streamer shares
+// them by the same key and counts its own references.
+
+namespace etextures {
+
+const int STREAM_LOW_MIP_SIZE = 64;   // Levels this wide and smaller load first and stay
+const int STREAM_MAX_IN_FLIGHT = 4;   // Decodes running at once
+
+struct StreamedTexture {
+  GLuint texture = 0;                 // 0: a free slot
+  uint64_t serial = 0;                // Tells a reused GL name from the one decoded for
+  std::string key;
+  std::string path;
+  int refs = 0;
+  int channels = 4;
+  bool flip = false;
+  int width = 0, height = 0;
+  int levels = 1;
+  int floor_level = 0;                // Coarsest level that may be asked for; always kept
+  int resident = 0;                   // Finest level resident; == levels: none yet
+  int wanted = 0;
+  int loading = -1;                   // Finest level being decoded, or -1
+  int64_t incoming = 0;               // Bytes being decoded
+  float pixels = 0.0f;                // Largest screen size this frame
+  uint64_t seen = 0;                  // Frame last drawn
+};
+
+// Decoded levels on their way to the GL thread
+struct StreamResult {
+  GLuint texture;
+  uint64_t serial;
+  int first;                          // Finest level in levels
+  int channels;
+  std::vector<std::vector<unsigned char>> levels;  // first, first+1, ..., empty if failed
+  std::vector<int> widths, heights;
+};
+
+struct Streamer {
+  int64_t budget = 0;                 // Bytes
+  int64_t resident_bytes = 0;
+  int64_t incoming_bytes = 0;         // Of decodes in flight
+  uint64_t frame = 0;
+  uint64_t serials = 0;
+  std::vector<StreamedTexture> textures;
+  std::unordered_map<GLuint, int> by_texture;
+  std::unordered_map<std::string, int> by_key;
+  std::mutex mutex;
+  std::deque<StreamResult> done;
+  ejobs::Counter decoding;
+  int in_flight = 0;
+  int uploads = 0;                    // Levels uploaded, last update
+  int evictions = 0;                  // Levels evicted, last update
+};
+
+inline int level_width(int width, int level) { return std::max(1, width >> level); }
+
+inline int64_t level_bytes(const StreamedTexture& t, int level) {
+  return (int64_t)level_width(t.width, level) * level_width(t.height, level) * t.channels;
+}
+
+// Bytes of levels from..levels-1
+inline int64_t levels_bytes(const StreamedTexture& t, int from) {
+  int64_t total = 0;
+  for (int i = from; i < t.levels; ++i) total += level_bytes(t, i);
+  return total;
+}
+
+inline Streamer* create_streamer(int64_t budget_bytes) {
+  Streamer* s = new Streamer();
+  s->budget = budget_bytes;
+  return s;
+}
+
+inline void delete_streamed(StreamedTexture& t) {
+  eglstate::forget_texture(t.texture);
+  ememtrack::untrack_texture(t.texture);
+  glDeleteTextures(1, &t.texture);
+  t.texture = 0;
+}
+
+inline void destroy_streamer(Streamer* s) {
+  ejobs::wait(&s->decoding);
+  for (StreamedTexture& t : s->textures) {
+    if (t.texture) delete_streamed(t);
+  }
+  delete s;
+}
+
+// ---- Decoding (pool) ----
+
+// Halve a w x h image (2x2 box; odd edges repeat)
+inline std::vector<unsigned char> downsample(const std::vector<unsigned char>& src, int w, int h,
+                                             int channels) {
+  int nw = std::max(1, w >> 1), nh = std::max(1, h >> 1);
+  std::vector<unsigned char> dst((size_t)nw * nh * channels);
+  for (int y = 0; y < nh; ++y) {
+    int y0 = std::min(2 * y, h - 1), y1 = std::min(2 * y + 1, h - 1);
+    for (int x = 0; x < nw; ++x) {
+      int x0 = std::min(2 * x, w - 1), x1 = std::min(2 * x + 1, w - 1);
+      for (int c = 0; c < channels; ++c) {
+        int sum = src[((size_t)y0 * w + x0) * channels + c] + src[((size_t)y0 * w + x1) * channels + c] +
+                  src[((size_t)y1 * w + x0) * channels + c] + src[((size_t)y1 * w + x1) * channels + c];
+        dst[((size_t)y * nw + x) * channels + c] = (unsigned char)((sum + 2) / 4);
+      }
+    }
+  }
+  return dst;
+}
+
+// Decode path and keep levels first..last
+inline StreamResult decode_levels(GLuint texture, uint64_t serial, const std::string& path,
+                                  int channels, bool flip, int first, int last) {
+  StreamResult r{texture, serial, first, channels, {}, {}, {}};
+  int w = 0, h = 0, n = 0;
+  unsigned char* pixels = stbi_load(path.c_str(), &w, &h, &n, channels);
+  if (!pixels) return r;
+  if (flip) flip_rows(pixels, w, h, channels);
+  std::vector<unsigned char> level(pixels, pixels + (size_t)w * h * channels);
+  stbi_image_free(pixels);
+  for (int i = 0; i <= last; ++i) {
+    if (i >= first) {
+      r.levels.push_back(level);
+      r.widths.push_back(w);
+      r.heights.push_back(h);
+    }
+    if (i == last) break;
+    level = downsample(level, w, h, channels);
+    w = std::max(1, w >> 1);
+    h = std::max(1, h >> 1);
+  }
+  return r;
+}
+
+inline void request_levels(Streamer* s, StreamedTexture& t, int first) {
+  int last = t.resident < t.levels ? t.resident - 1 : t.levels - 1;
+  t.loading = first;
+  t.incoming = levels_bytes(t, first) - levels_bytes(t, last + 1);
+  s->incoming_bytes += t.incoming;
+  ++s->in_flight;
+  GLuint texture = t.texture;
+  uint64_t serial = t.serial;
+  std::string path = t.path;
+  int channels = t.channels;
+  bool flip = t.flip;
+  ejobs::submit(&s->decoding, [s, texture, serial, path, channels, flip, first, last] {
+    StreamResult r = decode_levels(texture, serial, path, channels, flip, first, last);
+    std::lock_guard<std::mutex> lock(s->mutex);
+    s->done.push_back(std::move(r));
+  });
+}
+
+// ---- Loading ----
+
+// A streamed texture for path (0 if it isn't an image stb_image reads).
+// Same arguments as etextures::acquire; a second load shares the first.
+inline GLuint stream_texture(Streamer* s, const char* path, int alpha, int wrap_s, int wrap_t,
+                             int min_filter, int mag_filter, int flip) {
+  std::string key = cache_key(path, alpha, wrap_s, wrap_t, min_filter, mag_filter, flip);
+  auto found = s->by_key.find(key);
+  if (found != s->by_key.end()) {
+    StreamedTexture& t = s->textures[found->second];
+    ++t.refs;
+    return t.texture;
+  }
+  int w = 0, h = 0, n = 0;
+  if (!stbi_info(path, &w, &h, &n) || w <= 0 || h <= 0) return 0;
+
+  StreamedTexture t;
+  t.serial = ++s->serials;
+  t.key = key;
+  t.path = path;
+  t.refs = 1;
+  t.channels = alpha ? 4 : 3;
+  t.flip = flip != 0;
+  t.width = w;
+  t.height = h;
+  int largest = std::max(w, h);
+  while ((largest >> t.levels) > 0) ++t.levels;
+  while (t.floor_level < t.levels - 1 &&
+         std::max(level_width(w, t.floor_level), level_width(h, t.floor_level)) > STREAM_LOW_MIP_SIZE) {
+    ++t.floor_level;
+  }
+  t.resident = t.levels;
+  t.wanted = t.floor_level;
+
+  glGenTextures(1, &t.texture);
+  eglstate::bind_texture(GL_TEXTURE_2D, t.texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap_s);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap_t);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, min_filter);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, mag_filter);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+  const unsigned char white[4] = {255, 255, 255, 255};
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, white);
+
+  int slot = -1;
+  for (size_t i = 0; i < s->textures.size(); ++i) {
+    if (!s->textures[i].texture) {
+      slot = (int)i;
+      break;
+    }
+  }
+  if (slot < 0) {
+    slot = (int)s->textures.size();
+    s->textures.emplace_back();
+  }
+  s->textures[slot] = t;
+  s->by_key[key] = slot;
+  s->by_texture[t.texture] = slot;
+  // The low levels go ahead of the in-flight limit: they're small and
+  // every streamed texture needs them
+  request_levels(s, s->textures[slot], t.floor_level);
+  return t.texture;
+}
+
+// Drop one reference; the texture is deleted with the last. Returns true
+// if it was.
+inline bool release_streamed(Streamer* s, GLuint texture) {
+  auto it = s->by_texture.find(texture);
+  if (it == s->by_texture.end()) return false;
+  StreamedTexture& t = s->textures[it->second];
+  if (--t.refs > 0) return false;
+  s->resident_bytes -= t.resident < t.levels ? levels_bytes(t, t.resident) : 0;
+  s->incoming_bytes -= t.incoming;
+  s->by_key.erase(t.key);
+  s->by_texture.erase(it);
+  delete_streamed(t);
+  return true;
+}
+
+// ---- Residency (GL thread) ----
+
+inline void track_resident(Streamer* s, StreamedTexture& t, int resident) {
+  int64_t before = t.resident < t.levels ? levels_bytes(t, t.resident) : 0;
+  int64_t after = resident < t.levels ? levels_bytes(t, resident) : 0;
+  s->resident_bytes += after - before;
+  t.resident = resident;
+  ememtrack::track_texture(t.texture, ememtrack::CAT_TEXTURES, after);
+}
+
+// The texture r was decoded for, nullptr if it was released meanwhile
+inline StreamedTexture* result_texture(Streamer* s, const StreamResult& r) {
+  auto it = s->by_texture.find(r.texture);
+  if (it == s->by_texture.end() || s->textures[it->second].serial != r.serial) return nullptr;
+  return &s->textures[it->second];
+}
+
+inline void upload_levels(Streamer* s, const StreamResult& r) {
+  StreamedTexture* found = result_texture(s, r);
+  if (!found) return;
+  StreamedTexture& t = *found;
+  s->incoming_bytes -= t.incoming;
+  t.incoming = 0;
+  t.loading = -1;
+  if (r.levels.empty()) {
+    fprintf(stderr, "Failed to load texture image: %s (%s)\n", t.path.c_str(),
+            stbi_failure_reason());
+    return;
+  }
+  // Evicted past what was asked for while decoding: keep only what
+  // connects to what's resident
+  int last = r.first + (int)r.levels.size() - 1;
+  if (t.resident < t.levels && last + 1 < t.resident) return;
+  GLenum format = r.channels == 4 ? GL_RGBA : GL_RGB;
+  eglstate::bind_texture(GL_TEXTURE_2D, t.texture);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  for (size_t i = 0; i < r.levels.size(); ++i) {
+    int level = r.first + (int)i;
+    if (level >= t.resident) break;
+    glTexImage2D(GL_TEXTURE_2D, level, format, r.widths[i], r.heights[i], 0, format,
+                 GL_UNSIGNED_BYTE, r.levels[i].data());
+    glcount::texture_upload((long long)r.levels[i].size());
+    ++s->uploads;
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, std::min(r.first, t.resident));
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, t.levels - 1);
+  track_resident(s, t, std::min(r.first, t.resident));
+}
+
+// Keep levels from resident down only, freeing the finer ones
+inline void evict_to(Streamer* s, StreamedTexture& t, int resident) {
+  if (resident <= t.resident) return;
+  eglstate::bind_texture(GL_TEXTURE_2D, t.texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, resident);
+  GLenum format = t.channels == 4 ? GL_RGBA : GL_RGB;
+  for (int level = t.resident; level < resident; ++level) {
+    glTexImage2D(GL_TEXTURE_2D, level, format, 0, 0, 0, format, GL_UNSIGNED_BYTE, nullptr);
+    ++s->evictions;
+  }
+  track_resident(s, t, resident);
+}
+
+// Evict fine levels of textures not drawn this frame, least recently
+// drawn first, until bytes more fit in the budget. Returns whether they do.
+inline bool make_room(Streamer* s, int64_t bytes) {
+  auto fits = [&] { return s->resident_bytes + s->incoming_bytes + bytes <= s->budget; };
+  if (fits()) return true;
+  std::vector<int> idle;
+  for (size_t i = 0; i < s->textures.size(); ++i) {
+    const StreamedTexture& t = s->textures[i];
+    if (t.texture && t.seen != s->frame && t.resident < t.floor_level) idle.push_back((int)i);
+  }
+  std::sort(idle.begin(), idle.end(),
+            [&](int a, int b) { return s->textures[a].seen < s->textures[b].seen; });
+  for (int i : idle) {
+    evict_to(s, s->textures[i], s->textures[i].floor_level);
+    if (fits()) return true;
+  }
+  return fits();
+}
+
+// The level whose texels are about one per pixel across pixels
+inline int level_for(const StreamedTexture& t, float pixels) {
+  float largest = (float)std::max(t.width, t.height);
+  int level = pixels > 1.0f ? (int)std::floor(std::log2(largest / pixels)) : t.floor_level;
+  return std::clamp(level, 0, t.floor_level);
+}
+
+// Once a frame on the GL thread, after the frame's packets are queued (q
+// recording queue_texture_usage; nullptr: no usage this frame). Uploads
+// finished decodes for up to budget_ms (at least one), then keeps the
+// budget and asks for the levels drawn textures want.
+inline void stream_update(Streamer* s, const erender::RenderQueue* q, double budget_ms) {
+  ++s->frame;
+  s->uploads = 0;
+  s->evictions = 0;
+  if (q) {
+    for (const erender::TextureUsage& u : q->usage) {
+      auto it = s->by_texture.find(u.texture);
+      if (it == s->by_texture.end()) continue;
+      StreamedTexture& t = s->textures[it->second];
+      if (t.seen != s->frame) t.pixels = 0.0f;
+      t.pixels = std::max(t.pixels, u.pixels);
+      t.seen = s->frame;
+    }
+  }
+  for (StreamedTexture& t : s->textures) {
+    if (t.texture) t.wanted = t.seen == s->frame ? level_for(t, t.pixels) : t.floor_level;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  for (;;) {
+    StreamResult r;
+    {
+      std::lock_guard<std::mutex> lock(s->mutex);
+      if (s->done.empty()) break;
+      r = std::move(s->done.front());
+      s->done.pop_front();
+    }
+    --s->in_flight;
+    upload_levels(s, r);
+    std::chrono::duration<double, std::milli> spent = std::chrono::steady_clock::now() - start;
+    if (spent.count() >= budget_ms) break;
+  }
+  // Over budget: idle textures first, then drawn ones smallest first
+  if (!make_room(s, 0)) {
+    std::vector<int> drawn;
+    for (size_t i = 0; i < s->textures.size(); ++i) {
+      const StreamedTexture& t = s->textures[i];
+      if (t.texture && t.resident < t.floor_level) drawn.push_back((int)i);
+    }
+    std::sort(drawn.begin(), drawn.end(),
+              [&](int a, int b) { return s->textures[a].pixels < s->textures[b].pixels; });
+    for (int i : drawn) {
+      StreamedTexture& t = s->textures[i];
+      while (t.resident < t.floor_level && s->resident_bytes + s->incoming_bytes > s->budget) {
+        evict_to(s, t, t.resident + 1);
+        t.wanted = std::max(t.wanted, t.resident);
+      }
+      if (s->resident_bytes + s->incoming_bytes <= s->budget) break;
+    }
+  }
+
+  // Finer levels for what's drawn, largest on screen first
+  std::vector<int> wanting;
+  for (size_t i = 0; i < s->textures.size(); ++i) {
+    const StreamedTexture& t = s->textures[i];
+    if (t.texture && t.loading < 0 && t.resident < t.levels && t.wanted < t.resident) {
+      wanting.push_back((int)i);
+    }
+  }
+  std::sort(wanting.begin(), wanting.end(),
+            [&](int a, int b) { return s->textures[a].pixels > s->textures[b].pixels; });
+  for (int i : wanting) {
+    if (s->in_flight >= STREAM_MAX_IN_FLIGHT) break;
+    StreamedTexture& t = s->textures[i];
+    if (!make_room(s, levels_bytes(t, t.wanted) - levels_bytes(t, t.resident))) continue;
+    request_levels(s, t, t.wanted);
+  }
+}
+
+// ---- Stats ----
+
+inline int64_t streamer_resident_bytes(const Streamer* s) { return s->resident_bytes; }
+inline int64_t streamer_budget(const Streamer* s) { return s->budget; }
+inline int streamer_in_flight(const Streamer* s) { return s->in_flight; }
+inline int streamer_uploads(const Streamer* s) { return s->uploads; }
+inline int streamer_evictions(const Streamer* s) { return s->evictions; }
+
+inline int streamer_count(const Streamer* s) {
+  int n = 0;
+  for (const StreamedTexture& t : s->textures) n += t.texture ? 1 : 0;
+  return n;
+}
+
+}  // namespace etextures
@@ -0,0 +1,567 @@
+#pragma once
+#include "gl_wrappers.h"
+#include "engine/gl_state_impl.h"
+#include "engine/jobs_impl.h"
+#include "engine/memtrack_impl.h"
+#include "stb_image.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// ============ TEXTURE CACHE ============
+// Loaded textures by what they were loaded from: the normalized path plus
+// every parameter that changes the GL texture (format, wrap, filters,
+// flip). A second load of the same key returns the first texture and
+// bumps its count; release_texture deletes it once the count drops to 0.
+//
+// A glTF level whose primitives share one image decodes and uploads it
+// once instead of once per primitive.
+
+namespace etextures {
+
+struct CachedTexture {
+  std::string key;
+  int refs = 0;
+};
+
+struct TextureCache {
+  std::unordered_map<std::string, GLuint> by_key;
+  std::unordered_map<GLuint, CachedTexture> by_id;
+};
+
+inline TextureCache& cache() {
+  static TextureCache c;
+  return c;
+}
+
+// "a/./b/../c.png" and "a/c.png" are one texture
+inline std::string normalize_path(const char* path) {
+  return std::filesystem::path(path).lexically_normal().generic_string();
+}
+
+inline std::string cache_key(const char* path, int alpha, int wrap_s, int wrap_t,
+                             int min_filter, int mag_filter, int flip) {
+  return normalize_path(path) + "|" + std::to_string(alpha) + "|" +
+         std::to_string(wrap_s) + "|" + std::to_string(wrap_t) + "|" +
+         std::to_string(min_filter) + "|" + std::to_string(mag_filter) + "|" +
+         std::to_string(flip);
+}
+
+// The cached texture for these load arguments with its count bumped, or 0
+// if it isn't loaded
+inline GLuint acquire(const char* path, int alpha, int wrap_s, int wrap_t,
+                      int min_filter, int mag_filter, int flip) {
+  TextureCache& c = cache();
+  auto it = c.by_key.find(cache_key(path, alpha, wrap_s, wrap_t, min_filter, mag_filter, flip));
+  if (it == c.by_key.end()) return 0;
+  ++c.by_id[it->second].refs;
+  return it->second;
+}
+
+// Record a texture just loaded with these arguments, held once
+inline void insert(GLuint texture, const char* path, int alpha, int wrap_s, int wrap_t,
+                   int min_filter, int mag_filter, int flip) {
+  TextureCache& c = cache();
+  std::string key = cache_key(path, alpha, wrap_s, wrap_t, min_filter, mag_filter, flip);
+  c.by_key[key] = texture;
+  c.by_id[texture] = CachedTexture{key, 1};
+}
+
+// Drop one hold on texture; deletes it on the last. Textures the cache
+// never saw are deleted outright. Returns true if it was deleted.
+inline bool release(GLuint texture) {
+  if (texture == 0) return false;
+  TextureCache& c = cache();
+  auto it = c.by_id.find(texture);
+  if (it != c.by_id.end()) {
+    if (--it->second.refs > 0) return false;
+    c.by_key.erase(it->second.key);
+    c.by_id.erase(it);
+  }
+  eglstate::forget_texture(texture);
+  ememtrack::untrack_texture(texture);
+  glDeleteTextures(1, &texture);
+  return true;
+}
+
+// Record an uncompressed width x height texture with a full mip chain
+inline void account_texture(GLuint texture, int width, int height, int channels) {
+  ememtrack::track_texture(texture, ememtrack::CAT_TEXTURES,
+                           (int64_t)width * height * channels * 4 / 3);
+}
+
+inline int ref_count(GLuint texture) {
+  auto it = cache().by_id.find(texture);
+  return it == cache().by_id.end() ? 0 : it->second.refs;
+}
+
+inline int cached_count() {
+  return (int)cache().by_id.size();
+}
+
+// ============ COMPRESSED TEXTURES (KTX2) ============
+// scripts/compress-textures (the :game-textures job in asset-pipeline.edn)
+// writes block-compressed mip chains next to each source image:
+//   tex_ground.png -> tex_ground.astc.ktx2  (ASTC 4x4, ARM GPUs)
+//                     tex_ground.bc7.ktx2   (BC7, GL 4.2+ desktop)
+//                     tex_ground.bc1.ktx2   (BC1, desktops without BPTC, i.e. macOS)
+// load_compressed picks the first the context can sample and uploads its
+// levels as they are, with no decode and no glGenerateMipmap. When no
+// variant exists or the driver supports none, it returns 0 and the caller
+// decodes the source image as before.
+//
+// Only what the pipeline writes is read: 2D, one layer, one face, no
+// supercompression, full mip chain.
+
+// Not in every platform header (macOS gl3.h has none of them)
+const GLenum COMPRESSED_RGB_S3TC_DXT1 = 0x83F0;
+const GLenum COMPRESSED_RGBA_S3TC_DXT1 = 0x83F1;
+const GLenum COMPRESSED_RGBA_S3TC_DXT5 = 0x83F3;
+const GLenum COMPRESSED_RGBA_BPTC_UNORM = 0x8E8C;
+const GLenum COMPRESSED_RGBA_ASTC_4x4 = 0x93B0;
+
+struct CompressedSupport {
+  bool checked = false;
+  bool s3tc = false;
+  bool bptc = false;
+  bool astc = false;
+};
+
+inline const CompressedSupport& compressed_support() {
+  static CompressedSupport s;
+  if (!s.checked) {
+    s.checked = true;
+    GLint major = 0, minor = 0, count = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    s.bptc = major > 4 || (major == 4 && minor >= 2);
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; ++i) {
+      const char* ext = (const char*)glGetStringi(GL_EXTENSIONS, (GLuint)i);
+      if (!ext) continue;
+      if (!std::strcmp(ext, "GL_EXT_texture_compression_s3tc")) s.s3tc = true;
+      if (!std::strcmp(ext, "GL_ARB_texture_compression_bptc")) s.bptc = true;
+      if (!std::strcmp(ext, "GL_KHR_texture_compression_astc_ldr")) s.astc = true;
+    }
+  }
+  return s;
+}
+
+// GL format for a KTX2 vkFormat, 0 if not one we can sample
+inline GLenum gl_compressed_format(uint32_t vk_format) {
+  const CompressedSupport& s = compressed_support();
+  switch (vk_format) {
+    case 131: return s.s3tc ? COMPRESSED_RGB_S3TC_DXT1 : 0;    // BC1_RGB_UNORM
+    case 133: return s.s3tc ? COMPRESSED_RGBA_S3TC_DXT1 : 0;   // BC1_RGBA_UNORM
+    case 137: return s.s3tc ? COMPRESSED_RGBA_S3TC_DXT5 : 0;   // BC3_UNORM
+    case 145: return s.bptc ? COMPRESSED_RGBA_BPTC_UNORM : 0;  // BC7_UNORM
+    case 157: return s.astc ? COMPRESSED_RGBA_ASTC_4x4 : 0;    // ASTC_4x4_UNORM
+    default: return 0;
+  }
+}
+
+inline bool read_file(const std::string& path, std::vector<unsigned char>* out) {
+  FILE* f = fopen(path.c_str(), "rb");
+  if (!f) return false;
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  out->resize(size > 0 ? (size_t)size : 0);
+  bool ok = size > 0 && fread(out->data(), 1, out->size(), f) == out->size();
+  fclose(f);
+  return ok;
+}
+
+template <typename T>
+inline T read_le(const unsigned char* p) {
+  T v;
+  std::memcpy(&v, p, sizeof(T));  // KTX2 is little endian, as are our targets
+  return v;
+}
+
+// Upload a KTX2 file's mip chain into texture. False if the file isn't
+// one we can use, leaving texture untouched.
+inline bool upload_ktx2(GLuint texture, const std::vector<unsigned char>& file) {
+  static const unsigned char IDENTIFIER[12] =
+      {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+  const size_t HEADER_BYTES = 80, LEVEL_BYTES = 24;
+  const unsigned char* d = file.data();
+  if (file.size() < HEADER_BYTES || std::memcmp(d, IDENTIFIER, 12) != 0) return false;
+  uint32_t vk_format = read_le<uint32_t>(d + 12);
+  uint32_t width = read_le<uint32_t>(d + 20);
+  uint32_t height = read_le<uint32_t>(d + 24);
+  uint32_t depth = read_le<uint32_t>(d + 28);
+  uint32_t layers = read_le<uint32_t>(d + 32);
+  uint32_t faces = read_le<uint32_t>(d + 36);
+  uint32_t levels = read_le<uint32_t>(d + 40);
+  uint32_t supercompression = read_le<uint32_t>(d + 44);
+  GLenum format = gl_compressed_format(vk_format);
+  if (!format || depth > 0 || layers > 1 || faces != 1 || levels == 0 ||
+      supercompression != 0 || file.size() < HEADER_BYTES + levels * LEVEL_BYTES) {
+    return false;
+  }
+  for (uint32_t i = 0; i < levels; ++i) {
+    const unsigned char* level = d + HEADER_BYTES + i * LEVEL_BYTES;
+    uint64_t offset = read_le<uint64_t>(level), bytes = read_le<uint64_t>(level + 8);
+    if (offset + bytes > file.size()) return false;
+  }
+
+  eglstate::bind_texture(GL_TEXTURE_2D, texture);
+  int64_t total = 0;
+  for (uint32_t i = 0; i < levels; ++i) {
+    const unsigned char* level = d + HEADER_BYTES + i * LEVEL_BYTES;
+    uint64_t offset = read_le<uint64_t>(level), bytes = read_le<uint64_t>(level + 8);
+    total += (int64_t)bytes;
+    wrap_glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)i, format,
+                                (GLsizei)std::max(1u, width >> i), (GLsizei)std::max(1u, height >> i),
+                                0, (GLsizei)bytes, d + offset);
+  }
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)levels - 1);
+  ememtrack::track_texture(texture, ememtrack::CAT_TEXTURES, total);
+  return true;
+}
+
+// "dir/tex.png" -> "dir/tex.<variant>.ktx2"
+inline std::string ktx2_variant_path(const char* path, const char* variant) {
+  std::filesystem::path p(path);
+  p.replace_extension(std::string(".") + variant + ".ktx2");
+  return p.string();
+}
+
+// Texture from the best compressed variant of path's image, or 0
+inline GLuint load_compressed(const char* path, int wrap_s, int wrap_t,
+                              int min_filter, int mag_filter) {
+  static const char* VARIANTS[] = {"astc", "bc7", "bc1"};
+  std::vector<unsigned char> file;
+  for (const char* variant : VARIANTS) {
+    if (!read_file(ktx2_variant_path(path, variant), &file)) continue;
+    GLuint texture = 0;
+    glGenTextures(1, &texture);
+    eglstate::bind_texture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap_s);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap_t);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, min_filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, mag_filter);
+    if (upload_ktx2(texture, file)) return texture;
+    eglstate::forget_texture(texture);
+    glDeleteTextures(1, &texture);
+  }
+  return 0;
+}
+
+// ============ ASYNC LOADING ============
+// load_async hands back a texture id at once: a 1x1 white placeholder,
+// with its wrap and filter parameters already set. The image is decoded
+// on the job pool (engine/jobs_impl.h). pump_uploads runs on the GL thread once per
+// frame and uploads decoded images into their textures through a pixel
+// unpack buffer until its time budget is spent.
+//
+// The cache applies as for synchronous loads. A second load_async of an
+// image still in flight gets the same placeholder, which fills in for
+// both. If a texture is released before its image arrives, the upload is
+// dropped.
+//
+// Workers flip rows themselves: stb_image's flip flag is one global
+// (STBI_NO_THREAD_LOCALS), so setting it from a worker would race.
+
+struct DecodeJob {
+  GLuint texture;
+  std::string key;
+  std::string path;
+  int channels;                 // 3 or 4
+  bool flip;
+};
+
+struct DecodedImage {
+  DecodeJob job;
+  unsigned char* pixels;        // stbi-owned; nullptr if decoding failed
+  int width, height;
+};
+
+inline void flip_rows(unsigned char* pixels, int width, int height, int channels) {
+  size_t row = (size_t)width * channels;
+  std::vector<unsigned char> tmp(row);
+  for (int y = 0; y < height / 2; ++y) {
+    unsigned char* a = pixels + (size_t)y * row;
+    unsigned char* b = pixels + (size_t)(height - 1 - y) * row;
+    std::memcpy(tmp.data(), a, row);
+    std::memcpy(a, b, row);
+    std::memcpy(b, tmp.data(), row);
+  }
+}
+
+struct AsyncLoader {
+  std::mutex mutex;
+  std::deque<DecodeJob> jobs;
+  std::deque<DecodedImage> decoded;
+  ejobs::Counter decoding;      // One pool job per queued load
+  int pending = 0;              // GL thread: loads not yet uploaded
+  GLuint pbo = 0;
+
+  // A pool job: decode the oldest queued load, if stop left any
+  void decode_next() {
+    DecodeJob job;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (jobs.empty()) return;
+      job = std::move(jobs.front());
+      jobs.pop_front();
+    }
+    int w = 0, h = 0, n = 0;
+    unsigned char* pixels = stbi_load(job.path.c_str(), &w, &h, &n, job.channels);
+    if (pixels && job.flip) flip_rows(pixels, w, h, job.channels);
+    std::lock_guard<std::mutex> lock(mutex);
+    decoded.push_back(DecodedImage{std::move(job), pixels, w, h});
+  }
+
+  void queue(DecodeJob job) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      jobs.push_back(std::move(job));
+    }
+    ejobs::submit(&decoding, [this] { decode_next(); });
+  }
+
+  void stop() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      jobs.clear();
+    }
+    ejobs::wait(&decoding);
+    for (auto& d : decoded) {
+      if (d.pixels) stbi_image_free(d.pixels);
+    }
+    decoded.clear();
+    pending = 0;
+  }
+
+  ~AsyncLoader() { stop(); }
+};
+
+inline AsyncLoader& loader() {
+  static AsyncLoader l;
+  return l;
+}
+
+inline GLuint load_async(const char* path, int alpha, int wrap_s, int wrap_t,
+                         int min_filter, int mag_filter, int flip) {
+  GLuint cached = acquire(path, alpha, wrap_s, wrap_t, min_filter, mag_filter, flip);
+  if (cached) return cached;
+
+  // A compressed variant is ready to upload as is, no worker needed
+  GLuint compressed = flip ? 0 : load_compressed(path, wrap_s, wrap_t, min_filter, mag_filter);
+  if (compressed) {
+    insert(compressed, path, alpha, wrap_s, wrap_t, min_filter, mag_filter, flip);
+    return compressed;
+  }
+
+  GLuint texture = 0;
+  glGenTextures(1, &texture);
+  eglstate::bind_texture(GL_TEXTURE_2D, texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap_s);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap_t);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, min_filter);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, mag_filter);
+  const unsigned char white[4] = {255, 255, 255, 255};
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, white);
+  insert(texture, path, alpha, wrap_s, wrap_t, min_filter, mag_filter, flip);
+
+  AsyncLoader& l = loader();
+  l.queue(DecodeJob{texture, cache_key(path, alpha, wrap_s, wrap_t, min_filter, mag_filter, flip),
+                    path, alpha ? 4 : 3, flip != 0});
+  ++l.pending;
+  return texture;
+}
+
+// Upload one decoded image through the unpack buffer (orphaned per upload)
+inline void upload_decoded(AsyncLoader& l, const DecodedImage& d) {
+  GLenum format = d.job.channels == 4 ? GL_RGBA : GL_RGB;
+  size_t bytes = (size_t)d.width * d.height * d.job.channels;
+  if (!l.pbo) glGenBuffers(1, &l.pbo);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, l.pbo);
+  glBufferData(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)bytes, nullptr, GL_STREAM_DRAW);
+  void* dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr)bytes,
+                               GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+  const void* src = nullptr;    // Offset 0 in the unpack buffer
+  if (dst) {
+    std::memcpy(dst, d.pixels, bytes);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+  } else {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    src = d.pixels;
+  }
+  glcount::texture_upload((long long)bytes);
+  eglstate::bind_texture(GL_TEXTURE_2D, d.job.texture);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);  // RGB rows aren't 4-byte multiples
+  glTexImage2D(GL_TEXTURE_2D, 0, format, d.width, d.height, 0, format, GL_UNSIGNED_BYTE, src);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glGenerateMipmap(GL_TEXTURE_2D);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  account_texture(d.job.texture, d.width, d.height, d.job.channels);
+}
+
+// Upload decoded images until budget_ms has passed (at least one per call,
+// so loading always progresses). Returns the loads still pending.
+inline int pump_uploads(double budget_ms) {
+  AsyncLoader& l = loader();
+  if (l.pending == 0) return 0;
+  auto start = std::chrono::steady_clock::now();
+  for (;;) {
+    DecodedImage d;
+    {
+      std::lock_guard<std::mutex> lock(l.mutex);
+      if (l.decoded.empty()) break;
+      d = std::move(l.decoded.front());
+      l.decoded.pop_front();
+    }
+    --l.pending;
+    auto it = cache().by_key.find(d.job.key);
+    bool live = it != cache().by_key.end() && it->second == d.job.texture;
+    if (!d.pixels) {
+      fprintf(stderr, "Failed to load texture image: %s (%s)\n",
+              d.job.path.c_str(), stbi_failure_reason());
+    } else if (live) {
+      upload_decoded(l, d);
+    }
+    if (d.pixels) stbi_image_free(d.pixels);
+    std::chrono::duration<double, std::milli> spent = std::chrono::steady_clock::now() - start;
+    if (spent.count() >= budget_ms) break;
+  }
+  return l.pending;
+}
+
+inline int pending_uploads() {
+  return loader().pending;
+}
+
+// Wait out the decodes running and drop the loads still queued (their
+// textures keep the placeholder)
+inline void shutdown_async() {
+  loader().stop();
+}
+
+// ============ TEXTURE ARRAYS ============
+// A level's images packed into GL_TEXTURE_2D_ARRAYs, so primitives with
+// different images share one binding and can be drawn together. Images
+// are decoded to RGBA8 on worker threads and grouped by size, one array
+// (mipmapped, every layer sampled alike) per distinct size. Building is
+// synchronous. KTX2 variants aren't used: every layer of an array needs
+// one format, and the decoded images already share one.
+//
+// Arrays are owned by their set, not the cache; destroy_array_set deletes
+// them.
+
+struct TextureArraySet {
+  std::vector<std::string> paths;
+  std::unordered_map<std::string, int> by_path;
+  std::vector<GLuint> arrays;           // One per distinct image size
+  std::vector<int> array_of;            // Per path: index into arrays, -1 if it didn't load
+  std::vector<int> layer_of;
+};
+
+inline TextureArraySet* create_array_set() {
+  return new TextureArraySet();
+}
+
+// Index of path in the set, added on first sight
+inline int array_set_add(TextureArraySet* s, const char* path) {
+  std::string key = normalize_path(path);
+  auto it = s->by_path.find(key);
+  if (it != s->by_path.end()) return it->second;
+  int i = (int)s->paths.size();
+  s->paths.push_back(key);
+  s->by_path[key] = i;
+  return i;
+}
+
+// Decode every path and upload the arrays. Returns how many arrays there are.
+inline int array_set_build(TextureArraySet* s, int wrap_s, int wrap_t, int min_filter,
+                           int mag_filter, int flip) {
+  struct Image {
+    unsigned char* pixels = nullptr;
+    int width = 0, height = 0;
+  };
+  std::vector<Image> images(s->paths.size());
+  ejobs::parallel_for((int)images.size(), 1, [&](int i) {
+    int n = 0;
+    Image& im = images[i];
+    im.pixels = stbi_load(s->paths[i].c_str(), &im.width, &im.height, &n, 4);
+    if (im.pixels && flip) flip_rows(im.pixels, im.width, im.height, 4);
+  });
+
+  std::vector<std::pair<int, int>> sizes;
+  s->array_of.assign(images.size(), -1);
+  s->layer_of.assign(images.size(), -1);
+  std::vector<int> layers;
+  for (size_t i = 0; i < images.size(); ++i) {
+    if (!images[i].pixels) {
+      fprintf(stderr, "Failed to load texture image: %s (%s)\n", s->paths[i].c_str(),
+              stbi_failure_reason());
+      continue;
+    }
+    std::pair<int, int> size(images[i].width, images[i].height);
+    auto it = std::find(sizes.begin(), sizes.end(), size);
+    int a = (int)(it - sizes.begin());
+    if (it == sizes.end()) {
+      sizes.push_back(size);
+      layers.push_back(0);
+    }
+    s->array_of[i] = a;
+    s->layer_of[i] = layers[a]++;
+  }
+
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  for (size_t a = 0; a < sizes.size(); ++a) {
+    GLuint texture = 0;
+    glGenTextures(1, &texture);
+    eglstate::bind_texture(GL_TEXTURE_2D_ARRAY, texture);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, wrap_s);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, wrap_t);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, min_filter);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, mag_filter);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, sizes[a].first, sizes[a].second, layers[a], 0,
+                 GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    for (size_t i = 0; i < images.size(); ++i) {
+      if (s->array_of[i] != (int)a) continue;
+      glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, s->layer_of[i], sizes[a].first, sizes[a].second,
+                      1, GL_RGBA, GL_UNSIGNED_BYTE, images[i].pixels);
+    }
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    ememtrack::track_texture(texture, ememtrack::CAT_TEXTURES,
+                             (int64_t)sizes[a].first * sizes[a].second * 4 * layers[a] * 4 / 3);
+    s->arrays.push_back(texture);
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  for (Image& im : images) {
+    if (im.pixels) stbi_image_free(im.pixels);
+  }
+  return (int)s->arrays.size();
+}
+
+// Path i's array texture and layer; 0 and -1 if it didn't load
+inline GLuint array_set_texture(const TextureArraySet* s, int i) {
+  return s->array_of[i] < 0 ? 0 : s->arrays[s->array_of[i]];
+}
+
+inline int array_set_layer(const TextureArraySet* s, int i) {
+  return s->layer_of[i];
+}
+
+inline void destroy_array_set(TextureArraySet* s) {
+  for (GLuint texture : s->arrays) {
+    eglstate::forget_texture(texture);
+    ememtrack::untrack_texture(texture);
+  }
+  if (!s->arrays.empty()) glDeleteTextures((GLsizei)s->arrays.size(), s->arrays.data());
+  delete s;
+}
+
+} // namespace etextures
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace etiming {
+
+// ============================================================================
+// Monotonic clock
+// ============================================================================
+// steady_clock never jumps with wall-clock changes, so deadlines computed
+// from it stay evenly spaced.
+
+inline double now_ms() {
+    using namespace std::chrono;
+    return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+// The same clock in whole nanoseconds, for intervals a double of
+// milliseconds would round once the epoch is far back
+inline int64_t now_ns() {
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Sleep until deadline_ms (on now_ms's clock). OS sleeps overshoot by up to
+// a scheduler quantum, so the last spin_ms are spent yielding in a loop.
+inline void sleep_until_ms(double deadline_ms, double spin_ms) {
+    double remaining = deadline_ms - now_ms();
+    if (remaining > spin_ms) {
+        std::this_thread::sleep_for(
+            std::chrono::duration<double, std::milli>(remaining - spin_ms));
+    }
+    while (now_ms() < deadline_ms) {
+        std::this_thread::yield();
+    }
+}
+
+// ============================================================================
+// Startup profile
+// ============================================================================
+// Wall time of each startup phase (jank-engine_run --profile-startup): the
+// runtime's include/config/require/realize steps and whatever the game
+// wraps in timing/startup-phase. Off unless startup_begin was called, so
+// recording costs one branch otherwise.
+
+struct StartupEvent {
+    std::string category;
+    std::string name;
+    double start_ms;
+    double dur_ms;
+};
+
+struct StartupProfile {
+    bool enabled = false;
+    double origin_ms = 0.0;
+    std::string trace_path;
+    std::vector<StartupEvent> events;
+};
+
+inline StartupProfile& startup_profile() {
+    static StartupProfile profile;
+    return profile;
+}
+
+// trace_path: Chrome trace JSON to write at startup_finish ("" for none)
+inline void startup_begin(const char* trace_path) {
+    StartupProfile& p = startup_profile();
+    p.enabled = true;
+    p.origin_ms = now_ms();
+    p.trace_path = trace_path ? trace_path : "";
+    p.events.clear();
+}
+
+inline bool startup_enabled() {
+    return startup_profile().enabled;
+}
+
+// A phase that began at start_ms (now_ms's clock) and ends now
+inline void startup_record(const char* category, const char* name, double start_ms) {
+    StartupProfile& p = startup_profile();
+    if (!p.enabled) return;
+    p.events.push_back({category, name, start_ms, now_ms() - start_ms});
+}
+
+inline std::string json_escape(const std::string& s) {
+    std::string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\') out += '\\';
+        if ((unsigned char)c >= 0x20) out += c;
+    }
+    return out;
+}
+
+// Print every phase, slowest first, and write the trace if one was asked
+// for. Profiling stops; later calls do nothing.
+inline void startup_finish() {
+    StartupProfile& p = startup_profile();
+    if (!p.enabled) return;
+    p.enabled = false;
+    double total = now_ms() - p.origin_ms;
+
+    std::vector<StartupEvent> sorted = p.events;
+    std::stable_sort(sorted.begin(), sorted.end(),
+                     [](const StartupEvent& a, const StartupEvent& b) { return a.dur_ms > b.dur_ms; });
+    std::printf("\n=== Startup profile: %.1f ms ===\n", total);
+    std::printf("%10s %6s  %-9s %s\n", "ms", "%", "phase", "name");
+    for (const StartupEvent& e : sorted) {
+        std::printf("%10.1f %5.1f%%  %-9s %s\n", e.dur_ms, total > 0.0 ? 100.0 * e.dur_ms / total : 0.0,
+                    e.category.c_str(), e.name.c_str());
+    }
+
+    if (!p.trace_path.empty()) {
+        FILE* f = std::fopen(p.trace_path.c_str(), "w");
+        if (!f) {
+            std::printf("Can't write startup trace: %s\n", p.trace_path.c_str());
+        } else {
+            // Complete ("X") events in microseconds from the profile's start
+            std::fprintf(f, "{\"traceEvents\":[");
+            for (size_t i = 0; i < p.events.size(); ++i) {
+                const StartupEvent& e = p.events[i];
+                std::fprintf(f, "%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.0f,\"dur\":%.0f,\"pid\":1,\"tid\":1}",
+                             i ? "," : "", json_escape(e.name).c_str(), json_escape(e.category).c_str(),
+                             (e.start_ms - p.origin_ms) * 1000.0, e.dur_ms * 1000.0);
+            }
+            std::fprintf(f, "\n],\"displayTimeUnit\":\"ms\"}\n");
+            std::fclose(f);
+            std::printf("Startup trace: %s\n", p.trace_path.c_str());
+        }
+    }
+    p.events.clear();
+}
+
+} // namespace etiming
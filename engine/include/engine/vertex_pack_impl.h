@@ -0,0 +1,64 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// ============================================================================
+// Vertex attribute packing
+// ============================================================================
+// Shared by the glTF upload (engine/gltf_impl.h) and the compact skinned
+// layout (engine/animation_mesh_impl.h): normals as GL_INT_2_10_10_10_REV,
+// uvs as half floats, and weights as unorm8.
+
+namespace evpack {
+
+// Half uvs only while every uv is within this; past it the precision loss
+// shows in tiled textures
+const float HALF_UV_LIMIT = 2.0f;
+
+inline uint32_t pack_snorm_2_10_10_10(const float* n) {
+  auto q = [](float v) -> uint32_t {
+    v = std::max(-1.0f, std::min(1.0f, v));
+    return (uint32_t)((int32_t)std::lround(v * 511.0f)) & 0x3FFu;
+  };
+  return q(n[0]) | (q(n[1]) << 10) | (q(n[2]) << 20);
+}
+
+// Round to nearest; values here are small enough to skip overflow/denormal
+// care beyond flushing to zero
+inline uint16_t float_to_half(float f) {
+  uint32_t x;
+  std::memcpy(&x, &f, 4);
+  uint32_t sign = (x >> 16) & 0x8000u;
+  int32_t exponent = (int32_t)((x >> 23) & 0xFF) - 127 + 15;
+  uint32_t mantissa = x & 0x7FFFFFu;
+  if (exponent <= 0) return (uint16_t)sign;
+  if (exponent >= 31) return (uint16_t)(sign | 0x7BFFu);
+  uint32_t h = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+  if (mantissa & 0x1000u) h++;  // Carries into the exponent correctly
+  return (uint16_t)h;
+}
+
+// Four weights summing to 1 as unorm8 summing to exactly 255: each is
+// rounded and the rounding error goes to the largest, so the skinned
+// position isn't scaled
+inline void pack_unorm8_weights(const float* w, uint8_t* out) {
+  int total = 0;
+  int largest = 0;
+  for (int i = 0; i < 4; ++i) {
+    float v = std::max(0.0f, std::min(1.0f, w[i]));
+    out[i] = (uint8_t)std::lround(v * 255.0f);
+    total += out[i];
+    if (w[i] > w[largest]) largest = i;
+  }
+  out[largest] = (uint8_t)std::max(0, std::min(255, out[largest] + 255 - total));
+}
+
+inline void put(std::vector<unsigned char>* out, const void* data, size_t bytes) {
+  const unsigned char* p = static_cast<const unsigned char*>(data);
+  out->insert(out->end(), p, p + bytes);
+}
+
+} // namespace evpack
@@ -0,0 +1,280 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+
+namespace ewire {
+
+// ============================================================================
+// Binary wire format
+// ============================================================================
+// Byte-level helpers for the schema codec in engine.networking.protocol.
+// Little-endian, unaligned. Integers and lengths are zigzag/LEB128 varints.
+// Binary packets start with BINARY_MARKER; EDN text never starts with NUL,
+// so receivers tell the two formats apart by the first byte.
+
+const unsigned char BINARY_MARKER = 0x00;
+
+inline std::vector<unsigned char>* make_bytes(int reserve) {
+    std::vector<unsigned char>* bytes = new std::vector<unsigned char>();
+    bytes->reserve(reserve > 0 ? (size_t)reserve : 0);
+    return bytes;
+}
+
+// ============================================================================
+// Quantization
+// ============================================================================
+// Fixed point: round(v * scale) as a signed nbytes-wide (1-4) integer,
+// clamped to its range. Angles: degrees wrapped to [-180, 180) in 16 bits.
+// The quantize_* functions give the value a receiver will decode, so both
+// ends of a simulation can run on identical numbers.
+
+inline int64_t fixed_bits(double v, double scale, int nbytes) {
+    int64_t limit = ((int64_t)1 << (nbytes * 8 - 1)) - 1;
+    double q = std::round(v * scale);
+    if (!(q > (double)-limit)) return -limit;  // also catches NaN
+    if (q > (double)limit) return limit;
+    return (int64_t)q;
+}
+
+inline double quantize_fixed(double v, double scale, int nbytes) {
+    return (double)fixed_bits(v, scale, nbytes) / scale;
+}
+
+inline int angle_bits(double degrees) {
+    double turns = degrees / 360.0;
+    turns -= std::floor(turns + 0.5);  // [-0.5, 0.5)
+    return (int)std::lround(turns * 65536.0) & 0xffff;
+}
+
+inline double angle_from_bits(int bits) {
+    int16_t s = (int16_t)(uint16_t)bits;
+    return (double)s * (360.0 / 65536.0);
+}
+
+inline double quantize_angle16(double degrees) {
+    return angle_from_bits(angle_bits(degrees));
+}
+
+// ============================================================================
+// Writer
+// ============================================================================
+
+inline void write_u8(std::vector<unsigned char>* out, int v) {
+    out->push_back((unsigned char)v);
+}
+
+inline void write_varint(std::vector<unsigned char>* out, uint64_t v) {
+    while (v >= 0x80) {
+        out->push_back((unsigned char)(v | 0x80));
+        v >>= 7;
+    }
+    out->push_back((unsigned char)v);
+}
+
+// Signed ints are zigzag encoded so small negatives stay small
+inline void write_int(std::vector<unsigned char>* out, int64_t v) {
+    write_varint(out, ((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+}
+
+inline void write_count(std::vector<unsigned char>* out, int n) {
+    write_varint(out, (uint64_t)(n > 0 ? n : 0));
+}
+
+inline void write_f32(std::vector<unsigned char>* out, float v) {
+    unsigned char b[4];
+    memcpy(b, &v, 4);
+    out->insert(out->end(), b, b + 4);
+}
+
+inline void write_f64(std::vector<unsigned char>* out, double v) {
+    unsigned char b[8];
+    memcpy(b, &v, 8);
+    out->insert(out->end(), b, b + 8);
+}
+
+inline void write_fixed(std::vector<unsigned char>* out, double v, double scale, int nbytes) {
+    uint64_t bits = (uint64_t)fixed_bits(v, scale, nbytes);
+    for (int i = 0; i < nbytes; i++) out->push_back((unsigned char)(bits >> (8 * i)));
+}
+
+inline void write_angle16(std::vector<unsigned char>* out, double degrees) {
+    int bits = angle_bits(degrees);
+    out->push_back((unsigned char)bits);
+    out->push_back((unsigned char)(bits >> 8));
+}
+
+inline void write_str(std::vector<unsigned char>* out, const char* s) {
+    size_t len = s ? strlen(s) : 0;
+    write_varint(out, len);
+    out->insert(out->end(), (const unsigned char*)s, (const unsigned char*)s + len);
+}
+
+// Splice a pre-encoded part (e.g. a message body shared by several packets)
+inline void write_bytes(std::vector<unsigned char>* out, const std::vector<unsigned char>* part) {
+    out->insert(out->end(), part->begin(), part->end());
+}
+
+inline int hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Canonical "xxxxxxxx-xxxx-..." text to 16 raw bytes.
+// Returns false (and writes zeros) when s isn't a UUID.
+inline bool write_uuid(std::vector<unsigned char>* out, const char* s) {
+    unsigned char b[16] = {0};
+    int n = 0;
+    for (const char* p = s; p && *p && n < 32; p++) {
+        if (*p == '-') continue;
+        int d = hex_digit(*p);
+        if (d < 0) break;
+        b[n / 2] |= (unsigned char)(n % 2 == 0 ? d << 4 : d);
+        n++;
+    }
+    if (n != 32) memset(b, 0, 16);
+    out->insert(out->end(), b, b + 16);
+    return n == 32;
+}
+
+// ============================================================================
+// Reader
+// ============================================================================
+// Reads past the end return zero and clear ok, so a decoder can run to
+// completion on a truncated packet and check read_ok once at the end.
+
+struct Reader {
+    const unsigned char* data = nullptr;
+    size_t len = 0;
+    size_t pos = 0;
+    bool ok = true;
+    std::string scratch;  // backing store for read_str / read_uuid results
+};
+
+inline void reader_init(Reader* r, std::vector<unsigned char>* bytes) {
+    r->data = bytes->data();
+    r->len = bytes->size();
+    r->pos = 0;
+    r->ok = true;
+}
+
+// Read a borrowed span in place (e.g. a received packet's payload)
+inline void reader_init_span(Reader* r, const unsigned char* data, size_t len) {
+    r->data = data;
+    r->len = len;
+    r->pos = 0;
+    r->ok = true;
+}
+
+inline bool read_ok(Reader* r) {
+    return r->ok;
+}
+
+inline bool reader_take(Reader* r, size_t n) {
+    if (!r->ok || r->len - r->pos < n) {
+        r->ok = false;
+        return false;
+    }
+    return true;
+}
+
+// For decoders that find a value they can't accept (e.g. an unknown id)
+inline void reader_fail(Reader* r) {
+    r->ok = false;
+}
+
+inline int read_u8(Reader* r) {
+    if (!reader_take(r, 1)) return 0;
+    return r->data[r->pos++];
+}
+
+inline uint64_t read_varint(Reader* r) {
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (!reader_take(r, 1)) return 0;
+        unsigned char b = r->data[r->pos++];
+        v |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) return v;
+    }
+    r->ok = false;
+    return 0;
+}
+
+inline int64_t read_int(Reader* r) {
+    uint64_t v = read_varint(r);
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+// Counts are bounded by the bytes left so a corrupt length can't make the
+// decoder loop for long
+inline int read_count(Reader* r) {
+    uint64_t n = read_varint(r);
+    if (n > r->len - r->pos) {
+        r->ok = false;
+        return 0;
+    }
+    return (int)n;
+}
+
+inline float read_f32(Reader* r) {
+    float v = 0.0f;
+    if (!reader_take(r, 4)) return v;
+    memcpy(&v, r->data + r->pos, 4);
+    r->pos += 4;
+    return v;
+}
+
+inline double read_f64(Reader* r) {
+    double v = 0.0;
+    if (!reader_take(r, 8)) return v;
+    memcpy(&v, r->data + r->pos, 8);
+    r->pos += 8;
+    return v;
+}
+
+inline double read_fixed(Reader* r, double scale, int nbytes) {
+    if (!reader_take(r, (size_t)nbytes)) return 0.0;
+    uint64_t bits = 0;
+    for (int i = 0; i < nbytes; i++) bits |= (uint64_t)r->data[r->pos + i] << (8 * i);
+    r->pos += (size_t)nbytes;
+    int shift = 64 - nbytes * 8;
+    int64_t v = (int64_t)(bits << shift) >> shift;  // sign-extend
+    return (double)v / scale;
+}
+
+inline double read_angle16(Reader* r) {
+    if (!reader_take(r, 2)) return 0.0;
+    int bits = r->data[r->pos] | (r->data[r->pos + 1] << 8);
+    r->pos += 2;
+    return angle_from_bits(bits);
+}
+
+// Valid until the next read_str / read_uuid on r
+inline const char* read_str(Reader* r) {
+    int n = read_count(r);
+    r->scratch.assign((const char*)r->data + r->pos, (size_t)n);
+    r->pos += (size_t)n;
+    return r->scratch.c_str();
+}
+
+// Valid until the next read_str / read_uuid on r
+inline const char* read_uuid(Reader* r) {
+    static const char* HEX = "0123456789abcdef";
+    r->scratch.clear();
+    if (!reader_take(r, 16)) return r->scratch.c_str();
+    for (int i = 0; i < 16; i++) {
+        if (i == 4 || i == 6 || i == 8 || i == 10) r->scratch.push_back('-');
+        unsigned char b = r->data[r->pos + i];
+        r->scratch.push_back(HEX[b >> 4]);
+        r->scratch.push_back(HEX[b & 0xf]);
+    }
+    r->pos += 16;
+    return r->scratch.c_str();
+}
+
+} // namespace ewire
@@ -23,11 +23,104 @@ extern "C" {
 #include <GL/glew.h>
 #endif
 
+// Per-frame call counters: draws, primitives, program and texture binds,
+// bytes uploaded to buffers and textures. The wrappers below count
+// themselves; engine C++ that calls GL directly counts through the same
+// helpers. Off until glcount::set_enabled, and then a branch and an add
+// per call. end_frame closes the frame, read with last().
+namespace glcount {
+
+struct Counters {
+  long long draws = 0;          // Draw calls (a multi-draw is one)
+  long long primitives = 0;     // Triangles, lines or points, instances included
+  long long programs = 0;       // glUseProgram calls issued
+  long long texture_binds = 0;  // glBindTexture calls issued
+  long long buffer_bytes = 0;   // Uploaded to buffers (data, sub data, mapped)
+  long long texture_bytes = 0;  // Uploaded to textures
+};
+
+struct Stats {
+  bool enabled = false;
+  Counters frame;
+  Counters last;
+};
+
+inline Stats& stats() {
+  static Stats s;
+  return s;
+}
+
+inline void set_enabled(bool enabled) { stats().enabled = enabled; }
+inline bool enabled() { return stats().enabled; }
+
+inline long long primitive_count(GLenum mode, long long vertices) {
+  switch (mode) {
+  case GL_TRIANGLES: return vertices / 3;
+  case GL_TRIANGLE_STRIP:
+  case GL_TRIANGLE_FAN: return vertices > 2 ? vertices - 2 : 0;
+  case GL_LINES: return vertices / 2;
+  case GL_LINE_STRIP: return vertices > 1 ? vertices - 1 : 0;
+  case GL_LINE_LOOP: return vertices;
+  default: return vertices;
+  }
+}
+
+inline void draw(GLenum mode, long long vertices, long long instances = 1) {
+  Stats& s = stats();
+  if (!s.enabled) return;
+  ++s.frame.draws;
+  s.frame.primitives += primitive_count(mode, vertices) * instances;
+}
+
+// Primitives of one sub-draw of a multi-draw already counted by draw
+inline void primitives(GLenum mode, long long vertices, long long instances = 1) {
+  Stats& s = stats();
+  if (s.enabled) s.frame.primitives += primitive_count(mode, vertices) * instances;
+}
+
+inline void program() {
+  Stats& s = stats();
+  if (s.enabled) ++s.frame.programs;
+}
+
+inline void texture_bind() {
+  Stats& s = stats();
+  if (s.enabled) ++s.frame.texture_binds;
+}
+
+inline void buffer_upload(long long bytes) {
+  Stats& s = stats();
+  if (s.enabled) s.frame.buffer_bytes += bytes;
+}
+
+inline void texture_upload(long long bytes) {
+  Stats& s = stats();
+  if (s.enabled) s.frame.texture_bytes += bytes;
+}
+
+// Bytes in a width x height image of an unsized format and type, for
+// glTexImage2D / glTexSubImage2D (the formats the engine uploads)
+inline long long image_bytes(GLsizei width, GLsizei height, GLenum format, GLenum type) {
+  int channels = format == GL_RED ? 1 : format == GL_RG ? 2 : format == GL_RGB ? 3 : 4;
+  int size = type == GL_FLOAT ? 4 : type == GL_UNSIGNED_SHORT ? 2 : 1;
+  return (long long)width * height * channels * size;
+}
+
+inline void end_frame() {
+  Stats& s = stats();
+  s.last = s.frame;
+  s.frame = Counters();
+}
+
+inline const Counters& last() { return stats().last; }
+
+} // namespace glcount
+
 // Buffer operations
 inline void wrap_glGenBuffers(GLsizei n, GLuint *buffers) { glGenBuffers(n, buffers); }
 inline void wrap_glBindBuffer(GLenum target, GLuint buffer) { glBindBuffer(target, buffer); }
-inline void wrap_glBufferData(GLenum target, GLsizeiptr size, const void *data, GLenum usage) { glBufferData(target, size, data, usage); }
-inline void wrap_glBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void *data) { glBufferSubData(target, offset, size, data); }
+inline void wrap_glBufferData(GLenum target, GLsizeiptr size, const void *data, GLenum usage) { if (data) glcount::buffer_upload(size); glBufferData(target, size, data, usage); }
+inline void wrap_glBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void *data) { glcount::buffer_upload(size); glBufferSubData(target, offset, size, data); }
 
 // Vertex array operations
 inline void wrap_glGenVertexArrays(GLsizei n, GLuint *arrays) { glGenVertexArrays(n, arrays); }
@@ -37,8 +130,12 @@ inline void wrap_glVertexAttribIPointer(GLuint index, GLint size, GLenum type, G
 inline void wrap_glEnableVertexAttribArray(GLuint index) { glEnableVertexAttribArray(index); }
 
 // Draw operations
-inline void wrap_glDrawArrays(GLenum mode, GLint first, GLsizei count) { glDrawArrays(mode, first, count); }
-inline void wrap_glDrawElements(GLenum mode, GLsizei count, GLenum type, const void *indices) { glDrawElements(mode, count, type, indices); }
+inline void wrap_glDrawArrays(GLenum mode, GLint first, GLsizei count) { glcount::draw(mode, count); glDrawArrays(mode, first, count); }
+inline void wrap_glDrawElements(GLenum mode, GLsizei count, GLenum type, const void *indices) { glcount::draw(mode, count); glDrawElements(mode, count, type, indices); }
+inline void wrap_glDrawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei instances) { glcount::draw(mode, count, instances); glDrawArraysInstanced(mode, first, count, instances); }
+inline void wrap_glDrawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const void *indices, GLsizei instances) { glcount::draw(mode, count, instances); glDrawElementsInstanced(mode, count, type, indices, instances); }
+inline void wrap_glDrawElementsBaseVertex(GLenum mode, GLsizei count, GLenum type, const void *indices, GLint base_vertex) { glcount::draw(mode, count); glDrawElementsBaseVertex(mode, count, type, indices, base_vertex); }
+inline void wrap_glDrawElementsInstancedBaseVertex(GLenum mode, GLsizei count, GLenum type, const void *indices, GLsizei instances, GLint base_vertex) { glcount::draw(mode, count, instances); glDrawElementsInstancedBaseVertex(mode, count, type, indices, instances, base_vertex); }
 
 // Shader operations
 inline GLuint wrap_glCreateShader(GLenum type) { return glCreateShader(type); }
@@ -52,7 +149,7 @@ inline GLuint wrap_glCreateProgram() { return glCreateProgram(); }
 inline void wrap_glAttachShader(GLuint program, GLuint shader) { glAttachShader(program, shader); }
 inline void wrap_glLinkProgram(GLuint program) { glLinkProgram(program); }
 inline void wrap_glGetProgramiv(GLuint program, GLenum pname, GLint *params) { glGetProgramiv(program, pname, params); }
-inline void wrap_glUseProgram(GLuint program) { glUseProgram(program); }
+inline void wrap_glUseProgram(GLuint program) { glcount::program(); glUseProgram(program); }
 
 // Uniform operations
 inline GLint wrap_glGetUniformLocation(GLuint program, const GLchar *name) { return glGetUniformLocation(program, name); }
@@ -69,12 +166,15 @@ inline void wrap_glClear(GLbitfield mask) { glClear(mask); }
 inline void wrap_glClearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha) { glClearColor(red, green, blue, alpha); }
 inline void wrap_glViewport(GLint x, GLint y, GLsizei width, GLsizei height) { glViewport(x, y, width, height); }
 inline void wrap_glBlendFunc(GLenum sfactor, GLenum dfactor) { glBlendFunc(sfactor, dfactor); }
+inline const char *wrap_glGetString(GLenum name) { const GLubyte *s = glGetString(name); return s ? (const char *)s : ""; }
 
 // Texture operations
 inline void wrap_glGenTextures(GLsizei n, GLuint *textures) { glGenTextures(n, textures); }
-inline void wrap_glBindTexture(GLenum target, GLuint texture) { glBindTexture(target, texture); }
+inline void wrap_glBindTexture(GLenum target, GLuint texture) { glcount::texture_bind(); glBindTexture(target, texture); }
 inline void wrap_glActiveTexture(GLenum texture) { glActiveTexture(texture); }
-inline void wrap_glTexImage2D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const void *pixels) { glTexImage2D(target, level, internalformat, width, height, border, format, type, pixels); }
+inline void wrap_glTexImage2D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const void *pixels) { if (pixels) glcount::texture_upload(glcount::image_bytes(width, height, format, type)); glTexImage2D(target, level, internalformat, width, height, border, format, type, pixels); }
+inline void wrap_glTexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, const void *pixels) { glcount::texture_upload(glcount::image_bytes(width, height, format, type)); glTexSubImage2D(target, level, xoffset, yoffset, width, height, format, type, pixels); }
+inline void wrap_glCompressedTexImage2D(GLenum target, GLint level, GLenum internalformat, GLsizei width, GLsizei height, GLint border, GLsizei size, const void *data) { glcount::texture_upload(size); glCompressedTexImage2D(target, level, internalformat, width, height, border, size, data); }
 inline void wrap_glTexParameteri(GLenum target, GLenum pname, GLint param) { glTexParameteri(target, pname, param); }
 inline void wrap_glGenerateMipmap(GLenum target) { glGenerateMipmap(target); }
 
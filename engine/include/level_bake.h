@@ -0,0 +1,148 @@
+#ifndef LEVEL_BAKE_H
+#define LEVEL_BAKE_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Baked level (.level): a glTF level's render primitives and its finished
+// collision mesh, written by engine/tools/levelbake and mapped by
+// elevel::open_level (engine/level_impl.h).
+//
+//   LevelHeader                        section table
+//   sections                           each on a kLevelAlign boundary
+//
+// Collision sections are ecol::Bvh's arrays verbatim (BvhNode, Tri4 and
+// the index tables), plus the welded positions/indices the queries read,
+// so nothing is rebuilt at load. Render sections are every primitive's
+// Vertex array and 32-bit indices end to end, with a LevelPrimitive per
+// primitive saying where its slice is, its node transform and material.
+//
+// A primitive may carry a chain of coarser LODs (levelbake --lods):
+// simplified index lists over the same vertices, in kLevelIndices right
+// after its own, each with the error its simplification introduced (a
+// distance in the primitive's local units) for the renderer to project.
+// See engine/mesh_simplify_impl.h.
+//
+// The potentially visible set (PVS) divides the collision bounds into a
+// grid of cubic clusters and keeps, per cluster, a bitset of the clusters
+// visible from it, found offline by casting rays between them against the
+// collision mesh. Both PVS sections are empty when a level has no
+// collision. See engine/pvs_impl.h for the queries.
+//
+// A sectorized level (levelbake --sector-size) cuts both meshes along a
+// grid of square sectors on x/z, each triangle going to the sector its
+// centroid is in, so a client can stream sectors in and out around the
+// player (engine/level_stream_impl.h). Primitives are then grouped by
+// sector, and the collision sections hold each sector's own mesh and
+// BVH sub-tree end to end, every index local to the sector, with a
+// LevelSector per sector saying where its slices are. Without sectors
+// kLevelSectors is empty and the collision sections are one mesh.
+//
+// source_hash is levelbake's FNV-1a over the .gltf and its buffer files;
+// a loader given the source can tell a stale bake from a current one.
+// Fields are little-endian, as on every platform the engine ships.
+
+constexpr char kLevelMagic[4] = {'L', 'E', 'V', 'L'};
+constexpr uint32_t kLevelVersion = 4;
+constexpr size_t kLevelAlign = 16;
+constexpr size_t kLevelUriSize = 128;  // Including the terminator
+
+enum LevelSection : uint32_t {
+  kLevelCollisionPositions,   // glm::vec3
+  kLevelCollisionIndices,     // uint32_t
+  kLevelBvhNodes,             // ecol::BvhNode
+  kLevelBvhTris,              // ecol::Tri4
+  kLevelBvhTriSlot,           // uint32_t
+  kLevelBvhAdjOffsets,        // uint32_t
+  kLevelBvhAdjList,           // uint32_t
+  kLevelVertices,             // Vertex
+  kLevelIndices,              // uint32_t
+  kLevelPrimitives,           // LevelPrimitive
+  kLevelPvsGrid,              // LevelPvsGrid (zero or one)
+  kLevelPvsBits,              // uint8_t, row_bytes per cluster
+  kLevelSectors,              // LevelSector
+  kLevelLods,                 // LevelLod
+  kLevelSectionCount
+};
+
+struct LevelSectionEntry {
+  uint64_t offset;
+  uint64_t size;              // Bytes
+};
+
+struct LevelHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t source_hash;
+  uint32_t section_count;     // kLevelSectionCount when written
+  uint32_t reserved;
+  LevelSectionEntry sections[kLevelSectionCount];
+};
+
+struct LevelPrimitive {
+  uint64_t vertex_first;      // In kLevelVertices
+  uint64_t vertex_count;
+  uint64_t index_first;       // In kLevelIndices, local to the primitive
+  uint64_t index_count;
+  float bounds_min[3];        // Local space
+  float bounds_max[3];
+  float translation[3];
+  float scale[3];
+  uint32_t has_translation;
+  uint32_t has_scale;
+  float base_color[4];
+  int32_t mag_filter;
+  int32_t min_filter;
+  int32_t wrap_s;
+  int32_t wrap_t;
+  uint32_t has_texture;
+  uint32_t lod_first;         // In kLevelLods, finest first; none when lod_count is 0
+  uint32_t lod_count;         // Beyond this record's own indices
+  uint32_t reserved;
+  char texture_uri[kLevelUriSize];
+};
+
+// One coarser level of a primitive's indices, over the primitive's vertices
+struct LevelLod {
+  uint64_t index_first;       // In kLevelIndices
+  uint32_t index_count;
+  float error;                // Local units; never less than the finer levels'
+};
+
+// Cluster (x, y, z) is x + dims[0] * (y + dims[1] * z); bit j of cluster
+// i's row (byte j / 8, bit j % 8) is set when j is visible from i
+struct LevelPvsGrid {
+  float origin[3];            // Min corner of cluster 0
+  float cell_size;            // Cluster edge
+  uint32_t dims[3];
+  uint32_t row_bytes;         // (clusters + 7) / 8
+};
+
+// One sector's slices of a sectorized level. Its collision triangles'
+// kLevelBvhTriSlot entries start at index_first / 3.
+struct LevelSector {
+  float bounds_min[3];        // World space, render and collision
+  float bounds_max[3];
+  uint32_t primitive_first;   // In kLevelPrimitives
+  uint32_t primitive_count;
+  uint32_t position_first;    // In kLevelCollisionPositions
+  uint32_t position_count;
+  uint32_t index_first;       // In kLevelCollisionIndices, a multiple of 3
+  uint32_t index_count;
+  uint32_t node_first;        // In kLevelBvhNodes
+  uint32_t node_count;
+  uint32_t block_first;       // In kLevelBvhTris
+  uint32_t block_count;
+  uint32_t adj_offset_first;  // In kLevelBvhAdjOffsets, index_count / 3 + 1 of them
+  uint32_t adj_first;         // In kLevelBvhAdjList
+  uint32_t adj_count;
+  uint32_t reserved;
+};
+
+static_assert(sizeof(LevelHeader) == 24 + 16 * kLevelSectionCount, "level header layout");
+static_assert(sizeof(LevelPrimitive) == 136 + kLevelUriSize, "level primitive layout");
+static_assert(sizeof(LevelLod) == 16, "level lod layout");
+static_assert(sizeof(LevelPvsGrid) == 32, "level pvs grid layout");
+static_assert(sizeof(LevelSector) == 80, "level sector layout");
+
+#endif // LEVEL_BAKE_H
@@ -0,0 +1,376 @@
+;; Incremental asset pipeline driver. Reads a pipeline file (EDN) of jobs,
+;; each a command with declared inputs and outputs, and reruns a job only
+;; when its stamp changed: a SHA-256 over the command line, the tool's
+;; contents and every input file's contents. Jobs with no ordering between
+;; them run in parallel.
+;;
+;; Usage:
+;;   clojure -M scripts/asset-pipeline.clj [--jobs N] [--force] [--dry-run] \
+;;       <pipeline.edn> [job-id ...]
+;;
+;; With job ids, only those jobs (and the jobs they run :after) are built.
+;; --dry-run reports which jobs are stale from their own inputs; jobs after
+;; a stale one may be stale too once it reruns.
+;;
+;; Pipeline file:
+;;   {:root  ".."            ; paths are relative to this (itself relative to the file)
+;;    :cache "build/asset-cache"
+;;    :jobs  [{:id      :player-bundle
+;;             :tool    "tools/ozzbundle/build/ozzbundle"  ; hashed as the tool version
+;;             :cmd     ["${ROOT}/tools/ozzbundle/build/ozzbundle" "out.ozzb" ...]
+;;             :dir     "."                                ; working directory, default :root
+;;             :inputs  ["models/anims/*.ozz" "some/dir" "a/file"]
+;;             :outputs ["out.ozzb"]
+;;             :after   [:animations]                      ; jobs that must finish first
+;;             :optional true}]}                           ; skip, not fail, if tool/inputs are missing
+;;
+;; Strings may use ${VAR} or ${VAR:-default} for environment variables;
+;; ${ROOT} is the absolute root. A :cmd argument that expands to "" is
+;; dropped, so "${FLAGS:-}" adds optional flags. A path ending in a glob ("dir/*.ozz") matches
+;; files in that directory; a directory path means every file under it.
+;;
+;; Stamps live in <cache>/<id>.edn along with the hashes of the job's outputs,
+;; so an edited or deleted output is rebuilt too. File hashes are cached by
+;; size and modification time in <cache>/file-hashes.edn.
+
+(ns asset-pipeline
+  (:require [clojure.edn :as edn]
+            [clojure.java.io :as io]
+            [clojure.java.shell :as sh]
+            [clojure.string :as str])
+  (:import [java.io File FileInputStream]
+           [java.nio.file FileSystems]
+           [java.security MessageDigest]
+           [java.util.concurrent ExecutorCompletionService Executors]))
+
+(def log-lock (Object.))
+
+(defn log
+  [& parts]
+  (locking log-lock
+    (println (apply str parts))
+    (flush)))
+
+;; ============ HASHING ============
+
+(defn hex
+  [^bytes data]
+  (let [sb (StringBuilder.)]
+    (doseq [b data]
+      (.append sb (format "%02x" (bit-and b 0xFF))))
+    (str sb)))
+
+(defn sha256-string
+  [^String s]
+  (let [md (MessageDigest/getInstance "SHA-256")]
+    (hex (.digest md (.getBytes s "UTF-8")))))
+
+(defn sha256-file
+  [^File f]
+  (let [md  (MessageDigest/getInstance "SHA-256")
+        buf (byte-array 65536)]
+    (with-open [in (FileInputStream. f)]
+      (loop []
+        (let [n (.read in buf)]
+          (when (pos? n)
+            (.update md buf 0 n)
+            (recur)))))
+    (hex (.digest md))))
+
+(defn file-hash
+  "Content hash of f, reusing the cached one while size and mtime match."
+  [hash-cache ^File f]
+  (let [path  (.getPath f)
+        size  (.length f)
+        mtime (.lastModified f)
+        [csize cmtime chash] (get @hash-cache path)]
+    (if (and (= csize size) (= cmtime mtime))
+      chash
+      (let [h (sha256-file f)]
+        (swap! hash-cache assoc path [size mtime h])
+        h))))
+
+;; ============ PATHS ============
+
+(defn expand-env
+  "Substitutes ${VAR} and ${VAR:-default}; ROOT is the pipeline root."
+  [^File root s]
+  (str/replace s #"\$\{([A-Za-z_][A-Za-z0-9_]*)(?::-([^}]*))?\}"
+               (fn [[whole var default]]
+                 (let [v (if (= var "ROOT")
+                           (.getPath root)
+                           (System/getenv var))]
+                   (cond
+                     (not (str/blank? v)) v
+                     default default
+                     :else (throw (ex-info (str "environment variable " var " is not set")
+                                           {:in whole})))))))
+
+(defn ^File resolve-path
+  [^File root spec]
+  (let [f (io/file (expand-env root spec))]
+    (-> (if (.isAbsolute f) f (io/file root (.getPath f)))
+        (.toPath)
+        (.normalize)
+        (.toFile))))
+
+(defn ^String relative-path
+  [^File root ^File f]
+  (str (.relativize (.toPath root) (.toPath f))))
+
+(defn expand-spec
+  "Files a path spec names, sorted: a glob's matches in its directory, every
+   file under a directory, or the file itself. Empty if nothing exists."
+  [^File root spec]
+  (let [f (resolve-path root spec)]
+    (cond
+      (str/includes? (.getName f) "*")
+      (let [matcher (.getPathMatcher (FileSystems/getDefault) (str "glob:" (.getName f)))]
+        (->> (.listFiles (.getParentFile f))
+             (filter (fn [^File c]
+                       (and (.isFile c)
+                            (.matches matcher (.toPath (io/file (.getName c)))))))
+             (sort-by #(.getPath ^File %))))
+
+      (.isDirectory f)
+      (->> (file-seq f)
+           (filter #(.isFile ^File %))
+           (sort-by #(.getPath ^File %)))
+
+      (.isFile f)
+      [f]
+
+      :else
+      [])))
+
+;; ============ STAMPS ============
+
+(defn stamp-file
+  ^File [ctx id]
+  (io/file (:cache ctx) (str (name id) ".edn")))
+
+(defn read-stamp
+  [ctx id]
+  (let [f (stamp-file ctx id)]
+    (when (.isFile f)
+      (try
+        (edn/read-string (slurp f))
+        (catch Exception _ nil)))))
+
+(defn write-stamp
+  [ctx id stamp]
+  (let [f (stamp-file ctx id)]
+    (io/make-parents f)
+    (spit f (pr-str stamp))))
+
+(defn job-stamp
+  "Hash of everything that decides a job's outputs."
+  [ctx job cmd ^File tool input-files]
+  (let [{:keys [root hashes]} ctx
+        lines (concat
+               [(str "cmd " (pr-str cmd))
+                (str "dir " (:dir job "."))
+                (str "version " (:version job ""))]
+               (when tool
+                 (for [f (expand-spec root (.getPath tool))]
+                   (str "tool " (relative-path root f) " " (file-hash hashes f))))
+               (for [f input-files]
+                 (str "in " (relative-path root f) " " (file-hash hashes f))))]
+    (sha256-string (str/join "\n" lines))))
+
+(defn output-hashes
+  [ctx job]
+  (let [{:keys [root hashes]} ctx]
+    (into (sorted-map)
+          (for [spec (:outputs job)
+                f    (expand-spec root spec)]
+            [(relative-path root f) (file-hash hashes f)]))))
+
+;; ============ JOBS ============
+
+(defn skip-or-fail
+  [job reason]
+  (if (:optional job)
+    (do (log (name (:id job)) ": skipped, " reason)
+        :skipped)
+    (do (log (name (:id job)) ": FAILED, " reason)
+        :failed)))
+
+(defn print-output
+  [id {:keys [out err]}]
+  (let [text (str/trim (str out err))]
+    (when-not (str/blank? text)
+      (locking log-lock
+        (doseq [line (str/split-lines text)]
+          (println (str "  [" id "] " line)))
+        (flush)))))
+
+(defn run-job
+  "Rebuilds job if its stamp or outputs changed. Returns :built,
+   :up-to-date, :stale (dry run), :skipped or :failed."
+  [ctx job]
+  (let [{:keys [root force dry-run]} ctx
+        id      (name (:id job))
+        tool    (some->> (:tool job) (resolve-path root))
+        cmd     (into [] (comp (map #(expand-env root %)) (remove empty?)) (:cmd job))
+        dir     (resolve-path root (:dir job "."))
+        inputs  (map (fn [spec] [spec (expand-spec root spec)]) (:inputs job))
+        missing (first (keep (fn [[spec files]] (when (empty? files) spec)) inputs))]
+    (cond
+      (and tool (not (.exists tool)))
+      (skip-or-fail job (str "tool not found: " (relative-path root tool)))
+
+      missing
+      (skip-or-fail job (str "no input matches " missing))
+
+      :else
+      (let [input-files (distinct (mapcat second inputs))
+            stamp       (job-stamp ctx job cmd tool input-files)
+            previous    (read-stamp ctx (:id job))
+            outputs     (output-hashes ctx job)]
+        (cond
+          (and (not force)
+               (seq outputs)
+               (= stamp (:stamp previous))
+               (= outputs (:outputs previous)))
+          (do (log id ": up to date")
+              :up-to-date)
+
+          dry-run
+          (do (log id ": stale")
+              :stale)
+
+          :else
+          (let [started (System/currentTimeMillis)
+                _       (log id ": building")
+                _       (doseq [spec (:outputs job)
+                                :when (not (str/includes? spec "*"))]
+                          (io/make-parents (resolve-path root spec)))
+                result  (apply sh/sh (concat cmd [:dir dir]))
+                seconds (/ (- (System/currentTimeMillis) started) 1000.0)]
+            (print-output id result)
+            (if-not (zero? (:exit result))
+              (do (log id ": FAILED, exit " (:exit result))
+                  :failed)
+              (let [outputs (output-hashes ctx job)]
+                (if (empty? outputs)
+                  (do (log id ": FAILED, produced none of its outputs")
+                      :failed)
+                  (do (write-stamp ctx (:id job) {:stamp stamp :outputs outputs})
+                      (log id ": built in " (format "%.1f" seconds) "s")
+                      :built))))))))))
+
+(defn dep-state
+  [status job]
+  (let [states (map status (:after job))]
+    (cond
+      (some #{:failed :blocked} states) :blocked
+      (every? some? states) :ready
+      :else :waiting)))
+
+(defn run-pipeline
+  "Runs jobs on n threads, each once everything it's :after has finished.
+   Returns {job-id status}."
+  [ctx jobs n]
+  (let [pool (Executors/newFixedThreadPool n)
+        done (ExecutorCompletionService. pool)]
+    (try
+      (loop [pending jobs
+             running 0
+             status  {}]
+        (let [{:keys [ready waiting blocked]} (group-by #(dep-state status %) pending)
+              status (reduce (fn [s job]
+                               (log (name (:id job)) ": skipped, a job it runs after failed")
+                               (assoc s (:id job) :blocked))
+                             status
+                             blocked)]
+          (doseq [job ready]
+            (.submit done ^Callable (fn []
+                                      [(:id job)
+                                       (try
+                                         (run-job ctx job)
+                                         (catch Throwable t
+                                           (log (name (:id job)) ": FAILED, " (.getMessage t))
+                                           :failed))])))
+          (let [running (+ running (count ready))]
+            (cond
+              (pos? running)
+              (let [[id result] (.get (.take done))]
+                (recur waiting (dec running) (assoc status id result)))
+
+              (seq waiting)
+              (throw (ex-info (str "dependency cycle among "
+                                   (str/join ", " (map (comp name :id) waiting)))
+                              {}))
+
+              :else
+              status))))
+      (finally
+        (.shutdown pool)))))
+
+;; ============ CLI ============
+
+(defn parse-cli
+  [argv]
+  (loop [opts {:jobs (.availableProcessors (Runtime/getRuntime)) :only []}
+         remaining argv]
+    (let [[arg value] remaining]
+      (cond
+        (empty? remaining) opts
+        (= arg "--jobs") (recur (assoc opts :jobs (max 1 (Integer/parseInt value))) (drop 2 remaining))
+        (= arg "--force") (recur (assoc opts :force true) (rest remaining))
+        (= arg "--dry-run") (recur (assoc opts :dry-run true) (rest remaining))
+        (nil? (:pipeline opts)) (recur (assoc opts :pipeline arg) (rest remaining))
+        :else (recur (update opts :only conj (keyword arg)) (rest remaining))))))
+
+(defn select-jobs
+  "The requested jobs plus everything they run after, in pipeline order."
+  [jobs only]
+  (if (empty? only)
+    jobs
+    (let [by-id  (into {} (map (juxt :id identity) jobs))
+          wanted (loop [wanted #{} todo only]
+                   (if-let [id (first todo)]
+                     (if (wanted id)
+                       (recur wanted (rest todo))
+                       (recur (conj wanted id) (concat (rest todo) (:after (by-id id)))))
+                     wanted))]
+      (filter (comp wanted :id) jobs))))
+
+(defn check-jobs
+  [jobs only]
+  (let [ids (set (map :id jobs))]
+    (doseq [id (concat only (mapcat :after jobs))]
+      (when-not (ids id)
+        (throw (ex-info (str "unknown job: " (name id)) {}))))))
+
+(defn -main
+  [& argv]
+  (let [{:keys [pipeline jobs only force dry-run]} (parse-cli argv)]
+    (when (nil? pipeline)
+      (binding [*out* *err*]
+        (println "usage: asset-pipeline.clj [--jobs N] [--force] [--dry-run] <pipeline.edn> [job-id ...]"))
+      (System/exit 2))
+    (let [file     (.getAbsoluteFile (io/file pipeline))
+          config   (edn/read-string (slurp file))
+          root     (-> (io/file (.getParentFile file) (:root config "."))
+                       (.toPath) (.normalize) (.toFile))
+          cache    (resolve-path root (:cache config "build/asset-cache"))
+          hash-file (io/file cache "file-hashes.edn")
+          hashes   (atom (if (.isFile hash-file)
+                           (try (edn/read-string (slurp hash-file)) (catch Exception _ {}))
+                           {}))
+          ctx      {:root root :cache cache :hashes hashes :force force :dry-run dry-run}
+          _        (check-jobs (:jobs config) only)
+          selected (select-jobs (:jobs config) only)
+          status   (run-pipeline ctx selected jobs)
+          counts   (frequencies (vals status))]
+      (io/make-parents hash-file)
+      (spit hash-file (pr-str @hashes))
+      (log (str/join ", " (for [k [:built :up-to-date :stale :skipped :failed :blocked]
+                                :when (counts k)]
+                            (str (counts k) " " (name k)))))
+      (shutdown-agents)
+      (System/exit (if (or (counts :failed) (counts :blocked)) 1 0)))))
+
+(apply -main *command-line-args*)
@@ -1,6 +1,13 @@
 ;; Walks one or more asset directories and emits a single .cpp file containing
-;; every file as a static byte array, plus an extern "C" engine_register_resources
-;; function that calls jank_resource_register for each.
+;; every file as embedded bytes, a sorted name table, and extern "C" functions
+;; to reach them:
+;;   engine_register_resources()            registers uncompressed assets with
+;;                                          jank_resource_register
+;;   engine_find_resource(name, &data, &size)
+;;                                          any asset, by a hash table built
+;;                                          here; compressed ones are
+;;                                          decompressed (and registered) on
+;;                                          first lookup
 ;;
 ;; Also emits two functions describing engine-built-in include paths (so the
 ;; runtime binary knows which paths to add to the JIT's clang search path
@@ -10,9 +17,16 @@
 ;;
 ;; Usage:
 ;;   clojure -M scripts/embed-assets.clj <output.cpp> \
+;;       [--blob] [--zstd] \
 ;;       [--system-include PATH ...] \
 ;;       <asset-root> [<asset-root> ...]
 ;;
+;; --blob  writes the bytes to <output>.bin, pulled in with .incbin, instead of
+;;         as C++ array initializers; generation and compilation no longer
+;;         scale with asset size. Needs an ELF or Mach-O toolchain.
+;; --zstd  compresses each asset with the zstd CLI where that saves at least
+;;         10%; the library must then be linked with -lzstd.
+;;
 ;; Each <asset-root> is paired as: PREFIX:DIR
 ;; Example:  shaders:./shaders fonts:./fonts
 ;; produces registry keys like "shaders/basic_vertex.glsl", "fonts/JetBrainsMono-Regular.ttf".
@@ -35,17 +49,235 @@
   [logical]
   (-> logical (str/replace #"[^A-Za-z0-9]" "_")))
 
+(def ^"[Ljava.lang.String;" hex-literals
+  (into-array String (for [b (range 256)] (format "0x%02X" b))))
+
 (defn write-byte-array
   [^OutputStreamWriter out ident ^bytes data]
-  (.write out (str "static unsigned char const " ident "[] = {"))
-  (let [n (alength data)]
+  (let [n  (alength data)
+        sb (StringBuilder. (+ 64 (* 6 n)))]
+    (.append sb (str "static unsigned char const " ident "[] = {"))
     (dotimes [i n]
+      (when (zero? (mod i 16))
+        (.append sb "\n  "))
+      (.append sb (aget hex-literals (bit-and (aget data i) 0xFF)))
+      (when (< i (dec n)) (.append sb ",")))
+    (.append sb "\n};\n\n")
+    (.write out (str sb))))
+
+(def blob-align 16)
+
+(defn zstd-compress
+  "Compresses data with the zstd CLI (level 19)."
+  ^bytes [^bytes data]
+  (let [p (try
+            (.start (ProcessBuilder. ^java.util.List ["zstd" "-19" "-q" "-c"]))
+            (catch java.io.IOException _
+              (binding [*out* *err*]
+                (println "--zstd needs the zstd command line tool on PATH"))
+              (System/exit 1)))
+        writer (doto (Thread. (fn []
+                                (with-open [in (.getOutputStream p)]
+                                  (.write in data))))
+                 (.start))
+        packed (.readAllBytes (.getInputStream p))]
+    (.join writer)
+    (when-not (zero? (.waitFor p))
+      (binding [*out* *err*]
+        (println "zstd failed"))
+      (System/exit 1))
+    packed))
+
+(def fnv-offset (unchecked-long 0xcbf29ce484222325))
+(def fnv-prime 0x100000001b3)
+
+(defn fnv1a
+  "64-bit FNV-1a of s's UTF-8 bytes, as engine_asset_hash_name computes it."
+  ^long [^String s]
+  (long (reduce (fn [^long h b]
+                  (unchecked-multiply (bit-xor h (bit-and (long b) 0xFF)) fnv-prime))
+                fnv-offset
+                (.getBytes s "UTF-8"))))
+
+(defn pack-asset
+  "{:logical :hash :ident :data :raw-size :compressed?}; data is what gets embedded."
+  [logical ^bytes data zstd?]
+  (let [packed (when zstd? (zstd-compress data))
+        smaller? (and packed (< (alength ^bytes packed) (* 0.9 (alength data))))]
+    {:logical     logical
+     :hash        (fnv1a logical)
+     :ident       (str "asset_" (c-identifier logical))
+     :data        (if smaller? packed data)
+     :raw-size    (alength data)
+     :compressed? (boolean smaller?)}))
+
+(defn blob-path
+  [output]
+  (str (str/replace output #"\.cpp$" "") ".bin"))
+
+(defn write-blob
+  "Writes every asset's bytes to path, each at a blob-align boundary.
+   Returns the assets with their :offset."
+  [path assets]
+  (with-open [out (io/output-stream path)]
+    (loop [assets assets
+           offset 0
+           placed []]
+      (if-let [a (first assets)]
+        (let [^bytes data (:data a)
+              pad (mod (- blob-align (mod offset blob-align)) blob-align)]
+          (.write out (byte-array pad))
+          (.write out data)
+          (recur (rest assets)
+                 (+ offset pad (alength data))
+                 (conj placed (assoc a :offset (+ offset pad)))))
+        placed))))
+
+(defn write-incbin
+  "Assembles the blob into the library as engine_assets_blob."
+  [^OutputStreamWriter out path]
+  (let [path (str/replace (.getAbsolutePath (io/file path)) "\\" "/")]
+    (.write out (str "#if defined(__APPLE__)\n"
+                     "#define ENGINE_ASSETS_SYM \"_engine_assets_blob\"\n"
+                     "#define ENGINE_ASSETS_SECTION \".section __TEXT,__const\"\n"
+                     "#define ENGINE_ASSETS_HIDE \".private_extern \"\n"
+                     "#elif defined(__ELF__)\n"
+                     "#define ENGINE_ASSETS_SYM \"engine_assets_blob\"\n"
+                     "#define ENGINE_ASSETS_SECTION \".section .rodata\"\n"
+                     "#define ENGINE_ASSETS_HIDE \".hidden \"\n"
+                     "#else\n"
+                     "#error \"--blob needs an ELF or Mach-O target; regenerate without --blob\"\n"
+                     "#endif\n"
+                     "__asm__(ENGINE_ASSETS_SECTION \"\\n\"\n"
+                     "        \".globl \" ENGINE_ASSETS_SYM \"\\n\"\n"
+                     "        ENGINE_ASSETS_HIDE ENGINE_ASSETS_SYM \"\\n\"\n"
+                     "        \".balign " blob-align "\\n\"\n"
+                     "        ENGINE_ASSETS_SYM \":\\n\"\n"
+                     "        \".incbin \\\"" path "\\\"\\n\"\n"
+                     "        \".text\\n\");\n"
+                     "extern \"C\" __attribute__((visibility(\"hidden\"))) unsigned char const engine_assets_blob[];\n\n"))))
+
+(defn slot-count
+  "Power of two at least twice n, so probe chains stay short."
+  [n]
+  (loop [size 1]
+    (if (>= size (* 2 n)) size (recur (* 2 size)))))
+
+(defn build-slots
+  "Open-addressed table of asset index + 1 (0 empty), linear probing from
+   each name's hash."
+  [assets]
+  (let [size (slot-count (count assets))
+        mask (dec size)]
+    (reduce (fn [slots [i {:keys [hash]}]]
+              (loop [s (bit-and hash mask)]
+                (if (zero? (nth slots s))
+                  (assoc slots s (inc i))
+                  (recur (bit-and (inc s) mask)))))
+            (vec (repeat size 0))
+            (map-indexed vector assets))))
+
+(defn write-table
+  [^OutputStreamWriter out assets blob?]
+  (.write out "struct engine_asset\n{\n")
+  (.write out "  char const *name;\n")
+  (.write out "  std::uint64_t hash;    // engine_asset_hash_name(name)\n")
+  (.write out "  unsigned char const *data;\n")
+  (.write out "  std::size_t size;      // Embedded bytes\n")
+  (.write out "  std::size_t raw_size;  // Bytes once decompressed\n")
+  (.write out "  bool compressed;\n")
+  (.write out "};\n\n")
+  (.write out "// Sorted by name\n")
+  (.write out "static engine_asset const engine_assets[] = {\n")
+  (doseq [{:keys [logical hash ident data raw-size compressed? offset]} assets]
+    (.write out (format "  { \"%s\", 0x%016xULL, %s, %d, %d, %s },\n"
+                        logical
+                        hash
+                        (if blob? (str "engine_assets_blob + " offset) ident)
+                        (alength ^bytes data)
+                        raw-size
+                        (if compressed? "true" "false"))))
+  (.write out "};\n")
+  (.write out (format "static constexpr std::size_t engine_asset_count = %d;\n\n" (count assets)))
+  (let [slots (build-slots assets)]
+    (.write out "// engine_find_resource's hash table: asset index + 1, 0 for an empty slot\n")
+    (.write out (format "static constexpr std::size_t engine_asset_slot_mask = %d;\n" (dec (count slots))))
+    (.write out "static std::uint32_t const engine_asset_slots[] = {")
+    (doseq [[i slot] (map-indexed vector slots)]
       (when (zero? (mod i 16))
         (.write out "\n  "))
-      (.write out (format "0x%02X" (bit-and (aget data i) 0xFF)))
-      (when (< i (dec n)) (.write out ","))))
-  (.write out "\n};\n")
-  (.write out (str "static unsigned long const " ident "_size = " (alength data) ";\n\n")))
+      (.write out (str slot ",")))
+    (.write out "\n};\n\n")))
+
+(defn write-lookup
+  [^OutputStreamWriter out assets]
+  (let [zstd? (some :compressed? assets)]
+    (when zstd?
+      (.write out "static std::once_flag engine_asset_once[engine_asset_count];\n")
+      (.write out "static char const *engine_asset_raw[engine_asset_count];\n\n"))
+    (.write out "static bool engine_asset_view(std::size_t i, char const **data, std::size_t *size)\n{\n")
+    (.write out "  engine_asset const &a = engine_assets[i];\n")
+    (.write out "  if(!a.compressed)\n  {\n")
+    (.write out "    *data = (char const *)a.data;\n")
+    (.write out "    *size = a.size;\n")
+    (.write out "    return true;\n")
+    (.write out "  }\n")
+    (if zstd?
+      (do
+        (.write out "  // Decompressed once, kept for the process's lifetime, then registered\n")
+        (.write out "  // so jank's find_resource sees it from here on\n")
+        (.write out "  std::call_once(engine_asset_once[i], [&a, i] {\n")
+        (.write out "    char *raw = (char *)std::malloc(a.raw_size ? a.raw_size : 1);\n")
+        (.write out "    if(raw && ZSTD_decompress(raw, a.raw_size, a.data, a.size) == a.raw_size)\n    {\n")
+        (.write out "      engine_asset_raw[i] = raw;\n")
+        (.write out "      jank_resource_register(a.name, raw, (jank_usize)a.raw_size);\n")
+        (.write out "    }\n")
+        (.write out "    else\n    {\n")
+        (.write out "      std::free(raw);\n")
+        (.write out "    }\n")
+        (.write out "  });\n")
+        (.write out "  if(!engine_asset_raw[i]) { return false; }\n")
+        (.write out "  *data = engine_asset_raw[i];\n")
+        (.write out "  *size = a.raw_size;\n")
+        (.write out "  return true;\n"))
+      (.write out "  return false;\n"))
+    (.write out "}\n\n")
+    (.write out "// 64-bit FNV-1a, matching embed-assets.clj's fnv1a\n")
+    (.write out "static std::uint64_t engine_asset_hash_name(char const *name)\n{\n")
+    (.write out "  std::uint64_t h = 0xcbf29ce484222325ULL;\n")
+    (.write out "  for(; *name; ++name)\n  {\n")
+    (.write out "    h = (h ^ (unsigned char)*name) * 0x100000001b3ULL;\n")
+    (.write out "  }\n")
+    (.write out "  return h;\n")
+    (.write out "}\n\n")
+    (.write out "extern \"C\" bool engine_find_resource(char const *name, char const **data, std::size_t *size)\n{\n")
+    (.write out "  std::uint64_t h = engine_asset_hash_name(name);\n")
+    (.write out "  for(std::size_t s = h & engine_asset_slot_mask; engine_asset_slots[s]; s = (s + 1) & engine_asset_slot_mask)\n  {\n")
+    (.write out "    std::size_t i = engine_asset_slots[s] - 1;\n")
+    (.write out "    if(engine_assets[i].hash == h && std::strcmp(engine_assets[i].name, name) == 0)\n    {\n")
+    (.write out "      return engine_asset_view(i, data, size);\n")
+    (.write out "    }\n")
+    (.write out "  }\n")
+    (.write out "  return false;\n")
+    (.write out "}\n\n")
+    (.write out "extern \"C\" void engine_register_resources()\n{\n")
+    (.write out "  static bool initialized = false;\n")
+    (.write out "  if(initialized) { return; }\n")
+    (.write out "  initialized = true;\n")
+    (.write out "  for(std::size_t i = 0; i < engine_asset_count; ++i)\n  {\n")
+    (.write out "    engine_asset const &a = engine_assets[i];\n")
+    (.write out "    if(a.compressed) { continue; }\n")
+    (.write out "    jank_resource_register(a.name, (char const *)a.data, (jank_usize)a.size);\n")
+    (.write out "  }\n")
+    (.write out "}\n\n")))
+
+(defn write-empty-lookup
+  [^OutputStreamWriter out]
+  (.write out "extern \"C\" bool engine_find_resource(char const *, char const **, std::size_t *)\n{\n")
+  (.write out "  return false;\n")
+  (.write out "}\n\n")
+  (.write out "extern \"C\" void engine_register_resources()\n{\n")
+  (.write out "}\n\n"))
 
 (defn collect-files
   [^File root]
@@ -62,18 +294,25 @@
       [(subs spec 0 idx) (subs spec (inc idx))])))
 
 (defn parse-cli
-  "Returns {:output s :system-includes [s ...] :asset-specs [s ...]}."
+  "Returns {:output s :blob? b :zstd? b :system-includes [s ...] :asset-specs [s ...]}."
   [argv]
   (when (empty? argv)
     (binding [*out* *err*]
-      (println "usage: embed-assets.clj <output.cpp> [--system-include PATH ...] <prefix:dir> [<prefix:dir> ...]"))
+      (println "usage: embed-assets.clj <output.cpp> [--blob] [--zstd] [--system-include PATH ...] <prefix:dir> [<prefix:dir> ...]"))
     (System/exit 2))
-  (loop [includes []
+  (loop [opts     {:output (first argv) :blob? false :zstd? false}
+         includes []
          specs    []
          remaining (rest argv)]
     (cond
       (empty? remaining)
-      {:output (first argv) :system-includes includes :asset-specs specs}
+      (assoc opts :system-includes includes :asset-specs specs)
+
+      (= "--blob" (first remaining))
+      (recur (assoc opts :blob? true) includes specs (rest remaining))
+
+      (= "--zstd" (first remaining))
+      (recur (assoc opts :zstd? true) includes specs (rest remaining))
 
       (= "--system-include" (first remaining))
       (let [p (second remaining)]
@@ -81,46 +320,59 @@
           (binding [*out* *err*]
             (println "--system-include requires a path"))
           (System/exit 2))
-        (recur (conj includes p) specs (drop 2 remaining)))
+        (recur opts (conj includes p) specs (drop 2 remaining)))
 
       :else
-      (recur includes (conj specs (first remaining)) (rest remaining)))))
+      (recur opts includes (conj specs (first remaining)) (rest remaining)))))
+
+(defn read-assets
+  [asset-specs zstd?]
+  (->> (for [spec asset-specs
+             :let [[prefix dir] (parse-root-spec spec)
+                   root         (io/file dir)]
+             ^File f (do (when-not (.isDirectory root)
+                           (binding [*out* *err*]
+                             (println (str "asset root not a directory: " dir)))
+                           (System/exit 1))
+                         (collect-files root))]
+         (let [rel     (relative-path root f)
+               logical (if (empty? prefix) rel (str prefix "/" rel))]
+           (pack-asset logical (file-bytes f) zstd?)))
+       (sort-by :logical)
+       (vec)))
 
 (defn -main
   [& argv]
-  (let [{:keys [output system-includes asset-specs]} (parse-cli argv)]
+  (let [{:keys [output blob? zstd? system-includes asset-specs]} (parse-cli argv)]
     (when (and (empty? asset-specs) (empty? system-includes))
       (binding [*out* *err*]
         (println "nothing to embed (no asset specs, no --system-include)"))
       (System/exit 2))
     (io/make-parents output)
-    (let [entries (atom [])]
+    (let [assets (read-assets asset-specs zstd?)
+          assets (if (and blob? (seq assets))
+                   (write-blob (blob-path output) assets)
+                   assets)]
       (with-open [out (io/writer output)]
         (.write out "// Generated by scripts/embed-assets.clj. Do not edit.\n")
         (.write out "#include <jank/c_api.h>\n")
-        (.write out "#include <cstddef>\n\n")
-        (doseq [spec asset-specs]
-          (let [[prefix dir] (parse-root-spec spec)
-                root         (io/file dir)]
-            (when-not (.isDirectory root)
-              (binding [*out* *err*]
-                (println (str "asset root not a directory: " dir)))
-              (System/exit 1))
-            (doseq [^File f (collect-files root)]
-              (let [rel    (relative-path root f)
-                    logical (if (empty? prefix) rel (str prefix "/" rel))
-                    ident   (str "asset_" (c-identifier logical))
-                    data    (file-bytes f)]
-                (write-byte-array out ident data)
-                (swap! entries conj [logical ident])))))
-        (.write out "extern \"C\" void engine_register_resources()\n{\n")
-        (.write out "  static bool initialized = false;\n")
-        (.write out "  if(initialized) { return; }\n")
-        (.write out "  initialized = true;\n")
-        (doseq [[logical ident] @entries]
-          (.write out (format "  jank_resource_register(\"%s\", (char const *)%s, (jank_usize)%s_size);\n"
-                              logical ident ident)))
-        (.write out "}\n\n")
+        (.write out "#include <cstddef>\n")
+        (.write out "#include <cstdint>\n")
+        (.write out "#include <cstring>\n")
+        (when (some :compressed? assets)
+          (.write out "#include <cstdlib>\n")
+          (.write out "#include <mutex>\n")
+          (.write out "#include <zstd.h>\n"))
+        (.write out "\n")
+        (if (empty? assets)
+          (write-empty-lookup out)
+          (do
+            (if blob?
+              (write-incbin out (blob-path output))
+              (doseq [{:keys [ident data]} assets]
+                (write-byte-array out ident data)))
+            (write-table out assets blob?)
+            (write-lookup out assets)))
         ;; Emit the built-in include path table.
         (.write out (format "extern \"C\" std::size_t engine_built_includes_count() { return %d; }\n"
                             (count system-includes)))
@@ -135,7 +387,11 @@
               (.write out "  return paths[i];\n")))
         (.write out "}\n"))
       (binding [*out* *err*]
-        (println (str "embedded " (count @entries) " assets and "
+        (println (str "embedded " (count assets) " assets ("
+                      (reduce + (map :raw-size assets)) " bytes, "
+                      (reduce + (map #(alength ^bytes (:data %)) assets)) " stored"
+                      (when blob? (str " in " (blob-path output)))
+                      ") and "
                       (count system-includes) " include paths into " output))))))
 
 (apply -main *command-line-args*)
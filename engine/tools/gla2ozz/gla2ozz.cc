@@ -1,30 +1,235 @@
 // gla2ozz - Convert GLA animations to ozz-animation format
-// Uses ozz's OzzImporter framework for integration with CLI and config system
+// Uses ozz's OzzImporter framework for integration with CLI and config system.
+// With --jobs other than 1, the config's animations are instead converted by
+// gla2ozz itself: the GLA is parsed once and clips are built in parallel.
 
+#include <atomic>
+#include <cstdlib>
 #include <cstring>
+#include <fstream>
 #include <map>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <vector>
 
+#include "ozz/animation/offline/animation_builder.h"
+#include "ozz/animation/offline/animation_optimizer.h"
 #include "ozz/animation/offline/raw_animation.h"
 #include "ozz/animation/offline/raw_skeleton.h"
+#include "ozz/animation/offline/skeleton_builder.h"
 #include "ozz/animation/offline/raw_track.h"
 #include "ozz/animation/offline/tools/import2ozz.h"
+#include "ozz/animation/runtime/animation.h"
 #include "ozz/animation/runtime/skeleton.h"
 #include "ozz/base/containers/string.h"
 #include "ozz/base/containers/vector.h"
+#include "ozz/base/io/archive.h"
+#include "ozz/base/io/stream.h"
 #include "ozz/base/log.h"
+#include "ozz/options/options.h"
 
 #include "animation_cfg_parser.h"
 #include "coordinate_convert.h"
 #include "gla_format.h"
 #include "gla_parser.h"
+#include "json.hpp"
+
+using json = nlohmann::json;
+
+// Keyframe reduction. GLA clips store every frame of every bone, so most
+// keys are interpolable. Errors are measured hierarchically: a joint's
+// error includes what it causes down its chain, at --distance from each
+// joint (emulating skinned vertices). --joint_settings tightens or loosens
+// individual joints, which also applies to the chain leading to them.
+OZZ_OPTIONS_DECLARE_BOOL(optimize, "Reduce keyframes with AnimationOptimizer", true, false);
+OZZ_OPTIONS_DECLARE_FLOAT(tolerance, "Max optimization error on a joint hierarchy (meters)", 1e-3f, false);
+OZZ_OPTIONS_DECLARE_FLOAT(distance, "Distance from a joint at which error is measured (meters)", 1e-1f, false);
+OZZ_OPTIONS_DECLARE_STRING(joint_settings,
+                           "Per joint overrides: \"name:tolerance[:distance],...\"", "", false);
+
+// Batch conversion: one GLA parse, clips converted on this many threads
+// (0 = one per core). 1 keeps the stock single-threaded importer.
+OZZ_OPTIONS_DECLARE_INT(jobs, "Threads for batch conversion (0 = all cores, 1 = off)", 1, false);
 
 namespace {
 
+// Count keyframes across all tracks of a raw animation
+size_t CountKeys(const ozz::animation::offline::RawAnimation& _animation) {
+    size_t keys = 0;
+    for (const auto& track : _animation.tracks) {
+        keys += track.translations.size() + track.rotations.size() + track.scales.size();
+    }
+    return keys;
+}
+
+// Runtime (SamplingJob) size of a raw animation once built, in bytes
+size_t RuntimeSize(const ozz::animation::offline::RawAnimation& _animation) {
+    ozz::animation::offline::AnimationBuilder builder;
+    auto animation = builder(_animation);
+    return animation ? animation->size() : 0;
+}
+
+// Parse --joint_settings into optimizer overrides. Unknown joints or
+// malformed entries are reported and fail the import.
+bool ParseJointSettings(const ozz::animation::Skeleton& _skeleton,
+                        ozz::animation::offline::AnimationOptimizer* _optimizer) {
+    std::stringstream entries{std::string(OPTIONS_joint_settings.value())};
+    std::string entry;
+    while (std::getline(entries, entry, ',')) {
+        if (entry.empty()) continue;
+        std::stringstream fields(entry);
+        std::string name, tolerance, distance;
+        std::getline(fields, name, ':');
+        std::getline(fields, tolerance, ':');
+        std::getline(fields, distance, ':');
+        if (name.empty() || tolerance.empty()) {
+            ozz::log::Err() << "Bad --joint_settings entry '" << entry
+                           << "', expected name:tolerance[:distance]." << std::endl;
+            return false;
+        }
+
+        int joint = -1;
+        for (int i = 0; i < _skeleton.num_joints(); ++i) {
+            if (name == _skeleton.joint_names()[i]) {
+                joint = i;
+                break;
+            }
+        }
+        if (joint < 0) {
+            ozz::log::Err() << "--joint_settings: no joint named '" << name << "'." << std::endl;
+            return false;
+        }
+
+        ozz::animation::offline::AnimationOptimizer::Setting setting(
+            std::strtof(tolerance.c_str(), nullptr),
+            distance.empty() ? OPTIONS_distance.value() : std::strtof(distance.c_str(), nullptr));
+        _optimizer->joints_setting_override[joint] = setting;
+    }
+    return true;
+}
+
+// Value of --name=value in argv, for the importer framework's own options
+// (registered in its library, so not readable here)
+std::string ArgValue(int _argc, const char** _argv, const std::string& _name) {
+    std::string prefix = "--" + _name + "=";
+    for (int i = 1; i < _argc; ++i) {
+        if (std::strncmp(_argv[i], prefix.c_str(), prefix.size()) == 0) {
+            return _argv[i] + prefix.size();
+        }
+    }
+    return "";
+}
+
+// Output filename for a clip: ozz configs use '*' for the clip name
+std::string OutputFilename(std::string _pattern, const std::string& _clip) {
+    size_t star = _pattern.find('*');
+    if (star != std::string::npos) {
+        _pattern.replace(star, 1, _clip);
+    }
+    return _pattern;
+}
+
+template <typename T>
+bool WriteArchive(const std::string& _path, const T& _object) {
+    ozz::io::File file(_path.c_str(), "wb");
+    if (!file.opened()) {
+        ozz::log::Err() << "Failed to open output file " << _path << std::endl;
+        return false;
+    }
+    ozz::io::OArchive archive(&file);
+    archive << _object;
+    return true;
+}
+
 class GlaImporter : public ozz::animation::offline::OzzImporter {
  public:
     GlaImporter() {}
 
+    // Convert everything _config asks for from one parse of _gla_path,
+    // clips spread across _jobs threads. Returns a process exit code.
+    int RunBatch(const char* _gla_path, const json& _config, int _jobs) {
+        if (!Load(_gla_path)) {
+            return EXIT_FAILURE;
+        }
+
+        // Skeleton, written unless the config disables it
+        ozz::animation::offline::RawSkeleton raw_skeleton;
+        NodeType types = {};
+        types.any = true;
+        if (!Import(&raw_skeleton, types)) {
+            return EXIT_FAILURE;
+        }
+        ozz::animation::offline::SkeletonBuilder skeleton_builder;
+        auto skeleton = skeleton_builder(raw_skeleton);
+        if (!skeleton) {
+            ozz::log::Err() << "Failed to build skeleton." << std::endl;
+            return EXIT_FAILURE;
+        }
+        const json skeleton_config = _config.value("skeleton", json::object());
+        if (skeleton_config.value("import", json::object()).value("enable", true)) {
+            std::string path = skeleton_config.value("filename", "skeleton.ozz");
+            if (!WriteArchive(path, *skeleton)) {
+                return EXIT_FAILURE;
+            }
+            ozz::log::Log() << "Wrote skeleton " << path << std::endl;
+        }
+
+        // Expand the animation entries ("*" matches every clip) into jobs
+        struct Job {
+            std::string clip;
+            std::string path;
+            float sampling_rate;
+        };
+        std::vector<Job> work;
+        for (const auto& entry : _config.value("animations", json::array())) {
+            std::string clip = entry.value("clip", "*");
+            std::string filename = entry.value("filename", "*.ozz");
+            float sampling_rate = entry.value("sampling_rate", 0.0f);
+            for (const auto& name : GetAnimationNames()) {
+                if (clip == "*" || clip == name.c_str()) {
+                    work.push_back({name.c_str(), OutputFilename(filename, name.c_str()), sampling_rate});
+                }
+            }
+        }
+
+        if (_jobs <= 0) {
+            _jobs = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        }
+        _jobs = std::min<int>(_jobs, static_cast<int>(std::max<size_t>(work.size(), 1)));
+        ozz::log::Log() << "Converting " << work.size() << " animations on " << _jobs
+                        << " threads..." << std::endl;
+
+        // The parser and cfg are read-only after Load, so clips convert independently
+        std::atomic<size_t> next{0};
+        std::atomic<int> failures{0};
+        auto worker = [&]() {
+            for (size_t i = next++; i < work.size(); i = next++) {
+                const Job& job = work[i];
+                ozz::animation::offline::RawAnimation raw;
+                ozz::animation::offline::AnimationBuilder builder;
+                bool ok = Import(job.clip.c_str(), *skeleton, job.sampling_rate, &raw);
+                auto animation = ok ? builder(raw) : nullptr;
+                if (!animation || !WriteArchive(job.path, *animation)) {
+                    ozz::log::Err() << "Failed to convert animation '" << job.clip << "'." << std::endl;
+                    ++failures;
+                }
+            }
+        };
+        std::vector<std::thread> threads;
+        for (int t = 1; t < _jobs; ++t) {
+            threads.emplace_back(worker);
+        }
+        worker();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        ozz::log::Log() << "Converted " << work.size() - failures << " of " << work.size()
+                        << " animations." << std::endl;
+        return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
  private:
     // Load the GLA file and associated animation.cfg
     bool Load(const char* _filename) override {
@@ -307,11 +512,19 @@ class GlaImporter : public ozz::animation::offline::OzzImporter {
         std::vector<ozz::math::Float3> world_pos_ozz(num_joints);
         std::vector<ozz::math::Quaternion> world_rot_ozz(num_joints);
 
+        // Every bone of the current frame, decoded at once
+        gla::FrameTransforms frame;
+
         // For each frame in the clip
         for (int f = 0; f < clip->frame_count; ++f) {
             int gla_frame = clip->start_frame + f;
             float time = static_cast<float>(f) * frame_duration;
 
+            if (!m_parser.DecodeFrame(gla_frame, &frame)) {
+                ozz::log::Err() << "Failed to decode frame " << gla_frame << std::endl;
+                return false;
+            }
+
             // Phase 1: Compute and convert world transforms for all ozz joints
             for (int j = 0; j < num_joints; ++j) {
                 auto gla_it = ozz_to_gla.find(j);
@@ -323,9 +536,8 @@ class GlaImporter : public ozz::animation::offline::OzzImporter {
                 }
                 int gla_bone = gla_it->second;
 
-                ozz::math::Float3 world_pos_jka;
-                ozz::math::Quaternion world_rot_jka;
-                m_parser.ComputeAnimatedWorldTransform(gla_frame, gla_bone, &world_pos_jka, &world_rot_jka);
+                const ozz::math::Float3& world_pos_jka = frame.world_positions[gla_bone];
+                const ozz::math::Quaternion& world_rot_jka = frame.world_rotations[gla_bone];
 
                 // Convert world transform from JKA (Z-up) to ozz (Y-up)
                 world_pos_ozz[j] = coord_convert::ConvertPosition(world_pos_jka);
@@ -489,6 +701,10 @@ class GlaImporter : public ozz::animation::offline::OzzImporter {
             return false;
         }
 
+        if (OPTIONS_optimize && !Optimize(_skeleton, _animation)) {
+            return false;
+        }
+
         ozz::log::Log() << "Animation import complete: "
                         << _animation->duration << " seconds, "
                         << clip->frame_count << " frames." << std::endl;
@@ -537,6 +753,44 @@ class GlaImporter : public ozz::animation::offline::OzzImporter {
         return false;
     }
 
+ private:
+    // Replace _animation with its keyframe-reduced version and log the savings
+    bool Optimize(const ozz::animation::Skeleton& _skeleton,
+                  ozz::animation::offline::RawAnimation* _animation) {
+        ozz::animation::offline::AnimationOptimizer optimizer;
+        optimizer.setting.tolerance = OPTIONS_tolerance;
+        optimizer.setting.distance = OPTIONS_distance;
+        if (!ParseJointSettings(_skeleton, &optimizer)) {
+            return false;
+        }
+
+        ozz::animation::offline::RawAnimation optimized;
+        if (!optimizer(*_animation, _skeleton, &optimized)) {
+            ozz::log::Err() << "Animation optimization failed." << std::endl;
+            return false;
+        }
+
+        size_t keys_before = CountKeys(*_animation);
+        size_t keys_after = CountKeys(optimized);
+        size_t bytes_before = RuntimeSize(*_animation);
+        size_t bytes_after = RuntimeSize(optimized);
+        m_bytes_before += bytes_before;
+        m_bytes_after += bytes_after;
+
+        ozz::log::Log() << "Optimized: " << keys_before << " -> " << keys_after << " keys, "
+                        << bytes_before << " -> " << bytes_after << " bytes ("
+                        << (bytes_before ? 100.0 * bytes_after / bytes_before : 100.0)
+                        << "%)" << std::endl;
+        *_animation = std::move(optimized);
+        return true;
+    }
+
+ public:
+    // Runtime bytes of every clip imported so far, as built before and after
+    // optimization
+    size_t bytes_before() const { return m_bytes_before; }
+    size_t bytes_after() const { return m_bytes_after; }
+
  private:
     // Recursively build joint hierarchy
     void BuildJointRecursive(
@@ -586,11 +840,38 @@ class GlaImporter : public ozz::animation::offline::OzzImporter {
     gla::GlaParser m_parser;
     gla::AnimationCfgParser m_cfg_parser;
     std::string m_gla_path;
+    std::atomic<size_t> m_bytes_before{0};  // Updated from batch worker threads
+    std::atomic<size_t> m_bytes_after{0};
 };
 
 }  // namespace
 
 int main(int _argc, const char** _argv) {
     GlaImporter importer;
-    return importer(_argc, _argv);
+    int result;
+    ozz::options::ParseResult parsed = ozz::options::ParseCommandLine(
+        _argc, _argv, "1.0", "Converts GLA skeletons and animations to ozz format.");
+    if (parsed != ozz::options::kSuccess) {
+        return parsed == ozz::options::kExitSuccess ? EXIT_SUCCESS : EXIT_FAILURE;
+    } else if (OPTIONS_jobs != 1) {
+        std::string config_text = ArgValue(_argc, _argv, "config");
+        std::string config_file = ArgValue(_argc, _argv, "config_file");
+        if (!config_file.empty()) {
+            std::ifstream file(config_file);
+            config_text.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        }
+        json config = json::parse(config_text.empty() ? "{}" : config_text, nullptr, false);
+        if (config.is_discarded()) {
+            ozz::log::Err() << "Failed to parse config." << std::endl;
+            return EXIT_FAILURE;
+        }
+        result = importer.RunBatch(ArgValue(_argc, _argv, "file").c_str(), config, OPTIONS_jobs);
+    } else {
+        result = importer(_argc, _argv);
+    }
+    if (importer.bytes_before() > 0) {
+        ozz::log::Log() << "Animation memory: " << importer.bytes_before() << " -> "
+                        << importer.bytes_after() << " bytes after optimization" << std::endl;
+    }
+    return result;
 }
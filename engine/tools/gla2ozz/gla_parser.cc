@@ -2,11 +2,21 @@
 
 #include "gla_parser.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <cstring>
 #include <fstream>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include "ozz/base/log.h"
+#include "ozz/base/maths/soa_float4x4.h"
 
 namespace gla {
 
@@ -105,24 +115,88 @@ void SetIdentityMatrix34(float m[3][4]) {
     m[2][0] = 0; m[2][1] = 0; m[2][2] = 1; m[2][3] = 0;
 }
 
+// 3x4 row-major matrix <-> ozz column-major 4x4 (implicit [0,0,0,1] row)
+ozz::math::Float4x4 ToFloat4x4(const float m[3][4]) {
+    ozz::math::Float4x4 r;
+    for (int c = 0; c < 4; c++) {
+        r.cols[c] = ozz::math::simd_float4::Load(m[0][c], m[1][c], m[2][c],
+                                                 c == 3 ? 1.0f : 0.0f);
+    }
+    return r;
+}
+
+void FromFloat4x4(const ozz::math::Float4x4& m, float out[3][4]) {
+    for (int c = 0; c < 4; c++) {
+        float col[4];
+        ozz::math::StorePtrU(m.cols[c], col);
+        out[0][c] = col[0];
+        out[1][c] = col[1];
+        out[2][c] = col[2];
+    }
+}
+
+uint16_t ReadU16(const uint8_t* p) {
+    return static_cast<uint16_t>(p[0]) | (static_cast<uint16_t>(p[1]) << 8);
+}
+
 }  // anonymous namespace
 
 GlaParser::GlaParser()
     : m_frame_data(nullptr),
       m_bone_pool(nullptr),
       m_frame_data_size(0),
-      m_bone_pool_size(0) {
+      m_bone_pool_size(0),
+      m_data(nullptr),
+      m_data_size(0),
+      m_mapping(nullptr),
+      m_mapping_size(0) {
     memset(&m_header, 0, sizeof(m_header));
 }
 
 GlaParser::~GlaParser() {
+    Unmap();
+}
+
+void GlaParser::Unmap() {
+#ifndef _WIN32
+    if (m_mapping) {
+        munmap(m_mapping, m_mapping_size);
+    }
+#endif
+    m_mapping = nullptr;
+    m_mapping_size = 0;
 }
 
-bool GlaParser::Load(const char* filename) {
-    // Read entire file into memory
+bool GlaParser::MapFile(const char* filename) {
+#ifdef _WIN32
+    (void)filename;
+    return false;
+#else
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return false;
+    }
+    void* mapping = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    m_mapping = mapping;
+    m_mapping_size = static_cast<size_t>(st.st_size);
+    m_data = static_cast<const uint8_t*>(mapping);
+    m_data_size = m_mapping_size;
+    return true;
+#endif
+}
+
+bool GlaParser::ReadFile(const char* filename) {
     std::ifstream file(filename, std::ios::binary | std::ios::ate);
     if (!file.is_open()) {
-        ozz::log::Err() << "Failed to open GLA file: " << filename << std::endl;
         return false;
     }
 
@@ -134,7 +208,23 @@ bool GlaParser::Load(const char* filename) {
         ozz::log::Err() << "Failed to read GLA file: " << filename << std::endl;
         return false;
     }
-    file.close();
+    m_data = m_file_data.data();
+    m_data_size = m_file_data.size();
+    return true;
+}
+
+bool GlaParser::Load(const char* filename, bool use_mmap) {
+    Unmap();
+    m_file_data.clear();
+    m_data = nullptr;
+    m_data_size = 0;
+
+    // Map the file, so only the frames actually sampled are paged in;
+    // fall back to reading it whole
+    if (!(use_mmap && MapFile(filename)) && !ReadFile(filename)) {
+        ozz::log::Err() << "Failed to open GLA file: " << filename << std::endl;
+        return false;
+    }
 
     // Parse header
     if (!ParseHeader()) {
@@ -162,12 +252,12 @@ bool GlaParser::Load(const char* filename) {
 }
 
 bool GlaParser::ParseHeader() {
-    if (m_file_data.size() < sizeof(GlaHeader)) {
+    if (m_data_size < sizeof(GlaHeader)) {
         ozz::log::Err() << "File too small to contain GLA header" << std::endl;
         return false;
     }
 
-    memcpy(&m_header, m_file_data.data(), sizeof(GlaHeader));
+    memcpy(&m_header, m_data, sizeof(GlaHeader));
 
     // Verify magic
     if (m_header.ident != GLA_IDENT) {
@@ -194,7 +284,7 @@ bool GlaParser::ParseHeader() {
 
 bool GlaParser::ParseSkeleton() {
     if (m_header.ofs_skel <= 0 ||
-        static_cast<size_t>(m_header.ofs_skel) >= m_file_data.size()) {
+        static_cast<size_t>(m_header.ofs_skel) >= m_data_size) {
         ozz::log::Err() << "Invalid skeleton offset" << std::endl;
         return false;
     }
@@ -205,11 +295,11 @@ bool GlaParser::ParseSkeleton() {
     // The bone offset table is located immediately after the header (at sizeof(GlaHeader))
     // Each offset is relative to sizeof(GlaHeader), pointing to the actual bone data
     const size_t header_size = sizeof(GlaHeader);
-    const uint8_t* file_base = m_file_data.data();
+    const uint8_t* file_base = m_data;
 
     // Verify we have space for the offset table
     size_t offset_table_size = static_cast<size_t>(m_header.num_bones) * sizeof(int32_t);
-    if (header_size + offset_table_size > m_file_data.size()) {
+    if (header_size + offset_table_size > m_data_size) {
         ozz::log::Err() << "File too small for bone offset table" << std::endl;
         return false;
     }
@@ -222,7 +312,7 @@ bool GlaParser::ParseSkeleton() {
         const uint8_t* bone_data = file_base + header_size + bone_offset;
 
         // Verify we don't read past end of file
-        if (bone_data + sizeof(GlaSkelBoneHeader) > file_base + m_file_data.size()) {
+        if (bone_data + sizeof(GlaSkelBoneHeader) > file_base + m_data_size) {
             ozz::log::Err() << "Bone " << i << " (offset=" << bone_offset
                            << ") data extends past end of file" << std::endl;
             return false;
@@ -246,17 +336,38 @@ bool GlaParser::ParseSkeleton() {
                          << " children=" << bone.num_children << std::endl;
     }
 
+    // Order bones by depth for DecodeFrame, so each comes after its parent.
+    // Parents out of range count as roots, as does a bone in a cycle.
+    const int num_bones = m_header.num_bones;
+    std::vector<int> depth(num_bones, 0);
+    for (int i = 0; i < num_bones; ++i) {
+        int p = m_bones[i].parent;
+        while (p >= 0 && p < num_bones && depth[i] < num_bones) {
+            ++depth[i];
+            p = m_bones[p].parent;
+        }
+    }
+    m_bone_order.resize(num_bones);
+    for (int i = 0; i < num_bones; ++i) m_bone_order[i] = i;
+    std::stable_sort(m_bone_order.begin(), m_bone_order.end(),
+                     [&depth](int a, int b) { return depth[a] < depth[b]; });
+
+    m_base_poses.resize(num_bones);
+    for (int i = 0; i < num_bones; ++i) {
+        m_base_poses[i] = ToFloat4x4(m_bones[i].base_pose.matrix);
+    }
+
     return true;
 }
 
 bool GlaParser::LoadFrameIndices() {
     if (m_header.ofs_frames <= 0 ||
-        static_cast<size_t>(m_header.ofs_frames) >= m_file_data.size()) {
+        static_cast<size_t>(m_header.ofs_frames) >= m_data_size) {
         ozz::log::Err() << "Invalid frame data offset" << std::endl;
         return false;
     }
 
-    m_frame_data = m_file_data.data() + m_header.ofs_frames;
+    m_frame_data = m_data + m_header.ofs_frames;
 
     // Each frame has num_bones * 3 bytes (3-byte indices)
     // Total size = num_frames * num_bones * 3, padded to 4-byte boundary
@@ -264,7 +375,7 @@ bool GlaParser::LoadFrameIndices() {
     m_frame_data_size = static_cast<size_t>(m_header.num_frames) * frame_entry_size;
 
     // Verify we have enough data
-    if (m_frame_data + m_frame_data_size > m_file_data.data() + m_file_data.size()) {
+    if (m_frame_data + m_frame_data_size > m_data + m_data_size) {
         ozz::log::Err() << "Frame data extends past end of file" << std::endl;
         return false;
     }
@@ -274,17 +385,17 @@ bool GlaParser::LoadFrameIndices() {
 
 bool GlaParser::LoadCompressedBonePool() {
     if (m_header.ofs_comp_bone_pool <= 0 ||
-        static_cast<size_t>(m_header.ofs_comp_bone_pool) >= m_file_data.size()) {
+        static_cast<size_t>(m_header.ofs_comp_bone_pool) >= m_data_size) {
         ozz::log::Err() << "Invalid compressed bone pool offset" << std::endl;
         return false;
     }
 
-    m_bone_pool = m_file_data.data() + m_header.ofs_comp_bone_pool;
+    m_bone_pool = m_data + m_header.ofs_comp_bone_pool;
 
     // Pool extends to the skeleton section (or end of file)
     size_t pool_end = m_header.ofs_skel > 0 ?
         static_cast<size_t>(m_header.ofs_skel) :
-        m_file_data.size();
+        m_data_size;
     m_bone_pool_size = pool_end - static_cast<size_t>(m_header.ofs_comp_bone_pool);
 
     return true;
@@ -662,6 +773,91 @@ void GlaParser::ComputeAnimatedWorldTransform(int frame_index, int bone_index,
     DecomposeMatrix34(world_matrix, nullptr, world_rot, &scale);
 }
 
+bool GlaParser::DecodeFrame(int frame_index, FrameTransforms* out) const {
+    using namespace ozz::math;
+
+    if (frame_index < 0 || frame_index >= m_header.num_frames) {
+        return false;
+    }
+
+    const int num_bones = m_header.num_bones;
+    const int num_soa = (num_bones + 3) / 4;
+    out->rotations.resize(num_soa);
+    out->translations.resize(num_soa);
+    out->bone_matrices.resize(static_cast<size_t>(num_soa) * 4);
+    out->world_positions.resize(num_bones);
+    out->world_rotations.resize(num_bones);
+
+    const SimdFloat4 zero = simd_float4::zero();
+    const SimdFloat4 one = simd_float4::one();
+    const SimdFloat4 quat_scale = simd_float4::Load1(QUAT_SCALE);
+    const SimdFloat4 quat_offset = simd_float4::Load1(QUAT_OFFSET);
+    const SimdFloat4 trans_scale = simd_float4::Load1(TRANS_SCALE);
+    const SimdFloat4 trans_offset = simd_float4::Load1(TRANS_OFFSET);
+    const SimdFloat4 min_len_sq = simd_float4::Load1(1e-10f);
+    const SoaFloat3 unit_scale = SoaFloat3::one();
+
+    // Decompress 4 bones at a time (DecompressBone's layout and formulas),
+    // and build their local matrices into bone_matrices
+    for (int s = 0; s < num_soa; ++s) {
+        // The 7 shorts of each lane's bone; padding lanes stay 0
+        alignas(16) float raw[7][4] = {};
+        for (int lane = 0; lane < 4; ++lane) {
+            int bone = s * 4 + lane;
+            if (bone >= num_bones) break;
+            size_t pool_offset = static_cast<size_t>(ReadFrameIndex(frame_index, bone)) * 14;
+            if (pool_offset + 14 > m_bone_pool_size) {
+                ozz::log::Err() << "Bone pool index " << pool_offset / 14
+                                << " out of bounds for frame " << frame_index
+                                << " bone " << bone << std::endl;
+                return false;
+            }
+            const uint8_t* d = m_bone_pool + pool_offset;
+            for (int c = 0; c < 7; ++c) {
+                raw[c][lane] = static_cast<float>(ReadU16(d + c * 2));
+            }
+        }
+
+        // Scalar-first on disk: w, x, y, z
+        SoaQuaternion q = {simd_float4::LoadPtr(raw[1]) / quat_scale - quat_offset,
+                           simd_float4::LoadPtr(raw[2]) / quat_scale - quat_offset,
+                           simd_float4::LoadPtr(raw[3]) / quat_scale - quat_offset,
+                           simd_float4::LoadPtr(raw[0]) / quat_scale - quat_offset};
+        const SimdFloat4 len_sq = q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w;
+        const SimdInt4 valid = CmpGt(len_sq, min_len_sq);
+        const SimdFloat4 inv_len = one / Sqrt(len_sq);
+        q = {Select(valid, q.x * inv_len, zero), Select(valid, q.y * inv_len, zero),
+             Select(valid, q.z * inv_len, zero), Select(valid, q.w * inv_len, one)};
+
+        const SoaFloat3 t = {simd_float4::LoadPtr(raw[4]) / trans_scale - trans_offset,
+                             simd_float4::LoadPtr(raw[5]) / trans_scale - trans_offset,
+                             simd_float4::LoadPtr(raw[6]) / trans_scale - trans_offset};
+
+        out->rotations[s] = q;
+        out->translations[s] = t;
+
+        const SoaFloat4x4 local = SoaFloat4x4::FromAffine(t, q, unit_scale);
+        Transpose16x16(&local.cols[0].x, out->bone_matrices[s * 4].cols);
+    }
+
+    // One pass, parents first: bone_matrix = parent bone_matrix * local,
+    // in place (a parent's entry is final before its children read it)
+    for (int b : m_bone_order) {
+        int parent = m_bones[b].parent;
+        if (parent >= 0 && parent < num_bones) {
+            out->bone_matrices[b] = out->bone_matrices[parent] * out->bone_matrices[b];
+        }
+
+        const Float4x4 world = out->bone_matrices[b] * m_base_poses[b];
+        float world_matrix[3][4];
+        FromFloat4x4(world, world_matrix);
+        out->world_positions[b] = Float3(world_matrix[0][3], world_matrix[1][3], world_matrix[2][3]);
+        DecomposeMatrix34(world_matrix, nullptr, &out->world_rotations[b], nullptr);
+    }
+
+    return true;
+}
+
 // Compute bone_matrix recursively (hierarchical multiplication)
 void GlaParser::ComputeBoneMatrix(int frame_index, int bone_index, float out[3][4]) const {
     const GlaBone& bone = m_bones[bone_index];
@@ -675,8 +871,8 @@ void GlaParser::ComputeBoneMatrix(int frame_index, int bone_index, float out[3][
     float local_anim[3][4];
     BuildMatrix34(anim_rot, anim_trans, local_anim);
 
-    // Debug: print arm bones
-    static bool debug_printed = false;
+    // Debug: print arm bones (atomic: batch mode calls this from many threads)
+    static std::atomic<bool> debug_printed{false};
     if (!debug_printed && (bone_index == 25 || bone_index == 38)) {  // rhumerus or lhumerus
         printf("\n=== ComputeBoneMatrix debug for %s (bone %d) frame %d ===\n",
                bone.name, bone_index, frame_index);
@@ -10,17 +10,41 @@
 
 #include "gla_format.h"
 #include "ozz/base/maths/quaternion.h"
+#include "ozz/base/maths/simd_math.h"
+#include "ozz/base/maths/soa_float.h"
+#include "ozz/base/maths/soa_quaternion.h"
 #include "ozz/base/maths/vec_float.h"
 
 namespace gla {
 
+// Every bone of one frame, decoded together by GlaParser::DecodeFrame.
+// Reuse one across frames to keep its buffers.
+struct FrameTransforms {
+    // Local animation transforms (JKA coordinates), 4 bones per element;
+    // lanes past the last bone are padding
+    std::vector<ozz::math::SoaQuaternion> rotations;
+    std::vector<ozz::math::SoaFloat3> translations;
+
+    // Per bone: bone_matrix (parent bone_matrix * local) and the animated
+    // world transform (bone_matrix * base_pose), as from
+    // ComputeBoneMatrix and ComputeAnimatedWorldTransform
+    std::vector<ozz::math::Float4x4> bone_matrices;
+    std::vector<ozz::math::Float3> world_positions;
+    std::vector<ozz::math::Quaternion> world_rotations;
+};
+
 class GlaParser {
  public:
     GlaParser();
     ~GlaParser();
 
-    // Load a GLA file
-    bool Load(const char* filename);
+    // Load a GLA file. By default it is memory-mapped and frames are decoded
+    // straight from the mapping, so only the pages of frames actually read
+    // are loaded; use_mmap = false (or a failed map) reads it all instead.
+    bool Load(const char* filename, bool use_mmap = true);
+
+    // Whether the loaded file is memory-mapped (vs. copied into memory)
+    bool IsMapped() const { return m_mapping != nullptr; }
 
     // Accessors
     const GlaHeader& GetHeader() const { return m_header; }
@@ -66,6 +90,12 @@ class GlaParser {
                                         ozz::math::Float3* world_pos,
                                         ozz::math::Quaternion* world_rot) const;
 
+    // Decode every bone of a frame at once: decompress 4 bones at a time
+    // with ozz SIMD math, then build bone matrices in one parent-first
+    // pass, each from its parent's, instead of walking the parent chain
+    // again for every bone. Same results as the per-bone calls above.
+    bool DecodeFrame(int frame_index, FrameTransforms* out) const;
+
     // Compute bone_matrix hierarchically (like JKA's G2_TransformBone)
     void ComputeBoneMatrix(int frame_index, int bone_index, float out[3][4]) const;
 
@@ -85,6 +115,10 @@ class GlaParser {
                          ozz::math::Float3* scale) const;
 
  private:
+    bool MapFile(const char* filename);
+    bool ReadFile(const char* filename);
+    void Unmap();
+
     bool ParseHeader();
     bool ParseSkeleton();
     bool LoadCompressedBonePool();
@@ -107,13 +141,24 @@ class GlaParser {
 
     GlaHeader m_header;
     std::vector<GlaBone> m_bones;
-    std::vector<uint8_t> m_file_data;
+    std::vector<int> m_bone_order;                  // Parents before children
+    std::vector<ozz::math::Float4x4> m_base_poses;  // base_pose, per bone
+    std::vector<uint8_t> m_file_data;  // Only when not mapped
 
-    // Pointers into m_file_data for quick access
+    // Pointers into the file (mapping or m_file_data) for quick access
     const uint8_t* m_frame_data;      // Frame index data
     const uint8_t* m_bone_pool;       // Compressed bone pool
     size_t m_frame_data_size;
     size_t m_bone_pool_size;
+
+    // The file contents, wherever they live
+    const uint8_t* m_data;
+    size_t m_data_size;
+    void* m_mapping;
+    size_t m_mapping_size;
+
+    GlaParser(const GlaParser&) = delete;
+    GlaParser& operator=(const GlaParser&) = delete;
 };
 
 }  // namespace gla
@@ -2,6 +2,7 @@
 // Build: g++ -std=c++17 -I... -o gla_tests gla_tests.cc gla_parser.cc ...
 
 #include <cassert>
+#include <chrono>
 #include <cmath>
 #include <cstdio>
 #include <fstream>
@@ -359,6 +360,102 @@ void test_animation_transforms(const char* gla_path) {
     printf("  PASSED (manual verification needed)\n");
 }
 
+// Test 7b: Memory-mapped and copied loads decode identical frames
+void test_mmap_matches_copy(const char* gla_path) {
+    printf("Test: Memory-mapped load matches copied load... ");
+
+    gla::GlaParser mapped;
+    gla::GlaParser copied;
+    if (!mapped.Load(gla_path) || !copied.Load(gla_path, false)) {
+        printf("SKIPPED (file not found)\n");
+        return;
+    }
+    assert(!copied.IsMapped());
+    assert(mapped.GetNumFrames() == copied.GetNumFrames());
+    assert(mapped.GetNumBones() == copied.GetNumBones());
+
+    int frames[] = {0, mapped.GetNumFrames() / 2, mapped.GetNumFrames() - 1};
+    for (int frame : frames) {
+        for (int bone = 0; bone < mapped.GetNumBones(); ++bone) {
+            ozz::math::Float3 t1, t2;
+            ozz::math::Quaternion r1, r2;
+            assert(mapped.GetBoneTransform(frame, bone, &t1, &r1));
+            assert(copied.GetBoneTransform(frame, bone, &t2, &r2));
+            assert(t1.x == t2.x && t1.y == t2.y && t1.z == t2.z);
+            assert(r1.x == r2.x && r1.y == r2.y && r1.z == r2.z && r1.w == r2.w);
+        }
+    }
+
+    printf("%s PASSED\n", mapped.IsMapped() ? "(mapped)" : "(mmap unavailable, copied)");
+}
+
+// Test 7c: Frame-at-a-time decode matches the per-bone calls
+void test_decode_frame_matches_per_bone(const char* gla_path) {
+    printf("Test: DecodeFrame matches per-bone decode... ");
+
+    gla::GlaParser parser;
+    if (!parser.Load(gla_path)) {
+        printf("SKIPPED (file not found)\n");
+        return;
+    }
+
+    gla::FrameTransforms frame;
+    assert(!parser.DecodeFrame(-1, &frame));
+    assert(!parser.DecodeFrame(parser.GetNumFrames(), &frame));
+
+    int frames[] = {0, parser.GetNumFrames() / 2, parser.GetNumFrames() - 1};
+    for (int f : frames) {
+        assert(parser.DecodeFrame(f, &frame));
+        for (int bone = 0; bone < parser.GetNumBones(); ++bone) {
+            ozz::math::Float3 t;
+            ozz::math::Quaternion r;
+            assert(parser.GetBoneTransform(f, bone, &t, &r));
+            float tx[4], ty[4], tz[4], rx[4], ry[4], rz[4], rw[4];
+            const ozz::math::SoaFloat3& soa_t = frame.translations[bone / 4];
+            const ozz::math::SoaQuaternion& soa_r = frame.rotations[bone / 4];
+            ozz::math::StorePtrU(soa_t.x, tx);
+            ozz::math::StorePtrU(soa_t.y, ty);
+            ozz::math::StorePtrU(soa_t.z, tz);
+            ozz::math::StorePtrU(soa_r.x, rx);
+            ozz::math::StorePtrU(soa_r.y, ry);
+            ozz::math::StorePtrU(soa_r.z, rz);
+            ozz::math::StorePtrU(soa_r.w, rw);
+            int lane = bone % 4;
+            assert(vec3_eq(t, ozz::math::Float3(tx[lane], ty[lane], tz[lane]), 1e-4f));
+            assert(float_eq(r.x, rx[lane], 1e-5f) && float_eq(r.y, ry[lane], 1e-5f) &&
+                   float_eq(r.z, rz[lane], 1e-5f) && float_eq(r.w, rw[lane], 1e-5f));
+
+            ozz::math::Float3 world_pos;
+            ozz::math::Quaternion world_rot;
+            parser.ComputeAnimatedWorldTransform(f, bone, &world_pos, &world_rot);
+            assert(vec3_eq(world_pos, frame.world_positions[bone], 0.01f));
+            const ozz::math::Quaternion& q = frame.world_rotations[bone];
+            float dot = world_rot.x * q.x + world_rot.y * q.y + world_rot.z * q.z + world_rot.w * q.w;
+            assert(std::abs(dot) > 0.9999f);
+        }
+    }
+
+    // Throughput, all frames both ways
+    auto start = std::chrono::steady_clock::now();
+    for (int f = 0; f < parser.GetNumFrames(); ++f) {
+        for (int bone = 0; bone < parser.GetNumBones(); ++bone) {
+            ozz::math::Float3 world_pos;
+            ozz::math::Quaternion world_rot;
+            parser.ComputeAnimatedWorldTransform(f, bone, &world_pos, &world_rot);
+        }
+    }
+    auto middle = std::chrono::steady_clock::now();
+    for (int f = 0; f < parser.GetNumFrames(); ++f) {
+        parser.DecodeFrame(f, &frame);
+    }
+    auto end = std::chrono::steady_clock::now();
+    double per_bone_ms = std::chrono::duration<double, std::milli>(middle - start).count();
+    double per_frame_ms = std::chrono::duration<double, std::milli>(end - middle).count();
+
+    printf("PASSED (%d frames: per bone %.1f ms, per frame %.1f ms)\n",
+           parser.GetNumFrames(), per_bone_ms, per_frame_ms);
+}
+
 // Test 8: Check animation orientation - does frame 0 produce correct world positions?
 void test_animation_orientation(const char* ozz_skeleton_path, const char* ozz_anim_path) {
     printf("Test: Animation orientation (empirical)...\n");
@@ -605,6 +702,8 @@ int main(int argc, char** argv) {
     test_bind_pose_structure(gla_path);
     test_gla_ozz_comparison(gla_path, ozz_path);
     test_animation_transforms(gla_path);
+    test_mmap_matches_copy(gla_path);
+    test_decode_frame_matches_per_bone(gla_path);
     test_skeleton_orientation(ozz_path);
     test_animation_orientation(ozz_path, anim_path);
 
@@ -0,0 +1,3 @@
+// cgltf_impl.cc - cgltf's implementation, which the engine gets from libcgltf
+#define CGLTF_IMPLEMENTATION
+#include "cgltf.h"
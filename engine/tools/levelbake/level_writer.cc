@@ -0,0 +1,482 @@
+// level_writer.cc - Bake a glTF level into a .level file
+
+#include "level_writer.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <utility>
+
+#include "cgltf.h"
+#include "engine/gltf_headless_impl.h"
+#include "engine/level_impl.h"
+
+namespace levelbake {
+
+namespace {
+
+// Primitive record for a render primitive, as gltf.core/parse-material and
+// load read the node and material
+LevelPrimitive DescribePrimitive(cgltf_node* node, cgltf_primitive* primitive,
+                                 const egltf::PrimitiveBuffers& buffers) {
+    LevelPrimitive p;
+    std::memset(&p, 0, sizeof(p));
+    std::memcpy(p.bounds_min, buffers.min, sizeof(p.bounds_min));
+    std::memcpy(p.bounds_max, buffers.max, sizeof(p.bounds_max));
+    std::memcpy(p.translation, node->translation, sizeof(p.translation));
+    std::memcpy(p.scale, node->scale, sizeof(p.scale));
+    p.has_translation = node->has_translation ? 1 : 0;
+    p.has_scale = node->has_scale ? 1 : 0;
+    // parse-material leaves the factor at white
+    for (float& c : p.base_color) c = 1.0f;
+
+    cgltf_material* material = primitive->material;
+    cgltf_texture* texture = material && material->has_pbr_metallic_roughness
+                                 ? material->pbr_metallic_roughness.base_color_texture.texture
+                                 : nullptr;
+    if (texture && texture->image && texture->image->uri) {
+        p.has_texture = 1;
+        std::strncpy(p.texture_uri, texture->image->uri, kLevelUriSize - 1);
+        if (cgltf_sampler* sampler = texture->sampler) {
+            p.mag_filter = sampler->mag_filter;
+            p.min_filter = sampler->min_filter;
+            p.wrap_s = sampler->wrap_s;
+            p.wrap_t = sampler->wrap_t;
+        }
+    }
+    return p;
+}
+
+// xorshift32: deterministic sample points, so a bake is reproducible
+float NextUnit(uint32_t* state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return (float)(x >> 8) * (1.0f / 16777216.0f);
+}
+
+// World position of a primitive's vertex, as draw-primitive places it
+// (scale, then translate, applied scale-last)
+glm::vec3 WorldPoint(const LevelPrimitive& p, const float* pos) {
+    glm::vec3 t = p.has_translation ? glm::vec3(p.translation[0], p.translation[1], p.translation[2])
+                                    : glm::vec3(0.0f);
+    glm::vec3 s = p.has_scale ? glm::vec3(p.scale[0], p.scale[1], p.scale[2]) : glm::vec3(1.0f);
+    return s * (glm::vec3(pos[0], pos[1], pos[2]) + t);
+}
+
+using SectorKey = std::pair<int, int>;  // (z, x), so sectors are written row by row
+
+SectorKey KeyOf(const glm::vec3& c, const glm::vec2& origin, float size) {
+    return {(int)std::floor((c.z - origin.y) / size), (int)std::floor((c.x - origin.x) / size)};
+}
+
+// One primitive's triangles in one sector, vertices renumbered in first use
+struct SectorPrimitive {
+    LevelPrimitive record;
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+};
+
+struct SectorParts {
+    std::vector<SectorPrimitive> primitives;
+    std::vector<uint32_t> collision_tris;
+    glm::vec3 lo = glm::vec3(FLT_MAX);
+    glm::vec3 hi = glm::vec3(-FLT_MAX);
+
+    void Grow(const glm::vec3& v) {
+        lo = glm::min(lo, v);
+        hi = glm::max(hi, v);
+    }
+};
+
+template <typename T, typename A>
+void AddSection(std::vector<char>* file, LevelHeader* header, LevelSection s, const std::vector<T, A>& data) {
+    size_t offset = (file->size() + kLevelAlign - 1) / kLevelAlign * kLevelAlign;
+    size_t bytes = data.size() * sizeof(T);
+    file->resize(offset + bytes, 0);
+    if (bytes) std::memcpy(file->data() + offset, data.data(), bytes);
+    header->sections[s].offset = offset;
+    header->sections[s].size = bytes;
+}
+
+}  // namespace
+
+void OptimizePrimitive(egltf::PrimitiveBuffers* buffers) {
+    std::vector<unsigned int>& indices = buffers->indices;
+    size_t vertex_count = buffers->vertices.size();
+    if (indices.empty() || vertex_count == 0) return;
+    emeshopt::optimize_vertex_cache(indices.data(), indices.size(), vertex_count);
+    emeshopt::optimize_overdraw(indices.data(), indices.size(), buffers->vertices[0].pos,
+                                sizeof(Vertex) / sizeof(float), vertex_count);
+    std::vector<uint32_t> remap = emeshopt::vertex_fetch_remap(indices.data(), indices.size(), vertex_count);
+    emeshopt::remap_indices(indices.data(), indices.size(), remap);
+    emeshopt::remap_vertices(buffers->vertices.data(), vertex_count, 1, remap);
+}
+
+bool BuildPvs(ecol::Positions* positions, ecol::Indices* indices, ecol::Bvh* bvh,
+              const PvsOptions& options, LevelPvsGrid* grid, std::vector<uint8_t>* bits) {
+    if (!bvh || bvh->nodes.empty() || indices->empty()) return false;
+    glm::vec3 lo = bvh->nodes[0].bmin;
+    glm::vec3 size = bvh->nodes[0].bmax - lo + glm::vec3(0.0f, options.headroom, 0.0f);
+    float cell = options.cell_size > 0.0f ? options.cell_size : 1.0f;
+    uint32_t dims[3];
+    for (;;) {
+        uint64_t n = 1;
+        for (int k = 0; k < 3; k++) {
+            dims[k] = std::max(1u, (uint32_t)std::ceil(size[k] / cell));
+            n *= dims[k];
+        }
+        if (n <= (uint64_t)std::max(1, options.max_clusters)) break;
+        cell *= 1.25f;
+    }
+
+    std::memset(grid, 0, sizeof(*grid));
+    for (int k = 0; k < 3; k++) {
+        grid->origin[k] = lo[k];
+        grid->dims[k] = dims[k];
+    }
+    grid->cell_size = cell;
+    int n = (int)(dims[0] * dims[1] * dims[2]);
+    grid->row_bytes = (uint32_t)(n + 7) / 8;
+    bits->assign((size_t)n * grid->row_bytes, 0);
+    auto mark = [&](int i, int j) {
+        (*bits)[(size_t)i * grid->row_bytes + (size_t)(j >> 3)] |= (uint8_t)(1u << (j & 7));
+    };
+    auto coords = [&](int i, int* c) {
+        c[0] = i % (int)dims[0];
+        c[1] = (i / (int)dims[0]) % (int)dims[1];
+        c[2] = i / (int)(dims[0] * dims[1]);
+    };
+
+    for (int i = 0; i < n; i++) {
+        mark(i, i);
+        int ci[3];
+        coords(i, ci);
+        glm::vec3 base_i = lo + glm::vec3((float)ci[0], (float)ci[1], (float)ci[2]) * cell;
+        for (int j = i + 1; j < n; j++) {
+            int cj[3];
+            coords(j, cj);
+            bool visible = std::abs(ci[0] - cj[0]) <= 1 && std::abs(ci[1] - cj[1]) <= 1 &&
+                           std::abs(ci[2] - cj[2]) <= 1;
+            glm::vec3 base_j = lo + glm::vec3((float)cj[0], (float)cj[1], (float)cj[2]) * cell;
+            uint32_t rng = (uint32_t)(i * 73856093u) ^ (uint32_t)(j * 19349663u) ^ 0x9e3779b9u;
+            for (int s = 0; !visible && s < options.samples; s++) {
+                glm::vec3 a = base_i + glm::vec3(NextUnit(&rng), NextUnit(&rng), NextUnit(&rng)) * cell;
+                glm::vec3 b = base_j + glm::vec3(NextUnit(&rng), NextUnit(&rng), NextUnit(&rng)) * cell;
+                glm::vec3 d = b - a;
+                float length = glm::length(d);
+                float t;
+                visible = ecol::ray_closest_hit(positions, indices, bvh, a, d / length, length, &t,
+                                                nullptr) < 0;
+            }
+            if (visible) {
+                mark(i, j);
+                mark(j, i);
+            }
+        }
+    }
+    return true;
+}
+
+bool BakeLevel(const std::string& gltf_path, BakedLevel* out) {
+    cgltf_options options = {};
+    cgltf_data* data = nullptr;
+    if (cgltf_parse_file(&options, gltf_path.c_str(), &data) != cgltf_result_success ||
+        cgltf_load_buffers(&options, data, gltf_path.c_str()) != cgltf_result_success) {
+        std::cerr << "Error: Cannot load " << gltf_path << std::endl;
+        if (data) cgltf_free(data);
+        return false;
+    }
+
+    double acmr_before = 0.0;
+    double acmr_after = 0.0;
+    size_t total_triangles = 0;
+    for (cgltf_size s = 0; s < data->scenes_count; s++) {
+        cgltf_scene* scene = &data->scenes[s];
+        for (cgltf_size n = 0; n < scene->nodes_count; n++) {
+            cgltf_node* node = scene->nodes[n];
+            if (!node->mesh || egltf_hl::node_is_colonly(node)) continue;
+            for (cgltf_size i = 0; i < node->mesh->primitives_count; i++) {
+                cgltf_primitive* primitive = &node->mesh->primitives[i];
+                egltf::PrimitiveBuffers* buffers = egltf::unpack_primitive(primitive);
+                if (!buffers) continue;
+                size_t triangles = buffers->indices.size() / 3;
+                acmr_before += emeshopt::acmr(buffers->indices.data(), buffers->indices.size(),
+                                              buffers->vertices.size()) * triangles;
+                OptimizePrimitive(buffers);
+                acmr_after += emeshopt::acmr(buffers->indices.data(), buffers->indices.size(),
+                                             buffers->vertices.size()) * triangles;
+                total_triangles += triangles;
+                LevelPrimitive p = DescribePrimitive(node, primitive, *buffers);
+                p.vertex_first = out->vertices.size();
+                p.vertex_count = buffers->vertices.size();
+                p.index_first = out->indices.size();
+                p.index_count = buffers->indices.size();
+                out->vertices.insert(out->vertices.end(), buffers->vertices.begin(), buffers->vertices.end());
+                out->indices.insert(out->indices.end(), buffers->indices.begin(), buffers->indices.end());
+                out->primitives.push_back(p);
+                egltf::free_primitive_buffers(buffers);
+            }
+        }
+    }
+
+    if (total_triangles > 0) {
+        out->acmr_before = (float)(acmr_before / total_triangles);
+        out->acmr_after = (float)(acmr_after / total_triangles);
+    }
+
+    egltf_hl::append_collision_nodes(data, &out->collision_positions, &out->collision_indices);
+    cgltf_free(data);
+    ecol::clean_mesh(&out->collision_positions, &out->collision_indices,
+                     1.0f / ecol::WELD_GRID, true, &out->collision_clean);
+    ecol::Bvh* bvh = ecol::build_bvh(&out->collision_positions, &out->collision_indices);
+    out->bvh = std::move(*bvh);
+    ecol::destroy_bvh(bvh);
+    LevelPvsGrid grid;
+    if (BuildPvs(&out->collision_positions, &out->collision_indices, &out->bvh, PvsOptions(), &grid,
+                 &out->pvs_bits)) {
+        out->pvs_grid.push_back(grid);
+    }
+
+    out->source_hash = elevel::source_hash(gltf_path.c_str());
+    if (out->source_hash == 0) {
+        std::cerr << "Error: Cannot hash " << gltf_path << " and its buffers" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool SectorizeLevel(float size, BakedLevel* level) {
+    if (!(size > 0.0f)) return false;
+
+    // Grid origin: the level's min corner on x/z
+    glm::vec2 origin(FLT_MAX);
+    for (const LevelPrimitive& p : level->primitives) {
+        for (uint64_t v = p.vertex_first; v < p.vertex_first + p.vertex_count; v++) {
+            glm::vec3 w = WorldPoint(p, level->vertices[v].pos);
+            origin = glm::min(origin, glm::vec2(w.x, w.z));
+        }
+    }
+    for (const glm::vec3& v : level->collision_positions) origin = glm::min(origin, glm::vec2(v.x, v.z));
+    if (origin.x == FLT_MAX) return true;  // Nothing to cut
+
+    std::map<SectorKey, SectorParts> parts;
+    for (const LevelPrimitive& p : level->primitives) {
+        const Vertex* vertices = level->vertices.data() + p.vertex_first;
+        const uint32_t* indices = level->indices.data() + p.index_first;
+        std::map<SectorKey, std::pair<SectorPrimitive, std::vector<int64_t>>> split;
+        for (uint64_t i = 0; i + 2 < p.index_count; i += 3) {
+            glm::vec3 w[3];
+            for (int k = 0; k < 3; k++) w[k] = WorldPoint(p, vertices[indices[i + k]].pos);
+            auto& [piece, remap] = split[KeyOf((w[0] + w[1] + w[2]) / 3.0f, origin, size)];
+            if (remap.empty()) {
+                piece.record = p;
+                remap.assign(p.vertex_count, -1);
+            }
+            for (int k = 0; k < 3; k++) {
+                uint32_t v = indices[i + k];
+                if (remap[v] < 0) {
+                    remap[v] = (int64_t)piece.vertices.size();
+                    piece.vertices.push_back(vertices[v]);
+                }
+                piece.indices.push_back((uint32_t)remap[v]);
+            }
+        }
+        for (auto& [key, split_piece] : split) {
+            SectorPrimitive& piece = split_piece.first;
+            SectorParts& sector = parts[key];
+            for (int k = 0; k < 3; k++) {
+                piece.record.bounds_min[k] = FLT_MAX;
+                piece.record.bounds_max[k] = -FLT_MAX;
+            }
+            for (const Vertex& v : piece.vertices) {
+                for (int k = 0; k < 3; k++) {
+                    piece.record.bounds_min[k] = std::min(piece.record.bounds_min[k], v.pos[k]);
+                    piece.record.bounds_max[k] = std::max(piece.record.bounds_max[k], v.pos[k]);
+                }
+                sector.Grow(WorldPoint(piece.record, v.pos));
+            }
+            sector.primitives.push_back(std::move(piece));
+        }
+    }
+    const ecol::Positions& positions = level->collision_positions;
+    const ecol::Indices& indices = level->collision_indices;
+    for (uint32_t t = 0; t < indices.size() / 3; t++) {
+        glm::vec3 c = (positions[indices[t * 3]] + positions[indices[t * 3 + 1]] +
+                       positions[indices[t * 3 + 2]]) / 3.0f;
+        SectorParts& sector = parts[KeyOf(c, origin, size)];
+        sector.collision_tris.push_back(t);
+        for (int k = 0; k < 3; k++) sector.Grow(positions[indices[t * 3 + k]]);
+    }
+
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> render_indices;
+    std::vector<LevelPrimitive> primitives;
+    ecol::Positions sector_positions;
+    ecol::Indices sector_indices;
+    ecol::Bvh bvh;
+    std::vector<LevelSector> sectors;
+    for (auto& [key, sector] : parts) {
+        LevelSector c;
+        std::memset(&c, 0, sizeof(c));
+        for (int k = 0; k < 3; k++) {
+            c.bounds_min[k] = sector.lo[k];
+            c.bounds_max[k] = sector.hi[k];
+        }
+        c.primitive_first = (uint32_t)primitives.size();
+        c.primitive_count = (uint32_t)sector.primitives.size();
+        for (SectorPrimitive& piece : sector.primitives) {
+            piece.record.vertex_first = vertices.size();
+            piece.record.vertex_count = piece.vertices.size();
+            piece.record.index_first = render_indices.size();
+            piece.record.index_count = piece.indices.size();
+            vertices.insert(vertices.end(), piece.vertices.begin(), piece.vertices.end());
+            render_indices.insert(render_indices.end(), piece.indices.begin(), piece.indices.end());
+            primitives.push_back(piece.record);
+        }
+
+        ecol::Positions local_positions;
+        ecol::Indices local_indices;
+        std::vector<int64_t> remap(positions.size(), -1);
+        for (uint32_t t : sector.collision_tris) {
+            for (int k = 0; k < 3; k++) {
+                uint32_t v = indices[t * 3 + k];
+                if (remap[v] < 0) {
+                    remap[v] = (int64_t)local_positions.size();
+                    local_positions.push_back(positions[v]);
+                }
+                local_indices.push_back((uint32_t)remap[v]);
+            }
+        }
+        c.position_first = (uint32_t)sector_positions.size();
+        c.position_count = (uint32_t)local_positions.size();
+        c.index_first = (uint32_t)sector_indices.size();
+        c.index_count = (uint32_t)local_indices.size();
+        c.node_first = (uint32_t)bvh.nodes.size();
+        c.block_first = (uint32_t)bvh.tris.size();
+        c.adj_offset_first = (uint32_t)bvh.adj_offsets.size();
+        c.adj_first = (uint32_t)bvh.adj_list.size();
+        sector_positions.insert(sector_positions.end(), local_positions.begin(), local_positions.end());
+        sector_indices.insert(sector_indices.end(), local_indices.begin(), local_indices.end());
+        if (local_indices.empty()) {
+            bvh.adj_offsets.push_back(0);
+        } else {
+            ecol::Bvh* sub = ecol::build_bvh(&local_positions, &local_indices);
+            c.node_count = (uint32_t)sub->nodes.size();
+            c.block_count = (uint32_t)sub->tris.size();
+            c.adj_count = (uint32_t)sub->adj_list.size();
+            bvh.nodes.insert(bvh.nodes.end(), sub->nodes.begin(), sub->nodes.end());
+            bvh.tris.insert(bvh.tris.end(), sub->tris.begin(), sub->tris.end());
+            bvh.tri_slot.insert(bvh.tri_slot.end(), sub->tri_slot.begin(), sub->tri_slot.end());
+            bvh.adj_offsets.insert(bvh.adj_offsets.end(), sub->adj_offsets.begin(), sub->adj_offsets.end());
+            bvh.adj_list.insert(bvh.adj_list.end(), sub->adj_list.begin(), sub->adj_list.end());
+            ecol::destroy_bvh(sub);
+        }
+        sectors.push_back(c);
+    }
+
+    level->vertices = std::move(vertices);
+    level->indices = std::move(render_indices);
+    level->primitives = std::move(primitives);
+    level->collision_positions = std::move(sector_positions);
+    level->collision_indices = std::move(sector_indices);
+    level->bvh = std::move(bvh);
+    level->sectors = std::move(sectors);
+    return true;
+}
+
+void BuildLods(const LodOptions& options, BakedLevel* level) {
+    std::vector<uint32_t> indices;
+    std::vector<LevelLod> lods;
+    for (LevelPrimitive& p : level->primitives) {
+        std::vector<uint32_t> own(level->indices.begin() + p.index_first,
+                                  level->indices.begin() + p.index_first + p.index_count);
+        p.index_first = indices.size();
+        p.lod_first = (uint32_t)lods.size();
+        p.lod_count = 0;
+        indices.insert(indices.end(), own.begin(), own.end());
+
+        float diagonal = 0.0f;
+        for (int k = 0; k < 3; k++) {
+            float extent = p.bounds_max[k] - p.bounds_min[k];
+            diagonal += extent * extent;
+        }
+        diagonal = std::sqrt(diagonal);
+        const float* positions = level->vertices[p.vertex_first].pos;
+        size_t previous = own.size();
+        float error = 0.0f;
+        for (int k = 0; k < options.levels; k++) {
+            size_t target = (size_t)((float)previous * options.ratio) / 3 * 3;
+            float lod_error = 0.0f;
+            std::vector<uint32_t> lod =
+                emeshopt::simplify(own.data(), own.size(), positions, p.vertex_count, sizeof(Vertex),
+                                   target, options.max_error * diagonal, &lod_error);
+            if (lod.empty() || (float)lod.size() > (float)previous * options.min_gain) break;
+            emeshopt::optimize_vertex_cache(lod.data(), lod.size(), p.vertex_count);
+            error = std::max(error, lod_error);
+
+            LevelLod d;
+            std::memset(&d, 0, sizeof(d));
+            d.index_first = indices.size();
+            d.index_count = (uint32_t)lod.size();
+            d.error = error;
+            indices.insert(indices.end(), lod.begin(), lod.end());
+            lods.push_back(d);
+            p.lod_count++;
+            previous = lod.size();
+        }
+    }
+    level->indices = std::move(indices);
+    level->lods = std::move(lods);
+}
+
+bool WriteLevel(const std::string& path, const BakedLevel& level) {
+    LevelHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, kLevelMagic, sizeof(header.magic));
+    header.version = kLevelVersion;
+    header.source_hash = level.source_hash;
+    header.section_count = kLevelSectionCount;
+
+    std::vector<char> file(sizeof(LevelHeader), 0);
+    AddSection(&file, &header, kLevelCollisionPositions, level.collision_positions);
+    AddSection(&file, &header, kLevelCollisionIndices, level.collision_indices);
+    AddSection(&file, &header, kLevelBvhNodes, level.bvh.nodes);
+    AddSection(&file, &header, kLevelBvhTris, level.bvh.tris);
+    AddSection(&file, &header, kLevelBvhTriSlot, level.bvh.tri_slot);
+    AddSection(&file, &header, kLevelBvhAdjOffsets, level.bvh.adj_offsets);
+    AddSection(&file, &header, kLevelBvhAdjList, level.bvh.adj_list);
+    AddSection(&file, &header, kLevelVertices, level.vertices);
+    AddSection(&file, &header, kLevelIndices, level.indices);
+    AddSection(&file, &header, kLevelPrimitives, level.primitives);
+    AddSection(&file, &header, kLevelPvsGrid, level.pvs_grid);
+    AddSection(&file, &header, kLevelPvsBits, level.pvs_bits);
+    AddSection(&file, &header, kLevelSectors, level.sectors);
+    AddSection(&file, &header, kLevelLods, level.lods);
+    std::memcpy(file.data(), &header, sizeof(header));
+
+    std::ofstream out(path, std::ios::binary);
+    if (!out || !out.write(file.data(), static_cast<std::streamsize>(file.size()))) {
+        std::cerr << "Error: Cannot write " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool ReadLevelHeader(const std::string& path, LevelHeader* header) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in || !in.read(reinterpret_cast<char*>(header), sizeof(*header)) ||
+        std::memcmp(header->magic, kLevelMagic, sizeof(header->magic)) != 0) {
+        std::cerr << "Error: Not a level file: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+}  // namespace levelbake
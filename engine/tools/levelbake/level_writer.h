@@ -0,0 +1,96 @@
+// level_writer.h - Bake a glTF level into a .level file
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "level_bake.h"
+#include "engine/collision_impl.h"
+#include "engine/gltf_unpack_impl.h"
+#include "engine/mesh_optimize_impl.h"
+#include "engine/mesh_simplify_impl.h"
+
+namespace levelbake {
+
+// Everything that goes in a .level, before layout
+struct BakedLevel {
+    uint64_t source_hash = 0;
+    ecol::Positions collision_positions;
+    ecol::Indices collision_indices;
+    // What ecol::clean_mesh dropped from the collision mesh before the BVH
+    ecol::CleanStats collision_clean;
+    ecol::Bvh bvh;
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+    std::vector<LevelPrimitive> primitives;
+    // Render indices' ACMR (emeshopt::acmr) over every primitive, weighted
+    // by triangle count, as unpacked and after OptimizePrimitive
+    float acmr_before = 0.0f;
+    float acmr_after = 0.0f;
+    // Cluster visibility over the collision mesh (BuildPvs); empty without
+    // collision
+    std::vector<LevelPvsGrid> pvs_grid;
+    std::vector<uint8_t> pvs_bits;
+    // Set by SectorizeLevel; empty for a level loaded whole
+    std::vector<LevelSector> sectors;
+    // Set by BuildLods; each primitive's lod_first/lod_count index these
+    std::vector<LevelLod> lods;
+};
+
+struct PvsOptions {
+    float cell_size = 32.0f;    // Starting cluster edge, grown until the grid fits max_clusters
+    int max_clusters = 2048;
+    float headroom = 32.0f;     // Air kept above the collision bounds, for jumps
+    int samples = 16;           // Rays tried between two clusters before calling them hidden
+};
+
+struct LodOptions {
+    int levels = 3;             // Coarser levels per primitive, at most
+    float ratio = 0.5f;         // Each level's triangle target, of the one before
+    float max_error = 0.05f;    // Error allowed, of the primitive's bounds diagonal
+    float min_gain = 0.8f;      // Stop once a level keeps more than this of the one before
+};
+
+// Reorder a primitive's triangles for the vertex cache and overdraw, then
+// its vertices in first-use order (emeshopt). The same triangles, drawn
+// faster.
+void OptimizePrimitive(egltf::PrimitiveBuffers* buffers);
+
+// Grid the collision bounds into clusters and mark each pair visible when
+// they touch or any of options.samples rays between random points in them
+// gets through the mesh. Sampled, so a view through a gap narrower than the
+// rays' spacing can be missed. False when there is no mesh.
+bool BuildPvs(ecol::Positions* positions, ecol::Indices* indices, ecol::Bvh* bvh,
+              const PvsOptions& options, LevelPvsGrid* grid, std::vector<uint8_t>* bits);
+
+// Parse the glTF, unpack and optimize its render primitives and build the
+// collision BVH over its -colonly nodes, as the engine's loaders would, and
+// the PVS over that
+bool BakeLevel(const std::string& gltf_path, BakedLevel* out);
+
+// Cut a baked level along a grid of size x size sectors on x/z for
+// streaming (level_bake.h): each render and collision triangle goes to the
+// sector its centroid is in, primitives are split and grouped by sector,
+// and the collision mesh becomes each sector's own mesh and BVH sub-tree.
+// Collision adjacency stops at sector borders; the PVS, built over the
+// whole mesh, is kept. False if size isn't positive.
+bool SectorizeLevel(float size, BakedLevel* level);
+
+// Give every primitive a chain of up to options.levels coarser LODs over
+// its vertices (emeshopt::simplify, each level from the full mesh, then
+// ordered for the vertex cache), stopping early when a level can't cut
+// enough triangles within the error bound. Rewrites the render indices so
+// each primitive's LODs follow its own. Run after SectorizeLevel, which
+// doesn't carry LODs.
+void BuildLods(const LodOptions& options, BakedLevel* level);
+
+// Write the sections, each aligned to kLevelAlign
+bool WriteLevel(const std::string& path, const BakedLevel& level);
+
+// Read back a level's header (for --list and tests)
+bool ReadLevelHeader(const std::string& path, LevelHeader* header);
+
+}  // namespace levelbake
@@ -0,0 +1,142 @@
+// levelbake - Bake a glTF level into a .level file
+//
+// Usage:
+//   levelbake level.gltf level.level    # Bake render + collision data
+//   levelbake --sector-size 128 level.gltf level.level
+//                                       # ... cut into sectors for streaming
+//   levelbake --lods 3 level.gltf level.level
+//                                       # ... with simplified LOD chains
+//   levelbake --list level.level        # Show a level's sections
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "level_writer.h"
+
+void PrintUsage(const char* program) {
+    std::cout << "Usage: " << program
+              << " [--sector-size <units>] [--lods <n>] <level.gltf> <output.level>\n";
+    std::cout << "       " << program << " --list <level.level>\n\n";
+    std::cout << "Bake a level's unpacked render primitives (reordered for the vertex\n";
+    std::cout << "cache, overdraw and vertex fetch) and its finished collision\n";
+    std::cout << "BVH (over the -colonly nodes), with a potentially visible set of\n";
+    std::cout << "grid clusters over it, into one file the engine memory-maps,\n";
+    std::cout << "so neither the client nor the server parses glTF or builds a BVH.\n";
+    std::cout << "The source's hash is recorded; loaders ignore the bake once it's stale.\n\n";
+    std::cout << "  --sector-size <units>  Cut the level into sectors of this size on x/z,\n";
+    std::cout << "                         which the client streams in around the player\n";
+    std::cout << "  --lods <n>             Give each primitive up to n simplified LODs, which\n";
+    std::cout << "                         the renderer picks by projected error (default 0)\n";
+}
+
+int ListLevel(const std::string& path) {
+    static const char* const NAMES[kLevelSectionCount] = {
+        "collision positions", "collision indices", "bvh nodes", "bvh tris", "bvh tri slots",
+        "bvh adjacency offsets", "bvh adjacency", "vertices", "indices", "primitives",
+        "pvs grid", "pvs bits", "sectors", "lods"};
+    LevelHeader header;
+    if (!levelbake::ReadLevelHeader(path, &header)) {
+        return 1;
+    }
+    std::cout << path << ": version " << header.version << ", source hash " << std::hex
+              << header.source_hash << std::dec << std::endl;
+    for (uint32_t s = 0; s < kLevelSectionCount; s++) {
+        std::cout << "  " << NAMES[s] << "  " << header.sections[s].size << " bytes" << std::endl;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        PrintUsage(argv[0]);
+        return 0;
+    }
+    std::string first = argv[1];
+    if (first == "-h" || first == "--help") {
+        PrintUsage(argv[0]);
+        return 0;
+    }
+    if (first == "--list") {
+        if (argc != 3) {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+        return ListLevel(argv[2]);
+    }
+    float sector_size = 0.0f;
+    levelbake::LodOptions lod_options;
+    lod_options.levels = 0;
+    int arg = 1;
+    while (arg + 1 < argc && (std::string(argv[arg]) == "--sector-size" ||
+                              std::string(argv[arg]) == "--lods")) {
+        std::string option = argv[arg];
+        if (option == "--sector-size") {
+            sector_size = (float)std::atof(argv[arg + 1]);
+            if (!(sector_size > 0.0f)) {
+                std::cerr << "Error: --sector-size must be positive" << std::endl;
+                return 1;
+            }
+        } else {
+            lod_options.levels = std::atoi(argv[arg + 1]);
+            if (lod_options.levels < 0) {
+                std::cerr << "Error: --lods can't be negative" << std::endl;
+                return 1;
+            }
+        }
+        arg += 2;
+    }
+    if (argc != arg + 2) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    std::string gltf_path = argv[arg];
+    std::string output_path = argv[arg + 1];
+
+    levelbake::BakedLevel level;
+    if (!levelbake::BakeLevel(gltf_path, &level)) {
+        return 1;
+    }
+    if (sector_size > 0.0f && !levelbake::SectorizeLevel(sector_size, &level)) {
+        return 1;
+    }
+    size_t full_triangles = level.indices.size() / 3;
+    if (lod_options.levels > 0) {
+        levelbake::BuildLods(lod_options, &level);
+    }
+    if (!levelbake::WriteLevel(output_path, level)) {
+        return 1;
+    }
+
+    std::cout << "Wrote " << output_path << ": " << level.primitives.size() << " primitives, "
+              << level.vertices.size() << " vertices, " << level.collision_indices.size() / 3
+              << " collision triangles" << std::endl;
+    const ecol::CleanStats& clean = level.collision_clean;
+    if (clean.triangles_in != clean.triangles_out || clean.vertices_in != clean.vertices_out) {
+        std::cout << "Collision cleanup: " << clean.triangles_in << " -> " << clean.triangles_out
+                  << " triangles, " << clean.vertices_in << " -> " << clean.vertices_out
+                  << " vertices (" << clean.degenerate << " degenerate, " << clean.duplicate
+                  << " duplicate, " << clean.back_to_back << " back-to-back pairs)" << std::endl;
+    }
+    if (!level.pvs_grid.empty()) {
+        const LevelPvsGrid& g = level.pvs_grid[0];
+        std::cout << "PVS " << g.dims[0] << "x" << g.dims[1] << "x" << g.dims[2] << " clusters of "
+                  << g.cell_size << " units" << std::endl;
+    }
+    if (!level.sectors.empty()) {
+        std::cout << level.sectors.size() << " sectors of " << sector_size << " units" << std::endl;
+    }
+    if (!level.lods.empty()) {
+        size_t coarsest = 0;
+        for (const LevelPrimitive& p : level.primitives) {
+            coarsest += p.lod_count > 0 ? level.lods[p.lod_first + p.lod_count - 1].index_count
+                                        : p.index_count;
+        }
+        std::cout << level.lods.size() << " LODs; " << full_triangles << " triangles at full detail, "
+                  << coarsest / 3 << " at the coarsest" << std::endl;
+    }
+    std::cout << "Render ACMR " << level.acmr_before << " -> " << level.acmr_after
+              << " (vertex cache, overdraw and fetch order optimized)" << std::endl;
+    return 0;
+}
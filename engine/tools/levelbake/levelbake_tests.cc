@@ -0,0 +1,486 @@
+// Unit tests for levelbake
+// Tests baking, section layout, mesh optimization and the engine loader's
+// validation and stale check
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "level_writer.h"
+#include "engine/level_impl.h"
+
+// Test helpers
+bool float_eq(float a, float b, float epsilon = 0.001f) {
+    return std::abs(a - b) < epsilon;
+}
+
+std::vector<char> read_file(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::vector<char>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+void write_file(const std::string& path, const void* data, size_t size) {
+    std::ofstream file(path, std::ios::binary);
+    file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+}
+
+// A unit quad drawn by "floor" (textured, raised by 1) and collided with
+// through "floor-colonly", saved as a .gltf with a separate .bin
+std::string write_test_level() {
+    const float positions[] = {0, 0, 0, 1, 0, 0, 1, 0, 1, 0, 0, 1};
+    const uint32_t indices[] = {0, 1, 2, 0, 2, 3};
+    std::vector<char> bin(sizeof(positions) + sizeof(indices));
+    std::memcpy(bin.data(), positions, sizeof(positions));
+    std::memcpy(bin.data() + sizeof(positions), indices, sizeof(indices));
+    write_file("/tmp/levelbake_test.bin", bin.data(), bin.size());
+
+    const char* gltf = R"({
+  "asset": {"version": "2.0"},
+  "scene": 0,
+  "scenes": [{"nodes": [0, 1]}],
+  "nodes": [
+    {"name": "floor", "mesh": 0, "translation": [0, 1, 0]},
+    {"name": "floor-colonly", "mesh": 0}
+  ],
+  "meshes": [{"primitives": [{"attributes": {"POSITION": 0}, "indices": 1, "material": 0}]}],
+  "materials": [{"pbrMetallicRoughness": {"baseColorTexture": {"index": 0}}}],
+  "textures": [{"source": 0, "sampler": 0}],
+  "images": [{"uri": "floor.png"}],
+  "samplers": [{"magFilter": 9729, "minFilter": 9987, "wrapS": 10497, "wrapT": 33071}],
+  "buffers": [{"uri": "levelbake_test.bin", "byteLength": 72}],
+  "bufferViews": [
+    {"buffer": 0, "byteOffset": 0, "byteLength": 48},
+    {"buffer": 0, "byteOffset": 48, "byteLength": 24}
+  ],
+  "accessors": [
+    {"bufferView": 0, "componentType": 5126, "count": 4, "type": "VEC3",
+     "min": [0, 0, 0], "max": [1, 0, 1]},
+    {"bufferView": 1, "componentType": 5125, "count": 6, "type": "SCALAR"}
+  ]
+})";
+    std::string path = "/tmp/levelbake_test.gltf";
+    write_file(path, gltf, std::strlen(gltf));
+    return path;
+}
+
+// Bake the test level to path
+void bake_test_level(const std::string& path) {
+    levelbake::BakedLevel level;
+    assert(levelbake::BakeLevel(write_test_level(), &level));
+    assert(levelbake::WriteLevel(path, level));
+}
+
+// ============================================================================
+// Tests
+// ============================================================================
+
+void test_bake_splits_render_and_collision() {
+    printf("Test: Render nodes and -colonly nodes go to their own sections... ");
+
+    levelbake::BakedLevel level;
+    assert(levelbake::BakeLevel(write_test_level(), &level));
+    assert(level.source_hash != 0);
+    assert(level.primitives.size() == 1);
+    assert(level.vertices.size() == 4);
+    assert(level.indices.size() == 6);
+    assert(level.collision_indices.size() == 6);
+    assert(!level.bvh.nodes.empty());
+
+    const LevelPrimitive& p = level.primitives[0];
+    assert(p.has_translation == 1 && float_eq(p.translation[1], 1.0f));
+    assert(p.has_scale == 0);
+    assert(p.has_texture == 1 && std::string(p.texture_uri) == "floor.png");
+    assert(p.min_filter == 9987 && p.wrap_t == 33071);
+    assert(float_eq(p.bounds_max[0], 1.0f) && float_eq(p.bounds_max[2], 1.0f));
+
+    printf("PASSED\n");
+}
+
+void test_layout_round_trip() {
+    printf("Test: Header round-trips with aligned sections... ");
+
+    std::string path = "/tmp/levelbake_layout.level";
+    bake_test_level(path);
+    LevelHeader header;
+    assert(levelbake::ReadLevelHeader(path, &header));
+    assert(header.version == kLevelVersion);
+    assert(header.section_count == kLevelSectionCount);
+    size_t file_size = read_file(path).size();
+    for (uint32_t s = 0; s < kLevelSectionCount; s++) {
+        assert(header.sections[s].offset % kLevelAlign == 0);
+        assert(header.sections[s].offset + header.sections[s].size <= file_size);
+    }
+    assert(header.sections[kLevelPrimitives].size == sizeof(LevelPrimitive));
+
+    printf("PASSED\n");
+}
+
+void test_loader_reads_bake() {
+    printf("Test: open_level returns the baked BVH and primitive buffers... ");
+
+    std::string path = "/tmp/levelbake_load.level";
+    bake_test_level(path);
+    elevel::Level* l = elevel::open_level(path.c_str(), "/tmp/levelbake_test.gltf");
+    assert(l);
+
+    ecol::Positions positions;
+    ecol::Indices indices;
+    ecol::Bvh* bvh = elevel::level_collision(l, &positions, &indices);
+    assert(bvh);
+    assert(indices.size() == 6 && bvh->tri_slot.size() == 2);
+    ecol::destroy_bvh(bvh);
+
+    assert(elevel::level_primitive_count(l) == 1);
+    egltf::PrimitiveBuffers* b = elevel::level_primitive_buffers(l, 0);
+    assert(b->vertices.size() == 4 && b->indices.size() == 6);
+    assert(float_eq(b->vertices[2].pos[2], 1.0f));
+    egltf::free_primitive_buffers(b);
+
+    epvs::Pvs* pvs = elevel::level_pvs(l);
+    assert(pvs && epvs::cluster_count(pvs) == 1);
+    assert(epvs::pvs_cluster(pvs, 0.5f, 0.0f, 0.5f) == 0);
+    assert(epvs::pvs_cluster(pvs, 0.5f, -1.0f, 0.5f) == -1);
+    epvs::destroy_pvs(pvs);
+    elevel::close_level(l);
+
+    printf("PASSED\n");
+}
+
+void test_reject_corrupt_level() {
+    printf("Test: Out-of-range sections and indices are rejected... ");
+
+    std::string path = "/tmp/levelbake_corrupt.level";
+    bake_test_level(path);
+    std::vector<char> bytes = read_file(path);
+
+    LevelHeader header;
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    std::vector<char> truncated = bytes;
+    LevelHeader bad = header;
+    bad.sections[kLevelVertices].size += 1u << 20;
+    std::memcpy(truncated.data(), &bad, sizeof(bad));
+    write_file(path, truncated.data(), truncated.size());
+    assert(!elevel::open_level(path.c_str(), nullptr));
+
+    std::vector<char> bad_index = bytes;
+    uint32_t out_of_range = 1000;
+    std::memcpy(bad_index.data() + header.sections[kLevelIndices].offset, &out_of_range, 4);
+    write_file(path, bad_index.data(), bad_index.size());
+    assert(!elevel::open_level(path.c_str(), nullptr));
+
+    printf("PASSED\n");
+}
+
+void test_reject_stale_level() {
+    printf("Test: A bake of an older source is rejected... ");
+
+    std::string path = "/tmp/levelbake_stale.level";
+    bake_test_level(path);
+    std::vector<char> bin = read_file("/tmp/levelbake_test.bin");
+    bin[0] ^= 1;
+    write_file("/tmp/levelbake_test.bin", bin.data(), bin.size());
+    assert(!elevel::open_level(path.c_str(), "/tmp/levelbake_test.gltf"));
+
+    // Without the source to compare against the bake is still used
+    elevel::Level* l = elevel::open_level(path.c_str(), "/tmp/levelbake_missing.gltf");
+    assert(l);
+    elevel::close_level(l);
+
+    printf("PASSED\n");
+}
+
+void test_optimize_keeps_triangles() {
+    printf("Test: OptimizePrimitive reorders for the cache but keeps every triangle... ");
+
+    // A 16x16 grid with its triangles shuffled
+    const int n = 16;
+    egltf::PrimitiveBuffers buffers;
+    for (int z = 0; z <= n; z++) {
+        for (int x = 0; x <= n; x++) {
+            buffers.vertices.emplace_back((float)x, 0.0f, (float)z, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f);
+        }
+    }
+    for (int z = 0; z < n; z++) {
+        for (int x = 0; x < n; x++) {
+            unsigned int a = z * (n + 1) + x, b = a + 1, c = a + n + 1, d = c + 1;
+            buffers.indices.insert(buffers.indices.end(), {a, c, b, b, c, d});
+        }
+    }
+    size_t triangles = buffers.indices.size() / 3;
+    for (size_t i = triangles - 1; i > 0; i--) {
+        size_t j = (i * 7919) % (i + 1);
+        for (int k = 0; k < 3; k++) std::swap(buffers.indices[i * 3 + k], buffers.indices[j * 3 + k]);
+    }
+    auto corners = [](const egltf::PrimitiveBuffers& b) {
+        std::vector<std::vector<float>> out;
+        for (size_t t = 0; t < b.indices.size() / 3; t++) {
+            std::vector<float> tri;
+            for (int k = 0; k < 3; k++) {
+                const float* p = b.vertices[b.indices[t * 3 + k]].pos;
+                tri.insert(tri.end(), p, p + 3);
+            }
+            out.push_back(tri);
+        }
+        std::sort(out.begin(), out.end());
+        return out;
+    };
+    std::vector<std::vector<float>> before = corners(buffers);
+    size_t vertex_count = buffers.vertices.size();
+    float acmr_before = emeshopt::acmr(buffers.indices.data(), buffers.indices.size(), vertex_count);
+
+    levelbake::OptimizePrimitive(&buffers);
+    float acmr_after = emeshopt::acmr(buffers.indices.data(), buffers.indices.size(), vertex_count);
+    assert(buffers.vertices.size() == vertex_count);
+    assert(corners(buffers) == before);
+    assert(acmr_after < acmr_before * 0.5f);
+    // Vertices are numbered in first-use order
+    assert(buffers.indices[0] == 0);
+
+    printf("PASSED\n");
+}
+
+void test_clean_collision_mesh() {
+    printf("Test: Collision cleanup welds seams and drops degenerate, repeated and inner faces... ");
+
+    ecol::Positions positions;
+    ecol::Indices indices;
+    auto quad = [&](glm::vec3 a, glm::vec3 b, glm::vec3 c, glm::vec3 d) {
+        unsigned int s = (unsigned int)positions.size();
+        positions.insert(positions.end(), {a, b, c, d});
+        indices.insert(indices.end(), {s, s + 1, s + 2, s, s + 2, s + 3});
+    };
+    // Two floor quads sharing an edge, each with its own vertices
+    quad({0, 0, 0}, {0, 0, 1}, {1, 0, 1}, {1, 0, 0});
+    quad({1, 0, 0}, {1, 0, 1}, {2, 0, 1}, {2, 0, 0});
+    // The first one again
+    quad({0, 0, 0}, {0, 0, 1}, {1, 0, 1}, {1, 0, 0});
+    // Two boxes' faces pressed together at x = 5, wound opposite
+    quad({5, 0, 0}, {5, 1, 0}, {5, 1, 1}, {5, 0, 1});
+    quad({5, 0, 0}, {5, 0, 1}, {5, 1, 1}, {5, 1, 0});
+    // A sliver
+    unsigned int s = (unsigned int)positions.size();
+    positions.insert(positions.end(), {{3, 0, 0}, {3.0001f, 0, 0}, {4, 0, 0}});
+    indices.insert(indices.end(), {s, s + 1, s + 2});
+
+    ecol::CleanStats stats;
+    ecol::clean_mesh(&positions, &indices, 0.001f, true, &stats);
+    assert(stats.triangles_in == 11 && stats.triangles_out == 4);
+    assert(stats.degenerate == 1 && stats.duplicate == 2 && stats.back_to_back == 2);
+    assert(positions.size() == 6 && stats.vertices_out == 6);
+    assert(indices.size() == 12);
+
+    // Still a floor, and nothing at the wall
+    ecol::Bvh* bvh = ecol::build_bvh(&positions, &indices);
+    assert(float_eq(ecol::raycast_ground(&positions, &indices, bvh, 1.5f, 1.0f, 0.5f), 0.0f));
+    assert(ecol::raycast_horizontal(&positions, &indices, bvh, 4.0f, 0.5f, 0.5f,
+                                    1.0f, 0.0f, 0.0f, 5.0f) < 0.0f);
+    ecol::destroy_bvh(bvh);
+
+    printf("PASSED\n");
+}
+
+void test_pvs_wall_hides_far_side() {
+    printf("Test: A wall splits the PVS but neighbouring clusters stay visible... ");
+
+    // A 96x96 floor with a wall along x = 48 as tall as the grid
+    ecol::Positions positions;
+    ecol::Indices indices;
+    const float quads[2][4][3] = {
+        {{0, 0, 0}, {96, 0, 0}, {96, 0, 96}, {0, 0, 96}},
+        {{48, 0, 0}, {48, 48, 0}, {48, 48, 96}, {48, 0, 96}}};
+    for (const auto& quad : quads) {
+        uint32_t first = (uint32_t)positions.size();
+        for (const auto& v : quad) positions.emplace_back(v[0], v[1], v[2]);
+        for (uint32_t i : {0u, 1u, 2u, 0u, 2u, 3u}) indices.push_back(first + i);
+    }
+    ecol::Bvh* bvh = ecol::build_bvh(&positions, &indices);
+    levelbake::PvsOptions options;
+    options.cell_size = 16.0f;
+    options.headroom = 0.0f;
+    epvs::Pvs pvs;
+    assert(levelbake::BuildPvs(&positions, &indices, bvh, options, &pvs.grid, &pvs.bits));
+    ecol::destroy_bvh(bvh);
+    assert(pvs.grid.dims[0] == 6 && pvs.grid.dims[1] == 3 && pvs.grid.dims[2] == 6);
+
+    // Same side, across the room: visible. Far side: hidden, both ways.
+    assert(epvs::pvs_point_visible(&pvs, 8, 8, 8, 40, 40, 88));
+    assert(!epvs::pvs_point_visible(&pvs, 8, 8, 8, 88, 8, 8));
+    assert(!epvs::pvs_point_visible(&pvs, 88, 8, 8, 8, 8, 8));
+    // Clusters touching across the wall are kept, conservatively
+    assert(epvs::pvs_point_visible(&pvs, 40, 8, 8, 56, 8, 8));
+    // Outside the grid is never culled
+    assert(epvs::pvs_point_visible(&pvs, 8, 8, 8, 200, 8, 8));
+
+    int from = epvs::pvs_cluster(&pvs, 8, 8, 8);
+    assert(!epvs::pvs_box_visible(&pvs, from, glm::vec3(80, 0, 0), glm::vec3(90, 10, 10)));
+    assert(epvs::pvs_box_visible(&pvs, from, glm::vec3(30, 0, 0), glm::vec3(90, 10, 10)));
+
+    printf("PASSED\n");
+}
+
+void test_sectorized_level() {
+    printf("Test: A sectorized level splits by triangle and loads per sector or whole... ");
+
+    // Half-unit sectors put the quad's two triangles in different ones
+    levelbake::BakedLevel level;
+    assert(levelbake::BakeLevel(write_test_level(), &level));
+    assert(!levelbake::SectorizeLevel(0.0f, &level));
+    assert(levelbake::SectorizeLevel(0.5f, &level));
+    assert(level.sectors.size() == 2);
+    assert(level.primitives.size() == 2 && level.indices.size() == 6);
+    assert(level.vertices.size() == 6);
+    std::string path = "/tmp/levelbake_sectors.level";
+    assert(levelbake::WriteLevel(path, level));
+
+    elevel::Level* l = elevel::open_level(path.c_str(), "/tmp/levelbake_test.gltf");
+    assert(l);
+    assert(elevel::level_sector_count(l) == 2);
+    for (int i = 0; i < 2; i++) {
+        const LevelSector* c = elevel::level_sector(l, i);
+        assert(c->primitive_count == 1 && c->index_count == 3);
+        // Render bounds are in the world, raised with the floor node
+        assert(float_eq(c->bounds_max[1], 1.0f));
+
+        ecol::Positions positions;
+        ecol::Indices indices;
+        ecol::Bvh* bvh = elevel::sector_collision(l, i, &positions, &indices);
+        assert(bvh && positions.size() == 3 && bvh->tri_slot.size() == 1);
+        ecol::destroy_bvh(bvh);
+    }
+
+    // Whole, the sectors' sub-trees answer as one mesh
+    ecol::Positions positions;
+    ecol::Indices indices;
+    ecol::Bvh* bvh = elevel::level_collision(l, &positions, &indices);
+    assert(bvh);
+    assert(float_eq(ecol::raycast_ground(&positions, &indices, bvh, 0.8f, 0.0f, 0.2f), 0.0f));
+    assert(float_eq(ecol::raycast_ground(&positions, &indices, bvh, 0.2f, 0.0f, 0.8f), 0.0f));
+    assert(ecol::raycast_ground(&positions, &indices, bvh, 2.0f, 0.0f, 2.0f) < -1000.0f);
+    ecol::destroy_bvh(bvh);
+    elevel::close_level(l);
+
+    printf("PASSED\n");
+}
+
+// An n x n grid of quads on x/z with heights from height(x, z)
+template <typename F>
+egltf::PrimitiveBuffers make_grid(int n, F height) {
+    egltf::PrimitiveBuffers buffers;
+    for (int z = 0; z <= n; z++) {
+        for (int x = 0; x <= n; x++) {
+            buffers.vertices.emplace_back((float)x, height(x, z), (float)z, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f);
+        }
+    }
+    for (int z = 0; z < n; z++) {
+        for (int x = 0; x < n; x++) {
+            unsigned int a = z * (n + 1) + x, b = a + 1, c = a + n + 1, d = c + 1;
+            buffers.indices.insert(buffers.indices.end(), {a, c, b, b, c, d});
+        }
+    }
+    return buffers;
+}
+
+void test_simplify_keeps_border() {
+    printf("Test: simplify collapses a flat grid down to its locked border... ");
+
+    const int n = 16;
+    egltf::PrimitiveBuffers grid = make_grid(n, [](int, int) { return 0.0f; });
+    float error = -1.0f;
+    std::vector<uint32_t> lod =
+        emeshopt::simplify(grid.indices.data(), grid.indices.size(), grid.vertices[0].pos,
+                           grid.vertices.size(), sizeof(Vertex), 0, 0.001f, &error);
+    assert(error >= 0.0f && error < 0.001f);
+    assert(lod.size() * 4 < grid.indices.size());
+    std::vector<bool> used(grid.vertices.size(), false);
+    for (uint32_t v : lod) used[v] = true;
+    for (int i = 0; i <= n; i++) {
+        assert(used[i] && used[n * (n + 1) + i]);           // Front and back rows
+        assert(used[i * (n + 1)] && used[i * (n + 1) + n]); // Left and right columns
+    }
+
+    // Scattered heights leave nothing to collapse within a tight bound
+    egltf::PrimitiveBuffers bumps =
+        make_grid(n, [](int x, int z) { return (float)(((x * 73856093) ^ (z * 19349663)) % 7); });
+    lod = emeshopt::simplify(bumps.indices.data(), bumps.indices.size(), bumps.vertices[0].pos,
+                             bumps.vertices.size(), sizeof(Vertex), 0, 0.01f, &error);
+    assert(lod.size() == bumps.indices.size() && error == 0.0f);
+
+    printf("PASSED\n");
+}
+
+void test_build_lods_chain() {
+    printf("Test: BuildLods appends coarser levels with growing error after each primitive... ");
+
+    levelbake::BakedLevel level;
+    for (int k = 0; k < 2; k++) {
+        egltf::PrimitiveBuffers grid =
+            make_grid(32, [](int x, int z) { return std::sin(x * 0.2f) * std::cos(z * 0.2f); });
+        LevelPrimitive p;
+        std::memset(&p, 0, sizeof(p));
+        p.vertex_first = level.vertices.size();
+        p.vertex_count = grid.vertices.size();
+        p.index_first = level.indices.size();
+        p.index_count = grid.indices.size();
+        p.bounds_max[0] = p.bounds_max[2] = 32.0f;
+        level.vertices.insert(level.vertices.end(), grid.vertices.begin(), grid.vertices.end());
+        level.indices.insert(level.indices.end(), grid.indices.begin(), grid.indices.end());
+        level.primitives.push_back(p);
+    }
+    std::vector<uint32_t> full(level.indices.begin(), level.indices.begin() + level.primitives[0].index_count);
+    levelbake::LodOptions options;
+    levelbake::BuildLods(options, &level);
+
+    assert(level.lods.size() >= 4);
+    for (const LevelPrimitive& p : level.primitives) {
+        assert(p.lod_count >= 2 && p.lod_count <= (uint32_t)options.levels);
+        uint64_t next = p.index_first + p.index_count;
+        float error = 0.0f;
+        uint32_t previous = (uint32_t)p.index_count;
+        for (uint32_t k = 0; k < p.lod_count; k++) {
+            const LevelLod& d = level.lods[p.lod_first + k];
+            assert(d.index_first == next && d.index_count < previous && d.index_count % 3 == 0);
+            assert(d.error >= error);
+            for (uint32_t i = 0; i < d.index_count; i++) {
+                assert(level.indices[d.index_first + i] < p.vertex_count);
+            }
+            next += d.index_count;
+            error = d.error;
+            previous = d.index_count;
+        }
+    }
+    // The full-detail indices are kept as they were
+    assert(std::equal(full.begin(), full.end(), level.indices.begin() + level.primitives[0].index_first));
+
+    printf("PASSED\n");
+}
+
+// ============================================================================
+// Main
+// ============================================================================
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+
+    printf("=== levelbake Unit Tests ===\n\n");
+
+    test_bake_splits_render_and_collision();
+    test_layout_round_trip();
+    test_loader_reads_bake();
+    test_reject_corrupt_level();
+    test_reject_stale_level();
+    test_optimize_keeps_triangles();
+    test_clean_collision_mesh();
+    test_pvs_wall_hides_far_side();
+    test_sectorized_level();
+    test_simplify_keeps_border();
+    test_build_lods_chain();
+
+    printf("\n=== All Tests Complete ===\n");
+    return 0;
+}
@@ -1,10 +1,15 @@
 // ozz-retarget - Retarget animations between different skeleton formats
 // Converts animations between different skeleton formats
 
+#include <algorithm>
+#include <atomic>
 #include <cstring>
 #include <fstream>
 #include <iostream>
+#include <mutex>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "ozz/animation/offline/animation_builder.h"
@@ -16,6 +21,7 @@
 #include "ozz/base/maths/soa_transform.h"
 
 #include "bone_mapper.h"
+#include "json.hpp"
 
 namespace {
 
@@ -234,25 +240,18 @@ bool ShouldDebugBone(const char* name) {
            strcmp(name, "mixamorig:LeftHand") == 0;
 }
 
-// Compute world-space rotation by walking up the hierarchy
-ozz::math::Quaternion ComputeWorldRotation(
-    const std::vector<ozz::math::SoaTransform>& locals,
-    const ozz::animation::Skeleton& skeleton,
-    int joint_idx) {
-
-    ozz::math::Quaternion world = ozz::math::Quaternion::identity();
-
-    // Walk up the hierarchy
-    int current = joint_idx;
-    while (current >= 0) {
-        int soa_idx = current / 4;
-        int lane = current % 4;
-        ozz::math::Quaternion local = ExtractRotation(locals[soa_idx], lane);
-        world = QuatMul(local, world);  // parent * child
-        current = skeleton.joint_parents()[current];
+// Compute world-space rotations for every joint in one pass. ozz stores
+// joints parents first, so each parent's world rotation is final before
+// its children read it: one multiply per joint rather than a walk up the
+// chain for each.
+void ComputeWorldRotations(const ozz::animation::Skeleton& skeleton,
+                           const std::vector<ozz::math::Quaternion>& locals,
+                           std::vector<ozz::math::Quaternion>* worlds) {
+    const auto& parents = skeleton.joint_parents();
+    for (int i = 0; i < skeleton.num_joints(); ++i) {
+        int parent = parents[i];
+        (*worlds)[i] = parent < 0 ? locals[i] : QuatMul((*worlds)[parent], locals[i]);
     }
-
-    return world;
 }
 
 // Given a world rotation and parent world rotation, compute local rotation
@@ -263,100 +262,121 @@ ozz::math::Quaternion WorldToLocal(
     return QuatMul(QuatInverse(parent_world), world);
 }
 
-void PrintUsage(const char* program) {
-    std::cout << "Usage: " << program << " [options]\n"
-              << "\n"
-              << "Options:\n"
-              << "  --source-anim=FILE      Source animation file (.ozz)\n"
-              << "  --source-skeleton=FILE  Source skeleton file (.ozz)\n"
-              << "  --target-skeleton=FILE  Target skeleton file (.ozz)\n"
-              << "  --config=FILE           Bone mapping config file (.json)\n"
-              << "  --output=FILE           Output animation file (.ozz)\n"
-              << "  --sample-rate=N         Samples per second (default: 30)\n"
-              << "  --debug                 Print debug info for key bones\n"
-              << "  --help                  Show this help message\n";
+// Unpack every joint's local transform from SoA, storing each component
+// once per four joints rather than once per joint and lane
+void UnpackTransforms(const ozz::math::SoaTransform* soa, int num_joints,
+                      std::vector<ozz::math::Quaternion>* rotations,
+                      std::vector<ozz::math::Float3>* translations,
+                      std::vector<ozz::math::Float3>* scales) {
+    float tx[4], ty[4], tz[4];
+    float rx[4], ry[4], rz[4], rw[4];
+    float sx[4], sy[4], sz[4];
+    const int num_soa = (num_joints + 3) / 4;
+    for (int i = 0; i < num_soa; ++i) {
+        ozz::math::StorePtrU(soa[i].rotation.x, rx);
+        ozz::math::StorePtrU(soa[i].rotation.y, ry);
+        ozz::math::StorePtrU(soa[i].rotation.z, rz);
+        ozz::math::StorePtrU(soa[i].rotation.w, rw);
+        ozz::math::StorePtrU(soa[i].translation.x, tx);
+        ozz::math::StorePtrU(soa[i].translation.y, ty);
+        ozz::math::StorePtrU(soa[i].translation.z, tz);
+        if (scales) {
+            ozz::math::StorePtrU(soa[i].scale.x, sx);
+            ozz::math::StorePtrU(soa[i].scale.y, sy);
+            ozz::math::StorePtrU(soa[i].scale.z, sz);
+        }
+        const int lanes = std::min(4, num_joints - i * 4);
+        for (int lane = 0; lane < lanes; ++lane) {
+            const int joint = i * 4 + lane;
+            (*rotations)[joint] = ozz::math::Quaternion(rx[lane], ry[lane], rz[lane], rw[lane]);
+            (*translations)[joint] = ozz::math::Float3(tx[lane], ty[lane], tz[lane]);
+            if (scales) {
+                (*scales)[joint] = ozz::math::Float3(sx[lane], sy[lane], sz[lane]);
+            }
+        }
+    }
 }
 
-}  // namespace
-
-int main(int argc, char* argv[]) {
-    std::string source_anim_path;
-    std::string source_skeleton_path;
-    std::string target_skeleton_path;
-    std::string config_path;
-    std::string output_path;
-    float sample_rate = 30.0f;
-    bool debug_mode = false;
-
-    // Parse command line arguments
-    for (int i = 1; i < argc; ++i) {
-        std::string arg = argv[i];
+// Pre-computed mapping info for each target bone
+struct BoneMappingInfo {
+    bool is_mapped = false;
+    std::vector<int> source_indices;
+    bool combine_rotations = false;
+    ozz::math::Quaternion correction = ozz::math::Quaternion::identity();
+    bool has_correction = false;
+};
+
+// Everything a clip needs that doesn't depend on the clip. Built once and
+// only read afterwards, so manifest clips share it across threads.
+struct Retargeter {
+    const ozz::animation::Skeleton* source_skeleton = nullptr;
+    const ozz::animation::Skeleton* target_skeleton = nullptr;
+    std::vector<BoneMappingInfo> mapping_infos;
+    std::vector<ozz::math::Quaternion> target_rest_rotations;
+    std::vector<ozz::math::Float3> target_rest_translations;
+    std::vector<ozz::math::Float3> target_rest_scales;
+    bool debug = false;
+};
+
+void BuildRetargeter(const ozz::animation::Skeleton& source_skeleton,
+                     const ozz::animation::Skeleton& target_skeleton,
+                     const retarget::BoneMapper& mapper,
+                     bool debug,
+                     Retargeter* retargeter) {
+    retargeter->source_skeleton = &source_skeleton;
+    retargeter->target_skeleton = &target_skeleton;
+    retargeter->debug = debug;
+
+    const int num_target = target_skeleton.num_joints();
+    retargeter->mapping_infos.assign(num_target, BoneMappingInfo());
+    for (int target_idx = 0; target_idx < num_target; ++target_idx) {
+        const char* target_name = target_skeleton.joint_names()[target_idx];
+        auto mapping_opt = mapper.GetMapping(target_name);
 
-        if (arg == "--help") {
-            PrintUsage(argv[0]);
-            return 0;
-        } else if (arg.rfind("--source-anim=", 0) == 0) {
-            source_anim_path = arg.substr(14);
-        } else if (arg.rfind("--source-skeleton=", 0) == 0) {
-            source_skeleton_path = arg.substr(18);
-        } else if (arg.rfind("--target-skeleton=", 0) == 0) {
-            target_skeleton_path = arg.substr(18);
-        } else if (arg.rfind("--config=", 0) == 0) {
-            config_path = arg.substr(9);
-        } else if (arg.rfind("--output=", 0) == 0) {
-            output_path = arg.substr(9);
-        } else if (arg.rfind("--sample-rate=", 0) == 0) {
-            sample_rate = std::stof(arg.substr(14));
-        } else if (arg == "--debug") {
-            debug_mode = true;
-        } else {
-            std::cerr << "Unknown option: " << arg << std::endl;
-            PrintUsage(argv[0]);
-            return 1;
+        if (mapping_opt && !mapping_opt->is_unmapped()) {
+            BoneMappingInfo& info = retargeter->mapping_infos[target_idx];
+            info.is_mapped = true;
+            info.combine_rotations = mapping_opt->is_combined();
+            info.correction = mapping_opt->correction;
+            info.has_correction = mapping_opt->has_correction;
+            for (const auto& src_name : mapping_opt->source_bones) {
+                int idx = mapper.GetSourceBoneIndex(src_name);
+                if (idx >= 0) {
+                    info.source_indices.push_back(idx);
+                }
+            }
         }
     }
 
-    // Validate required arguments
-    if (source_anim_path.empty() || source_skeleton_path.empty() ||
-        target_skeleton_path.empty() || config_path.empty() || output_path.empty()) {
-        std::cerr << "Missing required arguments.\n";
-        PrintUsage(argv[0]);
-        return 1;
-    }
-
-    // Load source skeleton
-    ozz::animation::Skeleton source_skeleton;
-    if (!LoadSkeleton(source_skeleton_path, &source_skeleton)) {
-        return 1;
-    }
-    std::cout << "Loaded source skeleton: " << source_skeleton.num_joints() << " joints" << std::endl;
+    // Unmapped bones keep the target rest pose every frame
+    retargeter->target_rest_rotations.resize(num_target);
+    retargeter->target_rest_translations.resize(num_target);
+    retargeter->target_rest_scales.resize(num_target);
+    UnpackTransforms(target_skeleton.joint_rest_poses().data(), num_target,
+                     &retargeter->target_rest_rotations,
+                     &retargeter->target_rest_translations,
+                     &retargeter->target_rest_scales);
+}
 
-    // Load target skeleton
-    ozz::animation::Skeleton target_skeleton;
-    if (!LoadSkeleton(target_skeleton_path, &target_skeleton)) {
-        return 1;
-    }
-    std::cout << "Loaded target skeleton: " << target_skeleton.num_joints() << " joints" << std::endl;
+// Retarget one clip onto the target skeleton and save it. Progress goes to
+// log, so parallel clips can each report in one piece.
+bool RetargetClip(const Retargeter& retargeter,
+                  const std::string& source_anim_path,
+                  const std::string& output_path,
+                  float sample_rate,
+                  std::ostream& log) {
+    const ozz::animation::Skeleton& source_skeleton = *retargeter.source_skeleton;
+    const ozz::animation::Skeleton& target_skeleton = *retargeter.target_skeleton;
+    const bool debug_mode = retargeter.debug;
 
     // Load source animation
     ozz::animation::Animation source_animation;
     if (!LoadAnimation(source_anim_path, &source_animation)) {
-        return 1;
-    }
-    std::cout << "Loaded source animation: " << source_animation.duration() << "s, "
-              << source_animation.num_tracks() << " tracks" << std::endl;
-
-    // Load bone mapping config
-    retarget::BoneMapper mapper;
-    if (!mapper.LoadConfig(config_path)) {
-        return 1;
+        return false;
     }
-
-    // Build bone name maps
-    auto source_names = GetBoneNames(source_skeleton);
-    auto target_names = GetBoneNames(target_skeleton);
-    mapper.BuildSourceBoneMap(source_names);
-    mapper.BuildTargetBoneMap(target_names);
+    log << "Loaded source animation: " << source_anim_path << ", "
+        << source_animation.duration() << "s, "
+        << source_animation.num_tracks() << " tracks" << std::endl;
 
     // Create sampling context and buffer for source animation
     ozz::animation::SamplingJob::Context context;
@@ -368,65 +388,22 @@ int main(int argc, char* argv[]) {
     int num_keyframes = static_cast<int>(duration * sample_rate) + 1;
     float time_step = duration / std::max(1, num_keyframes - 1);
 
-    std::cout << "Retargeting with " << num_keyframes << " keyframes..." << std::endl;
-
-    // Debug: Print skeleton rest poses
-    if (debug_mode) {
-        std::cout << "\n=== SOURCE SKELETON REST POSES ===" << std::endl;
-        for (int i = 0; i < source_skeleton.num_joints(); ++i) {
-            const char* name = source_skeleton.joint_names()[i];
-            int parent = source_skeleton.joint_parents()[i];
-            ozz::math::Quaternion rest = GetRestPoseRotation(source_skeleton, i);
-            std::cout << "  [" << i << "] " << name << " (parent=" << parent << "): ";
-            std::cout << "quat(" << rest.x << ", " << rest.y << ", " << rest.z << ", " << rest.w << ")" << std::endl;
-        }
-
-        std::cout << "\n=== TARGET SKELETON REST POSES ===" << std::endl;
-        for (int i = 0; i < target_skeleton.num_joints(); ++i) {
-            const char* name = target_skeleton.joint_names()[i];
-            int parent = target_skeleton.joint_parents()[i];
-            ozz::math::Quaternion rest = GetRestPoseRotation(target_skeleton, i);
-            std::cout << "  [" << i << "] " << name << " (parent=" << parent << "): ";
-            std::cout << "quat(" << rest.x << ", " << rest.y << ", " << rest.z << ", " << rest.w << ")" << std::endl;
-        }
-        std::cout << std::endl;
-    }
+    log << "Retargeting with " << num_keyframes << " keyframes..." << std::endl;
 
     // Build raw animation for target skeleton
     ozz::animation::offline::RawAnimation raw_animation;
     raw_animation.duration = duration;
     raw_animation.name = "retargeted";
     raw_animation.tracks.resize(target_skeleton.num_joints());
-
-    // Pre-compute mapping info for each target bone
-    struct BoneMappingInfo {
-        bool is_mapped = false;
-        std::vector<int> source_indices;
-        bool combine_rotations = false;
-        ozz::math::Quaternion correction = ozz::math::Quaternion::identity();
-        bool has_correction = false;
-    };
-    std::vector<BoneMappingInfo> mapping_infos(target_skeleton.num_joints());
-
-    for (int target_idx = 0; target_idx < target_skeleton.num_joints(); ++target_idx) {
-        const char* target_name = target_skeleton.joint_names()[target_idx];
-        auto mapping_opt = mapper.GetMapping(target_name);
-
-        if (mapping_opt && !mapping_opt->is_unmapped()) {
-            mapping_infos[target_idx].is_mapped = true;
-            mapping_infos[target_idx].combine_rotations = mapping_opt->is_combined();
-            mapping_infos[target_idx].correction = mapping_opt->correction;
-            mapping_infos[target_idx].has_correction = mapping_opt->has_correction;
-            for (const auto& src_name : mapping_opt->source_bones) {
-                int idx = mapper.GetSourceBoneIndex(src_name);
-                if (idx >= 0) {
-                    mapping_infos[target_idx].source_indices.push_back(idx);
-                }
-            }
-        }
+    for (auto& track : raw_animation.tracks) {
+        track.translations.reserve(num_keyframes);
+        track.rotations.reserve(num_keyframes);
+        track.scales.reserve(num_keyframes);
     }
 
-    // Storage for world rotations during each frame
+    // Per-frame source locals unpacked from SoA, and world rotations
+    std::vector<ozz::math::Quaternion> source_rotations(source_skeleton.num_joints());
+    std::vector<ozz::math::Float3> source_translations(source_skeleton.num_joints());
     std::vector<ozz::math::Quaternion> source_world_rotations(source_skeleton.num_joints());
     std::vector<ozz::math::Quaternion> target_world_rotations(target_skeleton.num_joints());
 
@@ -441,29 +418,20 @@ int main(int argc, char* argv[]) {
         sampling_job.ratio = time / source_animation.duration();
         sampling_job.output = ozz::make_span(source_locals);
         if (!sampling_job.Run()) {
-            std::cerr << "Sampling failed at frame " << frame << std::endl;
-            return 1;
+            std::cerr << "Sampling failed at frame " << frame << ": " << source_anim_path << std::endl;
+            return false;
         }
 
-        // Compute world rotations for all source bones
-        for (int i = 0; i < source_skeleton.num_joints(); ++i) {
-            int soa_idx = i / 4;
-            int lane = i % 4;
-            ozz::math::Quaternion local = ExtractRotation(source_locals[soa_idx], lane);
+        UnpackTransforms(source_locals.data(), source_skeleton.num_joints(),
+                         &source_rotations, &source_translations, nullptr);
 
-            int parent = source_skeleton.joint_parents()[i];
-            if (parent < 0) {
-                source_world_rotations[i] = local;
-            } else {
-                source_world_rotations[i] = QuatMul(source_world_rotations[parent], local);
-            }
-        }
+        ComputeWorldRotations(source_skeleton, source_rotations, &source_world_rotations);
 
         // Process each target bone
         for (int target_idx = 0; target_idx < target_skeleton.num_joints(); ++target_idx) {
             const char* target_name = target_skeleton.joint_names()[target_idx];
             auto& track = raw_animation.tracks[target_idx];
-            const auto& info = mapping_infos[target_idx];
+            const auto& info = retargeter.mapping_infos[target_idx];
 
             // Get target parent world rotation
             int target_parent = target_skeleton.joint_parents()[target_idx];
@@ -477,28 +445,19 @@ int main(int argc, char* argv[]) {
 
             if (!info.is_mapped || info.source_indices.empty()) {
                 // Unmapped bone - use rest pose
-                int soa_idx = target_idx / 4;
-                int lane = target_idx % 4;
-                const auto& rest = target_skeleton.joint_rest_poses()[soa_idx];
-                local_rotation = ExtractRotation(rest, lane);
-                translation = ExtractTranslation(rest, lane);
-                scale = ExtractScale(rest, lane);
+                local_rotation = retargeter.target_rest_rotations[target_idx];
+                translation = retargeter.target_rest_translations[target_idx];
+                scale = retargeter.target_rest_scales[target_idx];
             } else {
                 // Get source world rotation (combine if needed)
                 ozz::math::Quaternion source_world;
                 if (info.combine_rotations && info.source_indices.size() > 1) {
                     // For combined bones, multiply the local rotations then compute world
                     int first_src = info.source_indices[0];
-                    int first_soa = first_src / 4;
-                    int first_lane = first_src % 4;
-                    ozz::math::Quaternion combined_local = ExtractRotation(source_locals[first_soa], first_lane);
+                    ozz::math::Quaternion combined_local = source_rotations[first_src];
 
                     for (size_t j = 1; j < info.source_indices.size(); ++j) {
-                        int src = info.source_indices[j];
-                        int soa_idx = src / 4;
-                        int lane = src % 4;
-                        ozz::math::Quaternion rot = ExtractRotation(source_locals[soa_idx], lane);
-                        combined_local = QuatMul(combined_local, rot);
+                        combined_local = QuatMul(combined_local, source_rotations[info.source_indices[j]]);
                     }
 
                     // Get parent of first source bone for world transform
@@ -509,15 +468,12 @@ int main(int argc, char* argv[]) {
                     source_world = QuatMul(parent_world, combined_local);
 
                     // Translation from first bone
-                    translation = ExtractTranslation(source_locals[first_soa], first_lane);
+                    translation = source_translations[first_src];
                 } else {
                     // Single source bone - use its world rotation
                     int src_idx = info.source_indices[0];
                     source_world = source_world_rotations[src_idx];
-
-                    int soa_idx = src_idx / 4;
-                    int lane = src_idx % 4;
-                    translation = ExtractTranslation(source_locals[soa_idx], lane);
+                    translation = source_translations[src_idx];
                 }
 
                 // Apply correction if specified
@@ -575,26 +531,248 @@ int main(int argc, char* argv[]) {
 
     // Validate raw animation
     if (!raw_animation.Validate()) {
-        std::cerr << "Raw animation validation failed" << std::endl;
-        return 1;
+        std::cerr << "Raw animation validation failed: " << source_anim_path << std::endl;
+        return false;
     }
 
     // Build runtime animation
     ozz::animation::offline::AnimationBuilder builder;
     ozz::unique_ptr<ozz::animation::Animation> output_animation = builder(raw_animation);
     if (!output_animation) {
-        std::cerr << "Failed to build animation" << std::endl;
-        return 1;
+        std::cerr << "Failed to build animation: " << source_anim_path << std::endl;
+        return false;
     }
 
     // Save output animation
     if (!SaveAnimation(output_path, *output_animation)) {
+        return false;
+    }
+
+    log << "Saved retargeted animation: " << output_path << std::endl;
+    log << "  Duration: " << output_animation->duration() << "s" << std::endl;
+    log << "  Tracks: " << output_animation->num_tracks() << std::endl;
+    return true;
+}
+
+// One manifest entry
+struct ClipJob {
+    std::string source;
+    std::string output;
+    float sample_rate;
+};
+
+// Read a manifest: {"clips": [{"source": "a.ozz", "output": "b.ozz",
+// "sample_rate": 30}, ...]}, sample_rate optional. Paths are used as given.
+bool LoadManifest(const std::string& path, float default_sample_rate, std::vector<ClipJob>* jobs) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open manifest file: " << path << std::endl;
+        return false;
+    }
+
+    nlohmann::json manifest;
+    try {
+        file >> manifest;
+    } catch (const nlohmann::json::parse_error& e) {
+        std::cerr << "Failed to parse manifest " << path << ": " << e.what() << std::endl;
+        return false;
+    }
+
+    const auto clips = manifest.value("clips", nlohmann::json::array());
+    for (const auto& entry : clips) {
+        ClipJob job;
+        job.source = entry.value("source", "");
+        job.output = entry.value("output", "");
+        job.sample_rate = entry.value("sample_rate", default_sample_rate);
+        if (job.source.empty() || job.output.empty()) {
+            std::cerr << "Manifest entry needs \"source\" and \"output\": " << entry.dump() << std::endl;
+            return false;
+        }
+        jobs->push_back(job);
+    }
+    if (jobs->empty()) {
+        std::cerr << "Manifest has no clips: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Retarget every manifest clip on up to num_threads threads (0: one per
+// core). Returns the number of clips that failed.
+int RetargetManifest(const Retargeter& retargeter, const std::vector<ClipJob>& jobs, int num_threads) {
+    if (num_threads <= 0) {
+        num_threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    }
+    num_threads = std::min<int>(num_threads, static_cast<int>(jobs.size()));
+    std::cout << "Retargeting " << jobs.size() << " clips on " << num_threads
+              << " threads..." << std::endl;
+
+    std::atomic<size_t> next{0};
+    std::atomic<int> failures{0};
+    std::mutex log_mutex;
+    auto worker = [&]() {
+        for (size_t i = next++; i < jobs.size(); i = next++) {
+            const ClipJob& job = jobs[i];
+            std::ostringstream log;
+            if (!RetargetClip(retargeter, job.source, job.output, job.sample_rate, log)) {
+                log << "Failed to retarget " << job.source << std::endl;
+                ++failures;
+            }
+            std::lock_guard<std::mutex> lock(log_mutex);
+            std::cout << log.str();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 1; i < num_threads; ++i) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return failures;
+}
+
+void PrintUsage(const char* program) {
+    std::cout << "Usage: " << program << " [options]\n"
+              << "\n"
+              << "Options:\n"
+              << "  --source-anim=FILE      Source animation file (.ozz)\n"
+              << "  --source-skeleton=FILE  Source skeleton file (.ozz)\n"
+              << "  --target-skeleton=FILE  Target skeleton file (.ozz)\n"
+              << "  --config=FILE           Bone mapping config file (.json)\n"
+              << "  --output=FILE           Output animation file (.ozz)\n"
+              << "  --manifest=FILE         Retarget every clip listed in FILE (.json)\n"
+              << "                          instead of --source-anim/--output\n"
+              << "  --jobs=N                Manifest clips to retarget at once\n"
+              << "                          (default: 0, one per core)\n"
+              << "  --sample-rate=N         Samples per second (default: 30)\n"
+              << "  --debug                 Print debug info for key bones\n"
+              << "  --help                  Show this help message\n";
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    std::string source_anim_path;
+    std::string source_skeleton_path;
+    std::string target_skeleton_path;
+    std::string config_path;
+    std::string output_path;
+    std::string manifest_path;
+    int num_jobs = 0;
+    float sample_rate = 30.0f;
+    bool debug_mode = false;
+
+    // Parse command line arguments
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+
+        if (arg == "--help") {
+            PrintUsage(argv[0]);
+            return 0;
+        } else if (arg.rfind("--source-anim=", 0) == 0) {
+            source_anim_path = arg.substr(14);
+        } else if (arg.rfind("--source-skeleton=", 0) == 0) {
+            source_skeleton_path = arg.substr(18);
+        } else if (arg.rfind("--target-skeleton=", 0) == 0) {
+            target_skeleton_path = arg.substr(18);
+        } else if (arg.rfind("--config=", 0) == 0) {
+            config_path = arg.substr(9);
+        } else if (arg.rfind("--output=", 0) == 0) {
+            output_path = arg.substr(9);
+        } else if (arg.rfind("--manifest=", 0) == 0) {
+            manifest_path = arg.substr(11);
+        } else if (arg.rfind("--jobs=", 0) == 0) {
+            num_jobs = std::stoi(arg.substr(7));
+        } else if (arg.rfind("--sample-rate=", 0) == 0) {
+            sample_rate = std::stof(arg.substr(14));
+        } else if (arg == "--debug") {
+            debug_mode = true;
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    // Validate required arguments
+    const bool manifest_mode = !manifest_path.empty();
+    if (source_skeleton_path.empty() || target_skeleton_path.empty() || config_path.empty() ||
+        (!manifest_mode && (source_anim_path.empty() || output_path.empty()))) {
+        std::cerr << "Missing required arguments.\n";
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    // Read the manifest before loading anything, so a bad one fails fast
+    std::vector<ClipJob> jobs;
+    if (manifest_mode && !LoadManifest(manifest_path, sample_rate, &jobs)) {
+        return 1;
+    }
+
+    // Load source skeleton
+    ozz::animation::Skeleton source_skeleton;
+    if (!LoadSkeleton(source_skeleton_path, &source_skeleton)) {
+        return 1;
+    }
+    std::cout << "Loaded source skeleton: " << source_skeleton.num_joints() << " joints" << std::endl;
+
+    // Load target skeleton
+    ozz::animation::Skeleton target_skeleton;
+    if (!LoadSkeleton(target_skeleton_path, &target_skeleton)) {
+        return 1;
+    }
+    std::cout << "Loaded target skeleton: " << target_skeleton.num_joints() << " joints" << std::endl;
+
+    // Load bone mapping config
+    retarget::BoneMapper mapper;
+    if (!mapper.LoadConfig(config_path)) {
         return 1;
     }
 
-    std::cout << "Saved retargeted animation: " << output_path << std::endl;
-    std::cout << "  Duration: " << output_animation->duration() << "s" << std::endl;
-    std::cout << "  Tracks: " << output_animation->num_tracks() << std::endl;
+    // Build bone name maps
+    auto source_names = GetBoneNames(source_skeleton);
+    auto target_names = GetBoneNames(target_skeleton);
+    mapper.BuildSourceBoneMap(source_names);
+    mapper.BuildTargetBoneMap(target_names);
+
+    // Debug: Print skeleton rest poses
+    if (debug_mode) {
+        std::cout << "\n=== SOURCE SKELETON REST POSES ===" << std::endl;
+        for (int i = 0; i < source_skeleton.num_joints(); ++i) {
+            const char* name = source_skeleton.joint_names()[i];
+            int parent = source_skeleton.joint_parents()[i];
+            ozz::math::Quaternion rest = GetRestPoseRotation(source_skeleton, i);
+            std::cout << "  [" << i << "] " << name << " (parent=" << parent << "): ";
+            std::cout << "quat(" << rest.x << ", " << rest.y << ", " << rest.z << ", " << rest.w << ")" << std::endl;
+        }
+
+        std::cout << "\n=== TARGET SKELETON REST POSES ===" << std::endl;
+        for (int i = 0; i < target_skeleton.num_joints(); ++i) {
+            const char* name = target_skeleton.joint_names()[i];
+            int parent = target_skeleton.joint_parents()[i];
+            ozz::math::Quaternion rest = GetRestPoseRotation(target_skeleton, i);
+            std::cout << "  [" << i << "] " << name << " (parent=" << parent << "): ";
+            std::cout << "quat(" << rest.x << ", " << rest.y << ", " << rest.z << ", " << rest.w << ")" << std::endl;
+        }
+        std::cout << std::endl;
+    }
+
+    // Skeletons and mappings are shared by every clip from here on
+    Retargeter retargeter;
+    BuildRetargeter(source_skeleton, target_skeleton, mapper, debug_mode, &retargeter);
+
+    if (manifest_mode) {
+        // Debug output is per bone and would interleave across threads
+        int failures = RetargetManifest(retargeter, jobs, debug_mode ? 1 : num_jobs);
+        if (failures > 0) {
+            std::cerr << failures << " of " << jobs.size() << " clips failed" << std::endl;
+            return 1;
+        }
+        return 0;
+    }
 
-    return 0;
+    return RetargetClip(retargeter, source_anim_path, output_path, sample_rate, std::cout) ? 0 : 1;
 }
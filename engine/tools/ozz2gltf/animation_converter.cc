@@ -0,0 +1,241 @@
+// Animation converter implementation
+
+#include "animation_converter.h"
+#include "soa_utils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "ozz/animation/runtime/sampling_job.h"
+#include "ozz/base/io/archive.h"
+#include "ozz/base/io/stream.h"
+#include "ozz/base/maths/soa_transform.h"
+
+namespace animation_converter {
+
+namespace {
+
+// Channels closer than this to their first key are constant
+const float kConstantEpsilon = 1e-6f;
+
+enum Channel { kTranslation, kRotation, kScale };
+
+const float* ChannelValues(const soa_utils::JointTransform& t, Channel channel) {
+    switch (channel) {
+        case kTranslation: return t.translation;
+        case kRotation: return t.rotation;
+        default: return t.scale;
+    }
+}
+
+bool NearlyEqual(const float* a, const float* b, int count) {
+    for (int i = 0; i < count; i++) {
+        if (std::fabs(a[i] - b[i]) > kConstantEpsilon) return false;
+    }
+    return true;
+}
+
+// Everything for one clip goes in one buffer view; accessors point into it
+struct ClipView {
+    size_t start;
+    int view_index;
+};
+
+int AddAccessor(tinygltf::Model* model, const ClipView& view, size_t offset,
+                int component_type, bool normalized, int type, size_t count) {
+    tinygltf::Accessor accessor;
+    accessor.bufferView = view.view_index;
+    accessor.byteOffset = offset - view.start;
+    accessor.componentType = component_type;
+    accessor.normalized = normalized;
+    accessor.count = count;
+    accessor.type = type;
+    model->accessors.push_back(accessor);
+    return static_cast<int>(model->accessors.size()) - 1;
+}
+
+}  // namespace
+
+bool LoadAnimation(const std::string& path, ozz::animation::Animation* animation) {
+    ozz::io::File file(path.c_str(), "rb");
+    if (!file.opened()) {
+        std::cerr << "Failed to open animation file: " << path << std::endl;
+        return false;
+    }
+
+    ozz::io::IArchive archive(&file);
+    if (!archive.TestTag<ozz::animation::Animation>()) {
+        std::cerr << "Invalid animation file: " << path << std::endl;
+        return false;
+    }
+
+    archive >> *animation;
+    return true;
+}
+
+bool AddAnimation(const ozz::animation::Skeleton& skeleton,
+                  const ozz::animation::Animation& animation,
+                  const Options& options,
+                  const std::string& name,
+                  bin_writer::BinWriter* bin,
+                  tinygltf::Model* model) {
+    const int num_joints = skeleton.num_joints();
+    if (animation.num_tracks() != num_joints) {
+        std::cerr << "Animation '" << name << "' has " << animation.num_tracks()
+                  << " tracks, skeleton has " << num_joints << " joints" << std::endl;
+        return false;
+    }
+
+    const float duration = animation.duration();
+    const int num_keys = std::max(2, static_cast<int>(duration * options.sample_rate) + 1);
+
+    // Sample every key, stored joint-major so each channel is contiguous
+    std::vector<soa_utils::JointTransform> keys(static_cast<size_t>(num_joints) * num_keys);
+    std::vector<soa_utils::JointTransform> frame(num_joints);
+    std::vector<ozz::math::SoaTransform> locals(skeleton.num_soa_joints());
+    ozz::animation::SamplingJob::Context context;
+    context.Resize(num_joints);
+
+    for (int k = 0; k < num_keys; k++) {
+        ozz::animation::SamplingJob sampling_job;
+        sampling_job.animation = &animation;
+        sampling_job.context = &context;
+        sampling_job.ratio = static_cast<float>(k) / static_cast<float>(num_keys - 1);
+        sampling_job.output = ozz::make_span(locals);
+        if (!sampling_job.Run()) {
+            std::cerr << "Sampling failed for animation '" << name << "'" << std::endl;
+            return false;
+        }
+        soa_utils::ExtractJointTransforms(ozz::make_span(locals), num_joints, frame.data());
+
+        for (int j = 0; j < num_joints; j++) {
+            soa_utils::JointTransform& key = keys[static_cast<size_t>(j) * num_keys + k];
+            key = frame[j];
+
+            // Keep each rotation in the previous one's hemisphere, so linear
+            // interpolation between keys takes the short way
+            if (k > 0) {
+                const float* prev = keys[static_cast<size_t>(j) * num_keys + k - 1].rotation;
+                float dot = prev[0] * key.rotation[0] + prev[1] * key.rotation[1] +
+                            prev[2] * key.rotation[2] + prev[3] * key.rotation[3];
+                if (dot < 0.0f) {
+                    for (float& c : key.rotation) c = -c;
+                }
+            }
+        }
+    }
+
+    std::vector<soa_utils::JointTransform> rest(num_joints);
+    soa_utils::ExtractJointTransforms(skeleton.joint_rest_poses(), num_joints, rest.data());
+
+    // The clip's buffer view; its length is known once everything is written
+    tinygltf::BufferView buffer_view;
+    buffer_view.buffer = 0;
+    buffer_view.byteOffset = bin->size();
+    model->bufferViews.push_back(buffer_view);
+    const ClipView view = {bin->size(), static_cast<int>(model->bufferViews.size()) - 1};
+
+    // Key times, and a single key for constant channels
+    std::vector<float> times(num_keys);
+    for (int k = 0; k < num_keys; k++) {
+        times[k] = duration * static_cast<float>(k) / static_cast<float>(num_keys - 1);
+    }
+    const size_t times_offset = bin->Append(times.data(), times.size() * sizeof(float));
+    const float zero = 0.0f;
+    const size_t single_offset = bin->Append(&zero, sizeof(zero));
+
+    const int times_accessor = AddAccessor(model, view, times_offset,
+                                           TINYGLTF_COMPONENT_TYPE_FLOAT, false,
+                                           TINYGLTF_TYPE_SCALAR, num_keys);
+    model->accessors[times_accessor].minValues = {0.0};
+    model->accessors[times_accessor].maxValues = {duration};
+    const int single_accessor = AddAccessor(model, view, single_offset,
+                                            TINYGLTF_COMPONENT_TYPE_FLOAT, false,
+                                            TINYGLTF_TYPE_SCALAR, 1);
+    model->accessors[single_accessor].minValues = {0.0};
+    model->accessors[single_accessor].maxValues = {0.0};
+
+    tinygltf::Animation gltf_animation;
+    gltf_animation.name = animation.name()[0] ? animation.name() : name;
+
+    static const char* const kPaths[] = {"translation", "rotation", "scale"};
+    std::vector<float> values;
+    std::vector<int16_t> quantized;
+    int constant_channels = 0;
+
+    for (int j = 0; j < num_joints; j++) {
+        const soa_utils::JointTransform* joint_keys = &keys[static_cast<size_t>(j) * num_keys];
+        for (int c = kTranslation; c <= kScale; c++) {
+            const Channel channel = static_cast<Channel>(c);
+            const int width = channel == kRotation ? 4 : 3;
+            const float* first = ChannelValues(joint_keys[0], channel);
+
+            bool constant = true;
+            for (int k = 1; k < num_keys && constant; k++) {
+                constant = NearlyEqual(ChannelValues(joint_keys[k], channel), first, width);
+            }
+            // The node already holds the rest pose. The root keeps its
+            // rotation, so a clip that never moves still has a channel.
+            if (constant && !(j == 0 && channel == kRotation) &&
+                NearlyEqual(first, ChannelValues(rest[j], channel), width)) {
+                continue;
+            }
+            const int count = constant ? 1 : num_keys;
+            constant_channels += constant ? 1 : 0;
+
+            values.resize(static_cast<size_t>(count) * width);
+            for (int k = 0; k < count; k++) {
+                std::copy(ChannelValues(joint_keys[k], channel),
+                          ChannelValues(joint_keys[k], channel) + width,
+                          values.begin() + static_cast<size_t>(k) * width);
+            }
+
+            int output;
+            if (channel == kRotation && options.quantize_rotations) {
+                // glTF allows normalized shorts for rotation keys
+                quantized.resize(values.size());
+                for (size_t i = 0; i < values.size(); i++) {
+                    float v = std::max(-1.0f, std::min(1.0f, values[i]));
+                    quantized[i] = static_cast<int16_t>(std::lround(v * 32767.0f));
+                }
+                size_t offset = bin->Append(quantized.data(), quantized.size() * sizeof(int16_t));
+                output = AddAccessor(model, view, offset, TINYGLTF_COMPONENT_TYPE_SHORT, true,
+                                     TINYGLTF_TYPE_VEC4, count);
+            } else {
+                size_t offset = bin->Append(values.data(), values.size() * sizeof(float));
+                output = AddAccessor(model, view, offset, TINYGLTF_COMPONENT_TYPE_FLOAT, false,
+                                     width == 4 ? TINYGLTF_TYPE_VEC4 : TINYGLTF_TYPE_VEC3, count);
+            }
+
+            tinygltf::AnimationSampler sampler;
+            sampler.input = constant ? single_accessor : times_accessor;
+            sampler.output = output;
+            sampler.interpolation = "LINEAR";
+            gltf_animation.samplers.push_back(sampler);
+
+            tinygltf::AnimationChannel gltf_channel;
+            gltf_channel.sampler = static_cast<int>(gltf_animation.samplers.size()) - 1;
+            gltf_channel.target_node = j;
+            gltf_channel.target_path = kPaths[c];
+            gltf_animation.channels.push_back(gltf_channel);
+        }
+    }
+
+    model->bufferViews[view.view_index].byteLength = bin->size() - view.start;
+    model->animations.push_back(gltf_animation);
+
+    if (!bin->good()) {
+        std::cerr << "Failed to write key data for animation '" << name << "'" << std::endl;
+        return false;
+    }
+
+    std::cout << "  Animation '" << gltf_animation.name << "': " << num_keys << " keys, "
+              << gltf_animation.channels.size() << " channels (" << constant_channels
+              << " constant), " << (bin->size() - view.start) / 1024 << " KB" << std::endl;
+    return true;
+}
+
+}  // namespace animation_converter
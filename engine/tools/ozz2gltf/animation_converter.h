@@ -0,0 +1,43 @@
+// Animation converter: ozz-animation clips to glTF animations
+
+#ifndef ANIMATION_CONVERTER_H_
+#define ANIMATION_CONVERTER_H_
+
+#include <string>
+
+#include "bin_writer.h"
+#include "ozz/animation/runtime/animation.h"
+#include "ozz/animation/runtime/skeleton.h"
+#include "tiny_gltf.h"
+
+namespace animation_converter {
+
+struct Options {
+    // Keys per second sampled from each clip
+    float sample_rate = 30.0f;
+
+    // Store rotation keys as normalized shorts instead of floats (half
+    // the size; about 1e-4 precision per component)
+    bool quantize_rotations = false;
+};
+
+// Sample animation at options.sample_rate and add it to model as one glTF
+// animation targeting the skeleton's joint nodes (node i is joint i).
+// Its key data is appended to bin in one buffer view, so only this clip's
+// keys are ever in memory. Channels that never move are written as one
+// key, or left out when they hold the rest pose. name is used when the
+// clip has none. Returns true on success.
+bool AddAnimation(const ozz::animation::Skeleton& skeleton,
+                  const ozz::animation::Animation& animation,
+                  const Options& options,
+                  const std::string& name,
+                  bin_writer::BinWriter* bin,
+                  tinygltf::Model* model);
+
+// Load animation from .ozz file.
+// Returns true on success.
+bool LoadAnimation(const std::string& path, ozz::animation::Animation* animation);
+
+}  // namespace animation_converter
+
+#endif  // ANIMATION_CONVERTER_H_
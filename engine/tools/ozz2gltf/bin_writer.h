@@ -0,0 +1,75 @@
+// Binary buffer writer: collects a glTF model's buffer data in a temporary
+// file as it is produced, so large exports never hold all of it in memory.
+
+#ifndef BIN_WRITER_H_
+#define BIN_WRITER_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+namespace bin_writer {
+
+class BinWriter {
+ public:
+    BinWriter() : file_(std::tmpfile()), size_(0) {}
+    ~BinWriter() {
+        if (file_) std::fclose(file_);
+    }
+
+    bool ok() const { return file_ != nullptr; }
+
+    // Bytes written so far (always a multiple of 4)
+    size_t size() const { return size_; }
+
+    // Append bytes, padded to 4 so every accessor that follows is aligned.
+    // Returns the offset they start at.
+    size_t Append(const void* data, size_t bytes) {
+        const size_t offset = size_;
+        const uint8_t zeros[3] = {0, 0, 0};
+        const size_t padding = (4 - bytes % 4) % 4;
+        if (std::fwrite(data, 1, bytes, file_) != bytes ||
+            std::fwrite(zeros, 1, padding, file_) != padding) {
+            failed_ = true;
+        }
+        size_ += bytes + padding;
+        return offset;
+    }
+
+    // Whether every write so far succeeded
+    bool good() const { return ok() && !failed_; }
+
+    // Copy everything written to out
+    bool CopyTo(std::FILE* out) {
+        std::fflush(file_);
+        std::rewind(file_);
+        char block[1 << 16];
+        size_t left = size_;
+        while (left > 0) {
+            size_t n = std::fread(block, 1, left < sizeof(block) ? left : sizeof(block), file_);
+            if (n == 0 || std::fwrite(block, 1, n, out) != n) return false;
+            left -= n;
+        }
+        return true;
+    }
+
+    // Read everything written back into memory (for embedded .gltf output)
+    bool ReadAll(std::vector<unsigned char>* out) {
+        std::fflush(file_);
+        std::rewind(file_);
+        out->resize(size_);
+        return size_ == 0 || std::fread(out->data(), 1, size_, file_) == size_;
+    }
+
+ private:
+    std::FILE* file_;
+    size_t size_;
+    bool failed_ = false;
+
+    BinWriter(const BinWriter&) = delete;
+    BinWriter& operator=(const BinWriter&) = delete;
+};
+
+}  // namespace bin_writer
+
+#endif  // BIN_WRITER_H_
@@ -3,20 +3,27 @@
 // Usage:
 //   ozz2gltf input.ozz output.gltf    # JSON format
 //   ozz2gltf input.ozz output.glb     # Binary format
+//   ozz2gltf [--rate 30] [--quantize-rotations] input.ozz output.glb clip.ozz...
+//                                     # With animations
 
+#include <cstdlib>
 #include <iostream>
 #include <string>
+#include <vector>
 
 #include "ozz/animation/runtime/skeleton.h"
 #include "skeleton_converter.h"
 
 void PrintUsage(const char* program) {
-    std::cout << "Usage: " << program << " <input.ozz> <output.gltf|.glb>\n\n";
-    std::cout << "Convert ozz-animation skeleton to glTF format for use in\n";
-    std::cout << "external 3D software (Blender, Maya, etc.).\n\n";
+    std::cout << "Usage: " << program << " [options] <input.ozz> <output.gltf|.glb> [animation.ozz ...]\n\n";
+    std::cout << "Convert ozz-animation skeleton, and optionally animations for it,\n";
+    std::cout << "to glTF format for use in external 3D software (Blender, Maya, etc.).\n\n";
     std::cout << "Output format is determined by file extension:\n";
     std::cout << "  .gltf  - JSON format (human-readable)\n";
-    std::cout << "  .glb   - Binary format (smaller file size)\n";
+    std::cout << "  .glb   - Binary format (smaller file size; clips are streamed)\n\n";
+    std::cout << "Options:\n";
+    std::cout << "  --rate <fps>            Animation keys per second (default 30)\n";
+    std::cout << "  --quantize-rotations    Store rotation keys as normalized shorts\n";
 }
 
 int main(int argc, char* argv[]) {
@@ -25,15 +32,34 @@ int main(int argc, char* argv[]) {
         return argc == 1 ? 0 : 1;
     }
 
-    std::string input_path = argv[1];
-    std::string output_path = argv[2];
-
-    // Check for help flag
-    if (input_path == "-h" || input_path == "--help") {
+    animation_converter::Options options;
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            PrintUsage(argv[0]);
+            return 0;
+        } else if (arg == "--rate" && i + 1 < argc) {
+            options.sample_rate = static_cast<float>(std::atof(argv[++i]));
+            if (options.sample_rate <= 0.0f) {
+                std::cerr << "Error: --rate must be positive\n";
+                return 1;
+            }
+        } else if (arg == "--quantize-rotations") {
+            options.quantize_rotations = true;
+        } else {
+            positional.push_back(arg);
+        }
+    }
+    if (positional.size() < 2) {
         PrintUsage(argv[0]);
-        return 0;
+        return 1;
     }
 
+    std::string input_path = positional[0];
+    std::string output_path = positional[1];
+    std::vector<std::string> animation_paths(positional.begin() + 2, positional.end());
+
     // Validate output extension
     bool valid_ext = false;
     if (output_path.size() >= 5) {
@@ -76,7 +102,10 @@ int main(int argc, char* argv[]) {
     }
 
     // Convert to glTF
-    if (!skeleton_converter::ConvertToGltf(skeleton, output_path)) {
+    if (!animation_paths.empty()) {
+        std::cout << "Animations: " << animation_paths.size() << std::endl;
+    }
+    if (!skeleton_converter::ConvertToGltf(skeleton, animation_paths, options, output_path)) {
         return 1;
     }
 
@@ -4,8 +4,11 @@
 #include "soa_utils.h"
 
 #include <cmath>
+#include <cstdint>
+#include <cstdio>
 #include <cstring>
 #include <iostream>
+#include <sstream>
 #include <vector>
 
 #include "ozz/base/io/archive.h"
@@ -147,6 +150,55 @@ bool InvertMatrix(const float* m, float* out) {
     return true;
 }
 
+// Name a clip after its file: "path/to/BOTH_STAND1.ozz" -> "BOTH_STAND1"
+std::string ClipName(const std::string& path) {
+    size_t slash = path.find_last_of("/\\");
+    std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+    size_t dot = name.rfind('.');
+    return dot == std::string::npos ? name : name.substr(0, dot);
+}
+
+// Write model as .glb: the JSON chunk, then the binary chunk copied from
+// bin. The JSON is written without buffers and the one buffer added after,
+// since its data never passes through the model.
+bool WriteGlb(const tinygltf::Model& model, bin_writer::BinWriter* bin,
+              const std::string& output_path) {
+    tinygltf::TinyGLTF writer;
+    std::ostringstream json_stream;
+    if (!writer.WriteGltfSceneToStream(&model, json_stream, false, false)) {
+        return false;
+    }
+    nlohmann::json doc = nlohmann::json::parse(json_stream.str());
+    if (bin->size() > 0) {
+        nlohmann::json buffer;
+        buffer["byteLength"] = bin->size();
+        doc["buffers"] = nlohmann::json::array({buffer});
+    }
+    std::string json = doc.dump();
+    json.append((4 - json.size() % 4) % 4, ' ');  // Chunks are 4-byte aligned
+
+    const uint64_t length = 12 + 8 + json.size() + (bin->size() > 0 ? 8 + bin->size() : 0);
+    if (length > UINT32_MAX) {
+        std::cerr << "Output exceeds the 4 GB .glb limit" << std::endl;
+        return false;
+    }
+
+    std::FILE* out = std::fopen(output_path.c_str(), "wb");
+    if (!out) {
+        return false;
+    }
+    const uint32_t header[3] = {0x46546C67, 2, static_cast<uint32_t>(length)};  // "glTF"
+    const uint32_t json_chunk[2] = {static_cast<uint32_t>(json.size()), 0x4E4F534A};  // "JSON"
+    bool ok = std::fwrite(header, sizeof(header), 1, out) == 1 &&
+              std::fwrite(json_chunk, sizeof(json_chunk), 1, out) == 1 &&
+              std::fwrite(json.data(), 1, json.size(), out) == json.size();
+    if (ok && bin->size() > 0) {
+        const uint32_t bin_chunk[2] = {static_cast<uint32_t>(bin->size()), 0x004E4942};  // "BIN"
+        ok = std::fwrite(bin_chunk, sizeof(bin_chunk), 1, out) == 1 && bin->CopyTo(out);
+    }
+    return std::fclose(out) == 0 && ok;
+}
+
 }  // namespace
 
 bool LoadSkeleton(const std::string& path, ozz::animation::Skeleton* skeleton) {
@@ -168,6 +220,13 @@ bool LoadSkeleton(const std::string& path, ozz::animation::Skeleton* skeleton) {
 
 bool ConvertToGltf(const ozz::animation::Skeleton& skeleton,
                    const std::string& output_path) {
+    return ConvertToGltf(skeleton, {}, animation_converter::Options(), output_path);
+}
+
+bool ConvertToGltf(const ozz::animation::Skeleton& skeleton,
+                   const std::vector<std::string>& animation_paths,
+                   const animation_converter::Options& options,
+                   const std::string& output_path) {
     const int num_joints = skeleton.num_joints();
     if (num_joints == 0) {
         std::cerr << "Skeleton has no joints" << std::endl;
@@ -241,12 +300,15 @@ bool ConvertToGltf(const ozz::animation::Skeleton& skeleton,
         }
     }
 
-    // Create buffer for inverse bind matrices
-    tinygltf::Buffer buffer;
+    // Buffer data (inverse bind matrices, then animation keys) goes
+    // through a temporary file
+    bin_writer::BinWriter bin;
+    if (!bin.ok()) {
+        std::cerr << "Failed to create temporary buffer file" << std::endl;
+        return false;
+    }
     size_t ibm_size = num_joints * 16 * sizeof(float);
-    buffer.data.resize(ibm_size);
-    std::memcpy(buffer.data.data(), inverse_bind_matrices.data(), ibm_size);
-    model.buffers.push_back(buffer);
+    bin.Append(inverse_bind_matrices.data(), ibm_size);
 
     // Create buffer view
     tinygltf::BufferView bufferView;
@@ -287,19 +349,39 @@ bool ConvertToGltf(const ozz::animation::Skeleton& skeleton,
     model.scenes.push_back(scene);
     model.defaultScene = 0;
 
-    // Write output
-    tinygltf::TinyGLTF writer;
-    std::string err;
-    std::string warn;
+    // Animations, one clip in memory at a time
+    for (const std::string& path : animation_paths) {
+        ozz::animation::Animation animation;
+        if (!animation_converter::LoadAnimation(path, &animation) ||
+            !animation_converter::AddAnimation(skeleton, animation, options, ClipName(path),
+                                               &bin, &model)) {
+            return false;
+        }
+    }
+    if (!bin.good()) {
+        std::cerr << "Failed to write temporary buffer file" << std::endl;
+        return false;
+    }
 
+    // Write output
     bool is_binary = output_path.size() >= 4 &&
                      output_path.substr(output_path.size() - 4) == ".glb";
 
-    bool success = writer.WriteGltfSceneToFile(&model, output_path,
-                                                true,   // embed images
-                                                true,   // embed buffers
-                                                true,   // pretty print
-                                                is_binary);
+    bool success;
+    if (is_binary) {
+        success = WriteGlb(model, &bin, output_path);
+    } else {
+        tinygltf::Buffer buffer;
+        success = bin.ReadAll(&buffer.data);
+        model.buffers.push_back(buffer);
+
+        tinygltf::TinyGLTF writer;
+        success = success && writer.WriteGltfSceneToFile(&model, output_path,
+                                                         true,   // embed images
+                                                         true,   // embed buffers
+                                                         true,   // pretty print
+                                                         false);
+    }
 
     if (!success) {
         std::cerr << "Failed to write glTF file" << std::endl;
@@ -4,7 +4,9 @@
 #define SKELETON_CONVERTER_H_
 
 #include <string>
+#include <vector>
 
+#include "animation_converter.h"
 #include "ozz/animation/runtime/skeleton.h"
 
 namespace skeleton_converter {
@@ -15,6 +17,17 @@ namespace skeleton_converter {
 bool ConvertToGltf(const ozz::animation::Skeleton& skeleton,
                    const std::string& output_path);
 
+// Convert an ozz skeleton and animations for it (.ozz files) to glTF.
+// Clips are loaded and converted one at a time, their keys going to a
+// temporary file; .glb output copies that straight into the binary chunk,
+// so memory stays at one clip however many there are. (.gltf embeds the
+// buffer as base64, so it is read back whole.)
+// Returns true on success.
+bool ConvertToGltf(const ozz::animation::Skeleton& skeleton,
+                   const std::vector<std::string>& animation_paths,
+                   const animation_converter::Options& options,
+                   const std::string& output_path);
+
 // Load skeleton from .ozz file.
 // Returns true on success.
 bool LoadSkeleton(const std::string& path, ozz::animation::Skeleton* skeleton);
@@ -85,6 +85,46 @@ inline JointTransform ExtractJointTransform(
     return t;
 }
 
+// Extract every joint's transform at once, storing each SoA component
+// once per four joints rather than once per joint
+inline void ExtractJointTransforms(
+    ozz::span<const ozz::math::SoaTransform> transforms,
+    int num_joints,
+    JointTransform* out) {
+
+    float tx[4], ty[4], tz[4];
+    float rx[4], ry[4], rz[4], rw[4];
+    float sx[4], sy[4], sz[4];
+    const int num_soa = (num_joints + 3) / 4;
+    for (int i = 0; i < num_soa; ++i) {
+        const auto& soa = transforms[i];
+        ozz::math::StorePtrU(soa.translation.x, tx);
+        ozz::math::StorePtrU(soa.translation.y, ty);
+        ozz::math::StorePtrU(soa.translation.z, tz);
+        ozz::math::StorePtrU(soa.rotation.x, rx);
+        ozz::math::StorePtrU(soa.rotation.y, ry);
+        ozz::math::StorePtrU(soa.rotation.z, rz);
+        ozz::math::StorePtrU(soa.rotation.w, rw);
+        ozz::math::StorePtrU(soa.scale.x, sx);
+        ozz::math::StorePtrU(soa.scale.y, sy);
+        ozz::math::StorePtrU(soa.scale.z, sz);
+        const int lanes = num_joints - i * 4 < 4 ? num_joints - i * 4 : 4;
+        for (int lane = 0; lane < lanes; ++lane) {
+            JointTransform& t = out[i * 4 + lane];
+            t.translation[0] = tx[lane];
+            t.translation[1] = ty[lane];
+            t.translation[2] = tz[lane];
+            t.rotation[0] = rx[lane];
+            t.rotation[1] = ry[lane];
+            t.rotation[2] = rz[lane];
+            t.rotation[3] = rw[lane];
+            t.scale[0] = sx[lane];
+            t.scale[1] = sy[lane];
+            t.scale[2] = sz[lane];
+        }
+    }
+}
+
 }  // namespace soa_utils
 
 #endif  // SOA_UTILS_H_
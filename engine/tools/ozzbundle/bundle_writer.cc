@@ -0,0 +1,208 @@
+// bundle_writer.cc - Pack a skeleton and .ozz clips into one .ozzb bundle
+
+#include "bundle_writer.h"
+
+#include <dirent.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <set>
+
+#include "ozz/animation/runtime/animation.h"
+#include "ozz/animation/runtime/skeleton.h"
+#include "ozz/base/io/archive.h"
+#include "ozz/base/io/stream.h"
+
+namespace ozzbundle {
+
+namespace {
+
+std::string Stem(const std::string& path) {
+    size_t slash = path.find_last_of("/\\");
+    std::string file = slash == std::string::npos ? path : path.substr(slash + 1);
+    size_t dot = file.rfind('.');
+    return dot == std::string::npos ? file : file.substr(0, dot);
+}
+
+bool ReadFile(const std::string& path, std::vector<char>* out) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) {
+        std::cerr << "Error: Cannot open " << path << std::endl;
+        return false;
+    }
+    std::streamsize size = file.tellg();
+    file.seekg(0);
+    out->resize(static_cast<size_t>(size));
+    return static_cast<bool>(file.read(out->data(), size));
+}
+
+// Deserialize the archive to check it's a T before it goes in a bundle
+template <typename T>
+bool LoadArchive(const std::string& path, T* object) {
+    ozz::io::File file(path.c_str(), "rb");
+    if (!file.opened()) {
+        std::cerr << "Error: Cannot open " << path << std::endl;
+        return false;
+    }
+    ozz::io::IArchive archive(&file);
+    if (!archive.TestTag<T>()) {
+        return false;
+    }
+    archive >> *object;
+    return true;
+}
+
+// Whether path holds a T archive, without deserializing it
+template <typename T>
+bool HasTag(const std::string& path) {
+    ozz::io::File file(path.c_str(), "rb");
+    if (!file.opened()) {
+        return false;
+    }
+    ozz::io::IArchive archive(&file);
+    return archive.TestTag<T>();
+}
+
+uint64_t Align(uint64_t offset) {
+    return (offset + kAnimationBundleAlign - 1) / kAnimationBundleAlign * kAnimationBundleAlign;
+}
+
+void Pad(std::ofstream& file, uint64_t from, uint64_t to) {
+    static const char zeros[kAnimationBundleAlign] = {};
+    file.write(zeros, static_cast<std::streamsize>(to - from));
+}
+
+}  // namespace
+
+bool LoadSkeleton(const std::string& path, Blob* out) {
+    ozz::animation::Skeleton skeleton;
+    if (!LoadArchive(path, &skeleton)) {
+        std::cerr << "Error: " << path << " is not an ozz skeleton" << std::endl;
+        return false;
+    }
+    out->name = Stem(path);
+    return ReadFile(path, &out->data);
+}
+
+bool LoadClip(const std::string& path, Blob* out) {
+    ozz::animation::Animation animation;
+    if (!LoadArchive(path, &animation)) {
+        std::cerr << "Error: " << path << " is not an ozz animation" << std::endl;
+        return false;
+    }
+    out->name = Stem(path);
+    out->duration = animation.duration();
+    out->num_tracks = animation.num_tracks();
+    return ReadFile(path, &out->data);
+}
+
+bool LoadClipsInDirectory(const std::string& dir, const std::string& skip, std::vector<Blob>* out) {
+    DIR* d = opendir(dir.c_str());
+    if (!d) {
+        std::cerr << "Error: Cannot open directory " << dir << std::endl;
+        return false;
+    }
+    std::vector<std::string> paths;
+    std::string base = dir.empty() || dir.back() == '/' ? dir : dir + "/";
+    while (struct dirent* entry = readdir(d)) {
+        std::string name = entry->d_name;
+        if (name.size() > 4 && name.compare(name.size() - 4, 4, ".ozz") == 0 && base + name != skip) {
+            paths.push_back(base + name);
+        }
+    }
+    closedir(d);
+    std::sort(paths.begin(), paths.end());
+
+    for (const auto& path : paths) {
+        // Skip other archives (meshes, extra skeletons)
+        if (!HasTag<ozz::animation::Animation>(path)) {
+            std::cout << "  Skipping " << path << " (not an animation)" << std::endl;
+            continue;
+        }
+        Blob clip;
+        if (!LoadClip(path, &clip)) {
+            return false;
+        }
+        out->push_back(std::move(clip));
+    }
+    return true;
+}
+
+bool WriteBundle(const std::string& path, const Blob& skeleton, const std::vector<Blob>& clips) {
+    std::set<std::string> names;
+    for (const auto& clip : clips) {
+        if (clip.name.size() >= kAnimationBundleNameSize) {
+            std::cerr << "Error: Clip name too long (max " << kAnimationBundleNameSize - 1
+                      << "): " << clip.name << std::endl;
+            return false;
+        }
+        if (!names.insert(clip.name).second) {
+            std::cerr << "Error: Duplicate clip name: " << clip.name << std::endl;
+            return false;
+        }
+    }
+
+    // Lay out: header, index, then each archive on an aligned offset
+    AnimationBundleHeader header = {};
+    std::memcpy(header.magic, kAnimationBundleMagic, sizeof(header.magic));
+    header.version = kAnimationBundleVersion;
+    header.clip_count = static_cast<uint32_t>(clips.size());
+    header.index_offset = sizeof(AnimationBundleHeader);
+    uint64_t end = header.index_offset + clips.size() * sizeof(AnimationBundleEntry);
+    header.skeleton_offset = Align(end);
+    header.skeleton_size = skeleton.data.size();
+    end = header.skeleton_offset + header.skeleton_size;
+
+    std::vector<AnimationBundleEntry> entries(clips.size());
+    for (size_t i = 0; i < clips.size(); ++i) {
+        AnimationBundleEntry& e = entries[i];
+        std::memset(&e, 0, sizeof(e));
+        std::memcpy(e.name, clips[i].name.c_str(), clips[i].name.size());
+        e.offset = Align(end);
+        e.size = clips[i].data.size();
+        e.duration = clips[i].duration;
+        e.num_tracks = static_cast<uint32_t>(clips[i].num_tracks);
+        end = e.offset + e.size;
+    }
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Error: Cannot write " << path << std::endl;
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(entries.data()),
+               static_cast<std::streamsize>(entries.size() * sizeof(AnimationBundleEntry)));
+    uint64_t at = header.index_offset + entries.size() * sizeof(AnimationBundleEntry);
+    Pad(file, at, header.skeleton_offset);
+    file.write(skeleton.data.data(), static_cast<std::streamsize>(skeleton.data.size()));
+    at = header.skeleton_offset + header.skeleton_size;
+    for (size_t i = 0; i < clips.size(); ++i) {
+        Pad(file, at, entries[i].offset);
+        file.write(clips[i].data.data(), static_cast<std::streamsize>(clips[i].data.size()));
+        at = entries[i].offset + entries[i].size;
+    }
+    return static_cast<bool>(file);
+}
+
+bool ReadBundleIndex(const std::string& path, AnimationBundleHeader* header,
+                     std::vector<AnimationBundleEntry>* entries) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.read(reinterpret_cast<char*>(header), sizeof(*header)) ||
+        std::memcmp(header->magic, kAnimationBundleMagic, sizeof(header->magic)) != 0) {
+        std::cerr << "Error: " << path << " is not an animation bundle" << std::endl;
+        return false;
+    }
+    if (header->version != kAnimationBundleVersion) {
+        std::cerr << "Error: Unsupported bundle version " << header->version << std::endl;
+        return false;
+    }
+    entries->resize(header->clip_count);
+    file.seekg(static_cast<std::streamoff>(header->index_offset));
+    return static_cast<bool>(file.read(reinterpret_cast<char*>(entries->data()),
+                                       static_cast<std::streamsize>(entries->size() * sizeof(AnimationBundleEntry))));
+}
+
+}  // namespace ozzbundle
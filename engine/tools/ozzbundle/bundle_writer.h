@@ -0,0 +1,35 @@
+// bundle_writer.h - Pack a skeleton and .ozz clips into one .ozzb bundle
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "anim_bundle.h"
+
+namespace ozzbundle {
+
+// An .ozz archive read whole, plus what the bundle index records about it
+struct Blob {
+    std::string name;        // File stem, e.g. "BOTH_RUN1"
+    std::vector<char> data;  // Archive bytes, stored verbatim
+    float duration = 0.0f;   // Clips only
+    int num_tracks = 0;
+};
+
+// Read an .ozz skeleton archive; fails if it isn't one
+bool LoadSkeleton(const std::string& path, Blob* out);
+
+// Read an .ozz animation archive; fails if it isn't one
+bool LoadClip(const std::string& path, Blob* out);
+
+// Every .ozz clip in dir (sorted by name), skipping the path skip
+bool LoadClipsInDirectory(const std::string& dir, const std::string& skip, std::vector<Blob>* out);
+
+// Write the bundle; fails on duplicate or over-long clip names
+bool WriteBundle(const std::string& path, const Blob& skeleton, const std::vector<Blob>& clips);
+
+// Read back a bundle's header and index (for --list and tests)
+bool ReadBundleIndex(const std::string& path, AnimationBundleHeader* header,
+                     std::vector<AnimationBundleEntry>* entries);
+
+}  // namespace ozzbundle
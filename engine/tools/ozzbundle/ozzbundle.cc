@@ -0,0 +1,97 @@
+// ozzbundle - Pack an ozz skeleton and animations into one .ozzb bundle
+//
+// Usage:
+//   ozzbundle output.ozzb skeleton.ozz clip.ozz...   # Listed clips
+//   ozzbundle output.ozzb skeleton.ozz dir/          # Every clip in dir
+//   ozzbundle --list bundle.ozzb                     # Show a bundle's index
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "bundle_writer.h"
+
+void PrintUsage(const char* program) {
+    std::cout << "Usage: " << program << " <output.ozzb> <skeleton.ozz> <clip.ozz|dir/>...\n";
+    std::cout << "       " << program << " --list <bundle.ozzb>\n\n";
+    std::cout << "Pack a skeleton and its animations into one file that the engine\n";
+    std::cout << "memory-maps, deserializing each clip the first time it plays.\n";
+    std::cout << "Clips are named after their file (BOTH_RUN1.ozz -> BOTH_RUN1).\n";
+    std::cout << "A directory adds every animation in it except the skeleton.\n";
+}
+
+bool IsDirectory(const std::string& path) {
+    return !path.empty() && path.back() == '/';
+}
+
+int ListBundle(const std::string& path) {
+    AnimationBundleHeader header;
+    std::vector<AnimationBundleEntry> entries;
+    if (!ozzbundle::ReadBundleIndex(path, &header, &entries)) {
+        return 1;
+    }
+    std::cout << path << ": skeleton " << header.skeleton_size << " bytes, "
+              << header.clip_count << " clips" << std::endl;
+    for (const auto& e : entries) {
+        std::cout << "  " << e.name << "  " << e.duration << "s  " << e.num_tracks
+                  << " tracks  " << e.size << " bytes" << std::endl;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        PrintUsage(argv[0]);
+        return 0;
+    }
+    std::string first = argv[1];
+    if (first == "-h" || first == "--help") {
+        PrintUsage(argv[0]);
+        return 0;
+    }
+    if (first == "--list") {
+        if (argc != 3) {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+        return ListBundle(argv[2]);
+    }
+    if (argc < 4) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    std::string output_path = first;
+    std::string skeleton_path = argv[2];
+
+    ozzbundle::Blob skeleton;
+    if (!ozzbundle::LoadSkeleton(skeleton_path, &skeleton)) {
+        return 1;
+    }
+
+    std::vector<ozzbundle::Blob> clips;
+    for (int i = 3; i < argc; i++) {
+        std::string arg = argv[i];
+        if (IsDirectory(arg)) {
+            if (!ozzbundle::LoadClipsInDirectory(arg, skeleton_path, &clips)) {
+                return 1;
+            }
+        } else {
+            ozzbundle::Blob clip;
+            if (!ozzbundle::LoadClip(arg, &clip)) {
+                return 1;
+            }
+            clips.push_back(std::move(clip));
+        }
+    }
+
+    if (!ozzbundle::WriteBundle(output_path, skeleton, clips)) {
+        return 1;
+    }
+
+    size_t bytes = skeleton.data.size();
+    for (const auto& clip : clips) bytes += clip.data.size();
+    std::cout << "Wrote " << output_path << ": skeleton + " << clips.size()
+              << " clips, " << bytes << " bytes of archives" << std::endl;
+    return 0;
+}
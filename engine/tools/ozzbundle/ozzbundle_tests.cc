@@ -0,0 +1,187 @@
+// Unit tests for ozzbundle
+// Tests bundle layout, index round-trip and clip deserialization from the blob
+
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "bundle_writer.h"
+
+#include "ozz/animation/offline/animation_builder.h"
+#include "ozz/animation/offline/raw_animation.h"
+#include "ozz/animation/offline/raw_skeleton.h"
+#include "ozz/animation/offline/skeleton_builder.h"
+#include "ozz/animation/runtime/animation.h"
+#include "ozz/animation/runtime/skeleton.h"
+#include "ozz/base/io/archive.h"
+#include "ozz/base/io/stream.h"
+#include "ozz/base/maths/transform.h"
+
+// Test helpers
+bool float_eq(float a, float b, float epsilon = 0.001f) {
+    return std::abs(a - b) < epsilon;
+}
+
+std::vector<char> read_file(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::vector<char>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+// Two-joint skeleton, saved as an .ozz file
+std::string write_test_skeleton() {
+    ozz::animation::offline::RawSkeleton raw;
+    raw.roots.resize(1);
+    raw.roots[0].name = "root";
+    raw.roots[0].transform = ozz::math::Transform::identity();
+    raw.roots[0].children.resize(1);
+    raw.roots[0].children[0].name = "child";
+    raw.roots[0].children[0].transform = ozz::math::Transform::identity();
+
+    ozz::animation::offline::SkeletonBuilder builder;
+    auto skeleton = builder(raw);
+    assert(skeleton);
+
+    std::string path = "/tmp/ozzbundle_test_skeleton.ozz";
+    ozz::io::File file(path.c_str(), "wb");
+    ozz::io::OArchive archive(&file);
+    archive << *skeleton;
+    return path;
+}
+
+// Two-track clip of the given duration, saved as name.ozz
+std::string write_test_clip(const std::string& name, float duration) {
+    ozz::animation::offline::RawAnimation raw;
+    raw.name = name.c_str();
+    raw.duration = duration;
+    raw.tracks.resize(2);
+    for (auto& track : raw.tracks) {
+        track.translations.push_back({0.0f, ozz::math::Float3::zero()});
+        track.translations.push_back({duration, ozz::math::Float3(1.0f, 0.0f, 0.0f)});
+    }
+
+    ozz::animation::offline::AnimationBuilder builder;
+    auto animation = builder(raw);
+    assert(animation);
+
+    std::string path = "/tmp/" + name + ".ozz";
+    ozz::io::File file(path.c_str(), "wb");
+    ozz::io::OArchive archive(&file);
+    archive << *animation;
+    return path;
+}
+
+// ============================================================================
+// Bundle Tests
+// ============================================================================
+
+void test_load_clip_metadata() {
+    printf("Test: Load clip records name, duration and tracks... ");
+
+    ozzbundle::Blob clip;
+    assert(ozzbundle::LoadClip(write_test_clip("TEST_RUN", 1.5f), &clip));
+    assert(clip.name == "TEST_RUN");
+    assert(float_eq(clip.duration, 1.5f));
+    assert(clip.num_tracks == 2);
+    assert(!clip.data.empty());
+
+    printf("PASSED\n");
+}
+
+void test_reject_wrong_archive() {
+    printf("Test: Skeleton is rejected as a clip and vice versa... ");
+
+    ozzbundle::Blob blob;
+    assert(!ozzbundle::LoadClip(write_test_skeleton(), &blob));
+    assert(!ozzbundle::LoadSkeleton(write_test_clip("TEST_WALK", 1.0f), &blob));
+
+    printf("PASSED\n");
+}
+
+void test_index_round_trip() {
+    printf("Test: Bundle index round-trips with aligned offsets... ");
+
+    ozzbundle::Blob skeleton;
+    assert(ozzbundle::LoadSkeleton(write_test_skeleton(), &skeleton));
+    std::vector<ozzbundle::Blob> clips(2);
+    assert(ozzbundle::LoadClip(write_test_clip("TEST_RUN", 1.5f), &clips[0]));
+    assert(ozzbundle::LoadClip(write_test_clip("TEST_WALK", 2.0f), &clips[1]));
+
+    std::string path = "/tmp/ozzbundle_test.ozzb";
+    assert(ozzbundle::WriteBundle(path, skeleton, clips));
+
+    AnimationBundleHeader header;
+    std::vector<AnimationBundleEntry> entries;
+    assert(ozzbundle::ReadBundleIndex(path, &header, &entries));
+    assert(header.clip_count == 2);
+    assert(header.skeleton_size == skeleton.data.size());
+    assert(header.skeleton_offset % kAnimationBundleAlign == 0);
+    assert(std::strcmp(entries[0].name, "TEST_RUN") == 0);
+    assert(std::strcmp(entries[1].name, "TEST_WALK") == 0);
+    assert(float_eq(entries[1].duration, 2.0f));
+    assert(entries[1].num_tracks == 2);
+    for (const auto& e : entries) {
+        assert(e.offset % kAnimationBundleAlign == 0);
+        assert(e.offset >= header.skeleton_offset + header.skeleton_size);
+    }
+
+    printf("PASSED\n");
+}
+
+void test_clip_blob_deserializes() {
+    printf("Test: Clip bytes in the bundle deserialize as the original... ");
+
+    std::string path = "/tmp/ozzbundle_test.ozzb";  // From test_index_round_trip
+    AnimationBundleHeader header;
+    std::vector<AnimationBundleEntry> entries;
+    assert(ozzbundle::ReadBundleIndex(path, &header, &entries));
+    std::vector<char> bytes = read_file(path);
+
+    ozz::io::MemoryStream stream;
+    stream.Write(bytes.data() + entries[1].offset, entries[1].size);
+    stream.Seek(0, ozz::io::Stream::kSet);
+    ozz::io::IArchive archive(&stream);
+    assert(archive.TestTag<ozz::animation::Animation>());
+    ozz::animation::Animation animation;
+    archive >> animation;
+    assert(float_eq(animation.duration(), 2.0f));
+    assert(std::strcmp(animation.name(), "TEST_WALK") == 0);
+
+    printf("PASSED\n");
+}
+
+void test_reject_duplicate_names() {
+    printf("Test: Duplicate clip names are rejected... ");
+
+    ozzbundle::Blob skeleton;
+    assert(ozzbundle::LoadSkeleton(write_test_skeleton(), &skeleton));
+    std::vector<ozzbundle::Blob> clips(2);
+    assert(ozzbundle::LoadClip(write_test_clip("TEST_RUN", 1.5f), &clips[0]));
+    clips[1] = clips[0];
+    assert(!ozzbundle::WriteBundle("/tmp/ozzbundle_dup.ozzb", skeleton, clips));
+
+    printf("PASSED\n");
+}
+
+// ============================================================================
+// Main
+// ============================================================================
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+
+    printf("=== ozzbundle Unit Tests ===\n\n");
+
+    test_load_clip_metadata();
+    test_reject_wrong_archive();
+    test_index_round_trip();
+    test_clip_blob_deserializes();
+    test_reject_duplicate_names();
+
+    printf("\n=== All Tests Complete ===\n");
+    return 0;
+}
@@ -0,0 +1,110 @@
+// mesh_optimizer.cc - Reorder .ozz skinned meshes for the GPU's vertex cache
+
+#include "mesh_optimizer.h"
+
+#include <iostream>
+#include <vector>
+
+#include "ozz/base/io/archive.h"
+#include "ozz/base/io/stream.h"
+
+namespace ozzmeshopt {
+
+namespace {
+
+// Apply a part-local remap to one per-vertex array of stride components
+template <typename T>
+void RemapArray(ozz::vector<T>* data, int vertex_count, const std::vector<uint32_t>& remap) {
+    if (data->empty() || vertex_count == 0) return;
+    size_t stride = data->size() / static_cast<size_t>(vertex_count);
+    emeshopt::remap_vertices(data->data(), static_cast<size_t>(vertex_count), stride, remap);
+}
+
+}  // namespace
+
+bool LoadMeshes(const std::string& path, ozz::vector<ozz::sample::Mesh>* out) {
+    ozz::io::File file(path.c_str(), "rb");
+    if (!file.opened()) {
+        std::cerr << "Error: Cannot open " << path << std::endl;
+        return false;
+    }
+    ozz::io::IArchive archive(&file);
+    out->clear();
+    while (archive.TestTag<ozz::sample::Mesh>()) {
+        out->resize(out->size() + 1);
+        archive >> out->back();
+    }
+    if (out->empty()) {
+        std::cerr << "Error: No meshes in " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool SaveMeshes(const std::string& path, const ozz::vector<ozz::sample::Mesh>& meshes) {
+    ozz::io::File file(path.c_str(), "wb");
+    if (!file.opened()) {
+        std::cerr << "Error: Cannot write " << path << std::endl;
+        return false;
+    }
+    ozz::io::OArchive archive(&file);
+    for (const auto& mesh : meshes) {
+        archive << mesh;
+    }
+    return true;
+}
+
+MeshStats OptimizeMesh(ozz::sample::Mesh* mesh) {
+    MeshStats stats;
+    size_t vertex_count = static_cast<size_t>(mesh->vertex_count());
+    std::vector<uint32_t> indices(mesh->triangle_indices.begin(), mesh->triangle_indices.end());
+    stats.triangles = static_cast<int>(indices.size() / 3);
+    stats.vertices = static_cast<int>(vertex_count);
+    stats.acmr_before = emeshopt::acmr(indices.data(), indices.size(), vertex_count);
+    if (indices.empty() || vertex_count == 0) {
+        stats.acmr_after = stats.acmr_before;
+        return stats;
+    }
+
+    // Indices are shared across parts, numbering their vertices in order
+    std::vector<float> positions;
+    positions.reserve(vertex_count * 3);
+    std::vector<uint32_t> part_of;
+    part_of.reserve(vertex_count);
+    std::vector<uint32_t> part_first;
+    for (size_t p = 0; p < mesh->parts.size(); ++p) {
+        const auto& part = mesh->parts[p];
+        part_first.push_back(static_cast<uint32_t>(part_of.size()));
+        positions.insert(positions.end(), part.positions.begin(), part.positions.end());
+        part_of.insert(part_of.end(), static_cast<size_t>(part.vertex_count()), static_cast<uint32_t>(p));
+    }
+
+    emeshopt::optimize_vertex_cache(indices.data(), indices.size(), vertex_count);
+    emeshopt::optimize_overdraw(indices.data(), indices.size(), positions.data(), 3, vertex_count);
+    std::vector<uint32_t> remap =
+        emeshopt::vertex_fetch_remap(indices.data(), indices.size(), vertex_count, part_of.data());
+    emeshopt::remap_indices(indices.data(), indices.size(), remap);
+
+    for (size_t p = 0; p < mesh->parts.size(); ++p) {
+        auto& part = mesh->parts[p];
+        int count = part.vertex_count();
+        std::vector<uint32_t> local(static_cast<size_t>(count));
+        for (int v = 0; v < count; ++v) {
+            local[v] = remap[part_first[p] + v] - part_first[p];
+        }
+        RemapArray(&part.positions, count, local);
+        RemapArray(&part.normals, count, local);
+        RemapArray(&part.tangents, count, local);
+        RemapArray(&part.uvs, count, local);
+        RemapArray(&part.colors, count, local);
+        RemapArray(&part.joint_indices, count, local);
+        RemapArray(&part.joint_weights, count, local);
+    }
+    for (size_t i = 0; i < indices.size(); ++i) {
+        mesh->triangle_indices[i] = static_cast<uint16_t>(indices[i]);
+    }
+    stats.acmr_after = emeshopt::acmr(indices.data(), indices.size(), vertex_count);
+    return stats;
+}
+
+}  // namespace ozzmeshopt
@@ -0,0 +1,29 @@
+// mesh_optimizer.h - Reorder .ozz skinned meshes for the GPU's vertex cache
+#pragma once
+
+#include <string>
+
+#include "engine/animation_impl.h"
+#include "engine/mesh_optimize_impl.h"
+
+namespace ozzmeshopt {
+
+struct MeshStats {
+    int triangles = 0;
+    int vertices = 0;
+    float acmr_before = 0.0f;
+    float acmr_after = 0.0f;
+};
+
+// Every mesh in an .ozz mesh archive (as eanim::load_meshes_ozz reads it)
+bool LoadMeshes(const std::string& path, ozz::vector<ozz::sample::Mesh>* out);
+
+bool SaveMeshes(const std::string& path, const ozz::vector<ozz::sample::Mesh>& meshes);
+
+// Reorder the mesh's triangles for the vertex cache and overdraw, then its
+// vertices in first-use order within each part (parts group vertices by
+// influence count, so none moves between them). Every per-vertex array
+// moves together; the triangles themselves are unchanged.
+MeshStats OptimizeMesh(ozz::sample::Mesh* mesh);
+
+}  // namespace ozzmeshopt
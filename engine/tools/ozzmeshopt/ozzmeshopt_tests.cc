@@ -0,0 +1,154 @@
+// Unit tests for ozzmeshopt
+// Tests that optimizing keeps every triangle and vertex attribute together,
+// keeps vertices in their parts, lowers the ACMR and survives a round trip
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "mesh_optimizer.h"
+
+// A 12x12 grid in two parts (left half one influence, right half two),
+// triangles shuffled; each vertex's uv and joint encode its position so
+// tests can check attributes moved with it
+ozz::sample::Mesh make_test_mesh() {
+    const int n = 12;
+    ozz::sample::Mesh mesh;
+    mesh.parts.resize(2);
+    std::vector<int> slot((n + 1) * (n + 1));
+    for (int pass = 0; pass < 2; pass++) {
+        auto& part = mesh.parts[pass];
+        for (int z = 0; z <= n; z++) {
+            for (int x = 0; x <= n; x++) {
+                if ((x > n / 2) != (pass == 1)) continue;
+                int base = pass == 0 ? 0 : static_cast<int>(mesh.parts[0].positions.size() / 3);
+                slot[z * (n + 1) + x] = base + static_cast<int>(part.positions.size() / 3);
+                part.positions.insert(part.positions.end(), {(float)x, 0.0f, (float)z});
+                part.normals.insert(part.normals.end(), {0.0f, 1.0f, 0.0f});
+                part.uvs.insert(part.uvs.end(), {(float)x / n, (float)z / n});
+                if (pass == 0) {
+                    part.joint_indices.push_back(static_cast<uint16_t>(x));
+                } else {
+                    part.joint_indices.insert(part.joint_indices.end(),
+                                              {static_cast<uint16_t>(x), static_cast<uint16_t>(z)});
+                    part.joint_weights.push_back((float)z / n);
+                }
+            }
+        }
+    }
+    std::vector<uint16_t> indices;
+    for (int z = 0; z < n; z++) {
+        for (int x = 0; x < n; x++) {
+            uint16_t a = slot[z * (n + 1) + x], b = slot[z * (n + 1) + x + 1];
+            uint16_t c = slot[(z + 1) * (n + 1) + x], d = slot[(z + 1) * (n + 1) + x + 1];
+            indices.insert(indices.end(), {a, c, b, b, c, d});
+        }
+    }
+    size_t triangles = indices.size() / 3;
+    for (size_t i = triangles - 1; i > 0; i--) {
+        size_t j = (i * 7919) % (i + 1);
+        for (int k = 0; k < 3; k++) std::swap(indices[i * 3 + k], indices[j * 3 + k]);
+    }
+    mesh.triangle_indices.assign(indices.begin(), indices.end());
+    return mesh;
+}
+
+// Position of global vertex v, and whether its attributes match it
+const float* vertex_position(const ozz::sample::Mesh& mesh, int v, bool* consistent) {
+    for (const auto& part : mesh.parts) {
+        if (v < part.vertex_count()) {
+            const float* p = &part.positions[v * 3];
+            int n = 12;
+            bool ok = std::abs(part.uvs[v * 2] - p[0] / n) < 1e-5f &&
+                      std::abs(part.uvs[v * 2 + 1] - p[2] / n) < 1e-5f;
+            int influences = part.influences_count();
+            ok = ok && part.joint_indices[v * influences] == static_cast<uint16_t>(p[0]);
+            if (influences == 2) {
+                ok = ok && part.joint_indices[v * 2 + 1] == static_cast<uint16_t>(p[2]) &&
+                     std::abs(part.joint_weights[v] - p[2] / n) < 1e-5f;
+            }
+            *consistent = *consistent && ok;
+            return p;
+        }
+        v -= part.vertex_count();
+    }
+    assert(false);
+    return nullptr;
+}
+
+std::vector<std::vector<float>> triangle_corners(const ozz::sample::Mesh& mesh, bool* consistent) {
+    std::vector<std::vector<float>> out;
+    for (size_t t = 0; t < mesh.triangle_indices.size() / 3; t++) {
+        std::vector<float> tri;
+        for (int k = 0; k < 3; k++) {
+            const float* p = vertex_position(mesh, mesh.triangle_indices[t * 3 + k], consistent);
+            tri.insert(tri.end(), p, p + 3);
+        }
+        out.push_back(tri);
+    }
+    std::sort(out.begin(), out.end());
+    return out;
+}
+
+// ============================================================================
+// Tests
+// ============================================================================
+
+void test_optimize_keeps_triangles_and_attributes() {
+    printf("Test: Optimizing keeps every triangle, with attributes beside their vertex... ");
+
+    ozz::sample::Mesh mesh = make_test_mesh();
+    bool consistent = true;
+    auto before = triangle_corners(mesh, &consistent);
+    assert(consistent);
+    int part0 = mesh.parts[0].vertex_count();
+    int part1 = mesh.parts[1].vertex_count();
+
+    ozzmeshopt::MeshStats stats = ozzmeshopt::OptimizeMesh(&mesh);
+    assert(mesh.parts[0].vertex_count() == part0 && mesh.parts[1].vertex_count() == part1);
+    assert(mesh.parts[1].influences_count() == 2);
+    assert(triangle_corners(mesh, &consistent) == before);
+    assert(consistent);
+    assert(stats.triangles == 288 && stats.vertices == part0 + part1);
+    assert(stats.acmr_after < stats.acmr_before * 0.5f);
+
+    printf("PASSED\n");
+}
+
+void test_round_trip() {
+    printf("Test: Optimized meshes save and load back unchanged... ");
+
+    ozz::vector<ozz::sample::Mesh> meshes;
+    meshes.push_back(make_test_mesh());
+    ozzmeshopt::OptimizeMesh(&meshes[0]);
+    std::string path = "/tmp/ozzmeshopt_test.ozz";
+    assert(ozzmeshopt::SaveMeshes(path, meshes));
+
+    ozz::vector<ozz::sample::Mesh> loaded;
+    assert(ozzmeshopt::LoadMeshes(path, &loaded));
+    assert(loaded.size() == 1);
+    assert(loaded[0].triangle_indices == meshes[0].triangle_indices);
+    assert(loaded[0].parts[1].joint_indices == meshes[0].parts[1].joint_indices);
+
+    printf("PASSED\n");
+}
+
+// ============================================================================
+// Main
+// ============================================================================
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+
+    printf("=== ozzmeshopt Unit Tests ===\n\n");
+
+    test_optimize_keeps_triangles_and_attributes();
+    test_round_trip();
+
+    printf("\n=== All Tests Complete ===\n");
+    return 0;
+}
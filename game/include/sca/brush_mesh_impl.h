@@ -0,0 +1,281 @@
+#pragma once
+
+#include "gl_wrappers.h"
+#include "engine/gl_state_impl.h"
+#include "engine/render_queue_impl.h"
+#include "engine/gltf_impl.h"
+#include "engine/collision_impl.h"
+#include <glm/glm.hpp>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+namespace sbrush {
+
+// ============================================================================
+// Brush to mesh
+// ============================================================================
+// Native sca.editor.brush.mesh/brushes-to-mesh: each brush plane becomes a
+// face by clipping a huge quad on it against the brush's other planes
+// (Sutherland-Hodgman), inset and fan-triangulated. Output is the same
+// positions/normals/indices, appended brush after brush into one BrushMesh
+// whose buffers are reused between builds. Clipping runs in double, as the
+// jank version does; the 65536-unit base quads lose too much in float.
+
+const double WORLD_BOUNDS = 65536.0;
+const double CLIP_EPSILON = 0.001;
+const double FACE_INSET = 0.01;
+
+struct BrushPlane {
+    glm::dvec3 normal;
+    double dist;
+    bool clip_only;
+};
+
+struct BrushMesh {
+    ecol::Positions positions;  // Also the collision piece
+    egc::atomic_vector<glm::vec3> normals;
+    ecol::Indices indices;
+    // Scratch, kept for reuse
+    std::vector<BrushPlane> planes;  // Current brush
+    std::vector<glm::dvec3> winding;
+    std::vector<glm::dvec3> clipped;
+};
+
+inline BrushMesh* create_brush_mesh() {
+    return new BrushMesh();
+}
+
+inline void destroy_brush_mesh(BrushMesh* m) {
+    delete m;
+}
+
+inline void brush_mesh_clear(BrushMesh* m) {
+    m->positions.clear();
+    m->normals.clear();
+    m->indices.clear();
+    m->planes.clear();
+}
+
+// Start a brush; add its planes, then brush_end meshes it
+inline void brush_begin(BrushMesh* m) {
+    m->planes.clear();
+}
+
+// Plane through three points, clockwise seen from outside (m/plane-from-points)
+inline void brush_add_plane(BrushMesh* m,
+                            double x1, double y1, double z1,
+                            double x2, double y2, double z2,
+                            double x3, double y3, double z3,
+                            bool clip_only) {
+    glm::dvec3 p1(x1, y1, z1);
+    glm::dvec3 n = glm::cross(glm::dvec3(x2, y2, z2) - p1, glm::dvec3(x3, y3, z3) - p1);
+    double len = glm::length(n);
+    n = len < 0.000001 ? glm::dvec3(0.0) : n / len;
+    m->planes.push_back({n, glm::dot(n, p1), clip_only});
+}
+
+// Large quad on a plane (base-winding)
+inline void base_winding(const BrushPlane& plane, std::vector<glm::dvec3>* out) {
+    const glm::dvec3& n = plane.normal;
+    double ax = std::fabs(n.x), ay = std::fabs(n.y), az = std::fabs(n.z);
+    glm::dvec3 up = (ax <= ay && ax <= az) ? glm::dvec3(1, 0, 0)
+                  : (ay <= az)             ? glm::dvec3(0, 1, 0)
+                                           : glm::dvec3(0, 0, 1);
+    glm::dvec3 tangent = glm::cross(n, up);
+    double len = glm::length(tangent);
+    tangent = len < 0.000001 ? glm::dvec3(0.0) : tangent / len;
+    glm::dvec3 bitangent = glm::cross(n, tangent);
+    glm::dvec3 center = n * plane.dist;
+    glm::dvec3 t = tangent * WORLD_BOUNDS;
+    glm::dvec3 b = bitangent * WORLD_BOUNDS;
+    out->clear();
+    out->push_back(center - t - b);
+    out->push_back(center - t + b);
+    out->push_back(center + t + b);
+    out->push_back(center + t - b);
+}
+
+// Keep the part of in on the plane's positive side (clip-winding).
+// Returns false once fewer than 3 points are left.
+inline bool clip_winding(const std::vector<glm::dvec3>& in, const BrushPlane& plane,
+                         std::vector<glm::dvec3>* out) {
+    out->clear();
+    size_t n = in.size();
+    if (n < 3) return false;
+    for (size_t i = 0; i < n; ++i) {
+        const glm::dvec3& current = in[i];
+        const glm::dvec3& next = in[(i + 1) % n];
+        double d_current = glm::dot(plane.normal, current) - plane.dist;
+        double d_next = glm::dot(plane.normal, next) - plane.dist;
+        bool current_inside = d_current >= -CLIP_EPSILON;
+        bool next_inside = d_next >= -CLIP_EPSILON;
+        if (current_inside) {
+            out->push_back(current);
+        }
+        if (current_inside != next_inside) {
+            double t = d_current / (d_current - d_next);
+            t = t < 0.0 ? 0.0 : (t > 1.0 ? 1.0 : t);
+            out->push_back(current + (next - current) * t);
+        }
+    }
+    return out->size() >= 3;
+}
+
+// Mesh the planes added since brush_begin. Returns the vertices added.
+inline int brush_end(BrushMesh* m) {
+    size_t first_vertex = m->positions.size();
+    size_t count = m->planes.size();
+    for (size_t face = 0; face < count; ++face) {
+        const BrushPlane& plane = m->planes[face];
+        base_winding(plane, &m->winding);
+        bool alive = true;
+        for (size_t j = 0; j < count && alive; ++j) {
+            if (j == face) continue;
+            alive = clip_winding(m->winding, m->planes[j], &m->clipped);
+            m->winding.swap(m->clipped);
+        }
+        if (!alive || plane.clip_only) continue;
+
+        // Inset along the (inward) normal against z-fighting, then fan
+        unsigned int base = (unsigned int)m->positions.size();
+        glm::dvec3 offset = plane.normal * FACE_INSET;
+        glm::vec3 normal(plane.normal);
+        size_t n = m->winding.size();
+        for (const glm::dvec3& v : m->winding) {
+            m->positions.push_back(glm::vec3(v + offset));
+            m->normals.push_back(normal);
+        }
+        for (size_t i = 1; i + 1 < n; ++i) {
+            m->indices.push_back(base);
+            m->indices.push_back(base + (unsigned int)i + 1);
+            m->indices.push_back(base + (unsigned int)i);
+        }
+    }
+    return (int)(m->positions.size() - first_vertex);
+}
+
+inline int brush_mesh_vertex_count(BrushMesh* m) {
+    return (int)m->positions.size();
+}
+
+inline int brush_mesh_index_count(BrushMesh* m) {
+    return (int)m->indices.size();
+}
+
+// For collision (ecol.bvh_add_piece / prepare-collision-buffers)
+inline ecol::Positions* brush_mesh_positions(BrushMesh* m) {
+    return &m->positions;
+}
+
+inline ecol::Indices* brush_mesh_indices(BrushMesh* m) {
+    return &m->indices;
+}
+
+// Append src's triangles to dst (chunk batching)
+inline void brush_mesh_append(BrushMesh* dst, BrushMesh* src) {
+    unsigned int base = (unsigned int)dst->positions.size();
+    dst->positions.insert(dst->positions.end(), src->positions.begin(), src->positions.end());
+    dst->normals.insert(dst->normals.end(), src->normals.begin(), src->normals.end());
+    dst->indices.reserve(dst->indices.size() + src->indices.size());
+    for (unsigned int idx : src->indices) dst->indices.push_back(base + idx);
+}
+
+// ============================================================================
+// GPU meshes
+// ============================================================================
+// Vertex layout of sca.editor.level/upload-mesh (Vertex: position, normal,
+// uv). A GpuMesh keeps its VAO and buffers, so a rebuilt chunk re-specifies
+// the same buffers instead of leaking a new VAO. Its bounding box lets the
+// render queue cull it.
+
+struct GpuMesh {
+    GLuint vao = 0, vbo = 0, ebo = 0;
+    int index_count = 0;
+    glm::vec3 lo, hi;
+};
+
+inline void fill_vertices(BrushMesh* m, std::vector<Vertex>* out) {
+    out->clear();
+    out->reserve(m->positions.size());
+    for (size_t i = 0; i < m->positions.size(); ++i) {
+        const glm::vec3& p = m->positions[i];
+        const glm::vec3& n = m->normals[i];
+        out->emplace_back(p.x, p.y, p.z, n.x, n.y, n.z, 0.0f, 0.0f);
+    }
+}
+
+inline GpuMesh* create_gpu_mesh() {
+    return new GpuMesh();
+}
+
+inline void gpu_mesh_upload(GpuMesh* g, BrushMesh* m) {
+    std::vector<Vertex> vertices;
+    fill_vertices(m, &vertices);
+
+    bool fresh = g->vao == 0;
+    if (fresh) {
+        glGenVertexArrays(1, &g->vao);
+        glGenBuffers(1, &g->vbo);
+        glGenBuffers(1, &g->ebo);
+    }
+    eglstate::bind_vertex_array(g->vao);
+    eglstate::bind_buffer(GL_ARRAY_BUFFER, g->vbo);
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)(vertices.size() * sizeof(Vertex)),
+                 vertices.data(), GL_STATIC_DRAW);
+    eglstate::bind_buffer(GL_ELEMENT_ARRAY_BUFFER, g->ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)(m->indices.size() * sizeof(unsigned int)),
+                 m->indices.data(), GL_STATIC_DRAW);
+    if (fresh) {
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, pos));
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, norm));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, uv));
+        glEnableVertexAttribArray(2);
+    }
+    g->index_count = (int)m->indices.size();
+
+    if (!m->positions.empty()) {
+        g->lo = g->hi = m->positions[0];
+        for (const glm::vec3& p : m->positions) {
+            g->lo = glm::min(g->lo, p);
+            g->hi = glm::max(g->hi, p);
+        }
+    }
+}
+
+inline void gpu_mesh_draw(GpuMesh* g) {
+    if (g->index_count == 0) return;
+    eglstate::bind_vertex_array(g->vao);
+    wrap_glDrawElements(GL_TRIANGLES, g->index_count, GL_UNSIGNED_INT, (void*)0);
+}
+
+// Queue the mesh for engine.gfx3d.render, culled by its bounds
+inline void gpu_mesh_submit(erender::RenderQueue* q, GLuint program, GpuMesh* g, bool blend) {
+    if (g->index_count == 0) return;
+    erender::queue_box(q, g->lo.x, g->lo.y, g->lo.z, g->hi.x, g->hi.y, g->hi.z);
+    erender::queue_elements(q, program, g->vao, 0, GL_TRIANGLES, g->index_count,
+                            GL_UNSIGNED_INT, 0, blend);
+}
+
+inline void destroy_gpu_mesh(GpuMesh* g) {
+    if (g->vao != 0) {
+        eglstate::forget_buffer(g->vbo);
+        eglstate::forget_buffer(g->ebo);
+        eglstate::forget_vertex_array(g->vao);
+        glDeleteBuffers(1, &g->vbo);
+        glDeleteBuffers(1, &g->ebo);
+        glDeleteVertexArrays(1, &g->vao);
+    }
+    delete g;
+}
+
+// One-off upload. Returns the VAO; its VBO and EBO stay bound to it.
+inline GLuint brush_mesh_upload(BrushMesh* m) {
+    GpuMesh g;
+    gpu_mesh_upload(&g, m);
+    return g.vao;
+}
+
+} // namespace sbrush
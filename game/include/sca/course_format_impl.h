@@ -0,0 +1,262 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace scourse {
+
+// ============================================================================
+// Binary course files
+// ============================================================================
+// A compact alternative to the EDN course files (sca.editor.course). It
+// holds the same data, values tagged the way EDN would read them back,
+// so a course loads into equal piece maps either way. Load doesn't go
+// through the reader: jank walks the tags with a cursor.
+//
+// Layout, little-endian:
+//   "SCRS" u32 VERSION
+//   u32 string count, then per string: u16 length, bytes
+//   one value (the course map)
+// A value is a u8 tag, then:
+//   TAG_NIL / TAG_TRUE / TAG_FALSE   nothing
+//   TAG_INT                          i64
+//   TAG_DOUBLE                       f64
+//   TAG_KEYWORD / TAG_STRING         u16 string index
+//   TAG_VECTOR                       u32 count, then count values
+//   TAG_MAP                          u32 count, then count key, value pairs
+// Keywords and strings are interned, so a course's keys cost two bytes
+// each. The writer buffers the body, since the table comes first.
+
+const uint32_t VERSION = 1;
+const char MAGIC[4] = {'S', 'C', 'R', 'S'};
+
+const int TAG_ERROR = -1;  // Malformed or truncated file
+const int TAG_NIL = 0;
+const int TAG_TRUE = 1;
+const int TAG_FALSE = 2;
+const int TAG_INT = 3;
+const int TAG_DOUBLE = 4;
+const int TAG_KEYWORD = 5;
+const int TAG_STRING = 6;
+const int TAG_VECTOR = 7;
+const int TAG_MAP = 8;
+
+// ---- Writing ----
+
+struct Writer {
+    std::vector<std::string> strings;
+    std::unordered_map<std::string, uint16_t> string_ids;
+    std::vector<uint8_t> body;
+    bool overflow = false;  // More than 65536 distinct strings
+};
+
+inline Writer* create_writer() {
+    return new Writer();
+}
+
+inline void destroy_writer(Writer* w) {
+    delete w;
+}
+
+inline void put_bytes(std::vector<uint8_t>* out, const void* data, size_t n) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    out->insert(out->end(), p, p + n);
+}
+
+inline uint16_t intern(Writer* w, const char* s) {
+    auto it = w->string_ids.find(s);
+    if (it != w->string_ids.end()) return it->second;
+    if (w->strings.size() > 0xFFFF) {
+        w->overflow = true;
+        return 0;
+    }
+    uint16_t id = static_cast<uint16_t>(w->strings.size());
+    w->strings.emplace_back(s);
+    w->string_ids.emplace(s, id);
+    return id;
+}
+
+inline void put_tag(Writer* w, int tag) {
+    w->body.push_back(static_cast<uint8_t>(tag));
+}
+
+inline void put_nil(Writer* w) {
+    put_tag(w, TAG_NIL);
+}
+
+inline void put_bool(Writer* w, bool b) {
+    put_tag(w, b ? TAG_TRUE : TAG_FALSE);
+}
+
+inline void put_int(Writer* w, int64_t v) {
+    put_tag(w, TAG_INT);
+    put_bytes(&w->body, &v, sizeof(v));
+}
+
+inline void put_double(Writer* w, double v) {
+    put_tag(w, TAG_DOUBLE);
+    put_bytes(&w->body, &v, sizeof(v));
+}
+
+// name without the leading colon; may carry a namespace ("a/b")
+inline void put_keyword(Writer* w, const char* name) {
+    put_tag(w, TAG_KEYWORD);
+    uint16_t id = intern(w, name);
+    put_bytes(&w->body, &id, sizeof(id));
+}
+
+inline void put_string(Writer* w, const char* s) {
+    put_tag(w, TAG_STRING);
+    uint16_t id = intern(w, s);
+    put_bytes(&w->body, &id, sizeof(id));
+}
+
+// Follow with count values
+inline void put_vector(Writer* w, uint32_t count) {
+    put_tag(w, TAG_VECTOR);
+    put_bytes(&w->body, &count, sizeof(count));
+}
+
+// Follow with count key, value pairs
+inline void put_map(Writer* w, uint32_t count) {
+    put_tag(w, TAG_MAP);
+    put_bytes(&w->body, &count, sizeof(count));
+}
+
+// Write the table and body to path. Returns false if anything failed.
+inline bool save(Writer* w, const char* path) {
+    if (w->overflow) return false;
+    FILE* f = fopen(path, "wb");
+    if (!f) return false;
+    uint32_t count = static_cast<uint32_t>(w->strings.size());
+    bool ok = fwrite(MAGIC, 1, 4, f) == 4 &&
+              fwrite(&VERSION, sizeof(VERSION), 1, f) == 1 &&
+              fwrite(&count, sizeof(count), 1, f) == 1;
+    for (const std::string& s : w->strings) {
+        if (!ok) break;
+        uint16_t len = static_cast<uint16_t>(s.size() > 0xFFFF ? 0xFFFF : s.size());
+        ok = fwrite(&len, sizeof(len), 1, f) == 1 && fwrite(s.data(), 1, len, f) == len;
+    }
+    ok = ok && fwrite(w->body.data(), 1, w->body.size(), f) == w->body.size();
+    return fclose(f) == 0 && ok;
+}
+
+// ---- Reading ----
+
+struct Reader {
+    std::vector<uint8_t> data;
+    std::vector<std::string> strings;
+    size_t pos = 0;
+    bool failed = false;
+};
+
+inline bool take(Reader* r, void* out, size_t n) {
+    if (r->failed || r->data.size() - r->pos < n) {
+        r->failed = true;
+        memset(out, 0, n);
+        return false;
+    }
+    memcpy(out, r->data.data() + r->pos, n);
+    r->pos += n;
+    return true;
+}
+
+inline bool is_binary_course(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return false;
+    char magic[4];
+    bool match = fread(magic, 1, 4, f) == 4 && memcmp(magic, MAGIC, 4) == 0;
+    fclose(f);
+    return match;
+}
+
+// Read path and its string table; nullptr if it can't be read or isn't a
+// binary course of this version
+inline Reader* open_reader(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return nullptr;
+    Reader* r = new Reader();
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    r->data.resize(size > 0 ? static_cast<size_t>(size) : 0);
+    bool ok = size > 0 && fread(r->data.data(), 1, r->data.size(), f) == r->data.size();
+    fclose(f);
+
+    char magic[4];
+    uint32_t version = 0, count = 0;
+    ok = ok && take(r, magic, 4) && memcmp(magic, MAGIC, 4) == 0 &&
+         take(r, &version, sizeof(version)) && version == VERSION &&
+         take(r, &count, sizeof(count));
+    for (uint32_t i = 0; ok && i < count; ++i) {
+        uint16_t len = 0;
+        ok = take(r, &len, sizeof(len)) && r->data.size() - r->pos >= len;
+        if (ok) {
+            r->strings.emplace_back(reinterpret_cast<const char*>(r->data.data() + r->pos), len);
+            r->pos += len;
+        }
+    }
+    if (!ok) {
+        delete r;
+        return nullptr;
+    }
+    return r;
+}
+
+inline void close_reader(Reader* r) {
+    delete r;
+}
+
+// The next value's tag; TAG_ERROR past the end or on a bad tag
+inline int read_tag(Reader* r) {
+    uint8_t tag = 0;
+    if (!take(r, &tag, 1) || tag > TAG_MAP) {
+        r->failed = true;
+        return TAG_ERROR;
+    }
+    return tag;
+}
+
+inline int64_t read_int(Reader* r) {
+    int64_t v = 0;
+    take(r, &v, sizeof(v));
+    return v;
+}
+
+inline double read_double(Reader* r) {
+    double v = 0.0;
+    take(r, &v, sizeof(v));
+    return v;
+}
+
+// A keyword's name or a string's text
+inline const char* read_text(Reader* r) {
+    uint16_t id = 0;
+    if (!take(r, &id, sizeof(id)) || id >= r->strings.size()) {
+        r->failed = true;
+        return "";
+    }
+    return r->strings[id].c_str();
+}
+
+// A vector's or map's entry count
+inline uint32_t read_count(Reader* r) {
+    uint32_t n = 0;
+    take(r, &n, sizeof(n));
+    // Every entry takes at least a byte, so a larger count is corrupt
+    if (n > r->data.size() - r->pos) {
+        r->failed = true;
+        return 0;
+    }
+    return n;
+}
+
+inline bool reader_ok(Reader* r) {
+    return !r->failed;
+}
+
+} // namespace scourse
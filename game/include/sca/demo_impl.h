@@ -0,0 +1,250 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <utility>
+#include <vector>
+#include "engine/io_impl.h"
+#include "engine/wire_impl.h"
+
+namespace sdemo {
+
+// ============================================================================
+// Demo files
+// ============================================================================
+// A match recorded as binary snapshots (sca.networking.demo), seekable: a
+// full keyframe every so often, deltas against the previous frame in
+// between, and an index of the keyframes at the end. Playback maps the
+// file and starts decoding at the keyframe before the wanted time.
+//
+// Layout, little-endian:
+//   "SCDM" u32 VERSION
+//   frames, each: u8 FRAME_KEY / FRAME_DELTA | f64 server time | u32 length |
+//                 payload (a :snapshot message, engine.networking.protocol)
+//   index: u32 keyframe count, then per keyframe f64 server time, u64 offset
+//          f64 last frame's server time
+//          u32 net id count, then per id u16 id, 16-byte UUID
+//   trailer: u64 index offset, "SCDX"
+// Payloads' :net-id fields use the demo's own id table, written last since
+// players join as it records.
+
+const uint32_t VERSION = 1;
+const char MAGIC[4] = {'S', 'C', 'D', 'M'};
+const char TRAILER_MAGIC[4] = {'S', 'C', 'D', 'X'};
+const size_t HEADER_BYTES = 8;
+const size_t FRAME_HEADER_BYTES = 13;
+const size_t TRAILER_BYTES = 12;
+
+const int FRAME_DELTA = 0;
+const int FRAME_KEY = 1;
+
+struct Keyframe {
+    double time;
+    uint64_t offset;
+};
+
+// ---- Writing ----
+
+struct Writer {
+    FILE* file = nullptr;
+    uint64_t offset = 0;
+    double last_time = 0.0;
+    bool failed = false;
+    std::vector<Keyframe> keyframes;
+    std::vector<unsigned char> ids;  // id table entries, written at close
+    uint32_t id_count = 0;
+};
+
+inline void write_raw(Writer* w, const void* data, size_t n) {
+    if (!w->file || w->failed) return;
+    if (fwrite(data, 1, n, w->file) != n) w->failed = true;
+    w->offset += n;
+}
+
+// [NULL POINTER] check writer_ok rather than the pointer
+inline Writer* open_writer(const char* path) {
+    Writer* w = new Writer();
+    w->file = fopen(path, "wb");
+    write_raw(w, MAGIC, 4);
+    write_raw(w, &VERSION, sizeof(VERSION));
+    return w;
+}
+
+inline bool writer_ok(Writer* w) {
+    return w->file != nullptr && !w->failed;
+}
+
+inline void write_frame(Writer* w, bool keyframe, double server_time,
+                        const std::vector<unsigned char>* payload) {
+    if (keyframe) w->keyframes.push_back({server_time, w->offset});
+    uint8_t kind = keyframe ? FRAME_KEY : FRAME_DELTA;
+    uint32_t len = static_cast<uint32_t>(payload->size());
+    write_raw(w, &kind, 1);
+    write_raw(w, &server_time, sizeof(server_time));
+    write_raw(w, &len, sizeof(len));
+    write_raw(w, payload->data(), payload->size());
+    w->last_time = server_time;
+}
+
+// Map the demo's net id to uuid (canonical text)
+inline void add_id(Writer* w, int id, const char* uuid) {
+    uint16_t id16 = static_cast<uint16_t>(id);
+    w->ids.insert(w->ids.end(), reinterpret_cast<unsigned char*>(&id16),
+                  reinterpret_cast<unsigned char*>(&id16) + sizeof(id16));
+    ewire::write_uuid(&w->ids, uuid);
+    w->id_count++;
+}
+
+// Write the index and trailer, close and free w. Returns false if any
+// write failed.
+inline bool close_writer(Writer* w) {
+    uint64_t index_offset = w->offset;
+    uint32_t count = static_cast<uint32_t>(w->keyframes.size());
+    write_raw(w, &count, sizeof(count));
+    for (const Keyframe& k : w->keyframes) {
+        write_raw(w, &k.time, sizeof(k.time));
+        write_raw(w, &k.offset, sizeof(k.offset));
+    }
+    write_raw(w, &w->last_time, sizeof(w->last_time));
+    write_raw(w, &w->id_count, sizeof(w->id_count));
+    write_raw(w, w->ids.data(), w->ids.size());
+    write_raw(w, &index_offset, sizeof(index_offset));
+    write_raw(w, TRAILER_MAGIC, 4);
+    bool ok = writer_ok(w);
+    if (w->file && fclose(w->file) != 0) ok = false;
+    delete w;
+    return ok;
+}
+
+// ---- Reading ----
+// Frames are read in place from the mapping; a frame's payload stays
+// valid until the reader is closed.
+
+struct Reader {
+    eio::MappedFile* file = nullptr;
+    std::vector<Keyframe> keyframes;
+    std::vector<std::pair<int, std::string>> ids;
+    double end_time = 0.0;
+    size_t frames_end = 0;  // where the index starts
+    size_t pos = 0;         // next frame
+    int kind = FRAME_DELTA;
+    double time = 0.0;
+    size_t payload = 0;
+    size_t length = 0;
+};
+
+inline bool take(ewire::Reader* r, void* out, size_t n) {
+    if (!ewire::reader_take(r, n)) return false;
+    memcpy(out, r->data + r->pos, n);
+    r->pos += n;
+    return true;
+}
+
+inline void close_reader(Reader* r) {
+    if (!r) return;
+    eio::unmap_file(r->file);
+    delete r;
+}
+
+// nullptr if path can't be mapped or isn't a whole demo of this version
+// (one still being written has no index yet)
+inline Reader* open_reader(const char* path) {
+    eio::MappedFile* file = eio::map_file(path);
+    if (!file) return nullptr;
+    Reader* r = new Reader();
+    r->file = file;
+    const unsigned char* d = file->data;
+    size_t size = file->size;
+    uint32_t version = 0;
+    uint64_t index_offset = 0;
+    bool ok = size >= HEADER_BYTES + TRAILER_BYTES && memcmp(d, MAGIC, 4) == 0 &&
+              memcmp(d + size - 4, TRAILER_MAGIC, 4) == 0;
+    if (ok) {
+        memcpy(&version, d + 4, sizeof(version));
+        memcpy(&index_offset, d + size - TRAILER_BYTES, sizeof(index_offset));
+        ok = version == VERSION && index_offset >= HEADER_BYTES &&
+             index_offset <= size - TRAILER_BYTES;
+    }
+
+    ewire::Reader index;
+    if (ok) {
+        ewire::reader_init_span(&index, d + index_offset, size - TRAILER_BYTES - index_offset);
+        uint32_t count = 0;
+        ok = take(&index, &count, sizeof(count));
+        for (uint32_t i = 0; ok && i < count; ++i) {
+            Keyframe k;
+            ok = take(&index, &k.time, sizeof(k.time)) && take(&index, &k.offset, sizeof(k.offset)) &&
+                 k.offset >= HEADER_BYTES && k.offset < index_offset;
+            r->keyframes.push_back(k);
+        }
+        uint32_t id_count = 0;
+        ok = ok && take(&index, &r->end_time, sizeof(r->end_time)) &&
+             take(&index, &id_count, sizeof(id_count));
+        for (uint32_t i = 0; ok && i < id_count; ++i) {
+            uint16_t id = 0;
+            ok = take(&index, &id, sizeof(id));
+            const char* uuid = ewire::read_uuid(&index);
+            ok = ok && ewire::read_ok(&index);
+            r->ids.emplace_back(id, uuid);
+        }
+    }
+    if (!ok) {
+        close_reader(r);
+        return nullptr;
+    }
+    r->frames_end = static_cast<size_t>(index_offset);
+    r->pos = HEADER_BYTES;
+    return r;
+}
+
+inline int keyframe_count(Reader* r) { return static_cast<int>(r->keyframes.size()); }
+inline double start_time(Reader* r) { return r->keyframes.empty() ? 0.0 : r->keyframes[0].time; }
+inline double end_time(Reader* r) { return r->end_time; }
+
+inline int id_count(Reader* r) { return static_cast<int>(r->ids.size()); }
+inline int id_at(Reader* r, int i) { return r->ids[i].first; }
+inline const char* id_uuid(Reader* r, int i) { return r->ids[i].second.c_str(); }
+
+// Move to the last keyframe at or before time (the first, before the
+// start). The next frame read is that keyframe. Returns its time.
+inline double seek(Reader* r, double time) {
+    if (r->keyframes.empty()) {
+        r->pos = r->frames_end;
+        return 0.0;
+    }
+    size_t lo = 0, hi = r->keyframes.size();
+    while (hi - lo > 1) {
+        size_t mid = (lo + hi) / 2;
+        if (r->keyframes[mid].time <= time) lo = mid; else hi = mid;
+    }
+    r->pos = static_cast<size_t>(r->keyframes[lo].offset);
+    return r->keyframes[lo].time;
+}
+
+// Advance to the next frame; false at the end (or on a truncated frame)
+inline bool next_frame(Reader* r) {
+    if (r->frames_end - r->pos < FRAME_HEADER_BYTES) return false;
+    const unsigned char* d = r->file->data + r->pos;
+    uint32_t len = 0;
+    memcpy(&r->time, d + 1, sizeof(r->time));
+    memcpy(&len, d + 1 + sizeof(r->time), sizeof(len));
+    if (r->frames_end - r->pos - FRAME_HEADER_BYTES < len) return false;
+    r->kind = d[0];
+    r->payload = r->pos + FRAME_HEADER_BYTES;
+    r->length = len;
+    r->pos = r->payload + len;
+    return true;
+}
+
+inline bool frame_keyframe(Reader* r) { return r->kind == FRAME_KEY; }
+inline double frame_time(Reader* r) { return r->time; }
+inline int frame_length(Reader* r) { return static_cast<int>(r->length); }
+
+// Point reader at the current frame's payload, for protocol decode-reader
+inline void frame_reader(Reader* r, ewire::Reader* reader) {
+    ewire::reader_init_span(reader, r->file->data + r->payload, r->length);
+}
+
+} // namespace sdemo
@@ -20,9 +20,26 @@ inline bool init_glew() {
 #endif
 }
 
+// Set when the window needs repainting (exposed or resized) although
+// nothing in the editor changed; the idle build loop redraws on it
+inline bool window_damaged = true;
+
 inline void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
     (void) window;
     glViewport(0, 0, width, height);
+    window_damaged = true;
+}
+
+inline void window_refresh_callback(GLFWwindow* window) {
+    (void) window;
+    window_damaged = true;
+}
+
+// Whether the window was damaged since the last call
+inline bool take_window_damage() {
+    bool damaged = window_damaged;
+    window_damaged = false;
+    return damaged;
 }
 
 } // namespace esd
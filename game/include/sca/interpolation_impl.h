@@ -0,0 +1,222 @@
+#pragma once
+
+#include <math.h>
+#include <vector>
+
+namespace sinterp {
+
+// ============================================================================
+// Remote entity interpolation
+// ============================================================================
+// Native side of sca.networking.interpolation. Each received snapshot is
+// packed once into a ring slot (one row per entity); a transition copies the
+// two active snapshots into from/to and records which to-row each from-row
+// continues as. Every frame then lerps all rows into one float buffer, so
+// per-frame cost is a flat loop with no jank allocation per entity.
+//
+// When the next snapshot is late, rows with no next state are dead-reckoned
+// along their velocity for as long as the caller allows. Whatever a row
+// was last drawn at is carried across a transition (interp_carry) and the
+// difference to its new position is blended out over blend_ms, so neither
+// a late snapshot nor a mispredicted extrapolation shows up as a snap.
+
+// Packed snapshot row
+const int S_PX = 0, S_PY = 1, S_PZ = 2;
+const int S_VX = 3, S_VY = 4, S_VZ = 5;
+const int S_PITCH = 6, S_YAW = 7;
+const int S_ANIM_INDEX = 8, S_ANIM_TIME = 9;
+const int S_GROUNDED = 10;
+const int SNAP_STRIDE = 11;
+
+// Output row (interp_get field ids)
+const int O_PX = 0, O_PY = 1, O_PZ = 2;
+const int O_PITCH = 3, O_YAW = 4;
+const int O_VX = 5, O_VY = 6, O_VZ = 7;
+const int O_ANIM_INDEX = 8, O_ANIM_TIME = 9;
+const int O_GROUNDED = 10;
+const int O_INTERPOLATE = 11;
+const int OUT_STRIDE = 12;
+
+struct Frame {
+    std::vector<float> rows;
+    int count = 0;
+};
+
+struct Interp {
+    std::vector<Frame> ring;
+    Frame from, to;
+    bool has_to = false;
+    std::vector<int> match;    // from-row -> to-row, -1 if gone
+    std::vector<float> out;    // OUT_STRIDE floats per from-row
+    std::vector<float> prev;   // out as of the last interp_link
+    std::vector<float> offset; // 3 per from-row: drawn minus computed position, blending to 0
+    std::vector<float> carried;// 3 per from-row: position drawn before the link
+    std::vector<char> carry;   // from-row -> carried holds a position still to offset against
+    float teleport_sq = 100.0f;
+    float anim_wrap = 0.8f;
+    float blend_ms = 100.0f;
+};
+
+inline Interp* create_interp(int slots, double teleport_threshold, double anim_wrap,
+                             double blend_ms) {
+    Interp* ip = new Interp();
+    ip->ring.resize(slots > 0 ? (size_t)slots : 1);
+    ip->teleport_sq = (float)(teleport_threshold * teleport_threshold);
+    ip->anim_wrap = (float)anim_wrap;
+    ip->blend_ms = blend_ms > 0.0 ? (float)blend_ms : 1.0f;
+    return ip;
+}
+
+// ============================================================================
+// Packing
+// ============================================================================
+
+inline void frame_begin(Interp* ip, int slot, int count) {
+    Frame& f = ip->ring[(size_t)slot];
+    f.count = count;
+    f.rows.assign((size_t)count * SNAP_STRIDE, 0.0f);
+}
+
+inline void frame_set(Interp* ip, int slot, int row,
+                      double px, double py, double pz,
+                      double vx, double vy, double vz,
+                      double pitch, double yaw,
+                      int anim_index, double anim_time, bool grounded) {
+    float* r = ip->ring[(size_t)slot].rows.data() + (size_t)row * SNAP_STRIDE;
+    r[S_PX] = (float)px; r[S_PY] = (float)py; r[S_PZ] = (float)pz;
+    r[S_VX] = (float)vx; r[S_VY] = (float)vy; r[S_VZ] = (float)vz;
+    r[S_PITCH] = (float)pitch; r[S_YAW] = (float)yaw;
+    r[S_ANIM_INDEX] = (float)anim_index;
+    r[S_ANIM_TIME] = (float)anim_time;
+    r[S_GROUNDED] = grounded ? 1.0f : 0.0f;
+}
+
+// Make ring slots the active pair; to_slot < 0 holds from (no next snapshot).
+// Rows start unmatched; interp_match links the ones present in both.
+inline void interp_link(Interp* ip, int from_slot, int to_slot) {
+    ip->from = ip->ring[(size_t)from_slot];
+    ip->has_to = to_slot >= 0;
+    if (ip->has_to) ip->to = ip->ring[(size_t)to_slot];
+    size_t n = (size_t)ip->from.count;
+    ip->match.assign(n, -1);
+    ip->prev.swap(ip->out);
+    ip->out.assign(n * OUT_STRIDE, 0.0f);
+    ip->offset.assign(n * 3, 0.0f);
+    ip->carried.assign(n * 3, 0.0f);
+    ip->carry.assign(n, 0);
+}
+
+inline void interp_match(Interp* ip, int from_row, int to_row) {
+    ip->match[(size_t)from_row] = to_row;
+}
+
+// The entity at from_row was drawn at row prev_row before the last link;
+// blend from there rather than jump to its new position
+inline void interp_carry(Interp* ip, int from_row, int prev_row) {
+    if ((size_t)(prev_row + 1) * OUT_STRIDE > ip->prev.size()) return;
+    const float* p = ip->prev.data() + (size_t)prev_row * OUT_STRIDE;
+    float* c = ip->carried.data() + (size_t)from_row * 3;
+    c[0] = p[O_PX]; c[1] = p[O_PY]; c[2] = p[O_PZ];
+    ip->carry[(size_t)from_row] = 1;
+}
+
+// ============================================================================
+// Per-frame pass
+// ============================================================================
+
+inline float lerp_angle(float a, float b, float t) {
+    float diff = b - a;
+    if (diff > 180.0f) diff -= 360.0f;
+    else if (diff < -180.0f) diff += 360.0f;
+    return a + diff * t;
+}
+
+// Position offsets: carried positions become offsets against the row's
+// position this frame (dropped past the teleport threshold), and every
+// offset shrinks linearly to zero over blend_ms
+inline void apply_offsets(Interp* ip, float dt_ms) {
+    float keep = 1.0f - dt_ms / ip->blend_ms;
+    if (keep < 0.0f) keep = 0.0f;
+    int n = ip->from.count;
+    for (int i = 0; i < n; i++) {
+        float* o = ip->out.data() + (size_t)i * OUT_STRIDE;
+        float* d = ip->offset.data() + (size_t)i * 3;
+        if (ip->carry[(size_t)i]) {
+            const float* c = ip->carried.data() + (size_t)i * 3;
+            d[0] = c[0] - o[O_PX]; d[1] = c[1] - o[O_PY]; d[2] = c[2] - o[O_PZ];
+            if (d[0] * d[0] + d[1] * d[1] + d[2] * d[2] >= ip->teleport_sq) {
+                d[0] = d[1] = d[2] = 0.0f;
+            }
+            ip->carry[(size_t)i] = 0;
+        } else {
+            d[0] *= keep; d[1] *= keep; d[2] *= keep;
+        }
+        o[O_PX] += d[0]; o[O_PY] += d[1]; o[O_PZ] += d[2];
+    }
+}
+
+// Same rules as the old per-entity path: teleports (> threshold) and
+// entities missing from the next snapshot hold their current state;
+// animation time only lerps within one animation, forward across a loop.
+// With no next snapshot at all, rows move extrapolate_ms along their
+// velocity instead of holding. dt_ms is the render time since the last run.
+inline void interp_run(Interp* ip, double lerp_factor, double extrapolate_ms, double dt_ms) {
+    float t = (float)lerp_factor;
+    float ext = ip->has_to ? 0.0f : (float)(extrapolate_ms * 0.001);
+    int n = ip->from.count;
+    for (int i = 0; i < n; i++) {
+        const float* a = ip->from.rows.data() + (size_t)i * SNAP_STRIDE;
+        float* o = ip->out.data() + (size_t)i * OUT_STRIDE;
+        int j = ip->has_to ? ip->match[(size_t)i] : -1;
+        const float* b = j >= 0 ? ip->to.rows.data() + (size_t)j * SNAP_STRIDE : nullptr;
+        if (b) {
+            float dx = b[S_PX] - a[S_PX], dy = b[S_PY] - a[S_PY], dz = b[S_PZ] - a[S_PZ];
+            if (dx * dx + dy * dy + dz * dz >= ip->teleport_sq) b = nullptr;
+        }
+        o[O_ANIM_INDEX] = a[S_ANIM_INDEX];
+        o[O_GROUNDED] = a[S_GROUNDED];
+        if (!b) {
+            o[O_PX] = a[S_PX] + a[S_VX] * ext;
+            o[O_PY] = a[S_PY] + a[S_VY] * ext;
+            o[O_PZ] = a[S_PZ] + a[S_VZ] * ext;
+            o[O_PITCH] = a[S_PITCH]; o[O_YAW] = a[S_YAW];
+            o[O_VX] = a[S_VX]; o[O_VY] = a[S_VY]; o[O_VZ] = a[S_VZ];
+            o[O_ANIM_TIME] = a[S_ANIM_TIME];
+            o[O_INTERPOLATE] = 0.0f;
+            continue;
+        }
+        o[O_PX] = a[S_PX] + (b[S_PX] - a[S_PX]) * t;
+        o[O_PY] = a[S_PY] + (b[S_PY] - a[S_PY]) * t;
+        o[O_PZ] = a[S_PZ] + (b[S_PZ] - a[S_PZ]) * t;
+        o[O_PITCH] = lerp_angle(a[S_PITCH], b[S_PITCH], t);
+        o[O_YAW] = lerp_angle(a[S_YAW], b[S_YAW], t);
+        o[O_VX] = a[S_VX] + (b[S_VX] - a[S_VX]) * t;
+        o[O_VY] = a[S_VY] + (b[S_VY] - a[S_VY]) * t;
+        o[O_VZ] = a[S_VZ] + (b[S_VZ] - a[S_VZ]) * t;
+        float ta = a[S_ANIM_TIME], tb = b[S_ANIM_TIME];
+        if (a[S_ANIM_INDEX] != b[S_ANIM_INDEX]) {
+            o[O_ANIM_TIME] = ta;
+        } else if (tb < ta) {
+            o[O_ANIM_TIME] = fmodf(ta + (tb + ip->anim_wrap - ta) * t, ip->anim_wrap);
+        } else {
+            o[O_ANIM_TIME] = ta + (tb - ta) * t;
+        }
+        o[O_INTERPOLATE] = 1.0f;
+    }
+    apply_offsets(ip, (float)dt_ms);
+}
+
+inline int interp_count(Interp* ip) {
+    return (int)ip->out.size() / OUT_STRIDE;
+}
+
+inline double interp_get(Interp* ip, int row, int field) {
+    return (double)ip->out[(size_t)row * OUT_STRIDE + field];
+}
+
+// Whole output buffer, OUT_STRIDE floats per row
+inline float* interp_buffer(Interp* ip) {
+    return ip->out.data();
+}
+
+} // namespace sinterp
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdio.h>
+
+namespace smap {
+
+// ============================================================================
+// Streaming .map writer
+// ============================================================================
+// sca.editor.map-format writes straight into a block-buffered FILE* instead
+// of building the file as one string. Points go through here: Y-up engine
+// coords become Z-up Quake coords, scaled and truncated like (int ...).
+
+const size_t WRITE_BUFFER_SIZE = 1 << 16;
+
+inline FILE* open_map(const char* path) {
+    FILE* f = fopen(path, "w");
+    if (f) setvbuf(f, nullptr, _IOFBF, WRITE_BUFFER_SIZE);
+    return f;
+}
+
+// Returns false if anything failed to write
+inline bool close_map(FILE* f) {
+    bool ok = !ferror(f);
+    return fclose(f) == 0 && ok;
+}
+
+inline void write_point(FILE* f, double scale, double x, double y, double z) {
+    fprintf(f, "( %d %d %d )", (int)(x * scale), (int)(z * scale), (int)(y * scale));
+}
+
+// Three plane points, p2 and p3 swapped to flip the inward engine normal
+// to the outward one .map expects
+inline void write_plane_points(FILE* f, double scale,
+                               double x1, double y1, double z1,
+                               double x2, double y2, double z2,
+                               double x3, double y3, double z3) {
+    write_point(f, scale, x1, y1, z1);
+    fputc(' ', f);
+    write_point(f, scale, x3, y3, z3);
+    fputc(' ', f);
+    write_point(f, scale, x2, y2, z2);
+}
+
+inline void write_text(FILE* f, const char* s) {
+    fputs(s, f);
+}
+
+} // namespace smap
@@ -0,0 +1,431 @@
+#pragma once
+
+#include <algorithm>
+#include <math.h>
+#include <vector>
+#include <cstdint>
+#include "engine/collision_impl.h"
+#include "engine/jobs_impl.h"
+#include "engine/wire_impl.h"
+#include "sca/pmove_impl.h"
+
+namespace pstore {
+
+// ============================================================================
+// Player component store
+// ============================================================================
+// Server-side player physics and animation state as flat arrays indexed by
+// a dense slot (sca.player-store). Ticks run pmove on a slot in place and
+// leave the result at wire precision, so the server's per-command work
+// allocates nothing on the jank heap.
+// Slots are reused after removal; different slots may step (or queue)
+// concurrently, but add/remove must not overlap a step.
+
+const uint8_t FLAG_GROUNDED = 1;
+const uint8_t FLAG_HAS_JUMP_Z = 2;
+const uint8_t FLAG_BACKFLIP = 4;
+const uint8_t FLAG_LIVE = 8;
+
+// store_get field ids
+const int F_PX = 0, F_PY = 1, F_PZ = 2;
+const int F_VX = 3, F_VY = 4, F_VZ = 5;
+const int F_PITCH = 6, F_YAW = 7;
+const int F_JUMP_Z = 8;
+const int F_ANIM_TIME = 9;
+
+// A command waiting for store_run_queued
+struct QueuedCommand {
+    bool forward, backward, left, right, jump_held;
+    double pitch, yaw, dt;
+};
+
+struct PlayerStore {
+    std::vector<double> px, py, pz;
+    std::vector<double> vx, vy, vz;
+    std::vector<double> pitch, yaw;
+    std::vector<double> jump_z;
+    std::vector<uint8_t> flags;
+    std::vector<int> anim_index;
+    std::vector<double> anim_time;
+    std::vector<ecol::ProbeCache*> caches;
+    std::vector<uint32_t> generation;  // Bumped on every store_add, so reuse is detectable
+    std::vector<int> free_slots;
+    std::vector<std::vector<QueuedCommand>> queued;  // Per slot, in arrival order
+
+    // Wire precision (engine.networking.protocol [:fixed scale nbytes])
+    double pos_scale = 64.0;
+    int pos_bytes = 3;
+    double vel_scale = 16.0;
+    int vel_bytes = 2;
+};
+
+inline PlayerStore* create_store(double pos_scale, int pos_bytes, double vel_scale, int vel_bytes) {
+    PlayerStore* s = new PlayerStore();
+    s->pos_scale = pos_scale;
+    s->pos_bytes = pos_bytes;
+    s->vel_scale = vel_scale;
+    s->vel_bytes = vel_bytes;
+    return s;
+}
+
+// Frees every slot's probe cache, live or not
+inline void destroy_store(PlayerStore* s) {
+    for (ecol::ProbeCache* cache : s->caches) ecol::destroy_probe_cache(cache);
+    delete s;
+}
+
+inline int store_add(PlayerStore* s, double px, double py, double pz, double pitch, double yaw) {
+    int slot;
+    if (!s->free_slots.empty()) {
+        slot = s->free_slots.back();
+        s->free_slots.pop_back();
+    } else {
+        slot = (int)s->px.size();
+        s->px.push_back(0.0); s->py.push_back(0.0); s->pz.push_back(0.0);
+        s->vx.push_back(0.0); s->vy.push_back(0.0); s->vz.push_back(0.0);
+        s->pitch.push_back(0.0); s->yaw.push_back(0.0);
+        s->jump_z.push_back(0.0);
+        s->flags.push_back(0);
+        s->anim_index.push_back(0);
+        s->anim_time.push_back(0.0);
+        s->caches.push_back(ecol::create_probe_cache());
+        s->generation.push_back(0);
+        s->queued.emplace_back();
+    }
+    s->generation[slot]++;
+    s->px[slot] = px; s->py[slot] = py; s->pz[slot] = pz;
+    s->vx[slot] = 0.0; s->vy[slot] = 0.0; s->vz[slot] = 0.0;
+    s->pitch[slot] = pitch; s->yaw[slot] = yaw;
+    s->jump_z[slot] = 0.0;
+    s->flags[slot] = FLAG_LIVE | FLAG_GROUNDED;
+    s->anim_index[slot] = 0;
+    s->anim_time[slot] = 0.0;
+    s->caches[slot]->last_tri = -1;
+    s->queued[slot].clear();
+    return slot;
+}
+
+inline void store_remove(PlayerStore* s, int slot) {
+    if (slot < 0 || slot >= (int)s->flags.size() || !(s->flags[slot] & FLAG_LIVE)) return;
+    s->flags[slot] = 0;
+    s->queued[slot].clear();
+    s->free_slots.push_back(slot);
+}
+
+inline double store_get(PlayerStore* s, int slot, int field) {
+    switch (field) {
+        case F_PX: return s->px[slot];
+        case F_PY: return s->py[slot];
+        case F_PZ: return s->pz[slot];
+        case F_VX: return s->vx[slot];
+        case F_VY: return s->vy[slot];
+        case F_VZ: return s->vz[slot];
+        case F_PITCH: return s->pitch[slot];
+        case F_YAW: return s->yaw[slot];
+        case F_JUMP_Z: return s->jump_z[slot];
+        case F_ANIM_TIME: return s->anim_time[slot];
+    }
+    return 0.0;
+}
+
+inline bool store_flag(PlayerStore* s, int slot, int flag) {
+    return (s->flags[slot] & flag) != 0;
+}
+
+inline int store_anim_index(PlayerStore* s, int slot) {
+    return s->anim_index[slot];
+}
+
+// Same rules as sca.physics/compute-animation-state: crouch held at 30% in
+// the air, run advancing with horizontal speed on the ground, frame 0 idle
+inline void update_animation(PlayerStore* s, int slot, double run_duration, double dt) {
+    float vx = (float)s->vx[slot];
+    float vz = (float)s->vz[slot];
+    float speed = sqrtf(vx * vx + vz * vz);
+    if (!(s->flags[slot] & FLAG_GROUNDED)) {
+        s->anim_index[slot] = 1;
+        s->anim_time[slot] = 0.3 * run_duration;
+    } else if (speed > 0.5f) {
+        double t = fmod(s->anim_time[slot] + dt * ((double)speed / 8.0), run_duration);
+        s->anim_index[slot] = 0;
+        s->anim_time[slot] = t < 0.0 ? t + run_duration : t;
+    } else {
+        s->anim_index[slot] = 0;
+        s->anim_time[slot] = 0.0;
+    }
+}
+
+inline pmove::PlayerMove store_move(PlayerStore* s, int slot) {
+    uint8_t f = s->flags[slot];
+    pmove::PlayerMove m;
+    m.px = s->px[slot]; m.py = s->py[slot]; m.pz = s->pz[slot];
+    m.vx = s->vx[slot]; m.vy = s->vy[slot]; m.vz = s->vz[slot];
+    m.grounded = (f & FLAG_GROUNDED) != 0;
+    m.has_jump_z = (f & FLAG_HAS_JUMP_Z) != 0;
+    m.jump_z = s->jump_z[slot];
+    m.backflip = (f & FLAG_BACKFLIP) != 0;
+    return m;
+}
+
+// Write a command's pmove result back at wire precision, then animation
+inline void store_commit(PlayerStore* s, int slot, const pmove::PlayerMove& m,
+                         double pitch, double yaw, double dt, double run_duration) {
+    s->px[slot] = ewire::quantize_fixed(m.px, s->pos_scale, s->pos_bytes);
+    s->py[slot] = ewire::quantize_fixed(m.py, s->pos_scale, s->pos_bytes);
+    s->pz[slot] = ewire::quantize_fixed(m.pz, s->pos_scale, s->pos_bytes);
+    s->vx[slot] = ewire::quantize_fixed(m.vx, s->vel_scale, s->vel_bytes);
+    s->vy[slot] = ewire::quantize_fixed(m.vy, s->vel_scale, s->vel_bytes);
+    s->vz[slot] = ewire::quantize_fixed(m.vz, s->vel_scale, s->vel_bytes);
+    s->pitch[slot] = ewire::quantize_angle16(pitch);
+    s->yaw[slot] = ewire::quantize_angle16(yaw);
+    s->jump_z[slot] = m.jump_z;
+    s->flags[slot] = FLAG_LIVE
+        | (m.grounded ? FLAG_GROUNDED : 0)
+        | (m.has_jump_z ? FLAG_HAS_JUMP_Z : 0)
+        | (m.backflip ? FLAG_BACKFLIP : 0);
+
+    update_animation(s, slot, run_duration, dt);
+}
+
+// One command for slot: pmove in place, rounded to wire precision, then
+// animation. positions may be null (no collision).
+inline void store_step(PlayerStore* s, int slot,
+                       ecol::Positions* positions, ecol::Indices* indices,
+                       ecol::Bvh* bvh,
+                       bool forward, bool backward, bool left, bool right, bool jump_held,
+                       double pitch, double yaw, double dt, double run_duration) {
+    pmove::PlayerMove m = store_move(s, slot);
+    pmove::pmove(&m, positions, indices, bvh, positions ? s->caches[slot] : nullptr,
+                 forward, backward, left, right, jump_held, yaw, dt);
+    store_commit(s, slot, m, pitch, yaw, dt, run_duration);
+}
+
+// [NULL POINTER] no collision mesh
+inline void store_step_no_collision(PlayerStore* s, int slot,
+                                    bool forward, bool backward, bool left, bool right,
+                                    bool jump_held, double pitch, double yaw, double dt,
+                                    double run_duration) {
+    store_step(s, slot, nullptr, nullptr, nullptr, forward, backward, left, right, jump_held,
+               pitch, yaw, dt, run_duration);
+}
+
+// ============================================================================
+// Batched commands
+// ============================================================================
+// Commands queued per slot as they arrive and run together, four players
+// per pmove::pmove4 call. Round r runs every slot's rth queued command, so
+// each player's commands still run in order; a round's groups of four are
+// split over the job pool. Each command's result is the same as
+// store_step's.
+
+inline void store_queue(PlayerStore* s, int slot,
+                        bool forward, bool backward, bool left, bool right, bool jump_held,
+                        double pitch, double yaw, double dt) {
+    s->queued[slot].push_back({forward, backward, left, right, jump_held, pitch, yaw, dt});
+}
+
+// Run every queued command and empty the queues. workers caps the pool
+// workers helping (-1: any, 0: this thread alone). positions may be null
+// (no collision). Returns the commands run.
+inline int store_run_queued(PlayerStore* s, ecol::Positions* positions, ecol::Indices* indices,
+                            ecol::Bvh* bvh, double run_duration, int workers) {
+    int slots = (int)s->queued.size();
+    size_t rounds = 0;
+    for (int i = 0; i < slots; i++) rounds = std::max(rounds, s->queued[i].size());
+    int run = 0;
+    std::vector<int> ready;
+    for (size_t r = 0; r < rounds; r++) {
+        ready.clear();
+        for (int i = 0; i < slots; i++) {
+            if ((s->flags[i] & FLAG_LIVE) && s->queued[i].size() > r) ready.push_back(i);
+        }
+        int groups = ((int)ready.size() + pmove::LANES - 1) / pmove::LANES;
+        ejobs::parallel_for(groups, 1, [&](int g) {
+            pmove::Move4 m;
+            int first = g * pmove::LANES;
+            m.count = std::min(pmove::LANES, (int)ready.size() - first);
+            for (int k = 0; k < m.count; k++) {
+                int slot = ready[first + k];
+                const QueuedCommand& c = s->queued[slot][r];
+                pmove::move4_set(&m, k, store_move(s, slot), c.forward, c.backward, c.left, c.right,
+                                 c.jump_held, c.yaw, c.dt, positions ? s->caches[slot] : nullptr);
+            }
+            pmove::pmove4(&m, positions, indices, bvh);
+            for (int k = 0; k < m.count; k++) {
+                int slot = ready[first + k];
+                const QueuedCommand& c = s->queued[slot][r];
+                pmove::PlayerMove result;
+                pmove::move4_get(&m, k, &result);
+                store_commit(s, slot, result, c.pitch, c.yaw, c.dt, run_duration);
+            }
+        }, workers);
+        run += (int)ready.size();
+    }
+    for (int i = 0; i < slots; i++) s->queued[i].clear();
+    return run;
+}
+
+// [NULL POINTER] no collision mesh
+inline int store_run_queued_no_collision(PlayerStore* s, double run_duration, int workers) {
+    return store_run_queued(s, nullptr, nullptr, nullptr, run_duration, workers);
+}
+
+// ============================================================================
+// Lag compensation history
+// ============================================================================
+// The last `frames` ticks of every slot's position and yaw, so hit tests can
+// rewind players to where a shooter saw them. One frame is recorded after
+// each tick; its rows are flat arrays indexed frame * capacity + slot, and
+// capacity grows with the store. A row only counts for the slot's current
+// occupant (its generation), so a reused slot never inherits old positions.
+// Bounds are an axis-aligned box around the player's feet position.
+
+struct History {
+    int frames = 60;
+    int capacity = 0;
+    int newest = -1;            // Frame written last
+    std::vector<double> times;  // Server time per frame (ms); -1 if unwritten
+    std::vector<float> px, py, pz, yaw;
+    std::vector<uint32_t> generation;  // 0: no live player in the row
+    float half_width = 0.4f;
+    float height = 1.8f;
+    double hit_distance = -1.0;  // Of the last history_raycast hit
+};
+
+inline History* create_history(int frames, double half_width, double height) {
+    History* h = new History();
+    h->frames = frames > 1 ? frames : 2;
+    h->times.assign((size_t)h->frames, -1.0);
+    h->half_width = (float)half_width;
+    h->height = (float)height;
+    return h;
+}
+
+inline void history_grow(History* h, int capacity) {
+    size_t n = (size_t)h->frames * (size_t)capacity;
+    std::vector<float> px(n, 0.0f), py(n, 0.0f), pz(n, 0.0f), yaw(n, 0.0f);
+    std::vector<uint32_t> generation(n, 0);
+    for (int f = 0; f < h->frames; f++) {
+        for (int i = 0; i < h->capacity; i++) {
+            size_t from = (size_t)f * h->capacity + i, to = (size_t)f * capacity + i;
+            px[to] = h->px[from]; py[to] = h->py[from]; pz[to] = h->pz[from];
+            yaw[to] = h->yaw[from];
+            generation[to] = h->generation[from];
+        }
+    }
+    h->px.swap(px); h->py.swap(py); h->pz.swap(pz); h->yaw.swap(yaw);
+    h->generation.swap(generation);
+    h->capacity = capacity;
+}
+
+// Record every slot of s as of server_time (ms)
+inline void history_record(History* h, PlayerStore* s, double server_time) {
+    int slots = (int)s->flags.size();
+    if (slots > h->capacity) history_grow(h, slots);
+    int f = (h->newest + 1) % h->frames;
+    h->newest = f;
+    h->times[(size_t)f] = server_time;
+    size_t base = (size_t)f * h->capacity;
+    for (int i = 0; i < h->capacity; i++) {
+        bool live = i < slots && (s->flags[i] & FLAG_LIVE);
+        h->generation[base + i] = live ? s->generation[i] : 0;
+        if (!live) continue;
+        h->px[base + i] = (float)s->px[i];
+        h->py[base + i] = (float)s->py[i];
+        h->pz[base + i] = (float)s->pz[i];
+        h->yaw[base + i] = (float)s->yaw[i];
+    }
+}
+
+// The frames around time: *a at or before it and *b after (-1 if none), and
+// the lerp factor between them. Times outside the history clamp to its ends.
+inline float history_bracket(const History* h, double time, int* a, int* b) {
+    *a = -1; *b = -1;
+    for (int k = 0; k < h->frames; k++) {
+        double t = h->times[(size_t)k];
+        if (t < 0.0) continue;
+        if (t <= time) {
+            if (*a < 0 || t > h->times[(size_t)*a]) *a = k;
+        } else if (*b < 0 || t < h->times[(size_t)*b]) {
+            *b = k;
+        }
+    }
+    if (*a < 0) { *a = *b; *b = -1; }
+    if (*a < 0 || *b < 0) return 0.0f;
+    double ta = h->times[(size_t)*a], tb = h->times[(size_t)*b];
+    return (float)((time - ta) / (tb - ta));
+}
+
+// Closest player slot hit by the ray at server time `time`, with players
+// rewound to their recorded positions and the level (if positions is
+// non-null) blocking; -1 if none. skip_slot (the shooter) is ignored. The
+// distance is left in h->hit_distance (history_hit_distance).
+inline int history_raycast(History* h, PlayerStore* s,
+                           ecol::Positions* positions, ecol::Indices* indices, ecol::Bvh* bvh,
+                           double time,
+                           double ox, double oy, double oz,
+                           double dx, double dy, double dz,
+                           double max_dist, int skip_slot) {
+    h->hit_distance = -1.0;
+    glm::vec3 origin((float)ox, (float)oy, (float)oz);
+    glm::vec3 dir((float)dx, (float)dy, (float)dz);
+    float len = glm::length(dir);
+    if (len <= 0.0f) return -1;
+    dir /= len;
+    glm::vec3 inv_dir;
+    for (int k = 0; k < 3; k++) inv_dir[k] = 1.0f / (dir[k] != 0.0f ? dir[k] : 1e-30f);
+
+    int a, b;
+    float t = history_bracket(h, time, &a, &b);
+    if (a < 0) return -1;
+    int slots = std::min(h->capacity, (int)s->generation.size());
+    size_t base_a = (size_t)a * h->capacity;
+    size_t base_b = b >= 0 ? (size_t)b * h->capacity : 0;
+    float closest = (float)max_dist;
+    int hit = -1;
+    for (int i = 0; i < slots; i++) {
+        uint32_t gen = s->generation[i];
+        if (i == skip_slot || !(s->flags[i] & FLAG_LIVE) || h->generation[base_a + i] != gen) {
+            continue;
+        }
+        glm::vec3 p(h->px[base_a + i], h->py[base_a + i], h->pz[base_a + i]);
+        if (b >= 0 && h->generation[base_b + i] == gen) {
+            glm::vec3 q(h->px[base_b + i], h->py[base_b + i], h->pz[base_b + i]);
+            p += (q - p) * t;
+        }
+        glm::vec3 bmin(p.x - h->half_width, p.y, p.z - h->half_width);
+        glm::vec3 bmax(p.x + h->half_width, p.y + h->height, p.z + h->half_width);
+        float d = ecol::ray_aabb(origin, inv_dir, bmin, bmax, closest);
+        if (d < closest) {
+            closest = d;
+            hit = i;
+        }
+    }
+    if (hit >= 0 && positions) {
+        float wall_t;
+        if (ecol::ray_closest_hit(positions, indices, bvh, origin, dir, closest, &wall_t, nullptr) >= 0) {
+            return -1;
+        }
+    }
+    if (hit >= 0) h->hit_distance = closest;
+    return hit;
+}
+
+// [NULL POINTER] no collision mesh
+inline int history_raycast_no_collision(History* h, PlayerStore* s, double time,
+                                        double ox, double oy, double oz,
+                                        double dx, double dy, double dz,
+                                        double max_dist, int skip_slot) {
+    return history_raycast(h, s, nullptr, nullptr, nullptr, time, ox, oy, oz, dx, dy, dz,
+                           max_dist, skip_slot);
+}
+
+inline double history_hit_distance(History* h) {
+    return h->hit_distance;
+}
+
+inline void destroy_history(History* h) {
+    delete h;
+}
+
+} // namespace pstore
@@ -0,0 +1,805 @@
+#pragma once
+
+#include <math.h>
+#include <vector>
+#include <glm/glm.hpp>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "engine/collision_impl.h"
+#include "engine/wire_impl.h"
+
+// Client and server must agree bit for bit, and pmove4 with pmove, so no
+// fused multiply-add here whatever the build's -ffp-contract says
+#if defined(__clang__)
+#pragma float_control(push)
+#pragma clang fp contract(off)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+namespace pmove {
+
+// ============================================================================
+// Player movement kernel
+// ============================================================================
+// One physics tick for a player, shared by server simulation and client
+// prediction (sca.physics/simulate-physics). Both sides run this exact code
+// on the same quantized inputs, so their results are bit-identical.
+// Quake-style: ground friction and acceleration in float, the rest in
+// double.
+
+const double GRAVITY = 25.6;
+const double JUMP_VELOCITY = 7.2;
+const double BACKFLIP_VELOCITY = 11.3;     // JUMP_VELOCITY + 4.1 boost, no force jump thrust
+const double FORCE_JUMP_STRENGTH = 26.88;  // Level 3 force jump
+const double FORCE_JUMP_HEIGHT = 12.3;     // Level 3 max height
+const float GROUND_ACCEL = 10.0f;
+const float AIR_ACCEL = 1.0f;              // 10:1 ratio for air control
+const float FRICTION = 6.0f;
+const float STOP_SPEED = 2.5f;
+const float MAX_SPEED = 8.0f;
+const float MIN_WALK_NORMAL = 0.7f;        // ~45 degrees
+const float WALL_PROBE_RADIUS = 0.15f;     // Waist-height wall sweep sphere
+const double WALL_BUFFER = 0.3;
+const double MAX_STEP = 1.0;
+const float NO_GROUND = -99999.0f;
+const double MAX_SUBSTEP = 0.02;           // Longer ticks are split; a 60 Hz tick is one step
+const int MAX_SUBSTEPS = 8;                // Time past MAX_SUBSTEP * MAX_SUBSTEPS is dropped
+const double REGION_MARGIN = 0.5;          // Slack around a tick's broadphase box
+
+struct PlayerMove {
+    double px = 0.0, py = 0.0, pz = 0.0;
+    double vx = 0.0, vy = 0.0, vz = 0.0;
+    bool grounded = true;
+    bool has_jump_z = false;   // jump held since takeoff at jump_z
+    double jump_z = 0.0;
+    bool backflip = false;
+};
+
+// This thread's scratch PlayerMove, set to the given state. It stays valid
+// until the next call on the same thread, which is long enough for one
+// pmove/replay and reading its result back; nothing is allocated.
+inline PlayerMove* make_player_move(double px, double py, double pz,
+                                    double vx, double vy, double vz,
+                                    bool grounded, bool has_jump_z, double jump_z,
+                                    bool backflip) {
+    thread_local PlayerMove scratch;
+    PlayerMove* s = &scratch;
+    s->px = px; s->py = py; s->pz = pz;
+    s->vx = vx; s->vy = vy; s->vz = vz;
+    s->grounded = grounded;
+    s->has_jump_z = has_jump_z;
+    s->jump_z = jump_z;
+    s->backflip = backflip;
+    return s;
+}
+
+// Friction - scales horizontal velocity down toward zero
+inline void friction(double* vx, double* vz, float friction, float stopspeed, float dt) {
+    float vxf = (float)*vx;
+    float vzf = (float)*vz;
+    float speed = sqrtf(vxf * vxf + vzf * vzf);
+    if (speed < 0.1f) {
+        *vx = 0.0;
+        *vz = 0.0;
+        return;
+    }
+    float control = speed < stopspeed ? stopspeed : speed;
+    float newspeed = speed - control * (friction * dt);
+    if (newspeed < 0.0f) newspeed = 0.0f;
+    float scale = newspeed / speed;
+    *vx = (double)(vxf * scale);
+    *vz = (double)(vzf * scale);
+}
+
+// Acceleration toward wish direction (dx, dz), up to wishspeed along it
+inline void accelerate(double* vx, double* vz, double dx, double dz,
+                       float wishspeed, float accel, float dt) {
+    float dxf = (float)dx;
+    float dzf = (float)dz;
+    float vxf = (float)*vx;
+    float vzf = (float)*vz;
+    float wish_len = sqrtf(dxf * dxf + dzf * dzf);
+    *vx = (double)vxf;
+    *vz = (double)vzf;
+    if (wish_len < 0.001f) return;
+    float nx = dxf / wish_len;
+    float nz = dzf / wish_len;
+    float addspeed = wishspeed - (vxf * nx + vzf * nz);
+    if (addspeed <= 0.0f) return;
+    float accelspeed = accel * (dt * wishspeed);
+    if (accelspeed > addspeed) accelspeed = addspeed;
+    *vx = (double)(vxf + accelspeed * nx);
+    *vz = (double)(vzf + accelspeed * nz);
+}
+
+// Unnormalized wish direction from movement keys and yaw (degrees)
+inline void wish_direction(bool forward, bool backward, bool left, bool right, double yaw,
+                           double* out_x, double* out_z) {
+    float r = glm::radians((float)yaw);
+    double front_x = (double)cosf(r);
+    double front_z = (double)sinf(r);
+    double right_x = (double)sinf(r);
+    double right_z = (double)(0.0f - cosf(r));
+    double x = 0.0, z = 0.0;
+    if (forward)  { x += front_x; z += front_z; }
+    if (backward) { x -= front_x; z -= front_z; }
+    if (left)     { x += right_x; z += right_z; }
+    if (right)    { x -= right_x; z -= right_z; }
+    *out_x = x;
+    *out_z = z;
+}
+
+// Ground Y under (x, y, z) and its normal, from the tick's region when
+// there is one (see pmove), else the Bvh
+inline float raycast_ground(ecol::Positions* positions, ecol::Indices* indices,
+                            ecol::Bvh* bvh, ecol::ProbeCache* cache, ecol::QueryRegion* region,
+                            double x, double y, double z, float* nx, float* ny, float* nz) {
+    if (region) return ecol::region_raycast_ground(region, (float)x, (float)y, (float)z, nx, ny, nz);
+    return ecol::raycast_ground_normal_cached(positions, indices, bvh, cache,
+                                              (float)x, (float)y, (float)z, nx, ny, nz);
+}
+
+// Walkable ground Y under (x, y, z), or NO_GROUND; normal Y to out_ny
+inline float probe_ground(ecol::Positions* positions, ecol::Indices* indices,
+                          ecol::Bvh* bvh, ecol::ProbeCache* cache, ecol::QueryRegion* region,
+                          double x, double y, double z, float* out_ny) {
+    float nx = 0.0f, ny = 1.0f, nz = 0.0f;
+    float h = raycast_ground(positions, indices, bvh, cache, region, x, y, z, &nx, &ny, &nz);
+    if (out_ny) *out_ny = ny;
+    return (h > -99998.0f && ny >= MIN_WALK_NORMAL) ? h : NO_GROUND;
+}
+
+// Sweep the waist sphere along one axis; returns how far the player may move
+inline double clip_axis_move(ecol::Positions* positions, ecol::Indices* indices,
+                             ecol::Bvh* bvh, ecol::QueryRegion* region,
+                             double ox, double oy, double oz,
+                             int axis, double move, bool* out_hit) {
+    *out_hit = false;
+    double dist = move > 0.0 ? move : -move;
+    double dir = move > 0.0 ? 1.0 : -1.0;
+    if (!positions || dist <= 0.001) return move;
+    double stand_off = WALL_BUFFER - WALL_PROBE_RADIUS;
+    float nx, ny, nz;
+    int tri;
+    float dx = axis == 0 ? (float)dir : 0.0f;
+    float dz = axis == 2 ? (float)dir : 0.0f;
+    float t = region
+        ? ecol::region_sweep_sphere(region, (float)ox, (float)oy, (float)oz, dx, 0.0f, dz,
+                                    WALL_PROBE_RADIUS, (float)(dist + stand_off), MIN_WALK_NORMAL,
+                                    &nx, &ny, &nz, &tri)
+        : ecol::sweep_sphere(positions, indices, bvh, (float)ox, (float)oy, (float)oz, dx, 0.0f, dz,
+                             WALL_PROBE_RADIUS, (float)(dist + stand_off), MIN_WALK_NORMAL,
+                             &nx, &ny, &nz, &tri);
+    if (t < 0.0f) return move;
+    *out_hit = true;
+    double allowed = (double)t - stand_off;
+    return dir * (allowed > 0.0 ? allowed : 0.0);
+}
+
+// One step of at most MAX_SUBSTEP; see pmove
+inline void pmove_step(PlayerMove* s,
+                       ecol::Positions* positions, ecol::Indices* indices,
+                       ecol::Bvh* bvh, ecol::ProbeCache* cache, ecol::QueryRegion* region,
+                       bool forward, bool backward, bool left, bool right, bool jump_held,
+                  double yaw, double dt) {
+    double px = s->px, py = s->py, pz = s->pz;
+    double vx = s->vx, vy = s->vy, vz = s->vz;
+    bool was_grounded = s->grounded;
+    bool has_jump_z = s->has_jump_z;
+    double jump_z = s->jump_z;
+    bool backflip = s->backflip;
+
+    // Ground detection (with surface normal)
+    float ground_nx = 0.0f, ground_ny = 1.0f, ground_nz = 0.0f;
+    bool ground_hit = false;
+    float ground_y = NO_GROUND;
+    if (positions) {
+        ground_y = raycast_ground(positions, indices, bvh, cache, region, px, py, pz,
+                                  &ground_nx, &ground_ny, &ground_nz);
+        ground_hit = ground_y > -99998.0f;
+    }
+    bool grounded = ground_hit && ground_ny >= MIN_WALK_NORMAL && py <= (double)ground_y + 0.2;
+
+    // Clear backflip flag on landing (falling onto ground, not just near it)
+    if (grounded && vy <= 0.0) backflip = false;
+
+    double wish_x, wish_z;
+    wish_direction(forward, backward, left, right, yaw, &wish_x, &wish_z);
+    if (grounded) friction(&vx, &vz, FRICTION, STOP_SPEED, (float)dt);
+    accelerate(&vx, &vz, wish_x, wish_z, MAX_SPEED, grounded ? GROUND_ACCEL : AIR_ACCEL, (float)dt);
+
+    if (!jump_held) has_jump_z = false;
+
+    // Initial jump; a pure backward jump is a backflip (boost, no thrust)
+    if (grounded && jump_held && !has_jump_z) {
+        bool is_backflip = backward && !forward && !left && !right;
+        vy = is_backflip ? BACKFLIP_VELOCITY : JUMP_VELOCITY;
+        grounded = false;
+        has_jump_z = true;
+        jump_z = py;
+        backflip = is_backflip;
+    }
+
+    // Force jump thrust (Metroid-style) while rising with jump held
+    if (!grounded && !backflip && jump_held && has_jump_z && vy > 0.0) {
+        double height = py - jump_z;
+        if (height < FORCE_JUMP_HEIGHT) {
+            vy = (FORCE_JUMP_HEIGHT - height) / FORCE_JUMP_HEIGHT * FORCE_JUMP_STRENGTH / 10.0
+                 + JUMP_VELOCITY;
+        } else if (vy > JUMP_VELOCITY) {
+            vy = JUMP_VELOCITY;
+        }
+    }
+
+    if (!grounded) vy -= GRAVITY * dt;
+
+    // Clip velocity on slope impact only (PM_SlideMove behavior)
+    if (grounded && !was_grounded && ground_hit && ground_ny < 0.99f) {
+        double backoff = vx * ground_nx + vy * ground_ny + vz * ground_nz;
+        vx -= ground_nx * backoff;
+        vy -= ground_ny * backoff;
+        vz -= ground_nz * backoff;
+    }
+
+    double new_px = px + vx * dt;
+    double new_py = py + vy * dt;
+    double new_pz = pz + vz * dt;
+
+    // Horizontal collision: sweep at waist height along X, then Z
+    double waist_y = py + 0.5;
+    bool x_hit, z_hit;
+    new_px = px + clip_axis_move(positions, indices, bvh, region, px, waist_y, pz, 0, new_px - px, &x_hit);
+    if (x_hit) vx = 0.0;
+    new_pz = pz + clip_axis_move(positions, indices, bvh, region, new_px, waist_y, pz, 2, new_pz - pz, &z_hit);
+    if (z_hit) vz = 0.0;
+
+    // Clamp to ground, probing old and new XZ to handle ledge transitions
+    if (positions) {
+        float gy_old = probe_ground(positions, indices, bvh, cache, region, px, new_py, pz, nullptr);
+        float gy_new = probe_ground(positions, indices, bvh, cache, region, new_px, new_py, new_pz, nullptr);
+        bool has_old = gy_old != NO_GROUND;
+        bool has_new = gy_new != NO_GROUND;
+        // New ground only if not much higher than old (no suction onto wall tops)
+        bool has_ground = false;
+        double ground = 0.0;
+        if (has_new && !has_old) {
+            if ((double)gy_new - py < MAX_STEP) { has_ground = true; ground = gy_new; }
+        } else if (has_new) {
+            has_ground = true;
+            ground = ((double)gy_new - (double)gy_old < MAX_STEP) ? gy_new : gy_old;
+        }
+        // Don't snap while actively jumping; small slope-projected vy is fine
+        if (has_ground && new_py < ground && vy < JUMP_VELOCITY) {
+            new_py = ground;
+            vy = 0.0;
+            grounded = true;
+            backflip = false;
+        }
+    }
+
+    s->px = new_px; s->py = new_py; s->pz = new_pz;
+    s->vx = vx; s->vy = vy; s->vz = vz;
+    s->grounded = grounded;
+    s->has_jump_z = has_jump_z;
+    s->jump_z = jump_z;
+    s->backflip = backflip;
+}
+
+// Broadphase box for a tick of dt from s: everything the tick's ground rays
+// and wall sweeps can touch. Horizontally, the farthest the player can get
+// (current speed plus the most acceleration, jump and gravity can add) and
+// the wall probe's reach; vertically, the ground rays' start above that
+// and the whole level below.
+inline void tick_bounds(const PlayerMove* s, ecol::Bvh* bvh, double dt,
+                        glm::vec3* out_min, glm::vec3* out_max) {
+    double speed = sqrt(s->vx * s->vx + s->vy * s->vy + s->vz * s->vz);
+    double reach = (speed + (GROUND_ACCEL * MAX_SPEED + GRAVITY) * dt + BACKFLIP_VELOCITY) * dt;
+    double side = reach + WALL_BUFFER + WALL_PROBE_RADIUS + REGION_MARGIN;
+    *out_min = glm::vec3((float)(s->px - side), bvh->nodes[0].bmin.y - 1.0f, (float)(s->pz - side));
+    *out_max = glm::vec3((float)(s->px + side), (float)(s->py + reach + MAX_STEP + 100.0 + REGION_MARGIN),
+                         (float)(s->pz + side));
+}
+
+inline ecol::QueryRegion& tick_region() {
+    thread_local ecol::QueryRegion region;
+    return region;
+}
+
+// One tick. positions may be null (no collision); cache may be null.
+// With a Bvh, the triangles the tick can reach are gathered once
+// (tick_bounds) and every probe of every sub-step tests only those, so
+// the cache isn't needed. A tick longer than MAX_SUBSTEP (a hitch) runs
+// as equal sub-steps, so a long dt can't carry the player through thin
+// geometry in one move.
+inline void pmove(PlayerMove* s,
+                  ecol::Positions* positions, ecol::Indices* indices,
+                  ecol::Bvh* bvh, ecol::ProbeCache* cache,
+                  bool forward, bool backward, bool left, bool right, bool jump_held,
+                  double yaw, double dt) {
+    ecol::QueryRegion* region = nullptr;
+    if (positions && bvh && !bvh->nodes.empty()) {
+        glm::vec3 bmin, bmax;
+        tick_bounds(s, bvh, dt, &bmin, &bmax);
+        region = &tick_region();
+        ecol::region_gather(region, bvh, bmin, bmax);
+    }
+    if (!(dt > MAX_SUBSTEP)) {
+        pmove_step(s, positions, indices, bvh, cache, region,
+                   forward, backward, left, right, jump_held, yaw, dt);
+        return;
+    }
+    int steps = (int)ceil(dt / MAX_SUBSTEP);
+    if (steps > MAX_SUBSTEPS) steps = MAX_SUBSTEPS;
+    double step_dt = fmin(dt / steps, MAX_SUBSTEP);
+    for (int i = 0; i < steps; ++i) {
+        pmove_step(s, positions, indices, bvh, cache, region,
+                   forward, backward, left, right, jump_held, yaw, step_dt);
+    }
+}
+
+// [NULL POINTER] jank has no null to pass, so one entry point per case
+inline void pmove_uncached(PlayerMove* s,
+                           ecol::Positions* positions, ecol::Indices* indices,
+                           ecol::Bvh* bvh,
+                           bool forward, bool backward, bool left, bool right, bool jump_held,
+                           double yaw, double dt) {
+    pmove(s, positions, indices, bvh, nullptr, forward, backward, left, right, jump_held, yaw, dt);
+}
+
+inline void pmove_no_collision(PlayerMove* s,
+                               bool forward, bool backward, bool left, bool right, bool jump_held,
+                               double yaw, double dt) {
+    pmove(s, nullptr, nullptr, nullptr, nullptr, forward, backward, left, right, jump_held, yaw, dt);
+}
+
+// ============================================================================
+// 4-wide movement
+// ============================================================================
+// pmove for four players at once, for the server's batched command runs
+// (pstore::store_run_queued). Collision queries stay per lane, each lane
+// gathering its own tick region as pmove does. The velocity update between
+// them runs on all four lanes together without branches: friction,
+// acceleration, jump, force jump thrust, gravity, slope clip and the
+// move. Masks pick each lane's case. Every lane does pmove_step's
+// arithmetic in the same precision and order, so results match pmove bit
+// for bit and client prediction stays in step; contraction is off for the
+// whole header (see the top). Uses SSE2 on x86;
+// elsewhere the lane loops run pmove_step's own helpers.
+
+const int LANES = 4;
+
+// Lanes past count are idle and stay zero
+struct Move4 {
+    double px[LANES] = {}, py[LANES] = {}, pz[LANES] = {};
+    double vx[LANES] = {}, vy[LANES] = {}, vz[LANES] = {};
+    double jump_z[LANES] = {};
+    bool grounded[LANES] = {}, has_jump_z[LANES] = {}, backflip[LANES] = {};
+    bool forward[LANES] = {}, backward[LANES] = {}, left[LANES] = {}, right[LANES] = {};
+    bool jump_held[LANES] = {};
+    double yaw[LANES] = {}, dt[LANES] = {};
+    ecol::ProbeCache* cache[LANES] = {};
+    int count = 0;  // Lanes in use, from lane 0
+};
+
+inline void move4_set(Move4* m, int k, const PlayerMove& s,
+                      bool forward, bool backward, bool left, bool right, bool jump_held,
+                      double yaw, double dt, ecol::ProbeCache* cache) {
+    m->px[k] = s.px; m->py[k] = s.py; m->pz[k] = s.pz;
+    m->vx[k] = s.vx; m->vy[k] = s.vy; m->vz[k] = s.vz;
+    m->jump_z[k] = s.jump_z;
+    m->grounded[k] = s.grounded;
+    m->has_jump_z[k] = s.has_jump_z;
+    m->backflip[k] = s.backflip;
+    m->forward[k] = forward; m->backward[k] = backward;
+    m->left[k] = left; m->right[k] = right;
+    m->jump_held[k] = jump_held;
+    m->yaw[k] = yaw;
+    m->dt[k] = dt;
+    m->cache[k] = cache;
+}
+
+inline void move4_get(const Move4* m, int k, PlayerMove* s) {
+    s->px = m->px[k]; s->py = m->py[k]; s->pz = m->pz[k];
+    s->vx = m->vx[k]; s->vy = m->vy[k]; s->vz = m->vz[k];
+    s->jump_z = m->jump_z[k];
+    s->grounded = m->grounded[k];
+    s->has_jump_z = m->has_jump_z[k];
+    s->backflip = m->backflip[k];
+}
+
+// Per-lane values pmove4_step's vector part reads and writes
+struct Lanes4 {
+    float ground_nx[LANES], ground_ny[LANES], ground_nz[LANES];
+    bool grounded[LANES];     // Ground under the lane at the step's start
+    bool slope[LANES];        // Hit ground steeper than a slope clip needs
+    bool is_backflip[LANES];  // Backward alone held
+    double wish_x[LANES], wish_z[LANES];
+};
+
+#if defined(__SSE2__)
+inline __m128 select_ps(__m128 mask, __m128 a, __m128 b) {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+inline __m128d select_pd(__m128d mask, __m128d a, __m128d b) {
+    return _mm_or_pd(_mm_and_pd(mask, a), _mm_andnot_pd(mask, b));
+}
+
+inline __m128 mask_ps(const bool* b) {
+    return _mm_castsi128_ps(_mm_set_epi32(-(int)b[3], -(int)b[2], -(int)b[1], -(int)b[0]));
+}
+
+inline __m128d mask_pd(const bool* b) {
+    return _mm_castsi128_pd(_mm_set_epi64x(-(long long)b[1], -(long long)b[0]));
+}
+
+inline void store_mask_pd(__m128d mask, bool* out) {
+    int bits = _mm_movemask_pd(mask);
+    out[0] = (bits & 1) != 0;
+    out[1] = (bits & 2) != 0;
+}
+
+inline __m128 load4_ps(const double* d) {
+    return _mm_movelh_ps(_mm_cvtpd_ps(_mm_loadu_pd(d)), _mm_cvtpd_ps(_mm_loadu_pd(d + 2)));
+}
+
+inline void store4_ps(__m128 f, double* out) {
+    _mm_storeu_pd(out, _mm_cvtps_pd(f));
+    _mm_storeu_pd(out + 2, _mm_cvtps_pd(_mm_movehl_ps(f, f)));
+}
+
+// Friction and acceleration on all lanes (pmove_step's friction and
+// accelerate), float as there
+inline void horizontal4(Move4* m, const Lanes4& l) {
+    __m128 grounded = mask_ps(l.grounded);
+    __m128 vx = load4_ps(m->vx);
+    __m128 vz = load4_ps(m->vz);
+    __m128 dt = load4_ps(m->dt);
+    __m128 zero = _mm_setzero_ps();
+
+    // Friction, grounded lanes
+    __m128 speed = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vz, vz)));
+    __m128 stop = _mm_set1_ps(STOP_SPEED);
+    __m128 control = select_ps(_mm_cmplt_ps(speed, stop), stop, speed);
+    __m128 newspeed = _mm_sub_ps(speed, _mm_mul_ps(control, _mm_mul_ps(_mm_set1_ps(FRICTION), dt)));
+    newspeed = select_ps(_mm_cmplt_ps(newspeed, zero), zero, newspeed);
+    __m128 scale = _mm_div_ps(newspeed, speed);
+    __m128 still = _mm_cmplt_ps(speed, _mm_set1_ps(0.1f));
+    vx = select_ps(grounded, select_ps(still, zero, _mm_mul_ps(vx, scale)), vx);
+    vz = select_ps(grounded, select_ps(still, zero, _mm_mul_ps(vz, scale)), vz);
+
+    // Acceleration toward the wish direction, up to MAX_SPEED along it
+    __m128 dx = load4_ps(l.wish_x);
+    __m128 dz = load4_ps(l.wish_z);
+    __m128 wish_len = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dz, dz)));
+    __m128 nx = _mm_div_ps(dx, wish_len);
+    __m128 nz = _mm_div_ps(dz, wish_len);
+    __m128 wishspeed = _mm_set1_ps(MAX_SPEED);
+    __m128 addspeed = _mm_sub_ps(wishspeed, _mm_add_ps(_mm_mul_ps(vx, nx), _mm_mul_ps(vz, nz)));
+    __m128 accel = select_ps(grounded, _mm_set1_ps(GROUND_ACCEL), _mm_set1_ps(AIR_ACCEL));
+    __m128 accelspeed = _mm_mul_ps(accel, _mm_mul_ps(dt, wishspeed));
+    accelspeed = select_ps(_mm_cmpgt_ps(accelspeed, addspeed), addspeed, accelspeed);
+    __m128 apply = _mm_and_ps(_mm_cmpge_ps(wish_len, _mm_set1_ps(0.001f)),
+                              _mm_cmpgt_ps(addspeed, zero));
+    vx = select_ps(apply, _mm_add_ps(vx, _mm_mul_ps(accelspeed, nx)), vx);
+    vz = select_ps(apply, _mm_add_ps(vz, _mm_mul_ps(accelspeed, nz)), vz);
+
+    store4_ps(vx, m->vx);
+    store4_ps(vz, m->vz);
+}
+
+// Jump, force jump thrust, gravity and slope clip, two lanes per register
+// (double, as in pmove_step); new positions to out_p*
+inline void vertical4(Move4* m, Lanes4& l, double* out_px, double* out_py, double* out_pz) {
+    for (int h = 0; h < LANES; h += 2) {
+        __m128d zero = _mm_setzero_pd();
+        __m128d jv = _mm_set1_pd(JUMP_VELOCITY);
+        __m128d py = _mm_loadu_pd(m->py + h);
+        __m128d vx = _mm_loadu_pd(m->vx + h);
+        __m128d vy = _mm_loadu_pd(m->vy + h);
+        __m128d vz = _mm_loadu_pd(m->vz + h);
+        __m128d jump_z = _mm_loadu_pd(m->jump_z + h);
+        __m128d dt = _mm_loadu_pd(m->dt + h);
+        __m128d was_grounded = mask_pd(m->grounded + h);
+        __m128d grounded = mask_pd(l.grounded + h);
+        __m128d jump_held = mask_pd(m->jump_held + h);
+        __m128d has_jump_z = _mm_and_pd(mask_pd(m->has_jump_z + h), jump_held);
+        __m128d is_backflip = mask_pd(l.is_backflip + h);
+
+        // Landing clears the backflip flag
+        __m128d backflip = _mm_andnot_pd(_mm_and_pd(grounded, _mm_cmple_pd(vy, zero)),
+                                         mask_pd(m->backflip + h));
+
+        // Initial jump
+        __m128d jump = _mm_andnot_pd(has_jump_z, _mm_and_pd(grounded, jump_held));
+        vy = select_pd(jump, select_pd(is_backflip, _mm_set1_pd(BACKFLIP_VELOCITY), jv), vy);
+        grounded = _mm_andnot_pd(jump, grounded);
+        has_jump_z = _mm_or_pd(has_jump_z, jump);
+        jump_z = select_pd(jump, py, jump_z);
+        backflip = select_pd(jump, is_backflip, backflip);
+
+        // Force jump thrust while rising with jump held
+        __m128d thrust = _mm_andnot_pd(_mm_or_pd(grounded, backflip),
+                                       _mm_and_pd(_mm_and_pd(jump_held, has_jump_z),
+                                                  _mm_cmpgt_pd(vy, zero)));
+        __m128d fjh = _mm_set1_pd(FORCE_JUMP_HEIGHT);
+        __m128d height = _mm_sub_pd(py, jump_z);
+        __m128d boost = _mm_add_pd(
+            _mm_div_pd(_mm_mul_pd(_mm_div_pd(_mm_sub_pd(fjh, height), fjh),
+                                  _mm_set1_pd(FORCE_JUMP_STRENGTH)),
+                       _mm_set1_pd(10.0)),
+            jv);
+        __m128d capped = select_pd(_mm_cmpgt_pd(vy, jv), jv, vy);
+        vy = select_pd(thrust, select_pd(_mm_cmplt_pd(height, fjh), boost, capped), vy);
+
+        vy = select_pd(grounded, vy, _mm_sub_pd(vy, _mm_mul_pd(_mm_set1_pd(GRAVITY), dt)));
+
+        // Clip velocity on slope impact only
+        __m128d clip = _mm_andnot_pd(was_grounded, _mm_and_pd(grounded, mask_pd(l.slope + h)));
+        __m128d nx = _mm_set_pd((double)l.ground_nx[h + 1], (double)l.ground_nx[h]);
+        __m128d ny = _mm_set_pd((double)l.ground_ny[h + 1], (double)l.ground_ny[h]);
+        __m128d nz = _mm_set_pd((double)l.ground_nz[h + 1], (double)l.ground_nz[h]);
+        __m128d backoff = _mm_add_pd(_mm_add_pd(_mm_mul_pd(vx, nx), _mm_mul_pd(vy, ny)),
+                                     _mm_mul_pd(vz, nz));
+        vx = select_pd(clip, _mm_sub_pd(vx, _mm_mul_pd(nx, backoff)), vx);
+        vy = select_pd(clip, _mm_sub_pd(vy, _mm_mul_pd(ny, backoff)), vy);
+        vz = select_pd(clip, _mm_sub_pd(vz, _mm_mul_pd(nz, backoff)), vz);
+
+        _mm_storeu_pd(out_px + h, _mm_add_pd(_mm_loadu_pd(m->px + h), _mm_mul_pd(vx, dt)));
+        _mm_storeu_pd(out_py + h, _mm_add_pd(py, _mm_mul_pd(vy, dt)));
+        _mm_storeu_pd(out_pz + h, _mm_add_pd(_mm_loadu_pd(m->pz + h), _mm_mul_pd(vz, dt)));
+        _mm_storeu_pd(m->vx + h, vx);
+        _mm_storeu_pd(m->vy + h, vy);
+        _mm_storeu_pd(m->vz + h, vz);
+        _mm_storeu_pd(m->jump_z + h, jump_z);
+        store_mask_pd(grounded, l.grounded + h);
+        store_mask_pd(has_jump_z, m->has_jump_z + h);
+        store_mask_pd(backflip, m->backflip + h);
+    }
+}
+#else
+inline void horizontal4(Move4* m, const Lanes4& l) {
+    for (int k = 0; k < LANES; k++) {
+        if (l.grounded[k]) friction(&m->vx[k], &m->vz[k], FRICTION, STOP_SPEED, (float)m->dt[k]);
+        accelerate(&m->vx[k], &m->vz[k], l.wish_x[k], l.wish_z[k], MAX_SPEED,
+                   l.grounded[k] ? GROUND_ACCEL : AIR_ACCEL, (float)m->dt[k]);
+    }
+}
+
+inline void vertical4(Move4* m, Lanes4& l, double* out_px, double* out_py, double* out_pz) {
+    for (int k = 0; k < LANES; k++) {
+        double dt = m->dt[k];
+        bool grounded = l.grounded[k];
+        bool jump_held = m->jump_held[k];
+        bool has_jump_z = m->has_jump_z[k] && jump_held;
+        bool backflip = m->backflip[k] && !(grounded && m->vy[k] <= 0.0);
+        bool jump = grounded && jump_held && !has_jump_z;
+        double vy = jump ? (l.is_backflip[k] ? BACKFLIP_VELOCITY : JUMP_VELOCITY) : m->vy[k];
+        grounded = grounded && !jump;
+        has_jump_z = has_jump_z || jump;
+        double jump_z = jump ? m->py[k] : m->jump_z[k];
+        backflip = jump ? l.is_backflip[k] : backflip;
+        double height = m->py[k] - jump_z;
+        double boost = (FORCE_JUMP_HEIGHT - height) / FORCE_JUMP_HEIGHT * FORCE_JUMP_STRENGTH / 10.0
+                       + JUMP_VELOCITY;
+        double capped = vy > JUMP_VELOCITY ? JUMP_VELOCITY : vy;
+        bool thrust = !grounded && !backflip && jump_held && has_jump_z && vy > 0.0;
+        vy = thrust ? (height < FORCE_JUMP_HEIGHT ? boost : capped) : vy;
+        vy = grounded ? vy : vy - GRAVITY * dt;
+        double vx = m->vx[k], vz = m->vz[k];
+        if (grounded && !m->grounded[k] && l.slope[k]) {
+            double backoff = vx * l.ground_nx[k] + vy * l.ground_ny[k] + vz * l.ground_nz[k];
+            vx -= l.ground_nx[k] * backoff;
+            vy -= l.ground_ny[k] * backoff;
+            vz -= l.ground_nz[k] * backoff;
+        }
+        out_px[k] = m->px[k] + vx * dt;
+        out_py[k] = m->py[k] + vy * dt;
+        out_pz[k] = m->pz[k] + vz * dt;
+        m->vx[k] = vx; m->vy[k] = vy; m->vz[k] = vz;
+        m->jump_z[k] = jump_z;
+        l.grounded[k] = grounded;
+        m->has_jump_z[k] = has_jump_z;
+        m->backflip[k] = backflip;
+    }
+}
+#endif
+
+// One step of each active lane by its dt (pmove_step on four players).
+// Inactive lanes come out as they went in.
+inline void pmove4_step(Move4* m, const bool* active,
+                        ecol::Positions* positions, ecol::Indices* indices,
+                        ecol::Bvh* bvh, ecol::QueryRegion** regions) {
+    bool all_active = active[0] && active[1] && active[2] && active[3];
+    Move4 in;
+    if (!all_active) in = *m;
+    Lanes4 l;
+    for (int k = 0; k < LANES; k++) {
+        // Ground detection (with surface normal); idle lanes run on their
+        // copy and are restored below
+        float gnx = 0.0f, gny = 1.0f, gnz = 0.0f;
+        bool hit = false;
+        float gy = NO_GROUND;
+        if (positions && active[k]) {
+            gy = raycast_ground(positions, indices, bvh, m->cache[k], regions[k],
+                                m->px[k], m->py[k], m->pz[k], &gnx, &gny, &gnz);
+            hit = gy > -99998.0f;
+        }
+        l.ground_nx[k] = gnx; l.ground_ny[k] = gny; l.ground_nz[k] = gnz;
+        l.grounded[k] = hit && gny >= MIN_WALK_NORMAL && m->py[k] <= (double)gy + 0.2;
+        l.slope[k] = hit && gny < 0.99f;
+        l.is_backflip[k] = m->backward[k] && !m->forward[k] && !m->left[k] && !m->right[k];
+        wish_direction(m->forward[k], m->backward[k], m->left[k], m->right[k], m->yaw[k],
+                       &l.wish_x[k], &l.wish_z[k]);
+    }
+
+    horizontal4(m, l);
+    double new_px[LANES], new_py[LANES], new_pz[LANES];
+    vertical4(m, l, new_px, new_py, new_pz);
+
+    for (int k = 0; k < LANES; k++) {
+        if (!active[k]) {
+            PlayerMove s;
+            move4_get(&in, k, &s);
+            move4_set(m, k, s, in.forward[k], in.backward[k], in.left[k], in.right[k],
+                      in.jump_held[k], in.yaw[k], in.dt[k], in.cache[k]);
+            continue;
+        }
+        double px = m->px[k], py = m->py[k], pz = m->pz[k];
+        bool grounded = l.grounded[k];
+
+        // Horizontal collision: sweep at waist height along X, then Z
+        double waist_y = py + 0.5;
+        bool x_hit, z_hit;
+        double npx = px + clip_axis_move(positions, indices, bvh, regions[k], px, waist_y, pz, 0,
+                                         new_px[k] - px, &x_hit);
+        if (x_hit) m->vx[k] = 0.0;
+        double npz = pz + clip_axis_move(positions, indices, bvh, regions[k], npx, waist_y, pz, 2,
+                                         new_pz[k] - pz, &z_hit);
+        if (z_hit) m->vz[k] = 0.0;
+        double npy = new_py[k];
+
+        // Clamp to ground, probing old and new XZ (as pmove_step)
+        if (positions) {
+            float gy_old = probe_ground(positions, indices, bvh, m->cache[k], regions[k],
+                                        px, npy, pz, nullptr);
+            float gy_new = probe_ground(positions, indices, bvh, m->cache[k], regions[k],
+                                        npx, npy, npz, nullptr);
+            bool has_old = gy_old != NO_GROUND;
+            bool has_new = gy_new != NO_GROUND;
+            bool has_ground = false;
+            double ground = 0.0;
+            if (has_new && !has_old) {
+                if ((double)gy_new - py < MAX_STEP) { has_ground = true; ground = gy_new; }
+            } else if (has_new) {
+                has_ground = true;
+                ground = ((double)gy_new - (double)gy_old < MAX_STEP) ? gy_new : gy_old;
+            }
+            if (has_ground && npy < ground && m->vy[k] < JUMP_VELOCITY) {
+                npy = ground;
+                m->vy[k] = 0.0;
+                grounded = true;
+                m->backflip[k] = false;
+            }
+        }
+
+        m->px[k] = npx; m->py[k] = npy; m->pz[k] = npz;
+        m->grounded[k] = grounded;
+    }
+}
+
+// pmove on m's lanes, each by its own dt: the same tick regions and
+// sub-steps, four lanes a step. positions may be null (no collision).
+inline void pmove4(Move4* m, ecol::Positions* positions, ecol::Indices* indices, ecol::Bvh* bvh) {
+    thread_local ecol::QueryRegion lane_regions[LANES];
+    ecol::QueryRegion* regions[LANES] = {nullptr, nullptr, nullptr, nullptr};
+    int steps[LANES] = {0, 0, 0, 0};
+    double step_dt[LANES];
+    int rounds = 0;
+    for (int k = 0; k < m->count; k++) {
+        if (positions && bvh && !bvh->nodes.empty()) {
+            PlayerMove s;
+            move4_get(m, k, &s);
+            glm::vec3 bmin, bmax;
+            tick_bounds(&s, bvh, m->dt[k], &bmin, &bmax);
+            regions[k] = &lane_regions[k];
+            ecol::region_gather(regions[k], bvh, bmin, bmax);
+        }
+        double dt = m->dt[k];
+        if (!(dt > MAX_SUBSTEP)) {
+            steps[k] = 1;
+            step_dt[k] = dt;
+        } else {
+            steps[k] = (int)ceil(dt / MAX_SUBSTEP);
+            if (steps[k] > MAX_SUBSTEPS) steps[k] = MAX_SUBSTEPS;
+            step_dt[k] = fmin(dt / steps[k], MAX_SUBSTEP);
+        }
+        if (steps[k] > rounds) rounds = steps[k];
+    }
+    double tick_dt[LANES];
+    for (int k = 0; k < LANES; k++) {
+        tick_dt[k] = m->dt[k];
+        if (k < m->count) m->dt[k] = step_dt[k];
+    }
+    for (int r = 0; r < rounds; r++) {
+        bool active[LANES];
+        for (int k = 0; k < LANES; k++) active[k] = r < steps[k];
+        pmove4_step(m, active, positions, indices, bvh, regions);
+    }
+    for (int k = 0; k < LANES; k++) m->dt[k] = tick_dt[k];
+}
+
+// ============================================================================
+// Replay
+// ============================================================================
+// Reconciliation re-runs the unacknowledged commands from the server's
+// state. The inputs are queued here (replay_clear, replay_push) and run
+// back to back on one PlayerMove, so the tail costs no per-tick state
+// maps. With pos_scale > 0 each tick ends as the client's physics-fn
+// does: dt at f32, position and velocity rounded to their wire fixed
+// point (ewire::quantize_fixed).
+
+struct ReplayInput {
+    bool forward, backward, left, right, jump_held;
+    double yaw;
+    double dt;
+};
+
+inline std::vector<ReplayInput>& replay_inputs() {
+    thread_local std::vector<ReplayInput> inputs;
+    return inputs;
+}
+
+inline void replay_clear() { replay_inputs().clear(); }
+
+inline void replay_push(bool forward, bool backward, bool left, bool right, bool jump_held,
+                        double yaw, double dt) {
+    replay_inputs().push_back({forward, backward, left, right, jump_held, yaw, dt});
+}
+
+inline int replay_count() { return (int)replay_inputs().size(); }
+
+// Run the queued inputs on s; positions may be null, as in pmove
+inline void replay(PlayerMove* s,
+                   ecol::Positions* positions, ecol::Indices* indices,
+                   ecol::Bvh* bvh, ecol::ProbeCache* cache,
+                   double pos_scale, int pos_bytes, double vel_scale, int vel_bytes) {
+    bool quantize = pos_scale > 0.0;
+    for (const ReplayInput& in : replay_inputs()) {
+        double dt = quantize ? (double)(float)in.dt : in.dt;
+        pmove(s, positions, indices, bvh, cache,
+              in.forward, in.backward, in.left, in.right, in.jump_held, in.yaw, dt);
+        if (quantize) {
+            s->px = ewire::quantize_fixed(s->px, pos_scale, pos_bytes);
+            s->py = ewire::quantize_fixed(s->py, pos_scale, pos_bytes);
+            s->pz = ewire::quantize_fixed(s->pz, pos_scale, pos_bytes);
+            s->vx = ewire::quantize_fixed(s->vx, vel_scale, vel_bytes);
+            s->vy = ewire::quantize_fixed(s->vy, vel_scale, vel_bytes);
+            s->vz = ewire::quantize_fixed(s->vz, vel_scale, vel_bytes);
+        }
+    }
+}
+
+inline void replay_uncached(PlayerMove* s,
+                            ecol::Positions* positions, ecol::Indices* indices,
+                            ecol::Bvh* bvh,
+                            double pos_scale, int pos_bytes, double vel_scale, int vel_bytes) {
+    replay(s, positions, indices, bvh, nullptr, pos_scale, pos_bytes, vel_scale, vel_bytes);
+}
+
+inline void replay_no_collision(PlayerMove* s,
+                                double pos_scale, int pos_bytes, double vel_scale, int vel_bytes) {
+    replay(s, nullptr, nullptr, nullptr, nullptr, pos_scale, pos_bytes, vel_scale, vel_bytes);
+}
+
+} // namespace pmove
+
+#if defined(__clang__)
+#pragma float_control(pop)
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
@@ -3,6 +3,9 @@
 #include "gl_wrappers.h"
 #include <GLFW/glfw3.h>
 #include "animation_types.h"
+#include "engine/gl_state_impl.h"
+#include "engine/shaders_impl.h"
+#include <cmath>
 #include <vector>
 #include <iostream>
 #include <cstdio>
@@ -30,6 +33,25 @@ inline void framebuffer_size_callback(GLFWwindow* window, int width, int height)
     glViewport(0, 0, width, height);
 }
 
+// Stress mode's per-character path: one draw of a create-skinned-vao mesh
+// standing at (x, y, z), turned yaw_degrees about +Y, as
+// eanim::instance_batch_add_placed places an instance. The skinned shader
+// is in use with the palette bound and this draw's offset set.
+inline void draw_skinned_placed(GLuint shader, GLuint vao, int index_count,
+                                float x, float y, float z, float yaw_degrees) {
+    float a = yaw_degrees * 0.017453292519943295f;
+    float c = std::cos(a), s = std::sin(a);
+    const float model[16] = {
+        c,    0.0f, -s,   0.0f,
+        0.0f, 1.0f, 0.0f, 0.0f,
+        s,    0.0f, c,    0.0f,
+        x,    y,    z,    1.0f,
+    };
+    glUniformMatrix4fv(eshaders::uniform_location(shader, "model"), 1, GL_FALSE, model);
+    eglstate::bind_vertex_array(vao);
+    wrap_glDrawElements(GL_TRIANGLES, index_count, GL_UNSIGNED_SHORT, (void*)0);
+}
+
 inline void print_bone_lines(float* vertices, int line_count, int max_print) {
     std::cout << std::endl << "=== BONE LINES BEING RENDERED ===" << std::endl;
     for (int i = 0; i < line_count && i < max_print; ++i) {
@@ -17,7 +17,10 @@
       opengl-libs (if (= platform-os "macos") ["OpenGL"] ["GL" "GLEW"])
       optimization-level (some-> (System/getenv "JANK_OPTIMIZATION_LEVEL")
                                  Integer/parseInt)
-      runtime (keyword (or (System/getenv "JANK_RUNTIME") "static"))]
+      runtime (keyword (or (System/getenv "JANK_RUNTIME") "static"))
+      ;; Dedicated server bundles (bake --profile server) link no window,
+      ;; GL, image, animation or embedded render asset libraries
+      server? (= "server" (System/getenv "JANK_BAKE_PROFILE"))]
   {:name (or (System/getenv "JANK_NAME") "sca")
    :target-dir (or (System/getenv "JANK_TARGET_DIR") "target/debug")
    :optimization-level (or optimization-level 0)
@@ -34,12 +37,14 @@
                   (str libs-dir "/cgltf/lib")
                   (str libs-dir "/opengl/lib")
                   (str libs-dir "/engine-assets/lib")]
-   :linked-libraries (vec (concat [glfw-lib
-                                   "ozz_animation_r"
-                                   "ozz_base_r"
-                                   "ozz_geometry_r"
-                                   "stb_all"
-                                   "enet"
-                                   "cgltf"
-                                   "engine_assets"]
-                                  opengl-libs))})
+   :linked-libraries (if server?
+                       ["enet" "cgltf"]
+                       (vec (concat [glfw-lib
+                                     "ozz_animation_r"
+                                     "ozz_base_r"
+                                     "ozz_geometry_r"
+                                     "stb_all"
+                                     "enet"
+                                     "cgltf"
+                                     "engine_assets"]
+                                    opengl-libs)))})
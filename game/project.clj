@@ -5,7 +5,8 @@
   :plugins [[org.jank-lang/lein-jank "2026.06-1"]]
   :middleware [leiningen.jank/middleware]
   :source-paths ["src" "../engine/src"]
-  :main sca.baked
+  ;; bake --profile server sets JANK_BAKE_PROFILE to build the headless entry
+  :main ~(if (= "server" (System/getenv "JANK_BAKE_PROFILE")) 'sca.baked-server 'sca.baked)
   :jank #=(load-file "lein-jank-config.clj")
   :profiles {:release {:jank {:target-dir "target/release"
                               :optimization-level 3}}})
@@ -0,0 +1,186 @@
+// Unit tests for the movement kernel
+// Checks that pmove4 matches scalar pmove bit for bit, with and without
+// collision, across lane counts and hitch-length ticks
+
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include "sca/pmove_impl.h"
+
+// Test helpers
+
+// Deterministic so a failure reproduces
+struct Rng {
+    uint64_t state;
+    uint32_t next() {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        return (uint32_t)(state >> 33);
+    }
+    double uniform(double lo, double hi) { return lo + (hi - lo) * (next() / 2147483648.0); }
+    bool coin() { return (next() & 1) != 0; }
+};
+
+struct Input {
+    bool forward, backward, left, right, jump_held;
+    double yaw, dt;
+};
+
+Input random_input(Rng* rng) {
+    Input in;
+    in.forward = rng->coin();
+    in.backward = rng->next() % 4 == 0;
+    in.left = rng->coin();
+    in.right = rng->next() % 3 == 0;
+    in.jump_held = rng->next() % 3 == 0;
+    in.yaw = rng->uniform(-3.2, 3.2);
+    // Mostly 60 Hz, with the odd hitch that sub-steps
+    uint32_t pick = rng->next() % 8;
+    in.dt = pick == 0 ? rng->uniform(0.02, 0.2) : pick == 1 ? rng->uniform(0.001, 0.02) : 1.0 / 60.0;
+    return in;
+}
+
+pmove::PlayerMove random_player(Rng* rng) {
+    pmove::PlayerMove s;
+    s.px = rng->uniform(-6.0, 6.0);
+    s.py = rng->uniform(0.0, 3.0);
+    s.pz = rng->uniform(-6.0, 6.0);
+    s.vx = rng->uniform(-9.0, 9.0);
+    s.vy = rng->uniform(-5.0, 5.0);
+    s.vz = rng->uniform(-9.0, 9.0);
+    s.grounded = rng->coin();
+    return s;
+}
+
+// Exact, so -0.0 against 0.0 or a differently rounded last bit both fail
+bool same_move(const pmove::PlayerMove& a, const pmove::PlayerMove& b) {
+    return std::memcmp(&a.px, &b.px, sizeof(double)) == 0 &&
+           std::memcmp(&a.py, &b.py, sizeof(double)) == 0 &&
+           std::memcmp(&a.pz, &b.pz, sizeof(double)) == 0 &&
+           std::memcmp(&a.vx, &b.vx, sizeof(double)) == 0 &&
+           std::memcmp(&a.vy, &b.vy, sizeof(double)) == 0 &&
+           std::memcmp(&a.vz, &b.vz, sizeof(double)) == 0 &&
+           std::memcmp(&a.jump_z, &b.jump_z, sizeof(double)) == 0 &&
+           a.grounded == b.grounded && a.has_jump_z == b.has_jump_z && a.backflip == b.backflip;
+}
+
+void add_quad(ecol::Positions* positions, ecol::Indices* indices,
+              glm::vec3 a, glm::vec3 b, glm::vec3 c, glm::vec3 d) {
+    unsigned int base = (unsigned int)positions->size();
+    positions->push_back(a);
+    positions->push_back(b);
+    positions->push_back(c);
+    positions->push_back(d);
+    const unsigned int quad[] = {0, 1, 2, 0, 2, 3};
+    for (unsigned int i : quad) indices->push_back(base + i);
+}
+
+// A floor, a ramp steep enough to slide on, a low step and a wall
+void build_test_course(ecol::Positions* positions, ecol::Indices* indices) {
+    add_quad(positions, indices, {-10, 0, -10}, {-10, 0, 10}, {10, 0, 10}, {10, 0, -10});
+    add_quad(positions, indices, {2, 0, -4}, {2, 0, 4}, {6, 4.5f, 4}, {6, 4.5f, -4});
+    add_quad(positions, indices, {-6, 0.6f, -2}, {-6, 0.6f, 2}, {-3, 0.6f, 2}, {-3, 0.6f, -2});
+    add_quad(positions, indices, {-8, 0, 6}, {-8, 4, 6}, {8, 4, 6}, {8, 0, 6});
+}
+
+// Run ticks on count players both ways and compare after every tick.
+// Returns the number of player ticks compared.
+int compare_runs(uint64_t seed, int count, int ticks,
+                 ecol::Positions* positions, ecol::Indices* indices, ecol::Bvh* bvh) {
+    Rng rng{seed};
+    pmove::PlayerMove scalar[pmove::LANES];
+    pmove::PlayerMove wide[pmove::LANES];
+    ecol::ProbeCache scalar_cache[pmove::LANES];
+    ecol::ProbeCache wide_cache[pmove::LANES];
+    for (int k = 0; k < count; k++) scalar[k] = wide[k] = random_player(&rng);
+
+    int compared = 0;
+    for (int t = 0; t < ticks; t++) {
+        pmove::Move4 m;
+        m.count = count;
+        for (int k = 0; k < count; k++) {
+            Input in = random_input(&rng);
+            pmove::pmove(&scalar[k], positions, indices, bvh, positions ? &scalar_cache[k] : nullptr,
+                         in.forward, in.backward, in.left, in.right, in.jump_held, in.yaw, in.dt);
+            pmove::move4_set(&m, k, wide[k], in.forward, in.backward, in.left, in.right,
+                             in.jump_held, in.yaw, in.dt, positions ? &wide_cache[k] : nullptr);
+        }
+        pmove::pmove4(&m, positions, indices, bvh);
+        for (int k = 0; k < count; k++) {
+            pmove::move4_get(&m, k, &wide[k]);
+            if (!same_move(scalar[k], wide[k])) {
+                printf("FAILED (seed %llu, tick %d, lane %d)\n", (unsigned long long)seed, t, k);
+                fflush(stdout);
+                assert(false);
+            }
+            compared++;
+        }
+        // Respawn anyone who left the course so collision stays exercised
+        for (int k = 0; k < count; k++) {
+            if (scalar[k].py < -20.0 || scalar[k].px < -12.0 || scalar[k].px > 12.0 ||
+                scalar[k].pz < -12.0 || scalar[k].pz > 12.0) {
+                scalar[k] = wide[k] = random_player(&rng);
+            }
+        }
+    }
+    return compared;
+}
+
+// ============================================================================
+// Tests
+// ============================================================================
+
+void test_pmove4_matches_pmove_no_collision() {
+    printf("Test: pmove4 matches pmove exactly without collision... ");
+
+    for (uint64_t seed = 1; seed <= 16; seed++) {
+        assert(compare_runs(seed, pmove::LANES, 400, nullptr, nullptr, nullptr) == 400 * pmove::LANES);
+    }
+
+    printf("PASSED\n");
+}
+
+void test_pmove4_matches_pmove_on_course() {
+    printf("Test: pmove4 matches pmove exactly on a collision course... ");
+
+    ecol::Positions positions;
+    ecol::Indices indices;
+    build_test_course(&positions, &indices);
+    ecol::Bvh* bvh = ecol::build_bvh(&positions, &indices);
+    for (uint64_t seed = 1; seed <= 16; seed++) {
+        assert(compare_runs(seed, pmove::LANES, 400, &positions, &indices, bvh) == 400 * pmove::LANES);
+    }
+    ecol::destroy_bvh(bvh);
+
+    printf("PASSED\n");
+}
+
+void test_pmove4_partial_lanes() {
+    printf("Test: pmove4 with fewer than four lanes matches pmove... ");
+
+    ecol::Positions positions;
+    ecol::Indices indices;
+    build_test_course(&positions, &indices);
+    ecol::Bvh* bvh = ecol::build_bvh(&positions, &indices);
+    for (int count = 1; count < pmove::LANES; count++) {
+        assert(compare_runs(100 + count, count, 200, &positions, &indices, bvh) == 200 * count);
+    }
+    ecol::destroy_bvh(bvh);
+
+    printf("PASSED\n");
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+
+    printf("=== pmove Unit Tests ===\n\n");
+
+    test_pmove4_matches_pmove_no_collision();
+    test_pmove4_matches_pmove_on_course();
+    test_pmove4_partial_lanes();
+
+    printf("\n=== All Tests Complete ===\n");
+    return 0;
+}